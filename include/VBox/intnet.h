@@ -131,8 +131,11 @@ typedef struct INTNETBUF
     STAMCOUNTER     cStatLost;
     /** Number of bad frames (both rings). */
     STAMCOUNTER     cStatBadFrames;
-    /** Reserved for future use. */
-    STAMCOUNTER     aStatReserved[2];
+    /** Number of times the receiver was woken up (receive ring). */
+    STAMCOUNTER     cStatRecvWakeups;
+    /** Number of receive ring wakeups saved because the receiver wasn't
+     * waiting for the frames. */
+    STAMCOUNTER     cStatRecvWakeupsSaved;
     /** Reserved for future send profiling. */
     STAMPROFILE     StatSend1;
     /** Reserved for future send profiling. */
@@ -141,8 +144,23 @@ typedef struct INTNETBUF
     STAMPROFILE     StatRecv1;
     /** Reserved for future receive profiling. */
     STAMPROFILE     StatRecv2;
-    /** Reserved for future profiling. */
-    STAMPROFILE     StatReserved;
+    /** Number of frames dropped by the QoS rate limiter or priority policy
+     * (send ring). */
+    STAMCOUNTER     cStatQoSDrops;
+    /** Number of times the QoS rate limiter left frames in the send ring for
+     * later. */
+    STAMCOUNTER     cStatQoSDelays;
+    /** The receive ring event index.  The consumer sets this to the read
+     * offset it found the receive ring empty at before it goes to sleep, and the
+     * producers only signal it once Recv.offWriteCom has moved away from it.
+     * INTNETBUF_RECV_EVENT_NONE while nobody waits. */
+    uint32_t volatile offRecvEvent;
+    /** Reserved for future use. */
+    uint32_t        u32Reserved;
+    /** How long (in nanoseconds) until the QoS rate limiter lets the frames it
+     * left in the send ring thru.  Set by IntNetR0IfSend when it delays frames,
+     * so the producer knows when to try again. */
+    uint64_t volatile cNsQoSDelay;
 } INTNETBUF;
 AssertCompileSize(INTNETBUF, 320);
 AssertCompileMemberOffset(INTNETBUF, Recv, 16);
@@ -156,6 +174,10 @@ typedef INTNETBUF const *PCINTNETBUF;
 /** Magic number for INTNETBUF::u32Magic (Sir William Gerald Golding). */
 #define INTNETBUF_MAGIC             UINT32_C(0x19110919)
 
+/** INTNETBUF::offRecvEvent value telling the producers that the consumer isn't
+ * waiting. */
+#define INTNETBUF_RECV_EVENT_NONE   UINT32_MAX
+
 /**
  * Asserts the sanity of the specified INTNETBUF structure.
  */
@@ -1185,6 +1207,57 @@ typedef INTNETIFABORTWAITREQ *PINTNETIFABORTWAITREQ;
 INTNETR0DECL(int) IntNetR0IfAbortWaitReq(PSUPDRVSESSION pSession, PINTNETIFABORTWAITREQ pReq);
 
 
+/** @name Interface QoS priority classes (INTNETIFSETQOSREQ::uPriority).
+ * @{ */
+/** Bulk traffic.  Frames exceeding the rate limit are dropped, and the frames
+ * are dropped first when the ring of a receiver is running low on space. */
+#define INTNET_QOS_PRIORITY_LOW         UINT32_C(0)
+/** The default class.  Frames exceeding the rate limit are delayed. */
+#define INTNET_QOS_PRIORITY_NORMAL      UINT32_C(1)
+/** Latency sensitive traffic.  Frames are only dropped when the ring of a
+ * receiver is completely full. */
+#define INTNET_QOS_PRIORITY_HIGH        UINT32_C(2)
+/** The end of the valid priority classes. */
+#define INTNET_QOS_PRIORITY_END         UINT32_C(3)
+/** @} */
+
+/** The max length of a QoS bandwidth group name (INTNETIFSETQOSREQ::szGroup),
+ * including the terminator. */
+#define INTNET_MAX_QOS_GROUP_NAME       64
+
+/**
+ * Request buffer for IntNetR0IfSetQoSReq / VMMR0_DO_INTNET_IF_SET_QOS.
+ * @see IntNetR0IfSetQoS.
+ */
+typedef struct INTNETIFSETQOSREQ
+{
+    /** The request header. */
+    SUPVMMR0REQHDR  Hdr;
+    /** Alternative to passing the taking the session from the VM handle.
+     * Either use this member or use the VM handle, don't do both. */
+    PSUPDRVSESSION  pSession;
+    /** Handle to the interface. */
+    INTNETIFHANDLE  hIf;
+    /** The max number of frames per second the interface may send, 0 for no
+     * limit. */
+    uint32_t        cMaxFramesPerSec;
+    /** The max number of bytes per second the interface may send, 0 for no
+     * limit. */
+    uint64_t        cbMaxPerSec;
+    /** The priority class, INTNET_QOS_PRIORITY_XXX. */
+    uint32_t        uPriority;
+    /** The name of the bandwidth group the interface shares the rate limits
+     * with, empty if it has them for itself.  The interfaces of a session
+     * using the same name share one set of token buckets. */
+    char            szGroup[INTNET_MAX_QOS_GROUP_NAME];
+} INTNETIFSETQOSREQ;
+/** Pointer to an IntNetR0IfSetQoSReq / VMMR0_DO_INTNET_IF_SET_QOS request
+ *  buffer. */
+typedef INTNETIFSETQOSREQ *PINTNETIFSETQOSREQ;
+
+INTNETR0DECL(int) IntNetR0IfSetQoSReq(PSUPDRVSESSION pSession, PINTNETIFSETQOSREQ pReq);
+
+
 #if defined(IN_RING0) || defined(IN_INTNET_TESTCASE)
 /** @name
  * @{
@@ -1206,6 +1279,8 @@ INTNETR0DECL(int)       IntNetR0IfSetActive(INTNETIFHANDLE hIf, PSUPDRVSESSION p
 INTNETR0DECL(int)       IntNetR0IfSend(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession);
 INTNETR0DECL(int)       IntNetR0IfWait(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession, uint32_t cMillies);
 INTNETR0DECL(int)       IntNetR0IfAbortWait(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession);
+INTNETR0DECL(int)       IntNetR0IfSetQoS(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession, uint64_t cbMaxPerSec,
+                                         uint32_t cMaxFramesPerSec, uint32_t uPriority, const char *pszGroup);
 
 /** @} */
 #endif /* IN_RING0 */
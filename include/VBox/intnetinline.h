@@ -299,6 +299,31 @@ DECLINLINE(PINTNETHDR) IntNetRingGetNextFrameToRead(PINTNETRINGBUF pRingBuf)
 }
 
 
+/**
+ * Gets the frame following a frame that has not been skipped yet.
+ *
+ * This allows a reader to look at several frames before releasing their ring
+ * space with IntNetRingSkipFrame.
+ *
+ * @returns Pointer to the next frame.  NULL if @a pHdr is the last one.
+ * @param   pRingBuf        The ring buffer.
+ * @param   pHdr            A frame returned by IntNetRingGetNextFrameToRead or
+ *                          by this function.
+ */
+DECLINLINE(PINTNETHDR) IntNetRingGetFrameAfter(PINTNETRINGBUF pRingBuf, PCINTNETHDR pHdr)
+{
+    uint32_t const offWriteCom = ASMAtomicUoReadU32(&pRingBuf->offWriteCom);
+    uint32_t       offNext     = (uint32_t)((uintptr_t)pHdr - (uintptr_t)pRingBuf) + pHdr->offFrame + pHdr->cbFrame;
+    offNext = RT_ALIGN_32(offNext, INTNETHDR_ALIGNMENT);
+    Assert(offNext <= pRingBuf->offEnd && offNext >= pRingBuf->offStart);
+    if (offNext >= pRingBuf->offEnd)
+        offNext = pRingBuf->offStart;
+    if (offNext == offWriteCom)
+        return NULL;
+    return (PINTNETHDR)((uint8_t *)pRingBuf + offNext);
+}
+
+
 /**
  * Get the amount of data ready for reading.
  *
@@ -561,9 +586,10 @@ DECLINLINE(void) IntNetRingCommitFrame(PINTNETRINGBUF pRingBuf, PINTNETHDR pHdr)
         offWriteCom = pRingBuf->offStart;
     }
     Log2(("IntNetRingCommitFrame:   offWriteCom: %#x -> %#x (R=%#x T=%#x S=%#x)\n", pRingBuf->offWriteCom, offWriteCom, pRingBuf->offReadX, pHdr->u16Type, cbFrame));
-    ASMAtomicWriteU32(&pRingBuf->offWriteCom, offWriteCom);
+    /* (Statistics first, the next producer may commit once offWriteCom moves.) */
     STAM_REL_COUNTER_ADD(&pRingBuf->cbStatWritten, cbFrame);
     STAM_REL_COUNTER_INC(&pRingBuf->cStatFrames);
+    ASMAtomicWriteU32(&pRingBuf->offWriteCom, offWriteCom);
 }
 
 
@@ -619,9 +645,9 @@ DECLINLINE(void) IntNetRingCommitFrameEx(PINTNETRINGBUF pRingBuf, PINTNETHDR pHd
     }
 
     Log2(("IntNetRingCommitFrameEx:   offWriteCom: %#x -> %#x (R=%#x T=%#x S=%#x P=%#x)\n", pRingBuf->offWriteCom, offWriteCom, pRingBuf->offReadX, pHdr->u16Type, pHdr->cbFrame, cbAlignedFrame - cbAlignedUsed));
-    ASMAtomicWriteU32(&pRingBuf->offWriteCom, offWriteCom);
     STAM_REL_COUNTER_ADD(&pRingBuf->cbStatWritten, cbUsed);
     STAM_REL_COUNTER_INC(&pRingBuf->cStatFrames);
+    ASMAtomicWriteU32(&pRingBuf->offWriteCom, offWriteCom);
 }
 
 
@@ -805,6 +831,7 @@ DECLINLINE(void) IntNetBufInit(PINTNETBUF pIntBuf, uint32_t cbBuf, uint32_t cbRe
     pIntBuf->Recv.offWriteInt   = offBuf;
     pIntBuf->Recv.offWriteCom   = offBuf;
     pIntBuf->Recv.offEnd        = offBuf + cbRecv;
+    pIntBuf->offRecvEvent       = INTNETBUF_RECV_EVENT_NONE;
 
     /* send ring buffer. */
     offBuf += cbRecv + RT_OFFSETOF(INTNETBUF, Recv) - RT_OFFSETOF(INTNETBUF, Send);
@@ -147,6 +147,14 @@ VBOXDDU_DECL(int) VDDbgIoLogCommit(VDIOLOGGER hIoLogger);
  */
 VBOXDDU_DECL(uint32_t) VDDbgIoLogGetFlags(VDIOLOGGER hIoLogger);
 
+/**
+ * Returns whether the given I/O log contains start timestamps for the requests.
+ *
+ * @returns true if timestamps are available, false otherwise.
+ * @param   hIoLogger    The I/O logger to use.
+ */
+VBOXDDU_DECL(bool) VDDbgIoLogHasTimestamps(VDIOLOGGER hIoLogger);
+
 /**
  * Starts logging of an I/O request.
  *
@@ -258,6 +266,18 @@ VBOXDDU_DECL(int) VDDbgIoLogEventGetStartDiscard(VDIOLOGGER hIoLogger, uint64_t
 VBOXDDU_DECL(int) VDDbgIoLogEventGetComplete(VDIOLOGGER hIoLogger, uint64_t *pidEvent, int *pRc,
                                              uint64_t *pmsDuration, size_t *pcbIo, size_t cbBuf, void *pvBuf);
 
+/**
+ * Returns the start timestamp of the start event read last with
+ * VDDbgIoLogEventGetStart() or VDDbgIoLogEventGetStartDiscard().
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED if the log doesn't contain timestamps.
+ * @param   hIoLogger    The I/O logger to use.
+ * @param   pu64TsStart  Where to store the start timestamp in nanoseconds
+ *                       relative to the creation of the log.
+ */
+VBOXDDU_DECL(int) VDDbgIoLogEventGetStartTimestamp(VDIOLOGGER hIoLogger, uint64_t *pu64TsStart);
+
 /** @} */
 
 RT_C_DECLS_END
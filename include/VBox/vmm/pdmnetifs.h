@@ -103,6 +103,26 @@ DECLINLINE(void) PDMScatterGatherSetOwner(PPDMSCATTERGATHER pSgBuf, uint32_t uNe
 
 
 
+/**
+ * A frame passed to PDMINETWORKDOWN::pfnReceiveFrames.
+ */
+typedef struct PDMNETWORKFRAME
+{
+    /** The frame bits. */
+    const void     *pvBuf;
+    /** The frame size. */
+    size_t          cb;
+} PDMNETWORKFRAME;
+/** Pointer to a frame descriptor. */
+typedef PDMNETWORKFRAME *PPDMNETWORKFRAME;
+/** Pointer to a const frame descriptor. */
+typedef PDMNETWORKFRAME const *PCPDMNETWORKFRAME;
+
+/** The max number of frames or buffers passed to PDMINETWORKDOWN::pfnReceiveFrames
+ * and PDMINETWORKUP::pfnSendBufs in one call. */
+#define PDMNETWORK_MAX_BATCH                    32
+
+
 /** Pointer to a network port interface */
 typedef struct PDMINETWORKDOWN *PPDMINETWORKDOWN;
 /**
@@ -150,6 +170,34 @@ typedef struct PDMINETWORKDOWN
      */
     DECLR3CALLBACKMEMBER(int, pfnReceiveGso,(PPDMINETWORKDOWN pInterface, const void *pvBuf, size_t cb, PCPDMNETWORKGSO pGso));
 
+    /**
+     * Receive a batch of normal frames from the network.
+     *
+     * Equivalent to calling pfnReceive for each frame, except that the device
+     * enters its locks and notifies the guest once for the whole batch.  The
+     * frames are taken in order and the device stops at the first frame it has
+     * no receive buffer for.  Like with pfnReceive, pfnWaitReceiveAvail must
+     * have succeeded before the call.
+     *
+     * This method is optional, callers must fall back on pfnReceive if it is
+     * NULL.
+     *
+     * @returns VBox status code.
+     * @retval  VERR_NET_NO_BUFFER_SPACE if the device ran out of receive buffers
+     *          before all the frames were taken.
+     * @retval  Other failures are what pfnReceive returned for the last frame
+     *          taken, the device dropped that frame and stopped.
+     * @param   pInterface      Pointer to the interface structure containing the called function pointer.
+     * @param   paFrames        The frames, at most PDMNETWORK_MAX_BATCH.
+     * @param   pcFrames        On input the number of frames in @a paFrames, on
+     *                          output the number of frames taken (including
+     *                          the ones the device dropped because of its
+     *                          receive filter).
+     *
+     * @thread  Non-EMT.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnReceiveFrames,(PPDMINETWORKDOWN pInterface, PCPDMNETWORKFRAME paFrames, uint32_t *pcFrames));
+
     /**
      * Do pending transmit work on the leaf driver's XMIT thread.
      *
@@ -166,7 +214,7 @@ typedef struct PDMINETWORKDOWN
 
 } PDMINETWORKDOWN;
 /** PDMINETWORKDOWN interface ID. */
-#define PDMINETWORKDOWN_IID                     "52b8cdbb-a087-493b-baa7-81ec3b803e06"
+#define PDMINETWORKDOWN_IID                     "8778238c-b305-425c-a860-7fc7a07960cd"
 
 
 /**
@@ -287,6 +335,35 @@ typedef struct PDMINETWORKUP
      */
     DECLR3CALLBACKMEMBER(int, pfnSendBuf,(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER pSgBuf, bool fOnWorkerThread));
 
+    /**
+     * Send a batch of buffers to the network.
+     *
+     * Equivalent to calling pfnSendBuf for each buffer in order, except that the
+     * driver pushes them on with a single notification.  The buffers must have
+     * been allocated by pfnAllocBuf in the same transmit session and in the
+     * same order as they appear in @a papSgBufs.
+     *
+     * This method is optional and only available in ring-3, callers must fall
+     * back on pfnSendBuf if it is NULL.
+     *
+     * @retval  VINF_SUCCESS on success.
+     * @retval  VERR_NET_DOWN if the NIC is not connected to a network.
+     * @retval  VERR_NET_NO_BUFFER_SPACE if we're out of resources.
+     *
+     * @param   pInterface      Pointer to the interface structure containing the
+     *                          called function pointer.
+     * @param   papSgBufs       The buffers to send, at most PDMNETWORK_MAX_BATCH.
+     *                          The buffer ownership shall be 1.  All the buffers
+     *                          are consumed, regardless of the status code.
+     * @param   cSgBufs         The number of buffers in @a papSgBufs.
+     * @param   fOnWorkerThread Set if we're being called on a work thread.  Clear
+     *                          if an EMT.
+     *
+     * @thread  Any, but normally EMT or the XMIT thread.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnSendBufs,(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER *papSgBufs, uint32_t cSgBufs,
+                                           bool fOnWorkerThread));
+
     /**
      * Ends a transmit session.
      *
@@ -361,7 +438,7 @@ typedef struct PDMINETWORKUPRC
 } PDMINETWORKUPRC;
 
 /** PDMINETWORKUP interface ID. */
-#define PDMINETWORKUP_IID                       "67e7e7a8-2594-4649-a1e3-7cee680c6083"
+#define PDMINETWORKUP_IID                       "c22b4bbe-342b-4013-805d-6b0609d11049"
 /** PDMINETWORKUP interface method names. */
 #define PDMINETWORKUP_SYM_LIST                  "BeginXmit;AllocBuf;FreeBuf;SendBuf;EndXmit;SetPromiscuousMode"
 
@@ -570,6 +570,76 @@ DECLINLINE(uint32_t) PDMNetGsoCarveSegment(PCPDMNETWORKGSO pGso, const uint8_t *
 }
 
 
+/**
+ * Carves out the specified segment into a separate buffer.
+ *
+ * This is PDMNetGsoCarveSegment followed by copying the payload, only for TCP
+ * the payload is checksummed while it is being copied so it is read just once.
+ *
+ * @returns The size of the segment frame.
+ * @param   pGso                The GSO context data.
+ * @param   pbFrame             Pointer to the GSO frame.  The buffer is not
+ *                              modified.
+ * @param   cbFrame             The size of the GSO frame.
+ * @param   iSeg                The segment that we're carving out (0-based).
+ * @param   cSegs               The number of segments in the GSO frame.  Use
+ *                              PDMNetGsoCalcSegmentCount to find this.
+ * @param   pbSegFrame          Where to put the segment frame.  The buffer must
+ *                              be at least pGso->cbHdrsTotal + pGso->cbMaxSeg
+ *                              bytes.
+ */
+DECLINLINE(uint32_t) PDMNetGsoCarveSegmentCopy(PCPDMNETWORKGSO pGso, const uint8_t *pbFrame, size_t cbFrame,
+                                               uint32_t iSeg, uint32_t cSegs, uint8_t *pbSegFrame)
+{
+    uint32_t cbSegHdrs;
+    uint32_t cbSegPayload;
+    switch ((PDMNETWORKGSOTYPE)pGso->u8Type)
+    {
+        case PDMNETWORKGSOTYPE_IPV4_TCP:
+        case PDMNETWORKGSOTYPE_IPV6_TCP:
+        case PDMNETWORKGSOTYPE_IPV4_IPV6_TCP:
+        {
+            bool     fOdd = false;
+            uint32_t u32PayloadSum;
+            uint32_t u32PseudoSum;
+            cbSegHdrs     = pdmNetSegHdrLen(pGso, iSeg);
+            cbSegPayload  = pdmNetSegPayloadLen(pGso, iSeg, cSegs, (uint32_t)cbFrame);
+            Assert(iSeg < cSegs);
+            Assert(PDMNetGsoIsValid(pGso, sizeof(*pGso), cbFrame));
+
+            memcpy(pbSegFrame, pbFrame, pGso->cbHdrsTotal);
+            u32PayloadSum = RTNetIPv4AddDataChecksumAndCopy(pbSegFrame + cbSegHdrs, pbFrame + cbSegHdrs + iSeg * pGso->cbMaxSeg,
+                                                            cbSegPayload, 0, &fOdd);
+            if (pGso->u8Type == PDMNETWORKGSOTYPE_IPV4_TCP)
+                u32PseudoSum = pdmNetGsoUpdateIPv4Hdr(pbSegFrame, pGso->offHdr1, cbSegPayload, iSeg, cbSegHdrs);
+            else if (pGso->u8Type == PDMNETWORKGSOTYPE_IPV6_TCP)
+                u32PseudoSum = pdmNetGsoUpdateIPv6Hdr(pbSegFrame, pGso->offHdr1, cbSegPayload, cbSegHdrs,
+                                                      pGso->offHdr2, RTNETIPV4_PROT_TCP);
+            else
+            {
+                pdmNetGsoUpdateIPv4Hdr(pbSegFrame, pGso->offHdr1, cbSegPayload, iSeg, cbSegHdrs);
+                u32PseudoSum = pdmNetGsoUpdateIPv6Hdr(pbSegFrame, pgmNetGsoCalcIpv6Offset(pbSegFrame, pGso->offHdr1),
+                                                      cbSegPayload, cbSegHdrs, pGso->offHdr2, RTNETIPV4_PROT_TCP);
+            }
+
+            /* The payload sum rides along with the pseudo header sum. */
+            pdmNetGsoUpdateTcpHdr(u32PseudoSum + u32PayloadSum, pbSegFrame, pGso->offHdr2, NULL, 0, iSeg * pGso->cbMaxSeg,
+                                  cbSegHdrs, iSeg + 1 == cSegs, PDMNETCSUMTYPE_COMPLETE);
+            break;
+        }
+
+        default:
+        {
+            uint32_t offSegPayload = PDMNetGsoCarveSegment(pGso, pbFrame, cbFrame, iSeg, cSegs, pbSegFrame,
+                                                           &cbSegHdrs, &cbSegPayload);
+            memcpy(pbSegFrame + cbSegHdrs, pbFrame + offSegPayload, cbSegPayload);
+            break;
+        }
+    }
+    return cbSegHdrs + cbSegPayload;
+}
+
+
 /**
  * Prepares the GSO frame for direct use without any segmenting.
  *
@@ -430,6 +430,8 @@ typedef enum VMMR0OPERATION
     VMMR0_DO_INTNET_IF_WAIT,
     /** Call IntNetR0IfAbortWait(). */
     VMMR0_DO_INTNET_IF_ABORT_WAIT,
+    /** Call IntNetR0IfSetQoS(). */
+    VMMR0_DO_INTNET_IF_SET_QOS,
 
     /** Forward call to the PCI driver */
     VMMR0_DO_PCIRAW_REQ,
@@ -838,6 +838,7 @@
 # define RTMsgWarning                                   RT_MANGLER(RTMsgWarning)
 # define RTMsgWarningV                                  RT_MANGLER(RTMsgWarningV)
 # define RTNetIPv4AddDataChecksum                       RT_MANGLER(RTNetIPv4AddDataChecksum)
+# define RTNetIPv4AddDataChecksumAndCopy                RT_MANGLER(RTNetIPv4AddDataChecksumAndCopy)
 # define RTNetIPv4AddTCPChecksum                        RT_MANGLER(RTNetIPv4AddTCPChecksum)
 # define RTNetIPv4AddUDPChecksum                        RT_MANGLER(RTNetIPv4AddUDPChecksum)
 # define RTNetIPv4FinalizeChecksum                      RT_MANGLER(RTNetIPv4FinalizeChecksum)
@@ -58,6 +58,7 @@
 
 #include "DevEEPROM.h"
 #include "DevE1000Phy.h"
+#include "DevNetIntMod.h"
 
 /* Little helpers ************************************************************/
 #undef htons
@@ -166,6 +167,15 @@ struct E1kChips
 #define E1K_MAX_TX_PKT_SIZE    16288
 #define E1K_MAX_RX_PKT_SIZE    16384
 
+/* The number of transmit descriptors fetched from guest memory at once */
+#define E1K_TXD_CACHE_SIZE     32
+/* The number of receive descriptors fetched from guest memory at once */
+#define E1K_RXD_CACHE_SIZE     32
+
+/* Actions owed to the guest once the cached TX descriptors are written back */
+#define E1K_TXD_REPORT_INT     RT_BIT(0) /**< EOP+RS without IDE: raise TXDW. */
+#define E1K_TXD_REPORT_IDE     RT_BIT(1) /**< EOP+RS with IDE: arm delay timers. */
+
 /*****************************************************************************/
 
 /** Gets the specfieid bits from the register. */
@@ -921,6 +931,14 @@ struct E1kState_st
     PTMTIMERR3              pLUTimerR3;               /**< Link Up(/Restore) Timer. */
     /** The scatter / gather buffer used for the current outgoing packet - R3. */
     R3PTRTYPE(PPDMSCATTERGATHER) pTxSgR3;
+    /** Frames queued up for PDMINETWORKUP::pfnSendBufs - R3. */
+    R3PTRTYPE(PPDMSCATTERGATHER) apTxSgBatchR3[PDMNETWORK_MAX_BATCH];
+    /** Number of frames in apTxSgBatchR3. */
+    uint32_t                cTxSgBatchR3;
+    /** The fOnWorkerThread value to pass along with the batch. */
+    bool                    fTxSgBatchOnWorkerThreadR3;
+    /** Alignment padding (also covers PDMINETWORKDOWN on 32-bit hosts). */
+    bool                    afTxSgBatchAlignment[HC_ARCH_BITS == 64 ? 3 : 7];
 
     PPDMDEVINSR0            pDevInsR0;                   /**< Device instance - R0. */
     R0PTRTYPE(PPDMQUEUE)    pTxQueueR0;                   /**< Transmit queue - R0. */
@@ -1039,11 +1057,41 @@ struct E1kState_st
     E1KCHIP     eChip;
     uint32_t    alignmentFix;
 
+    /** TX: Transmit descriptors fetched from guest memory in one go. Only valid
+     *  while e1kXmitPending runs, hence not saved. */
+    E1KTXDESC   aTxDescriptors[E1K_TXD_CACHE_SIZE];
+    /** TX: Guest physical address of aTxDescriptors[0]. */
+    RTGCPHYS    GCPhysTxDCache;
+    /** TX: Number of valid entries in aTxDescriptors. */
+    uint8_t     nTxDFetched;
+    /** TX: Index of the next descriptor to process in aTxDescriptors. */
+    uint8_t     iTxDCurrent;
+    /** TX: First descriptor in aTxDescriptors awaiting write-back. */
+    uint8_t     iTxDWbFirst;
+    /** TX: Index past the last descriptor awaiting write-back. */
+    uint8_t     iTxDWbEnd;
+    /** TX: E1K_TXD_REPORT_XXX, what to tell the guest after the write-back. */
+    uint32_t    fTxDReport;
+    /** RX: Receive descriptors prefetched from guest memory, starting at RDH.
+     *  Invalidated whenever the guest moves the ring, not saved. */
+    E1KRXDESC   aRxDescriptors[E1K_RXD_CACHE_SIZE];
+    /** RX: Number of valid entries in aRxDescriptors. */
+    uint8_t     nRxDFetched;
+    /** RX: Index of the next descriptor to use in aRxDescriptors. */
+    uint8_t     iRxDCurrent;
+    /** RX: First descriptor in aRxDescriptors awaiting write-back, i.e. the one
+     *  RDH points to. */
+    uint8_t     iRxDWbFirst;
+    uint8_t     abRxDAlignment[5];
+
     /** EMT: EEPROM emulation */
     E1kEEPROM   eeprom;
     /** EMT: Physical interface emulation. */
     PHY         phy;
 
+    /** All: Adaptive interrupt moderation, see DevNetIntMod.h. */
+    NETINTMOD   IntMod;
+
 #if 0
     /** Alignment padding. */
     uint8_t                             Alignment[HC_ARCH_BITS == 64 ? 8 : 4];
@@ -1083,6 +1131,10 @@ struct E1kState_st
     STAMCOUNTER                         StatTxPathFallback;
     STAMCOUNTER                         StatTxPathGSO;
     STAMCOUNTER                         StatTxPathRegular;
+    STAMCOUNTER                         StatTxDescFetches;
+    STAMCOUNTER                         StatTxDescWriteBacks;
+    STAMCOUNTER                         StatRxDescFetches;
+    STAMCOUNTER                         StatRxDescWriteBacks;
     STAMCOUNTER                         StatPHYAccesses;
 
 #endif /* VBOX_WITH_STATISTICS || E1K_REL_STATS */
@@ -1146,6 +1198,7 @@ static int e1kRegWriteIMS          (E1KSTATE* pState, uint32_t offset, uint32_t
 static int e1kRegWriteIMC          (E1KSTATE* pState, uint32_t offset, uint32_t index, uint32_t u32Value);
 static int e1kRegWriteRCTL         (E1KSTATE* pState, uint32_t offset, uint32_t index, uint32_t u32Value);
 static int e1kRegWritePBA          (E1KSTATE* pState, uint32_t offset, uint32_t index, uint32_t u32Value);
+static int e1kRegWriteRxRing       (E1KSTATE* pState, uint32_t offset, uint32_t index, uint32_t u32Value);
 static int e1kRegWriteRDT          (E1KSTATE* pState, uint32_t offset, uint32_t index, uint32_t u32Value);
 static int e1kRegWriteRDTR         (E1KSTATE* pState, uint32_t offset, uint32_t index, uint32_t u32Value);
 static int e1kRegWriteTDT          (E1KSTATE* pState, uint32_t offset, uint32_t index, uint32_t u32Value);
@@ -1215,10 +1268,10 @@ const static struct E1kRegMap_st
     { 0x02420, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadUnimplemented, e1kRegWriteUnimplemented, "RDFHS"   , "Receive Data FIFO Head Saved Register" },
     { 0x02428, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadUnimplemented, e1kRegWriteUnimplemented, "RDFTS"   , "Receive Data FIFO Tail Saved Register" },
     { 0x02430, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadUnimplemented, e1kRegWriteUnimplemented, "RDFPC"   , "Receive Data FIFO Packet Count" },
-    { 0x02800, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadDefault      , e1kRegWriteDefault      , "RDBAL"   , "Receive Descriptor Base Low" },
-    { 0x02804, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadDefault      , e1kRegWriteDefault      , "RDBAH"   , "Receive Descriptor Base High" },
-    { 0x02808, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadDefault      , e1kRegWriteDefault      , "RDLEN"   , "Receive Descriptor Length" },
-    { 0x02810, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadDefault      , e1kRegWriteDefault      , "RDH"     , "Receive Descriptor Head" },
+    { 0x02800, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadDefault      , e1kRegWriteRxRing       , "RDBAL"   , "Receive Descriptor Base Low" },
+    { 0x02804, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadDefault      , e1kRegWriteRxRing       , "RDBAH"   , "Receive Descriptor Base High" },
+    { 0x02808, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadDefault      , e1kRegWriteRxRing       , "RDLEN"   , "Receive Descriptor Length" },
+    { 0x02810, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadDefault      , e1kRegWriteRxRing       , "RDH"     , "Receive Descriptor Head" },
     { 0x02818, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadDefault      , e1kRegWriteRDT          , "RDT"     , "Receive Descriptor Tail" },
     { 0x02820, 0x00004, 0x0000FFFF, 0x0000FFFF, e1kRegReadDefault      , e1kRegWriteRDTR         , "RDTR"    , "Receive Delay Timer" },
     { 0x02828, 0x00004, 0xFFFFFFFF, 0xFFFFFFFF, e1kRegReadUnimplemented, e1kRegWriteUnimplemented, "RXDCTL"  , "Receive Descriptor Control" },
@@ -1495,6 +1548,17 @@ DECLINLINE(void) e1kMutexRelease(E1KSTATE *pState)
 }
 
 #endif /* !E1K_GLOBAL_MUTEX */
+
+/**
+ * Drop the prefetched receive descriptors.
+ *
+ * @param   pState      The device state structure.
+ */
+DECLINLINE(void) e1kRxDInvalidate(E1KSTATE *pState)
+{
+    pState->nRxDFetched = pState->iRxDCurrent = pState->iRxDWbFirst = 0;
+}
+
 #ifdef IN_RING3
 
 /**
@@ -1533,6 +1597,7 @@ static void e1kHardReset(E1KSTATE *pState)
     TSPMT  = 0x01000400;/* TSMT=0400h TSPBP=0100h */
     Assert(GET_BITS(RCTL, BSIZE) == 0);
     pState->u16RxBSize = 2048;
+    e1kRxDInvalidate(pState);
 
     /* Reset promiscuous mode */
     if (pState->pDrvR3)
@@ -1766,8 +1831,19 @@ static int e1kRaiseInterrupt(E1KSTATE *pState, int rcBusy, uint32_t u32IntCause
         }
         else
         {
-#ifdef E1K_ITR_ENABLED
             uint64_t tstamp = TMTimerGet(pState->CTX_SUFF(pIntTimer));
+            /* Adaptive moderation takes the guest's ITR as the lower bound. */
+            uint64_t cNsDelay = netIntModDelay(&pState->IntMod, tstamp, ITR * 256);
+            if (cNsDelay)
+            {
+                /* Leave it to the late interrupt timer. */
+                if (!TMTimerIsActive(pState->CTX_SUFF(pIntTimer)))
+                    TMTimerSet(pState->CTX_SUFF(pIntTimer), tstamp + cNsDelay);
+                E1kLog2(("%s e1kRaiseInterrupt: Moderated, deliver in %llu ns.\n",
+                        INSTANCE(pState), cNsDelay));
+            }
+            else
+#ifdef E1K_ITR_ENABLED
             /* interrupts/sec = 1 / (256 * 10E-9 * ITR) */
             E1kLog2(("%s e1kRaiseInterrupt: tstamp - pState->u64AckedAt = %d, ITR * 256 = %d\n",
                         INSTANCE(pState), (uint32_t)(tstamp - pState->u64AckedAt), ITR * 256));
@@ -1785,6 +1861,7 @@ static int e1kRaiseInterrupt(E1KSTATE *pState, int rcBusy, uint32_t u32IntCause
                  * there is no need to do it later -- stop the timer.
                  */
                 TMTimerStop(pState->CTX_SUFF(pIntTimer));
+                netIntModDelivered(&pState->IntMod, tstamp);
                 E1K_INC_ISTAT_CNT(pState->uStatInt);
                 STAM_COUNTER_INC(&pState->StatIntsRaised);
                 /* Got at least one unmasked interrupt cause */
@@ -1862,14 +1939,84 @@ DECLINLINE(void) e1kAdvanceRDH(E1KSTATE *pState)
     //e1kCsLeave(pState);
 }
 
+/**
+ * Write back the receive descriptors used since the last call in one go and
+ * advance RDH past them.
+ *
+ * @remarks The caller holds csRx, RDH and the descriptor cache are shared with
+ *          the receive ring register handlers.
+ *
+ * @param   pState      The device state structure.
+ */
+static void e1kRxDWriteBack(E1KSTATE *pState)
+{
+    unsigned const iFirst = pState->iRxDWbFirst;
+    if (pState->iRxDCurrent <= iFirst)
+        return;
+
+    unsigned const cDescs = pState->iRxDCurrent - iFirst;
+    PDMDevHlpPhysWrite(pState->CTX_SUFF(pDevIns), e1kDescAddr(RDBAH, RDBAL, RDH),
+                       &pState->aRxDescriptors[iFirst], cDescs * sizeof(E1KRXDESC));
+    STAM_COUNTER_INC(&pState->StatRxDescWriteBacks);
+    pState->iRxDWbFirst = pState->iRxDCurrent;
+    for (unsigned i = iFirst; i < iFirst + cDescs; i++)
+    {
+        e1kPrintRDesc(pState, &pState->aRxDescriptors[i]);
+        E1kLogRel(("E1000: Wrote back RX desc, RDH=%x\n", RDH));
+        /* Advance head */
+        e1kAdvanceRDH(pState);
+    }
+}
+
+/**
+ * Get the next available receive descriptor.
+ *
+ * Descriptors are prefetched from guest memory starting at RDH, as many as
+ * the guest has made available up to the end of the ring, with a single
+ * physical read. The ones between RDH and RDT belong to us, so they stay
+ * valid until the guest moves the ring.
+ *
+ * @returns Pointer to the cached descriptor, NULL if the guest has not given
+ *          us any more.
+ * @param   pState      The device state structure.
+ */
+static E1KRXDESC *e1kRxDGet(E1KSTATE *pState)
+{
+    if (pState->iRxDCurrent >= pState->nRxDFetched)
+    {
+        /* RDH must catch up with the cache before we refill it. */
+        e1kRxDWriteBack(pState);
+        e1kRxDInvalidate(pState);
+
+        unsigned const cRing  = RDLEN / sizeof(E1KRXDESC);
+        unsigned       cDescs = 0;
+        if (RDH < cRing && RDH != RDT)
+            cDescs = (RDT > RDH && RDT <= cRing ? RDT : cRing) - RDH;
+        if (cDescs > E1K_RXD_CACHE_SIZE)
+            cDescs = E1K_RXD_CACHE_SIZE;
+        if (!cDescs)
+            return NULL;
+
+        PDMDevHlpPhysRead(pState->CTX_SUFF(pDevIns), e1kDescAddr(RDBAH, RDBAL, RDH),
+                          &pState->aRxDescriptors[0], cDescs * sizeof(E1KRXDESC));
+        pState->nRxDFetched = (uint8_t)cDescs;
+        STAM_COUNTER_INC(&pState->StatRxDescFetches);
+        E1kLog3(("%s e1kRxDGet: fetched %u descriptors at RDH=%x\n", INSTANCE(pState), cDescs, RDH));
+    }
+    return &pState->aRxDescriptors[pState->iRxDCurrent++];
+}
+
 /**
  * Store a fragment of received packet that fits into the next available RX
  * buffer.
  *
  * @remarks Trigger the RXT0 interrupt if it is the last fragment of the packet.
+ *          The descriptors used by the packet are written back along with the
+ *          last fragment. Called without csRx, it is only taken for the write
+ *          back.
  *
  * @param   pState          The device state structure.
- * @param   pDesc           The next available RX descriptor.
+ * @param   pDesc           The next available RX descriptor (cached).
  * @param   pvBuf           The fragment.
  * @param   cb              The size of the fragment.
  */
@@ -1879,15 +2026,16 @@ static DECLCALLBACK(void) e1kStoreRxFragment(E1KSTATE *pState, E1KRXDESC *pDesc,
     E1kLog2(("%s e1kStoreRxFragment: store fragment of %04X at %016LX, EOP=%d\n", pState->szInstance, cb, pDesc->u64BufAddr, pDesc->status.fEOP));
     PDMDevHlpPhysWrite(pState->CTX_SUFF(pDevIns), pDesc->u64BufAddr, pvBuf, cb);
     pDesc->u16Length = (uint16_t)cb;                        Assert(pDesc->u16Length == cb);
-    /* Write back the descriptor */
-    PDMDevHlpPhysWrite(pState->CTX_SUFF(pDevIns), e1kDescAddr(RDBAH, RDBAL, RDH), pDesc, sizeof(E1KRXDESC));
-    e1kPrintRDesc(pState, pDesc);
-    E1kLogRel(("E1000: Wrote back RX desc, RDH=%x\n", RDH));
-    /* Advance head */
-    e1kAdvanceRDH(pState);
     //E1kLog2(("%s e1kStoreRxFragment: EOP=%d RDTR=%08X RADV=%08X\n", INSTANCE(pState), pDesc->fEOP, RDTR, RADV));
     if (pDesc->status.fEOP)
     {
+        /* Write back the descriptors of the whole packet and advance head */
+        if (RT_LIKELY(e1kCsRxEnter(pState, VERR_SEM_BUSY) == VINF_SUCCESS))
+        {
+            e1kRxDWriteBack(pState);
+            e1kCsRxLeave(pState);
+        }
+
         /* Complete packet has been stored -- it is time to let the guest know. */
 #ifdef E1K_USE_RX_TIMERS
         if (RDTR)
@@ -2053,6 +2201,7 @@ static int e1kHandleRxPacket(E1KSTATE* pState, const void *pvBuf, size_t cb, E1K
         E1K_INC_CNT32(PRC1522);
 
     E1K_INC_ISTAT_CNT(pState->uStatRxFrm);
+    netIntModFrames(&pState->IntMod, 1);
 
     if (RDH == RDT)
     {
@@ -2060,18 +2209,16 @@ static int e1kHandleRxPacket(E1KSTATE* pState, const void *pvBuf, size_t cb, E1K
                 INSTANCE(pState)));
     }
     /* Store the packet to receive buffers */
-    while (RDH != RDT)
+    E1KRXDESC *pDesc;
+    while ((pDesc = e1kRxDGet(pState)) != NULL)
     {
-        /* Load the descriptor pointed by head */
-        E1KRXDESC desc;
-        PDMDevHlpPhysRead(pState->CTX_SUFF(pDevIns), e1kDescAddr(RDBAH, RDBAL, RDH),
-                          &desc, sizeof(desc));
-        if (desc.u64BufAddr)
+        /* The descriptor pointed by head (or following it) was loaded by e1kRxDGet */
+        if (pDesc->u64BufAddr)
         {
             /* Update descriptor */
-            desc.status        = status;
-            desc.u16Checksum   = checksum;
-            desc.status.fDD    = true;
+            pDesc->status        = status;
+            pDesc->u16Checksum   = checksum;
+            pDesc->status.fDD    = true;
 
             /*
              * We need to leave Rx critical section here or we risk deadlocking
@@ -2082,9 +2229,9 @@ static int e1kHandleRxPacket(E1KSTATE* pState, const void *pvBuf, size_t cb, E1K
              */
             if (cb > pState->u16RxBSize)
             {
-                desc.status.fEOP = false;
+                pDesc->status.fEOP = false;
                 e1kCsRxLeave(pState);
-                e1kStoreRxFragment(pState, &desc, ptr, pState->u16RxBSize);
+                e1kStoreRxFragment(pState, pDesc, ptr, pState->u16RxBSize);
                 rc = e1kCsRxEnter(pState, VERR_SEM_BUSY);
                 if (RT_UNLIKELY(rc != VINF_SUCCESS))
                     return rc;
@@ -2093,24 +2240,21 @@ static int e1kHandleRxPacket(E1KSTATE* pState, const void *pvBuf, size_t cb, E1K
             }
             else
             {
-                desc.status.fEOP = true;
+                pDesc->status.fEOP = true;
                 e1kCsRxLeave(pState);
-                e1kStoreRxFragment(pState, &desc, ptr, cb);
+                e1kStoreRxFragment(pState, pDesc, ptr, cb);
                 pState->led.Actual.s.fReading = 0;
                 return VINF_SUCCESS;
             }
-            /* Note: RDH is advanced by e1kStoreRxFragment! */
+            /* Note: RDH is advanced by e1kRxDWriteBack once the packet is complete! */
         }
         else
-        {
-            desc.status.fDD = true;
-            PDMDevHlpPhysWrite(pState->CTX_SUFF(pDevIns),
-                               e1kDescAddr(RDBAH, RDBAL, RDH),
-                                           &desc, sizeof(desc));
-            e1kAdvanceRDH(pState);
-        }
+            pDesc->status.fDD = true;
     }
 
+    /* Give back whatever the partially stored packet has used up. */
+    e1kRxDWriteBack(pState);
+
     if (cb > 0)
         E1kLog(("%s Out of receive buffers, dropping %u bytes", INSTANCE(pState), cb));
 
@@ -2619,6 +2763,34 @@ static int e1kRegWritePBA(E1KSTATE* pState, uint32_t offset, uint32_t index, uin
     return VINF_SUCCESS;
 }
 
+/**
+ * Write handler for the receive descriptor ring registers (RDBAL, RDBAH, RDLEN
+ * and RDH).
+ *
+ * Drops the prefetched receive descriptors as they may not match the ring any
+ * longer.
+ *
+ * @returns VBox status code.
+ *
+ * @param   pState      The device state structure.
+ * @param   offset      Register offset in memory-mapped frame.
+ * @param   index       Register index in register array.
+ * @param   value       The value to store.
+ * @param   mask        Used to implement partial writes (8 and 16-bit).
+ * @thread  EMT
+ */
+static int e1kRegWriteRxRing(E1KSTATE* pState, uint32_t offset, uint32_t index, uint32_t value)
+{
+    int rc = e1kCsRxEnter(pState, VINF_IOM_HC_MMIO_WRITE);
+    if (RT_LIKELY(rc == VINF_SUCCESS))
+    {
+        rc = e1kRegWriteDefault(pState, offset, index, value);
+        e1kRxDInvalidate(pState);
+        e1kCsRxLeave(pState);
+    }
+    return rc;
+}
+
 /**
  * Write handler for Receive Descriptor Tail register.
  *
@@ -3032,6 +3204,35 @@ DECLINLINE(bool) e1kCanDoGso(PCPDMNETWORKGSO pGso, E1KTXDAT const *pData, E1KTXC
     }
 }
 
+#ifdef IN_RING3
+/**
+ * Hands the queued up frames to the driver in one go.
+ *
+ * Must be called while owning the E1000 mutex, it is released while the
+ * driver is busy with the frames.
+ *
+ * @param   pState              The device state structure.
+ * @thread  E1000_TX
+ */
+static void e1kXmitFlushBatch(E1KSTATE *pState)
+{
+    uint32_t const cSgBufs = pState->cTxSgBatchR3;
+    if (!cSgBufs)
+        return;
+    pState->cTxSgBatchR3 = 0;
+
+    PPDMINETWORKUP pDrv = pState->pDrvR3;
+    /* Release critical section to avoid deadlock in CanReceive */
+    e1kMutexRelease(pState);
+    STAM_PROFILE_START(&pState->StatTransmitSendR3, a);
+    int rc = pDrv->pfnSendBufs(pDrv, &pState->apTxSgBatchR3[0], cSgBufs, pState->fTxSgBatchOnWorkerThreadR3);
+    STAM_PROFILE_STOP(&pState->StatTransmitSendR3, a);
+    e1kMutexAcquire(pState, VERR_SEM_BUSY, RT_SRC_POS);
+    if (RT_FAILURE(rc))
+        E1kLogRel(("E1000: ERROR! pfnSendBufs returned %Rrc\n", rc));
+}
+#endif /* IN_RING3 */
+
 /**
  * Frees the current xmit buffer.
  *
@@ -3040,6 +3241,11 @@ DECLINLINE(bool) e1kCanDoGso(PCPDMNETWORKGSO pGso, E1KTXDAT const *pData, E1KTXC
 static void e1kXmitFreeBuf(E1KSTATE *pState)
 {
     PPDMSCATTERGATHER pSg = pState->CTX_SUFF(pTxSg);
+#ifdef IN_RING3
+    /* Freeing commits the frame, so the queued ones must go first. */
+    if (pSg && pState->cTxSgBatchR3)
+        e1kXmitFlushBatch(pState);
+#endif
     if (pSg)
     {
         pState->CTX_SUFF(pTxSg) = NULL;
@@ -3096,6 +3302,14 @@ DECLINLINE(int) e1kXmitAllocBuf(E1KSTATE *pState, size_t cbMin, bool fExactSize,
         if (RT_UNLIKELY(!pDrv))
             return VERR_NET_DOWN;
         int rc = pDrv->pfnAllocBuf(pDrv, cbMin, fGso ? &pState->GsoCtx : NULL, &pSg);
+#ifdef IN_RING3
+        /* The queued frames may be holding the space we need. */
+        if (RT_FAILURE(rc) && pState->cTxSgBatchR3)
+        {
+            e1kXmitFlushBatch(pState);
+            rc = pDrv->pfnAllocBuf(pDrv, cbMin, fGso ? &pState->GsoCtx : NULL, &pSg);
+        }
+#endif
         if (RT_FAILURE(rc))
             return rc;
     }
@@ -3136,31 +3350,99 @@ DECLINLINE(bool) e1kXmitIsGsoBuf(PDMSCATTERGATHER const *pTxSg)
 }
 
 /**
- * Load transmit descriptor from guest memory.
+ * Fetch the next run of transmit descriptors into the cache.
+ *
+ * Reads as many descriptors as are pending between TDH and TDT (stopping at
+ * the end of the ring and at the cache size) with a single physical read.
+ * Pending write-backs of the previous run must have been flushed.
  *
+ * @returns Number of descriptors fetched.
  * @param   pState      The device state structure.
- * @param   pDesc       Pointer to descriptor union.
- * @param   addr        Physical address in guest context.
  * @thread  E1000_TX
  */
-DECLINLINE(void) e1kLoadDesc(E1KSTATE* pState, E1KTXDESC* pDesc, RTGCPHYS addr)
-{
-    PDMDevHlpPhysRead(pState->CTX_SUFF(pDevIns), addr, pDesc, sizeof(E1KTXDESC));
+static unsigned e1kTxDLoadMore(E1KSTATE* pState)
+{
+    Assert(pState->iTxDWbEnd <= pState->iTxDWbFirst);
+    unsigned const cRing  = TDLEN / sizeof(E1KTXDESC);
+    unsigned       cDescs = 0;
+    if (TDH < cRing && TDH != TDT)
+        cDescs = (TDT > TDH && TDT <= cRing ? TDT : cRing) - TDH;
+    if (cDescs > E1K_TXD_CACHE_SIZE)
+        cDescs = E1K_TXD_CACHE_SIZE;
+
+    pState->GCPhysTxDCache = ((uint64_t)TDBAH << 32) + TDBAL + TDH * sizeof(E1KTXDESC);
+    pState->nTxDFetched    = (uint8_t)cDescs;
+    pState->iTxDCurrent    = 0;
+    pState->iTxDWbFirst    = 0;
+    pState->iTxDWbEnd      = 0;
+    if (cDescs)
+    {
+        PDMDevHlpPhysRead(pState->CTX_SUFF(pDevIns), pState->GCPhysTxDCache,
+                          &pState->aTxDescriptors[0], cDescs * sizeof(E1KTXDESC));
+        STAM_COUNTER_INC(&pState->StatTxDescFetches);
+    }
+    E1kLog3(("%s e1kTxDLoadMore: fetched %u descriptors at TDH=%08x\n", INSTANCE(pState), cDescs, TDH));
+    return cDescs;
 }
 
 /**
- * Write back transmit descriptor to guest memory.
+ * Write back the transmit descriptors marked done since the last call and
+ * notify the guest about them.
+ *
+ * All descriptors between the first and the last one with RS set go out in a
+ * single physical write. The ones in between without RS are written back
+ * exactly as fetched, so the guest does not see any change in them. The
+ * interrupt (or the delay timers) is only triggered once the descriptors are
+ * in guest memory.
  *
  * @param   pState      The device state structure.
- * @param   pDesc       Pointer to descriptor union.
- * @param   addr        Physical address in guest context.
  * @thread  E1000_TX
  */
-DECLINLINE(void) e1kWriteBackDesc(E1KSTATE* pState, E1KTXDESC* pDesc, RTGCPHYS addr)
+static void e1kTxDWriteBack(E1KSTATE* pState)
 {
-    /* Only the last half of the descriptor has to be written back. */
-    e1kPrintTDesc(pState, pDesc, "^^^");
-    PDMDevHlpPhysWrite(pState->CTX_SUFF(pDevIns), addr, pDesc, sizeof(E1KTXDESC));
+    if (pState->iTxDWbEnd > pState->iTxDWbFirst)
+    {
+        unsigned const iFirst = pState->iTxDWbFirst;
+        unsigned const cDescs = pState->iTxDWbEnd - iFirst;
+        for (unsigned i = iFirst; i < iFirst + cDescs; i++)
+            e1kPrintTDesc(pState, &pState->aTxDescriptors[i], "^^^");
+        PDMDevHlpPhysWrite(pState->CTX_SUFF(pDevIns), pState->GCPhysTxDCache + iFirst * sizeof(E1KTXDESC),
+                           &pState->aTxDescriptors[iFirst], cDescs * sizeof(E1KTXDESC));
+        STAM_COUNTER_INC(&pState->StatTxDescWriteBacks);
+    }
+    pState->iTxDWbFirst = pState->iTxDWbEnd = 0;
+
+    uint32_t const fReport = pState->fTxDReport;
+    pState->fTxDReport = 0;
+#ifdef E1K_USE_TX_TIMERS
+    if (fReport == E1K_TXD_REPORT_IDE)
+    {
+        E1K_INC_ISTAT_CNT(pState->uStatTxIDE);
+        /* Arm the timer to fire in TIVD usec (discard .024) */
+        e1kArmTimer(pState, pState->CTX_SUFF(pTIDTimer), TIDV);
+# ifndef E1K_NO_TAD
+        /* If absolute timer delay is enabled and the timer is not running yet, arm it. */
+        E1kLog2(("%s Checking if TAD timer is running\n",
+                 INSTANCE(pState)));
+        if (TADV != 0 && !TMTimerIsActive(pState->CTX_SUFF(pTADTimer)))
+            e1kArmTimer(pState, pState->CTX_SUFF(pTADTimer), TADV);
+# endif /* E1K_NO_TAD */
+    }
+    else if (fReport)
+    {
+        E1kLog2(("%s No IDE set, cancel TAD timer and raise interrupt\n",
+                INSTANCE(pState)));
+# ifndef E1K_NO_TAD
+        /* Cancel both timers if armed and fire immediately. */
+        e1kCancelTimer(pState, pState->CTX_SUFF(pTADTimer));
+# endif /* E1K_NO_TAD */
+#else  /* !E1K_USE_TX_TIMERS */
+    if (fReport)
+    {
+#endif /* !E1K_USE_TX_TIMERS */
+        E1K_INC_ISTAT_CNT(pState->uStatIntTx);
+        e1kRaiseInterrupt(pState, VERR_SEM_BUSY, ICR_TXDW);
+    }
 }
 
 /**
@@ -3213,6 +3495,7 @@ static void e1kTransmitFrame(E1KSTATE* pState, bool fOnWorkerThread)
         E1K_INC_CNT32(PTC1522);
 
     E1K_INC_ISTAT_CNT(pState->uStatTxFrm);
+    netIntModFrames(&pState->IntMod, 1);
 
     /*
      * Dump and send the packet.
@@ -3224,6 +3507,18 @@ static void e1kTransmitFrame(E1KSTATE* pState, bool fOnWorkerThread)
 
         pState->CTX_SUFF(pTxSg) = NULL;
         PPDMINETWORKUP pDrv = pState->CTX_SUFF(pDrv);
+#ifdef IN_RING3
+        if (pDrv && pDrv->pfnSendBufs)
+        {
+            /* Queue it up, e1kXmitPending hands the batch to the driver. */
+            pState->apTxSgBatchR3[pState->cTxSgBatchR3++] = pSg;
+            pState->fTxSgBatchOnWorkerThreadR3 = fOnWorkerThread;
+            if (pState->cTxSgBatchR3 >= RT_ELEMENTS(pState->apTxSgBatchR3))
+                e1kXmitFlushBatch(pState);
+            rc = VINF_SUCCESS;
+        }
+        else
+#endif
         if (pDrv)
         {
             /* Release critical section to avoid deadlock in CanReceive */
@@ -3526,7 +3821,11 @@ static bool e1kAddToFrame(E1KSTATE *pThis, RTGCPHYS PhysAddr, uint32_t cbFragmen
 
 
 /**
- * Write the descriptor back to guest memory and notify the guest.
+ * Mark the descriptor done and schedule its write-back and the guest
+ * notification.
+ *
+ * The write-back itself happens in e1kTxDWriteBack, once per run of cached
+ * descriptors.
  *
  * @param   pState      The device state structure.
  * @param   pDesc       Pointer to the descriptor have been transmitted.
@@ -3536,8 +3835,8 @@ static bool e1kAddToFrame(E1KSTATE *pThis, RTGCPHYS PhysAddr, uint32_t cbFragmen
 static void e1kDescReport(E1KSTATE* pState, E1KTXDESC* pDesc, RTGCPHYS addr)
 {
     /*
-     * We fake descriptor write-back bursting. Descriptors are written back as they are
-     * processed.
+     * We fake descriptor write-back bursting. Descriptors are written back
+     * by e1kTxDWriteBack once the fetched run has been processed.
      */
     /* Let's pretend we process descriptors. Write back with DD set. */
     /*
@@ -3551,48 +3850,23 @@ static void e1kDescReport(E1KSTATE* pState, E1KTXDESC* pDesc, RTGCPHYS addr)
      * which is a little bit different from what the real hardware does in
      * case there is a chain of data descritors where some of them have RS set
      * and others do not. It is very uncommon scenario imho.
+     * Descriptors without RS that happen to sit between two reported ones are
+     * rewritten with their original contents, DD stays clear in them.
      */
     if (pDesc->legacy.cmd.fRS)
     {
+        unsigned const i = pState->iTxDCurrent;
+        Assert(i < pState->nTxDFetched);
+        Assert(pState->GCPhysTxDCache + i * sizeof(E1KTXDESC) == addr); NOREF(addr);
+
         pDesc->legacy.dw3.fDD = 1; /* Descriptor Done */
-        e1kWriteBackDesc(pState, pDesc, addr);
+        pState->aTxDescriptors[i].legacy.dw3.fDD = 1;
+        if (pState->iTxDWbEnd <= pState->iTxDWbFirst)
+            pState->iTxDWbFirst = (uint8_t)i;
+        pState->iTxDWbEnd = (uint8_t)(i + 1);
+
         if (pDesc->legacy.cmd.fEOP)
-        {
-#ifdef E1K_USE_TX_TIMERS
-            if (pDesc->legacy.cmd.fIDE)
-            {
-                E1K_INC_ISTAT_CNT(pState->uStatTxIDE);
-                //if (pState->fIntRaised)
-                //{
-                //    /* Interrupt is already pending, no need for timers */
-                //    ICR |= ICR_TXDW;
-                //}
-                //else {
-                /* Arm the timer to fire in TIVD usec (discard .024) */
-                e1kArmTimer(pState, pState->CTX_SUFF(pTIDTimer), TIDV);
-# ifndef E1K_NO_TAD
-                /* If absolute timer delay is enabled and the timer is not running yet, arm it. */
-                E1kLog2(("%s Checking if TAD timer is running\n",
-                         INSTANCE(pState)));
-                if (TADV != 0 && !TMTimerIsActive(pState->CTX_SUFF(pTADTimer)))
-                    e1kArmTimer(pState, pState->CTX_SUFF(pTADTimer), TADV);
-# endif /* E1K_NO_TAD */
-            }
-            else
-            {
-                E1kLog2(("%s No IDE set, cancel TAD timer and raise interrupt\n",
-                        INSTANCE(pState)));
-# ifndef E1K_NO_TAD
-                /* Cancel both timers if armed and fire immediately. */
-                e1kCancelTimer(pState, pState->CTX_SUFF(pTADTimer));
-# endif /* E1K_NO_TAD */
-#endif /* E1K_USE_TX_TIMERS */
-                E1K_INC_ISTAT_CNT(pState->uStatIntTx);
-                e1kRaiseInterrupt(pState, VERR_SEM_BUSY, ICR_TXDW);
-#ifdef E1K_USE_TX_TIMERS
-            }
-#endif /* E1K_USE_TX_TIMERS */
-        }
+            pState->fTxDReport |= pDesc->legacy.cmd.fIDE ? E1K_TXD_REPORT_IDE : E1K_TXD_REPORT_INT;
     }
     else
     {
@@ -3827,17 +4101,30 @@ static int e1kXmitPending(E1KSTATE *pState, bool fOnWorkerThread)
     if (RT_SUCCESS(rc))
     {
         /*
-         * Process all pending descriptors.
+         * Process all pending descriptors, fetching them from guest memory a
+         * run at a time.
          * Note! Do not process descriptors in locked state
          */
+        pState->nTxDFetched = pState->iTxDCurrent = 0;
+        pState->iTxDWbFirst = pState->iTxDWbEnd   = 0;
+        pState->fTxDReport  = 0;
         while (TDH != TDT && !pState->fLocked)
         {
-            E1KTXDESC desc;
+            if (pState->iTxDCurrent >= pState->nTxDFetched)
+            {
+                e1kTxDWriteBack(pState);
+                if (!e1kTxDLoadMore(pState))
+                    break;
+            }
+
+            /* Work on a copy, the cached one is written back as fetched (plus DD). */
+            E1KTXDESC desc = pState->aTxDescriptors[pState->iTxDCurrent];
+            RTGCPHYS const addr = pState->GCPhysTxDCache + pState->iTxDCurrent * sizeof(desc);
             E1kLog3(("%s About to process new TX descriptor at %08x%08x, TDLEN=%08x, TDH=%08x, TDT=%08x\n",
                      INSTANCE(pState), TDBAH, TDBAL + TDH * sizeof(desc), TDLEN, TDH, TDT));
 
-            e1kLoadDesc(pState, &desc, ((uint64_t)TDBAH << 32) + TDBAL + TDH * sizeof(desc));
-            e1kXmitDesc(pState, &desc, ((uint64_t)TDBAH << 32) + TDBAL + TDH * sizeof(desc), fOnWorkerThread);
+            e1kXmitDesc(pState, &desc, addr, fOnWorkerThread);
+            pState->iTxDCurrent++;
             if (++TDH * sizeof(desc) >= TDLEN)
                 TDH = 0;
 
@@ -3851,6 +4138,19 @@ static int e1kXmitPending(E1KSTATE *pState, bool fOnWorkerThread)
             STAM_PROFILE_ADV_STOP(&pState->CTX_SUFF_Z(StatTransmit), a);
         }
 
+        /*
+         * Write back what is left and let the guest know. This must happen
+         * before we drop the lock, the guest may not see TDH move past a
+         * descriptor that is still pending write-back.
+         */
+        e1kTxDWriteBack(pState);
+        pState->nTxDFetched = pState->iTxDCurrent = 0;
+
+#ifdef IN_RING3
+        /* Hand what's left of the batch to the driver. */
+        e1kXmitFlushBatch(pState);
+#endif
+
         /// @todo: uncomment: pState->uStatIntTXQE++;
         /// @todo: uncomment: e1kRaiseInterrupt(pState, ICR_TXQE);
 
@@ -4659,22 +4959,16 @@ static DECLCALLBACK(int) e1kMap(PPCIDEVICE pPciDev, int iRegion,
 }
 
 /**
- * Check if the device can receive data now.
- * This must be called before the pfnRecieve() method is called.
+ * Works out how much receive buffer space the guest has given us.
  *
  * @returns Number of bytes the device can receive.
- * @param   pInterface      Pointer to the interface structure containing the called function pointer.
- * @thread  EMT
+ * @param   pState          The device state structure.
+ * @remarks The caller owns the E1000 mutex and the RX critical section.
  */
-static int e1kCanReceive(E1KSTATE *pState)
+static size_t e1kRxBufferSpace(E1KSTATE *pState)
 {
     size_t cb;
 
-    if (RT_UNLIKELY(e1kMutexAcquire(pState, VERR_SEM_BUSY, RT_SRC_POS) != VINF_SUCCESS))
-        return VERR_NET_NO_BUFFER_SPACE;
-    if (RT_UNLIKELY(e1kCsRxEnter(pState, VERR_SEM_BUSY) != VINF_SUCCESS))
-        return VERR_NET_NO_BUFFER_SPACE;
-
     if (RT_UNLIKELY(RDLEN == sizeof(E1KRXDESC)))
     {
         E1KRXDESC desc;
@@ -4694,8 +4988,29 @@ static int e1kCanReceive(E1KSTATE *pState)
         cb = 0;
         E1kLogRel(("E1000: OUT of RX descriptors!\n"));
     }
-    E1kLog2(("%s e1kCanReceive: at exit RDH=%d RDT=%d RDLEN=%d u16RxBSize=%d cb=%lu\n",
+    E1kLog2(("%s e1kRxBufferSpace: RDH=%d RDT=%d RDLEN=%d u16RxBSize=%d cb=%lu\n",
              INSTANCE(pState), RDH, RDT, RDLEN, pState->u16RxBSize, cb));
+    return cb;
+}
+
+/**
+ * Check if the device can receive data now.
+ * This must be called before the pfnRecieve() method is called.
+ *
+ * @returns VINF_SUCCESS or VERR_NET_NO_BUFFER_SPACE.
+ * @param   pState          The device state structure.
+ * @thread  EMT
+ */
+static int e1kCanReceive(E1KSTATE *pState)
+{
+    size_t cb;
+
+    if (RT_UNLIKELY(e1kMutexAcquire(pState, VERR_SEM_BUSY, RT_SRC_POS) != VINF_SUCCESS))
+        return VERR_NET_NO_BUFFER_SPACE;
+    if (RT_UNLIKELY(e1kCsRxEnter(pState, VERR_SEM_BUSY) != VINF_SUCCESS))
+        return VERR_NET_NO_BUFFER_SPACE;
+
+    cb = e1kRxBufferSpace(pState);
 
     e1kCsRxLeave(pState);
     e1kMutexRelease(pState);
@@ -4961,6 +5276,95 @@ static DECLCALLBACK(int) e1kNetworkDown_Receive(PPDMINETWORKDOWN pInterface, con
     return rc;
 }
 
+/**
+ * @interface_method_impl{PDMINETWORKDOWN,pfnReceiveFrames}
+ */
+static DECLCALLBACK(int) e1kNetworkDown_ReceiveFrames(PPDMINETWORKDOWN pInterface, PCPDMNETWORKFRAME paFrames,
+                                                      uint32_t *pcFrames)
+{
+    E1KSTATE *pState  = RT_FROM_MEMBER(pInterface, E1KSTATE, INetworkDown);
+    uint32_t  cFrames = *pcFrames;
+    uint32_t  iFrame  = 0;
+    int       rc      = VINF_SUCCESS;
+
+    /*
+     * Drop packets if the VM is not running yet/anymore.
+     */
+    VMSTATE enmVMState = PDMDevHlpVMState(STATE_TO_DEVINS(pState));
+    if (    enmVMState != VMSTATE_RUNNING
+        &&  enmVMState != VMSTATE_RUNNING_LS)
+    {
+        E1kLog(("%s Dropping %u incoming packets as VM is not running.\n", INSTANCE(pState), cFrames));
+        return VINF_SUCCESS;
+    }
+
+    /* Discard incoming packets in locked state */
+    if (!(RCTL & RCTL_EN) || pState->fLocked || !(STATUS & STATUS_LU))
+    {
+        E1kLog(("%s Dropping %u incoming packets as receive operation is disabled.\n", INSTANCE(pState), cFrames));
+        return VINF_SUCCESS;
+    }
+
+    /*
+     * Take the mutex once for the whole batch and stop as soon as the guest
+     * runs out of receive descriptors, the caller keeps the rest.
+     */
+    STAM_PROFILE_ADV_START(&pState->StatReceive, a);
+    rc = e1kMutexAcquire(pState, VERR_SEM_BUSY, RT_SRC_POS);
+    if (RT_LIKELY(rc == VINF_SUCCESS))
+    {
+        for (; iFrame < cFrames; iFrame++)
+        {
+            const void *pvBuf = paFrames[iFrame].pvBuf;
+            size_t      cb    = paFrames[iFrame].cb;
+
+            if (iFrame > 0)
+            {
+                size_t cbAvail = 0;
+                if (RT_LIKELY(e1kCsRxEnter(pState, VERR_SEM_BUSY) == VINF_SUCCESS))
+                {
+                    cbAvail = e1kRxBufferSpace(pState);
+                    e1kCsRxLeave(pState);
+                }
+                if (!cbAvail)
+                {
+                    rc = VERR_NET_NO_BUFFER_SPACE;
+                    break;
+                }
+            }
+
+            e1kPacketDump(pState, (const uint8_t*)pvBuf, cb, "<-- Incoming");
+
+            /* Update stats */
+            if (RT_LIKELY(e1kCsEnter(pState, VERR_SEM_BUSY) == VINF_SUCCESS))
+            {
+                E1K_INC_CNT32(TPR);
+                E1K_ADD_CNT64(TORL, TORH, cb < 64? 64 : cb);
+                e1kCsLeave(pState);
+            }
+            STAM_PROFILE_ADV_START(&pState->StatReceiveFilter, a);
+            E1KRXDST status;
+            RT_ZERO(status);
+            bool fPassed = e1kAddressFilter(pState, pvBuf, cb, &status);
+            STAM_PROFILE_ADV_STOP(&pState->StatReceiveFilter, a);
+            if (fPassed)
+            {
+                rc = e1kHandleRxPacket(pState, pvBuf, cb, status);
+                if (RT_FAILURE(rc))
+                {
+                    iFrame++;
+                    break;
+                }
+            }
+        }
+        e1kMutexRelease(pState);
+    }
+    STAM_PROFILE_ADV_STOP(&pState->StatReceive, a);
+
+    *pcFrames = iFrame;
+    return rc;
+}
+
 /**
  * Gets the pointer to the status LED of a unit.
  *
@@ -5289,6 +5693,7 @@ static DECLCALLBACK(int) e1kLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint32
 
         /* derived state  */
         e1kSetupGsoCtx(&pState->GsoCtx, &pState->contextTSE);
+        e1kRxDInvalidate(pState);
 
         E1kLog(("%s State has been restored\n", INSTANCE(pState)));
         e1kDumpState(pState);
@@ -5331,6 +5736,16 @@ static DECLCALLBACK(int) e1kLoadDone(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
         /* Restore the link back in five seconds. */
         e1kArmTimer(pState, pState->pLUTimerR3, 5000000);
     }
+    /*
+     * An interrupt adaptive moderation left to the late interrupt timer is
+     * not saved, deliver it now. Without moderation a pending cause that is
+     * not raised was held back by the guest's ITR and gets delivered with the
+     * next event like before the save.
+     */
+    else if (   pState->IntMod.fEnabled
+             && (ICR & IMS)
+             && !pState->fIntRaised)
+        e1kRaiseInterrupt(pState, VERR_SEM_BUSY);
     e1kMutexRelease(pState);
     return VINF_SUCCESS;
 }
@@ -5682,7 +6097,8 @@ static DECLCALLBACK(int) e1kConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
     /*
      * Validate configuration.
      */
-    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "AdapterType\0" "LineSpeed\0"))
+    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "AdapterType\0" "LineSpeed\0"
+                                    "AdaptiveIntModeration\0"))
         return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
                                 N_("Invalid configuration for E1000 device"));
 
@@ -5703,6 +6119,11 @@ static DECLCALLBACK(int) e1kConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
         return PDMDEV_SET_ERROR(pDevIns, rc,
                                 N_("Configuration error: Failed to get the value of 'AdapterType'"));
     Assert(pState->eChip <= E1K_CHIP_82545EM);
+    bool fAdaptiveIntMod;
+    rc = CFGMR3QueryBoolDef(pCfg, "AdaptiveIntModeration", &fAdaptiveIntMod, false);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'AdaptiveIntModeration'"));
 
     E1kLog(("%s Chip=%s\n", INSTANCE(pState), g_Chips[pState->eChip].pcszName));
 
@@ -5721,6 +6142,7 @@ static DECLCALLBACK(int) e1kConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
     pState->u64AckedAt   = 0;
     pState->led.u32Magic = PDMLED_MAGIC;
     pState->u32PktNo     = 1;
+    netIntModInit(&pState->IntMod, fAdaptiveIntMod);
 
 #ifdef E1K_INT_STATS
     pState->uStatInt = 0;
@@ -5757,6 +6179,7 @@ static DECLCALLBACK(int) e1kConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
 
     pState->INetworkDown.pfnWaitReceiveAvail = e1kNetworkDown_WaitReceiveAvail;
     pState->INetworkDown.pfnReceive          = e1kNetworkDown_Receive;
+    pState->INetworkDown.pfnReceiveFrames    = e1kNetworkDown_ReceiveFrames;
     pState->INetworkDown.pfnXmitPending      = e1kNetworkDown_XmitPending;
 
     pState->ILeds.pfnQueryStatusLed          = e1kQueryStatusLed;
@@ -5957,6 +6380,12 @@ static DECLCALLBACK(int) e1kConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatRxOverflowWakeup,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Nr of RX overflow wakeups",          "/Devices/E1k%d/RxOverflowWakeup", iInstance);
 #endif /* VBOX_WITH_STATISTICS || E1K_REL_STATS */
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatReceiveBytes,       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,          "Amount of data received",            "/Devices/E1k%d/ReceiveBytes", iInstance);
+    if (pState->IntMod.fEnabled)
+    {
+        PDMDevHlpSTAMRegisterF(pDevIns, &pState->IntMod.cIntsPerSec,   STAMTYPE_U32,     STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Interrupts per second",              "/Devices/E1k%d/IntMod/IntsPerSec", iInstance);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pState->IntMod.cFramesPerInt, STAMTYPE_U32,     STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Frames per interrupt",               "/Devices/E1k%d/IntMod/FramesPerInt", iInstance);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pState->IntMod.StatDeferred,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Interrupts held back by moderation", "/Devices/E1k%d/IntMod/Deferred", iInstance);
+    }
 #if defined(VBOX_WITH_STATISTICS) || defined(E1K_REL_STATS)
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatTransmitRZ,         STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling transmits in RZ",          "/Devices/E1k%d/Transmit/TotalRZ", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatTransmitR3,         STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling transmits in R3",          "/Devices/E1k%d/Transmit/TotalR3", iInstance);
@@ -5974,6 +6403,10 @@ static DECLCALLBACK(int) e1kConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatTxPathFallback,     STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Fallback TSE descriptor path",       "/Devices/E1k%d/TxPath/Fallback", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatTxPathGSO,          STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "GSO TSE descriptor path",            "/Devices/E1k%d/TxPath/GSO", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatTxPathRegular,      STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Regular descriptor path",            "/Devices/E1k%d/TxPath/Normal", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatTxDescFetches,      STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Bulk TX descriptor reads",           "/Devices/E1k%d/TxDesc/Fetches", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatTxDescWriteBacks,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Bulk TX descriptor write-backs",     "/Devices/E1k%d/TxDesc/WriteBacks", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatRxDescFetches,      STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Bulk RX descriptor reads",           "/Devices/E1k%d/RxDesc/Fetches", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatRxDescWriteBacks,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Bulk RX descriptor write-backs",     "/Devices/E1k%d/RxDesc/WriteBacks", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatPHYAccesses,        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of PHY accesses",             "/Devices/E1k%d/PHYAccesses", iInstance);
 #endif /* VBOX_WITH_STATISTICS || E1K_REL_STATS */
 
@@ -48,6 +48,9 @@ RT_C_DECLS_END
 #include <iprt/uuid.h>
 
 #include "VBoxDD.h"
+#ifndef RT_OS_WINDOWS
+# include "DrvNATlwIP.h"
+#endif
 
 
 /*******************************************************************************
@@ -553,6 +556,18 @@ static DECLCALLBACK(int) devINIPConstruct(PPDMDEVINS pDevIns, int iInstance,
         goto out;
     }
 
+#ifndef RT_OS_WINDOWS
+    /*
+     * lwIP has global state, so it cannot be shared with the NAT TCP engine.
+     */
+    if (DrvNATlwIPConfigured())
+    {
+        rc = PDMDEV_SET_ERROR(pDevIns, VERR_RESOURCE_BUSY,
+                              N_("The lwIP stack is already used by the NAT TCP engine of a network adapter"));
+        goto out;
+    }
+#endif
+
     /*
      * Init the static parts.
      */
@@ -0,0 +1,170 @@
+/* $Id$ */
+/** @file
+ * Adaptive interrupt moderation helpers shared by the network devices.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ___VBox_DevNetIntMod_h
+#define ___VBox_DevNetIntMod_h
+
+#include <iprt/asm.h>
+#include <iprt/asm-math.h>
+#include <VBox/types.h>
+#include <VBox/vmm/stam.h>
+
+/** @name Adaptive interrupt moderation parameters.
+ * The frame rate is sampled over NETINTMOD_INTERVAL_NS and mapped to a minimum
+ * gap between two interrupts, much like the dynamic ITR mode of real NICs:
+ * a trickle of frames is delivered at once, a stream is coalesced.
+ * @{ */
+/** Length of the sampling interval. */
+#define NETINTMOD_INTERVAL_NS           UINT32_C(4000000)
+/** Below this many frames per second there is no moderation at all. */
+#define NETINTMOD_LOW_RATE              UINT32_C(10000)
+/** Below this many frames per second we aim for NETINTMOD_LOW_GAP_NS. */
+#define NETINTMOD_BULK_RATE             UINT32_C(60000)
+/** Gap for moderate traffic, i.e. at most 20000 interrupts per second. */
+#define NETINTMOD_LOW_GAP_NS            UINT32_C(50000)
+/** Gap for bulk traffic, i.e. at most 8000 interrupts per second. */
+#define NETINTMOD_BULK_GAP_NS           UINT32_C(125000)
+/** @} */
+
+/**
+ * Adaptive interrupt moderation state of a device queue.
+ *
+ * All times are TMCLOCK_VIRTUAL nanoseconds. The caller serializes access,
+ * except for netIntModFrames which may race the rest.
+ */
+typedef struct NETINTMOD
+{
+    /** Start of the current sampling interval. */
+    uint64_t        u64IntervalStart;
+    /** When the last interrupt was delivered. */
+    uint64_t        u64LastInt;
+    /** Frames seen in the current sampling interval. */
+    uint32_t volatile cFrames;
+    /** Interrupts delivered in the current sampling interval. */
+    uint32_t        cInts;
+    /** The minimum gap between two interrupts currently in force. */
+    uint32_t        cNsMinGap;
+    /** Whether adaptive moderation is enabled. */
+    bool            fEnabled;
+    bool            afAlignment[3];
+    /** Interrupts per second over the last sampling interval (STAM). */
+    uint32_t        cIntsPerSec;
+    /** Frames per interrupt over the last sampling interval (STAM). */
+    uint32_t        cFramesPerInt;
+    /** Interrupts held back for later delivery. */
+    STAMCOUNTER     StatDeferred;
+} NETINTMOD;
+AssertCompileSizeAlignment(NETINTMOD, 8);
+/** Pointer to adaptive interrupt moderation state. */
+typedef NETINTMOD *PNETINTMOD;
+
+
+/**
+ * Initializes the moderation state.
+ *
+ * @param   pMod        The moderation state.
+ * @param   fEnabled    Whether to moderate at all.
+ */
+DECLINLINE(void) netIntModInit(PNETINTMOD pMod, bool fEnabled)
+{
+    pMod->u64IntervalStart = 0;
+    pMod->u64LastInt       = 0;
+    pMod->cFrames          = 0;
+    pMod->cInts            = 0;
+    pMod->cNsMinGap        = 0;
+    pMod->fEnabled         = fEnabled;
+    pMod->cIntsPerSec      = 0;
+    pMod->cFramesPerInt    = 0;
+}
+
+/**
+ * Accounts for frames passed to or taken from the guest.
+ *
+ * @param   pMod        The moderation state.
+ * @param   cFrames     The number of frames.
+ */
+DECLINLINE(void) netIntModFrames(PNETINTMOD pMod, uint32_t cFrames)
+{
+    ASMAtomicAddU32(&pMod->cFrames, cFrames);
+}
+
+/**
+ * Closes the sampling interval if it is over and picks the gap for the next
+ * one from the frame rate observed.
+ *
+ * @param   pMod        The moderation state.
+ * @param   u64Now      The current time.
+ */
+DECLINLINE(void) netIntModUpdate(PNETINTMOD pMod, uint64_t u64Now)
+{
+    uint64_t cNsElapsed = u64Now - pMod->u64IntervalStart;
+    if (cNsElapsed < NETINTMOD_INTERVAL_NS)
+        return;
+    uint32_t const cNs = cNsElapsed < UINT32_MAX ? (uint32_t)cNsElapsed : UINT32_MAX;
+
+    uint32_t const cFrames       = ASMAtomicXchgU32(&pMod->cFrames, 0);
+    uint64_t const cFramesPerSec = ASMMultU64ByU32DivByU32(cFrames, UINT32_C(1000000000), cNs);
+    if (cFramesPerSec < NETINTMOD_LOW_RATE)
+        pMod->cNsMinGap = 0;
+    else if (cFramesPerSec < NETINTMOD_BULK_RATE)
+        pMod->cNsMinGap = NETINTMOD_LOW_GAP_NS;
+    else
+        pMod->cNsMinGap = NETINTMOD_BULK_GAP_NS;
+
+    pMod->cIntsPerSec      = (uint32_t)ASMMultU64ByU32DivByU32(pMod->cInts, UINT32_C(1000000000), cNs);
+    pMod->cFramesPerInt    = pMod->cInts ? cFrames / pMod->cInts : 0;
+    pMod->cInts            = 0;
+    pMod->u64IntervalStart = u64Now;
+}
+
+/**
+ * Works out how long an interrupt should be held back.
+ *
+ * @returns Nanoseconds to wait before delivering the interrupt, 0 if it should
+ *          be delivered right away.
+ * @param   pMod        The moderation state.
+ * @param   u64Now      The current time.
+ * @param   cNsMinGap   The minimum gap the guest programmed itself, 0 if none.
+ *                      The adaptive gap never goes below it.
+ */
+DECLINLINE(uint64_t) netIntModDelay(PNETINTMOD pMod, uint64_t u64Now, uint32_t cNsMinGap)
+{
+    if (!pMod->fEnabled)
+        return 0;
+    netIntModUpdate(pMod, u64Now);
+    cNsMinGap = RT_MAX(cNsMinGap, pMod->cNsMinGap);
+
+    uint64_t const cNsSince = u64Now - pMod->u64LastInt;
+    if (cNsSince >= cNsMinGap)
+        return 0;
+    STAM_COUNTER_INC(&pMod->StatDeferred);
+    return cNsMinGap - cNsSince;
+}
+
+/**
+ * Notes that an interrupt has been delivered.
+ *
+ * @param   pMod        The moderation state.
+ * @param   u64Now      The current time.
+ */
+DECLINLINE(void) netIntModDelivered(PNETINTMOD pMod, uint64_t u64Now)
+{
+    pMod->u64LastInt = u64Now;
+    pMod->cInts++;
+}
+
+#endif
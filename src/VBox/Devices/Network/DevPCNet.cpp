@@ -178,9 +178,9 @@ struct PCNetState_st
     PTMTIMERRC                          pTimerPollRC;
 #endif
 
-//#if HC_ARCH_BITS == 64
+#if HC_ARCH_BITS == 64
     uint32_t                            Alignment1;
-//#endif
+#endif
 
     /** Register Address Pointer */
     uint32_t                            u32RAP;
@@ -4563,18 +4563,14 @@ static DECLCALLBACK(void *) pcnetQueryInterface(struct PDMIBASE *pInterface, con
 
 
 /**
- * Check if the device/driver can receive data now.
- * This must be called before the pfnRecieve() method is called.
+ * Check if the device/driver can receive data now, caller owns the critsect.
  *
  * @returns VBox status code.
- * @param   pInterface      Pointer to the interface structure containing the called function pointer.
+ * @param   pThis           The PCNet instance data.
  */
-static int pcnetCanReceive(PCNetState *pThis)
+static int pcnetCanReceiveNoSync(PCNetState *pThis)
 {
-    int rc = PDMCritSectEnter(&pThis->CritSect, VERR_SEM_BUSY);
-    AssertReleaseRC(rc);
-
-    rc = VERR_NET_NO_BUFFER_SPACE;
+    int rc = VERR_NET_NO_BUFFER_SPACE;
 
     if (RT_LIKELY(!CSR_DRX(pThis) && !CSR_STOP(pThis) && !CSR_SPND(pThis)))
     {
@@ -4590,6 +4586,23 @@ static int pcnetCanReceive(PCNetState *pThis)
         else
             rc = VINF_SUCCESS;
     }
+    return rc;
+}
+
+
+/**
+ * Check if the device/driver can receive data now.
+ * This must be called before the pfnRecieve() method is called.
+ *
+ * @returns VBox status code.
+ * @param   pThis           The PCNet instance data.
+ */
+static int pcnetCanReceive(PCNetState *pThis)
+{
+    int rc = PDMCritSectEnter(&pThis->CritSect, VERR_SEM_BUSY);
+    AssertReleaseRC(rc);
+
+    rc = pcnetCanReceiveNoSync(pThis);
 
     PDMCritSectLeave(&pThis->CritSect);
     return rc;
@@ -4639,17 +4652,14 @@ static DECLCALLBACK(int) pcnetNetworkDown_WaitReceiveAvail(PPDMINETWORKDOWN pInt
 
 
 /**
- * @interface_method_impl{PDMINETWORKDOWN,pfnReceive}
+ * Passes one incoming frame to the receive code, caller owns the critsect.
+ *
+ * @param   pThis           The PCNet instance data.
+ * @param   pvBuf           The frame.
+ * @param   cb              The frame size.
  */
-static DECLCALLBACK(int) pcnetNetworkDown_Receive(PPDMINETWORKDOWN pInterface, const void *pvBuf, size_t cb)
+static void pcnetReceiveFrameNoSync(PCNetState *pThis, const void *pvBuf, size_t cb)
 {
-    PCNetState *pThis = RT_FROM_MEMBER(pInterface, PCNetState, INetworkDown);
-    int         rc;
-
-    STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
-    rc = PDMCritSectEnter(&pThis->CritSect, VERR_SEM_BUSY);
-    AssertReleaseRC(rc);
-
     /*
      * Check for the max ethernet frame size, taking the IEEE 802.1Q (VLAN) tag into
      * account. Note that we are *not* expecting the CRC Checksum.
@@ -4681,6 +4691,22 @@ static DECLCALLBACK(int) pcnetNetworkDown_Receive(PPDMINETWORKDOWN pInterface, c
                   PCNET_INST_NR, cb, cbMaxFrame));
     }
 #endif /* LOG_ENABLED */
+}
+
+
+/**
+ * @interface_method_impl{PDMINETWORKDOWN,pfnReceive}
+ */
+static DECLCALLBACK(int) pcnetNetworkDown_Receive(PPDMINETWORKDOWN pInterface, const void *pvBuf, size_t cb)
+{
+    PCNetState *pThis = RT_FROM_MEMBER(pInterface, PCNetState, INetworkDown);
+    int         rc;
+
+    STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
+    rc = PDMCritSectEnter(&pThis->CritSect, VERR_SEM_BUSY);
+    AssertReleaseRC(rc);
+
+    pcnetReceiveFrameNoSync(pThis, pvBuf, cb);
 
     PDMCritSectLeave(&pThis->CritSect);
     STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
@@ -4689,6 +4715,41 @@ static DECLCALLBACK(int) pcnetNetworkDown_Receive(PPDMINETWORKDOWN pInterface, c
 }
 
 
+/**
+ * @interface_method_impl{PDMINETWORKDOWN,pfnReceiveFrames}
+ */
+static DECLCALLBACK(int) pcnetNetworkDown_ReceiveFrames(PPDMINETWORKDOWN pInterface, PCPDMNETWORKFRAME paFrames,
+                                                        uint32_t *pcFrames)
+{
+    PCNetState *pThis   = RT_FROM_MEMBER(pInterface, PCNetState, INetworkDown);
+    uint32_t    cFrames = *pcFrames;
+    uint32_t    iFrame;
+    int         rc;
+
+    STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
+    rc = PDMCritSectEnter(&pThis->CritSect, VERR_SEM_BUSY);
+    AssertReleaseRC(rc);
+
+    /* The caller checked for the first frame, we check before each of the others. */
+    for (iFrame = 0; iFrame < cFrames; iFrame++)
+    {
+        if (iFrame > 0)
+        {
+            rc = pcnetCanReceiveNoSync(pThis);
+            if (RT_FAILURE(rc))
+                break;
+        }
+        pcnetReceiveFrameNoSync(pThis, paFrames[iFrame].pvBuf, paFrames[iFrame].cb);
+    }
+
+    PDMCritSectLeave(&pThis->CritSect);
+    STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
+
+    *pcFrames = iFrame;
+    return iFrame < cFrames ? VERR_NET_NO_BUFFER_SPACE : VINF_SUCCESS;
+}
+
+
 /**
  * @interface_method_impl{PDMINETWORKDOWN,pfnXmitPending}
  */
@@ -5072,6 +5133,7 @@ static DECLCALLBACK(int) pcnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGM
     /* INeworkPort */
     pThis->INetworkDown.pfnWaitReceiveAvail = pcnetNetworkDown_WaitReceiveAvail;
     pThis->INetworkDown.pfnReceive          = pcnetNetworkDown_Receive;
+    pThis->INetworkDown.pfnReceiveFrames    = pcnetNetworkDown_ReceiveFrames;
     pThis->INetworkDown.pfnXmitPending      = pcnetNetworkDown_XmitPending;
     /* INetworkConfig */
     pThis->INetworkConfig.pfnGetMac         = pcnetGetMac;
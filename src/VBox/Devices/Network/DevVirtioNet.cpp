@@ -28,9 +28,12 @@
 #include <iprt/semaphore.h>
 #ifdef IN_RING3
 # include <iprt/mem.h>
+# include <iprt/string.h>
+# include <iprt/thread.h>
 # include <iprt/uuid.h>
 #endif /* IN_RING3 */
 #include "VBoxDD.h"
+#include "DevNetIntMod.h"
 #include "../VirtIO/Virtio.h"
 
 
@@ -69,6 +72,8 @@ RT_C_DECLS_END
 #define VNET_MAX_FRAME_SIZE     65536  // TODO: Is it the right limit?
 #define VNET_MAC_FILTER_LEN     32
 #define VNET_MAX_VID            (1 << 12)
+#define VNET_MAX_QUEUE_PAIRS    4
+#define VNET_TX_RETRY_MS        2      /* Retry interval of the TX thread when the driver is busy */
 
 /* Virtio net features */
 #define VNET_F_CSUM       0x00000001  /* Host handles pkts w/ partial csum */
@@ -88,6 +93,7 @@ RT_C_DECLS_END
 #define VNET_F_CTRL_VQ    0x00020000  /* Control channel available */
 #define VNET_F_CTRL_RX    0x00040000  /* Control channel RX mode support */
 #define VNET_F_CTRL_VLAN  0x00080000  /* Control channel VLAN filtering */
+#define VNET_F_MQ         0x00400000  /* Device supports multiple queue pairs */
 
 #define VNET_S_LINK_UP    1
 
@@ -100,8 +106,80 @@ struct __attribute__ ((__packed__)) VNetPCIConfig
 {
     RTMAC    mac;
     uint16_t uStatus;
+    uint16_t uMaxVirtqueuePairs;
 };
 AssertCompileMemberOffset(struct VNetPCIConfig, uStatus, 6);
+AssertCompileMemberOffset(struct VNetPCIConfig, uMaxVirtqueuePairs, 8);
+
+/** Bytes a transmit thread may hold back for the driver, several big frames. */
+#define VNET_TX_STAGE_SIZE      (4 * VNET_MAX_FRAME_SIZE)
+
+/**
+ * Frames a transmit thread has taken off its TX queue and not yet handed to
+ * the driver.
+ *
+ * The thread reads the frames out of guest memory into here without holding
+ * the transmit session of the driver, see vnetTxFlush.
+ */
+typedef struct VNetTxStage
+{
+    /** Number of frames in aFrames. */
+    uint32_t                cFrames;
+    /** Number of bytes used in abData. */
+    uint32_t                cbUsed;
+    struct
+    {
+        /** Where the frame starts in abData. */
+        uint32_t            off;
+        /** The size of the frame. */
+        uint32_t            cb;
+        /** Whether Gso applies. */
+        bool                fGso;
+        /** The GSO context, with the header size fixed up. */
+        PDMNETWORKGSO       Gso;
+    } aFrames[PDMNETWORK_MAX_BATCH];
+    /** The frames. */
+    uint8_t                 abData[VNET_TX_STAGE_SIZE];
+} VNETTXSTAGE;
+typedef VNETTXSTAGE *PVNETTXSTAGE;
+
+/**
+ * A receive and transmit queue pair.
+ *
+ * The guest spreads its flows over the pairs, we steer received frames to
+ * them by flow hash and give every transmit queue a thread of its own when
+ * there is more than one pair.
+ */
+struct VNetQueuePair
+{
+    R3PTRTYPE(PVQUEUE)      pRxQueue;
+    R3PTRTYPE(PVQUEUE)      pTxQueue;
+    /** Delivers the receive interrupts held back by RxIntMod, NULL if off. */
+    PTMTIMERR3              pRxIntTimer;
+    /** The transmit thread, NULL if transmission happens on EMT. */
+    R3PTRTYPE(PPDMTHREAD)   pTxThread;
+    /** The frames waiting for the driver, allocated along with pTxThread. */
+    R3PTRTYPE(PVNETTXSTAGE) pTxStage;
+    /** Signalled when the guest kicks the transmit queue or the driver has
+     * room again. */
+    RTSEMEVENT              hEventTxKick;
+    /** Indicates transmission in progress -- only one thread is allowed. */
+    uint32_t volatile       uIsTransmitting;
+    /** Set while the transmit thread waits for another pair to end its
+     * transmit session. */
+    bool volatile           fTxWaiting;
+    bool                    afPadding[3];
+    /** Adaptive moderation of the receive interrupts. */
+    NETINTMOD               RxIntMod;
+    /** Number of frames steered to this pair. */
+    STAMCOUNTER             StatReceivePackets;
+    /** Number of frames sent from this pair. */
+    STAMCOUNTER             StatTransmitPackets;
+    /** Number of frames dropped because the RX queue of the pair was full. */
+    STAMCOUNTER             StatReceiveOverflows;
+};
+typedef struct VNetQueuePair VNETQUEUEPAIR;
+typedef VNETQUEUEPAIR *PVNETQUEUEPAIR;
 
 /**
  * Device state structure. Holds the current state of device.
@@ -125,9 +203,7 @@ struct VNetState_st
     R3PTRTYPE(PPDMQUEUE)    pCanRxQueueR3;           /**< Rx wakeup signaller - R3. */
     R0PTRTYPE(PPDMQUEUE)    pCanRxQueueR0;           /**< Rx wakeup signaller - R0. */
     RCPTRTYPE(PPDMQUEUE)    pCanRxQueueRC;           /**< Rx wakeup signaller - RC. */
-# if HC_ARCH_BITS == 64
     uint32_t                padding;
-# endif
 
     /**< Link Up(/Restore) Timer. */
     PTMTIMERR3              pLinkUpTimer;
@@ -151,9 +227,6 @@ struct VNetState_st
     uint64_t                u64NanoTS;
 #endif /* VNET_TX_DELAY */
 
-    /** Indicates transmission in progress -- only one thread is allowed. */
-    uint32_t                uIsTransmitting;
-
     /** PCI config area holding MAC address as well as TBD. */
     struct VNetPCIConfig    config;
     /** MAC address obtained from the configuration. */
@@ -178,14 +251,20 @@ struct VNetState_st
     /** Bit array of VLAN filter, one bit per VLAN ID. */
     uint8_t                 aVlanFilter[VNET_MAX_VID / sizeof(uint8_t)];
 
-    R3PTRTYPE(PVQUEUE)      pRxQueue;
-    R3PTRTYPE(PVQUEUE)      pTxQueue;
     R3PTRTYPE(PVQUEUE)      pCtlQueue;
     /* Receive-blocking-related fields ***************************************/
 
     /** EMT: Gets signalled when more RX descriptors become available. */
     RTSEMEVENT              hEventMoreRxDescAvail;
 
+    /** Number of queue pairs offered to the guest. */
+    uint16_t                cQueuePairs;
+    /** Number of queue pairs the guest has enabled. */
+    uint16_t volatile       cActivePairs;
+    uint32_t                u32Padding3;
+    /** The queue pairs, only the first cQueuePairs are used. */
+    VNETQUEUEPAIR           aQueuePairs[VNET_MAX_QUEUE_PAIRS];
+
     /* Statistic fields ******************************************************/
 
     STAMCOUNTER             StatReceiveBytes;
@@ -256,6 +335,9 @@ typedef uint8_t VNETCTLACK;
 #define VNET_CTRL_CMD_VLAN_ADD         0
 #define VNET_CTRL_CMD_VLAN_DEL         1
 
+#define VNET_CTRL_CLS_MQ               4
+#define VNET_CTRL_CMD_MQ_VQ_PAIRS_SET  0
+
 
 struct VNetCtlHdr
 {
@@ -272,6 +354,20 @@ DECLINLINE(bool) vnetMergeableRxBuffers(PVNETSTATE pState)
     return !!(pState->VPCI.uGuestFeatures & VNET_F_MRG_RXBUF);
 }
 
+/* Returns true if the guest driver takes GSO frames of the given type. */
+DECLINLINE(bool) vnetGuestAcceptsGso(PVNETSTATE pState, PCPDMNETWORKGSO pGso)
+{
+    switch (pGso->u8Type)
+    {
+        case PDMNETWORKGSOTYPE_IPV4_TCP:
+            return !!(pState->VPCI.uGuestFeatures & VNET_F_GUEST_TSO4);
+        case PDMNETWORKGSOTYPE_IPV6_TCP:
+            return !!(pState->VPCI.uGuestFeatures & VNET_F_GUEST_TSO6);
+        default:
+            return false;
+    }
+}
+
 DECLINLINE(int) vnetCsEnter(PVNETSTATE pState, int rcBusy)
 {
     return vpciCsEnter(&pState->VPCI, rcBusy);
@@ -282,6 +378,40 @@ DECLINLINE(void) vnetCsLeave(PVNETSTATE pState)
     vpciCsLeave(&pState->VPCI);
 }
 
+/**
+ * Publishes the used buffers of a queue.
+ *
+ * The receive, transmit and control paths run on different threads, the
+ * used ring index of the queues, the ISR and the interrupt line are shared
+ * and only touched with the device critical section held.
+ *
+ * @param   pState          The device state structure.
+ * @param   pQueue          The queue.
+ * @param   fNotify         Whether to interrupt the guest.
+ */
+static void vnetQueueSync(PVNETSTATE pState, PVQUEUE pQueue, bool fNotify = true)
+{
+    int rc = vnetCsEnter(pState, VERR_SEM_BUSY);
+    AssertRCReturnVoid(rc);
+    vqueueSync(&pState->VPCI, pQueue, fNotify);
+    vnetCsLeave(pState);
+}
+
+/**
+ * Enables or disables guest notifications for a queue, see vnetQueueSync.
+ *
+ * @param   pState          The device state structure.
+ * @param   pQueue          The queue.
+ * @param   fEnabled        Whether the guest should kick us.
+ */
+static void vnetQueueSetNotification(PVNETSTATE pState, PVQUEUE pQueue, bool fEnabled)
+{
+    int rc = vnetCsEnter(pState, VERR_SEM_BUSY);
+    AssertRCReturnVoid(rc);
+    vringSetNotification(&pState->VPCI, &pQueue->VRing, fEnabled);
+    vnetCsLeave(pState);
+}
+
 DECLINLINE(int) vnetCsRxEnter(PVNETSTATE pState, int rcBusy)
 {
     // STAM_PROFILE_START(&pState->CTXSUFF(StatCsRx), a);
@@ -317,6 +447,7 @@ DECLINLINE(void) vnetPacketDump(PVNETSTATE pState, const uint8_t *cpPacket, size
 
 PDMBOTHCBDECL(uint32_t) vnetGetHostFeatures(void *pvState)
 {
+    VNETSTATE *pState = (VNETSTATE *)pvState;
     /* We support:
      * - Host-provided MAC address
      * - Link status reporting in config space
@@ -324,8 +455,11 @@ PDMBOTHCBDECL(uint32_t) vnetGetHostFeatures(void *pvState)
      * - RX mode setting
      * - MAC filter table
      * - VLAN filter
+     * - Segmentation offload in both directions (GSO)
+     * - Multiple queue pairs if configured
      */
-    return VNET_F_MAC
+    return (pState->cQueuePairs > 1 ? VNET_F_MQ : 0)
+        | VNET_F_MAC
         | VNET_F_STATUS
         | VNET_F_CTRL_VQ
         | VNET_F_CTRL_RX
@@ -335,6 +469,9 @@ PDMBOTHCBDECL(uint32_t) vnetGetHostFeatures(void *pvState)
         | VNET_F_HOST_TSO4
         | VNET_F_HOST_TSO6
         | VNET_F_HOST_UFO
+        | VNET_F_GUEST_CSUM
+        | VNET_F_GUEST_TSO4
+        | VNET_F_GUEST_TSO6
 #endif
 #ifdef VNET_WITH_MERGEABLE_RX_BUFS
         | VNET_F_MRG_RXBUF
@@ -347,11 +484,18 @@ PDMBOTHCBDECL(uint32_t) vnetGetHostMinimalFeatures(void *pvState)
     return VNET_F_MAC;
 }
 
+#ifdef IN_RING3
+static void vnetSetupQueues(PVNETSTATE pState, uint16_t cPairs);
+#endif
+
 PDMBOTHCBDECL(void) vnetSetHostFeatures(void *pvState, uint32_t uFeatures)
 {
-    // TODO: Nothing to do here yet
     VNETSTATE *pState = (VNETSTATE *)pvState;
     LogFlow(("%s vnetSetHostFeatures: uFeatures=%x\n", INSTANCE(pState), uFeatures));
+#ifdef IN_RING3
+    /* The control queue moves behind the additional pairs. */
+    vnetSetupQueues(pState, (uFeatures & VNET_F_MQ) ? pState->cQueuePairs : 1);
+#endif
 }
 
 PDMBOTHCBDECL(int) vnetGetConfig(void *pvState, uint32_t port, uint32_t cb, void *data)
@@ -415,10 +559,19 @@ PDMBOTHCBDECL(int) vnetReset(void *pvState)
     pState->nMacFilterEntries = 0;
     memset(pState->aMacFilter,  0, VNET_MAC_FILTER_LEN * sizeof(RTMAC));
     memset(pState->aVlanFilter, 0, sizeof(pState->aVlanFilter));
-    pState->uIsTransmitting   = 0;
+    for (unsigned i = 0; i < RT_ELEMENTS(pState->aQueuePairs); i++)
+        pState->aQueuePairs[i].uIsTransmitting = 0;
 #ifndef IN_RING3
     return VINF_IOM_HC_IOPORT_WRITE;
 #else
+    /* Frames staged by the transmit threads belong to the old queues. */
+    for (unsigned i = 0; i < RT_ELEMENTS(pState->aQueuePairs); i++)
+        if (pState->aQueuePairs[i].pTxStage)
+        {
+            pState->aQueuePairs[i].pTxStage->cFrames = 0;
+            pState->aQueuePairs[i].pTxStage->cbUsed  = 0;
+        }
+    vnetSetupQueues(pState, 1);
     if (pState->pDrv)
         pState->pDrv->pfnSetPromiscuousMode(pState->pDrv, true);
     return VINF_SUCCESS;
@@ -557,27 +710,32 @@ PDMBOTHCBDECL(int) vnetIOPortOut(PPDMDEVINS pDevIns, void *pvUser,
  */
 static int vnetCanReceive(VNETSTATE *pState)
 {
-    int rc = vnetCsRxEnter(pState, VERR_SEM_BUSY);
+    int rc = vnetCsEnter(pState, VERR_SEM_BUSY);
     AssertRCReturn(rc, rc);
 
     LogFlow(("%s vnetCanReceive\n", INSTANCE(pState)));
-    if (!(pState->VPCI.uStatus & VPCI_STATUS_DRV_OK))
-        rc = VERR_NET_NO_BUFFER_SPACE;
-    else if (!vqueueIsReady(&pState->VPCI, pState->pRxQueue))
-        rc = VERR_NET_NO_BUFFER_SPACE;
-    else if (vqueueIsEmpty(&pState->VPCI, pState->pRxQueue))
+    rc = VERR_NET_NO_BUFFER_SPACE;
+    if (pState->VPCI.uStatus & VPCI_STATUS_DRV_OK)
     {
-        vringSetNotification(&pState->VPCI, &pState->pRxQueue->VRing, true);
-        rc = VERR_NET_NO_BUFFER_SPACE;
-    }
-    else
-    {
-        vringSetNotification(&pState->VPCI, &pState->pRxQueue->VRing, false);
-        rc = VINF_SUCCESS;
+        /* We can receive as long as any of the active RX queues has room. */
+        uint16_t cPairs = pState->cActivePairs;
+        for (uint16_t i = 0; i < cPairs; i++)
+        {
+            PVQUEUE pRxQueue = pState->aQueuePairs[i].pRxQueue;
+            if (!pRxQueue || !vqueueIsReady(&pState->VPCI, pRxQueue))
+                continue;
+            if (vqueueIsEmpty(&pState->VPCI, pRxQueue))
+                vringSetNotification(&pState->VPCI, &pRxQueue->VRing, true);
+            else
+            {
+                vringSetNotification(&pState->VPCI, &pRxQueue->VRing, false);
+                rc = VINF_SUCCESS;
+            }
+        }
     }
 
     LogFlow(("%s vnetCanReceive -> %Rrc\n", INSTANCE(pState), rc));
-    vnetCsRxLeave(pState);
+    vnetCsLeave(pState);
     return rc;
 }
 
@@ -702,6 +860,86 @@ static bool vnetAddressFilter(PVNETSTATE pState, const void *pvBuf, size_t cb)
     return false;
 }
 
+/**
+ * Picks the queue pair a received frame goes to.
+ *
+ * Frames are spread over the active pairs by a hash of the IP addresses and
+ * the TCP or UDP ports, so all frames of a flow end up on the same queue and
+ * with the guest CPU serving it. Everything without ports goes to the pair
+ * the address hash points at. The frame stays on that pair even if its queue
+ * is out of buffers, handing it to another one would reorder the flow.
+ *
+ * @returns The queue pair.
+ * @param   pState          The device state structure.
+ * @param   pvBuf           The ethernet frame.
+ * @param   cb              The size of the frame.
+ * @thread  RX
+ */
+static PVNETQUEUEPAIR vnetRxSelectPair(PVNETSTATE pState, const void *pvBuf, size_t cb)
+{
+    uint16_t cPairs = pState->cActivePairs;
+    uint16_t iPair  = 0;
+
+    if (cPairs > 1 && cb >= sizeof(RTNETETHERHDR))
+    {
+        const uint8_t *pbFrame    = (const uint8_t *)pvBuf;
+        size_t         off        = sizeof(RTNETETHERHDR);
+        uint16_t       uEtherType = RT_BE2H_U16(((PCRTNETETHERHDR)pbFrame)->EtherType);
+        uint32_t       uHash      = 0;
+        uint8_t        uProto     = 0;
+        size_t         offL4      = 0;
+
+        if (uEtherType == RTNET_ETHERTYPE_VLAN && cb >= off + 4)
+        {
+            uEtherType = RT_BE2H_U16(*(const uint16_t *)(pbFrame + off + 2));
+            off += 4;
+        }
+        if (uEtherType == RTNET_ETHERTYPE_IPV4 && cb >= off + RTNETIPV4_MIN_LEN)
+        {
+            PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)(pbFrame + off);
+            uHash = pIpHdr->ip_src.u ^ pIpHdr->ip_dst.u;
+            /* Only the first fragment carries the ports. */
+            if (!(RT_BE2H_U16(pIpHdr->ip_off) & (RTNETIPV4_FLAGS_MF | UINT16_C(0x1fff) /* offset */)))
+            {
+                uProto = pIpHdr->ip_p;
+                offL4  = off + pIpHdr->ip_hl * 4;
+            }
+        }
+        else if (uEtherType == RTNET_ETHERTYPE_IPV6 && cb >= off + RTNETIPV6_MIN_LEN)
+        {
+            PCRTNETIPV6 pIp6Hdr = (PCRTNETIPV6)(pbFrame + off);
+            for (unsigned i = 0; i < RT_ELEMENTS(pIp6Hdr->ip6_src.au32); i++)
+                uHash ^= pIp6Hdr->ip6_src.au32[i] ^ pIp6Hdr->ip6_dst.au32[i];
+            uProto = pIp6Hdr->ip6_nxt;
+            offL4  = off + RTNETIPV6_MIN_LEN;
+        }
+        if (   (uProto == RTNETIPV4_PROT_TCP || uProto == RTNETIPV4_PROT_UDP)
+            && cb >= offL4 + 2 * sizeof(uint16_t))
+            uHash ^= *(const uint32_t *)(pbFrame + offL4); /* both ports */
+
+        uHash ^= uHash >> 16;
+        uHash *= UINT32_C(0x45d9f3b);
+        uHash ^= uHash >> 16;
+        iPair = (uint16_t)(uHash % cPairs);
+    }
+    return &pState->aQueuePairs[iPair];
+}
+
+/**
+ * Checks if the RX queue of a pair has buffers for another frame.
+ *
+ * @returns true if it has.
+ * @param   pState          The device state structure.
+ * @param   pPair           The queue pair.
+ * @thread  RX
+ */
+DECLINLINE(bool) vnetRxPairHasRoom(PVNETSTATE pState, PVNETQUEUEPAIR pPair)
+{
+    return pPair->pRxQueue
+        && vqueueIsReady(&pState->VPCI, pPair->pRxQueue)
+        && !vqueueIsEmpty(&pState->VPCI, pPair->pRxQueue);
+}
+
 /**
  * Pad and store received packet.
  *
@@ -710,11 +948,14 @@ static bool vnetAddressFilter(PVNETSTATE pState, const void *pvBuf, size_t cb)
  *
  * @returns VBox status code.
  * @param   pState          The device state structure.
+ * @param   pRxQueue        The receive queue to store the packet in.
  * @param   pvBuf           The available data.
  * @param   cb              Number of bytes available in the buffer.
+ * @param   pGso            The GSO context, NULL if not a GSO frame.
+ * @remarks The caller must call vqueueSync when done with the RX queue.
  * @thread  RX
  */
-static int vnetHandleRxPacket(PVNETSTATE pState, const void *pvBuf, size_t cb,
+static int vnetHandleRxPacket(PVNETSTATE pState, PVQUEUE pRxQueue, const void *pvBuf, size_t cb,
                               PCPDMNETWORKGSO pGso)
 {
     VNETHDRMRX   Hdr;
@@ -770,7 +1011,7 @@ static int vnetHandleRxPacket(PVNETSTATE pState, const void *pvBuf, size_t cb,
         VQUEUEELEM elem;
         unsigned int nSeg = 0, uElemSize = 0, cbReserved = 0;
 
-        if (!vqueueGet(&pState->VPCI, pState->pRxQueue, &elem))
+        if (!vqueueGet(&pState->VPCI, pRxQueue, &elem))
         {
             /*
              * @todo: It is possible to run out of RX buffers if only a few
@@ -814,7 +1055,7 @@ static int vnetHandleRxPacket(PVNETSTATE pState, const void *pvBuf, size_t cb,
             uElemSize += uSize;
         }
         STAM_PROFILE_START(&pState->StatReceiveStore, a);
-        vqueuePut(&pState->VPCI, pState->pRxQueue, &elem, uElemSize, cbReserved);
+        vqueuePut(&pState->VPCI, pRxQueue, &elem, uElemSize, cbReserved);
         STAM_PROFILE_STOP(&pState->StatReceiveStore, a);
         if (!vnetMergeableRxBuffers(pState))
             break;
@@ -832,7 +1073,6 @@ static int vnetHandleRxPacket(PVNETSTATE pState, const void *pvBuf, size_t cb,
             return rc;
         }
     }
-    vqueueSync(&pState->VPCI, pState->pRxQueue);
     if (uOffset < cb)
     {
         Log(("%s vnetHandleRxPacket: Packet did not fit into RX queue (packet size=%u)!\n",
@@ -843,6 +1083,67 @@ static int vnetHandleRxPacket(PVNETSTATE pState, const void *pvBuf, size_t cb,
     return VINF_SUCCESS;
 }
 
+/**
+ * Publishes the frames put into the RX queue of a pair and interrupts the
+ * guest, unless adaptive moderation wants the interrupt to wait.
+ *
+ * @param   pState          The device state structure.
+ * @param   pPair           The queue pair.
+ * @remarks The caller holds the RX critical section.
+ * @thread  RX
+ */
+static void vnetRxSync(PVNETSTATE pState, PVNETQUEUEPAIR pPair)
+{
+    if (!pPair->RxIntMod.fEnabled)
+    {
+        vnetQueueSync(pState, pPair->pRxQueue);
+        return;
+    }
+
+    int rc = vnetCsEnter(pState, VERR_SEM_BUSY);
+    AssertRCReturnVoid(rc);
+    vqueueSync(&pState->VPCI, pPair->pRxQueue, false /*fNotify*/);
+    uint64_t const u64Now   = TMTimerGet(pPair->pRxIntTimer);
+    uint64_t const cNsDelay = netIntModDelay(&pPair->RxIntMod, u64Now, 0);
+    if (cNsDelay)
+    {
+        if (!TMTimerIsActive(pPair->pRxIntTimer))
+            TMTimerSet(pPair->pRxIntTimer, u64Now + cNsDelay);
+    }
+    else
+    {
+        TMTimerStop(pPair->pRxIntTimer);
+        netIntModDelivered(&pPair->RxIntMod, u64Now);
+        vqueueNotify(&pState->VPCI, pPair->pRxQueue);
+    }
+    vnetCsLeave(pState);
+}
+
+/**
+ * Receive Interrupt Moderation Timer handler, delivers the interrupt
+ * vnetRxSync held back.
+ *
+ * @param   pDevIns     Pointer to device instance structure.
+ * @param   pTimer      Pointer to the timer.
+ * @param   pvUser      The queue pair.
+ * @thread  EMT
+ */
+static DECLCALLBACK(void) vnetRxIntTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, void *pvUser)
+{
+    VNETSTATE     *pState = PDMINS_2_DATA(pDevIns, VNETSTATE *);
+    PVNETQUEUEPAIR pPair  = (PVNETQUEUEPAIR)pvUser;
+
+    if (RT_SUCCESS(vnetCsEnter(pState, VERR_SEM_BUSY)))
+    {
+        if (pPair->pRxQueue && vqueueIsReady(&pState->VPCI, pPair->pRxQueue))
+        {
+            netIntModDelivered(&pPair->RxIntMod, TMTimerGet(pTimer));
+            vqueueNotify(&pState->VPCI, pPair->pRxQueue);
+        }
+        vnetCsLeave(pState);
+    }
+}
+
 /**
  * @interface_method_impl{PDMINETWORKDOWN,pfnReceiveGso}
  */
@@ -854,6 +1155,9 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
 
     Log2(("%s vnetNetworkDown_ReceiveGso: pvBuf=%p cb=%u pGso=%p\n",
           INSTANCE(pState), pvBuf, cb, pGso));
+    /* The caller segments frames the guest driver didn't sign up for. */
+    if (pGso && !vnetGuestAcceptsGso(pState, pGso))
+        return VERR_NOT_SUPPORTED;
     int rc = vnetCanReceive(pState);
     if (RT_FAILURE(rc))
         return rc;
@@ -872,8 +1176,20 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
         rc = vnetCsRxEnter(pState, VERR_SEM_BUSY);
         if (RT_SUCCESS(rc))
         {
-            rc = vnetHandleRxPacket(pState, pvBuf, cb, pGso);
-            STAM_REL_COUNTER_ADD(&pState->StatReceiveBytes, cb);
+            PVNETQUEUEPAIR pPair = vnetRxSelectPair(pState, pvBuf, cb);
+            if (vnetRxPairHasRoom(pState, pPair))
+            {
+                rc = vnetHandleRxPacket(pState, pPair->pRxQueue, pvBuf, cb, pGso);
+                netIntModFrames(&pPair->RxIntMod, 1);
+                vnetRxSync(pState, pPair);
+                STAM_REL_COUNTER_ADD(&pState->StatReceiveBytes, cb);
+                STAM_COUNTER_INC(&pPair->StatReceivePackets);
+            }
+            else if (pState->cActivePairs > 1)
+                /* Another queue had room, dropping keeps the flow in order. */
+                STAM_REL_COUNTER_INC(&pPair->StatReceiveOverflows);
+            else
+                rc = VERR_NET_NO_BUFFER_SPACE;
             vnetCsRxLeave(pState);
         }
     }
@@ -882,6 +1198,81 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
     return rc;
 }
 
+/**
+ * @interface_method_impl{PDMINETWORKDOWN,pfnReceiveFrames}
+ */
+static DECLCALLBACK(int) vnetNetworkDown_ReceiveFrames(PPDMINETWORKDOWN pInterface, PCPDMNETWORKFRAME paFrames,
+                                                       uint32_t *pcFrames)
+{
+    VNETSTATE *pState  = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
+    uint32_t   cFrames = *pcFrames;
+    uint32_t   iFrame  = 0;
+
+    Log2(("%s vnetNetworkDown_ReceiveFrames: cFrames=%u\n", INSTANCE(pState), cFrames));
+    int rc = vnetCanReceive(pState);
+    if (RT_FAILURE(rc))
+    {
+        *pcFrames = 0;
+        return rc;
+    }
+
+    /* Drop packets if VM is not running or cable is disconnected. */
+    VMSTATE enmVMState = PDMDevHlpVMState(pState->VPCI.CTX_SUFF(pDevIns));
+    if ((   enmVMState != VMSTATE_RUNNING
+         && enmVMState != VMSTATE_RUNNING_LS)
+        || !(STATUS & VNET_S_LINK_UP))
+        return VINF_SUCCESS;
+
+    /*
+     * Fill the RX queues with as many frames as it takes and tell the guest
+     * about all of them with a single sync per queue.
+     */
+    STAM_PROFILE_START(&pState->StatReceive, a);
+    vpciSetReadLed(&pState->VPCI, true);
+    rc = vnetCsRxEnter(pState, VERR_SEM_BUSY);
+    if (RT_SUCCESS(rc))
+    {
+        uint32_t fPairsUsed = 0;
+        for (; iFrame < cFrames; iFrame++)
+        {
+            if (!vnetAddressFilter(pState, paFrames[iFrame].pvBuf, paFrames[iFrame].cb))
+                continue;
+            PVNETQUEUEPAIR pPair = vnetRxSelectPair(pState, paFrames[iFrame].pvBuf, paFrames[iFrame].cb);
+            if (!vnetRxPairHasRoom(pState, pPair))
+            {
+                if (pState->cActivePairs > 1)
+                {
+                    /* Dropped to keep the flow in order, see vnetNetworkDown_ReceiveGso. */
+                    STAM_REL_COUNTER_INC(&pPair->StatReceiveOverflows);
+                    continue;
+                }
+                rc = VERR_NET_NO_BUFFER_SPACE;
+                break;
+            }
+            rc = vnetHandleRxPacket(pState, pPair->pRxQueue, paFrames[iFrame].pvBuf, paFrames[iFrame].cb, NULL);
+            fPairsUsed |= RT_BIT_32(pPair - &pState->aQueuePairs[0]);
+            netIntModFrames(&pPair->RxIntMod, 1);
+            if (RT_FAILURE(rc))
+            {
+                /* Dropped like with pfnReceive, the buffers it used still get synced. */
+                iFrame++;
+                break;
+            }
+            STAM_REL_COUNTER_ADD(&pState->StatReceiveBytes, paFrames[iFrame].cb);
+            STAM_COUNTER_INC(&pPair->StatReceivePackets);
+        }
+        for (unsigned i = 0; i < RT_ELEMENTS(pState->aQueuePairs); i++)
+            if (fPairsUsed & RT_BIT_32(i))
+                vnetRxSync(pState, &pState->aQueuePairs[i]);
+        vnetCsRxLeave(pState);
+    }
+    vpciSetReadLed(&pState->VPCI, false);
+    STAM_PROFILE_STOP(&pState->StatReceive, a);
+
+    *pcFrames = iFrame;
+    return rc;
+}
+
 /**
  * @interface_method_impl{PDMINETWORKDOWN,pfnReceive}
  */
@@ -1028,32 +1419,133 @@ DECLINLINE(void) vnetCompleteChecksum(uint8_t *pBuf, unsigned cbSize, uint16_t u
     *(uint16_t*)(pBuf + uStart + uOffset) = vnetCSum16(pBuf + uStart, cbSize - uStart);
 }
 
-static void vnetTransmitPendingPackets(PVNETSTATE pState, PVQUEUE pQueue, bool fOnWorkerThread)
+/**
+ * Hands the frames staged by the transmit thread of a queue pair to the driver.
+ *
+ * This is the only part of the transmission that runs in a transmit session
+ * of the driver, the PDMINETWORKUP interface wants the buffers allocated in
+ * the same session they are sent in. The frames stay staged if the driver is
+ * busy.
+ *
+ * @returns VINF_SUCCESS or VERR_TRY_AGAIN.
+ * @param   pState              The device state structure.
+ * @param   pPair               The queue pair.
+ * @param   fOnWorkerThread     Whether we're on a worker thread or on EMT.
+ */
+static int vnetTxFlush(PVNETSTATE pState, PVNETQUEUEPAIR pPair, bool fOnWorkerThread)
 {
+    PVNETTXSTAGE   pStage = pPair->pTxStage;
+    PPDMINETWORKUP pDrv   = pState->pDrv;
+    if (!pStage->cFrames)
+        return VINF_SUCCESS;
+    if (!pDrv)
+    {
+        pStage->cFrames = 0;
+        pStage->cbUsed  = 0;
+        return VINF_SUCCESS;
+    }
+
+    /* Flag the wait first, so the pair ending its session next sees it. */
+    ASMAtomicWriteBool(&pPair->fTxWaiting, true);
+    int rc = pDrv->pfnBeginXmit(pDrv, fOnWorkerThread);
+    Assert(rc == VINF_SUCCESS || rc == VERR_TRY_AGAIN);
+    if (rc == VERR_TRY_AGAIN)
+        return VERR_TRY_AGAIN;
+    ASMAtomicWriteBool(&pPair->fTxWaiting, false);
+
+    STAM_PROFILE_START(&pState->StatTransmitSend, a);
+    PPDMSCATTERGATHER apSgBatch[PDMNETWORK_MAX_BATCH];
+    uint32_t          cSgBatch = 0;
+    for (uint32_t i = 0; i < pStage->cFrames; i++)
+    {
+        PDMNETWORKGSO *pGso = pStage->aFrames[i].fGso ? &pStage->aFrames[i].Gso : NULL;
+        uint32_t const cb   = pStage->aFrames[i].cb;
+        PPDMSCATTERGATHER pSgBuf;
+        rc = pDrv->pfnAllocBuf(pDrv, cb, pGso, &pSgBuf);
+        if (RT_FAILURE(rc) && cSgBatch)
+        {
+            /* The queued frames may be holding the space we need. */
+            pDrv->pfnSendBufs(pDrv, apSgBatch, cSgBatch, fOnWorkerThread);
+            cSgBatch = 0;
+            rc = pDrv->pfnAllocBuf(pDrv, cb, pGso, &pSgBuf);
+        }
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("virtio-net: failed to allocate SG buffer: size=%u rc=%Rrc\n", cb, rc));
+            continue;
+        }
+        Assert(pSgBuf->cSegs == 1);
+        memcpy(pSgBuf->aSegs[0].pvSeg, &pStage->abData[pStage->aFrames[i].off], cb);
+        pSgBuf->cbUsed = cb;
+        if (pDrv->pfnSendBufs)
+            apSgBatch[cSgBatch++] = pSgBuf;
+        else
+            pDrv->pfnSendBuf(pDrv, pSgBuf, fOnWorkerThread);
+    }
+    if (cSgBatch)
+        pDrv->pfnSendBufs(pDrv, apSgBatch, cSgBatch, fOnWorkerThread);
+    STAM_PROFILE_STOP(&pState->StatTransmitSend, a);
+
+    pDrv->pfnEndXmit(pDrv);
+    pStage->cFrames = 0;
+    pStage->cbUsed  = 0;
+
+    /* Hand over to the pairs that found the session taken. */
+    uint16_t const cPairs = pState->cActivePairs;
+    for (uint16_t i = 0; i < cPairs; i++)
+        if (   &pState->aQueuePairs[i] != pPair
+            && ASMAtomicXchgBool(&pState->aQueuePairs[i].fTxWaiting, false))
+            RTSemEventSignal(pState->aQueuePairs[i].hEventTxKick);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Transmits the frames queued up in the TX queue of a queue pair.
+ *
+ * On EMT the frames are copied straight into driver buffers within one
+ * transmit session. A transmit thread instead stages them in the pair and
+ * takes the session only to hand them over (vnetTxFlush), so the threads of
+ * the other pairs can read their frames out of guest memory meanwhile.
+ *
+ * @returns VINF_SUCCESS if the queue was processed, VERR_TRY_AGAIN if another
+ *          thread is transmitting or the driver is busy, VERR_INVALID_STATE if
+ *          the guest driver is not ready.
+ * @param   pState              The device state structure.
+ * @param   pPair               The queue pair.
+ * @param   fOnWorkerThread     Whether we're on a worker thread or on EMT.
+ */
+static int vnetTransmitPendingPackets(PVNETSTATE pState, PVNETQUEUEPAIR pPair, bool fOnWorkerThread)
+{
+    PVQUEUE      pQueue = pPair->pTxQueue;
+    PVNETTXSTAGE pStage = pPair->pTxStage;
+
     /*
      * Only one thread is allowed to transmit at a time, others should skip
      * transmission as the packets will be picked up by the transmitting
      * thread.
      */
-    if (!ASMAtomicCmpXchgU32(&pState->uIsTransmitting, 1, 0))
-        return;
+    if (!ASMAtomicCmpXchgU32(&pPair->uIsTransmitting, 1, 0))
+        return VERR_TRY_AGAIN;
 
-    if ((pState->VPCI.uStatus & VPCI_STATUS_DRV_OK) == 0)
+    if ((pState->VPCI.uStatus & VPCI_STATUS_DRV_OK) == 0 || !pQueue)
     {
         Log(("%s Ignoring transmit requests from non-existent driver (status=0x%x).\n",
              INSTANCE(pState), pState->VPCI.uStatus));
-        return;
+        ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+        return VERR_INVALID_STATE;
     }
 
     PPDMINETWORKUP pDrv = pState->pDrv;
     if (pDrv)
     {
-        int rc = pDrv->pfnBeginXmit(pDrv, fOnWorkerThread);
+        /* What the driver could not take last time goes first. */
+        int rc = pStage ? vnetTxFlush(pState, pPair, fOnWorkerThread)
+                        : pDrv->pfnBeginXmit(pDrv, fOnWorkerThread);
         Assert(rc == VINF_SUCCESS || rc == VERR_TRY_AGAIN);
         if (rc == VERR_TRY_AGAIN)
         {
-            ASMAtomicWriteU32(&pState->uIsTransmitting, 0);
-            return;
+            ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+            return VERR_TRY_AGAIN;
         }
     }
 
@@ -1064,13 +1556,36 @@ static void vnetTransmitPendingPackets(PVNETSTATE pState, PVQUEUE pQueue, bool f
         uHdrLen = sizeof(VNETHDR);
 
     Log3(("%s vnetTransmitPendingPackets: About to transmit %d pending packets\n", INSTANCE(pState),
-          vringReadAvailIndex(&pState->VPCI, &pState->pTxQueue->VRing) - pState->pTxQueue->uNextAvailIndex));
+          vringReadAvailIndex(&pState->VPCI, &pQueue->VRing) - pQueue->uNextAvailIndex));
 
     vpciSetWriteLed(&pState->VPCI, true);
 
+    /*
+     * If the driver takes several frames at once we queue them up here and
+     * only tell it and the guest about them once per batch.
+     */
+    PPDMSCATTERGATHER apSgBatch[PDMNETWORK_MAX_BATCH];
+    uint32_t          cSgBatch  = 0;
+    bool const        fBatch    = pDrv && (pStage || pDrv->pfnSendBufs);
+    bool              fUnsynced = false;
+    int               rcRet     = VINF_SUCCESS;
+
     VQUEUEELEM elem;
-    while (vqueueGet(&pState->VPCI, pQueue, &elem))
+    for (;;)
     {
+        if (   pStage
+            && (   pStage->cFrames >= RT_ELEMENTS(pStage->aFrames)
+                || pStage->cbUsed > sizeof(pStage->abData) - VNET_MAX_FRAME_SIZE))
+        {
+            vnetQueueSync(pState, pQueue);
+            fUnsynced = false;
+            rcRet = vnetTxFlush(pState, pPair, fOnWorkerThread);
+            if (RT_FAILURE(rcRet))
+                break; /* The rest stays in the queue until the driver has room. */
+        }
+        if (!vqueueGet(&pState->VPCI, pQueue, &elem))
+            break;
+
         unsigned int uOffset = 0;
         if (elem.nOut < 2 || elem.aSegsOut[0].cb != uHdrLen)
         {
@@ -1095,26 +1610,47 @@ static void vnetTransmitPendingPackets(PVNETSTATE pState, PVQUEUE pQueue, bool f
                                   &Hdr, sizeof(Hdr));
 
                 STAM_REL_COUNTER_INC(&pState->StatTransmitPackets);
+                STAM_COUNTER_INC(&pPair->StatTransmitPackets);
 
                 STAM_PROFILE_START(&pState->StatTransmitSend, a);
 
                 pGso = vnetSetupGsoCtx(&Gso, &Hdr);
                 /** @todo Optimize away the extra copying! (lazy bird) */
-                PPDMSCATTERGATHER pSgBuf;
-                int rc = pState->pDrv->pfnAllocBuf(pState->pDrv, uSize, pGso, &pSgBuf);
+                PPDMSCATTERGATHER pSgBuf = NULL;
+                uint8_t *pbFrame = NULL;
+                int rc;
+                if (pStage)
+                {
+                    /* There is always room for a frame of the maximum size. */
+                    rc = uSize <= VNET_MAX_FRAME_SIZE ? VINF_SUCCESS : VERR_BUFFER_OVERFLOW;
+                    pbFrame = &pStage->abData[pStage->cbUsed];
+                }
+                else
+                {
+                    rc = pState->pDrv->pfnAllocBuf(pState->pDrv, uSize, pGso, &pSgBuf);
+                    if (RT_FAILURE(rc) && cSgBatch)
+                    {
+                        /* The queued frames may be holding the space we need. */
+                        pDrv->pfnSendBufs(pDrv, apSgBatch, cSgBatch, fOnWorkerThread);
+                        cSgBatch = 0;
+                        rc = pState->pDrv->pfnAllocBuf(pState->pDrv, uSize, pGso, &pSgBuf);
+                    }
+                    if (RT_SUCCESS(rc))
+                    {
+                        Assert(pSgBuf->cSegs == 1);
+                        pbFrame = (uint8_t *)pSgBuf->aSegs[0].pvSeg;
+                    }
+                }
                 if (RT_SUCCESS(rc))
                 {
-                    Assert(pSgBuf->cSegs == 1);
                     /* Assemble a complete frame. */
                     for (unsigned int i = 1; i < elem.nOut; i++)
                     {
                         PDMDevHlpPhysRead(pState->VPCI.CTX_SUFF(pDevIns), elem.aSegsOut[i].addr,
-                                          ((uint8_t*)pSgBuf->aSegs[0].pvSeg) + uOffset,
-                                          elem.aSegsOut[i].cb);
+                                          pbFrame + uOffset, elem.aSegsOut[i].cb);
                         uOffset += elem.aSegsOut[i].cb;
                     }
-                    pSgBuf->cbUsed = uSize;
-                    vnetPacketDump(pState, (uint8_t*)pSgBuf->aSegs[0].pvSeg, uSize, "--> Outgoing");
+                    vnetPacketDump(pState, pbFrame, uSize, "--> Outgoing");
                     if (pGso)
                     {
                         /* Some guests (RHEL) may report HdrLen excluding transport layer header! */
@@ -1131,14 +1667,15 @@ static void vnetTransmitPendingPackets(PVNETSTATE pState, PVQUEUE pQueue, bool f
                                 case PDMNETWORKGSOTYPE_IPV4_TCP:
                                 case PDMNETWORKGSOTYPE_IPV6_TCP:
                                     pGso->cbHdrsTotal = Hdr.u16CSumStart +
-                                        ((PRTNETTCP)(((uint8_t*)pSgBuf->aSegs[0].pvSeg) + Hdr.u16CSumStart))->th_off * 4;
+                                        ((PRTNETTCP)(pbFrame + Hdr.u16CSumStart))->th_off * 4;
                                     break;
                                 case PDMNETWORKGSOTYPE_IPV4_UDP:
                                     pGso->cbHdrsTotal = Hdr.u16CSumStart + sizeof(RTNETUDP);
                                     break;
                             }
                             /* Update GSO structure embedded into the frame */
-                            ((PPDMNETWORKGSO)pSgBuf->pvUser)->cbHdrsTotal = pGso->cbHdrsTotal;
+                            if (pSgBuf)
+                                ((PPDMNETWORKGSO)pSgBuf->pvUser)->cbHdrsTotal = pGso->cbHdrsTotal;
                             Log4(("%s vnetTransmitPendingPackets: adjusted HdrLen to %d.\n",
                                   INSTANCE(pState), pGso->cbHdrsTotal));
                         }
@@ -1153,28 +1690,84 @@ static void vnetTransmitPendingPackets(PVNETSTATE pState, PVQUEUE pQueue, bool f
                         /*
                          * This is not GSO frame but checksum offloading is requested.
                          */
-                        vnetCompleteChecksum((uint8_t*)pSgBuf->aSegs[0].pvSeg, uSize,
-                                             Hdr.u16CSumStart, Hdr.u16CSumOffset);
+                        vnetCompleteChecksum(pbFrame, uSize, Hdr.u16CSumStart, Hdr.u16CSumOffset);
                     }
 
-                    rc = pState->pDrv->pfnSendBuf(pState->pDrv, pSgBuf, false);
+                    if (pStage)
+                    {
+                        uint32_t iFrame = pStage->cFrames++;
+                        pStage->aFrames[iFrame].off  = pStage->cbUsed;
+                        pStage->aFrames[iFrame].cb   = uSize;
+                        pStage->aFrames[iFrame].fGso = pGso != NULL;
+                        if (pGso)
+                            pStage->aFrames[iFrame].Gso = *pGso;
+                        pStage->cbUsed += uSize;
+                    }
+                    else
+                    {
+                        pSgBuf->cbUsed = uSize;
+                        if (fBatch)
+                            apSgBatch[cSgBatch++] = pSgBuf;
+                        else
+                            rc = pState->pDrv->pfnSendBuf(pState->pDrv, pSgBuf, fOnWorkerThread);
+                    }
                 }
                 else
                     LogRel(("virtio-net: failed to allocate SG buffer: size=%u rc=%Rrc\n", uSize, rc));
 
-                STAM_PROFILE_STOP(&pState->StatTransmitSend, a);
+                if (!pStage) /* vnetTxFlush does the sending */
+                    STAM_PROFILE_STOP(&pState->StatTransmitSend, a);
                 STAM_REL_COUNTER_ADD(&pState->StatTransmitBytes, uOffset);
             }
         }
         vqueuePut(&pState->VPCI, pQueue, &elem, sizeof(VNETHDR) + uOffset);
-        vqueueSync(&pState->VPCI, pQueue);
+        if (cSgBatch >= RT_ELEMENTS(apSgBatch))
+        {
+            pDrv->pfnSendBufs(pDrv, apSgBatch, cSgBatch, fOnWorkerThread);
+            cSgBatch = 0;
+        }
+        if (!fBatch || (!pStage && !cSgBatch))
+        {
+            vnetQueueSync(pState, pQueue);
+            fUnsynced = false;
+        }
+        else
+            fUnsynced = true;
         STAM_PROFILE_ADV_STOP(&pState->StatTransmit, a);
     }
+    if (cSgBatch)
+        pDrv->pfnSendBufs(pDrv, apSgBatch, cSgBatch, fOnWorkerThread);
+    if (fUnsynced)
+        vnetQueueSync(pState, pQueue);
     vpciSetWriteLed(&pState->VPCI, false);
 
-    if (pDrv)
+    if (pStage)
+    {
+        if (RT_SUCCESS(rcRet))
+            rcRet = vnetTxFlush(pState, pPair, fOnWorkerThread);
+    }
+    else if (pDrv)
         pDrv->pfnEndXmit(pDrv);
-    ASMAtomicWriteU32(&pState->uIsTransmitting, 0);
+    ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+    return rcRet;
+}
+
+/**
+ * Looks up the queue pair a TX queue belongs to.
+ *
+ * @returns The queue pair, NULL if the queue is not one of the active TX
+ *          queues (e.g. a stale kick while the guest re-arranges the queues).
+ * @param   pState          The device state structure.
+ * @param   pQueue          The queue, see vnetSetupQueues for the layout.
+ */
+static PVNETQUEUEPAIR vnetTxQueuePair(PVNETSTATE pState, PVQUEUE pQueue)
+{
+    unsigned iPair = (unsigned)(pQueue - &pState->VPCI.Queues[0]) / 2;
+    if (   iPair < RT_ELEMENTS(pState->aQueuePairs)
+        && pState->aQueuePairs[iPair].pTxQueue == pQueue)
+        return &pState->aQueuePairs[iPair];
+    Log(("%s vnetTxQueuePair: %s is not a TX queue\n", INSTANCE(pState), pQueue->pcszName));
+    return NULL;
 }
 
 /**
@@ -1183,7 +1776,82 @@ static void vnetTransmitPendingPackets(PVNETSTATE pState, PVQUEUE pQueue, bool f
 static DECLCALLBACK(void) vnetNetworkDown_XmitPending(PPDMINETWORKDOWN pInterface)
 {
     VNETSTATE *pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
-    vnetTransmitPendingPackets(pThis, pThis->pTxQueue, false /*fOnWorkerThread*/);
+    if (pThis->aQueuePairs[0].pTxThread)
+    {
+        uint16_t const cPairs = pThis->cActivePairs;
+        for (uint16_t i = 0; i < cPairs; i++)
+            RTSemEventSignal(pThis->aQueuePairs[i].hEventTxKick);
+    }
+    else if (pThis->aQueuePairs[0].pTxQueue)
+        vnetTransmitPendingPackets(pThis, &pThis->aQueuePairs[0], false /*fOnWorkerThread*/);
+}
+
+/**
+ * The transmit thread of a queue pair, used when there is more than one pair.
+ *
+ * The threads read their frames out of guest memory side by side and only
+ * queue up on the transmit session of the driver to hand them over. Guest
+ * notifications for the queue are kept off while it is being drained, so a
+ * guest pushing frames at a high rate only kicks us once per burst. When the
+ * driver is busy we wait for it to call pfnXmitPending or for the pair holding
+ * the session to end it, with a timeout for drivers that don't call back.
+ *
+ * @returns VINF_SUCCESS.
+ * @param   pDevIns     The device instance.
+ * @param   pThread     The thread.
+ */
+static DECLCALLBACK(int) vnetTxThread(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    PVNETSTATE     pState = PDMINS_2_DATA(pDevIns, PVNETSTATE);
+    PVNETQUEUEPAIR pPair  = (PVNETQUEUEPAIR)pThread->pvUser;
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        bool    fBusy  = false;
+        PVQUEUE pQueue = pPair->pTxQueue;
+        if (   pQueue
+            && (unsigned)(pPair - &pState->aQueuePairs[0]) < pState->cActivePairs)
+        {
+            /* Staged frames left over from a busy driver count as work too. */
+            while (   (   vqueueIsReady(&pState->VPCI, pQueue)
+                       || pPair->pTxStage->cFrames)
+                   && pThread->enmState == PDMTHREADSTATE_RUNNING)
+            {
+                vnetQueueSetNotification(pState, pQueue, false);
+                int rc = vnetTransmitPendingPackets(pState, pPair, true /*fOnWorkerThread*/);
+                vnetQueueSetNotification(pState, pQueue, true);
+                if (rc == VERR_TRY_AGAIN)
+                {
+                    fBusy = true;
+                    break;
+                }
+                if (RT_FAILURE(rc) || vqueueIsEmpty(&pState->VPCI, pQueue))
+                    break; /* Re-check after enabling notification closes the race with the guest. */
+            }
+        }
+
+        RTSemEventWait(pPair->hEventTxKick, fBusy ? VNET_TX_RETRY_MS : RT_INDEFINITE_WAIT);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Unblocks the transmit thread of a queue pair so it can respond to a state
+ * change.
+ *
+ * @returns VBox status code.
+ * @param   pDevIns     The device instance.
+ * @param   pThread     The thread.
+ */
+static DECLCALLBACK(int) vnetTxThreadWakeUp(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    PVNETQUEUEPAIR pPair = (PVNETQUEUEPAIR)pThread->pvUser;
+    NOREF(pDevIns);
+    return RTSemEventSignal(pPair->hEventTxKick);
 }
 
 #ifdef VNET_TX_DELAY
@@ -1191,18 +1859,27 @@ static DECLCALLBACK(void) vnetNetworkDown_XmitPending(PPDMINETWORKDOWN pInterfac
 static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
 {
     VNETSTATE *pState = (VNETSTATE*)pvState;
+    PVNETQUEUEPAIR pPair = vnetTxQueuePair(pState, pQueue);
+
+    if (!pPair)
+        return;
+    if (pPair->pTxThread)
+    {
+        RTSemEventSignal(pPair->hEventTxKick);
+        return;
+    }
 
     if (TMTimerIsActive(pState->CTX_SUFF(pTxTimer)))
     {
         int rc = TMTimerStop(pState->CTX_SUFF(pTxTimer));
         Log3(("%s vnetQueueTransmit: Got kicked with notification disabled, "
               "re-enable notification and flush TX queue\n", INSTANCE(pState)));
-        vnetTransmitPendingPackets(pState, pQueue, false /*fOnWorkerThread*/);
+        vnetTransmitPendingPackets(pState, pPair, false /*fOnWorkerThread*/);
         if (RT_FAILURE(vnetCsEnter(pState, VERR_SEM_BUSY)))
             LogRel(("vnetQueueTransmit: Failed to enter critical section!/n"));
         else
         {
-            vringSetNotification(&pState->VPCI, &pState->pTxQueue->VRing, true);
+            vringSetNotification(&pState->VPCI, &pQueue->VRing, true);
             vnetCsLeave(pState);
         }
     }
@@ -1212,7 +1889,7 @@ static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
             LogRel(("vnetQueueTransmit: Failed to enter critical section!/n"));
         else
         {
-            vringSetNotification(&pState->VPCI, &pState->pTxQueue->VRing, false);
+            vringSetNotification(&pState->VPCI, &pQueue->VRing, false);
             TMTimerSetMicro(pState->CTX_SUFF(pTxTimer), VNET_TX_DELAY);
             pState->u64NanoTS = RTTimeNanoTS();
             vnetCsLeave(pState);
@@ -1245,13 +1922,17 @@ static DECLCALLBACK(void) vnetTxTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, void
             u32MicroDiff, pState->u32AvgDiff, pState->u32MinDiff, pState->u32MaxDiff));
 
 //    Log3(("%s vnetTxTimer: Expired\n", INSTANCE(pState)));
-    vnetTransmitPendingPackets(pState, pState->pTxQueue, false /*fOnWorkerThread*/);
+    /* The timer is only used when the first pair transmits on EMT. */
+    PVNETQUEUEPAIR pPair = &pState->aQueuePairs[0];
+    if (!pPair->pTxQueue)
+        return;
+    vnetTransmitPendingPackets(pState, pPair, false /*fOnWorkerThread*/);
     if (RT_FAILURE(vnetCsEnter(pState, VERR_SEM_BUSY)))
     {
         LogRel(("vnetTxTimer: Failed to enter critical section!/n"));
         return;
     }
-    vringSetNotification(&pState->VPCI, &pState->pTxQueue->VRing, true);
+    vringSetNotification(&pState->VPCI, &pPair->pTxQueue->VRing, true);
     vnetCsLeave(pState);
 }
 
@@ -1260,8 +1941,14 @@ static DECLCALLBACK(void) vnetTxTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, void
 static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
 {
     VNETSTATE *pState = (VNETSTATE*)pvState;
+    PVNETQUEUEPAIR pPair = vnetTxQueuePair(pState, pQueue);
 
-    vnetTransmitPendingPackets(pState, pQueue, false /*fOnWorkerThread*/);
+    if (!pPair)
+        return;
+    if (pPair->pTxThread)
+        RTSemEventSignal(pPair->hEventTxKick);
+    else
+        vnetTransmitPendingPackets(pState, pPair, false /*fOnWorkerThread*/);
 }
 
 #endif /* !VNET_TX_DELAY */
@@ -1419,6 +2106,37 @@ static uint8_t vnetControlVlan(PVNETSTATE pState, PVNETCTLHDR pCtlHdr, PVQUEUEEL
     return u8Ack;
 }
 
+static uint8_t vnetControlMq(PVNETSTATE pState, PVNETCTLHDR pCtlHdr, PVQUEUEELEM pElem)
+{
+    uint16_t cPairs;
+
+    if (   pCtlHdr->u8Command != VNET_CTRL_CMD_MQ_VQ_PAIRS_SET
+        || !(pState->VPCI.uGuestFeatures & VNET_F_MQ)
+        || pElem->nOut != 2
+        || pElem->aSegsOut[1].cb != sizeof(cPairs))
+    {
+        Log(("%s vnetControlMq: Bad command or segment layout "
+             "(u8Command=%u nOut=%u cb=%u)\n", INSTANCE(pState),
+             pCtlHdr->u8Command, pElem->nOut, pElem->aSegsOut[1].cb));
+        return VNET_ERROR;
+    }
+
+    PDMDevHlpPhysRead(pState->VPCI.CTX_SUFF(pDevIns),
+                      pElem->aSegsOut[1].addr,
+                      &cPairs, sizeof(cPairs));
+    if (cPairs < 1 || cPairs > pState->cQueuePairs)
+    {
+        Log(("%s vnetControlMq: Number of queue pairs is out of range "
+             "(%u, max %u)\n", INSTANCE(pState), cPairs, pState->cQueuePairs));
+        return VNET_ERROR;
+    }
+
+    Log(("%s vnetControlMq: %u queue pairs active\n", INSTANCE(pState), cPairs));
+    ASMAtomicWriteU16(&pState->cActivePairs, cPairs);
+    vnetWakeupReceive(pState->VPCI.CTX_SUFF(pDevIns));
+    return VNET_OK;
+}
+
 
 static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
 {
@@ -1461,6 +2179,9 @@ static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
                 case VNET_CTRL_CLS_VLAN:
                     u8Ack = vnetControlVlan(pState, &CtlHdr, &elem);
                     break;
+                case VNET_CTRL_CLS_MQ:
+                    u8Ack = vnetControlMq(pState, &CtlHdr, &elem);
+                    break;
                 default:
                     u8Ack = VNET_ERROR;
             }
@@ -1471,8 +2192,43 @@ static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
                                &u8Ack, sizeof(u8Ack));
         }
         vqueuePut(&pState->VPCI, pQueue, &elem, sizeof(u8Ack));
-        vqueueSync(&pState->VPCI, pQueue);
+        vnetQueueSync(pState, pQueue);
+    }
+}
+
+/**
+ * Arranges the queues for the given number of queue pairs.
+ *
+ * The pairs come first as rx0, tx0, rx1, tx1 and so on, followed by the
+ * control queue. With a single pair this is the layout of the original
+ * device, so guests not negotiating VNET_F_MQ see no difference. The ring
+ * addresses are left alone, this is called after the guest has set the
+ * features and when loading a saved state.
+ *
+ * @param   pState      The device state structure.
+ * @param   cPairs      The number of queue pairs.
+ */
+static void vnetSetupQueues(PVNETSTATE pState, uint16_t cPairs)
+{
+    static const char * const s_apszRxNames[VNET_MAX_QUEUE_PAIRS] = { "RX0", "RX1", "RX2", "RX3" };
+    static const char * const s_apszTxNames[VNET_MAX_QUEUE_PAIRS] = { "TX0", "TX1", "TX2", "TX3" };
+
+    Assert(cPairs >= 1 && cPairs <= pState->cQueuePairs);
+    for (unsigned i = 0; i < RT_ELEMENTS(pState->aQueuePairs); i++)
+    {
+        PVNETQUEUEPAIR pPair = &pState->aQueuePairs[i];
+        if (i < cPairs)
+        {
+            pPair->pRxQueue = vpciSetQueue(&pState->VPCI, 2 * i,     256, vnetQueueReceive,  s_apszRxNames[i]);
+            pPair->pTxQueue = vpciSetQueue(&pState->VPCI, 2 * i + 1, 256, vnetQueueTransmit, s_apszTxNames[i]);
+        }
+        else
+            pPair->pRxQueue = pPair->pTxQueue = NULL;
     }
+    pState->pCtlQueue = vpciSetQueue(&pState->VPCI, 2 * cPairs, 16, vnetQueueControl, "CTL");
+    pState->VPCI.nQueues = 2 * cPairs + 1;
+    /* The guest starts with one pair and enables the others through the control queue. */
+    ASMAtomicWriteU16(&pState->cActivePairs, 1);
 }
 
 /**
@@ -1516,6 +2272,27 @@ static DECLCALLBACK(int) vnetSavePrep(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     if (RT_UNLIKELY(rc != VINF_SUCCESS))
         return rc;
     vnetCsRxLeave(pState);
+
+    /*
+     * The moderation timers are not saved. Deliver the receive interrupts
+     * they hold back now, so they end up in the saved ISR and the interrupt
+     * line instead of being lost.
+     */
+    rc = vnetCsEnter(pState, VERR_SEM_BUSY);
+    if (RT_UNLIKELY(rc != VINF_SUCCESS))
+        return rc;
+    for (unsigned i = 0; i < pState->cActivePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pState->aQueuePairs[i];
+        if (   pPair->pRxIntTimer
+            && TMTimerIsActive(pPair->pRxIntTimer))
+        {
+            TMTimerStop(pPair->pRxIntTimer);
+            netIntModDelivered(&pPair->RxIntMod, TMTimerGet(pPair->pRxIntTimer));
+            vqueueNotify(&pState->VPCI, pPair->pRxQueue);
+        }
+    }
+    vnetCsLeave(pState);
     return VINF_SUCCESS;
 }
 
@@ -1550,6 +2327,8 @@ static DECLCALLBACK(int) vnetSaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     AssertRCReturn(rc, rc);
     rc = SSMR3PutMem( pSSM, pState->aVlanFilter, sizeof(pState->aVlanFilter));
     AssertRCReturn(rc, rc);
+    rc = SSMR3PutU16( pSSM, pState->cActivePairs);
+    AssertRCReturn(rc, rc);
     Log(("%s State has been saved\n", INSTANCE(pState)));
     return VINF_SUCCESS;
 }
@@ -1624,6 +2403,14 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
 
     if (uPass == SSM_PASS_FINAL)
     {
+        /* Put the restored rings back into the queue layout the guest negotiated. */
+        uint16_t cPairs = (pState->VPCI.uGuestFeatures & VNET_F_MQ) ? pState->cQueuePairs : 1;
+        if (pState->VPCI.nQueues != 2U * cPairs + 1U)
+            return SSMR3SetCfgError(pSSM, RT_SRC_POS,
+                                    N_("The number of queues differs: saved=%u config=%u"),
+                                    pState->VPCI.nQueues, 2U * cPairs + 1U);
+        vnetSetupQueues(pState, cPairs);
+
         rc = SSMR3GetMem( pSSM, pState->config.mac.au8,
                           sizeof(pState->config.mac));
         AssertRCReturn(rc, rc);
@@ -1659,6 +2446,17 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
             if (pState->pDrv)
                 pState->pDrv->pfnSetPromiscuousMode(pState->pDrv, true);
         }
+
+        if (uVersion > VIRTIO_SAVEDSTATE_VERSION_PRE_MSIX)
+        {
+            uint16_t cActivePairs;
+            rc = SSMR3GetU16(pSSM, &cActivePairs);
+            AssertRCReturn(rc, rc);
+            AssertLogRelMsgReturn(cActivePairs >= 1 && cActivePairs <= cPairs,
+                                  ("%u active queue pairs\n", cActivePairs),
+                                  VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+            pState->cActivePairs = cActivePairs;
+        }
     }
 
     return rc;
@@ -1903,6 +2701,25 @@ static DECLCALLBACK(int) vnetDestruct(PPDMDEVINS pDevIns)
         pState->hEventMoreRxDescAvail = NIL_RTSEMEVENT;
     }
 
+    /* Stop the transmit threads before their semaphores and stages go away. */
+    for (unsigned i = 0; i < RT_ELEMENTS(pState->aQueuePairs); i++)
+    {
+        PVNETQUEUEPAIR pPair = &pState->aQueuePairs[i];
+        if (pPair->pTxThread)
+        {
+            int rc = PDMR3ThreadDestroy(pPair->pTxThread, NULL);
+            AssertRC(rc);
+            pPair->pTxThread = NULL;
+        }
+        if (pPair->hEventTxKick != NIL_RTSEMEVENT)
+        {
+            RTSemEventDestroy(pPair->hEventTxKick);
+            pPair->hEventTxKick = NIL_RTSEMEVENT;
+        }
+        RTMemFree(pPair->pTxStage);
+        pPair->pTxStage = NULL;
+    }
+
     // if (PDMCritSectIsInitialized(&pState->csRx))
     //     PDMR3CritSectDelete(&pState->csRx);
 
@@ -1918,23 +2735,36 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     int        rc;
     PDMDEV_CHECK_VERSIONS_RETURN(pDevIns);
 
+    /* The number of queue pairs determines the number of MSI-X vectors. */
+    rc = CFGMR3QueryU16Def(pCfg, "QueuePairs", &pState->cQueuePairs, 1);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'QueuePairs'"));
+    if (pState->cQueuePairs < 1 || pState->cQueuePairs > VNET_MAX_QUEUE_PAIRS)
+        return PDMDevHlpVMSetError(pDevIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("Configuration error: 'QueuePairs' must be between 1 and %u"),
+                                   VNET_MAX_QUEUE_PAIRS);
+
     /* Initialize PCI part first. */
     pState->VPCI.IBase.pfnQueryInterface    = vnetQueryInterface;
     rc = vpciConstruct(pDevIns, &pState->VPCI, iInstance,
                        VNET_NAME_FMT, VNET_PCI_SUBSYSTEM_ID,
-                       VNET_PCI_CLASS, VNET_N_QUEUES);
-    pState->pRxQueue  = vpciAddQueue(&pState->VPCI, 256, vnetQueueReceive,  "RX ");
-    pState->pTxQueue  = vpciAddQueue(&pState->VPCI, 256, vnetQueueTransmit, "TX ");
-    pState->pCtlQueue = vpciAddQueue(&pState->VPCI, 16,  vnetQueueControl,  "CTL");
+                       VNET_PCI_CLASS, VNET_N_QUEUES,
+                       /* One vector per queue plus one for configuration changes. */
+                       pState->cQueuePairs > 1 ? 2 * pState->cQueuePairs + 2 : 0);
+    vnetSetupQueues(pState, 1);
 
     Log(("%s Constructing new instance\n", INSTANCE(pState)));
 
     pState->hEventMoreRxDescAvail = NIL_RTSEMEVENT;
+    for (unsigned i = 0; i < RT_ELEMENTS(pState->aQueuePairs); i++)
+        pState->aQueuePairs[i].hEventTxKick = NIL_RTSEMEVENT;
 
     /*
      * Validate configuration.
      */
-    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "LineSpeed\0"))
+    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "LineSpeed\0" "QueuePairs\0"
+                                    "AdaptiveIntModeration\0"))
                     return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
                                             N_("Invalid configuration for VirtioNet device"));
 
@@ -1948,18 +2778,27 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     if (RT_FAILURE(rc))
         return PDMDEV_SET_ERROR(pDevIns, rc,
                                 N_("Configuration error: Failed to get the value of 'CableConnected'"));
+    bool fAdaptiveIntMod;
+    rc = CFGMR3QueryBoolDef(pCfg, "AdaptiveIntModeration", &fAdaptiveIntMod, false);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'AdaptiveIntModeration'"));
 
     /* Initialize PCI config space */
     memcpy(pState->config.mac.au8, pState->macConfigured.au8, sizeof(pState->config.mac.au8));
     pState->config.uStatus = 0;
+    pState->config.uMaxVirtqueuePairs = pState->cQueuePairs;
 
     /* Initialize state structure */
     pState->u32PktNo     = 1;
+    for (unsigned i = 0; i < RT_ELEMENTS(pState->aQueuePairs); i++)
+        netIntModInit(&pState->aQueuePairs[i].RxIntMod, fAdaptiveIntMod && i < pState->cQueuePairs);
 
     /* Interfaces */
     pState->INetworkDown.pfnWaitReceiveAvail = vnetNetworkDown_WaitReceiveAvail;
     pState->INetworkDown.pfnReceive          = vnetNetworkDown_Receive;
     pState->INetworkDown.pfnReceiveGso       = vnetNetworkDown_ReceiveGso;
+    pState->INetworkDown.pfnReceiveFrames    = vnetNetworkDown_ReceiveFrames;
     pState->INetworkDown.pfnXmitPending      = vnetNetworkDown_XmitPending;
 
     pState->INetworkConfig.pfnGetMac         = vnetGetMac;
@@ -1975,7 +2814,7 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
 
     /* Map our ports to IO space. */
     rc = PDMDevHlpPCIIORegionRegister(pDevIns, 0,
-                                      VPCI_CONFIG + sizeof(VNetPCIConfig),
+                                      VPCI_CONFIG_MSIX + sizeof(VNetPCIConfig),
                                       PCI_ADDRESS_SPACE_IO, vnetMap);
     if (RT_FAILURE(rc))
         return rc;
@@ -2004,6 +2843,19 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     if (RT_FAILURE(rc))
         return rc;
 
+    /* Create Receive Interrupt Moderation Timers */
+    for (unsigned i = 0; i < pState->cQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pState->aQueuePairs[i];
+        if (!pPair->RxIntMod.fEnabled)
+            continue;
+        rc = PDMDevHlpTMTimerCreate(pDevIns, TMCLOCK_VIRTUAL, vnetRxIntTimer, pPair,
+                                    TMTIMER_FLAGS_NO_CRIT_SECT,
+                                    "VirtioNet RX Interrupt Moderation Timer", &pPair->pRxIntTimer);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
 #ifdef VNET_TX_DELAY
     /* Create Transmit Delay Timer */
     rc = PDMDevHlpTMTimerCreate(pDevIns, TMCLOCK_VIRTUAL, vnetTxTimer, pState,
@@ -2043,6 +2895,30 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     if (RT_FAILURE(rc))
         return rc;
 
+    /*
+     * With more than one queue pair the guest kicks the transmit queues from
+     * different CPUs, every transmit queue gets a thread of its own.
+     */
+    if (pState->cQueuePairs > 1)
+    {
+        for (unsigned i = 0; i < pState->cQueuePairs; i++)
+        {
+            PVNETQUEUEPAIR pPair = &pState->aQueuePairs[i];
+            pPair->pTxStage = (PVNETTXSTAGE)RTMemAllocZ(sizeof(VNETTXSTAGE));
+            if (!pPair->pTxStage)
+                return VERR_NO_MEMORY;
+            rc = RTSemEventCreate(&pPair->hEventTxKick);
+            if (RT_FAILURE(rc))
+                return rc;
+            char szName[16];
+            RTStrPrintf(szName, sizeof(szName), "VNet%dTx%u", iInstance, i);
+            rc = PDMDevHlpThreadCreate(pDevIns, &pPair->pTxThread, pPair, vnetTxThread,
+                                       vnetTxThreadWakeUp, 0, RTTHREADTYPE_IO, szName);
+            if (RT_FAILURE(rc))
+                return PDMDEV_SET_ERROR(pDevIns, rc, N_("Failed to create the transmit thread"));
+        }
+    }
+
     rc = vnetReset(pState);
     AssertRC(rc);
 
@@ -2059,7 +2935,24 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatRxOverflowWakeup,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Nr of RX overflow wakeups",          "/Devices/VNet%d/RxOverflowWakeup", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatTransmit,           STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling transmits in HC",          "/Devices/VNet%d/Transmit/Total", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatTransmitSend,       STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling send transmit in HC",      "/Devices/VNet%d/Transmit/Send", iInstance);
+    for (unsigned i = 0; i < pState->cQueuePairs; i++)
+    {
+        PDMDevHlpSTAMRegisterF(pDevIns, &pState->aQueuePairs[i].StatReceivePackets,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT, "Number of packets steered to the pair", "/Devices/VNet%d/Queue%u/Receive", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pState->aQueuePairs[i].StatTransmitPackets, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT, "Number of packets sent by the pair",    "/Devices/VNet%d/Queue%u/Transmit", iInstance, i);
+    }
 #endif /* VBOX_WITH_STATISTICS */
+    for (unsigned i = 0; i < pState->cQueuePairs; i++)
+        if (pState->cQueuePairs > 1)
+            PDMDevHlpSTAMRegisterF(pDevIns, &pState->aQueuePairs[i].StatReceiveOverflows, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT, "Frames dropped because the RX queue was full", "/Devices/VNet%d/Queue%u/ReceiveOverflows", iInstance, i);
+    for (unsigned i = 0; i < pState->cQueuePairs; i++)
+    {
+        PNETINTMOD pMod = &pState->aQueuePairs[i].RxIntMod;
+        if (!pMod->fEnabled)
+            continue;
+        PDMDevHlpSTAMRegisterF(pDevIns, &pMod->cIntsPerSec,   STAMTYPE_U32,     STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES, "Receive interrupts per second",      "/Devices/VNet%d/Queue%u/IntMod/IntsPerSec", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pMod->cFramesPerInt, STAMTYPE_U32,     STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES, "Frames per receive interrupt",       "/Devices/VNet%d/Queue%u/IntMod/FramesPerInt", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pMod->StatDeferred,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES, "Interrupts held back by moderation", "/Devices/VNet%d/Queue%u/IntMod/Deferred", iInstance, i);
+    }
 
     return VINF_SUCCESS;
 }
@@ -95,7 +95,9 @@ typedef struct DRVINTNET
     PDMIBASER0                      IBaseR0;
     /** Ring-3 base interface for the raw-mode context. */
     PDMIBASERC                      IBaseRC;
+#if HC_ARCH_BITS == 64
     RTR3PTR                         R3PtrAlignment;
+#endif
 
     /** The network interface for the ring-0 context. */
     PDMINETWORKUPR0                 INetworkUpR0;
@@ -140,8 +142,12 @@ typedef struct DRVINTNET
     /** Set if data transmission should start immediately and deactivate
      * as late as possible. */
     bool                            fActivateEarlyDeactivateLate;
+    /** Set when the QoS rate limiter of the interface left frames in the send
+     * ring, the xmit thread will then retry once INTNETBUF::cNsQoSDelay has
+     * passed. */
+    bool volatile                   fXmitQoSDelayed;
     /** Padding. */
-    bool                            afReserved[HC_ARCH_BITS == 64 ? 3 : 3];
+    bool                            afReserved[HC_ARCH_BITS == 64 ? 2 : 2];
     /** Scratch space for holding the ring-0 scatter / gather descriptor.
      * The PDMSCATTERGATHER::fFlags member is used to indicate whether it is in
      * use or not.  Always accessed while owning the XmitLock. */
@@ -167,6 +173,10 @@ typedef struct DRVINTNET
     STAMCOUNTER                     StatXmitWakeupR3;
     /** The times the xmit thread has been told to process the ring. */
     STAMCOUNTER                     StatXmitProcessRing;
+    /** Number of PDMINETWORKUP::pfnSendBufs batches. */
+    STAMCOUNTER                     StatSentBatch;
+    /** Number of PDMINETWORKDOWN::pfnReceiveFrames batches. */
+    STAMCOUNTER                     StatReceivedBatch;
 #ifdef VBOX_WITH_STATISTICS
     /** Profiling packet transmit runs. */
     STAMPROFILE                     StatTransmit;
@@ -306,6 +316,13 @@ DECLINLINE(int) drvIntNetProcessXmit(PDRVINTNET pThis)
         rc = VINF_SUCCESS;
     }
 #endif
+
+    /* Frames left in the ring were delayed by QoS, get the xmit thread to
+       retry them. */
+    if (    RT_SUCCESS(rc)
+        &&  IntNetRingHasMoreToRead(&pThis->CTX_SUFF(pBuf)->Send)
+        &&  !ASMAtomicXchgBool(&pThis->fXmitQoSDelayed, true))
+        drvIntNetSignalXmit(pThis);
     return rc;
 }
 
@@ -519,6 +536,48 @@ PDMBOTHCBDECL(int) drvIntNetUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGAT
 }
 
 
+#ifdef IN_RING3
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnSendBufs}
+ */
+static DECLCALLBACK(int) drvR3IntNetUp_SendBufs(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER *papSgBufs, uint32_t cSgBufs,
+                                                bool fOnWorkerThread)
+{
+    PDRVINTNET  pThis = RT_FROM_MEMBER(pInterface, DRVINTNET, INetworkUpR3);
+    STAM_PROFILE_START(&pThis->StatTransmit, a);
+
+    Assert(cSgBufs > 0 && cSgBufs <= PDMNETWORK_MAX_BATCH);
+    Assert(PDMCritSectIsOwner(&pThis->XmitLock));
+    STAM_COUNTER_INC(&pThis->StatSentBatch);
+
+    /* Set an FTM checkpoint as this operation changes the state permanently. */
+    PDMDrvHlpFTSetCheckpoint(pThis->pDrvInsR3, FTMCHECKPOINTTYPE_NETWORK);
+
+    /*
+     * Commit the frames in allocation order, then push them all thru the
+     * switch with a single ring-0 call.
+     */
+    for (uint32_t i = 0; i < cSgBufs; i++)
+    {
+        PPDMSCATTERGATHER pSgBuf = papSgBufs[i];
+        AssertPtr(pSgBuf);
+        Assert(pSgBuf->fFlags == (PDMSCATTERGATHER_FLAGS_MAGIC | PDMSCATTERGATHER_FLAGS_OWNER_1));
+        Assert(pSgBuf->cbUsed <= pSgBuf->cbAvailable);
+        if (pSgBuf->pvUser)
+            STAM_COUNTER_INC(&pThis->StatSentGso);
+
+        IntNetRingCommitFrameEx(&pThis->pBufR3->Send, (PINTNETHDR)pSgBuf->pvAllocator, pSgBuf->cbUsed);
+        RTMemCacheFree(pThis->hSgCache, pSgBuf);
+    }
+    int rc = drvIntNetProcessXmit(pThis);
+
+    STAM_PROFILE_STOP(&pThis->StatTransmit, a);
+    return rc;
+}
+
+#endif /* IN_RING3 */
+
 /**
  * @interface_method_impl{PDMINETWORKUP,pfnEndXmit}
  */
@@ -620,9 +679,25 @@ static DECLCALLBACK(int) drvR3IntNetXmitThread(PPDMDRVINS pDrvIns, PPDMTHREAD pT
 
         /*
          * Block until we've got something to send or is supposed
-         * to leave the running state.
+         * to leave the running state.  Frames delayed by QoS are retried
+         * periodically for as long as there are any.
          */
-        int rc = SUPSemEventWaitNoResume(pThis->pSupDrvSession, pThis->hXmitEvt, RT_INDEFINITE_WAIT);
+        uint32_t cMillies = RT_INDEFINITE_WAIT;
+        if (ASMAtomicXchgBool(&pThis->fXmitQoSDelayed, false))
+        {
+            if (IntNetRingHasMoreToRead(&pThis->pBufR3->Send))
+            {
+                ASMAtomicWriteBool(&pThis->fXmitQoSDelayed, true);
+                uint64_t const cNsDelay = ASMAtomicReadU64(&pThis->pBufR3->cNsQoSDelay);
+                cMillies = (uint32_t)RT_MIN(RT_MAX((cNsDelay + RT_NS_1MS - 1) / RT_NS_1MS, 1), RT_MS_1SEC);
+            }
+        }
+        int rc = SUPSemEventWaitNoResume(pThis->pSupDrvSession, pThis->hXmitEvt, cMillies);
+        if (rc == VERR_TIMEOUT)
+        {
+            ASMAtomicUoWriteBool(&pThis->fXmitProcessRing, true);
+            rc = VINF_SUCCESS;
+        }
         AssertLogRelMsgReturn(RT_SUCCESS(rc) || rc == VERR_INTERRUPTED, ("%Rrc\n", rc), rc);
         if (RT_UNLIKELY(pThread->enmState != PDMTHREADSTATE_RUNNING))
             break;
@@ -714,7 +789,40 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
                 int rc = pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, 0);
                 if (rc == VINF_SUCCESS)
                 {
-                    if (u16Type == INTNETHDR_TYPE_FRAME)
+                    if (   u16Type == INTNETHDR_TYPE_FRAME
+                        && pThis->pIAboveNet->pfnReceiveFrames)
+                    {
+                        /*
+                         * A run of normal frames.  They are only skipped once the
+                         * device has taken them so the switch can't reuse their
+                         * ring space under our feet.  If the device runs out of
+                         * buffers half way we end up in the wait below on the
+                         * next round.
+                         */
+                        PDMNETWORKFRAME aFrames[PDMNETWORK_MAX_BATCH];
+                        uint32_t        cFrames = 0;
+                        PINTNETHDR      pHdrCur = pHdr;
+                        do
+                        {
+                            aFrames[cFrames].pvBuf = IntNetHdrGetFramePtr(pHdrCur, pBuf);
+                            aFrames[cFrames].cb    = pHdrCur->cbFrame;
+                            cFrames++;
+                        } while (   cFrames < RT_ELEMENTS(aFrames)
+                                 && (pHdrCur = IntNetRingGetFrameAfter(pRingBuf, pHdrCur)) != NULL
+                                 && pHdrCur->u16Type == INTNETHDR_TYPE_FRAME);
+                        LogFlow(("drvR3IntNetRecvRun: %u frames in a batch\n", cFrames));
+
+                        uint32_t cTaken = cFrames;
+                        rc = pThis->pIAboveNet->pfnReceiveFrames(pThis->pIAboveNet, aFrames, &cTaken);
+                        AssertMsg(RT_SUCCESS(rc) || rc == VERR_NET_NO_BUFFER_SPACE, ("%Rrc\n", rc));
+                        Assert(cTaken <= cFrames);
+                        STAM_COUNTER_INC(&pThis->StatReceivedBatch);
+
+                        /* skip to the first frame the device didn't take. */
+                        while (cTaken-- > 0)
+                            IntNetRingSkipFrame(pRingBuf);
+                    }
+                    else if (u16Type == INTNETHDR_TYPE_FRAME)
                     {
                         /*
                          * Normal frame.
@@ -1184,11 +1292,17 @@ static DECLCALLBACK(void) drvR3IntNetDestruct(PPDMDRVINS pDrvIns)
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatYieldsNok);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatLost);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatBadFrames);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatRecvWakeups);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatRecvWakeupsSaved);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatSend1);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatSend2);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatRecv1);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatRecv2);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatQoSDrops);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatQoSDelays);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceivedGso);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceivedBatch);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatSentBatch);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatSentGso);
 #ifdef VBOX_WITH_STATISTICS
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceive);
@@ -1335,6 +1449,7 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     pThis->INetworkUpR3.pfnAllocBuf                 = drvIntNetUp_AllocBuf;
     pThis->INetworkUpR3.pfnFreeBuf                  = drvIntNetUp_FreeBuf;
     pThis->INetworkUpR3.pfnSendBuf                  = drvIntNetUp_SendBuf;
+    pThis->INetworkUpR3.pfnSendBufs                 = drvR3IntNetUp_SendBufs;
     pThis->INetworkUpR3.pfnEndXmit                  = drvIntNetUp_EndXmit;
     pThis->INetworkUpR3.pfnSetPromiscuousMode       = drvIntNetUp_SetPromiscuousMode;
     pThis->INetworkUpR3.pfnNotifyLinkChanged        = drvR3IntNetUp_NotifyLinkChanged;
@@ -1361,7 +1476,11 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
                                   "|TrunkPolicyWire"
                                   "|IsService"
                                   "|IgnoreConnectFailure"
-                                  "|Workaround1",
+                                  "|Workaround1"
+                                  "|MaxBytesPerSec"
+                                  "|MaxFramesPerSec"
+                                  "|Priority"
+                                  "|BwGroup",
                                   "");
 
     /*
@@ -1652,6 +1771,52 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     if (fWorkaround1)
         OpenReq.fFlags |= INTNET_OPEN_FLAGS_WORKAROUND_1;
 
+    /** @cfgm{MaxBytesPerSec, uint64_t, 0}
+     * The max number of bytes per second the interface may send, 0 for no
+     * limit.  Main sets this from the bandwidth group of the adapter. */
+    INTNETIFSETQOSREQ SetQoSReq;
+    RT_ZERO(SetQoSReq);
+    rc = CFGMR3QueryU64Def(pCfg, "MaxBytesPerSec", &SetQoSReq.cbMaxPerSec, 0);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("Configuration error: Failed to get the \"MaxBytesPerSec\" value"));
+
+    /** @cfgm{MaxFramesPerSec, uint32_t, 0}
+     * The max number of frames per second the interface may send, 0 for no
+     * limit. */
+    rc = CFGMR3QueryU32Def(pCfg, "MaxFramesPerSec", &SetQoSReq.cMaxFramesPerSec, 0);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("Configuration error: Failed to get the \"MaxFramesPerSec\" value"));
+
+    /** @cfgm{Priority, string, "normal"}
+     * The QoS priority class of the frames sent by the interface: "low",
+     * "normal" or "high".  See INTNET_QOS_PRIORITY_XXX. */
+    char szPriority[16];
+    rc = CFGMR3QueryStringDef(pCfg, "Priority", szPriority, sizeof(szPriority), "normal");
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("Configuration error: Failed to get the \"Priority\" value"));
+    if (!strcmp(szPriority, "low"))
+        SetQoSReq.uPriority = INTNET_QOS_PRIORITY_LOW;
+    else if (!strcmp(szPriority, "normal"))
+        SetQoSReq.uPriority = INTNET_QOS_PRIORITY_NORMAL;
+    else if (!strcmp(szPriority, "high"))
+        SetQoSReq.uPriority = INTNET_QOS_PRIORITY_HIGH;
+    else
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("Configuration error: The \"Priority\" value \"%s\" is invalid, expected \"low\", \"normal\" or \"high\""),
+                                   szPriority);
+
+    /** @cfgm{BwGroup, string, ""}
+     * The bandwidth group the interface shares MaxBytesPerSec and
+     * MaxFramesPerSec with.  The adapters of the VM naming the same group
+     * share one limit, otherwise each has it for itself. */
+    rc = CFGMR3QueryStringDef(pCfg, "BwGroup", SetQoSReq.szGroup, sizeof(SetQoSReq.szGroup), "");
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("Configuration error: Failed to get the \"BwGroup\" value"));
+
     LogRel(("IntNet#%u: szNetwork={%s} enmTrunkType=%d szTrunk={%s} fFlags=%#x cbRecv=%u cbSend=%u fIgnoreConnectFailure=%RTbool\n",
             pDrvIns->iInstance, OpenReq.szNetwork, OpenReq.enmTrunkType, OpenReq.szTrunk, OpenReq.fFlags,
             OpenReq.cbRecv, OpenReq.cbSend, fIgnoreConnectFailure));
@@ -1741,6 +1906,26 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     pThis->pBufR3 = GetBufferPtrsReq.pRing3Buf;
     pThis->pBufR0 = GetBufferPtrsReq.pRing0Buf;
 
+    /*
+     * Apply the QoS settings if they differ from the defaults.
+     */
+    if (    SetQoSReq.cbMaxPerSec
+        ||  SetQoSReq.cMaxFramesPerSec
+        ||  SetQoSReq.uPriority != INTNET_QOS_PRIORITY_NORMAL)
+    {
+        LogRel(("IntNet#%u: QoS cbMaxPerSec=%RU64 cMaxFramesPerSec=%RU32 uPriority=%RU32 szGroup={%s}\n",
+                pDrvIns->iInstance, SetQoSReq.cbMaxPerSec, SetQoSReq.cMaxFramesPerSec, SetQoSReq.uPriority,
+                SetQoSReq.szGroup));
+        SetQoSReq.Hdr.u32Magic = SUPVMMR0REQHDR_MAGIC;
+        SetQoSReq.Hdr.cbReq    = sizeof(SetQoSReq);
+        SetQoSReq.pSession     = NIL_RTR0PTR;
+        SetQoSReq.hIf          = pThis->hIf;
+        rc = PDMDrvHlpSUPCallVMMR0Ex(pDrvIns, VMMR0_DO_INTNET_IF_SET_QOS, &SetQoSReq, sizeof(SetQoSReq));
+        if (RT_FAILURE(rc))
+            return PDMDrvHlpVMSetError(pDrvIns, rc, RT_SRC_POS,
+                                       N_("Failed to set the QoS parameters of the interface to '%s'"), pThis->szNetwork);
+    }
+
     /*
      * Register statistics.
      */
@@ -1752,17 +1937,22 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->Send.cStatFrames,   "Packets/Sent",         "Number of sent packets.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatReceivedGso,            "Packets/Received-Gso", "The GSO portion of the received packets.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatSentGso,                "Packets/Sent-Gso",     "The GSO portion of the sent packets.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatReceivedBatch,          "Packets/Received-Batches", "Number of frame batches passed up to the device.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatSentBatch,              "Packets/Sent-Batches", "Number of buffer batches sent by the device.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatSentR0,                 "Packets/Sent-R0",      "The ring-0 portion of the sent packets.");
 
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatLost,          "Packets/Lost",         "Number of lost packets.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatYieldsNok,     "YieldOk",              "Number of times yielding helped fix an overflow.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatYieldsOk,      "YieldNok",             "Number of times yielding didn't help fix an overflow.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatBadFrames,     "BadFrames",            "Number of bad frames seed by the consumers.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatRecvWakeups,   "Recv/Wakeups",         "Number of times the receive thread was woken up.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatRecvWakeupsSaved, "Recv/WakeupsSaved",  "Number of receive wakeups saved because the receive thread wasn't waiting.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatSend1,          "Send1",                "Profiling IntNetR0IfSend.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatSend2,          "Send2",                "Profiling sending to the trunk.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatRecv1,          "Recv1",                "Reserved for future receive profiling.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatRecv2,          "Recv2",                "Reserved for future receive profiling.");
-    PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatReserved,       "Reserved",             "Reserved for future use.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatQoSDrops,      "QoS/Drops",            "Number of sent frames dropped by QoS.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatQoSDelays,     "QoS/Delays",           "Number of times QoS delayed sending frames.");
 #ifdef VBOX_WITH_STATISTICS
     PDMDrvHlpSTAMRegProfileAdv(pDrvIns, &pThis->StatReceive,             "Receive",              "Profiling packet receive runs.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->StatTransmit,               "Transmit",             "Profiling packet transmit runs.");
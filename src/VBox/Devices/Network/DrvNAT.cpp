@@ -40,6 +40,16 @@
 
 #include "VBoxDD.h"
 
+/** The lwIP TCP engine is available (see the TcpEngine key).  It needs the
+ * lwIP stack built for DevINIP and POSIX sockets.  The lwIP stack is global,
+ * so only one NAT adapter per VM can use it: a second adapter configured with
+ * TcpEngine=lwip, or one next to DevINIP, fails the VM start with
+ * VERR_RESOURCE_BUSY. */
+#if defined(VBOX_WITH_INIP) && !defined(RT_OS_WINDOWS)
+# define DRVNAT_WITH_LWIP
+# include "DrvNATlwIP.h"
+#endif
+
 #ifndef RT_OS_WINDOWS
 # include <unistd.h>
 # include <fcntl.h>
@@ -51,6 +61,7 @@
 #endif
 #include <iprt/semaphore.h>
 #include <iprt/req.h>
+#include <iprt/memcache.h>
 
 #define COUNTERS_INIT
 #include "counters.h"
@@ -66,6 +77,12 @@
  */
 #define VBOX_NAT_DELAY_HACK
 
+/** Maximum number of NAT engines (flow shards) a driver instance can run. */
+#define DRVNAT_SHARDS_MAX 8
+
+/** The largest frame the NAT engine takes in one mbuf (16K jumbo cluster). */
+#define DRVNAT_FRAME_MAX (16 * _1K - 1)
+
 #define GET_EXTRADATA(pthis, node, name, rc, type, type_name, var)                                  \
 do {                                                                                                \
     (rc) = CFGMR3Query ## type((node), name, &(var));                                               \
@@ -123,6 +140,68 @@ do                                                      \
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
 *******************************************************************************/
+/**
+ * A slirp engine together with the thread driving it.
+ *
+ * The driver runs one or more of these.  Guest TCP and UDP flows are
+ * distributed over them by slirp_flow_select, so each engine owns its own
+ * sockets, mbuf zones and timers and no locking between them is required.
+ * Shard 0 is the primary engine which additionally handles ARP requests,
+ * DHCP, DNS, TFTP, ICMP and port forwarding; the secondary engines are
+ * created without the DNS configuration (see slirp_init).
+ */
+typedef struct DRVNATSHARD
+{
+    /** Pointer to the driver instance data. */
+    struct DRVNAT          *pThis;
+    /** NAT state of this engine. */
+    PNATState               pNATState;
+    /** Polling thread. */
+    PPDMTHREAD              pSlirpThread;
+    /** Queue for NAT-thread-external events. */
+    PRTREQQUEUE             pSlirpReqQueue;
+    /** Link state of the engine. */
+    PDMNETWORKLINKSTATE     enmLinkState;
+    /** Index of the shard, 0 is the primary engine. */
+    uint32_t                iShard;
+#ifndef RT_OS_WINDOWS
+    /** The write end of the control pipe. */
+    RTPIPE                  hPipeWrite;
+    /** The read end of the control pipe. */
+    RTPIPE                  hPipeRead;
+#else
+    /** for external notification */
+    HANDLE                  hWakeupEvent;
+#endif
+    /** Number of guest frames handed to this engine. */
+    STAMCOUNTER             StatFramesIn;
+} DRVNATSHARD;
+/** Pointer to a NAT engine. */
+typedef DRVNATSHARD *PDRVNATSHARD;
+
+/**
+ * A frame on its way from a NAT engine to the device, see DRVNAT::pRecvHead.
+ */
+typedef struct DRVNATRECVFRAME
+{
+    /** The next frame in the FIFO. */
+    struct DRVNATRECVFRAME *pNext;
+    /** The engine owning the mbuf, NULL if the frame comes from the lwIP
+     * engine and pu8Buf is to be freed with RTMemFree. */
+    PDRVNATSHARD            pShard;
+    /** The mbuf holding the frame. */
+    struct mbuf            *m;
+    /** The frame bits. */
+    uint8_t                *pu8Buf;
+    /** The frame size. */
+    int                     cb;
+    /** The MSS of a frame from the lwIP engine carrying several TCP segments,
+     * otherwise 0. */
+    uint16_t                cbMaxSeg;
+} DRVNATRECVFRAME;
+/** Pointer to a frame on its way to the device. */
+typedef DRVNATRECVFRAME *PDRVNATRECVFRAME;
+
 /**
  * NAT network transport driver instance data.
  *
@@ -140,37 +219,30 @@ typedef struct DRVNAT
     PPDMINETWORKCONFIG      pIAboveConfig;
     /** Pointer to the driver instance. */
     PPDMDRVINS              pDrvIns;
-    /** Link state */
-    PDMNETWORKLINKSTATE     enmLinkState;
-    /** NAT state for this instance. */
-    PNATState               pNATState;
     /** TFTP directory prefix. */
     char                   *pszTFTPPrefix;
     /** Boot file name to provide in the DHCP server response. */
     char                   *pszBootFile;
     /** tftp server name to provide in the DHCP server response. */
     char                   *pszNextServer;
-    /** Polling thread. */
-    PPDMTHREAD              pSlirpThread;
-    /** Queue for NAT-thread-external events. */
-    PRTREQQUEUE             pSlirpReqQueue;
     /** The guest IP for port-forwarding. */
     uint32_t                GuestIP;
     /** Link state set when the VM is suspended. */
     PDMNETWORKLINKSTATE     enmLinkStateWant;
+    /** The NAT network address (host byte order). */
+    RTIPV4ADDR              Network;
+    /** The NAT network mask (host byte order). */
+    RTIPV4ADDR              Netmask;
+    /** Number of engines in aShards. */
+    uint32_t                cShards;
+    /** The NAT engines, see DRVNATSHARD. */
+    DRVNATSHARD             aShards[DRVNAT_SHARDS_MAX];
+    /** How guest frames are distributed over the engines. */
+    SLIRPFLOWSEL            FlowSel;
 
 #ifdef VBOX_WITH_SLIRP_MT
     PPDMTHREAD              pGuestThread;
 #endif
-#ifndef RT_OS_WINDOWS
-    /** The write end of the control pipe. */
-    RTPIPE                  hPipeWrite;
-    /** The read end of the control pipe. */
-    RTPIPE                  hPipeRead;
-#else
-    /** for external notification */
-    HANDLE                  hWakeupEvent;
-#endif
 
 #define DRV_PROFILE_COUNTER(name, dsc)     STAMPROFILE Stat ## name
 #define DRV_COUNTING_COUNTER(name, dsc)    STAMCOUNTER Stat ## name
@@ -183,8 +255,14 @@ typedef struct DRVNAT
     RTSEMEVENT              EventRecv;
     /** event to wakeup the guest urgent receive thread */
     RTSEMEVENT              EventUrgRecv;
-    /** Receive Req queue (deliver packets to the guest) */
-    PRTREQQUEUE             pRecvReqQueue;
+    /** Lock protecting the receive FIFO (pRecvHead and ppRecvTail). */
+    RTCRITSECT              RecvLock;
+    /** Head of the FIFO of frames to deliver to the guest. */
+    PDRVNATRECVFRAME        pRecvHead;
+    /** Where to link in the next frame. */
+    PDRVNATRECVFRAME       *ppRecvTail;
+    /** Cache for DRVNATRECVFRAME. */
+    RTMEMCACHE              hRecvFrameCache;
     /** Receive Urgent Req queue (deliver packets to the guest). */
     PRTREQQUEUE             pUrgRecvReqQueue;
 
@@ -197,6 +275,13 @@ typedef struct DRVNAT
 
     /** Transmit lock taken by BeginXmit and released by EndXmit. */
     RTCRITSECT              XmitLock;
+
+#ifdef DRVNAT_WITH_LWIP
+    /** The lwIP TCP engine, NULL if slirp handles TCP. */
+    PDRVNATLWIP             pLwIP;
+    /** The thread running the lwIP TCP engine. */
+    PPDMTHREAD              pLwIPThread;
+#endif
 } DRVNAT;
 AssertCompileMemberAlignment(DRVNAT, StatNATRecvWakeups, 8);
 /** Pointer the NAT driver instance data. */
@@ -206,7 +291,8 @@ typedef DRVNAT *PDRVNAT;
 /*******************************************************************************
 *   Internal Functions                                                         *
 *******************************************************************************/
-static void drvNATNotifyNATThread(PDRVNAT pThis, const char *pszWho);
+static void drvNATNotifyNATThread(PDRVNATSHARD pShard, const char *pszWho);
+static void drvNATRecvProcess(PDRVNAT pThis);
 
 
 static DECLCALLBACK(int) drvNATRecv(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
@@ -218,7 +304,7 @@ static DECLCALLBACK(int) drvNATRecv(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
 
     while (pThread->enmState == PDMTHREADSTATE_RUNNING)
     {
-        RTReqProcess(pThis->pRecvReqQueue, 0);
+        drvNATRecvProcess(pThis);
         if (ASMAtomicReadU32(&pThis->cPkts) == 0)
             RTSemEventWait(pThis->EventRecv, RT_INDEFINITE_WAIT);
     }
@@ -264,8 +350,9 @@ static DECLCALLBACK(int) drvNATUrgRecvWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
     return VINF_SUCCESS;
 }
 
-static DECLCALLBACK(void) drvNATUrgRecvWorker(PDRVNAT pThis, uint8_t *pu8Buf, int cb, struct mbuf *m)
+static DECLCALLBACK(void) drvNATUrgRecvWorker(PDRVNATSHARD pShard, uint8_t *pu8Buf, int cb, struct mbuf *m)
 {
+    PDRVNAT pThis = pShard->pThis;
     int rc = RTCritSectEnter(&pThis->DevAccessLock);
     AssertRC(rc);
     rc = pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, RT_INDEFINITE_WAIT);
@@ -283,28 +370,115 @@ static DECLCALLBACK(void) drvNATUrgRecvWorker(PDRVNAT pThis, uint8_t *pu8Buf, in
     rc = RTCritSectLeave(&pThis->DevAccessLock);
     AssertRC(rc);
 
-    slirp_ext_m_free(pThis->pNATState, m, pu8Buf);
+    slirp_ext_m_free(pShard->pNATState, m, pu8Buf);
     if (ASMAtomicDecU32(&pThis->cUrgPkts) == 0)
     {
         drvNATRecvWakeup(pThis->pDrvIns, pThis->pRecvThread);
-        drvNATNotifyNATThread(pThis, "drvNATUrgRecvWorker");
+        drvNATNotifyNATThread(pShard, "drvNATUrgRecvWorker");
     }
 }
 
 
-static DECLCALLBACK(void) drvNATRecvWorker(PDRVNAT pThis, uint8_t *pu8Buf, int cb, struct mbuf *m)
+/**
+ * Passes a TCP frame the NAT engine left unsegmented to the device above.
+ *
+ * The frame goes up as is if the device does large receives, otherwise it is
+ * cut into segments here.
+ *
+ * @returns VBox status code.
+ * @param   pThis               Pointer to the NAT instance.
+ * @param   pbFrame             The ethernet frame.  Modified.
+ * @param   cbFrame             The size of the frame.
+ * @param   cbMaxSeg            The segment size (MSS) of the connection.
+ * @thread  NATRX
+ */
+static int drvNATRecvGso(PDRVNAT pThis, uint8_t *pbFrame, size_t cbFrame, uint16_t cbMaxSeg)
 {
+    PCRTNETIPV4   pIpHdr = (PCRTNETIPV4)(pbFrame + sizeof(RTNETETHERHDR));
+    PDMNETWORKGSO Gso;
+    Gso.u8Type      = PDMNETWORKGSOTYPE_IPV4_TCP;
+    Gso.offHdr1     = sizeof(RTNETETHERHDR);
+    Gso.offHdr2     = (uint8_t)(Gso.offHdr1 + pIpHdr->ip_hl * 4);
+    Gso.cbHdrsTotal = (uint8_t)(Gso.offHdr2 + ((PCRTNETTCP)(pbFrame + Gso.offHdr2))->th_off * 4);
+    Gso.cbHdrsSeg   = Gso.cbHdrsTotal;
+    Gso.cbMaxSeg    = cbMaxSeg;
+    Gso.u8Unused    = 0;
+    AssertReturn(PDMNetGsoIsValid(&Gso, sizeof(Gso), cbFrame), VERR_INVALID_PARAMETER);
+
     int rc;
-    STAM_PROFILE_START(&pThis->StatNATRecv, a);
+    if (pThis->pIAboveNet->pfnReceiveGso)
+    {
+        PDMNetGsoPrepForDirectUse(&Gso, pbFrame, cbFrame, PDMNETCSUMTYPE_PSEUDO);
+        rc = pThis->pIAboveNet->pfnReceiveGso(pThis->pIAboveNet, pbFrame, cbFrame, &Gso);
+        if (RT_SUCCESS(rc))
+        {
+            STAM_COUNTER_INC(&pThis->StatNATRecvGso);
+            return rc;
+        }
+    }
+
+    /*
+     * The device (or the guest driver) doesn't do large receives.
+     */
+    STAM_COUNTER_INC(&pThis->StatNATRecvGsoSegmented);
+    uint8_t        abHdrScratch[256];
+    uint32_t const cSegs = PDMNetGsoCalcSegmentCount(&Gso, cbFrame);
+    rc = VINF_SUCCESS;
+    for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
+    {
+        uint32_t cbSegFrame;
+        void    *pvSegFrame = PDMNetGsoCarveSegmentQD(&Gso, pbFrame, cbFrame, abHdrScratch, iSeg, cSegs, &cbSegFrame);
+        if (iSeg != 0)
+        {
+            rc = pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, RT_INDEFINITE_WAIT);
+            if (RT_FAILURE(rc))
+                break; /* we drop the rest. */
+        }
+        rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pvSegFrame, cbSegFrame);
+        AssertRC(rc);
+    }
+    return rc;
+}
 
 
+/**
+ * Gets the MSS of a frame the engine left unsegmented.
+ *
+ * @returns The MSS, 0 if the frame is an ordinary one.
+ * @param   pFrame              The frame.
+ */
+DECLINLINE(uint16_t) drvNATRecvFrameMaxSeg(PDRVNATRECVFRAME pFrame)
+{
+    if (pFrame->pShard)
+        return (uint16_t)slirp_ext_m_get_tso_segsz(pFrame->pShard->pNATState, pFrame->m);
+    return pFrame->cbMaxSeg;
+}
+
+
+/**
+ * Passes a run of frames from the receive FIFO to the device.
+ *
+ * TCP frames the engine left unsegmented go up one at a time, ordinary frames
+ * go up in batches if the device takes them that way.
+ *
+ * @returns Number of frames from the head of @a pFrame that are done with,
+ *          whether the device took them or they were dropped.
+ * @param   pThis               Pointer to the NAT instance.
+ * @param   pFrame              The first frame.
+ * @thread  NATRX
+ */
+static uint32_t drvNATRecvBatch(PDRVNAT pThis, PDRVNATRECVFRAME pFrame)
+{
+    int rc;
+    uint32_t cDone = 1;
+
     while (ASMAtomicReadU32(&pThis->cUrgPkts) != 0)
     {
         rc = RTSemEventWait(pThis->EventRecv, RT_INDEFINITE_WAIT);
         if (   RT_FAILURE(rc)
             && (   rc == VERR_TIMEOUT
                 || rc == VERR_INTERRUPTED))
-            goto done_unlocked;
+            return cDone;
     }
 
     rc = RTCritSectEnter(&pThis->DevAccessLock);
@@ -316,7 +490,34 @@ static DECLCALLBACK(void) drvNATRecvWorker(PDRVNAT pThis, uint8_t *pu8Buf, int c
 
     if (RT_SUCCESS(rc))
     {
-        rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pu8Buf, cb);
+        uint16_t cbMaxSeg = drvNATRecvFrameMaxSeg(pFrame);
+        if (cbMaxSeg)
+            rc = drvNATRecvGso(pThis, pFrame->pu8Buf, pFrame->cb, cbMaxSeg);
+        else if (pThis->pIAboveNet->pfnReceiveFrames)
+        {
+            PDMNETWORKFRAME aFrames[PDMNETWORK_MAX_BATCH];
+            uint32_t        cFrames = 0;
+            do
+            {
+                aFrames[cFrames].pvBuf = pFrame->pu8Buf;
+                aFrames[cFrames].cb    = pFrame->cb;
+                cFrames++;
+            } while (   cFrames < RT_ELEMENTS(aFrames)
+                     && (pFrame = pFrame->pNext) != NULL
+                     && !drvNATRecvFrameMaxSeg(pFrame));
+
+            cDone = cFrames;
+            rc = pThis->pIAboveNet->pfnReceiveFrames(pThis->pIAboveNet, aFrames, &cDone);
+            AssertMsg(RT_SUCCESS(rc) || rc == VERR_NET_NO_BUFFER_SPACE, ("%Rrc\n", rc));
+            /* Nothing taken means we wait for buffers on the next round,
+               unless the device is in real trouble. */
+            if (!cDone && rc != VERR_NET_NO_BUFFER_SPACE)
+                cDone = 1;
+            rc = VINF_SUCCESS;
+            STAM_COUNTER_INC(&pThis->StatNATRecvBatch);
+        }
+        else
+            rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pFrame->pu8Buf, pFrame->cb);
         AssertRC(rc);
     }
     else if (   rc != VERR_TIMEOUT
@@ -327,30 +528,67 @@ static DECLCALLBACK(void) drvNATRecvWorker(PDRVNAT pThis, uint8_t *pu8Buf, int c
 
     rc = RTCritSectLeave(&pThis->DevAccessLock);
     AssertRC(rc);
+    return cDone;
+}
 
-done_unlocked:
-    slirp_ext_m_free(pThis->pNATState, m, pu8Buf);
-    ASMAtomicDecU32(&pThis->cPkts);
+/**
+ * Delivers the frames queued up by slirp_output to the device.
+ *
+ * @param   pThis               Pointer to the NAT instance.
+ * @thread  NATRX
+ */
+static void drvNATRecvProcess(PDRVNAT pThis)
+{
+    /* Take everything queued so far off the FIFO. */
+    RTCritSectEnter(&pThis->RecvLock);
+    PDRVNATRECVFRAME pHead = pThis->pRecvHead;
+    pThis->pRecvHead  = NULL;
+    pThis->ppRecvTail = &pThis->pRecvHead;
+    RTCritSectLeave(&pThis->RecvLock);
+
+    while (pHead)
+    {
+        STAM_PROFILE_START(&pThis->StatNATRecv, a);
+        uint32_t cDone = drvNATRecvBatch(pThis, pHead);
 
-    drvNATNotifyNATThread(pThis, "drvNATRecvWorker");
+        /* Return the mbufs and wake up each engine involved once. */
+        uint32_t fShards = 0;
+        while (cDone-- > 0 && pHead)
+        {
+            PDRVNATRECVFRAME pFrame = pHead;
+            pHead = pFrame->pNext;
+            if (pFrame->pShard)
+            {
+                slirp_ext_m_free(pFrame->pShard->pNATState, pFrame->m, pFrame->pu8Buf);
+                fShards |= RT_BIT_32(pFrame->pShard->iShard);
+            }
+            else
+                RTMemFree(pFrame->pu8Buf);
+            ASMAtomicDecU32(&pThis->cPkts);
+            RTMemCacheFree(pThis->hRecvFrameCache, pFrame);
+        }
+        for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
+            if (fShards & RT_BIT_32(iShard))
+                drvNATNotifyNATThread(&pThis->aShards[iShard], "drvNATRecvProcess");
 
-    STAM_PROFILE_STOP(&pThis->StatNATRecv, a);
+        STAM_PROFILE_STOP(&pThis->StatNATRecv, a);
+    }
 }
 
 /**
  * Frees a S/G buffer allocated by drvNATNetworkUp_AllocBuf.
  *
- * @param   pThis               Pointer to the NAT instance.
+ * @param   pShard              The engine owning the mbuf of the buffer.
  * @param   pSgBuf              The S/G buffer to free.
  */
-static void drvNATFreeSgBuf(PDRVNAT pThis, PPDMSCATTERGATHER pSgBuf)
+static void drvNATFreeSgBuf(PDRVNATSHARD pShard, PPDMSCATTERGATHER pSgBuf)
 {
     Assert((pSgBuf->fFlags & PDMSCATTERGATHER_FLAGS_MAGIC_MASK) == PDMSCATTERGATHER_FLAGS_MAGIC);
     pSgBuf->fFlags = 0;
     if (pSgBuf->pvAllocator)
     {
         Assert(!pSgBuf->pvUser);
-        slirp_ext_m_free(pThis->pNATState, (struct mbuf *)pSgBuf->pvAllocator, NULL);
+        slirp_ext_m_free(pShard->pNATState, (struct mbuf *)pSgBuf->pvAllocator, NULL);
         pSgBuf->pvAllocator = NULL;
     }
     else if (pSgBuf->pvUser)
@@ -366,14 +604,14 @@ static void drvNATFreeSgBuf(PDRVNAT pThis, PPDMSCATTERGATHER pSgBuf)
 /**
  * Worker function for drvNATSend().
  *
- * @param   pThis               Pointer to the NAT instance.
+ * @param   pShard              The engine the frame was dispatched to.
  * @param   pSgBuf              The scatter/gather buffer.
  * @thread  NAT
  */
-static void drvNATSendWorker(PDRVNAT pThis, PPDMSCATTERGATHER pSgBuf)
+static void drvNATSendWorker(PDRVNATSHARD pShard, PPDMSCATTERGATHER pSgBuf)
 {
-    Assert(pThis->enmLinkState == PDMNETWORKLINKSTATE_UP);
-    if (pThis->enmLinkState == PDMNETWORKLINKSTATE_UP)
+    Assert(pShard->enmLinkState == PDMNETWORKLINKSTATE_UP);
+    if (pShard->enmLinkState == PDMNETWORKLINKSTATE_UP)
     {
         struct mbuf *m = (struct mbuf *)pSgBuf->pvAllocator;
         if (m)
@@ -382,47 +620,56 @@ static void drvNATSendWorker(PDRVNAT pThis, PPDMSCATTERGATHER pSgBuf)
              * A normal frame.
              */
             pSgBuf->pvAllocator = NULL;
-            slirp_input(pThis->pNATState, m, pSgBuf->cbUsed);
+            STAM_COUNTER_INC(&pShard->StatFramesIn);
+            slirp_input(pShard->pNATState, m, pSgBuf->cbUsed);
         }
         else
         {
             /*
-             * GSO frame, need to segment it.
+             * GSO frame, need to segment it.  The NAT engine takes TCP segments
+             * larger than the MSS, so these are only cut into chunks fitting
+             * its largest mbufs.  Everything else is segmented the usual way.
              */
-            /** @todo Make the NAT engine grok large frames?  Could be more efficient... */
 #if 0 /* this is for testing PDMNetGsoCarveSegmentQD. */
             uint8_t         abHdrScratch[256];
 #endif
             uint8_t const  *pbFrame = (uint8_t const *)pSgBuf->aSegs[0].pvSeg;
-            PCPDMNETWORKGSO pGso    = (PCPDMNETWORKGSO)pSgBuf->pvUser;
-            uint32_t const  cSegs   = PDMNetGsoCalcSegmentCount(pGso, pSgBuf->cbUsed);  Assert(cSegs > 1);
+            PDMNETWORKGSO   Gso     = *(PCPDMNETWORKGSO)pSgBuf->pvUser;
+            PCPDMNETWORKGSO pGso    = &Gso;
+            STAM_COUNTER_INC(&pShard->pThis->StatNATSendGso);
+            if (Gso.u8Type == PDMNETWORKGSOTYPE_IPV4_TCP)
+            {
+                uint32_t const cSegsPerChunk = (DRVNAT_FRAME_MAX - Gso.cbHdrsTotal) / Gso.cbMaxSeg;
+                if (cSegsPerChunk > 1)
+                    Gso.cbMaxSeg = (uint16_t)RT_MIN(cSegsPerChunk * Gso.cbMaxSeg, pSgBuf->cbUsed - Gso.cbHdrsTotal);
+            }
+            uint32_t const  cSegs   = PDMNetGsoCalcSegmentCount(pGso, pSgBuf->cbUsed);
             for (size_t iSeg = 0; iSeg < cSegs; iSeg++)
             {
                 size_t cbSeg;
                 void  *pvSeg;
-                m = slirp_ext_m_get(pThis->pNATState, pGso->cbHdrsTotal + pGso->cbMaxSeg, &pvSeg, &cbSeg);
+                m = slirp_ext_m_get(pShard->pNATState, pGso->cbHdrsTotal + pGso->cbMaxSeg, &pvSeg, &cbSeg);
                 if (!m)
                     break;
 
 #if 1
-                uint32_t cbPayload, cbHdrs;
-                uint32_t offPayload = PDMNetGsoCarveSegment(pGso, pbFrame, pSgBuf->cbUsed,
-                                                            iSeg, cSegs, (uint8_t *)pvSeg, &cbHdrs, &cbPayload);
-                memcpy((uint8_t *)pvSeg + cbHdrs, pbFrame + offPayload, cbPayload);
+                uint32_t cbSegFrame = PDMNetGsoCarveSegmentCopy(pGso, pbFrame, pSgBuf->cbUsed,
+                                                                iSeg, cSegs, (uint8_t *)pvSeg);
 
-                slirp_input(pThis->pNATState, m, cbPayload + cbHdrs);
+                STAM_COUNTER_INC(&pShard->StatFramesIn);
+                slirp_input(pShard->pNATState, m, cbSegFrame);
 #else
                 uint32_t cbSegFrame;
                 void *pvSegFrame = PDMNetGsoCarveSegmentQD(pGso, (uint8_t *)pbFrame, pSgBuf->cbUsed, abHdrScratch,
                                                            iSeg, cSegs, &cbSegFrame);
                 memcpy((uint8_t *)pvSeg, pvSegFrame, cbSegFrame);
 
-                slirp_input(pThis->pNATState, m, cbSegFrame);
+                slirp_input(pShard->pNATState, m, cbSegFrame);
 #endif
             }
         }
     }
-    drvNATFreeSgBuf(pThis, pSgBuf);
+    drvNATFreeSgBuf(pShard, pSgBuf);
 
     /** @todo Implement the VERR_TRY_AGAIN drvNATNetworkUp_AllocBuf semantics. */
 }
@@ -454,7 +701,7 @@ static DECLCALLBACK(int) drvNATNetworkUp_AllocBuf(PPDMINETWORKUP pInterface, siz
     /*
      * Drop the incoming frame if the NAT thread isn't running.
      */
-    if (pThis->pSlirpThread->enmState != PDMTHREADSTATE_RUNNING)
+    if (pThis->aShards[0].pSlirpThread->enmState != PDMTHREADSTATE_RUNNING)
     {
         Log(("drvNATNetowrkUp_AllocBuf: returns VERR_NET_NO_NETWORK\n"));
         return VERR_NET_NO_NETWORK;
@@ -469,7 +716,7 @@ static DECLCALLBACK(int) drvNATNetworkUp_AllocBuf(PPDMINETWORKUP pInterface, siz
     if (!pGso)
     {
         pSgBuf->pvUser      = NULL;
-        pSgBuf->pvAllocator = slirp_ext_m_get(pThis->pNATState, cbMin,
+        pSgBuf->pvAllocator = slirp_ext_m_get(pThis->aShards[0].pNATState, cbMin,
                                               &pSgBuf->aSegs[0].pvSeg, &pSgBuf->aSegs[0].cbSeg);
         if (!pSgBuf->pvAllocator)
         {
@@ -514,43 +761,230 @@ static DECLCALLBACK(int) drvNATNetworkUp_FreeBuf(PPDMINETWORKUP pInterface, PPDM
 {
     PDRVNAT pThis = RT_FROM_MEMBER(pInterface, DRVNAT, INetworkUp);
     Assert(RTCritSectIsOwner(&pThis->XmitLock));
-    drvNATFreeSgBuf(pThis, pSgBuf);
+    drvNATFreeSgBuf(&pThis->aShards[0], pSgBuf);
     return VINF_SUCCESS;
 }
 
+#ifdef DRVNAT_WITH_LWIP
 /**
- * @interface_method_impl{PDMINETWORKUP,pfnSendBuf}
+ * Checks whether a guest frame is for the lwIP TCP engine.
+ *
+ * That is TCP to the outside world and to the host loopback alias, which
+ * includes the guest side of TCP port forwarding.  FTP stays with slirp
+ * because of its alias handler, and so does everything else.
+ *
+ * @returns true if it is, false if slirp gets it.
+ * @param   pThis               Pointer to the NAT instance.
+ * @param   pbFrame             The ethernet frame.
+ * @param   cbFrame             The size of the frame.
  */
-static DECLCALLBACK(int) drvNATNetworkUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER pSgBuf, bool fOnWorkerThread)
+static bool drvNATIsLwIPFrame(PDRVNAT pThis, uint8_t const *pbFrame, size_t cbFrame)
 {
-    PDRVNAT pThis = RT_FROM_MEMBER(pInterface, DRVNAT, INetworkUp);
-    Assert((pSgBuf->fFlags & PDMSCATTERGATHER_FLAGS_OWNER_MASK) == PDMSCATTERGATHER_FLAGS_OWNER_1);
-    Assert(RTCritSectIsOwner(&pThis->XmitLock));
+    if (   !pThis->pLwIP
+        || pThis->pLwIPThread->enmState != PDMTHREADSTATE_RUNNING
+        || cbFrame < sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN)
+        return false;
+
+    PCRTNETETHERHDR pEthHdr = (PCRTNETETHERHDR)pbFrame;
+    if (pEthHdr->EtherType != RT_H2BE_U16_C(RTNET_ETHERTYPE_IPV4))
+        return false;
+
+    PCRTNETIPV4 pIpHdr  = (PCRTNETIPV4)(pEthHdr + 1);
+    size_t      cbIpHdr = pIpHdr->ip_hl * 4;
+    uint32_t    uDst    = RT_BE2H_U32(pIpHdr->ip_dst.u);
+    if (   pIpHdr->ip_v != 4
+        || pIpHdr->ip_p != RTNETIPV4_PROT_TCP
+        || cbIpHdr < RTNETIPV4_MIN_LEN
+        || cbFrame < sizeof(RTNETETHERHDR) + cbIpHdr + RTNETTCP_MIN_LEN
+        || (RT_BE2H_U16(pIpHdr->ip_off) & (RTNETIPV4_FLAGS_MF | UINT16_C(0x1fff) /* offset */))
+        || (   (uDst & pThis->Netmask) == pThis->Network
+            && uDst != (pThis->Network | CTL_ALIAS)))
+        return false;
+
+    PCRTNETTCP pTcpHdr = (PCRTNETTCP)((uint8_t const *)pIpHdr + cbIpHdr);
+    uint16_t   uSrcPort = RT_BE2H_U16(pTcpHdr->th_sport);
+    uint16_t   uDstPort = RT_BE2H_U16(pTcpHdr->th_dport);
+    return uDstPort != 21 && uDstPort != 20
+        && uSrcPort != 21 && uSrcPort != 20;
+}
+#endif /* DRVNAT_WITH_LWIP */
 
-    int rc;
-    if (pThis->pSlirpThread->enmState == PDMTHREADSTATE_RUNNING)
-    {
-        /* Set an FTM checkpoint as this operation changes the state permanently. */
-        PDMDrvHlpFTSetCheckpoint(pThis->pDrvIns, FTMCHECKPOINTTYPE_NETWORK);
+/** drvNATSendQueue: the lwIP engine has to be woken up. */
+#define DRVNAT_NOTIFY_LWIP          RT_BIT_32(31)
 
+/**
+ * Hands a guest frame to the request queue of an engine.
+ *
+ * @returns VBox status code, the buffer is consumed either way.
+ * @param   pShard              The engine.
+ * @param   pSgBuf              The frame, its mbuf (if any) must come from the
+ *                              zones of the engine.
+ */
+static int drvNATSendToShard(PDRVNATSHARD pShard, PPDMSCATTERGATHER pSgBuf)
+{
 #ifdef VBOX_WITH_SLIRP_MT
-        PRTREQQUEUE pQueue = (PRTREQQUEUE)slirp_get_queue(pThis->pNATState);
+    PRTREQQUEUE pQueue = (PRTREQQUEUE)slirp_get_queue(pShard->pNATState);
 #else
-        PRTREQQUEUE pQueue = pThis->pSlirpReqQueue;
+    PRTREQQUEUE pQueue = pShard->pSlirpReqQueue;
 #endif
-        rc = RTReqCallEx(pQueue, NULL /*ppReq*/, 0 /*cMillies*/, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
-                         (PFNRT)drvNATSendWorker, 2, pThis, pSgBuf);
-        if (RT_SUCCESS(rc))
+    int rc = RTReqCallEx(pQueue, NULL /*ppReq*/, 0 /*cMillies*/, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
+                         (PFNRT)drvNATSendWorker, 2, pShard, pSgBuf);
+    if (RT_SUCCESS(rc))
+        return VINF_SUCCESS;
+    drvNATFreeSgBuf(pShard, pSgBuf);
+    return VERR_NET_NO_BUFFER_SPACE;
+}
+
+/**
+ * Copies a guest frame into the mbuf zones of a secondary engine.
+ *
+ * @returns The copy, NULL if out of buffers.
+ * @param   pShard              The engine.
+ * @param   pSgBuf              The frame.
+ */
+static PPDMSCATTERGATHER drvNATCopySgBuf(PDRVNATSHARD pShard, PDMSCATTERGATHER const *pSgBuf)
+{
+    PPDMSCATTERGATHER pCopy = (PPDMSCATTERGATHER)RTMemAlloc(sizeof(*pCopy));
+    if (!pCopy)
+        return NULL;
+    pCopy->pvUser      = NULL;
+    pCopy->pvAllocator = slirp_ext_m_get(pShard->pNATState, pSgBuf->cbUsed,
+                                         &pCopy->aSegs[0].pvSeg, &pCopy->aSegs[0].cbSeg);
+    if (!pCopy->pvAllocator)
+    {
+        RTMemFree(pCopy);
+        return NULL;
+    }
+    memcpy(pCopy->aSegs[0].pvSeg, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed);
+    pCopy->fFlags      = PDMSCATTERGATHER_FLAGS_MAGIC | PDMSCATTERGATHER_FLAGS_OWNER_1;
+    pCopy->cbUsed      = pSgBuf->cbUsed;
+    pCopy->cbAvailable = pCopy->aSegs[0].cbSeg;
+    pCopy->cSegs       = 1;
+    return pCopy;
+}
+
+/**
+ * Queues a guest frame for the engine owning its flow, without waking the
+ * engine up.
+ *
+ * @returns VBox status code, the buffer is consumed either way.
+ * @param   pThis               Pointer to the NAT instance.
+ * @param   pSgBuf              The frame.
+ * @param   pfNotify            Where to add the bits of the engines to wake up
+ *                              (RT_BIT_32(iShard) and DRVNAT_NOTIFY_LWIP).
+ */
+static int drvNATSendQueue(PDRVNAT pThis, PPDMSCATTERGATHER pSgBuf, uint32_t *pfNotify)
+{
+    Assert((pSgBuf->fFlags & PDMSCATTERGATHER_FLAGS_OWNER_MASK) == PDMSCATTERGATHER_FLAGS_OWNER_1);
+
+    PDRVNATSHARD pShard = &pThis->aShards[0];
+    if (pShard->pSlirpThread->enmState != PDMTHREADSTATE_RUNNING)
+    {
+        drvNATFreeSgBuf(pShard, pSgBuf);
+        return VERR_NET_DOWN;
+    }
+
+    /* Set an FTM checkpoint as this operation changes the state permanently. */
+    PDMDrvHlpFTSetCheckpoint(pThis->pDrvIns, FTMCHECKPOINTTYPE_NETWORK);
+
+    uint8_t const *pbFrame = (uint8_t const *)pSgBuf->aSegs[0].pvSeg;
+#ifdef DRVNAT_WITH_LWIP
+    if (drvNATIsLwIPFrame(pThis, pbFrame, pSgBuf->cbUsed))
+    {
+        /* pvUser is the GSO context of GSO frames and NULL otherwise. */
+        DrvNATlwIPInput(pThis->pLwIP, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed, (PCPDMNETWORKGSO)pSgBuf->pvUser);
+        drvNATFreeSgBuf(pShard, pSgBuf);
+        *pfNotify |= DRVNAT_NOTIFY_LWIP;
+        return VINF_SUCCESS;
+    }
+#endif
+
+    unsigned iShard = slirp_flow_select(&pThis->FlowSel, pbFrame, pSgBuf->cbUsed);
+    if (iShard == SLIRP_FLOW_ALL_ENGINES)
+    {
+        /* Every engine keeps its own ARP cache, the original goes to the primary one. */
+        for (uint32_t i = 1; i < pThis->cShards; i++)
         {
-            drvNATNotifyNATThread(pThis, "drvNATNetworkUp_SendBuf");
-            return VINF_SUCCESS;
+            PPDMSCATTERGATHER pCopy = drvNATCopySgBuf(&pThis->aShards[i], pSgBuf);
+            if (   pCopy
+                && RT_SUCCESS(drvNATSendToShard(&pThis->aShards[i], pCopy)))
+                *pfNotify |= RT_BIT_32(i);
         }
+        iShard = 0;
+    }
 
-        rc = VERR_NET_NO_BUFFER_SPACE;
+    pShard = &pThis->aShards[iShard];
+    if (iShard != 0 && pSgBuf->pvAllocator)
+    {
+        /*
+         * The mbuf comes from the zones of the primary engine, move the
+         * frame over to the zones of the engine owning the flow.
+         */
+        PPDMSCATTERGATHER pCopy = drvNATCopySgBuf(pShard, pSgBuf);
+        drvNATFreeSgBuf(&pThis->aShards[0], pSgBuf);
+        if (!pCopy)
+            return VERR_NET_NO_BUFFER_SPACE;
+        pSgBuf = pCopy;
     }
-    else
-        rc = VERR_NET_DOWN;
-    drvNATFreeSgBuf(pThis, pSgBuf);
+
+    int rc = drvNATSendToShard(pShard, pSgBuf);
+    if (RT_SUCCESS(rc))
+        *pfNotify |= RT_BIT_32(iShard);
+    return rc;
+}
+
+/**
+ * Wakes up the engines a batch of frames was queued for.
+ *
+ * @param   pThis               Pointer to the NAT instance.
+ * @param   fNotify             The engines, see drvNATSendQueue.
+ * @param   pszWho              The caller for logging.
+ */
+static void drvNATSendNotify(PDRVNAT pThis, uint32_t fNotify, const char *pszWho)
+{
+    for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
+        if (fNotify & RT_BIT_32(iShard))
+            drvNATNotifyNATThread(&pThis->aShards[iShard], pszWho);
+#ifdef DRVNAT_WITH_LWIP
+    if (fNotify & DRVNAT_NOTIFY_LWIP)
+        DrvNATlwIPWakeup(pThis->pLwIP);
+#endif
+}
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnSendBuf}
+ */
+static DECLCALLBACK(int) drvNATNetworkUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER pSgBuf, bool fOnWorkerThread)
+{
+    PDRVNAT pThis = RT_FROM_MEMBER(pInterface, DRVNAT, INetworkUp);
+    Assert(RTCritSectIsOwner(&pThis->XmitLock));
+
+    uint32_t fNotify = 0;
+    int rc = drvNATSendQueue(pThis, pSgBuf, &fNotify);
+    drvNATSendNotify(pThis, fNotify, "drvNATNetworkUp_SendBuf");
+    return rc;
+}
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnSendBufs}
+ */
+static DECLCALLBACK(int) drvNATNetworkUp_SendBufs(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER *papSgBufs,
+                                                  uint32_t cSgBufs, bool fOnWorkerThread)
+{
+    PDRVNAT pThis = RT_FROM_MEMBER(pInterface, DRVNAT, INetworkUp);
+    Assert(RTCritSectIsOwner(&pThis->XmitLock));
+
+    /* Queue them all up and kick each engine involved once. */
+    int      rc      = VINF_SUCCESS;
+    uint32_t fNotify = 0;
+    for (uint32_t i = 0; i < cSgBufs; i++)
+    {
+        int rc2 = drvNATSendQueue(pThis, papSgBufs[i], &fNotify);
+        if (RT_FAILURE(rc2) && RT_SUCCESS(rc))
+            rc = rc2;
+    }
+    drvNATSendNotify(pThis, fNotify, "drvNATNetworkUp_SendBufs");
+    STAM_COUNTER_INC(&pThis->StatNATSendBatch);
     return rc;
 }
 
@@ -566,16 +1000,16 @@ static DECLCALLBACK(void) drvNATNetworkUp_EndXmit(PPDMINETWORKUP pInterface)
 /**
  * Get the NAT thread out of poll/WSAWaitForMultipleEvents
  */
-static void drvNATNotifyNATThread(PDRVNAT pThis, const char *pszWho)
+static void drvNATNotifyNATThread(PDRVNATSHARD pShard, const char *pszWho)
 {
     int rc;
 #ifndef RT_OS_WINDOWS
     /* kick poll() */
     size_t cbIgnored;
-    rc = RTPipeWrite(pThis->hPipeWrite, "", 1, &cbIgnored);
+    rc = RTPipeWrite(pShard->hPipeWrite, "", 1, &cbIgnored);
 #else
     /* kick WSAWaitForMultipleEvents */
-    rc = WSASetEvent(pThis->hWakeupEvent);
+    rc = WSASetEvent(pShard->hWakeupEvent);
 #endif
     AssertRC(rc);
 }
@@ -593,20 +1027,22 @@ static DECLCALLBACK(void) drvNATNetworkUp_SetPromiscuousMode(PPDMINETWORKUP pInt
  * Worker function for drvNATNetworkUp_NotifyLinkChanged().
  * @thread "NAT" thread.
  */
-static void drvNATNotifyLinkChangedWorker(PDRVNAT pThis, PDMNETWORKLINKSTATE enmLinkState)
+static void drvNATNotifyLinkChangedWorker(PDRVNATSHARD pShard, PDMNETWORKLINKSTATE enmLinkState)
 {
-    pThis->enmLinkState = pThis->enmLinkStateWant = enmLinkState;
+    pShard->enmLinkState = pShard->pThis->enmLinkStateWant = enmLinkState;
     switch (enmLinkState)
     {
         case PDMNETWORKLINKSTATE_UP:
-            LogRel(("NAT: link up\n"));
-            slirp_link_up(pThis->pNATState);
+            if (pShard->iShard == 0)
+                LogRel(("NAT: link up\n"));
+            slirp_link_up(pShard->pNATState);
             break;
 
         case PDMNETWORKLINKSTATE_DOWN:
         case PDMNETWORKLINKSTATE_DOWN_RESUME:
-            LogRel(("NAT: link down\n"));
-            slirp_link_down(pThis->pNATState);
+            if (pShard->iShard == 0)
+                LogRel(("NAT: link down\n"));
+            slirp_link_down(pShard->pNATState);
             break;
 
         default:
@@ -629,24 +1065,28 @@ static DECLCALLBACK(void) drvNATNetworkUp_NotifyLinkChanged(PPDMINETWORKUP pInte
 
     /* Don't queue new requests when the NAT thread is about to stop.
      * But the VM could also be paused. So memorize the desired state. */
-    if (pThis->pSlirpThread->enmState != PDMTHREADSTATE_RUNNING)
+    if (pThis->aShards[0].pSlirpThread->enmState != PDMTHREADSTATE_RUNNING)
     {
         pThis->enmLinkStateWant = enmLinkState;
         return;
     }
 
-    PRTREQ pReq;
-    int rc = RTReqCallEx(pThis->pSlirpReqQueue, &pReq, 0 /*cMillies*/, RTREQFLAGS_VOID,
-                         (PFNRT)drvNATNotifyLinkChangedWorker, 2, pThis, enmLinkState);
-    if (RT_LIKELY(rc == VERR_TIMEOUT))
+    for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
     {
-        drvNATNotifyNATThread(pThis, "drvNATNetworkUp_NotifyLinkChanged");
-        rc = RTReqWait(pReq, RT_INDEFINITE_WAIT);
-        AssertRC(rc);
+        PDRVNATSHARD pShard = &pThis->aShards[iShard];
+        PRTREQ pReq;
+        int rc = RTReqCallEx(pShard->pSlirpReqQueue, &pReq, 0 /*cMillies*/, RTREQFLAGS_VOID,
+                             (PFNRT)drvNATNotifyLinkChangedWorker, 2, pShard, enmLinkState);
+        if (RT_LIKELY(rc == VERR_TIMEOUT))
+        {
+            drvNATNotifyNATThread(pShard, "drvNATNetworkUp_NotifyLinkChanged");
+            rc = RTReqWait(pReq, RT_INDEFINITE_WAIT);
+            AssertRC(rc);
+        }
+        else
+            AssertRC(rc);
+        RTReqFree(pReq);
     }
-    else
-        AssertRC(rc);
-    RTReqFree(pReq);
 }
 
 static void drvNATNotifyApplyPortForwardCommand(PDRVNAT pThis, bool fRemove,
@@ -668,10 +1108,33 @@ static void drvNATNotifyApplyPortForwardCommand(PDRVNAT pThis, bool fRemove,
         || inet_aton(pGuestIp, &guestIp) == 0)
         guestIp.s_addr = pThis->GuestIP;
 
+#ifdef DRVNAT_WITH_LWIP
+    /* TCP port forwarding is done by the lwIP engine when it is used. */
+    if (!fUdp && pThis->pLwIP)
+    {
+        RTNETADDRIPV4 HostAddr, GuestAddr;
+        HostAddr.u  = hostIp.s_addr;
+        GuestAddr.u = guestIp.s_addr;
+        int rc;
+        if (fRemove)
+            rc = DrvNATlwIPRemoveRedirect(pThis->pLwIP, HostAddr, u16HostPort, GuestAddr, u16GuestPort);
+        else
+            rc = DrvNATlwIPAddRedirect(pThis->pLwIP, HostAddr, u16HostPort, GuestAddr, u16GuestPort);
+        if (RT_FAILURE(rc))
+            LogRel(("NAT: %s TCP port forwarding rule for host port %u failed: %Rrc\n",
+                    fRemove ? "removing" : "adding", u16HostPort, rc));
+        return;
+    }
+#endif
+
+    /* port forwarding is the business of the primary engine */
     if (fRemove)
-        slirp_remove_redirect(pThis->pNATState, fUdp, hostIp, u16HostPort, guestIp, u16GuestPort);
+        slirp_remove_redirect(pThis->aShards[0].pNATState, fUdp, hostIp, u16HostPort, guestIp, u16GuestPort);
     else
-        slirp_add_redirect(pThis->pNATState, fUdp, hostIp, u16HostPort, guestIp, u16GuestPort, Mac.au8);
+    {
+        slirp_flow_add_forward(&pThis->FlowSel, fUdp, u16GuestPort);
+        slirp_add_redirect(pThis->aShards[0].pNATState, fUdp, hostIp, u16HostPort, guestIp, u16GuestPort, Mac.au8);
+    }
 }
 
 DECLCALLBACK(int) drvNATNetworkNatConfig_RedirectRuleCommand(PPDMINETWORKNATCONFIG pInterface, bool fRemove,
@@ -683,12 +1146,12 @@ DECLCALLBACK(int) drvNATNetworkNatConfig_RedirectRuleCommand(PPDMINETWORKNATCONF
                  u16GuestPort));
     PDRVNAT pThis = RT_FROM_MEMBER(pInterface, DRVNAT, INetworkNATCfg);
     PRTREQ pReq;
-    int rc = RTReqCallEx(pThis->pSlirpReqQueue, &pReq, 0 /*cMillies*/, RTREQFLAGS_VOID,
+    int rc = RTReqCallEx(pThis->aShards[0].pSlirpReqQueue, &pReq, 0 /*cMillies*/, RTREQFLAGS_VOID,
                          (PFNRT)drvNATNotifyApplyPortForwardCommand, 7, pThis, fRemove,
                          fUdp, pHostIp, u16HostPort, pGuestIp, u16GuestPort);
     if (RT_LIKELY(rc == VERR_TIMEOUT))
     {
-        drvNATNotifyNATThread(pThis, "drvNATNetworkNatConfig_RedirectRuleCommand");
+        drvNATNotifyNATThread(&pThis->aShards[0], "drvNATNetworkNatConfig_RedirectRuleCommand");
         rc = RTReqWait(pReq, RT_INDEFINITE_WAIT);
         AssertRC(rc);
     }
@@ -704,30 +1167,31 @@ DECLCALLBACK(int) drvNATNetworkNatConfig_RedirectRuleCommand(PPDMINETWORKNATCONF
  * NAT thread handling the slirp stuff.
  *
  * The slirp implementation is single-threaded so we execute this enginre in a
- * dedicated thread. We take care that this thread does not become the
+ * dedicated thread, one per engine (see DRVNATSHARD). We take care that this thread does not become the
  * bottleneck: If the guest wants to send, a request is enqueued into the
  * pSlirpReqQueue and handled asynchronously by this thread.  If this thread
- * wants to deliver packets to the guest, it enqueues a request into
- * pRecvReqQueue which is later handled by the Recv thread.
+ * wants to deliver packets to the guest, it appends them to the pRecvHead
+ * FIFO which the Recv thread drains, passing them to the device in batches.
  */
 static DECLCALLBACK(int) drvNATAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
 {
-    PDRVNAT pThis = PDMINS_2_DATA(pDrvIns, PDRVNAT);
+    PDRVNATSHARD pShard = (PDRVNATSHARD)pThread->pvUser;
+    PDRVNAT pThis = pShard->pThis;
     int     nFDs = -1;
 #ifdef RT_OS_WINDOWS
-    HANDLE  *phEvents = slirp_get_events(pThis->pNATState);
+    HANDLE  *phEvents = slirp_get_events(pShard->pNATState);
     unsigned int cBreak = 0;
 #else /* RT_OS_WINDOWS */
     unsigned int cPollNegRet = 0;
 #endif /* !RT_OS_WINDOWS */
 
-    LogFlow(("drvNATAsyncIoThread: pThis=%p\n", pThis));
+    LogFlow(("drvNATAsyncIoThread: pThis=%p iShard=%u\n", pThis, pShard->iShard));
 
     if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
         return VINF_SUCCESS;
 
-    if (pThis->enmLinkStateWant != pThis->enmLinkState)
-        drvNATNotifyLinkChangedWorker(pThis, pThis->enmLinkStateWant);
+    if (pThis->enmLinkStateWant != pShard->enmLinkState)
+        drvNATNotifyLinkChangedWorker(pShard, pThis->enmLinkStateWant);
 
     /*
      * Polling loop.
@@ -737,22 +1201,57 @@ static DECLCALLBACK(int) drvNATAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
         /*
          * To prevent concurrent execution of sending/receiving threads
          */
-#ifndef RT_OS_WINDOWS
-        nFDs = slirp_get_nsock(pThis->pNATState);
+#if defined(VBOX_WITH_NAT_EPOLL)
+        /* The sockets and the management pipe stay registered with the epoll
+         * set, fill only pushes interest changes. */
+        slirp_select_fill(pShard->pNATState, &nFDs);
+
+        bool fWakeup = false;
+        int cEvents = slirp_select_wait(pShard->pNATState, slirp_get_timeout_ms(pShard->pNATState), &fWakeup);
+        if (cEvents < 0)
+        {
+            if (errno == EINTR)
+            {
+                Log2(("NAT: signal was caught while sleep on epoll_wait\n"));
+                cEvents = 0;
+            }
+            else if (cPollNegRet++ > 128)
+            {
+                LogRel(("NAT:epoll_wait returns (%s) suppressed %d\n", strerror(errno), cPollNegRet));
+                cPollNegRet = 0;
+            }
+        }
+
+        if (cEvents >= 0)
+        {
+            slirp_select_poll(pShard->pNATState, cEvents);
+            if (fWakeup)
+            {
+                /* drain the pipe, see the poll() variant below */
+                char ch;
+                size_t cbRead;
+                RTPipeRead(pShard->hPipeRead, &ch, 1, &cbRead);
+            }
+        }
+        /* process _all_ outstanding requests but don't wait */
+        RTReqProcess(pShard->pSlirpReqQueue, 0);
+
+#elif !defined(RT_OS_WINDOWS)
+        nFDs = slirp_get_nsock(pShard->pNATState);
         /* allocation for all sockets + Management pipe */
         struct pollfd *polls = (struct pollfd *)RTMemAlloc((1 + nFDs) * sizeof(struct pollfd) + sizeof(uint32_t));
         if (polls == NULL)
             return VERR_NO_MEMORY;
 
         /* don't pass the management pipe */
-        slirp_select_fill(pThis->pNATState, &nFDs, &polls[1]);
+        slirp_select_fill(pShard->pNATState, &nFDs, &polls[1]);
 
-        polls[0].fd = RTPipeToNative(pThis->hPipeRead);
+        polls[0].fd = RTPipeToNative(pShard->hPipeRead);
         /* POLLRDBAND usually doesn't used on Linux but seems used on Solaris */
         polls[0].events = POLLRDNORM | POLLPRI | POLLRDBAND;
         polls[0].revents = 0;
 
-        int cChangedFDs = poll(polls, nFDs + 1, slirp_get_timeout_ms(pThis->pNATState));
+        int cChangedFDs = poll(polls, nFDs + 1, slirp_get_timeout_ms(pShard->pNATState));
         if (cChangedFDs < 0)
         {
             if (errno == EINTR)
@@ -770,7 +1269,7 @@ static DECLCALLBACK(int) drvNATAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
 
         if (cChangedFDs >= 0)
         {
-            slirp_select_poll(pThis->pNATState, &polls[1], nFDs);
+            slirp_select_poll(pShard->pNATState, &polls[1], nFDs);
             if (polls[0].revents & (POLLRDNORM|POLLPRI|POLLRDBAND))
             {
                 /* drain the pipe
@@ -787,18 +1286,18 @@ static DECLCALLBACK(int) drvNATAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
                  * pipe.*/
                 char ch;
                 size_t cbRead;
-                RTPipeRead(pThis->hPipeRead, &ch, 1, &cbRead);
+                RTPipeRead(pShard->hPipeRead, &ch, 1, &cbRead);
             }
         }
         /* process _all_ outstanding requests but don't wait */
-        RTReqProcess(pThis->pSlirpReqQueue, 0);
+        RTReqProcess(pShard->pSlirpReqQueue, 0);
         RTMemFree(polls);
 
 #else /* RT_OS_WINDOWS */
         nFDs = -1;
-        slirp_select_fill(pThis->pNATState, &nFDs);
+        slirp_select_fill(pShard->pNATState, &nFDs);
         DWORD dwEvent = WSAWaitForMultipleEvents(nFDs, phEvents, FALSE,
-                                                 slirp_get_timeout_ms(pThis->pNATState),
+                                                 slirp_get_timeout_ms(pShard->pNATState),
                                                  FALSE);
         if (   (dwEvent < WSA_WAIT_EVENT_0 || dwEvent > WSA_WAIT_EVENT_0 + nFDs - 1)
             && dwEvent != WSA_WAIT_TIMEOUT)
@@ -811,14 +1310,14 @@ static DECLCALLBACK(int) drvNATAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
         if (dwEvent == WSA_WAIT_TIMEOUT)
         {
             /* only check for slow/fast timers */
-            slirp_select_poll(pThis->pNATState, /* fTimeout=*/true, /*fIcmp=*/false);
+            slirp_select_poll(pShard->pNATState, /* fTimeout=*/true, /*fIcmp=*/false);
             continue;
         }
         /* poll the sockets in any case */
         Log2(("%s: poll\n", __FUNCTION__));
-        slirp_select_poll(pThis->pNATState, /* fTimeout=*/false, /* fIcmp=*/(dwEvent == WSA_WAIT_EVENT_0));
+        slirp_select_poll(pShard->pNATState, /* fTimeout=*/false, /* fIcmp=*/(dwEvent == WSA_WAIT_EVENT_0));
         /* process _all_ outstanding requests but don't wait */
-        RTReqProcess(pThis->pSlirpReqQueue, 0);
+        RTReqProcess(pShard->pSlirpReqQueue, 0);
 # ifdef VBOX_NAT_DELAY_HACK
         if (cBreak++ > 128)
         {
@@ -842,9 +1341,7 @@ static DECLCALLBACK(int) drvNATAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
  */
 static DECLCALLBACK(int) drvNATAsyncIoWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
 {
-    PDRVNAT pThis = PDMINS_2_DATA(pDrvIns, PDRVNAT);
-
-    drvNATNotifyNATThread(pThis, "drvNATAsyncIoWakeup");
+    drvNATNotifyNATThread((PDRVNATSHARD)pThread->pvUser, "drvNATAsyncIoWakeup");
     return VINF_SUCCESS;
 }
 
@@ -858,7 +1355,7 @@ static DECLCALLBACK(int) drvNATAsyncIoGuest(PPDMDRVINS pDrvIns, PPDMTHREAD pThre
         return VINF_SUCCESS;
 
     while (pThread->enmState == PDMTHREADSTATE_RUNNING)
-        slirp_process_queue(pThis->pNATState);
+        slirp_process_queue(pThis->aShards[0].pNATState);
 
     return VINF_SUCCESS;
 }
@@ -885,35 +1382,46 @@ int slirp_can_output(void *pvUser)
 
 void slirp_push_recv_thread(void *pvUser)
 {
-    PDRVNAT pThis = (PDRVNAT)pvUser;
+    PDRVNAT pThis = ((PDRVNATSHARD)pvUser)->pThis;
     Assert(pThis);
     drvNATUrgRecvWakeup(pThis->pDrvIns, pThis->pUrgRecvThread);
 }
 
 void slirp_urg_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
 {
-    PDRVNAT pThis = (PDRVNAT)pvUser;
+    PDRVNATSHARD pShard = (PDRVNATSHARD)pvUser;
+    PDRVNAT pThis = pShard->pThis;
     Assert(pThis);
 
     PRTREQ pReq = NULL;
 
     /* don't queue new requests when the NAT thread is about to stop */
-    if (pThis->pSlirpThread->enmState != PDMTHREADSTATE_RUNNING)
+    if (pShard->pSlirpThread->enmState != PDMTHREADSTATE_RUNNING)
         return;
 
     ASMAtomicIncU32(&pThis->cUrgPkts);
     int rc = RTReqCallEx(pThis->pUrgRecvReqQueue, NULL /*ppReq*/, 0 /*cMillies*/, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
-                         (PFNRT)drvNATUrgRecvWorker, 4, pThis, pu8Buf, cb, m);
+                         (PFNRT)drvNATUrgRecvWorker, 4, pShard, pu8Buf, cb, m);
     AssertRC(rc);
     drvNATUrgRecvWakeup(pThis->pDrvIns, pThis->pUrgRecvThread);
 }
 
+/**
+ * Called by slirp from other threads when the NAT thread has work to pick up.
+ */
+void slirp_wakeup_nat_thread(void *pvUser)
+{
+    PDRVNATSHARD pShard = (PDRVNATSHARD)pvUser;
+    Assert(pShard);
+    drvNATNotifyNATThread(pShard, "slirp_wakeup_nat_thread");
+}
+
 /**
  * Function called by slirp to wake up device after VERR_TRY_AGAIN
  */
 void slirp_output_pending(void *pvUser)
 {
-    PDRVNAT pThis = (PDRVNAT)pvUser;
+    PDRVNAT pThis = ((PDRVNATSHARD)pvUser)->pThis;
     Assert(pThis);
     pThis->pIAboveNet->pfnXmitPending(pThis->pIAboveNet);
 }
@@ -923,27 +1431,118 @@ void slirp_output_pending(void *pvUser)
  */
 void slirp_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
 {
-    PDRVNAT pThis = (PDRVNAT)pvUser;
+    PDRVNATSHARD pShard = (PDRVNATSHARD)pvUser;
+    PDRVNAT pThis = pShard->pThis;
     Assert(pThis);
 
     LogFlow(("slirp_output BEGIN %x %d\n", pu8Buf, cb));
     Log2(("slirp_output: pu8Buf=%p cb=%#x (pThis=%p)\n%.*Rhxd\n", pu8Buf, cb, pThis, cb, pu8Buf));
 
-    PRTREQ pReq = NULL;
+    /* don't queue new frames when the NAT thread is about to stop */
+    if (pShard->pSlirpThread->enmState != PDMTHREADSTATE_RUNNING)
+        return;
 
-    /* don't queue new requests when the NAT thread is about to stop */
-    if (pThis->pSlirpThread->enmState != PDMTHREADSTATE_RUNNING)
+    PDRVNATRECVFRAME pFrame = (PDRVNATRECVFRAME)RTMemCacheAlloc(pThis->hRecvFrameCache);
+    if (RT_UNLIKELY(!pFrame))
+    {
+        slirp_ext_m_free(pShard->pNATState, m, (uint8_t *)pu8Buf);
+        STAM_COUNTER_INC(&pThis->StatQueuePktDropped);
         return;
+    }
+    pFrame->pNext  = NULL;
+    pFrame->pShard = pShard;
+    pFrame->m      = m;
+    pFrame->pu8Buf = (uint8_t *)pu8Buf;
+    pFrame->cb     = cb;
 
     ASMAtomicIncU32(&pThis->cPkts);
-    int rc = RTReqCallEx(pThis->pRecvReqQueue, NULL /*ppReq*/, 0 /*cMillies*/, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
-                         (PFNRT)drvNATRecvWorker, 4, pThis, pu8Buf, cb, m);
-    AssertRC(rc);
+    RTCritSectEnter(&pThis->RecvLock);
+    *pThis->ppRecvTail = pFrame;
+    pThis->ppRecvTail  = &pFrame->pNext;
+    RTCritSectLeave(&pThis->RecvLock);
     drvNATRecvWakeup(pThis->pDrvIns, pThis->pRecvThread);
     STAM_COUNTER_INC(&pThis->StatQueuePktSent);
 }
 
 
+#ifdef DRVNAT_WITH_LWIP
+/**
+ * Queues a frame from the lwIP TCP engine for the guest.
+ *
+ * @copydoc FNDRVNATLWIPOUTPUT
+ */
+static DECLCALLBACK(void) drvNATlwIPOutput(void *pvUser, void *pvFrame, size_t cbFrame, uint16_t cbMaxSeg)
+{
+    PDRVNAT pThis = (PDRVNAT)pvUser;
+
+    /* don't queue new frames when the engine thread is about to stop */
+    if (pThis->pLwIPThread->enmState != PDMTHREADSTATE_RUNNING)
+    {
+        RTMemFree(pvFrame);
+        return;
+    }
+
+    PDRVNATRECVFRAME pFrame = (PDRVNATRECVFRAME)RTMemCacheAlloc(pThis->hRecvFrameCache);
+    if (RT_UNLIKELY(!pFrame))
+    {
+        RTMemFree(pvFrame);
+        STAM_COUNTER_INC(&pThis->StatQueuePktDropped);
+        return;
+    }
+    pFrame->pNext    = NULL;
+    pFrame->pShard   = NULL;
+    pFrame->m        = NULL;
+    pFrame->pu8Buf   = (uint8_t *)pvFrame;
+    pFrame->cb       = (int)cbFrame;
+    pFrame->cbMaxSeg = cbMaxSeg;
+
+    ASMAtomicIncU32(&pThis->cPkts);
+    RTCritSectEnter(&pThis->RecvLock);
+    *pThis->ppRecvTail = pFrame;
+    pThis->ppRecvTail  = &pFrame->pNext;
+    RTCritSectLeave(&pThis->RecvLock);
+    drvNATRecvWakeup(pThis->pDrvIns, pThis->pRecvThread);
+    STAM_COUNTER_INC(&pThis->StatQueuePktSent);
+}
+
+
+/**
+ * Thread running the lwIP TCP engine.
+ */
+static DECLCALLBACK(int) drvNATlwIPThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PDRVNAT pThis = PDMINS_2_DATA(pDrvIns, PDRVNAT);
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    unsigned cErrors = 0;
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        int rc = DrvNATlwIPPoll(pThis->pLwIP, RT_MS_1SEC);
+        if (RT_FAILURE(rc))
+        {
+            if (cErrors++ < 16)
+                LogRel(("NAT: lwIP engine poll failed: %Rrc\n", rc));
+            RTThreadSleep(10);
+        }
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Unblocks the lwIP TCP engine thread so it can respond to a state change.
+ */
+static DECLCALLBACK(int) drvNATlwIPThreadWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PDRVNAT pThis = PDMINS_2_DATA(pDrvIns, PDRVNAT);
+    DrvNATlwIPWakeup(pThis->pLwIP);
+    return VINF_SUCCESS;
+}
+#endif /* DRVNAT_WITH_LWIP */
+
+
 /**
  * @interface_method_impl{PDMIBASE,pfnQueryInterface}
  */
@@ -971,7 +1570,12 @@ static void drvNATSetMac(PDRVNAT pThis)
         RTMAC Mac;
         pThis->pIAboveConfig->pfnGetMac(pThis->pIAboveConfig, &Mac);
         /* Re-activate the port forwarding. If  */
-        slirp_set_ethaddr_and_activate_port_forwarding(pThis->pNATState, Mac.au8, pThis->GuestIP);
+        for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
+            slirp_set_ethaddr_and_activate_port_forwarding(pThis->aShards[iShard].pNATState, Mac.au8, pThis->GuestIP);
+#ifdef DRVNAT_WITH_LWIP
+        if (pThis->pLwIP)
+            DrvNATlwIPSetGuestMac(pThis->pLwIP, &Mac);
+#endif
     }
 }
 
@@ -1005,7 +1609,16 @@ static DECLCALLBACK(void) drvNATPowerOn(PPDMDRVINS pDrvIns)
 static DECLCALLBACK(void) drvNATInfo(PPDMDRVINS pDrvIns, PCDBGFINFOHLP pHlp, const char *pszArgs)
 {
     PDRVNAT pThis = PDMINS_2_DATA(pDrvIns, PDRVNAT);
-    slirp_info(pThis->pNATState, pHlp, pszArgs);
+    for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
+    {
+        if (pThis->cShards > 1)
+            pHlp->pfnPrintf(pHlp, "Engine #%u:\n", iShard);
+        slirp_info(pThis->aShards[iShard].pNATState, pHlp, pszArgs);
+    }
+#ifdef DRVNAT_WITH_LWIP
+    if (pThis->pLwIP)
+        DrvNATlwIPInfo(pThis->pLwIP, pHlp);
+#endif
 }
 
 
@@ -1080,7 +1693,24 @@ static int drvNATConstructRedir(unsigned iInstance, PDRVNAT pThis, PCFGMNODE pCf
          */
         struct in_addr BindIP;
         GETIP_DEF(rc, pThis, pNode, BindIP, INADDR_ANY);
-        if (slirp_add_redirect(pThis->pNATState, fUDP, BindIP, iHostPort, GuestIP, iGuestPort, Mac.au8) < 0)
+#ifdef DRVNAT_WITH_LWIP
+        if (!fUDP && pThis->pLwIP)
+        {
+            RTNETADDRIPV4 HostAddr, GuestAddr;
+            HostAddr.u  = BindIP.s_addr;
+            GuestAddr.u = GuestIP.s_addr;
+            rc = DrvNATlwIPAddRedirect(pThis->pLwIP, HostAddr, (uint16_t)iHostPort, GuestAddr, (uint16_t)iGuestPort);
+            if (RT_FAILURE(rc))
+                return PDMDrvHlpVMSetError(pThis->pDrvIns, VERR_NAT_REDIR_SETUP, RT_SRC_POS,
+                                           N_("NAT#%d: configuration error: failed to set up "
+                                           "redirection of %d to %d. Probably a conflict with "
+                                           "existing services or other rules"), iInstance, iHostPort,
+                                           iGuestPort);
+            continue;
+        }
+#endif
+        slirp_flow_add_forward(&pThis->FlowSel, fUDP, (uint16_t)iGuestPort);
+        if (slirp_add_redirect(pThis->aShards[0].pNATState, fUDP, BindIP, iHostPort, GuestIP, iGuestPort, Mac.au8) < 0)
             return PDMDrvHlpVMSetError(pThis->pDrvIns, VERR_NAT_REDIR_SETUP, RT_SRC_POS,
                                        N_("NAT#%d: configuration error: failed to set up "
                                        "redirection of %d to %d. Probably a conflict with "
@@ -1106,24 +1736,74 @@ static DECLCALLBACK(void) drvNATDestruct(PPDMDRVINS pDrvIns)
     LogFlow(("drvNATDestruct:\n"));
     PDMDRV_CHECK_VERSIONS_RETURN_VOID(pDrvIns);
 
-    if (pThis->pNATState)
+    if (pThis->aShards[0].pNATState)
     {
-        slirp_term(pThis->pNATState);
-        slirp_deregister_statistics(pThis->pNATState, pDrvIns);
+        for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
+            slirp_deregister_statistics(pThis->aShards[iShard].pNATState, pDrvIns);
 #ifdef VBOX_WITH_STATISTICS
 # define DRV_PROFILE_COUNTER(name, dsc)     DEREGISTER_COUNTER(name, pThis)
 # define DRV_COUNTING_COUNTER(name, dsc)    DEREGISTER_COUNTER(name, pThis)
 # include "counters.h"
 #endif
-        pThis->pNATState = NULL;
     }
 
-    RTReqDestroyQueue(pThis->pSlirpReqQueue);
-    pThis->pSlirpReqQueue = NULL;
+    /*
+     * This also runs when the construction failed half way, so each engine may
+     * be missing its thread, pipe and queue.  The thread has to go before the
+     * engine it polls.
+     */
+    for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
+    {
+        PDRVNATSHARD pShard = &pThis->aShards[iShard];
+        if (pShard->pSlirpThread)
+        {
+            PDMR3ThreadDestroy(pShard->pSlirpThread, NULL);
+            pShard->pSlirpThread = NULL;
+        }
+        if (pShard->pNATState)
+        {
+            slirp_term(pShard->pNATState);
+            pShard->pNATState = NULL;
+        }
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pShard->StatFramesIn);
+
+#ifndef RT_OS_WINDOWS
+        RTPipeClose(pShard->hPipeRead);
+        pShard->hPipeRead = NIL_RTPIPE;
+        RTPipeClose(pShard->hPipeWrite);
+        pShard->hPipeWrite = NIL_RTPIPE;
+#else
+        if (pShard->hWakeupEvent)
+        {
+            CloseHandle(pShard->hWakeupEvent);
+            pShard->hWakeupEvent = NULL;
+        }
+#endif
+
+        RTReqDestroyQueue(pShard->pSlirpReqQueue);
+        pShard->pSlirpReqQueue = NULL;
+    }
+
+#ifdef DRVNAT_WITH_LWIP
+    DrvNATlwIPDestroy(pThis->pLwIP);
+    pThis->pLwIP = NULL;
+#endif
 
     RTReqDestroyQueue(pThis->pUrgRecvReqQueue);
     pThis->pUrgRecvReqQueue = NULL;
 
+    /* The mbufs of frames still queued went away with the engines above,
+       the frames of the lwIP engine are plain heap blocks. */
+    for (PDRVNATRECVFRAME pFrame = pThis->pRecvHead; pFrame; pFrame = pFrame->pNext)
+        if (!pFrame->pShard)
+            RTMemFree(pFrame->pu8Buf);
+    RTMemCacheDestroy(pThis->hRecvFrameCache);
+    pThis->hRecvFrameCache = NIL_RTMEMCACHE;
+    pThis->pRecvHead = NULL;
+
+    if (RTCritSectIsInitialized(&pThis->RecvLock))
+        RTCritSectDelete(&pThis->RecvLock);
+
     RTSemEventDestroy(pThis->EventRecv);
     pThis->EventRecv = NIL_RTSEMEVENT;
 
@@ -1157,7 +1837,7 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
                               "\0NextServer\0DNSProxy\0BindIP\0UseHostResolver\0"
                               "SlirpMTU\0AliasMode\0"
                               "SockRcv\0SockSnd\0TcpRcv\0TcpSnd\0"
-                              "SoMaxConnection\0"))
+                              "SoMaxConnection\0WorkerThreads\0TcpEngine\0"))
         return PDMDRV_SET_ERROR(pDrvIns, VERR_PDM_DRVINS_UNKNOWN_CFG_VALUES,
                                 N_("Unknown NAT configuration option, only supports PassDomain,"
                                 " TFTPPrefix, BootFile and Network"));
@@ -1166,14 +1846,29 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
      * Init the static parts.
      */
     pThis->pDrvIns                      = pDrvIns;
-    pThis->pNATState                    = NULL;
     pThis->pszTFTPPrefix                = NULL;
     pThis->pszBootFile                  = NULL;
     pThis->pszNextServer                = NULL;
-    pThis->pSlirpReqQueue               = NULL;
+    pThis->cShards                      = 0;
     pThis->pUrgRecvReqQueue             = NULL;
+    pThis->pRecvHead                    = NULL;
+    pThis->ppRecvTail                   = &pThis->pRecvHead;
+    pThis->hRecvFrameCache              = NIL_RTMEMCACHE;
     pThis->EventRecv                    = NIL_RTSEMEVENT;
     pThis->EventUrgRecv                 = NIL_RTSEMEVENT;
+    for (uint32_t iShard = 0; iShard < RT_ELEMENTS(pThis->aShards); iShard++)
+    {
+        PDRVNATSHARD pShard = &pThis->aShards[iShard];
+        pShard->pNATState       = NULL;
+        pShard->pSlirpReqQueue  = NULL;
+        pShard->pSlirpThread    = NULL;
+#ifndef RT_OS_WINDOWS
+        pShard->hPipeRead       = NIL_RTPIPE;
+        pShard->hPipeWrite      = NIL_RTPIPE;
+#else
+        pShard->hWakeupEvent    = NULL;
+#endif
+    }
 
     /* IBase */
     pDrvIns->IBase.pfnQueryInterface    = drvNATQueryInterface;
@@ -1183,6 +1878,7 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
     pThis->INetworkUp.pfnAllocBuf           = drvNATNetworkUp_AllocBuf;
     pThis->INetworkUp.pfnFreeBuf            = drvNATNetworkUp_FreeBuf;
     pThis->INetworkUp.pfnSendBuf            = drvNATNetworkUp_SendBuf;
+    pThis->INetworkUp.pfnSendBufs           = drvNATNetworkUp_SendBufs;
     pThis->INetworkUp.pfnEndXmit            = drvNATNetworkUp_EndXmit;
     pThis->INetworkUp.pfnSetPromiscuousMode = drvNATNetworkUp_SetPromiscuousMode;
     pThis->INetworkUp.pfnNotifyLinkChanged  = drvNATNetworkUp_NotifyLinkChanged;
@@ -1216,6 +1912,40 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
     i32AliasMode |= (i32MainAliasMode & 0x4 ? 0x4 : 0);
     int i32SoMaxConn = 1;
     GET_S32(rc, pThis, pCfg, "SoMaxConnection", i32SoMaxConn);
+    /* Number of engines guest flows are spread over, each with its own thread. */
+    uint32_t cShards;
+    rc = CFGMR3QueryU32Def(pCfg, "WorkerThreads", &cShards, 1);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("NAT: configuration query for \"WorkerThreads\" failed"));
+    if (cShards < 1 || cShards > DRVNAT_SHARDS_MAX)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("NAT#%d: \"WorkerThreads\" must be between 1 and %u"),
+                                   pDrvIns->iInstance, DRVNAT_SHARDS_MAX);
+#ifdef VBOX_WITH_SLIRP_MT
+    cShards = 1; /* the multi-threaded slirp has its own guest thread */
+#endif
+    /* The engine guest TCP connections are terminated in, "slirp" or "lwip".
+       Only one adapter of the VM can have "lwip", for the next one
+       DrvNATlwIPCreate fails with VERR_RESOURCE_BUSY and so does the VM start. */
+    char szTcpEngine[16];
+    GET_STRING(rc, pThis, pCfg, "TcpEngine", szTcpEngine[0], sizeof(szTcpEngine));
+    if (rc == VERR_CFGM_VALUE_NOT_FOUND)
+        RTStrCopy(szTcpEngine, sizeof(szTcpEngine), "slirp");
+    bool fLwIP = false;
+    if (!RTStrICmp(szTcpEngine, "lwip"))
+    {
+#ifdef DRVNAT_WITH_LWIP
+        fLwIP = true;
+#else
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_NOT_SUPPORTED, RT_SRC_POS,
+                                   N_("NAT#%d: the lwIP TCP engine is not available on this host"),
+                                   pDrvIns->iInstance);
+#endif
+    }
+    else if (RTStrICmp(szTcpEngine, "slirp"))
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("NAT#%d: Invalid configuration value for \"TcpEngine\": \"%s\""),
+                                   pDrvIns->iInstance, szTcpEngine);
     /*
      * Query the network port interface.
      */
@@ -1246,42 +1976,94 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
                                    "network '%s' describes not a valid IPv4 network"),
                                    pDrvIns->iInstance, szNetwork);
 
+    pThis->Network = Network;
+    pThis->Netmask = Netmask;
+
     /*
-     * Initialize slirp.
+     * Initialize slirp, one engine per worker thread.
      */
-    rc = slirp_init(&pThis->pNATState, RT_H2N_U32(Network), Netmask,
-                    fPassDomain, !!fUseHostResolver, i32AliasMode, pThis);
-    if (RT_SUCCESS(rc))
+    char *pszBindIP = NULL;
+    GET_STRING_ALLOC(rc, pThis, pCfg, "BindIP", pszBindIP);
+    int rcInit = VINF_SUCCESS;
+    for (uint32_t iShard = 0; iShard < cShards; iShard++)
     {
-        slirp_set_dhcp_TFTP_prefix(pThis->pNATState, pThis->pszTFTPPrefix);
-        slirp_set_dhcp_TFTP_bootfile(pThis->pNATState, pThis->pszBootFile);
-        slirp_set_dhcp_next_server(pThis->pNATState, pThis->pszNextServer);
-        slirp_set_dhcp_dns_proxy(pThis->pNATState, !!fDNSProxy);
-        slirp_set_mtu(pThis->pNATState, MTU);
-        slirp_set_somaxconn(pThis->pNATState, i32SoMaxConn);
-        char *pszBindIP = NULL;
-        GET_STRING_ALLOC(rc, pThis, pCfg, "BindIP", pszBindIP);
-        rc = slirp_set_binding_address(pThis->pNATState, pszBindIP);
-        if (rc != 0)
+        PDRVNATSHARD pShard = &pThis->aShards[iShard];
+        pShard->pThis  = pThis;
+        pShard->iShard = iShard;
+        rc = slirp_init(&pShard->pNATState, RT_H2N_U32(Network), Netmask,
+                        fPassDomain, !!fUseHostResolver, i32AliasMode, iShard != 0, pShard);
+        if (RT_FAILURE(rc))
+            break;
+        pThis->cShards++;
+        if (iShard == 0)
+            rcInit = rc; /* might be VINF_NAT_DNS */
+
+        slirp_set_dhcp_TFTP_prefix(pShard->pNATState, pThis->pszTFTPPrefix);
+        slirp_set_dhcp_TFTP_bootfile(pShard->pNATState, pThis->pszBootFile);
+        slirp_set_dhcp_next_server(pShard->pNATState, pThis->pszNextServer);
+        slirp_set_dhcp_dns_proxy(pShard->pNATState, !!fDNSProxy);
+        slirp_set_mtu(pShard->pNATState, MTU);
+        /* Leave TCP segmentation to devices doing large receives. */
+        slirp_set_gso(pShard->pNATState, pThis->pIAboveNet->pfnReceiveGso != NULL);
+        slirp_set_somaxconn(pShard->pNATState, i32SoMaxConn);
+        rc = slirp_set_binding_address(pShard->pNATState, pszBindIP);
+        if (rc != 0 && iShard == 0)
             LogRel(("NAT: value of BindIP has been ignored\n"));
-
-        if(pszBindIP != NULL)
-            MMR3HeapFree(pszBindIP);
 #define SLIRP_SET_TUNING_VALUE(name, setter)                    \
             do                                                  \
             {                                                   \
                 int len = 0;                                    \
                 rc = CFGMR3QueryS32(pCfg, name, &len);    \
                 if (RT_SUCCESS(rc))                             \
-                    setter(pThis->pNATState, len);              \
+                    setter(pShard->pNATState, len);             \
             } while(0)
 
         SLIRP_SET_TUNING_VALUE("SockRcv", slirp_set_rcvbuf);
         SLIRP_SET_TUNING_VALUE("SockSnd", slirp_set_sndbuf);
         SLIRP_SET_TUNING_VALUE("TcpRcv", slirp_set_tcp_rcvspace);
         SLIRP_SET_TUNING_VALUE("TcpSnd", slirp_set_tcp_sndspace);
+        rc = VINF_SUCCESS;
+
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pShard->StatFramesIn, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
+                               STAMUNIT_COUNT, "Guest frames handed to the engine",
+                               "/Drivers/NAT%u/Engine%u/FramesIn", pDrvIns->iInstance, iShard);
+    }
+    slirp_flow_init(&pThis->FlowSel, Network, Netmask, pThis->cShards);
+#ifdef DRVNAT_WITH_LWIP
+    if (RT_SUCCESS(rc) && fLwIP)
+    {
+        DRVNATLWIPCFG LwIPCfg;
+        LwIPCfg.Network       = Network;
+        LwIPCfg.Netmask       = Netmask;
+        LwIPCfg.pszBindIP     = pszBindIP;
+        LwIPCfg.fLargeReceive = pThis->pIAboveNet->pfnReceiveGso != NULL;
+        LwIPCfg.pfnOutput     = drvNATlwIPOutput;
+        LwIPCfg.pvUser        = pThis;
+        rc = DrvNATlwIPCreate(&pThis->pLwIP, &LwIPCfg);
+        if (RT_FAILURE(rc))
+        {
+            if (pszBindIP != NULL)
+                MMR3HeapFree(pszBindIP);
+            for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
+            {
+                slirp_term(pThis->aShards[iShard].pNATState);
+                pThis->aShards[iShard].pNATState = NULL;
+            }
+            return PDMDrvHlpVMSetError(pDrvIns, rc, RT_SRC_POS,
+                                       rc == VERR_RESOURCE_BUSY
+                                       ? N_("NAT#%d: the lwIP TCP engine is already used by another network adapter or by the internal networking stack")
+                                       : N_("NAT#%d: failed to start the lwIP TCP engine"),
+                                       pDrvIns->iInstance);
+        }
+    }
+#endif
+    if (pszBindIP != NULL)
+        MMR3HeapFree(pszBindIP);
 
-        slirp_register_statistics(pThis->pNATState, pDrvIns);
+    if (RT_SUCCESS(rc))
+    {
+        for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
+            slirp_register_statistics(pThis->aShards[iShard].pNATState, pDrvIns, iShard);
 #ifdef VBOX_WITH_STATISTICS
 # define DRV_PROFILE_COUNTER(name, dsc)     REGISTER_COUNTER(name, pThis, STAMTYPE_PROFILE, STAMUNIT_TICKS_PER_CALL, dsc)
 # define DRV_COUNTING_COUNTER(name, dsc)    REGISTER_COUNTER(name, pThis, STAMTYPE_COUNTER, STAMUNIT_COUNT,          dsc)
@@ -1298,19 +2080,12 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
             rc = PDMDrvHlpSSMRegisterLoadDone(pDrvIns, drvNATLoadDone);
             AssertRCReturn(rc, rc);
 
-            rc = RTReqCreateQueue(&pThis->pSlirpReqQueue);
-            if (RT_FAILURE(rc))
-            {
-                LogRel(("NAT: Can't create request queue\n"));
-                return rc;
-            }
+            rc = RTCritSectInit(&pThis->RecvLock);
+            AssertRCReturn(rc, rc);
 
-            rc = RTReqCreateQueue(&pThis->pRecvReqQueue);
-            if (RT_FAILURE(rc))
-            {
-                LogRel(("NAT: Can't create request queue\n"));
-                return rc;
-            }
+            rc = RTMemCacheCreate(&pThis->hRecvFrameCache, sizeof(DRVNATRECVFRAME), 0, UINT32_MAX,
+                                  NULL, NULL, NULL, 0);
+            AssertRCReturn(rc, rc);
 
             rc = RTReqCreateQueue(&pThis->pUrgRecvReqQueue);
             if (RT_FAILURE(rc))
@@ -1346,21 +2121,44 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
             RTStrPrintf(szTmp, sizeof(szTmp), "nat%d", pDrvIns->iInstance);
             PDMDrvHlpDBGFInfoRegister(pDrvIns, szTmp, "NAT info.", drvNATInfo);
 
+            for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
+            {
+                PDRVNATSHARD pShard = &pThis->aShards[iShard];
+
+                rc = RTReqCreateQueue(&pShard->pSlirpReqQueue);
+                if (RT_FAILURE(rc))
+                {
+                    LogRel(("NAT: Can't create request queue\n"));
+                    return rc;
+                }
+
 #ifndef RT_OS_WINDOWS
-            /*
-             * Create the control pipe.
-             */
-            rc = RTPipeCreate(&pThis->hPipeRead, &pThis->hPipeWrite, 0 /*fFlags*/);
-            AssertRCReturn(rc, rc);
+                /*
+                 * Create the control pipe.
+                 */
+                rc = RTPipeCreate(&pShard->hPipeRead, &pShard->hPipeWrite, 0 /*fFlags*/);
+                AssertRCReturn(rc, rc);
+# ifdef VBOX_WITH_NAT_EPOLL
+                rc = slirp_register_wakeup_fd(pShard->pNATState, RTPipeToNative(pShard->hPipeRead));
+                AssertRCReturn(rc, rc);
+# endif
 #else
-            pThis->hWakeupEvent = CreateEvent(NULL, FALSE, FALSE, NULL); /* auto-reset event */
-            slirp_register_external_event(pThis->pNATState, pThis->hWakeupEvent,
-                                          VBOX_WAKEUP_EVENT_INDEX);
+                pShard->hWakeupEvent = CreateEvent(NULL, FALSE, FALSE, NULL); /* auto-reset event */
+                slirp_register_external_event(pShard->pNATState, pShard->hWakeupEvent,
+                                              VBOX_WAKEUP_EVENT_INDEX);
 #endif
 
-            rc = PDMDrvHlpThreadCreate(pDrvIns, &pThis->pSlirpThread, pThis, drvNATAsyncIoThread,
-                                       drvNATAsyncIoWakeup, 128 * _1K, RTTHREADTYPE_IO, "NAT");
-            AssertRCReturn(rc, rc);
+                char szThread[16];
+                if (iShard == 0)
+                    RTStrCopy(szThread, sizeof(szThread), "NAT");
+                else
+                    RTStrPrintf(szThread, sizeof(szThread), "NAT%u", iShard);
+                rc = PDMDrvHlpThreadCreate(pDrvIns, &pShard->pSlirpThread, pShard, drvNATAsyncIoThread,
+                                           drvNATAsyncIoWakeup, 128 * _1K, RTTHREADTYPE_IO, szThread);
+                AssertRCReturn(rc, rc);
+
+                pShard->enmLinkState = PDMNETWORKLINKSTATE_UP;
+            }
 
 #ifdef VBOX_WITH_SLIRP_MT
             rc = PDMDrvHlpThreadCreate(pDrvIns, &pThis->pGuestThread, pThis, drvNATAsyncIoGuest,
@@ -1368,15 +2166,23 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
             AssertRCReturn(rc, rc);
 #endif
 
-            pThis->enmLinkState = pThis->enmLinkStateWant = PDMNETWORKLINKSTATE_UP;
+#ifdef DRVNAT_WITH_LWIP
+            if (pThis->pLwIP)
+            {
+                rc = PDMDrvHlpThreadCreate(pDrvIns, &pThis->pLwIPThread, pThis, drvNATlwIPThread,
+                                           drvNATlwIPThreadWakeup, 128 * _1K, RTTHREADTYPE_IO, "NATLWIP");
+                AssertRCReturn(rc, rc);
+                LogRel(("NAT: guest TCP connections are handled by the lwIP engine\n"));
+            }
+#endif
+
+            pThis->enmLinkStateWant = PDMNETWORKLINKSTATE_UP;
+            if (pThis->cShards > 1)
+                LogRel(("NAT: guest TCP and UDP flows are distributed over %u engines\n", pThis->cShards));
 
             /* might return VINF_NAT_DNS */
-            return rc;
+            return rcInit;
         }
-
-        /* failure path */
-        slirp_term(pThis->pNATState);
-        pThis->pNATState = NULL;
     }
     else
     {
@@ -1384,6 +2190,13 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
         AssertMsgFailed(("Add error message for rc=%d (%Rrc)\n", rc, rc));
     }
 
+    /* failure path */
+    for (uint32_t iShard = 0; iShard < pThis->cShards; iShard++)
+    {
+        slirp_term(pThis->aShards[iShard].pNATState);
+        pThis->aShards[iShard].pNATState = NULL;
+    }
+
     return rc;
 }
 
@@ -0,0 +1,1446 @@
+/* $Id$ */
+/** @file
+ * DrvNATlwIP - lwIP based TCP engine for the NAT driver.
+ *
+ * Guest TCP connections are terminated in lwIP, with large windows and window
+ * scaling, and proxied to host sockets.  lwIP runs without its tcpip thread:
+ * everything, input processing, timers and socket I/O, happens on the thread
+ * calling DrvNATlwIPPoll.  The stack is global, so there is one engine per
+ * process and it cannot be combined with DevINIP: a second NAT adapter with
+ * TcpEngine=lwip fails the VM start with VERR_RESOURCE_BUSY.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#define LOG_GROUP LOG_GROUP_DRV_NAT
+#include <iprt/cdefs.h>     /* include early to allow RT_C_DECLS_BEGIN hack */
+#include <iprt/mem.h>       /* include anything of ours that the lwip headers use. */
+#include <iprt/semaphore.h>
+#include <iprt/thread.h>
+#include <iprt/alloca.h>
+/* All lwip header files are not C++ safe. So hack around this. */
+RT_C_DECLS_BEGIN
+#include "lwip/sys.h"
+#include "lwip/stats.h"
+#include "lwip/mem.h"
+#include "lwip/memp.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include "ipv4/lwip/ip.h"
+#include "lwip/tcp.h"
+#include "lwip/inet.h"
+RT_C_DECLS_END
+#include <VBox/vmm/pdmnetinline.h>
+#include <VBox/vmm/dbgf.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/critsect.h>
+#include <iprt/err.h>
+#include <iprt/net.h>
+#include <iprt/pipe.h>
+#include <iprt/string.h>
+#include <iprt/time.h>
+
+#ifdef RT_OS_OS2 /* temporary workaround, see ticket #127 */
+# include <sys/time.h>
+#endif
+#include <poll.h>
+
+#include "DrvNATlwIP.h"
+#include "DrvNATlwIPSock.h"
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** Max number of guest segments waiting for the engine thread. */
+#define DRVNATLWIP_INPUT_MAX        1024
+/** Max size of a coalesced frame to the guest, ethernet header included. */
+#define DRVNATLWIP_GRO_FRAME_MAX    (_64K - 1)
+/** Max number of bytes moved from a host socket to lwIP at a time
+ * (tcp_write takes a 16-bit length). */
+#define DRVNATLWIP_XFER_MAX         0xffff
+/** Number of TCP PCBs, one per guest connection.  The static pools are sized
+ * for DevINIP, the rest is added with memp_add. */
+#define DRVNATLWIP_TCP_PCBS         256
+/** Number of TCP segments, enough to fill the large send buffers. */
+#define DRVNATLWIP_TCP_SEGS         2048
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * A proxied connection, the lwIP PCB facing the guest plus the host socket.
+ */
+typedef struct DRVNATLWIPCONN
+{
+    /** The next connection. */
+    struct DRVNATLWIPCONN  *pNext;
+    /** The lwIP PCB, NULL once lwIP is done with it. */
+    struct tcp_pcb         *pcb;
+    /** The host socket. */
+    int                     hSock;
+    /** Index into DRVNATLWIP::paPollFds, -1 if not polled. */
+    int                     iPollFd;
+    /** Guest data not yet written to the host socket. */
+    struct pbuf            *pToHost;
+    /** How much of the first pbuf in pToHost was written already. */
+    uint16_t                offToHost;
+    /** Host data lwIP had no room for. */
+    uint8_t                *pbStash;
+    /** Size of the data in pbStash. */
+    size_t                  cbStash;
+    /** Port forwarding: the host accepted and lwIP connects to the guest. */
+    bool                    fForward;
+    /** Both sides are connected. */
+    bool                    fConnected;
+    /** The guest sent a FIN. */
+    bool                    fGuestFin;
+    /** The FIN was passed on to the host. */
+    bool                    fShutWr;
+    /** The host closed its side. */
+    bool                    fHostEof;
+    /** The FIN was passed on to the guest. */
+    bool                    fFinSent;
+    /** The connection failed, everything pending is discarded. */
+    bool                    fDead;
+    /** Reset the host side when closing the socket. */
+    bool                    fReset;
+} DRVNATLWIPCONN;
+/** Pointer to a proxied connection. */
+typedef DRVNATLWIPCONN *PDRVNATLWIPCONN;
+
+/**
+ * A TCP port forwarding rule.
+ */
+typedef struct DRVNATLWIPFWD
+{
+    /** The next rule. */
+    struct DRVNATLWIPFWD   *pNext;
+    /** The listening host socket. */
+    int                     hSock;
+    /** Index into DRVNATLWIP::paPollFds, -1 if not polled. */
+    int                     iPollFd;
+    /** The rule was removed, the engine thread cleans up. */
+    bool                    fRemoved;
+    /** The host address. */
+    RTNETADDRIPV4           HostIP;
+    /** The host port. */
+    uint16_t                u16HostPort;
+    /** The guest port. */
+    uint16_t                u16GuestPort;
+    /** The guest address. */
+    RTNETADDRIPV4           GuestIP;
+} DRVNATLWIPFWD;
+/** Pointer to a port forwarding rule. */
+typedef DRVNATLWIPFWD *PDRVNATLWIPFWD;
+
+/**
+ * The lwIP TCP engine.
+ */
+typedef struct DRVNATLWIP
+{
+    /** Where frames for the guest go. */
+    PFNDRVNATLWIPOUTPUT     pfnOutput;
+    /** User argument for pfnOutput. */
+    void                   *pvUser;
+    /** Whether to coalesce segments to the guest. */
+    bool                    fLargeReceive;
+    /** The address outgoing connections are bound to (network order). */
+    uint32_t                u32BindAddr;
+    /** The NAT's own address, connections to it go to the host loopback. */
+    struct ip_addr          AliasIP;
+    /** The lwIP interface facing the guest. */
+    struct netif            NetIf;
+    /** The guest MAC address as used for output. */
+    RTMAC                   GuestMac;
+
+    /** Lock protecting the input ring, GuestMacIn and the rule list. */
+    RTCRITSECT              Lock;
+    /** Guest segments waiting for the engine thread (IP header up front). */
+    struct pbuf            *apInput[DRVNATLWIP_INPUT_MAX];
+    /** The oldest entry in apInput. */
+    uint32_t                iInputHead;
+    /** Number of entries in apInput. */
+    uint32_t                cInput;
+    /** The guest MAC address learned from the input. */
+    RTMAC                   GuestMacIn;
+    /** Port forwarding rules. */
+    PDRVNATLWIPFWD          pFwds;
+
+    /** The read end of the wakeup pipe. */
+    RTPIPE                  hPipeRead;
+    /** The write end of the wakeup pipe. */
+    RTPIPE                  hPipeWrite;
+    /** The proxied connections. */
+    PDRVNATLWIPCONN         pConns;
+    /** poll() array, the pipe comes first. */
+    struct pollfd          *paPollFds;
+    /** Number of entries paPollFds has room for. */
+    uint32_t                cPollFdsAlloc;
+    /** When tcp_slowtmr is due next (RTTimeMilliTS). */
+    uint64_t                u64NextSlowTmr;
+    /** Bounce buffer for host to guest data. */
+    uint8_t                *pbXfer;
+
+    /** The frame being coalesced, NULL if none. */
+    uint8_t                *pbGro;
+    /** Size of the frame in pbGro. */
+    size_t                  cbGro;
+    /** Number of segments in pbGro. */
+    uint32_t                cGroSegs;
+    /** Payload size of the first segment, all but the last have this size. */
+    uint16_t                cbGroSeg;
+    /** No more segments may be added (short or PSH segment seen). */
+    bool                    fGroClosed;
+    /** The sequence number the next segment must have (host order). */
+    uint32_t                uGroNextSeq;
+
+    /** @name Statistics, read without locking by DrvNATlwIPInfo.
+     * @{ */
+    uint64_t                cConnsTotal;
+    uint64_t                cConnsFailed;
+    uint64_t                cConnsForwarded;
+    uint32_t                cConnsActive;
+    uint64_t                cFramesIn;
+    /** Updated atomically, the EMTs of all the devices may drop frames. */
+    uint64_t volatile       cFramesInDropped;
+    uint64_t                cFramesOut;
+    uint64_t                cFramesCoalesced;
+    uint64_t                cSegsCoalesced;
+    uint64_t                cbToHost;
+    uint64_t                cbToGuest;
+    /** @} */
+} DRVNATLWIP;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The (only) engine in the process. */
+static PDRVNATLWIP g_pDrvNATlwIP = NULL;
+/** Whether the lwIP globals were set up already. */
+static bool        g_fDrvNATlwIPStackInitialized = false;
+/** The source MAC address of frames to the guest, slirp's alias address. */
+static const RTMAC g_DrvNATlwIPMac = { { 0x52, 0x54, 0x00, 0x12, 0x35, 0x02 } };
+
+
+/*******************************************************************************
+*   Internal Functions                                                         *
+*******************************************************************************/
+extern bool DevINIPConfigured(void);
+static void drvNATlwIPGroFlush(PDRVNATLWIP pEngine);
+
+
+/**
+ * Fills in the ethernet header of a frame to the guest.
+ */
+static void drvNATlwIPEthHdr(PDRVNATLWIP pEngine, uint8_t *pbFrame)
+{
+    PRTNETETHERHDR pEthHdr = (PRTNETETHERHDR)pbFrame;
+    static const RTMAC s_Broadcast = { { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff } };
+    static const RTMAC s_Zero      = { { 0, 0, 0, 0, 0, 0 } };
+    pEthHdr->DstMac    = memcmp(&pEngine->GuestMac, &s_Zero, sizeof(s_Zero)) ? pEngine->GuestMac : s_Broadcast;
+    pEthHdr->SrcMac    = g_DrvNATlwIPMac;
+    pEthHdr->EtherType = RT_H2BE_U16_C(RTNET_ETHERTYPE_IPV4);
+}
+
+
+/**
+ * Copies data out of a pbuf chain.
+ *
+ * @param   p               The pbuf chain.
+ * @param   off             Where to start in the chain.
+ * @param   pbDst           Where to copy to.
+ * @param   cb              How much to copy.
+ */
+static void drvNATlwIPCopyOut(struct pbuf *p, size_t off, uint8_t *pbDst, size_t cb)
+{
+    for (; p && cb; p = p->next)
+    {
+        if (off >= p->len)
+        {
+            off -= p->len;
+            continue;
+        }
+        size_t cbChunk = RT_MIN(cb, (size_t)p->len - off);
+        memcpy(pbDst, (uint8_t const *)p->payload + off, cbChunk);
+        pbDst += cbChunk;
+        cb    -= cbChunk;
+        off    = 0;
+    }
+}
+
+
+/**
+ * Checks whether an outgoing IP packet is a TCP data segment which can be
+ * coalesced with others.
+ *
+ * @returns true if it can, false if not.
+ * @param   p               The packet, the IP and TCP headers are expected in
+ *                          the first pbuf (lwIP builds them that way).
+ * @param   ppIpHdr         Where to return the IP header.
+ * @param   ppTcpHdr        Where to return the TCP header.
+ * @param   pcbPayload      Where to return the payload size.
+ */
+static bool drvNATlwIPGroParse(struct pbuf *p, PCRTNETIPV4 *ppIpHdr, PCRTNETTCP *ppTcpHdr, uint16_t *pcbPayload)
+{
+    if (p->len < RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN)
+        return false;
+
+    PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)p->payload;
+    if (   pIpHdr->ip_v  != 4
+        || pIpHdr->ip_hl != RTNETIPV4_MIN_LEN / 4
+        || pIpHdr->ip_p  != RTNETIPV4_PROT_TCP
+        || (RT_BE2H_U16(pIpHdr->ip_off) & (RTNETIPV4_FLAGS_MF | UINT16_C(0x1fff) /* offset */)))
+        return false;
+
+    /* Plain ACK or ACK+PSH without options.  Everything else goes out as is. */
+    PCRTNETTCP pTcpHdr = (PCRTNETTCP)(pIpHdr + 1);
+    if (   pTcpHdr->th_off != RTNETTCP_MIN_LEN / 4
+        || (pTcpHdr->th_flags & ~(RTNETTCP_F_ACK | RTNETTCP_F_PSH))
+        || !(pTcpHdr->th_flags & RTNETTCP_F_ACK))
+        return false;
+
+    uint16_t const cbIp = RT_BE2H_U16(pIpHdr->ip_len);
+    if (   cbIp <= RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN
+        || cbIp != p->tot_len)
+        return false;
+
+    *ppIpHdr    = pIpHdr;
+    *ppTcpHdr   = pTcpHdr;
+    *pcbPayload = cbIp - RTNETIPV4_MIN_LEN - RTNETTCP_MIN_LEN;
+    return true;
+}
+
+
+/**
+ * Tries to add a segment to the frame being coalesced.
+ *
+ * @returns true if added, false if the caller has to flush and start over.
+ * @param   pEngine         The engine.
+ * @param   p               The IP packet.
+ */
+static bool drvNATlwIPGroAppend(PDRVNATLWIP pEngine, struct pbuf *p)
+{
+    if (!pEngine->pbGro || pEngine->fGroClosed)
+        return false;
+
+    PCRTNETIPV4 pIpHdr;
+    PCRTNETTCP  pTcpHdr;
+    uint16_t    cbPayload;
+    if (!drvNATlwIPGroParse(p, &pIpHdr, &pTcpHdr, &cbPayload))
+        return false;
+
+    PRTNETIPV4 pGroIpHdr  = (PRTNETIPV4)(pEngine->pbGro + sizeof(RTNETETHERHDR));
+    PRTNETTCP  pGroTcpHdr = (PRTNETTCP)(pGroIpHdr + 1);
+    if (   pIpHdr->ip_src.u       != pGroIpHdr->ip_src.u
+        || pIpHdr->ip_dst.u       != pGroIpHdr->ip_dst.u
+        || pTcpHdr->th_sport      != pGroTcpHdr->th_sport
+        || pTcpHdr->th_dport      != pGroTcpHdr->th_dport
+        || RT_BE2H_U32(pTcpHdr->th_seq) != pEngine->uGroNextSeq
+        || cbPayload > pEngine->cbGroSeg
+        || pEngine->cbGro + cbPayload > DRVNATLWIP_GRO_FRAME_MAX)
+        return false;
+
+    drvNATlwIPCopyOut(p, RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN, pEngine->pbGro + pEngine->cbGro, cbPayload);
+    pEngine->cbGro       += cbPayload;
+    pEngine->uGroNextSeq += cbPayload;
+    pEngine->cGroSegs++;
+
+    /* The newest segment carries the current ACK and window. */
+    pGroTcpHdr->th_ack    = pTcpHdr->th_ack;
+    pGroTcpHdr->th_win    = pTcpHdr->th_win;
+    pGroTcpHdr->th_flags |= pTcpHdr->th_flags & RTNETTCP_F_PSH;
+    if (   cbPayload < pEngine->cbGroSeg
+        || (pTcpHdr->th_flags & RTNETTCP_F_PSH))
+        pEngine->fGroClosed = true;
+    return true;
+}
+
+
+/**
+ * Starts coalescing with the given segment if it qualifies.
+ *
+ * @returns true if started, false if the caller has to send the packet as is.
+ * @param   pEngine         The engine.
+ * @param   p               The IP packet.
+ */
+static bool drvNATlwIPGroStart(PDRVNATLWIP pEngine, struct pbuf *p)
+{
+    Assert(!pEngine->pbGro);
+
+    PCRTNETIPV4 pIpHdr;
+    PCRTNETTCP  pTcpHdr;
+    uint16_t    cbPayload;
+    if (   !drvNATlwIPGroParse(p, &pIpHdr, &pTcpHdr, &cbPayload)
+        || (pTcpHdr->th_flags & RTNETTCP_F_PSH))
+        return false;
+
+    pEngine->pbGro = (uint8_t *)RTMemAlloc(DRVNATLWIP_GRO_FRAME_MAX);
+    if (!pEngine->pbGro)
+        return false;
+    drvNATlwIPEthHdr(pEngine, pEngine->pbGro);
+    drvNATlwIPCopyOut(p, 0, pEngine->pbGro + sizeof(RTNETETHERHDR), p->tot_len);
+    pEngine->cbGro       = sizeof(RTNETETHERHDR) + p->tot_len;
+    pEngine->cGroSegs    = 1;
+    pEngine->cbGroSeg    = cbPayload;
+    pEngine->fGroClosed  = false;
+    pEngine->uGroNextSeq = RT_BE2H_U32(pTcpHdr->th_seq) + cbPayload;
+    return true;
+}
+
+
+/**
+ * Passes the frame being coalesced on to the guest.
+ *
+ * @param   pEngine         The engine.
+ */
+static void drvNATlwIPGroFlush(PDRVNATLWIP pEngine)
+{
+    uint8_t *pbFrame = pEngine->pbGro;
+    if (!pbFrame)
+        return;
+    pEngine->pbGro = NULL;
+
+    pEngine->cFramesOut++;
+    if (pEngine->cGroSegs == 1)
+    {
+        uint8_t *pbShrunk = (uint8_t *)RTMemRealloc(pbFrame, pEngine->cbGro);
+        pEngine->pfnOutput(pEngine->pvUser, pbShrunk ? pbShrunk : pbFrame, pEngine->cbGro, 0);
+        return;
+    }
+
+    /* The checksums are redone when the frame is segmented or prepared for
+       the device, only the length has to be right. */
+    PRTNETIPV4 pIpHdr = (PRTNETIPV4)(pbFrame + sizeof(RTNETETHERHDR));
+    pIpHdr->ip_len = RT_H2BE_U16((uint16_t)(pEngine->cbGro - sizeof(RTNETETHERHDR)));
+    pEngine->cFramesCoalesced++;
+    pEngine->cSegsCoalesced += pEngine->cGroSegs;
+    pEngine->pfnOutput(pEngine->pvUser, pbFrame, pEngine->cbGro, pEngine->cbGroSeg);
+}
+
+
+/**
+ * lwIP netif output callback, sends an IP packet to the guest.
+ */
+static err_t drvNATlwIPNetIfOutput(struct netif *pNetIf, struct pbuf *p, struct ip_addr *pIpAddr)
+{
+    PDRVNATLWIP pEngine = (PDRVNATLWIP)pNetIf->state;
+    NOREF(pIpAddr);
+
+    if (pEngine->fLargeReceive)
+    {
+        if (drvNATlwIPGroAppend(pEngine, p))
+            return ERR_OK;
+        drvNATlwIPGroFlush(pEngine);
+        if (drvNATlwIPGroStart(pEngine, p))
+            return ERR_OK;
+    }
+
+    size_t const cbFrame = sizeof(RTNETETHERHDR) + p->tot_len;
+    uint8_t *pbFrame = (uint8_t *)RTMemAlloc(cbFrame);
+    if (!pbFrame)
+        return ERR_MEM;
+    drvNATlwIPEthHdr(pEngine, pbFrame);
+    drvNATlwIPCopyOut(p, 0, pbFrame + sizeof(RTNETETHERHDR), p->tot_len);
+    pEngine->cFramesOut++;
+    pEngine->pfnOutput(pEngine->pvUser, pbFrame, cbFrame, 0);
+    return ERR_OK;
+}
+
+
+/**
+ * lwIP netif init callback.
+ */
+static err_t drvNATlwIPNetIfInit(struct netif *pNetIf)
+{
+    pNetIf->name[0]    = 'N';
+    pNetIf->name[1]    = 'T';
+    pNetIf->hwaddr_len = sizeof(g_DrvNATlwIPMac);
+    memcpy(pNetIf->hwaddr, &g_DrvNATlwIPMac, sizeof(g_DrvNATlwIPMac));
+    pNetIf->mtu        = 1500;
+    pNetIf->flags      = NETIF_FLAG_LINK_UP | NETIF_FLAG_PROXY;
+    pNetIf->output     = drvNATlwIPNetIfOutput;
+    return ERR_OK;
+}
+
+
+/**
+ * Allocates a connection and links it into the engine.
+ */
+static PDRVNATLWIPCONN drvNATlwIPConnAlloc(PDRVNATLWIP pEngine, int hSock)
+{
+    PDRVNATLWIPCONN pConn = (PDRVNATLWIPCONN)RTMemAllocZ(sizeof(*pConn));
+    if (pConn)
+    {
+        pConn->hSock    = hSock;
+        pConn->iPollFd  = -1;
+        pConn->pNext    = pEngine->pConns;
+        pEngine->pConns = pConn;
+        pEngine->cConnsActive++;
+    }
+    return pConn;
+}
+
+
+/**
+ * Cuts the connection loose from its PCB.  lwIP may free the PCB any time
+ * after this without telling us.
+ */
+static void drvNATlwIPConnDetach(PDRVNATLWIPCONN pConn)
+{
+    struct tcp_pcb *pcb = pConn->pcb;
+    if (pcb)
+    {
+        lwip_tcp_arg(pcb, NULL);
+        lwip_tcp_recv(pcb, NULL);
+        lwip_tcp_err(pcb, NULL);
+        pConn->pcb = NULL;
+    }
+}
+
+
+/**
+ * Resets both sides of a connection.
+ */
+static void drvNATlwIPConnAbort(PDRVNATLWIPCONN pConn)
+{
+    struct tcp_pcb *pcb = pConn->pcb;
+    if (pcb)
+    {
+        drvNATlwIPConnDetach(pConn);
+        lwip_tcp_abort(pcb);
+    }
+    pConn->fDead  = true;
+    pConn->fReset = true;
+}
+
+
+/**
+ * lwIP receive callback, queues guest data for the host socket.
+ */
+static err_t drvNATlwIPTcpRecv(void *pvArg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    PDRVNATLWIPCONN pConn = (PDRVNATLWIPCONN)pvArg;
+    NOREF(err);
+    if (!p)
+        pConn->fGuestFin = true;
+    else if (pConn->fDead)
+    {
+        lwip_tcp_recved(pcb, p->tot_len);
+        lwip_pbuf_free(p);
+    }
+    else if (pConn->pToHost)
+        lwip_pbuf_cat(pConn->pToHost, p);
+    else
+        pConn->pToHost = p;
+    return ERR_OK;
+}
+
+
+/**
+ * lwIP error callback, the PCB is gone (reset by the guest or timed out).
+ */
+static void drvNATlwIPTcpErr(void *pvArg, err_t err)
+{
+    PDRVNATLWIPCONN pConn = (PDRVNATLWIPCONN)pvArg;
+    LogFlow(("drvNATlwIPTcpErr: pConn=%p err=%d\n", pConn, err));
+    pConn->pcb    = NULL;
+    pConn->fDead  = true;
+    pConn->fReset = true;
+}
+
+
+/**
+ * lwIP connected callback for forwarded connections, the guest accepted.
+ */
+static err_t drvNATlwIPTcpConnected(void *pvArg, struct tcp_pcb *pcb, err_t err)
+{
+    PDRVNATLWIPCONN pConn = (PDRVNATLWIPCONN)pvArg;
+    NOREF(pcb); NOREF(err);
+    pConn->fConnected = true;
+    return ERR_OK;
+}
+
+
+/**
+ * lwIP proxy SYN hook, starts connecting to the host the guest wants to talk
+ * to.  The SYN is answered once the host connection is up.
+ */
+static err_t drvNATlwIPTcpProxySyn(void *pvArg, struct tcp_pcb *pcb)
+{
+    PDRVNATLWIP pEngine = (PDRVNATLWIP)pvArg;
+
+    uint32_t u32Addr = pcb->local_ip.addr;
+    if (u32Addr == pEngine->AliasIP.addr)
+        u32Addr = lwip_htonl(INADDR_LOOPBACK);
+
+    int hSock;
+    int rc = drvNATlwIPSockConnect(u32Addr, pcb->local_port, pEngine->u32BindAddr, &hSock);
+    if (RT_FAILURE(rc))
+    {
+        LogFlow(("drvNATlwIPTcpProxySyn: %RTnaipv4:%u -> %Rrc\n", u32Addr, pcb->local_port, rc));
+        pEngine->cConnsFailed++;
+        return ERR_CONN;
+    }
+
+    PDRVNATLWIPCONN pConn = drvNATlwIPConnAlloc(pEngine, hSock);
+    if (!pConn)
+    {
+        drvNATlwIPSockClose(hSock, true /*fReset*/);
+        return ERR_MEM;
+    }
+    pConn->pcb = pcb;
+    lwip_tcp_arg(pcb, pConn);
+    lwip_tcp_recv(pcb, drvNATlwIPTcpRecv);
+    lwip_tcp_err(pcb, drvNATlwIPTcpErr);
+    pEngine->cConnsTotal++;
+
+    /* Even an immediate success is picked up by the poll loop, the SYN|ACK
+       must not go out from within lwIP's input processing. */
+    return ERR_OK;
+}
+
+
+/**
+ * Tells lwIP how much guest data made it to the host, reopening the window.
+ */
+static void drvNATlwIPConnRecved(PDRVNATLWIPCONN pConn, size_t cb)
+{
+    if (!pConn->pcb)
+        return;
+    while (cb > 0)
+    {
+        u16_t cbChunk = (u16_t)RT_MIN(cb, 0xffff);
+        lwip_tcp_recved(pConn->pcb, cbChunk);
+        cb -= cbChunk;
+    }
+}
+
+
+/**
+ * Writes queued guest data to the host socket.
+ */
+static void drvNATlwIPConnToHost(PDRVNATLWIP pEngine, PDRVNATLWIPCONN pConn)
+{
+    while (pConn->pToHost)
+    {
+        RTSGSEG  aSegs[16];
+        unsigned cSegs   = 0;
+        size_t   cbTotal = 0;
+        size_t   off     = pConn->offToHost;
+        for (struct pbuf *q = pConn->pToHost; q && cSegs < RT_ELEMENTS(aSegs); q = q->next, off = 0)
+        {
+            aSegs[cSegs].pvSeg = (uint8_t *)q->payload + off;
+            aSegs[cSegs].cbSeg = q->len - off;
+            cbTotal += aSegs[cSegs].cbSeg;
+            cSegs++;
+        }
+
+        size_t cbWritten = 0;
+        if (cbTotal)
+        {
+            int rc = drvNATlwIPSockWriteSg(pConn->hSock, aSegs, cSegs, &cbWritten);
+            if (rc == VINF_TRY_AGAIN)
+                break;
+            if (RT_FAILURE(rc))
+            {
+                LogFlow(("drvNATlwIPConnToHost: pConn=%p %Rrc\n", pConn, rc));
+                drvNATlwIPConnAbort(pConn);
+                return;
+            }
+            pEngine->cbToHost += cbWritten;
+            drvNATlwIPConnRecved(pConn, cbWritten);
+        }
+
+        /* Drop what went out, taking care to only free one pbuf of the chain
+           at a time. */
+        size_t cbLeft = cbWritten;
+        while (pConn->pToHost && (cbLeft || pConn->offToHost == pConn->pToHost->len))
+        {
+            struct pbuf *p = pConn->pToHost;
+            size_t cbInBuf = p->len - pConn->offToHost;
+            if (cbLeft < cbInBuf)
+            {
+                pConn->offToHost += (uint16_t)cbLeft;
+                break;
+            }
+            cbLeft -= cbInBuf;
+            pConn->offToHost = 0;
+            pConn->pToHost   = p->next;
+            if (p->next)
+                lwip_pbuf_ref(p->next);
+            lwip_pbuf_free(p);
+        }
+
+        if (cbWritten < cbTotal)
+            break;
+    }
+}
+
+
+/**
+ * Works out how much host data lwIP can take for a connection right now.
+ */
+static size_t drvNATlwIPConnSendRoom(struct tcp_pcb *pcb)
+{
+    if (pcb->state != ESTABLISHED && pcb->state != CLOSE_WAIT)
+        return 0;
+    uint32_t const cSegsMax = (uint32_t)(TCP_SND_QUEUELEN);
+    if (pcb->snd_queuelen + 1U >= cSegsMax)
+        return 0;
+    size_t cb = RT_MIN((size_t)tcp_sndbuf(pcb), (size_t)(cSegsMax - pcb->snd_queuelen - 1) * pcb->mss);
+    return RT_MIN(cb, DRVNATLWIP_XFER_MAX);
+}
+
+
+/**
+ * Moves host data into lwIP.
+ */
+static void drvNATlwIPConnToGuest(PDRVNATLWIP pEngine, PDRVNATLWIPCONN pConn)
+{
+    struct tcp_pcb *pcb = pConn->pcb;
+
+    if (pConn->cbStash)
+    {
+        if (lwip_tcp_write(pcb, pConn->pbStash, (u16_t)pConn->cbStash, 1 /*copy*/) != ERR_OK)
+            return;
+        RTMemFree(pConn->pbStash);
+        pConn->pbStash = NULL;
+        pConn->cbStash = 0;
+    }
+
+    for (;;)
+    {
+        size_t const cbMax = drvNATlwIPConnSendRoom(pcb);
+        if (!cbMax)
+            break;
+
+        size_t cbRead;
+        int rc = drvNATlwIPSockRead(pConn->hSock, pEngine->pbXfer, cbMax, &cbRead);
+        if (rc == VINF_TRY_AGAIN)
+            break;
+        if (RT_FAILURE(rc))
+        {
+            LogFlow(("drvNATlwIPConnToGuest: pConn=%p %Rrc\n", pConn, rc));
+            drvNATlwIPConnAbort(pConn);
+            return;
+        }
+        if (!cbRead)
+        {
+            pConn->fHostEof = true;
+            break;
+        }
+        pEngine->cbToGuest += cbRead;
+
+        /* Out of segments, keep the data until lwIP has room again. */
+        if (lwip_tcp_write(pcb, pEngine->pbXfer, (u16_t)cbRead, 1 /*copy*/) != ERR_OK)
+        {
+            pConn->pbStash = (uint8_t *)RTMemDup(pEngine->pbXfer, cbRead);
+            if (!pConn->pbStash)
+            {
+                drvNATlwIPConnAbort(pConn);
+                return;
+            }
+            pConn->cbStash = cbRead;
+            break;
+        }
+        if (cbRead < cbMax)
+            break;
+    }
+    lwip_tcp_output(pcb);
+}
+
+
+/**
+ * Does what there is to do for a connection after polling.
+ *
+ * @param   pEngine         The engine.
+ * @param   pConn           The connection.
+ * @param   fRevents        The poll events of the socket.
+ */
+static void drvNATlwIPConnService(PDRVNATLWIP pEngine, PDRVNATLWIPCONN pConn, short fRevents)
+{
+    if (pConn->fDead)
+        return;
+
+    if (!pConn->fConnected)
+    {
+        /* Forwarded connections are completed by drvNATlwIPTcpConnected. */
+        if (   pConn->fForward
+            || !pConn->pcb
+            || !(fRevents & (POLLOUT | POLLERR | POLLHUP)))
+            return;
+        int rc = drvNATlwIPSockConnectResult(pConn->hSock);
+        if (   RT_FAILURE(rc)
+            || lwip_tcp_proxy_accept(pConn->pcb) != ERR_OK)
+        {
+            LogFlow(("drvNATlwIPConnService: pConn=%p connect failed %Rrc\n", pConn, rc));
+            pEngine->cConnsFailed++;
+            drvNATlwIPConnAbort(pConn);
+            return;
+        }
+        pConn->fConnected = true;
+        return;
+    }
+
+    if (pConn->pToHost)
+        drvNATlwIPConnToHost(pEngine, pConn);
+    if (   pConn->fGuestFin
+        && !pConn->pToHost
+        && !pConn->fShutWr
+        && !pConn->fDead)
+    {
+        drvNATlwIPSockShutdownWrite(pConn->hSock);
+        pConn->fShutWr = true;
+    }
+
+    if (   pConn->pcb
+        && !pConn->fHostEof
+        && (pConn->cbStash || (fRevents & (POLLIN | POLLERR | POLLHUP))))
+        drvNATlwIPConnToGuest(pEngine, pConn);
+    if (   pConn->pcb
+        && pConn->fHostEof
+        && !pConn->cbStash
+        && !pConn->fFinSent
+        && lwip_tcp_close(pConn->pcb) == ERR_OK)
+        pConn->fFinSent = true;
+
+    /* Both FINs went through, lwIP finishes the close on its own. */
+    if (   pConn->pcb
+        && pConn->fFinSent
+        && pConn->fGuestFin)
+        drvNATlwIPConnDetach(pConn);
+}
+
+
+/**
+ * Frees a connection which is done with, closing the host socket.
+ */
+static void drvNATlwIPConnFree(PDRVNATLWIP pEngine, PDRVNATLWIPCONN pConn)
+{
+    drvNATlwIPConnDetach(pConn);
+    if (pConn->hSock >= 0)
+        drvNATlwIPSockClose(pConn->hSock, pConn->fReset);
+    if (pConn->pToHost)
+        lwip_pbuf_free(pConn->pToHost);
+    RTMemFree(pConn->pbStash);
+    RTMemFree(pConn);
+    pEngine->cConnsActive--;
+}
+
+
+/**
+ * Accepts connections on a port forwarding socket and connects lwIP to the
+ * guest for each.
+ */
+static void drvNATlwIPFwdAccept(PDRVNATLWIP pEngine, PDRVNATLWIPFWD pFwd)
+{
+    for (unsigned i = 0; i < 16; i++)
+    {
+        int hSock;
+        int rc = drvNATlwIPSockAccept(pFwd->hSock, &hSock);
+        if (rc == VINF_TRY_AGAIN)
+            break;
+        if (RT_FAILURE(rc))
+        {
+            LogFlow(("drvNATlwIPFwdAccept: port %u: %Rrc\n", pFwd->u16HostPort, rc));
+            break;
+        }
+
+        struct tcp_pcb *pcb = lwip_tcp_new();
+        if (!pcb)
+        {
+            drvNATlwIPSockClose(hSock, true /*fReset*/);
+            continue;
+        }
+        PDRVNATLWIPCONN pConn = drvNATlwIPConnAlloc(pEngine, hSock);
+        if (!pConn)
+        {
+            lwip_tcp_close(pcb);
+            drvNATlwIPSockClose(hSock, true /*fReset*/);
+            continue;
+        }
+        pConn->fForward = true;
+        pConn->pcb      = pcb;
+        lwip_tcp_arg(pcb, pConn);
+        lwip_tcp_recv(pcb, drvNATlwIPTcpRecv);
+        lwip_tcp_err(pcb, drvNATlwIPTcpErr);
+
+        struct ip_addr GuestAddr;
+        GuestAddr.addr = pFwd->GuestIP.u;
+        if (   lwip_tcp_bind(pcb, &pEngine->AliasIP, 0) != ERR_OK
+            || lwip_tcp_connect(pcb, &GuestAddr, pFwd->u16GuestPort, drvNATlwIPTcpConnected) != ERR_OK)
+        {
+            /* Not registered with lwIP yet, so this just frees it. */
+            drvNATlwIPConnDetach(pConn);
+            lwip_tcp_close(pcb);
+            pConn->fDead = pConn->fReset = true;
+            continue;
+        }
+        pEngine->cConnsTotal++;
+        pEngine->cConnsForwarded++;
+    }
+}
+
+
+/**
+ * Feeds the queued guest segments to lwIP.
+ */
+static void drvNATlwIPInputProcess(PDRVNATLWIP pEngine)
+{
+    for (;;)
+    {
+        struct pbuf *apBatch[64];
+        uint32_t     cBatch = 0;
+
+        RTCritSectEnter(&pEngine->Lock);
+        pEngine->GuestMac = pEngine->GuestMacIn;
+        while (pEngine->cInput && cBatch < RT_ELEMENTS(apBatch))
+        {
+            apBatch[cBatch++]    = pEngine->apInput[pEngine->iInputHead];
+            pEngine->iInputHead  = (pEngine->iInputHead + 1) % DRVNATLWIP_INPUT_MAX;
+            pEngine->cInput--;
+        }
+        RTCritSectLeave(&pEngine->Lock);
+        if (!cBatch)
+            break;
+
+        for (uint32_t i = 0; i < cBatch; i++)
+            lwip_ip_input(apBatch[i], &pEngine->NetIf);
+        pEngine->cFramesIn += cBatch;
+
+        /* Send the delayed ACKs right away instead of waiting for the timer,
+           the guest link has no use for delaying them. */
+        lwip_tcp_fasttmr();
+    }
+}
+
+
+/**
+ * Queues a guest segment for the engine thread.
+ *
+ * @param   pEngine         The engine.
+ * @param   p               The segment, IP header up front.  Consumed.
+ * @param   pSrcMac         The source MAC address of the frame it came in.
+ */
+static void drvNATlwIPInputQueue(PDRVNATLWIP pEngine, struct pbuf *p, PCRTMAC pSrcMac)
+{
+    RTCritSectEnter(&pEngine->Lock);
+    /* The guest's MAC is taken from whatever it sends our way. */
+    if (memcmp(&pEngine->GuestMacIn, pSrcMac, sizeof(RTMAC)))
+        pEngine->GuestMacIn = *pSrcMac;
+    if (pEngine->cInput < DRVNATLWIP_INPUT_MAX)
+    {
+        pEngine->apInput[(pEngine->iInputHead + pEngine->cInput) % DRVNATLWIP_INPUT_MAX] = p;
+        pEngine->cInput++;
+        p = NULL;
+    }
+    else
+        ASMAtomicIncU64(&pEngine->cFramesInDropped);
+    RTCritSectLeave(&pEngine->Lock);
+    if (p)
+        lwip_pbuf_free(p);
+}
+
+
+/**
+ * Hands a guest frame to the engine.  The engine is not woken up, call
+ * DrvNATlwIPWakeup when done with a batch of frames.
+ *
+ * @param   pEngine         The engine.
+ * @param   pvFrame         The ethernet frame carrying an IPv4 TCP segment.
+ *                          Copied.
+ * @param   cbFrame         The size of the frame.
+ * @param   pGso            The GSO context if a GSO frame, otherwise NULL.
+ */
+void DrvNATlwIPInput(PDRVNATLWIP pEngine, void const *pvFrame, size_t cbFrame, PCPDMNETWORKGSO pGso)
+{
+    uint8_t const *pbFrame = (uint8_t const *)pvFrame;
+    if (cbFrame < sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN)
+        return;
+
+    PCRTNETETHERHDR pEthHdr = (PCRTNETETHERHDR)pbFrame;
+
+    if (!pGso)
+    {
+        /* Trim the ethernet padding here, lwIP would realloc the pbuf. */
+        PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)(pEthHdr + 1);
+        size_t cbIp = RT_MIN(RT_BE2H_U16(pIpHdr->ip_len), cbFrame - sizeof(RTNETETHERHDR));
+        if (cbIp < RTNETIPV4_MIN_LEN)
+            return;
+        struct pbuf *p = lwip_pbuf_alloc(PBUF_RAW, (u16_t)cbIp, PBUF_RAM);
+        if (!p)
+        {
+            ASMAtomicIncU64(&pEngine->cFramesInDropped);
+            return;
+        }
+        memcpy(p->payload, pIpHdr, cbIp);
+        drvNATlwIPInputQueue(pEngine, p, &pEthHdr->SrcMac);
+        return;
+    }
+
+    /*
+     * Cut GSO frames into segments right here, lwIP takes nothing bigger
+     * than the MSS it advertised.
+     */
+    if (   pGso->u8Type != PDMNETWORKGSOTYPE_IPV4_TCP
+        || !PDMNetGsoIsValid(pGso, sizeof(*pGso), cbFrame))
+        return;
+    uint32_t const cSegs = PDMNetGsoCalcSegmentCount(pGso, cbFrame);
+    for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
+    {
+        uint32_t const cbSeg = pdmNetSegHdrLen(pGso, iSeg) + pdmNetSegPayloadLen(pGso, iSeg, cSegs, (uint32_t)cbFrame);
+        struct pbuf *p = lwip_pbuf_alloc(PBUF_RAW, (u16_t)cbSeg, PBUF_RAM);
+        if (!p)
+        {
+            ASMAtomicIncU64(&pEngine->cFramesInDropped);
+            break;
+        }
+        uint32_t cbSegFrame = PDMNetGsoCarveSegmentCopy(pGso, pbFrame, cbFrame, iSeg, cSegs, (uint8_t *)p->payload);
+        Assert(cbSegFrame == cbSeg); NOREF(cbSegFrame);
+        lwip_pbuf_header(p, -(s16_t)sizeof(RTNETETHERHDR));
+        drvNATlwIPInputQueue(pEngine, p, &pEthHdr->SrcMac);
+    }
+}
+
+
+/**
+ * Wakes up the engine thread.
+ *
+ * @param   pEngine         The engine.
+ */
+void DrvNATlwIPWakeup(PDRVNATLWIP pEngine)
+{
+    size_t cbIgnored;
+    RTPipeWrite(pEngine->hPipeWrite, "", 1, &cbIgnored);
+}
+
+
+/**
+ * Runs the engine for one round: waits for something to do and does it.
+ *
+ * @returns VBox status code.
+ * @param   pEngine         The engine.
+ * @param   cMillies        How long to wait at most.
+ * @thread  NATLWIP
+ */
+int DrvNATlwIPPoll(PDRVNATLWIP pEngine, RTMSINTERVAL cMillies)
+{
+    /*
+     * Collect the sockets.
+     */
+    uint32_t cFds = 1;
+    RTCritSectEnter(&pEngine->Lock);
+    for (PDRVNATLWIPFWD *ppFwd = &pEngine->pFwds; *ppFwd; )
+    {
+        PDRVNATLWIPFWD pFwd = *ppFwd;
+        if (pFwd->fRemoved)
+        {
+            *ppFwd = pFwd->pNext;
+            drvNATlwIPSockClose(pFwd->hSock, false /*fReset*/);
+            RTMemFree(pFwd);
+            continue;
+        }
+        cFds++;
+        ppFwd = &pFwd->pNext;
+    }
+    for (PDRVNATLWIPCONN pConn = pEngine->pConns; pConn; pConn = pConn->pNext)
+        cFds++;
+    if (cFds > pEngine->cPollFdsAlloc)
+    {
+        uint32_t cNew = RT_ALIGN_32(cFds, 64);
+        struct pollfd *paNew = (struct pollfd *)RTMemRealloc(pEngine->paPollFds, cNew * sizeof(paNew[0]));
+        if (!paNew)
+        {
+            RTCritSectLeave(&pEngine->Lock);
+            return VERR_NO_MEMORY;
+        }
+        pEngine->paPollFds     = paNew;
+        pEngine->cPollFdsAlloc = cNew;
+    }
+
+    struct pollfd *paFds = pEngine->paPollFds;
+    uint32_t       iFd   = 0;
+    paFds[iFd].fd      = (int)RTPipeToNative(pEngine->hPipeRead);
+    paFds[iFd].events  = POLLIN;
+    paFds[iFd].revents = 0;
+    iFd++;
+    for (PDRVNATLWIPFWD pFwd = pEngine->pFwds; pFwd; pFwd = pFwd->pNext)
+    {
+        pFwd->iPollFd      = iFd;
+        paFds[iFd].fd      = pFwd->hSock;
+        paFds[iFd].events  = POLLIN;
+        paFds[iFd].revents = 0;
+        iFd++;
+    }
+    bool const fInputPending = pEngine->cInput != 0;
+    RTCritSectLeave(&pEngine->Lock);
+
+    for (PDRVNATLWIPCONN pConn = pEngine->pConns; pConn; pConn = pConn->pNext)
+    {
+        short fEvents = 0;
+        if (!pConn->fDead)
+        {
+            if (!pConn->fConnected)
+                fEvents = pConn->fForward ? 0 : POLLOUT;
+            else
+            {
+                if (pConn->pToHost)
+                    fEvents |= POLLOUT;
+                if (   pConn->pcb
+                    && !pConn->fHostEof
+                    && !pConn->cbStash
+                    && drvNATlwIPConnSendRoom(pConn->pcb))
+                    fEvents |= POLLIN;
+            }
+        }
+        pConn->iPollFd     = iFd;
+        paFds[iFd].fd      = fEvents ? pConn->hSock : -1;
+        paFds[iFd].events  = fEvents;
+        paFds[iFd].revents = 0;
+        iFd++;
+    }
+
+    /*
+     * Wait.
+     */
+    uint64_t u64Now = RTTimeMilliTS();
+    int cMsTimeout = 0;
+    if (!fInputPending)
+    {
+        uint64_t cMsSlowTmr = pEngine->u64NextSlowTmr > u64Now ? pEngine->u64NextSlowTmr - u64Now : 0;
+        cMsTimeout = (int)RT_MIN(cMillies, cMsSlowTmr);
+    }
+    int cReady = poll(paFds, iFd, cMsTimeout);
+    if (cReady < 0 && errno != EINTR)
+        return RTErrConvertFromErrno(errno);
+    if (paFds[0].revents & POLLIN)
+    {
+        char   abDrain[64];
+        size_t cbRead;
+        while (   RTPipeRead(pEngine->hPipeRead, abDrain, sizeof(abDrain), &cbRead) == VINF_SUCCESS
+               && cbRead == sizeof(abDrain))
+            /* nothing */;
+    }
+
+    /*
+     * Guest segments and timers.
+     */
+    drvNATlwIPInputProcess(pEngine);
+    u64Now = RTTimeMilliTS();
+    if (u64Now >= pEngine->u64NextSlowTmr)
+    {
+        lwip_tcp_slowtmr();
+        lwip_tcp_fasttmr();
+        pEngine->u64NextSlowTmr = u64Now + TCP_SLOW_INTERVAL;
+    }
+
+    /*
+     * Sockets.
+     */
+    RTCritSectEnter(&pEngine->Lock);
+    for (PDRVNATLWIPFWD pFwd = pEngine->pFwds; pFwd; pFwd = pFwd->pNext)
+        if (   pFwd->iPollFd >= 0
+            && !pFwd->fRemoved
+            && (paFds[pFwd->iPollFd].revents & POLLIN))
+            drvNATlwIPFwdAccept(pEngine, pFwd);
+    RTCritSectLeave(&pEngine->Lock);
+
+    for (PDRVNATLWIPCONN *ppConn = &pEngine->pConns; *ppConn; )
+    {
+        PDRVNATLWIPCONN pConn = *ppConn;
+        drvNATlwIPConnService(pEngine, pConn, pConn->iPollFd >= 0 ? paFds[pConn->iPollFd].revents : 0);
+        pConn->iPollFd = -1;
+        if (   !pConn->pcb
+            && (pConn->fDead || !pConn->pToHost))
+        {
+            *ppConn = pConn->pNext;
+            drvNATlwIPConnFree(pEngine, pConn);
+            continue;
+        }
+        ppConn = &pConn->pNext;
+    }
+
+    drvNATlwIPGroFlush(pEngine);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Sets the guest MAC address, until the guest sends something.
+ *
+ * @param   pEngine         The engine.
+ * @param   pMac            The MAC address.
+ */
+void DrvNATlwIPSetGuestMac(PDRVNATLWIP pEngine, PCRTMAC pMac)
+{
+    RTCritSectEnter(&pEngine->Lock);
+    pEngine->GuestMacIn = *pMac;
+    RTCritSectLeave(&pEngine->Lock);
+    DrvNATlwIPWakeup(pEngine);
+}
+
+
+/**
+ * Adds a TCP port forwarding rule.
+ *
+ * @returns VBox status code.
+ * @param   pEngine         The engine.
+ * @param   HostIP          The host address to listen on (network order), 0
+ *                          for any.
+ * @param   u16HostPort     The host port.
+ * @param   GuestIP         The guest address (network order).
+ * @param   u16GuestPort    The guest port.
+ */
+int DrvNATlwIPAddRedirect(PDRVNATLWIP pEngine, RTNETADDRIPV4 HostIP, uint16_t u16HostPort,
+                          RTNETADDRIPV4 GuestIP, uint16_t u16GuestPort)
+{
+    PDRVNATLWIPFWD pFwd = (PDRVNATLWIPFWD)RTMemAllocZ(sizeof(*pFwd));
+    if (!pFwd)
+        return VERR_NO_MEMORY;
+    int rc = drvNATlwIPSockListen(HostIP.u, u16HostPort, &pFwd->hSock);
+    if (RT_FAILURE(rc))
+    {
+        RTMemFree(pFwd);
+        return rc;
+    }
+    pFwd->iPollFd      = -1;
+    pFwd->HostIP       = HostIP;
+    pFwd->u16HostPort  = u16HostPort;
+    pFwd->GuestIP      = GuestIP;
+    pFwd->u16GuestPort = u16GuestPort;
+
+    RTCritSectEnter(&pEngine->Lock);
+    pFwd->pNext    = pEngine->pFwds;
+    pEngine->pFwds = pFwd;
+    RTCritSectLeave(&pEngine->Lock);
+    DrvNATlwIPWakeup(pEngine);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Removes a TCP port forwarding rule.  Established connections are kept.
+ *
+ * @returns VBox status code, VERR_NOT_FOUND if there is no such rule.
+ * @param   pEngine         The engine.
+ * @param   HostIP          The host address (network order).
+ * @param   u16HostPort     The host port.
+ * @param   GuestIP         The guest address (network order).
+ * @param   u16GuestPort    The guest port.
+ */
+int DrvNATlwIPRemoveRedirect(PDRVNATLWIP pEngine, RTNETADDRIPV4 HostIP, uint16_t u16HostPort,
+                             RTNETADDRIPV4 GuestIP, uint16_t u16GuestPort)
+{
+    int rc = VERR_NOT_FOUND;
+    RTCritSectEnter(&pEngine->Lock);
+    for (PDRVNATLWIPFWD pFwd = pEngine->pFwds; pFwd; pFwd = pFwd->pNext)
+        if (   !pFwd->fRemoved
+            && pFwd->HostIP.u      == HostIP.u
+            && pFwd->u16HostPort   == u16HostPort
+            && pFwd->GuestIP.u     == GuestIP.u
+            && pFwd->u16GuestPort  == u16GuestPort)
+        {
+            pFwd->fRemoved = true;
+            rc = VINF_SUCCESS;
+            break;
+        }
+    RTCritSectLeave(&pEngine->Lock);
+    if (RT_SUCCESS(rc))
+        DrvNATlwIPWakeup(pEngine);
+    return rc;
+}
+
+
+/**
+ * Prints the engine statistics.
+ *
+ * @param   pEngine         The engine.
+ * @param   pHlp            The info helpers.
+ */
+void DrvNATlwIPInfo(PDRVNATLWIP pEngine, PCDBGFINFOHLP pHlp)
+{
+    pHlp->pfnPrintf(pHlp,
+                    "lwIP TCP engine:\n"
+                    "  Connections: %u active, %llu total, %llu forwarded, %llu failed\n"
+                    "  Guest segments in: %llu (%llu dropped)\n"
+                    "  Frames out: %llu, %llu of them coalesced from %llu segments\n"
+                    "  Bytes to host: %llu, to guest: %llu\n",
+                    pEngine->cConnsActive, pEngine->cConnsTotal, pEngine->cConnsForwarded, pEngine->cConnsFailed,
+                    pEngine->cFramesIn, ASMAtomicReadU64(&pEngine->cFramesInDropped),
+                    pEngine->cFramesOut, pEngine->cFramesCoalesced, pEngine->cSegsCoalesced,
+                    pEngine->cbToHost, pEngine->cbToGuest);
+}
+
+
+/**
+ * Checks whether the engine is in use.  Since lwIP has global state, there
+ * can only be one engine per process and DevINIP cannot run next to it.
+ *
+ * @returns True if there is an engine.
+ */
+bool DrvNATlwIPConfigured(void)
+{
+    return g_pDrvNATlwIP != NULL;
+}
+
+
+/**
+ * Creates the engine.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_RESOURCE_BUSY if lwIP is already taken by another engine or
+ *          by DevINIP.
+ * @param   ppEngine        Where to return the engine.
+ * @param   pCfg            The configuration.
+ */
+int DrvNATlwIPCreate(PDRVNATLWIP *ppEngine, PCDRVNATLWIPCFG pCfg)
+{
+    if (g_pDrvNATlwIP || DevINIPConfigured())
+        return VERR_RESOURCE_BUSY;
+    AssertPtrReturn(pCfg->pfnOutput, VERR_INVALID_POINTER);
+
+    struct in_addr BindAddr;
+    BindAddr.s_addr = 0;
+    if (   pCfg->pszBindIP
+        && !lwip_inet_aton(pCfg->pszBindIP, &BindAddr))
+        return VERR_INVALID_PARAMETER;
+
+    PDRVNATLWIP pEngine = (PDRVNATLWIP)RTMemAllocZ(sizeof(*pEngine));
+    if (!pEngine)
+        return VERR_NO_MEMORY;
+    pEngine->pfnOutput     = pCfg->pfnOutput;
+    pEngine->pvUser        = pCfg->pvUser;
+    pEngine->fLargeReceive = pCfg->fLargeReceive;
+    pEngine->u32BindAddr   = BindAddr.s_addr;
+    pEngine->hPipeRead     = NIL_RTPIPE;
+    pEngine->hPipeWrite    = NIL_RTPIPE;
+
+    int rc = RTCritSectInit(&pEngine->Lock);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTPipeCreate(&pEngine->hPipeRead, &pEngine->hPipeWrite, 0 /*fFlags*/);
+        if (RT_SUCCESS(rc))
+        {
+            pEngine->pbXfer = (uint8_t *)RTMemAlloc(DRVNATLWIP_XFER_MAX);
+            if (pEngine->pbXfer)
+            {
+                /*
+                 * Initialize lwIP, the tcpip thread is not used.
+                 */
+                if (!g_fDrvNATlwIPStackInitialized)
+                {
+                    lwip_stats_init();
+                    lwip_sys_init();
+#if MEM_LIBC_MALLOC == 0
+                    lwip_mem_init();
+#endif
+                    lwip_memp_init();
+                    lwip_pbuf_init();
+                    lwip_netif_init();
+                    lwip_ip_init();
+                    lwip_tcp_init();
+
+                    /* The large windows, send buffers and pools are ours
+                       only, DevINIP can't run next to us. */
+                    lwip_tcp_large_wnd = 1;
+                    lwip_memp_add(MEMP_TCP_PCB, DRVNATLWIP_TCP_PCBS - MEMP_NUM_TCP_PCB);
+                    lwip_memp_add(MEMP_TCP_SEG, DRVNATLWIP_TCP_SEGS - MEMP_NUM_TCP_SEG);
+                    g_fDrvNATlwIPStackInitialized = true;
+                }
+
+                struct ip_addr IpAddr, Netmask, Gateway;
+                IpAddr.addr  = RT_H2BE_U32(pCfg->Network | 2);
+                Netmask.addr = RT_H2BE_U32(pCfg->Netmask);
+                Gateway.addr = 0;
+                pEngine->AliasIP = IpAddr;
+                if (lwip_netif_add(&pEngine->NetIf, &IpAddr, &Netmask, &Gateway, pEngine,
+                              drvNATlwIPNetIfInit, lwip_ip_input))
+                {
+                    lwip_netif_set_default(&pEngine->NetIf);
+                    lwip_netif_set_up(&pEngine->NetIf);
+                    lwip_tcp_proxy_syn(drvNATlwIPTcpProxySyn, pEngine);
+                    pEngine->u64NextSlowTmr = RTTimeMilliTS() + TCP_SLOW_INTERVAL;
+
+                    g_pDrvNATlwIP = pEngine;
+                    *ppEngine = pEngine;
+                    LogRel(("NAT: lwIP TCP engine started (window %u, scale %u, large receive %RTbool)\n",
+                            TCP_WND, TCP_RCV_SCALE, pEngine->fLargeReceive));
+                    return VINF_SUCCESS;
+                }
+                rc = VERR_NET_NO_NETWORK;
+                RTMemFree(pEngine->pbXfer);
+            }
+            else
+                rc = VERR_NO_MEMORY;
+            RTPipeClose(pEngine->hPipeRead);
+            RTPipeClose(pEngine->hPipeWrite);
+        }
+        RTCritSectDelete(&pEngine->Lock);
+    }
+    RTMemFree(pEngine);
+    return rc;
+}
+
+
+/**
+ * Destroys the engine, resetting all connections.  The engine thread must
+ * be stopped.
+ *
+ * @param   pEngine         The engine, NULL is ignored.
+ */
+void DrvNATlwIPDestroy(PDRVNATLWIP pEngine)
+{
+    if (!pEngine)
+        return;
+    Assert(g_pDrvNATlwIP == pEngine);
+
+    lwip_tcp_proxy_syn(NULL, NULL);
+    while (pEngine->pConns)
+    {
+        PDRVNATLWIPCONN pConn = pEngine->pConns;
+        pEngine->pConns = pConn->pNext;
+        drvNATlwIPConnAbort(pConn);
+        drvNATlwIPConnFree(pEngine, pConn);
+    }
+    while (pEngine->pFwds)
+    {
+        PDRVNATLWIPFWD pFwd = pEngine->pFwds;
+        pEngine->pFwds = pFwd->pNext;
+        drvNATlwIPSockClose(pFwd->hSock, false /*fReset*/);
+        RTMemFree(pFwd);
+    }
+    while (pEngine->cInput)
+    {
+        lwip_pbuf_free(pEngine->apInput[pEngine->iInputHead]);
+        pEngine->iInputHead = (pEngine->iInputHead + 1) % DRVNATLWIP_INPUT_MAX;
+        pEngine->cInput--;
+    }
+    RTMemFree(pEngine->pbGro);
+    lwip_netif_remove(&pEngine->NetIf);
+
+    RTMemFree(pEngine->paPollFds);
+    RTMemFree(pEngine->pbXfer);
+    RTPipeClose(pEngine->hPipeRead);
+    RTPipeClose(pEngine->hPipeWrite);
+    RTCritSectDelete(&pEngine->Lock);
+    RTMemFree(pEngine);
+    g_pDrvNATlwIP = NULL;
+}
@@ -0,0 +1,83 @@
+/* $Id$ */
+/** @file
+ * DrvNATlwIP - lwIP based TCP engine for the NAT driver, Header.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ___DrvNATlwIP_h
+#define ___DrvNATlwIP_h
+
+#include <iprt/cidr.h>
+#include <iprt/net.h>
+#include <VBox/types.h>
+#include <VBox/vmm/pdmnetifs.h>
+
+RT_C_DECLS_BEGIN
+
+/** Handle to the lwIP TCP engine. */
+typedef struct DRVNATLWIP *PDRVNATLWIP;
+
+/**
+ * Hands a frame for the guest to the owner of the engine.
+ *
+ * @param   pvUser          The user argument from DRVNATLWIPCFG.
+ * @param   pvFrame         The ethernet frame, allocated by RTMemAlloc.  The
+ *                          callee takes ownership.
+ * @param   cbFrame         The size of the frame.
+ * @param   cbMaxSeg        The MSS if this is a TCP frame carrying several
+ *                          coalesced segments, otherwise 0.
+ * @thread  NATLWIP
+ */
+typedef DECLCALLBACK(void) FNDRVNATLWIPOUTPUT(void *pvUser, void *pvFrame, size_t cbFrame, uint16_t cbMaxSeg);
+/** Pointer to a FNDRVNATLWIPOUTPUT. */
+typedef FNDRVNATLWIPOUTPUT *PFNDRVNATLWIPOUTPUT;
+
+/**
+ * The configuration of the lwIP TCP engine.
+ */
+typedef struct DRVNATLWIPCFG
+{
+    /** The NAT network address (host byte order). */
+    RTIPV4ADDR              Network;
+    /** The NAT network mask (host byte order). */
+    RTIPV4ADDR              Netmask;
+    /** The address outgoing connections are bound to, NULL for any. */
+    const char             *pszBindIP;
+    /** Whether in-order segments of a connection may be coalesced into one
+     * large frame (cbMaxSeg != 0) on the way to the guest. */
+    bool                    fLargeReceive;
+    /** Where frames for the guest go. */
+    PFNDRVNATLWIPOUTPUT     pfnOutput;
+    /** User argument for pfnOutput. */
+    void                   *pvUser;
+} DRVNATLWIPCFG;
+/** Pointer to a const lwIP TCP engine configuration. */
+typedef DRVNATLWIPCFG const *PCDRVNATLWIPCFG;
+
+int  DrvNATlwIPCreate(PDRVNATLWIP *ppEngine, PCDRVNATLWIPCFG pCfg);
+void DrvNATlwIPDestroy(PDRVNATLWIP pEngine);
+bool DrvNATlwIPConfigured(void);
+void DrvNATlwIPInput(PDRVNATLWIP pEngine, void const *pvFrame, size_t cbFrame, PCPDMNETWORKGSO pGso);
+void DrvNATlwIPWakeup(PDRVNATLWIP pEngine);
+int  DrvNATlwIPPoll(PDRVNATLWIP pEngine, RTMSINTERVAL cMillies);
+void DrvNATlwIPSetGuestMac(PDRVNATLWIP pEngine, PCRTMAC pMac);
+int  DrvNATlwIPAddRedirect(PDRVNATLWIP pEngine, RTNETADDRIPV4 HostIP, uint16_t u16HostPort,
+                           RTNETADDRIPV4 GuestIP, uint16_t u16GuestPort);
+int  DrvNATlwIPRemoveRedirect(PDRVNATLWIP pEngine, RTNETADDRIPV4 HostIP, uint16_t u16HostPort,
+                              RTNETADDRIPV4 GuestIP, uint16_t u16GuestPort);
+void DrvNATlwIPInfo(PDRVNATLWIP pEngine, PCDBGFINFOHLP pHlp);
+
+RT_C_DECLS_END
+
+#endif
@@ -0,0 +1,313 @@
+/* $Id$ */
+/** @file
+ * DrvNATlwIP - Host socket helpers for the lwIP TCP engine.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#define LOG_GROUP LOG_GROUP_DRV_NAT
+#include "DrvNATlwIPSock.h"
+
+#include <VBox/log.h>
+#include <iprt/assert.h>
+#include <iprt/err.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** Max number of segments drvNATlwIPSockWriteSg passes to sendmsg at once. */
+#define DRVNATLWIPSOCK_MAX_SEGS     16
+
+/** Flags for sendmsg, a host closing on us must not raise SIGPIPE. */
+#ifdef MSG_NOSIGNAL
+# define DRVNATLWIPSOCK_SEND_FLAGS  MSG_NOSIGNAL
+#else
+# define DRVNATLWIPSOCK_SEND_FLAGS  0
+#endif
+
+
+/**
+ * Creates a non-blocking TCP socket.
+ *
+ * @returns VBox status code.
+ * @param   phSock          Where to return the socket.
+ */
+static int drvNATlwIPSockCreate(int *phSock)
+{
+    int hSock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (hSock < 0)
+        return RTErrConvertFromErrno(errno);
+
+    int fFlags = fcntl(hSock, F_GETFL, 0);
+    if (   fFlags == -1
+        || fcntl(hSock, F_SETFL, fFlags | O_NONBLOCK) == -1)
+    {
+        int rc = RTErrConvertFromErrno(errno);
+        close(hSock);
+        return rc;
+    }
+    fcntl(hSock, F_SETFD, FD_CLOEXEC);
+
+    /* The engine does its own batching, don't delay anything on top of it. */
+    int fOn = 1;
+    setsockopt(hSock, IPPROTO_TCP, TCP_NODELAY, &fOn, sizeof(fOn));
+#ifdef SO_NOSIGPIPE
+    setsockopt(hSock, SOL_SOCKET, SO_NOSIGPIPE, &fOn, sizeof(fOn));
+#endif
+    *phSock = hSock;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Starts connecting to a host.
+ *
+ * @returns VINF_SUCCESS if the connection is up already, VINF_TRY_AGAIN if it
+ *          is in progress (wait for the socket to become writable and check
+ *          with drvNATlwIPSockConnectResult), or an error status.
+ * @param   u32Addr         The address to connect to.
+ * @param   u16Port         The port to connect to.
+ * @param   u32BindAddr     The local address to bind to, INADDR_ANY if none.
+ * @param   phSock          Where to return the socket.
+ */
+int drvNATlwIPSockConnect(uint32_t u32Addr, uint16_t u16Port, uint32_t u32BindAddr, int *phSock)
+{
+    int hSock;
+    int rc = drvNATlwIPSockCreate(&hSock);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    struct sockaddr_in Addr;
+    memset(&Addr, 0, sizeof(Addr));
+#ifdef RT_OS_DARWIN
+    Addr.sin_len = sizeof(Addr);
+#endif
+    Addr.sin_family = AF_INET;
+    if (u32BindAddr != INADDR_ANY)
+    {
+        Addr.sin_addr.s_addr = u32BindAddr;
+        if (bind(hSock, (struct sockaddr *)&Addr, sizeof(Addr)) != 0)
+        {
+            rc = RTErrConvertFromErrno(errno);
+            close(hSock);
+            return rc;
+        }
+    }
+
+    Addr.sin_addr.s_addr = u32Addr;
+    Addr.sin_port        = htons(u16Port);
+    if (connect(hSock, (struct sockaddr *)&Addr, sizeof(Addr)) == 0)
+        rc = VINF_SUCCESS;
+    else if (errno == EINPROGRESS)
+        rc = VINF_TRY_AGAIN;
+    else
+    {
+        rc = RTErrConvertFromErrno(errno);
+        close(hSock);
+        return rc;
+    }
+    *phSock = hSock;
+    return rc;
+}
+
+
+/**
+ * Gets the outcome of a connect started by drvNATlwIPSockConnect.
+ *
+ * @returns VBox status code.
+ * @param   hSock           The socket.
+ */
+int drvNATlwIPSockConnectResult(int hSock)
+{
+    int       iErr  = 0;
+    socklen_t cbErr = sizeof(iErr);
+    if (getsockopt(hSock, SOL_SOCKET, SO_ERROR, &iErr, &cbErr) != 0)
+        iErr = errno;
+    return iErr ? RTErrConvertFromErrno(iErr) : VINF_SUCCESS;
+}
+
+
+/**
+ * Creates a listening socket for port forwarding.
+ *
+ * @returns VBox status code.
+ * @param   u32Addr         The address to listen on, INADDR_ANY for all.
+ * @param   u16Port         The port to listen on.
+ * @param   phSock          Where to return the socket.
+ */
+int drvNATlwIPSockListen(uint32_t u32Addr, uint16_t u16Port, int *phSock)
+{
+    int hSock;
+    int rc = drvNATlwIPSockCreate(&hSock);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    int fOn = 1;
+    setsockopt(hSock, SOL_SOCKET, SO_REUSEADDR, &fOn, sizeof(fOn));
+
+    struct sockaddr_in Addr;
+    memset(&Addr, 0, sizeof(Addr));
+#ifdef RT_OS_DARWIN
+    Addr.sin_len = sizeof(Addr);
+#endif
+    Addr.sin_family      = AF_INET;
+    Addr.sin_addr.s_addr = u32Addr;
+    Addr.sin_port        = htons(u16Port);
+    if (   bind(hSock, (struct sockaddr *)&Addr, sizeof(Addr)) != 0
+        || listen(hSock, SOMAXCONN) != 0)
+    {
+        rc = RTErrConvertFromErrno(errno);
+        close(hSock);
+        return rc;
+    }
+    *phSock = hSock;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Accepts a connection on a listening socket.
+ *
+ * @returns VBox status code, VINF_TRY_AGAIN if there was nothing to accept.
+ * @param   hSockListen     The listening socket.
+ * @param   phSock          Where to return the new non-blocking socket.
+ */
+int drvNATlwIPSockAccept(int hSockListen, int *phSock)
+{
+    int hSock = accept(hSockListen, NULL, NULL);
+    if (hSock < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED
+             ? VINF_TRY_AGAIN : RTErrConvertFromErrno(errno);
+
+    int fFlags = fcntl(hSock, F_GETFL, 0);
+    if (   fFlags == -1
+        || fcntl(hSock, F_SETFL, fFlags | O_NONBLOCK) == -1)
+    {
+        int rc = RTErrConvertFromErrno(errno);
+        close(hSock);
+        return rc;
+    }
+    fcntl(hSock, F_SETFD, FD_CLOEXEC);
+    int fOn = 1;
+    setsockopt(hSock, IPPROTO_TCP, TCP_NODELAY, &fOn, sizeof(fOn));
+#ifdef SO_NOSIGPIPE
+    setsockopt(hSock, SOL_SOCKET, SO_NOSIGPIPE, &fOn, sizeof(fOn));
+#endif
+    *phSock = hSock;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Reads what is available from a socket.
+ *
+ * @returns VBox status code, VINF_TRY_AGAIN if there is nothing to read.
+ *          VINF_SUCCESS with *pcbRead set to zero means end of stream.
+ * @param   hSock           The socket.
+ * @param   pvBuf           Where to put the data.
+ * @param   cbBuf           The buffer size.
+ * @param   pcbRead         Where to return the number of bytes read.
+ */
+int drvNATlwIPSockRead(int hSock, void *pvBuf, size_t cbBuf, size_t *pcbRead)
+{
+    *pcbRead = 0;
+    ssize_t cbRead = recv(hSock, pvBuf, cbBuf, 0);
+    if (cbRead < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR
+             ? VINF_TRY_AGAIN : RTErrConvertFromErrno(errno);
+    *pcbRead = (size_t)cbRead;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Writes as much of a segment list as the socket takes.
+ *
+ * @returns VBox status code, VINF_TRY_AGAIN if the socket is full.
+ * @param   hSock           The socket.
+ * @param   paSegs          The segments.
+ * @param   cSegs           The number of segments.
+ * @param   pcbWritten      Where to return the number of bytes written.
+ */
+int drvNATlwIPSockWriteSg(int hSock, PCRTSGSEG paSegs, unsigned cSegs, size_t *pcbWritten)
+{
+    struct iovec aVecs[DRVNATLWIPSOCK_MAX_SEGS];
+    cSegs = RT_MIN(cSegs, RT_ELEMENTS(aVecs));
+    for (unsigned i = 0; i < cSegs; i++)
+    {
+        aVecs[i].iov_base = paSegs[i].pvSeg;
+        aVecs[i].iov_len  = paSegs[i].cbSeg;
+    }
+
+    struct msghdr Msg;
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov    = aVecs;
+    Msg.msg_iovlen = cSegs;
+
+    *pcbWritten = 0;
+    ssize_t cbWritten = sendmsg(hSock, &Msg, DRVNATLWIPSOCK_SEND_FLAGS);
+    if (cbWritten < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR
+             ? VINF_TRY_AGAIN : RTErrConvertFromErrno(errno);
+    *pcbWritten = (size_t)cbWritten;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Sends a FIN to the host side of the connection.
+ *
+ * @returns VBox status code.
+ * @param   hSock           The socket.
+ */
+int drvNATlwIPSockShutdownWrite(int hSock)
+{
+    if (shutdown(hSock, SHUT_WR) != 0)
+        return RTErrConvertFromErrno(errno);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Closes a socket.
+ *
+ * @param   hSock           The socket.
+ * @param   fReset          Whether to reset the connection rather than
+ *                          closing it gracefully, used when the guest side
+ *                          was reset.
+ */
+void drvNATlwIPSockClose(int hSock, bool fReset)
+{
+    if (fReset)
+    {
+        struct linger Linger;
+        Linger.l_onoff  = 1;
+        Linger.l_linger = 0;
+        setsockopt(hSock, SOL_SOCKET, SO_LINGER, &Linger, sizeof(Linger));
+    }
+    close(hSock);
+}
@@ -0,0 +1,42 @@
+/* $Id$ */
+/** @file
+ * DrvNATlwIP - Host socket helpers for the lwIP TCP engine, Header.
+ *
+ * The lwIP headers carry their own BSD socket definitions which collide with
+ * the host ones, so everything touching host sockets lives in a separate
+ * translation unit behind this interface.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ___DrvNATlwIPSock_h
+#define ___DrvNATlwIPSock_h
+
+#include <iprt/types.h>
+#include <iprt/sg.h>
+
+RT_C_DECLS_BEGIN
+
+/* Addresses are in network byte order, ports in host byte order. */
+int  drvNATlwIPSockConnect(uint32_t u32Addr, uint16_t u16Port, uint32_t u32BindAddr, int *phSock);
+int  drvNATlwIPSockConnectResult(int hSock);
+int  drvNATlwIPSockListen(uint32_t u32Addr, uint16_t u16Port, int *phSock);
+int  drvNATlwIPSockAccept(int hSockListen, int *phSock);
+int  drvNATlwIPSockRead(int hSock, void *pvBuf, size_t cbBuf, size_t *pcbRead);
+int  drvNATlwIPSockWriteSg(int hSock, PCRTSGSEG paSegs, unsigned cSegs, size_t *pcbWritten);
+int  drvNATlwIPSockShutdownWrite(int hSock);
+void drvNATlwIPSockClose(int hSock, bool fReset);
+
+RT_C_DECLS_END
+
+#endif
@@ -24,10 +24,14 @@
 #include <VBox/vmm/pdmnetifs.h>
 
 #include <VBox/log.h>
+#include <VBox/vmm/pdmnetinline.h>
+#include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/critsect.h>
 #include <iprt/file.h>
+#include <iprt/mem.h>
 #include <iprt/process.h>
+#include <iprt/semaphore.h>
 #include <iprt/string.h>
 #include <iprt/time.h>
 #include <iprt/uuid.h>
@@ -37,9 +41,77 @@
 #include "VBoxDD.h"
 
 
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** @name Capture directions, indexes into DRVNETSNIFFER::aRings.
+ * @{ */
+#define DRVNETSNIFFER_DIR_XMIT          0
+#define DRVNETSNIFFER_DIR_RECV          1
+/** @} */
+/** The default size of each capture ring in async mode. */
+#define DRVNETSNIFFER_DEF_RING_SIZE     _4M
+/** The size of the writer thread's output buffer. */
+#define DRVNETSNIFFER_WRITE_BUF_SIZE    _256K
+/** The max snap length; a record must fit into the output buffer. */
+#define DRVNETSNIFFER_MAX_SNAPLEN       _64K
+/** How often the writer thread flushes when the rings fill slowly. */
+#define DRVNETSNIFFER_FLUSH_MS          100
+/** DRVNETSNIFFERREC::cbCaptured value marking the padding at the end of a
+ *  ring. */
+#define DRVNETSNIFFERREC_PAD            UINT32_MAX
+
+
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
 *******************************************************************************/
+/**
+ * Header of a frame copy in a capture ring, followed by the captured bytes.
+ */
+typedef struct DRVNETSNIFFERREC
+{
+    /** The size of the record including this header, 8 byte aligned. */
+    uint32_t                cbRec;
+    /** The number of captured bytes, DRVNETSNIFFERREC_PAD for padding. */
+    uint32_t                cbCaptured;
+    /** The original size of the frame. */
+    uint32_t                cbOrig;
+    uint32_t                u32Reserved;
+    /** When the frame was captured, nanoseconds since the epoch. */
+    uint64_t                u64Timestamp;
+} DRVNETSNIFFERREC;
+/** Pointer to a capture record. */
+typedef DRVNETSNIFFERREC *PDRVNETSNIFFERREC;
+
+/**
+ * Capture ring of one direction (async mode).
+ *
+ * The datapath threads of the direction are the producers and the writer
+ * thread the consumer.  Producers serialize on the producer lock, which is
+ * uncontended unless two threads capture the same direction at once, so a
+ * second producer waits its turn instead of losing its frame.  The consumer
+ * takes no lock.
+ */
+typedef struct DRVNETSNIFFERRING
+{
+    /** The ring buffer. */
+    uint8_t                *pbRing;
+    /** The size of the ring buffer, a power of two. */
+    uint32_t                cbRing;
+    /** The free running producer offset. */
+    uint32_t volatile       offWrite;
+    /** The free running consumer offset. */
+    uint32_t volatile       offRead;
+    /** Serializes the producers. */
+    RTCRITSECT              ProducerLock;
+    /** Frames queued. */
+    STAMCOUNTER             StatFrames;
+    /** Frames dropped because the ring was full. */
+    STAMCOUNTER             StatDropped;
+} DRVNETSNIFFERRING;
+/** Pointer to a capture ring. */
+typedef DRVNETSNIFFERRING *PDRVNETSNIFFERRING;
+
 /**
  * Block driver instance data.
  *
@@ -75,9 +147,426 @@ typedef struct DRVNETSNIFFER
     /** For when we're the leaf driver. */
     RTCRITSECT              XmitLock;
 
+    /** The max number of bytes captured per frame. */
+    uint32_t                cbSnapLen;
+    /** Whether frames are queued for the writer thread (pcapng) rather than
+     * written on the datapath (pcap). */
+    bool                    fAsync;
+    /** Set when the writer thread has been signalled and not yet run. */
+    bool volatile           fWriterSignalled;
+    /** Set when writing has failed, so we complain only once. */
+    bool                    fWriteError;
+    /** Whether Mac is valid. */
+    bool                    fMacValid;
+    /** The MAC address of the device, for the interface description. */
+    RTMAC                   Mac;
+    /** What to add to RTTimeNanoTS to get nanoseconds since the epoch. */
+    uint64_t                u64EpochNanoTSDelta;
+    /** The capture rings, indexed by DRVNETSNIFFER_DIR_XMIT/RECV. */
+    DRVNETSNIFFERRING       aRings[2];
+    /** The writer thread. */
+    PPDMTHREAD              pWriterThread;
+    /** The event the writer thread waits on. */
+    RTSEMEVENT              hWriterEvt;
+    /** The writer thread's output buffer (DRVNETSNIFFER_WRITE_BUF_SIZE). */
+    uint8_t                *pbWriteBuf;
+    /** The number of bytes pending in the output buffer. */
+    uint32_t                cbWriteBuf;
+    /** The number of the current file, 0 for szFilename itself. */
+    uint32_t                iFile;
+    /** The max number of files kept when rotating, 0 for no limit. */
+    uint32_t                cMaxFiles;
+    /** The size at which the file is rotated, 0 for never. */
+    uint64_t                cbMaxFileSize;
+    /** The size of the current file. */
+    uint64_t                cbFile;
+    /** Bytes written by the writer thread. */
+    STAMCOUNTER             StatBytesWritten;
+    /** Files started due to rotation. */
+    STAMCOUNTER             StatRotations;
+
 } DRVNETSNIFFER, *PDRVNETSNIFFER;
 
 
+/**
+ * Queues a copy of a frame for the writer thread.
+ *
+ * The frame may come in two parts, which is for carved GSO segments.
+ *
+ * @param   pThis           The sniffer instance.
+ * @param   pRing           The ring of the direction.
+ * @param   cbOrig          The size of the frame.
+ * @param   pvHdrs          The first part.
+ * @param   cbHdrs          The size of the first part.
+ * @param   pvPayload       The second part, NULL if none.
+ * @param   cbPayload       The size of the second part.  The two parts add up
+ *                          to less than cbOrig if the frame was truncated.
+ */
+static void drvNetSnifferRingPut(PDRVNETSNIFFER pThis, PDRVNETSNIFFERRING pRing, uint32_t cbOrig,
+                                 const void *pvHdrs, uint32_t cbHdrs, const void *pvPayload, uint32_t cbPayload)
+{
+    uint64_t const u64Timestamp = RTTimeNanoTS() + pThis->u64EpochNanoTSDelta;
+    uint32_t const cbCaptured   = RT_MIN(cbHdrs + cbPayload, pThis->cbSnapLen);
+    uint32_t const cbRec        = RT_ALIGN_32(sizeof(DRVNETSNIFFERREC) + cbCaptured, 8);
+
+    RTCritSectEnter(&pRing->ProducerLock);
+
+    /*
+     * A record never wraps around, the end of the ring is skipped instead.
+     */
+    uint32_t const offWrite = pRing->offWrite;
+    uint32_t const cbFree   = pRing->cbRing - (offWrite - ASMAtomicReadU32(&pRing->offRead));
+    uint32_t       off      = offWrite & (pRing->cbRing - 1);
+    uint32_t       cbPad    = pRing->cbRing - off;
+    if (cbPad >= cbRec)
+        cbPad = 0;
+    if (RT_LIKELY(cbPad + cbRec <= cbFree))
+    {
+        if (cbPad)
+        {
+            if (cbPad >= sizeof(DRVNETSNIFFERREC))
+            {
+                PDRVNETSNIFFERREC pPad = (PDRVNETSNIFFERREC)&pRing->pbRing[off];
+                pPad->cbRec      = cbPad;
+                pPad->cbCaptured = DRVNETSNIFFERREC_PAD;
+            }
+            off = 0;
+        }
+
+        PDRVNETSNIFFERREC pRec = (PDRVNETSNIFFERREC)&pRing->pbRing[off];
+        pRec->cbRec        = cbRec;
+        pRec->cbCaptured   = cbCaptured;
+        pRec->cbOrig       = cbOrig;
+        pRec->u32Reserved  = 0;
+        pRec->u64Timestamp = u64Timestamp;
+        memcpy(pRec + 1, pvHdrs, RT_MIN(cbHdrs, cbCaptured));
+        if (cbCaptured > cbHdrs)
+            memcpy((uint8_t *)(pRec + 1) + cbHdrs, pvPayload, cbCaptured - cbHdrs);
+        ASMAtomicWriteU32(&pRing->offWrite, offWrite + cbPad + cbRec);
+        STAM_REL_COUNTER_INC(&pRing->StatFrames);
+
+        /* Kick the writer once the ring is half full, it polls otherwise. */
+        if (   cbFree - cbPad - cbRec < pRing->cbRing / 2
+            && !ASMAtomicXchgBool(&pThis->fWriterSignalled, true))
+            RTSemEventSignal(pThis->hWriterEvt);
+    }
+    else
+        STAM_REL_COUNTER_INC(&pRing->StatDropped);
+
+    RTCritSectLeave(&pRing->ProducerLock);
+}
+
+
+/**
+ * Gets the oldest record of a ring, skipping padding.
+ *
+ * @returns Pointer to the record, NULL if the ring is empty.
+ * @param   pRing           The ring.
+ * @thread  The writer thread.
+ */
+static PDRVNETSNIFFERREC drvNetSnifferRingPeek(PDRVNETSNIFFERRING pRing)
+{
+    for (;;)
+    {
+        uint32_t const offRead = pRing->offRead;
+        if (offRead == ASMAtomicReadU32(&pRing->offWrite))
+            return NULL;
+
+        uint32_t const    off     = offRead & (pRing->cbRing - 1);
+        uint32_t const    cbToEnd = pRing->cbRing - off;
+        PDRVNETSNIFFERREC pRec    = (PDRVNETSNIFFERREC)&pRing->pbRing[off];
+        if (   cbToEnd >= sizeof(DRVNETSNIFFERREC)
+            && pRec->cbCaptured != DRVNETSNIFFERREC_PAD)
+            return pRec;
+        ASMAtomicWriteU32(&pRing->offRead, offRead + cbToEnd);
+    }
+}
+
+
+/**
+ * Captures a frame, either writing it to the file (pcap) or queuing a copy for
+ * the writer thread (pcapng).
+ *
+ * @param   pThis           The sniffer instance.
+ * @param   iDir            DRVNETSNIFFER_DIR_XMIT or DRVNETSNIFFER_DIR_RECV.
+ * @param   pvFrame         The start of the frame.
+ * @param   cbFrame         The size of the frame.
+ * @param   cbMax           The number of bytes available at @a pvFrame.
+ */
+static void drvNetSnifferCaptureFrame(PDRVNETSNIFFER pThis, unsigned iDir, const void *pvFrame, size_t cbFrame, size_t cbMax)
+{
+    if (pThis->fAsync)
+        drvNetSnifferRingPut(pThis, &pThis->aRings[iDir], (uint32_t)cbFrame, pvFrame, (uint32_t)cbMax, NULL, 0);
+    else
+    {
+        RTCritSectEnter(&pThis->Lock);
+        PcapFileFrame(pThis->hFile, pThis->StartNanoTS, pvFrame, cbFrame, RT_MIN(cbMax, pThis->cbSnapLen));
+        RTCritSectLeave(&pThis->Lock);
+    }
+}
+
+
+/**
+ * Captures a GSO frame, either writing it to the file (pcap) or queuing the
+ * segments the wire will see for the writer thread (pcapng).
+ *
+ * @param   pThis           The sniffer instance.
+ * @param   iDir            DRVNETSNIFFER_DIR_XMIT or DRVNETSNIFFER_DIR_RECV.
+ * @param   pGso            The GSO context.
+ * @param   pvFrame         The start of the frame.
+ * @param   cbFrame         The size of the frame.
+ * @param   cbMax           The number of bytes available at @a pvFrame.
+ */
+static void drvNetSnifferCaptureGsoFrame(PDRVNETSNIFFER pThis, unsigned iDir, PCPDMNETWORKGSO pGso,
+                                         const void *pvFrame, size_t cbFrame, size_t cbMax)
+{
+    if (!pThis->fAsync)
+    {
+        RTCritSectEnter(&pThis->Lock);
+        PcapFileGsoFrame(pThis->hFile, pThis->StartNanoTS, pGso, pvFrame, cbFrame, RT_MIN(cbMax, pThis->cbSnapLen));
+        RTCritSectLeave(&pThis->Lock);
+    }
+    else
+    {
+        uint8_t const  *pbFrame = (uint8_t const *)pvFrame;
+        uint8_t         abHdrs[256];
+        uint32_t const  cSegs   = PDMNetGsoCalcSegmentCount(pGso, cbMax);
+        for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
+        {
+            uint32_t cbSegPayload, cbHdrs;
+            uint32_t offSegPayload = PDMNetGsoCarveSegment(pGso, pbFrame, cbMax, iSeg, cSegs, abHdrs, &cbHdrs, &cbSegPayload);
+            drvNetSnifferRingPut(pThis, &pThis->aRings[iDir], cbHdrs + cbSegPayload,
+                                 abHdrs, cbHdrs, pbFrame + offSegPayload, cbSegPayload);
+        }
+    }
+}
+
+
+/**
+ * Captures a frame the device is sending.
+ *
+ * @param   pThis           The sniffer instance.
+ * @param   pSgBuf          The frame.
+ */
+static void drvNetSnifferCaptureSgBuf(PDRVNETSNIFFER pThis, PPDMSCATTERGATHER pSgBuf)
+{
+    size_t const cbMax = RT_MIN(pSgBuf->cbUsed, pSgBuf->aSegs[0].cbSeg);
+    if (!pSgBuf->pvUser)
+        drvNetSnifferCaptureFrame(pThis, DRVNETSNIFFER_DIR_XMIT, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed, cbMax);
+    else
+        drvNetSnifferCaptureGsoFrame(pThis, DRVNETSNIFFER_DIR_XMIT, (PCPDMNETWORKGSO)pSgBuf->pvUser,
+                                     pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed, cbMax);
+}
+
+
+/**
+ * Formats the name of a capture file.
+ *
+ * @param   pThis           The sniffer instance.
+ * @param   iFile           The file number, 0 for the configured name.
+ * @param   pszName         Where to store the name.
+ * @param   cbName          The size of the buffer.
+ */
+static void drvNetSnifferFileName(PDRVNETSNIFFER pThis, uint32_t iFile, char *pszName, size_t cbName)
+{
+    if (!iFile)
+        RTStrCopy(pszName, cbName, pThis->szFilename);
+    else
+        RTStrPrintf(pszName, cbName, "%s.%u", pThis->szFilename, iFile);
+}
+
+
+/**
+ * Opens a capture file and writes the pcapng section header and the
+ * interface description to it.
+ *
+ * @returns IPRT status code.
+ * @param   pThis           The sniffer instance.
+ * @param   pszName         The file name.
+ */
+static int drvNetSnifferOpenNgFile(PDRVNETSNIFFER pThis, const char *pszName)
+{
+    int rc = RTFileOpen(&pThis->hFile, pszName, RTFILE_O_WRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_WRITE);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    char    szIfName[32];
+    char    szIfDesc[80];
+    uint8_t abHdrs[512];
+    RTStrPrintf(szIfName, sizeof(szIfName), "NetSniffer#%u", pThis->pDrvIns->iInstance);
+    RTStrPrintf(szIfDesc, sizeof(szIfDesc), "VirtualBox virtual network adapter, process %#x", RTProcSelf());
+    size_t cb = PcapNgFormatSectionHdr(abHdrs, sizeof(abHdrs), "VirtualBox");
+    cb += PcapNgFormatIfDesc(&abHdrs[cb], sizeof(abHdrs) - cb, szIfName, szIfDesc,
+                             pThis->fMacValid ? &pThis->Mac : NULL, pThis->cbSnapLen);
+    rc = RTFileWrite(pThis->hFile, abHdrs, cb, NULL);
+    pThis->cbFile = cb;
+    return rc;
+}
+
+
+/**
+ * Records the drop count and closes the current pcapng file.
+ *
+ * @param   pThis           The sniffer instance.
+ */
+static void drvNetSnifferCloseNgFile(PDRVNETSNIFFER pThis)
+{
+    if (pThis->hFile == NIL_RTFILE)
+        return;
+
+    uint8_t  abStats[64];
+    uint64_t cDropped = pThis->aRings[DRVNETSNIFFER_DIR_XMIT].StatDropped.c
+                      + pThis->aRings[DRVNETSNIFFER_DIR_RECV].StatDropped.c;
+    size_t   cb = PcapNgFormatIfStats(abStats, sizeof(abStats), 0, RTTimeNanoTS() + pThis->u64EpochNanoTSDelta, cDropped);
+    RTFileWrite(pThis->hFile, abStats, cb, NULL);
+    RTFileClose(pThis->hFile);
+    pThis->hFile = NIL_RTFILE;
+}
+
+
+/**
+ * Writes out the output buffer, starting a new file first if the current one
+ * would grow beyond the configured size.
+ *
+ * @param   pThis           The sniffer instance.
+ * @thread  The writer thread, or the destructor once it is gone.
+ */
+static void drvNetSnifferWriterFlush(PDRVNETSNIFFER pThis)
+{
+    if (!pThis->cbWriteBuf)
+        return;
+
+    if (   pThis->cbMaxFileSize
+        && pThis->cbFile + pThis->cbWriteBuf > pThis->cbMaxFileSize)
+    {
+        drvNetSnifferCloseNgFile(pThis);
+
+        char szName[RTPATH_MAX];
+        pThis->iFile++;
+        if (pThis->cMaxFiles && pThis->iFile >= pThis->cMaxFiles)
+        {
+            drvNetSnifferFileName(pThis, pThis->iFile - pThis->cMaxFiles, szName, sizeof(szName));
+            RTFileDelete(szName);
+        }
+        drvNetSnifferFileName(pThis, pThis->iFile, szName, sizeof(szName));
+        int rc = drvNetSnifferOpenNgFile(pThis, szName);
+        if (RT_FAILURE(rc) && !pThis->fWriteError)
+        {
+            LogRel(("NetSniffer#%u: Failed to open '%s': %Rrc\n", pThis->pDrvIns->iInstance, szName, rc));
+            pThis->fWriteError = true;
+        }
+        STAM_REL_COUNTER_INC(&pThis->StatRotations);
+    }
+
+    if (pThis->hFile != NIL_RTFILE)
+    {
+        int rc = RTFileWrite(pThis->hFile, pThis->pbWriteBuf, pThis->cbWriteBuf, NULL);
+        if (RT_SUCCESS(rc))
+        {
+            pThis->cbFile += pThis->cbWriteBuf;
+            STAM_REL_COUNTER_ADD(&pThis->StatBytesWritten, pThis->cbWriteBuf);
+        }
+        else if (!pThis->fWriteError)
+        {
+            LogRel(("NetSniffer#%u: Writing the capture failed: %Rrc\n", pThis->pDrvIns->iInstance, rc));
+            pThis->fWriteError = true;
+        }
+    }
+    pThis->cbWriteBuf = 0;
+}
+
+
+/**
+ * Moves everything queued in the rings into the output buffer, oldest frame
+ * first, flushing the buffer whenever it fills up.
+ *
+ * @param   pThis           The sniffer instance.
+ * @thread  The writer thread, or the destructor once it is gone.
+ */
+static void drvNetSnifferWriterDrain(PDRVNETSNIFFER pThis)
+{
+    PDRVNETSNIFFERRING const pXmitRing = &pThis->aRings[DRVNETSNIFFER_DIR_XMIT];
+    PDRVNETSNIFFERRING const pRecvRing = &pThis->aRings[DRVNETSNIFFER_DIR_RECV];
+    for (;;)
+    {
+        PDRVNETSNIFFERREC pXmitRec = drvNetSnifferRingPeek(pXmitRing);
+        PDRVNETSNIFFERREC pRecvRec = drvNetSnifferRingPeek(pRecvRing);
+        PDRVNETSNIFFERRING pRing;
+        PDRVNETSNIFFERREC  pRec;
+        uint32_t           fFlags;
+        if (pXmitRec && (!pRecvRec || pXmitRec->u64Timestamp <= pRecvRec->u64Timestamp))
+        {
+            pRing  = pXmitRing;
+            pRec   = pXmitRec;
+            fFlags = PCAPNG_EPB_FLAGS_OUTBOUND;
+        }
+        else if (pRecvRec)
+        {
+            pRing  = pRecvRing;
+            pRec   = pRecvRec;
+            fFlags = PCAPNG_EPB_FLAGS_INBOUND;
+        }
+        else
+            break;
+
+        size_t cb = PcapNgFormatPacket(&pThis->pbWriteBuf[pThis->cbWriteBuf], DRVNETSNIFFER_WRITE_BUF_SIZE - pThis->cbWriteBuf,
+                                       0, pRec->u64Timestamp, fFlags, pRec + 1, pRec->cbCaptured, pRec->cbOrig);
+        if (!cb)
+        {
+            drvNetSnifferWriterFlush(pThis);
+            cb = PcapNgFormatPacket(pThis->pbWriteBuf, DRVNETSNIFFER_WRITE_BUF_SIZE,
+                                    0, pRec->u64Timestamp, fFlags, pRec + 1, pRec->cbCaptured, pRec->cbOrig);
+            Assert(cb);
+        }
+        pThis->cbWriteBuf += (uint32_t)cb;
+        ASMAtomicWriteU32(&pRing->offRead, pRing->offRead + pRec->cbRec);
+    }
+}
+
+
+/**
+ * The writer thread, turning the queued frames into large file writes.
+ *
+ * @returns VINF_SUCCESS.
+ * @param   pDrvIns         The driver instance.
+ * @param   pThread         The thread.
+ */
+static DECLCALLBACK(int) drvNetSnifferWriterThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PDRVNETSNIFFER pThis = PDMINS_2_DATA(pDrvIns, PDRVNETSNIFFER);
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        RTSemEventWait(pThis->hWriterEvt, DRVNETSNIFFER_FLUSH_MS);
+        ASMAtomicWriteBool(&pThis->fWriterSignalled, false);
+        drvNetSnifferWriterDrain(pThis);
+        drvNetSnifferWriterFlush(pThis);
+    }
+
+    /* Don't sit on anything while the VM is suspended. */
+    drvNetSnifferWriterDrain(pThis);
+    drvNetSnifferWriterFlush(pThis);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Unblocks the writer thread so it can respond to a state change.
+ *
+ * @returns VBox status code.
+ * @param   pDrvIns         The driver instance.
+ * @param   pThread         The thread.
+ */
+static DECLCALLBACK(int) drvNetSnifferWriterWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PDRVNETSNIFFER pThis = PDMINS_2_DATA(pDrvIns, PDRVNETSNIFFER);
+    NOREF(pThread);
+    return RTSemEventSignal(pThis->hWriterEvt);
+}
+
+
 
 /**
  * @interface_method_impl{PDMINETWORKUP,pfnBeginXmit}
@@ -131,23 +620,44 @@ static DECLCALLBACK(int) drvNetSnifferUp_SendBuf(PPDMINETWORKUP pInterface, PPDM
         return VERR_NET_DOWN;
 
     /* output to sniffer */
-    RTCritSectEnter(&pThis->Lock);
-    if (!pSgBuf->pvUser)
-        PcapFileFrame(pThis->hFile, pThis->StartNanoTS,
-                      pSgBuf->aSegs[0].pvSeg,
-                      pSgBuf->cbUsed,
-                      RT_MIN(pSgBuf->cbUsed, pSgBuf->aSegs[0].cbSeg));
-    else
-        PcapFileGsoFrame(pThis->hFile, pThis->StartNanoTS, (PCPDMNETWORKGSO)pSgBuf->pvUser,
-                         pSgBuf->aSegs[0].pvSeg,
-                         pSgBuf->cbUsed,
-                         RT_MIN(pSgBuf->cbUsed, pSgBuf->aSegs[0].cbSeg));
-    RTCritSectLeave(&pThis->Lock);
+    drvNetSnifferCaptureSgBuf(pThis, pSgBuf);
 
     return pThis->pIBelowNet->pfnSendBuf(pThis->pIBelowNet, pSgBuf, fOnWorkerThread);
 }
 
 
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnSendBufs}
+ */
+static DECLCALLBACK(int) drvNetSnifferUp_SendBufs(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER *papSgBufs,
+                                                  uint32_t cSgBufs, bool fOnWorkerThread)
+{
+    PDRVNETSNIFFER pThis = RT_FROM_MEMBER(pInterface, DRVNETSNIFFER, INetworkUp);
+    if (RT_UNLIKELY(!pThis->pIBelowNet))
+        return VERR_NET_DOWN;
+
+    /* output to sniffer */
+    if (!pThis->fAsync)
+        RTCritSectEnter(&pThis->Lock);
+    for (uint32_t i = 0; i < cSgBufs; i++)
+        drvNetSnifferCaptureSgBuf(pThis, papSgBufs[i]);
+    if (!pThis->fAsync)
+        RTCritSectLeave(&pThis->Lock);
+
+    if (pThis->pIBelowNet->pfnSendBufs)
+        return pThis->pIBelowNet->pfnSendBufs(pThis->pIBelowNet, papSgBufs, cSgBufs, fOnWorkerThread);
+
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < cSgBufs; i++)
+    {
+        int rc2 = pThis->pIBelowNet->pfnSendBuf(pThis->pIBelowNet, papSgBufs[i], fOnWorkerThread);
+        if (RT_FAILURE(rc2) && RT_SUCCESS(rc))
+            rc = rc2;
+    }
+    return rc;
+}
+
+
 /**
  * @interface_method_impl{PDMINETWORKUP,pfnEndXmit}
  */
@@ -204,9 +714,7 @@ static DECLCALLBACK(int) drvNetSnifferDown_Receive(PPDMINETWORKDOWN pInterface,
     PDRVNETSNIFFER pThis = RT_FROM_MEMBER(pInterface, DRVNETSNIFFER, INetworkDown);
 
     /* output to sniffer */
-    RTCritSectEnter(&pThis->Lock);
-    PcapFileFrame(pThis->hFile, pThis->StartNanoTS, pvBuf, cb, cb);
-    RTCritSectLeave(&pThis->Lock);
+    drvNetSnifferCaptureFrame(pThis, DRVNETSNIFFER_DIR_RECV, pvBuf, cb, cb);
 
     /* pass up */
     int rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pvBuf, cb);
@@ -223,6 +731,63 @@ static DECLCALLBACK(int) drvNetSnifferDown_Receive(PPDMINETWORKDOWN pInterface,
 }
 
 
+/**
+ * @interface_method_impl{PDMINETWORKDOWN,pfnReceiveGso}
+ */
+static DECLCALLBACK(int) drvNetSnifferDown_ReceiveGso(PPDMINETWORKDOWN pInterface, const void *pvBuf, size_t cb,
+                                                      PCPDMNETWORKGSO pGso)
+{
+    PDRVNETSNIFFER pThis = RT_FROM_MEMBER(pInterface, DRVNETSNIFFER, INetworkDown);
+
+    /* output to sniffer */
+    drvNetSnifferCaptureGsoFrame(pThis, DRVNETSNIFFER_DIR_RECV, pGso, pvBuf, cb, cb);
+
+    /* pass up */
+    return pThis->pIAboveNet->pfnReceiveGso(pThis->pIAboveNet, pvBuf, cb, pGso);
+}
+
+
+/**
+ * @interface_method_impl{PDMINETWORKDOWN,pfnReceiveFrames}
+ */
+static DECLCALLBACK(int) drvNetSnifferDown_ReceiveFrames(PPDMINETWORKDOWN pInterface, PCPDMNETWORKFRAME paFrames,
+                                                         uint32_t *pcFrames)
+{
+    PDRVNETSNIFFER pThis   = RT_FROM_MEMBER(pInterface, DRVNETSNIFFER, INetworkDown);
+    uint32_t       cFrames = *pcFrames;
+    int            rc      = VINF_SUCCESS;
+
+    /* pass up, one by one if the device can't take a batch. */
+    if (pThis->pIAboveNet->pfnReceiveFrames)
+        rc = pThis->pIAboveNet->pfnReceiveFrames(pThis->pIAboveNet, paFrames, pcFrames);
+    else
+    {
+        uint32_t iFrame;
+        for (iFrame = 0; iFrame < cFrames; iFrame++)
+        {
+            if (   iFrame > 0
+                && pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, 0) != VINF_SUCCESS)
+            {
+                rc = VERR_NET_NO_BUFFER_SPACE;
+                break;
+            }
+            pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, paFrames[iFrame].pvBuf, paFrames[iFrame].cb);
+        }
+        *pcFrames = iFrame;
+    }
+
+    /* output to sniffer what the device took */
+    if (!pThis->fAsync)
+        RTCritSectEnter(&pThis->Lock);
+    for (uint32_t i = 0; i < *pcFrames; i++)
+        drvNetSnifferCaptureFrame(pThis, DRVNETSNIFFER_DIR_RECV, paFrames[i].pvBuf, paFrames[i].cb, paFrames[i].cb);
+    if (!pThis->fAsync)
+        RTCritSectLeave(&pThis->Lock);
+
+    return rc;
+}
+
+
 /**
  * @interface_method_impl{PDMINETWORKDOWN,pfnXmitPending}
  */
@@ -351,6 +916,44 @@ static DECLCALLBACK(void) drvNetSnifferDestruct(PPDMDRVINS pDrvIns)
     PDRVNETSNIFFER pThis = PDMINS_2_DATA(pDrvIns, PDRVNETSNIFFER);
     PDMDRV_CHECK_VERSIONS_RETURN_VOID(pDrvIns);
 
+    if (pThis->fAsync)
+    {
+        /*
+         * The writer thread uses the rings and the file, so stop it and write
+         * out what it left behind ourselves.
+         */
+        if (pThis->pWriterThread)
+        {
+            PDMR3ThreadDestroy(pThis->pWriterThread, NULL);
+            pThis->pWriterThread = NULL;
+        }
+        if (pThis->pbWriteBuf)
+        {
+            drvNetSnifferWriterDrain(pThis);
+            drvNetSnifferWriterFlush(pThis);
+        }
+        drvNetSnifferCloseNgFile(pThis);
+
+        for (unsigned i = 0; i < RT_ELEMENTS(pThis->aRings); i++)
+        {
+            RTMemFree(pThis->aRings[i].pbRing);
+            pThis->aRings[i].pbRing = NULL;
+            if (RTCritSectIsInitialized(&pThis->aRings[i].ProducerLock))
+                RTCritSectDelete(&pThis->aRings[i].ProducerLock);
+            PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->aRings[i].StatFrames);
+            PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->aRings[i].StatDropped);
+        }
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatBytesWritten);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatRotations);
+        RTMemFree(pThis->pbWriteBuf);
+        pThis->pbWriteBuf = NULL;
+        if (pThis->hWriterEvt != NIL_RTSEMEVENT)
+        {
+            RTSemEventDestroy(pThis->hWriterEvt);
+            pThis->hWriterEvt = NIL_RTSEMEVENT;
+        }
+    }
+
     if (RTCritSectIsInitialized(&pThis->Lock))
         RTCritSectDelete(&pThis->Lock);
 
@@ -377,6 +980,7 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
      */
     pThis->pDrvIns                                  = pDrvIns;
     pThis->hFile                                    = NIL_RTFILE;
+    pThis->hWriterEvt                               = NIL_RTSEMEVENT;
     /* The pcap file *must* start at time offset 0,0. */
     pThis->StartNanoTS                              = RTTimeNanoTS() - RTTimeProgramNanoTS();
     /* IBase */
@@ -386,12 +990,14 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
     pThis->INetworkUp.pfnAllocBuf                   = drvNetSnifferUp_AllocBuf;
     pThis->INetworkUp.pfnFreeBuf                    = drvNetSnifferUp_FreeBuf;
     pThis->INetworkUp.pfnSendBuf                    = drvNetSnifferUp_SendBuf;
+    pThis->INetworkUp.pfnSendBufs                   = drvNetSnifferUp_SendBufs;
     pThis->INetworkUp.pfnEndXmit                    = drvNetSnifferUp_EndXmit;
     pThis->INetworkUp.pfnSetPromiscuousMode         = drvNetSnifferUp_SetPromiscuousMode;
     pThis->INetworkUp.pfnNotifyLinkChanged          = drvNetSnifferUp_NotifyLinkChanged;
     /* INetworkDown */
     pThis->INetworkDown.pfnWaitReceiveAvail         = drvNetSnifferDown_WaitReceiveAvail;
     pThis->INetworkDown.pfnReceive                  = drvNetSnifferDown_Receive;
+    pThis->INetworkDown.pfnReceiveFrames            = drvNetSnifferDown_ReceiveFrames;
     pThis->INetworkDown.pfnXmitPending              = drvNetSnifferDown_XmitPending;
     /* INetworkConfig */
     pThis->INetworkConfig.pfnGetMac                 = drvNetSnifferDownCfg_GetMac;
@@ -409,22 +1015,69 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
     /*
      * Validate the config.
      */
-    if (!CFGMR3AreValuesValid(pCfg, "File\0"))
+    if (!CFGMR3AreValuesValid(pCfg, "File\0"
+                                    "SnapLen\0"
+                                    "Async\0"
+                                    "RingSize\0"
+                                    "MaxFileSize\0"
+                                    "MaxFiles\0"))
         return VERR_PDM_DRVINS_UNKNOWN_CFG_VALUES;
 
     if (CFGMR3GetFirstChild(pCfg))
         LogRel(("NetSniffer: Found child config entries -- are you trying to redirect ports?\n"));
 
+    /** @cfgm{SnapLen, uint32_t, 65535}
+     * The max number of bytes captured per frame. */
+    rc = CFGMR3QueryU32Def(pCfg, "SnapLen", &pThis->cbSnapLen, 0xffff);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"SnapLen\" value"));
+    pThis->cbSnapLen = RT_MAX(RT_MIN(pThis->cbSnapLen, DRVNETSNIFFER_MAX_SNAPLEN), 64);
+
+    /** @cfgm{Async, bool, false}
+     * Queue frame copies for a writer thread and produce pcapng instead of
+     * writing pcap on the datapath. */
+    rc = CFGMR3QueryBoolDef(pCfg, "Async", &pThis->fAsync, false);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"Async\" value"));
+
+    /** @cfgm{RingSize, uint32_t, 4M}
+     * The size of each capture ring in async mode, rounded up to a power of
+     * two. */
+    uint32_t cbRing;
+    rc = CFGMR3QueryU32Def(pCfg, "RingSize", &cbRing, DRVNETSNIFFER_DEF_RING_SIZE);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"RingSize\" value"));
+    cbRing = RT_MAX(RT_MIN(cbRing, _1G), _256K);
+    while (cbRing & (cbRing - 1))
+        cbRing = (cbRing | (cbRing - 1)) + 1;
+
+    /** @cfgm{MaxFileSize, uint64_t, 0}
+     * Start a new capture file once the current one reaches this size (async
+     * mode only), 0 for never.  The files are named File, File.1, File.2 and so
+     * on. */
+    rc = CFGMR3QueryU64Def(pCfg, "MaxFileSize", &pThis->cbMaxFileSize, 0);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"MaxFileSize\" value"));
+    if (pThis->cbMaxFileSize)
+        pThis->cbMaxFileSize = RT_MAX(pThis->cbMaxFileSize, _1M);
+
+    /** @cfgm{MaxFiles, uint32_t, 0}
+     * The number of capture files kept when rotating, 0 for no limit. */
+    rc = CFGMR3QueryU32Def(pCfg, "MaxFiles", &pThis->cMaxFiles, 0);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"MaxFiles\" value"));
+
     /*
      * Get the filename.
      */
     rc = CFGMR3QueryString(pCfg, "File", pThis->szFilename, sizeof(pThis->szFilename));
     if (rc == VERR_CFGM_VALUE_NOT_FOUND)
     {
+        const char *pszSuffix = pThis->fAsync ? "pcapng" : "pcap";
         if (pDrvIns->iInstance > 0)
-            RTStrPrintf(pThis->szFilename, sizeof(pThis->szFilename), "./VBox-%x-%u.pcap", RTProcSelf(), pDrvIns->iInstance);
+            RTStrPrintf(pThis->szFilename, sizeof(pThis->szFilename), "./VBox-%x-%u.%s", RTProcSelf(), pDrvIns->iInstance, pszSuffix);
         else
-            RTStrPrintf(pThis->szFilename, sizeof(pThis->szFilename), "./VBox-%x.pcap", RTProcSelf());
+            RTStrPrintf(pThis->szFilename, sizeof(pThis->szFilename), "./VBox-%x.%s", RTProcSelf(), pszSuffix);
     }
 
     else if (RT_FAILURE(rc))
@@ -443,6 +1096,10 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
         return VERR_PDM_MISSING_INTERFACE_ABOVE;
     }
 
+    /* Large frames only come our way if the device above takes them. */
+    if (pThis->pIAboveNet->pfnReceiveGso)
+        pThis->INetworkDown.pfnReceiveGso           = drvNetSnifferDown_ReceiveGso;
+
     /*
      * Query the network config interface.
      */
@@ -476,6 +1133,48 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
         return rc;
     }
 
+    /*
+     * Async mode: set up the rings and the writer thread, then open the first
+     * pcapng file.
+     */
+    if (pThis->fAsync)
+    {
+        RTTIMESPEC Now;
+        pThis->u64EpochNanoTSDelta = RTTimeSpecGetNano(RTTimeNow(&Now)) - RTTimeNanoTS();
+        pThis->fMacValid = RT_SUCCESS(pThis->pIAboveConfig->pfnGetMac(pThis->pIAboveConfig, &pThis->Mac));
+
+        static const char * const s_apszDirs[] = { "Xmit", "Recv" };
+        for (unsigned i = 0; i < RT_ELEMENTS(pThis->aRings); i++)
+        {
+            rc = RTCritSectInit(&pThis->aRings[i].ProducerLock);
+            AssertRCReturn(rc, rc);
+            pThis->aRings[i].cbRing = cbRing;
+            pThis->aRings[i].pbRing = (uint8_t *)RTMemAlloc(cbRing);
+            if (!pThis->aRings[i].pbRing)
+                return VERR_NO_MEMORY;
+            PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->aRings[i].StatFrames,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES, "Number of frames queued for capture.", "/Drivers/NetSniffer%d/%s/Frames", pDrvIns->iInstance, s_apszDirs[i]);
+            PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->aRings[i].StatDropped, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES, "Number of frames not captured because the ring was full.", "/Drivers/NetSniffer%d/%s/Dropped", pDrvIns->iInstance, s_apszDirs[i]);
+        }
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatBytesWritten, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,       "Number of bytes written to the capture files.", "/Drivers/NetSniffer%d/BytesWritten", pDrvIns->iInstance);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatRotations,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES, "Number of times a new capture file was started.", "/Drivers/NetSniffer%d/Rotations", pDrvIns->iInstance);
+
+        pThis->pbWriteBuf = (uint8_t *)RTMemAlloc(DRVNETSNIFFER_WRITE_BUF_SIZE);
+        if (!pThis->pbWriteBuf)
+            return VERR_NO_MEMORY;
+        rc = RTSemEventCreate(&pThis->hWriterEvt);
+        AssertRCReturn(rc, rc);
+
+        rc = drvNetSnifferOpenNgFile(pThis, pThis->szFilename);
+        if (RT_FAILURE(rc))
+            return PDMDrvHlpVMSetError(pDrvIns, rc, RT_SRC_POS,
+                                       N_("Netsniffer cannot open '%s' for writing. The directory must exist and it must be writable for the current user"), pThis->szFilename);
+
+        rc = PDMDrvHlpThreadCreate(pDrvIns, &pThis->pWriterThread, pThis, drvNetSnifferWriterThread,
+                                   drvNetSnifferWriterWakeup, 128 * _1K, RTTHREADTYPE_IO, "NetSniffer");
+        AssertRCReturn(rc, rc);
+        return VINF_SUCCESS;
+    }
+
     /*
      * Open output file / pipe.
      */
@@ -29,6 +29,7 @@
 #include <iprt/ctype.h>
 #include <iprt/file.h>
 #include <iprt/mem.h>
+#include <iprt/net.h>
 #include <iprt/path.h>
 #include <iprt/pipe.h>
 #include <iprt/semaphore.h>
@@ -66,6 +67,11 @@
 #else
 # include <sys/fcntl.h>
 #endif
+#include <sys/uio.h>
+#ifdef RT_OS_LINUX
+# include <net/if.h>
+# include <linux/if_tun.h>
+#endif
 #include <errno.h>
 #include <unistd.h>
 
@@ -76,9 +82,112 @@
 #include "VBoxDD.h"
 
 
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The max number of TAP queues we use (IFF_MULTI_QUEUE). */
+#define DRVTAP_MAX_QUEUES               8
+/** The size of the receive buffer of each queue. */
+#define DRVTAP_RECV_BUF_SIZE            _256K
+/** The largest frame we read when the kernel doesn't hand us GSO frames. */
+#define DRVTAP_MAX_FRAME                16384
+/** The largest frame we read when the kernel hands us GSO frames. */
+#define DRVTAP_MAX_FRAME_GSO            (_64K + 64)
+/** How often a queue waiting for receive buffers checks the device again.
+ * PDMINETWORKDOWN::pfnWaitReceiveAvail only wakes up one waiter, with several
+ * queues the others notice the space this way. */
+#define DRVTAP_RECV_WAIT_MS             10
+
+#ifdef RT_OS_LINUX
+/* Older kernel headers lack some of these. */
+# ifndef IFF_VNET_HDR
+#  define IFF_VNET_HDR                  0x4000
+# endif
+# ifndef IFF_MULTI_QUEUE
+#  define IFF_MULTI_QUEUE               0x0100
+# endif
+# ifndef TUNSETOFFLOAD
+#  define TUNSETOFFLOAD                 _IOW('T', 208, unsigned int)
+# endif
+# ifndef TUNGETIFF
+#  define TUNGETIFF                     _IOR('T', 210, unsigned int)
+# endif
+# ifndef TUN_F_CSUM
+#  define TUN_F_CSUM                    0x01
+#  define TUN_F_TSO4                    0x02
+#  define TUN_F_TSO6                    0x04
+# endif
+#endif
+
+/** @name DRVTAPVNETHDR::u8Flags
+ * @{ */
+#define DRVTAP_VNETHDR_F_NEEDS_CSUM     1
+/** @} */
+/** @name DRVTAPVNETHDR::u8GsoType
+ * @{ */
+#define DRVTAP_VNETHDR_GSO_NONE         0
+#define DRVTAP_VNETHDR_GSO_TCPV4        1
+#define DRVTAP_VNETHDR_GSO_TCPV6        4
+#define DRVTAP_VNETHDR_GSO_ECN          0x80
+/** @} */
+
+
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
 *******************************************************************************/
+/**
+ * The header preceding each frame when the TAP device is in IFF_VNET_HDR
+ * mode.  This is the virtio-net header (struct virtio_net_hdr) in host byte
+ * order.
+ */
+#pragma pack(1)
+typedef struct DRVTAPVNETHDR
+{
+    uint8_t                 u8Flags;
+    uint8_t                 u8GsoType;
+    /** The size of the headers; only a hint on receive. */
+    uint16_t                u16HdrLen;
+    /** The segment size (MSS). */
+    uint16_t                u16GsoSize;
+    /** Where to start checksumming. */
+    uint16_t                u16CSumStart;
+    /** Where to store the checksum, relative to u16CSumStart. */
+    uint16_t                u16CSumOffset;
+} DRVTAPVNETHDR;
+#pragma pack()
+AssertCompileSize(DRVTAPVNETHDR, 10);
+/** Pointer to a virtio-net header. */
+typedef DRVTAPVNETHDR *PDRVTAPVNETHDR;
+
+/**
+ * A TAP queue, i.e. a file handle with its own reader thread.
+ */
+typedef struct DRVTAPQUEUE
+{
+    /** Pointer to the driver instance data. */
+    struct DRVTAP          *pThis;
+    /** The TAP file handle of this queue. */
+    RTFILE                  hFile;
+    /** The write end of the control pipe. */
+    RTPIPE                  hPipeWrite;
+    /** The read end of the control pipe. */
+    RTPIPE                  hPipeRead;
+    /** Reader thread. */
+    PPDMTHREAD              pThread;
+    /** The receive buffer (DRVTAP_RECV_BUF_SIZE bytes). */
+    uint8_t                *pbRecvBuf;
+    /** The queue number. */
+    uint32_t                iQueue;
+    /** Whether hFile was opened by us and must be closed by us. */
+    bool                    fOwnFile;
+#ifdef VBOX_WITH_STATISTICS
+    /** Profiling packet receive runs. */
+    STAMPROFILEADV          StatReceive;
+#endif
+} DRVTAPQUEUE;
+/** Pointer to a TAP queue. */
+typedef DRVTAPQUEUE *PDRVTAPQUEUE;
+
 /**
  * TAP driver instance data.
  *
@@ -113,16 +222,22 @@ typedef struct DRVTAP
     char                   *pszSetupApplication;
     /** TAP terminate application. */
     char                   *pszTerminateApplication;
-    /** The write end of the control pipe. */
-    RTPIPE                  hPipeWrite;
-    /** The read end of the control pipe. */
-    RTPIPE                  hPipeRead;
-    /** Reader thread. */
-    PPDMTHREAD              pThread;
+    /** The number of queues in use. */
+    uint32_t                cQueues;
+    /** Whether frames are preceded by a DRVTAPVNETHDR (IFF_VNET_HDR). */
+    bool                    fVNetHdr;
+    /** Whether the kernel may hand us GSO frames and frames with partial
+     *  checksums (TUNSETOFFLOAD). */
+    bool                    fRecvGso;
+    /** The queues, the first one uses hFileDevice. */
+    DRVTAPQUEUE             aQueues[DRVTAP_MAX_QUEUES];
 
     /** @todo The transmit thread. */
     /** Transmit lock used by drvTAPNetworkUp_BeginXmit. */
     RTCRITSECT              XmitLock;
+    /** Serializes the queues' calls handing frames to the device above.  It
+     *  is not held while waiting for receive buffers. */
+    RTCRITSECT              RecvLock;
 
 #ifdef VBOX_WITH_STATISTICS
     /** Number of sent packets. */
@@ -133,10 +248,18 @@ typedef struct DRVTAP
     STAMCOUNTER             StatPktRecv;
     /** Number of received bytes. */
     STAMCOUNTER             StatPktRecvBytes;
+    /** Number of GSO frames handed to the kernel as is. */
+    STAMCOUNTER             StatPktSentGso;
+    /** Number of GSO frames passed up as is. */
+    STAMCOUNTER             StatPktRecvGso;
+    /** Number of GSO frames segmented because the device above can't take them. */
+    STAMCOUNTER             StatPktRecvGsoSegmented;
+    /** Number of frames we completed the checksum of. */
+    STAMCOUNTER             StatPktRecvCsum;
+    /** Number of receive batches passed up with pfnReceiveFrames. */
+    STAMCOUNTER             StatRecvBatches;
     /** Profiling packet transmit runs. */
     STAMPROFILE             StatTransmit;
-    /** Profiling packet receive runs. */
-    STAMPROFILEADV          StatReceive;
 #endif /* VBOX_WITH_STATISTICS */
 
 #ifdef LOG_ENABLED
@@ -246,24 +369,108 @@ static DECLCALLBACK(int) drvTAPNetworkUp_FreeBuf(PPDMINETWORKUP pInterface, PPDM
 
 
 /**
- * @interface_method_impl{PDMINETWORKUP,pfnSendBuf}
+ * Picks the queue to write a frame to.
+ *
+ * A multi-queue TAP device remembers which queue a frame came in on and the
+ * host spreads the processing over its CPUs by that.  Hashing the addresses
+ * and ports keeps each flow on one queue, so its frames stay in order.
+ *
+ * @returns The file handle of the queue.
+ * @param   pThis           The instance data.
+ * @param   pvFrame         The frame.
+ * @param   cbFrame         The frame size.
  */
-static DECLCALLBACK(int) drvTAPNetworkUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER pSgBuf, bool fOnWorkerThread)
+static RTFILE drvTAPTxFile(PDRVTAP pThis, const void *pvFrame, size_t cbFrame)
+{
+    if (pThis->cQueues <= 1 || cbFrame < sizeof(RTNETETHERHDR))
+        return pThis->hFileDevice;
+
+    uint8_t const *pbFrame    = (uint8_t const *)pvFrame;
+    uint16_t const uEtherType = RT_BE2H_U16(((PCRTNETETHERHDR)pbFrame)->EtherType);
+    size_t const   off        = sizeof(RTNETETHERHDR);
+    uint32_t       uHash      = 0;
+    uint8_t        uProto     = 0;
+    size_t         offL4      = 0;
+    if (uEtherType == RTNET_ETHERTYPE_IPV4 && cbFrame >= off + RTNETIPV4_MIN_LEN)
+    {
+        PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)(pbFrame + off);
+        uHash = pIpHdr->ip_src.u ^ pIpHdr->ip_dst.u;
+        /* Only the first fragment carries the ports. */
+        if (!(RT_BE2H_U16(pIpHdr->ip_off) & (RTNETIPV4_FLAGS_MF | UINT16_C(0x1fff) /* offset */)))
+        {
+            uProto = pIpHdr->ip_p;
+            offL4  = off + pIpHdr->ip_hl * 4;
+        }
+    }
+    else if (uEtherType == RTNET_ETHERTYPE_IPV6 && cbFrame >= off + RTNETIPV6_MIN_LEN)
+    {
+        PCRTNETIPV6 pIp6Hdr = (PCRTNETIPV6)(pbFrame + off);
+        for (unsigned i = 0; i < RT_ELEMENTS(pIp6Hdr->ip6_src.au32); i++)
+            uHash ^= pIp6Hdr->ip6_src.au32[i] ^ pIp6Hdr->ip6_dst.au32[i];
+        uProto = pIp6Hdr->ip6_nxt;
+        offL4  = off + RTNETIPV6_MIN_LEN;
+    }
+    if (   (uProto == RTNETIPV4_PROT_TCP || uProto == RTNETIPV4_PROT_UDP)
+        && cbFrame >= offL4 + 2 * sizeof(uint16_t))
+        uHash ^= *(const uint32_t *)(pbFrame + offL4); /* both ports */
+
+    uHash ^= uHash >> 16;
+    uHash *= UINT32_C(0x45d9f3b);
+    uHash ^= uHash >> 16;
+    return pThis->aQueues[uHash % pThis->cQueues].hFile;
+}
+
+
+/**
+ * Writes one frame to the TAP device, preceded by a virtio-net header when
+ * the device is in IFF_VNET_HDR mode.
+ *
+ * @returns VBox status code.
+ * @param   pThis           The instance data.
+ * @param   hFile           The queue to write to, see drvTAPTxFile.
+ * @param   pHdr            The virtio-net header. Ignored if not in
+ *                          IFF_VNET_HDR mode.
+ * @param   pvFrame         The frame.
+ * @param   cbFrame         The frame size.
+ */
+static int drvTAPWriteFrame(PDRVTAP pThis, RTFILE hFile, PDRVTAPVNETHDR pHdr, const void *pvFrame, size_t cbFrame)
+{
+    if (!pThis->fVNetHdr)
+        return RTFileWrite(hFile, pvFrame, cbFrame, NULL);
+
+    struct iovec aIov[2];
+    aIov[0].iov_base = pHdr;
+    aIov[0].iov_len  = sizeof(*pHdr);
+    aIov[1].iov_base = (void *)pvFrame;
+    aIov[1].iov_len  = cbFrame;
+    if (writev(RTFileToNative(hFile), &aIov[0], RT_ELEMENTS(aIov)) >= 0)
+        return VINF_SUCCESS;
+    return RTErrConvertFromErrno(errno);
+}
+
+
+/**
+ * Sends one S/G buffer, leaving the freeing to the caller.
+ *
+ * GSO frames go to the kernel as is when it takes them, they are segmented
+ * here otherwise.
+ *
+ * @returns VBox status code.
+ * @param   pThis           The instance data.
+ * @param   pSgBuf          The buffer to send.
+ */
+static int drvTAPSendOne(PDRVTAP pThis, PPDMSCATTERGATHER pSgBuf)
 {
-    PDRVTAP pThis = PDMINETWORKUP_2_DRVTAP(pInterface);
     STAM_COUNTER_INC(&pThis->StatPktSent);
     STAM_COUNTER_ADD(&pThis->StatPktSentBytes, pSgBuf->cbUsed);
-    STAM_PROFILE_START(&pThis->StatTransmit, a);
 
-    AssertPtr(pSgBuf);
-    Assert((pSgBuf->fFlags & PDMSCATTERGATHER_FLAGS_MAGIC_MASK) == PDMSCATTERGATHER_FLAGS_MAGIC);
-    Assert(RTCritSectIsOwner(&pThis->XmitLock));
-
-    /* Set an FTM checkpoint as this operation changes the state permanently. */
-    PDMDrvHlpFTSetCheckpoint(pThis->pDrvIns, FTMCHECKPOINTTYPE_NETWORK);
+    DRVTAPVNETHDR Hdr;
+    RT_ZERO(Hdr);
 
     int rc;
-    if (!pSgBuf->pvUser)
+    RTFILE const    hFile = drvTAPTxFile(pThis, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed);
+    PCPDMNETWORKGSO pGso  = (PCPDMNETWORKGSO)pSgBuf->pvUser;
+    if (!pGso)
     {
 #ifdef LOG_ENABLED
         uint64_t u64Now = RTTimeProgramNanoTS();
@@ -275,25 +482,73 @@ static DECLCALLBACK(int) drvTAPNetworkUp_SendBuf(PPDMINETWORKUP pInterface, PPDM
               "%.*Rhxd\n",
               pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed, pSgBuf->cbUsed, pSgBuf->aSegs[0].pvSeg));
 
-        rc = RTFileWrite(pThis->hFileDevice, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed, NULL);
+        rc = drvTAPWriteFrame(pThis, hFile, &Hdr, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed);
+    }
+    else if (   pThis->fVNetHdr
+             && (   pGso->u8Type == PDMNETWORKGSOTYPE_IPV4_TCP
+                 || pGso->u8Type == PDMNETWORKGSOTYPE_IPV6_TCP))
+    {
+        /*
+         * Let the kernel do the segmentation.  It wants the IP lengths set and
+         * the pseudo header checksum in the TCP header.
+         */
+        PDMNetGsoPrepForDirectUse(pGso, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed, PDMNETCSUMTYPE_PSEUDO);
+        Hdr.u8Flags       = DRVTAP_VNETHDR_F_NEEDS_CSUM;
+        Hdr.u8GsoType     = pGso->u8Type == PDMNETWORKGSOTYPE_IPV4_TCP ? DRVTAP_VNETHDR_GSO_TCPV4 : DRVTAP_VNETHDR_GSO_TCPV6;
+        Hdr.u16HdrLen     = pGso->cbHdrsTotal;
+        Hdr.u16GsoSize    = pGso->cbMaxSeg;
+        Hdr.u16CSumStart  = pGso->offHdr2;
+        Hdr.u16CSumOffset = RT_OFFSETOF(RTNETTCP, th_sum);
+        STAM_COUNTER_INC(&pThis->StatPktSentGso);
+        rc = drvTAPWriteFrame(pThis, hFile, &Hdr, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed);
     }
     else
     {
-        uint8_t         abHdrScratch[256];
-        uint8_t const  *pbFrame = (uint8_t const *)pSgBuf->aSegs[0].pvSeg;
-        PCPDMNETWORKGSO pGso    = (PCPDMNETWORKGSO)pSgBuf->pvUser;
-        uint32_t const  cSegs   = PDMNetGsoCalcSegmentCount(pGso, pSgBuf->cbUsed);  Assert(cSegs > 1);
+        /* Segments fitting into abSegBuf are copied there with the payload
+           checksummed on the way, so it is read just once.  abSegBuf is the
+           header scratch buffer of the in-place carving otherwise. */
+        uint8_t         abSegBuf[2048];
+        uint8_t const  *pbFrame   = (uint8_t const *)pSgBuf->aSegs[0].pvSeg;
+        uint32_t const  cSegs     = PDMNetGsoCalcSegmentCount(pGso, pSgBuf->cbUsed);  Assert(cSegs > 1);
+        bool const      fCopySegs = (uint32_t)pGso->cbHdrsTotal + pGso->cbMaxSeg <= sizeof(abSegBuf);
         rc = VINF_SUCCESS;
         for (size_t iSeg = 0; iSeg < cSegs; iSeg++)
         {
             uint32_t cbSegFrame;
-            void *pvSegFrame = PDMNetGsoCarveSegmentQD(pGso, (uint8_t *)pbFrame, pSgBuf->cbUsed, abHdrScratch,
-                                                       iSeg, cSegs, &cbSegFrame);
-            rc = RTFileWrite(pThis->hFileDevice, pvSegFrame, cbSegFrame, NULL);
+            void    *pvSegFrame;
+            if (fCopySegs)
+            {
+                cbSegFrame = PDMNetGsoCarveSegmentCopy(pGso, pbFrame, pSgBuf->cbUsed, (uint32_t)iSeg, cSegs, abSegBuf);
+                pvSegFrame = abSegBuf;
+            }
+            else
+                pvSegFrame = PDMNetGsoCarveSegmentQD(pGso, (uint8_t *)pbFrame, pSgBuf->cbUsed, abSegBuf,
+                                                     iSeg, cSegs, &cbSegFrame);
+            rc = drvTAPWriteFrame(pThis, hFile, &Hdr, pvSegFrame, cbSegFrame);
             if (RT_FAILURE(rc))
                 break;
         }
     }
+    return rc;
+}
+
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnSendBuf}
+ */
+static DECLCALLBACK(int) drvTAPNetworkUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER pSgBuf, bool fOnWorkerThread)
+{
+    PDRVTAP pThis = PDMINETWORKUP_2_DRVTAP(pInterface);
+    STAM_PROFILE_START(&pThis->StatTransmit, a);
+
+    AssertPtr(pSgBuf);
+    Assert((pSgBuf->fFlags & PDMSCATTERGATHER_FLAGS_MAGIC_MASK) == PDMSCATTERGATHER_FLAGS_MAGIC);
+    Assert(RTCritSectIsOwner(&pThis->XmitLock));
+
+    /* Set an FTM checkpoint as this operation changes the state permanently. */
+    PDMDrvHlpFTSetCheckpoint(pThis->pDrvIns, FTMCHECKPOINTTYPE_NETWORK);
+
+    int rc = drvTAPSendOne(pThis, pSgBuf);
 
     pSgBuf->fFlags = 0;
     RTMemFree(pSgBuf);
@@ -306,6 +561,41 @@ static DECLCALLBACK(int) drvTAPNetworkUp_SendBuf(PPDMINETWORKUP pInterface, PPDM
 }
 
 
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnSendBufs}
+ */
+static DECLCALLBACK(int) drvTAPNetworkUp_SendBufs(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER *papSgBufs, uint32_t cSgBufs,
+                                                  bool fOnWorkerThread)
+{
+    PDRVTAP pThis = PDMINETWORKUP_2_DRVTAP(pInterface);
+    STAM_PROFILE_START(&pThis->StatTransmit, a);
+    Assert(RTCritSectIsOwner(&pThis->XmitLock));
+    Assert(cSgBufs <= PDMNETWORK_MAX_BATCH);
+
+    PDMDrvHlpFTSetCheckpoint(pThis->pDrvIns, FTMCHECKPOINTTYPE_NETWORK);
+
+    /* TAP takes one frame per write, so this only saves the calls and the
+       checkpoints.  The rest of the batch is dropped on failure. */
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < cSgBufs; i++)
+    {
+        PPDMSCATTERGATHER pSgBuf = papSgBufs[i];
+        AssertPtr(pSgBuf);
+        Assert((pSgBuf->fFlags & PDMSCATTERGATHER_FLAGS_MAGIC_MASK) == PDMSCATTERGATHER_FLAGS_MAGIC);
+        if (RT_SUCCESS(rc))
+            rc = drvTAPSendOne(pThis, pSgBuf);
+        pSgBuf->fFlags = 0;
+        RTMemFree(pSgBuf);
+    }
+
+    STAM_PROFILE_STOP(&pThis->StatTransmit, a);
+    AssertRC(rc);
+    if (RT_FAILURE(rc))
+        rc = rc == VERR_NO_MEMORY ? VERR_NET_NO_BUFFER_SPACE : VERR_NET_DOWN;
+    return rc;
+}
+
+
 /**
  * @interface_method_impl{PDMINETWORKUP,pfnEndXmit}
  */
@@ -341,21 +631,281 @@ static DECLCALLBACK(void) drvTAPNetworkUp_NotifyLinkChanged(PPDMINETWORKUP pInte
 
 
 /**
- * Asynchronous I/O thread for handling receive.
+ * Completes the checksum of a frame the kernel left it to us
+ * (DRVTAP_VNETHDR_F_NEEDS_CSUM).
+ *
+ * @param   pThis           The instance data.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The frame size.
+ * @param   pHdr            The virtio-net header of the frame.
+ */
+static void drvTAPRecvCompleteCsum(PDRVTAP pThis, uint8_t *pbFrame, size_t cbFrame, PDRVTAPVNETHDR pHdr)
+{
+    size_t const offCSum = (size_t)pHdr->u16CSumStart + pHdr->u16CSumOffset;
+    if (offCSum + sizeof(uint16_t) > cbFrame)
+        return;
+
+    /* The checksum field holds the pseudo header sum already. */
+    bool     fOdd   = false;
+    uint32_t u32Sum = RTNetIPv4AddDataChecksum(pbFrame + pHdr->u16CSumStart, cbFrame - pHdr->u16CSumStart, 0, &fOdd);
+    uint16_t u16Sum = RTNetIPv4FinalizeChecksum(u32Sum);
+    if (!u16Sum && pHdr->u16CSumOffset == RT_OFFSETOF(RTNETUDP, uh_sum))
+        u16Sum = 0xffff;
+    memcpy(pbFrame + offCSum, &u16Sum, sizeof(u16Sum));
+    STAM_COUNTER_INC(&pThis->StatPktRecvCsum);
+}
+
+
+/**
+ * Waits for the device above to have receive buffers.
+ *
+ * Most guests use frame-sized receive buffers, hence non-zero cbMax
+ * automatically means there is enough room for entire frame. Some guests
+ * (eg. Solaris) use large chains of small receive buffers (each 128 or so
+ * bytes large). We will still start receiving as soon as cbMax is non-zero
+ * because:
+ *  - it would be quite expensive for pfnCanReceive to accurately determine
+ *    free receive buffer space
+ *  - if we were waiting for enough free buffers, there is a risk of
+ *    deadlocking because the guest could be waiting for a receive overflow
+ *    error to allocate more receive buffers
+ *
+ * This is called without RecvLock.  With several queues it wakes up every
+ * DRVTAP_RECV_WAIT_MS as only one waiter is signalled.
+ *
+ * @returns VBox status code.  A failure means we were woken up during a VM
+ *          state transition and the frames should be dropped.
+ * @param   pThis           The instance data.
+ */
+static int drvTAPRecvWait(PDRVTAP pThis)
+{
+    return pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet,
+                                                  pThis->cQueues > 1 ? DRVTAP_RECV_WAIT_MS : RT_INDEFINITE_WAIT);
+}
+
+
+/**
+ * Hands one frame up, waiting for receive buffers as long as the device
+ * reports it has none.
+ *
+ * @returns VBox status code.  VERR_INTERRUPTED if we were woken up during a
+ *          VM state transition.
+ * @param   pThis           The instance data.
+ * @param   pvFrame         The frame.
+ * @param   cbFrame         The frame size.
+ * @param   pGso            The GSO context if it should be handed up as a GSO
+ *                          frame, NULL if not.
+ */
+static int drvTAPRecvOne(PDRVTAP pThis, const void *pvFrame, size_t cbFrame, PCPDMNETWORKGSO pGso)
+{
+    int rc;
+    do
+    {
+        rc = drvTAPRecvWait(pThis);
+        if (RT_FAILURE(rc))
+            return VERR_INTERRUPTED;
+
+        RTCritSectEnter(&pThis->RecvLock);
+        if (pGso)
+            rc = pThis->pIAboveNet->pfnReceiveGso(pThis->pIAboveNet, pvFrame, cbFrame, pGso);
+        else
+            rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pvFrame, cbFrame);
+        RTCritSectLeave(&pThis->RecvLock);
+    } while (rc == VERR_NET_NO_BUFFER_SPACE); /* another queue got there first */
+    return rc;
+}
+
+
+/**
+ * Passes a GSO frame from the kernel up, segmenting it if the device above
+ * can't take it as is.
+ *
+ * @returns VBox status code.
+ * @param   pThis           The instance data.
+ * @param   pbFrame         The frame.  Modified.
+ * @param   cbFrame         The frame size.
+ * @param   pHdr            The virtio-net header of the frame.
+ */
+static int drvTAPRecvGso(PDRVTAP pThis, uint8_t *pbFrame, size_t cbFrame, PDRVTAPVNETHDR pHdr)
+{
+    PDMNETWORKGSO Gso;
+    switch (pHdr->u8GsoType & ~DRVTAP_VNETHDR_GSO_ECN)
+    {
+        case DRVTAP_VNETHDR_GSO_TCPV4:  Gso.u8Type = PDMNETWORKGSOTYPE_IPV4_TCP; break;
+        case DRVTAP_VNETHDR_GSO_TCPV6:  Gso.u8Type = PDMNETWORKGSOTYPE_IPV6_TCP; break;
+        default:
+            return VERR_NOT_SUPPORTED;
+    }
+
+    /* u16HdrLen is only a hint, work out the header size from the TCP header. */
+    if ((size_t)pHdr->u16CSumStart + sizeof(RTNETTCP) > cbFrame)
+        return VERR_INVALID_PARAMETER;
+    size_t const cbHdrsTotal = pHdr->u16CSumStart + ((PCRTNETTCP)(pbFrame + pHdr->u16CSumStart))->th_off * 4;
+    if (cbHdrsTotal > UINT8_MAX)
+        return VERR_INVALID_PARAMETER;
+    Gso.offHdr1     = sizeof(RTNETETHERHDR);
+    Gso.offHdr2     = (uint8_t)pHdr->u16CSumStart;
+    Gso.cbHdrsTotal = (uint8_t)cbHdrsTotal;
+    Gso.cbHdrsSeg   = Gso.cbHdrsTotal;
+    Gso.cbMaxSeg    = pHdr->u16GsoSize;
+    Gso.u8Unused    = 0;
+    if (!PDMNetGsoIsValid(&Gso, sizeof(Gso), cbFrame))
+        return VERR_INVALID_PARAMETER;
+
+    int rc;
+    if (pThis->pIAboveNet->pfnReceiveGso)
+    {
+        PDMNetGsoPrepForDirectUse(&Gso, pbFrame, cbFrame, PDMNETCSUMTYPE_PSEUDO);
+        rc = drvTAPRecvOne(pThis, pbFrame, cbFrame, &Gso);
+        if (RT_SUCCESS(rc))
+        {
+            STAM_COUNTER_INC(&pThis->StatPktRecvGso);
+            return rc;
+        }
+        if (rc == VERR_INTERRUPTED)
+            return rc;
+    }
+
+    /*
+     * The device (or the guest driver) doesn't do large receives.
+     */
+    STAM_COUNTER_INC(&pThis->StatPktRecvGsoSegmented);
+    uint8_t        abSegBuf[2048]; /* See drvTAPSendOne. */
+    uint32_t const cSegs     = PDMNetGsoCalcSegmentCount(&Gso, cbFrame);
+    bool const     fCopySegs = (uint32_t)Gso.cbHdrsTotal + Gso.cbMaxSeg <= sizeof(abSegBuf);
+    rc = VINF_SUCCESS;
+    for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
+    {
+        uint32_t cbSegFrame;
+        void    *pvSegFrame;
+        if (fCopySegs)
+        {
+            cbSegFrame = PDMNetGsoCarveSegmentCopy(&Gso, pbFrame, cbFrame, iSeg, cSegs, abSegBuf);
+            pvSegFrame = abSegBuf;
+        }
+        else
+            pvSegFrame = PDMNetGsoCarveSegmentQD(&Gso, pbFrame, cbFrame, abSegBuf, iSeg, cSegs, &cbSegFrame);
+        rc = drvTAPRecvOne(pThis, pvSegFrame, cbSegFrame, NULL);
+        if (rc == VERR_INTERRUPTED)
+            break; /* we drop the rest. */
+        AssertRC(rc);
+    }
+    return rc;
+}
+
+
+/**
+ * Passes a run of normal frames up, using pfnReceiveFrames when the device
+ * above has it.
+ *
+ * @param   pThis           The instance data.
+ * @param   paFrames        The frames.
+ * @param   cFrames         The number of frames.
+ */
+static void drvTAPRecvFrames(PDRVTAP pThis, PCPDMNETWORKFRAME paFrames, uint32_t cFrames)
+{
+    if (!pThis->pIAboveNet->pfnReceiveFrames)
+    {
+        for (uint32_t iFrame = 0; iFrame < cFrames; iFrame++)
+        {
+            int rc = drvTAPRecvOne(pThis, paFrames[iFrame].pvBuf, paFrames[iFrame].cb, NULL);
+            if (rc == VERR_INTERRUPTED)
+                return; /* drop the rest and wait for the next ones. */
+            AssertRC(rc);
+        }
+        return;
+    }
+
+    uint32_t iFrame = 0;
+    while (iFrame < cFrames)
+    {
+        int rc = drvTAPRecvWait(pThis);
+
+        /*
+         * A return code != VINF_SUCCESS means that we were woken up during a VM
+         * state transition. Drop the rest and wait for the next ones.
+         */
+        if (RT_FAILURE(rc))
+            return;
+
+        uint32_t cTaken = cFrames - iFrame;
+        RTCritSectEnter(&pThis->RecvLock);
+        rc = pThis->pIAboveNet->pfnReceiveFrames(pThis->pIAboveNet, &paFrames[iFrame], &cTaken);
+        RTCritSectLeave(&pThis->RecvLock);
+        AssertMsg(RT_SUCCESS(rc) || rc == VERR_NET_NO_BUFFER_SPACE, ("%Rrc\n", rc));
+        /* Nothing taken means we wait for buffers again, unless the
+           device is in real trouble. */
+        if (!cTaken && rc != VERR_NET_NO_BUFFER_SPACE)
+            cTaken = 1;
+        iFrame += cTaken;
+        STAM_COUNTER_INC(&pThis->StatRecvBatches);
+    }
+}
+
+
+/**
+ * Passes the frames read by a queue up to the device.
+ *
+ * RecvLock is only taken around the calls handing frames up, the waits for
+ * receive buffers run without it so one queue can't stall the others.
+ *
+ * @param   pThis           The instance data.
+ * @param   paHdrs          The virtio-net headers of the frames, zeroed if
+ *                          the device isn't in IFF_VNET_HDR mode.
+ * @param   paFrames        The frames.
+ * @param   cFrames         The number of frames.
+ */
+static void drvTAPRecvProcess(PDRVTAP pThis, PDRVTAPVNETHDR paHdrs, PPDMNETWORKFRAME paFrames, uint32_t cFrames)
+{
+    uint32_t iFirst = 0;
+    for (uint32_t iFrame = 0; iFrame < cFrames; iFrame++)
+    {
+        uint8_t *pbFrame = (uint8_t *)paFrames[iFrame].pvBuf;
+        size_t   cbFrame = paFrames[iFrame].cb;
+#ifdef LOG_ENABLED
+        uint64_t u64Now = RTTimeProgramNanoTS();
+        LogFlow(("drvTAPAsyncIoThread: %-4d bytes at %llu ns  deltas: r=%llu t=%llu\n",
+                 cbFrame, u64Now, u64Now - pThis->u64LastReceiveTS, u64Now - pThis->u64LastTransferTS));
+        pThis->u64LastReceiveTS = u64Now;
+#endif
+        Log2(("drvTAPAsyncIoThread: cbRead=%#x\n" "%.*Rhxd\n", cbFrame, cbFrame, pbFrame));
+        STAM_COUNTER_INC(&pThis->StatPktRecv);
+        STAM_COUNTER_ADD(&pThis->StatPktRecvBytes, cbFrame);
+
+        if (paHdrs[iFrame].u8GsoType != DRVTAP_VNETHDR_GSO_NONE)
+        {
+            /* Keep the order: the normal frames before it go first. */
+            drvTAPRecvFrames(pThis, &paFrames[iFirst], iFrame - iFirst);
+            iFirst = iFrame + 1;
+            int rc = drvTAPRecvGso(pThis, pbFrame, cbFrame, &paHdrs[iFrame]);
+            if (RT_FAILURE(rc))
+                LogFlow(("drvTAPAsyncIoThread: dropped GSO frame: %Rrc (type=%#x size=%u start=%u)\n", rc,
+                         paHdrs[iFrame].u8GsoType, paHdrs[iFrame].u16GsoSize, paHdrs[iFrame].u16CSumStart));
+        }
+        else if (paHdrs[iFrame].u8Flags & DRVTAP_VNETHDR_F_NEEDS_CSUM)
+            drvTAPRecvCompleteCsum(pThis, pbFrame, cbFrame, &paHdrs[iFrame]);
+    }
+    drvTAPRecvFrames(pThis, &paFrames[iFirst], cFrames - iFirst);
+}
+
+
+/**
+ * Asynchronous I/O thread for handling receive on one queue.
  *
  * @returns VINF_SUCCESS (ignored).
  * @param   Thread          Thread handle.
- * @param   pvUser          Pointer to a DRVTAP structure.
+ * @param   pvUser          Pointer to a DRVTAPQUEUE structure.
  */
 static DECLCALLBACK(int) drvTAPAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
 {
-    PDRVTAP pThis = PDMINS_2_DATA(pDrvIns, PDRVTAP);
-    LogFlow(("drvTAPAsyncIoThread: pThis=%p\n", pThis));
+    PDRVTAPQUEUE pQueue = (PDRVTAPQUEUE)pThread->pvUser;
+    PDRVTAP      pThis  = pQueue->pThis;
+    LogFlow(("drvTAPAsyncIoThread: pThis=%p iQueue=%u\n", pThis, pQueue->iQueue));
 
     if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
         return VINF_SUCCESS;
 
-    STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
+    STAM_PROFILE_ADV_START(&pQueue->StatReceive, a);
 
     /*
      * Polling loop.
@@ -366,13 +916,13 @@ static DECLCALLBACK(int) drvTAPAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
          * Wait for something to become available.
          */
         struct pollfd aFDs[2];
-        aFDs[0].fd      = RTFileToNative(pThis->hFileDevice);
+        aFDs[0].fd      = RTFileToNative(pQueue->hFile);
         aFDs[0].events  = POLLIN | POLLPRI;
         aFDs[0].revents = 0;
-        aFDs[1].fd      = RTPipeToNative(pThis->hPipeRead);
+        aFDs[1].fd      = RTPipeToNative(pQueue->hPipeRead);
         aFDs[1].events  = POLLIN | POLLPRI | POLLERR | POLLHUP;
         aFDs[1].revents = 0;
-        STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
+        STAM_PROFILE_ADV_STOP(&pQueue->StatReceive, a);
         errno=0;
         int rc = poll(&aFDs[0], RT_ELEMENTS(aFDs), -1 /* infinite */);
 
@@ -380,73 +930,79 @@ static DECLCALLBACK(int) drvTAPAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
         if (pThread->enmState != PDMTHREADSTATE_RUNNING)
             break;
 
-        STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
+        STAM_PROFILE_ADV_START(&pQueue->StatReceive, a);
         if (    rc > 0
             &&  (aFDs[0].revents & (POLLIN | POLLPRI))
             &&  !aFDs[1].revents)
         {
             /*
-             * Read the frame.
+             * Read the frames, each preceded by a virtio-net header in
+             * IFF_VNET_HDR mode.
              */
-            char achBuf[16384];
-            size_t cbRead = 0;
+            DRVTAPVNETHDR   aHdrs[PDMNETWORK_MAX_BATCH];
+            PDMNETWORKFRAME aFrames[PDMNETWORK_MAX_BATCH];
+            uint32_t        cFrames    = 0;
+            size_t const    cbMaxFrame = pThis->fRecvGso ? DRVTAP_MAX_FRAME_GSO : DRVTAP_MAX_FRAME;
 #ifdef VBOX_WITH_CROSSBOW
-            cbRead = sizeof(achBuf);
-            rc = g_pfnLibDlpiRecv(pThis->pDeviceHandle, NULL, NULL, achBuf, &cbRead, -1, NULL);
+            size_t cbRead = cbMaxFrame;
+            rc = g_pfnLibDlpiRecv(pThis->pDeviceHandle, NULL, NULL, pQueue->pbRecvBuf, &cbRead, -1, NULL);
             rc = RT_LIKELY(rc == DLPI_SUCCESS) ? VINF_SUCCESS : SolarisDLPIErr2VBoxErr(rc);
-#else
-            /** @note At least on Linux we will never receive more than one network packet
-             *        after poll() returned successfully. I don't know why but a second
-             *        RTFileRead() operation will return with VERR_TRY_AGAIN in any case. */
-            rc = RTFileRead(pThis->hFileDevice, achBuf, sizeof(achBuf), &cbRead);
-#endif
             if (RT_SUCCESS(rc))
             {
-                /*
-                 * Wait for the device to have space for this frame.
-                 * Most guests use frame-sized receive buffers, hence non-zero cbMax
-                 * automatically means there is enough room for entire frame. Some
-                 * guests (eg. Solaris) use large chains of small receive buffers
-                 * (each 128 or so bytes large). We will still start receiving as soon
-                 * as cbMax is non-zero because:
-                 *  - it would be quite expensive for pfnCanReceive to accurately
-                 *    determine free receive buffer space
-                 *  - if we were waiting for enough free buffers, there is a risk
-                 *    of deadlocking because the guest could be waiting for a receive
-                 *    overflow error to allocate more receive buffers
-                 */
-                STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
-                int rc1 = pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, RT_INDEFINITE_WAIT);
-                STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
-
-                /*
-                 * A return code != VINF_SUCCESS means that we were woken up during a VM
-                 * state transition. Drop the packet and wait for the next one.
-                 */
-                if (RT_FAILURE(rc1))
+                RT_ZERO(aHdrs[0]);
+                aFrames[0].pvBuf = pQueue->pbRecvBuf;
+                aFrames[0].cb    = cbRead;
+                cFrames = 1;
+            }
+#else
+            /*
+             * The kernel hands us one frame per read, so drain what it has
+             * queued up until the batch or the buffer is full.
+             */
+            size_t const    cbHdr  = pThis->fVNetHdr ? sizeof(aHdrs[0]) : 0;
+            size_t          offBuf = 0;
+            rc = VINF_SUCCESS;
+            for (uint32_t cReads = 0;
+                    cReads < PDMNETWORK_MAX_BATCH
+                 && DRVTAP_RECV_BUF_SIZE - offBuf >= cbMaxFrame;
+                 cReads++)
+            {
+                struct iovec aIov[2];
+                aIov[0].iov_base = &aHdrs[cFrames];
+                aIov[0].iov_len  = sizeof(aHdrs[0]);
+                aIov[1].iov_base = pQueue->pbRecvBuf + offBuf;
+                aIov[1].iov_len  = cbMaxFrame;
+                unsigned const iIov = cbHdr ? 0 : 1;
+                ssize_t cbRead = readv(RTFileToNative(pQueue->hFile), &aIov[iIov], RT_ELEMENTS(aIov) - iIov);
+                if (cbRead < 0)
+                {
+                    if (!cFrames)
+                        rc = RTErrConvertFromErrno(errno);
+                    break;
+                }
+                if ((size_t)cbRead <= cbHdr)
                     continue;
-
-                /*
-                 * Pass the data up.
-                 */
-#ifdef LOG_ENABLED
-                uint64_t u64Now = RTTimeProgramNanoTS();
-                LogFlow(("drvTAPAsyncIoThread: %-4d bytes at %llu ns  deltas: r=%llu t=%llu\n",
-                         cbRead, u64Now, u64Now - pThis->u64LastReceiveTS, u64Now - pThis->u64LastTransferTS));
-                pThis->u64LastReceiveTS = u64Now;
+                if (!cbHdr)
+                    RT_ZERO(aHdrs[cFrames]);
+                aFrames[cFrames].pvBuf = pQueue->pbRecvBuf + offBuf;
+                aFrames[cFrames].cb    = cbRead - cbHdr;
+                offBuf += RT_ALIGN_Z(aFrames[cFrames].cb, 16);
+                cFrames++;
+            }
 #endif
-                Log2(("drvTAPAsyncIoThread: cbRead=%#x\n" "%.*Rhxd\n", cbRead, cbRead, achBuf));
-                STAM_COUNTER_INC(&pThis->StatPktRecv);
-                STAM_COUNTER_ADD(&pThis->StatPktRecvBytes, cbRead);
-                rc1 = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, achBuf, cbRead);
-                AssertRC(rc1);
+            if (cFrames)
+            {
+                STAM_PROFILE_ADV_STOP(&pQueue->StatReceive, a);
+                drvTAPRecvProcess(pThis, aHdrs, aFrames, cFrames);
+                STAM_PROFILE_ADV_START(&pQueue->StatReceive, a);
             }
             else
             {
-                LogFlow(("drvTAPAsyncIoThread: RTFileRead -> %Rrc\n", rc));
+                LogFlow(("drvTAPAsyncIoThread: read -> %Rrc\n", rc));
                 if (rc == VERR_INVALID_HANDLE)
                     break;
-                RTThreadYield();
+                if (rc != VERR_TRY_AGAIN)
+                    RTThreadYield();
             }
         }
         else if (   rc > 0
@@ -459,7 +1015,7 @@ static DECLCALLBACK(int) drvTAPAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
             /* drain the pipe */
             char ch;
             size_t cbRead;
-            RTPipeRead(pThis->hPipeRead, &ch, 1, &cbRead);
+            RTPipeRead(pQueue->hPipeRead, &ch, 1, &cbRead);
         }
         else
         {
@@ -479,7 +1035,7 @@ static DECLCALLBACK(int) drvTAPAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
 
 
     LogFlow(("drvTAPAsyncIoThread: returns %Rrc\n", VINF_SUCCESS));
-    STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
+    STAM_PROFILE_ADV_STOP(&pQueue->StatReceive, a);
     return VINF_SUCCESS;
 }
 
@@ -493,10 +1049,10 @@ static DECLCALLBACK(int) drvTAPAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
  */
 static DECLCALLBACK(int) drvTapAsyncIoWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
 {
-    PDRVTAP pThis = PDMINS_2_DATA(pDrvIns, PDRVTAP);
+    PDRVTAPQUEUE pQueue = (PDRVTAPQUEUE)pThread->pvUser;
 
     size_t cbIgnored;
-    int rc = RTPipeWrite(pThis->hPipeWrite, "", 1, &cbIgnored);
+    int rc = RTPipeWrite(pQueue->hPipeWrite, "", 1, &cbIgnored);
     AssertRC(rc);
 
     return VINF_SUCCESS;
@@ -899,6 +1455,85 @@ static DECLCALLBACK(int) SolarisTAPAttach(PDRVTAP pThis)
 # endif /* VBOX_WITH_CROSSBOW */
 #endif  /* RT_OS_SOLARIS */
 
+#ifdef RT_OS_LINUX
+/**
+ * Switches on offloading and opens the extra queues, as far as the TAP
+ * device was set up for it (IFF_VNET_HDR, IFF_MULTI_QUEUE).
+ *
+ * Failures are not fatal, we just carry on with what we've got.
+ *
+ * @param   pThis           The instance data.
+ * @param   cQueuesWanted   The number of queues we'd like to use.
+ */
+static void drvTAPLinuxSetup(PDRVTAP pThis, uint32_t cQueuesWanted)
+{
+    int const iInstance = pThis->pDrvIns->iInstance;
+    int const fd        = RTFileToNative(pThis->hFileDevice);
+
+    struct ifreq IfReq;
+    RT_ZERO(IfReq);
+    if (ioctl(fd, TUNGETIFF, &IfReq) == -1)
+    {
+        LogRel(("TAP#%d: TUNGETIFF failed, errno=%d. No offloading.\n", iInstance, errno));
+        return;
+    }
+
+    /*
+     * Offloading.  The kernel only hands us GSO frames and partial checksums
+     * if the device above can take GSO frames, otherwise it is pointless.
+     */
+    if (IfReq.ifr_flags & IFF_VNET_HDR)
+    {
+        pThis->fVNetHdr = true;
+        unsigned fOffload = pThis->pIAboveNet->pfnReceiveGso ? TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 : 0;
+        if (ioctl(fd, TUNSETOFFLOAD, fOffload) == -1)
+        {
+            LogRel(("TAP#%d: TUNSETOFFLOAD(%#x) failed, errno=%d\n", iInstance, fOffload, errno));
+            fOffload = 0;
+            ioctl(fd, TUNSETOFFLOAD, fOffload);
+        }
+        pThis->fRecvGso = fOffload != 0;
+    }
+
+    /*
+     * Attach more queues to the same device.
+     */
+    if (cQueuesWanted > 1)
+    {
+        if (IfReq.ifr_flags & IFF_MULTI_QUEUE)
+        {
+            IfReq.ifr_flags &= IFF_TAP | IFF_NO_PI | IFF_VNET_HDR | IFF_MULTI_QUEUE;
+            while (pThis->cQueues < cQueuesWanted)
+            {
+                RTFILE hFile;
+                int rc = RTFileOpen(&hFile, "/dev/net/tun", RTFILE_O_READWRITE | RTFILE_O_OPEN | RTFILE_O_DENY_NONE);
+                if (RT_FAILURE(rc))
+                {
+                    LogRel(("TAP#%d: Failed to open /dev/net/tun for queue #%u: %Rrc\n", iInstance, pThis->cQueues, rc));
+                    break;
+                }
+                if (   ioctl(RTFileToNative(hFile), TUNSETIFF, &IfReq) == -1
+                    || fcntl(RTFileToNative(hFile), F_SETFL, O_NONBLOCK) == -1)
+                {
+                    LogRel(("TAP#%d: Failed to attach queue #%u to %s, errno=%d\n", iInstance, pThis->cQueues, IfReq.ifr_name, errno));
+                    RTFileClose(hFile);
+                    break;
+                }
+                pThis->aQueues[pThis->cQueues].hFile    = hFile;
+                pThis->aQueues[pThis->cQueues].fOwnFile = true;
+                pThis->cQueues++;
+            }
+        }
+        else
+            LogRel(("TAP#%d: %s is not a multi-queue device.\n", iInstance, IfReq.ifr_name));
+    }
+
+    LogRel(("TAP#%d: %s: %u queue(s)%s%s\n", iInstance, IfReq.ifr_name, pThis->cQueues,
+            pThis->fVNetHdr ? ", virtio-net header" : "", pThis->fRecvGso ? ", receive offloading" : ""));
+}
+#endif /* RT_OS_LINUX */
+
+
 /* -=-=-=-=- PDMIBASE -=-=-=-=- */
 
 /**
@@ -931,13 +1566,40 @@ static DECLCALLBACK(void) drvTAPDestruct(PPDMDRVINS pDrvIns)
     PDMDRV_CHECK_VERSIONS_RETURN_VOID(pDrvIns);
 
     /*
-     * Terminate the control pipe.
+     * Terminate the reader threads, their control pipes and the extra queues.
      */
     int rc;
-    rc = RTPipeClose(pThis->hPipeWrite); AssertRC(rc);
-    pThis->hPipeWrite = NIL_RTPIPE;
-    rc = RTPipeClose(pThis->hPipeRead); AssertRC(rc);
-    pThis->hPipeRead = NIL_RTPIPE;
+    for (uint32_t iQueue = 0; iQueue < RT_ELEMENTS(pThis->aQueues); iQueue++)
+    {
+        PDRVTAPQUEUE pQueue = &pThis->aQueues[iQueue];
+        if (pQueue->pThread)
+        {
+            rc = PDMR3ThreadDestroy(pQueue->pThread, NULL);
+            AssertRC(rc);
+            pQueue->pThread = NULL;
+        }
+        if (pQueue->hPipeWrite != NIL_RTPIPE)
+        {
+            rc = RTPipeClose(pQueue->hPipeWrite); AssertRC(rc);
+            pQueue->hPipeWrite = NIL_RTPIPE;
+        }
+        if (pQueue->hPipeRead != NIL_RTPIPE)
+        {
+            rc = RTPipeClose(pQueue->hPipeRead); AssertRC(rc);
+            pQueue->hPipeRead = NIL_RTPIPE;
+        }
+        if (pQueue->fOwnFile)
+        {
+            rc = RTFileClose(pQueue->hFile); AssertRC(rc);
+            pQueue->hFile    = NIL_RTFILE;
+            pQueue->fOwnFile = false;
+        }
+        RTMemFree(pQueue->pbRecvBuf);
+        pQueue->pbRecvBuf = NULL;
+#ifdef VBOX_WITH_STATISTICS
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pQueue->StatReceive);
+#endif
+    }
 
 #ifdef RT_OS_SOLARIS
     /** @todo r=bird: This *does* need checking against ConsoleImpl2.cpp if used on non-solaris systems. */
@@ -981,6 +1643,8 @@ static DECLCALLBACK(void) drvTAPDestruct(PPDMDRVINS pDrvIns)
      */
     if (RTCritSectIsInitialized(&pThis->XmitLock))
         RTCritSectDelete(&pThis->XmitLock);
+    if (RTCritSectIsInitialized(&pThis->RecvLock))
+        RTCritSectDelete(&pThis->RecvLock);
 
 #ifdef VBOX_WITH_STATISTICS
     /*
@@ -990,8 +1654,12 @@ static DECLCALLBACK(void) drvTAPDestruct(PPDMDRVINS pDrvIns)
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktSentBytes);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktRecv);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktRecvBytes);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktSentGso);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktRecvGso);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktRecvGsoSegmented);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktRecvCsum);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatRecvBatches);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatTransmit);
-    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceive);
 #endif /* VBOX_WITH_STATISTICS */
 }
 
@@ -1022,6 +1690,17 @@ static DECLCALLBACK(int) drvTAPConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
 #endif
     pThis->pszSetupApplication          = NULL;
     pThis->pszTerminateApplication      = NULL;
+    pThis->cQueues                      = 1;
+    pThis->fVNetHdr                     = false;
+    pThis->fRecvGso                     = false;
+    for (uint32_t iQueue = 0; iQueue < RT_ELEMENTS(pThis->aQueues); iQueue++)
+    {
+        pThis->aQueues[iQueue].pThis        = pThis;
+        pThis->aQueues[iQueue].hFile        = NIL_RTFILE;
+        pThis->aQueues[iQueue].hPipeWrite   = NIL_RTPIPE;
+        pThis->aQueues[iQueue].hPipeRead    = NIL_RTPIPE;
+        pThis->aQueues[iQueue].iQueue       = iQueue;
+    }
 
     /* IBase */
     pDrvIns->IBase.pfnQueryInterface    = drvTAPQueryInterface;
@@ -1030,6 +1709,7 @@ static DECLCALLBACK(int) drvTAPConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
     pThis->INetworkUp.pfnAllocBuf               = drvTAPNetworkUp_AllocBuf;
     pThis->INetworkUp.pfnFreeBuf                = drvTAPNetworkUp_FreeBuf;
     pThis->INetworkUp.pfnSendBuf                = drvTAPNetworkUp_SendBuf;
+    pThis->INetworkUp.pfnSendBufs               = drvTAPNetworkUp_SendBufs;
     pThis->INetworkUp.pfnEndXmit                = drvTAPNetworkUp_EndXmit;
     pThis->INetworkUp.pfnSetPromiscuousMode     = drvTAPNetworkUp_SetPromiscuousMode;
     pThis->INetworkUp.pfnNotifyLinkChanged      = drvTAPNetworkUp_NotifyLinkChanged;
@@ -1042,14 +1722,18 @@ static DECLCALLBACK(int) drvTAPConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktSentBytes,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,             "Number of sent bytes.",            "/Drivers/TAP%d/Bytes/Sent", pDrvIns->iInstance);
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktRecv,       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "Number of received packets.",      "/Drivers/TAP%d/Packets/Received", pDrvIns->iInstance);
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktRecvBytes,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,             "Number of received bytes.",        "/Drivers/TAP%d/Bytes/Received", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktSentGso,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "GSO frames handed to the kernel.", "/Drivers/TAP%d/Packets/SentGso", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktRecvGso,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "GSO frames passed up.",            "/Drivers/TAP%d/Packets/ReceivedGso", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktRecvGsoSegmented, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,  "GSO frames segmented on receive.", "/Drivers/TAP%d/Packets/ReceivedGsoSegmented", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktRecvCsum,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "Received frames we completed the checksum of.", "/Drivers/TAP%d/Packets/ReceivedCsum", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatRecvBatches,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "Receive batches passed up.",       "/Drivers/TAP%d/ReceiveBatches", pDrvIns->iInstance);
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatTransmit,      STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,    "Profiling packet transmit runs.",  "/Drivers/TAP%d/Transmit", pDrvIns->iInstance);
-    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatReceive,       STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,    "Profiling packet receive runs.",   "/Drivers/TAP%d/Receive", pDrvIns->iInstance);
 #endif /* VBOX_WITH_STATISTICS */
 
     /*
      * Validate the config.
      */
-    if (!CFGMR3AreValuesValid(pCfg, "Device\0InitProg\0TermProg\0FileHandle\0TAPSetupApplication\0TAPTerminateApplication\0MAC"))
+    if (!CFGMR3AreValuesValid(pCfg, "Device\0InitProg\0TermProg\0FileHandle\0TAPSetupApplication\0TAPTerminateApplication\0MAC\0Queues"))
         return PDMDRV_SET_ERROR(pDrvIns, VERR_PDM_DRVINS_UNKNOWN_CFG_VALUES, "");
 
     /*
@@ -1070,7 +1754,14 @@ static DECLCALLBACK(int) drvTAPConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
     /*
      * Read the configuration.
      */
-    int rc;
+    uint32_t cQueuesWanted;
+    int rc = CFGMR3QueryU32Def(pCfg, "Queues", &cQueuesWanted, 1);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to query \"Queues\""));
+    if (cQueuesWanted < 1 || cQueuesWanted > DRVTAP_MAX_QUEUES)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("Configuration error: \"Queues\" must be between 1 and %u"), DRVTAP_MAX_QUEUES);
+
 #if defined(RT_OS_SOLARIS)   /** @todo Other platforms' TAP code should be moved here from ConsoleImpl & VBoxBFE. */
     rc = CFGMR3QueryStringAlloc(pCfg, "TAPSetupApplication", &pThis->pszSetupApplication);
     if (RT_SUCCESS(rc))
@@ -1141,10 +1832,12 @@ static DECLCALLBACK(int) drvTAPConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
 #endif /* !RT_OS_SOLARIS */
 
     /*
-     * Create the transmit lock.
+     * Create the transmit and receive locks.
      */
     rc = RTCritSectInit(&pThis->XmitLock);
     AssertRCReturn(rc, rc);
+    rc = RTCritSectInit(&pThis->RecvLock);
+    AssertRCReturn(rc, rc);
 
     /*
      * Make sure the descriptor is non-blocking and valid.
@@ -1157,19 +1850,43 @@ static DECLCALLBACK(int) drvTAPConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
                                    N_("Configuration error: Failed to configure /dev/net/tun. errno=%d"), errno);
     /** @todo determine device name. This can be done by reading the link /proc/<pid>/fd/<fd> */
     Log(("drvTAPContruct: %d (from fd)\n", pThis->hFileDevice));
-    rc = VINF_SUCCESS;
+    pThis->aQueues[0].hFile = pThis->hFileDevice;
 
-    /*
-     * Create the control pipe.
-     */
-    rc = RTPipeCreate(&pThis->hPipeRead, &pThis->hPipeWrite, 0 /*fFlags*/);
-    AssertRCReturn(rc, rc);
+#ifdef RT_OS_LINUX
+    drvTAPLinuxSetup(pThis, cQueuesWanted);
+#else
+    if (cQueuesWanted > 1)
+        LogRel(("TAP#%d: Multiple queues are not supported on this host.\n", pDrvIns->iInstance));
+#endif
 
     /*
-     * Create the async I/O thread.
+     * Set up the queues: the receive buffer, the control pipe and the
+     * async I/O thread.
      */
-    rc = PDMDrvHlpThreadCreate(pDrvIns, &pThis->pThread, pThis, drvTAPAsyncIoThread, drvTapAsyncIoWakeup, 128 * _1K, RTTHREADTYPE_IO, "TAP");
-    AssertRCReturn(rc, rc);
+    for (uint32_t iQueue = 0; iQueue < pThis->cQueues; iQueue++)
+    {
+        PDRVTAPQUEUE pQueue = &pThis->aQueues[iQueue];
+        pQueue->pbRecvBuf = (uint8_t *)RTMemAlloc(DRVTAP_RECV_BUF_SIZE);
+        if (!pQueue->pbRecvBuf)
+            return VERR_NO_MEMORY;
+
+        rc = RTPipeCreate(&pQueue->hPipeRead, &pQueue->hPipeWrite, 0 /*fFlags*/);
+        AssertRCReturn(rc, rc);
+
+#ifdef VBOX_WITH_STATISTICS
+        if (!iQueue)
+            PDMDrvHlpSTAMRegisterF(pDrvIns, &pQueue->StatReceive, STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,
+                                   "Profiling packet receive runs.", "/Drivers/TAP%d/Receive", pDrvIns->iInstance);
+        else
+            PDMDrvHlpSTAMRegisterF(pDrvIns, &pQueue->StatReceive, STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,
+                                   "Profiling packet receive runs.", "/Drivers/TAP%d/Receive%u", pDrvIns->iInstance, iQueue);
+#endif
+
+        char szName[16];
+        RTStrPrintf(szName, sizeof(szName), iQueue ? "TAP%u" : "TAP", iQueue);
+        rc = PDMDrvHlpThreadCreate(pDrvIns, &pQueue->pThread, pQueue, drvTAPAsyncIoThread, drvTapAsyncIoWakeup, 128 * _1K, RTTHREADTYPE_IO, szName);
+        AssertRCReturn(rc, rc);
+    }
 
     return rc;
 }
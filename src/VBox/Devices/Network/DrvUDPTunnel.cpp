@@ -35,13 +35,127 @@
 #include <iprt/uuid.h>
 #include <iprt/string.h>
 #include <iprt/critsect.h>
+#include <iprt/net.h>
+#include <iprt/socket.h>
+
+#ifdef RT_OS_LINUX
+/** Use our own sockets with recvmmsg/sendmmsg instead of RTUdpServer. */
+# define DRVUDPTUNNEL_WITH_MMSG
+#endif
+
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+# include <iprt/pipe.h>
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <sys/poll.h>
+# include <netinet/in.h>
+# include <netinet/udp.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
 
 #include "VBoxDD.h"
 
 
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The max number of tunnel sockets. */
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+# define DRVUDPTUNNEL_MAX_SOCKETS       8
+#else
+# define DRVUDPTUNNEL_MAX_SOCKETS       1
+#endif
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+/** The size of a receive buffer without UDP GRO. */
+# define DRVUDPTUNNEL_RECV_BUF_SIZE     16384
+/** The size of a receive buffer with UDP GRO. */
+# define DRVUDPTUNNEL_RECV_BUF_SIZE_GRO _64K
+/** The max number of datagrams staged for one sendmmsg call. */
+# define DRVUDPTUNNEL_XMIT_MSGS         64
+/** The max number of I/O vectors staged for one sendmmsg call. */
+# define DRVUDPTUNNEL_XMIT_IOVS         256
+/** The size of the buffer for carved segment headers. */
+# define DRVUDPTUNNEL_XMIT_HDRS         _32K
+/** The max number of segments per UDP GSO datagram (UDP_MAX_SEGMENTS). */
+# define DRVUDPTUNNEL_GSO_MAX_SEGS      64
+/** The max size of a UDP GSO datagram. */
+# define DRVUDPTUNNEL_GSO_MAX_SIZE      65000
+
+/* Older headers lack these. */
+# ifndef SOL_UDP
+#  define SOL_UDP                       17
+# endif
+# ifndef UDP_SEGMENT
+#  define UDP_SEGMENT                   103
+# endif
+# ifndef UDP_GRO
+#  define UDP_GRO                       104
+# endif
+#endif /* DRVUDPTUNNEL_WITH_MMSG */
+
+
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
 *******************************************************************************/
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+/**
+ * A tunnel socket with its receive thread.
+ *
+ * Socket number N uses source port sport + N and destination port dport + N,
+ * so both ends must be configured with the same number of sockets.
+ */
+typedef struct DRVUDPTUNNELSOCK
+{
+    /** Pointer to the driver instance data. */
+    struct DRVUDPTUNNEL    *pThis;
+    /** The native socket, -1 if not open. */
+    int                     fd;
+    /** The socket number. */
+    uint32_t                iSock;
+    /** The destination address. */
+    struct sockaddr_in      DestAddr;
+    /** The write end of the control pipe. */
+    RTPIPE                  hPipeWrite;
+    /** The read end of the control pipe. */
+    RTPIPE                  hPipeRead;
+    /** Receive thread. */
+    PPDMTHREAD              pThread;
+    /** The receive ring, PDMNETWORK_MAX_BATCH buffers of
+     *  DRVUDPTUNNEL::cbRecvBuf bytes. */
+    uint8_t                *pbRecvRing;
+#ifdef VBOX_WITH_STATISTICS
+    /** Profiling packet receive runs. */
+    STAMPROFILEADV          StatReceive;
+#endif
+
+    /** @name Transmit staging, protected by DRVUDPTUNNEL::XmitLock.
+     * @{ */
+    /** Number of staged datagrams. */
+    uint32_t                cXmitMsgs;
+    /** Number of I/O vectors used. */
+    uint32_t                cXmitIovs;
+    /** Bytes used in abXmitHdrs. */
+    uint32_t                offXmitHdrs;
+    /** The staged datagrams. */
+    struct mmsghdr          aXmitMsgs[DRVUDPTUNNEL_XMIT_MSGS];
+    /** The I/O vectors of the staged datagrams. */
+    struct iovec            aXmitIovs[DRVUDPTUNNEL_XMIT_IOVS];
+    /** The UDP_SEGMENT control messages, one per datagram. */
+    union
+    {
+        struct cmsghdr      Hdr;
+        uint8_t             ab[CMSG_SPACE(sizeof(uint16_t))];
+    }                       aXmitCtls[DRVUDPTUNNEL_XMIT_MSGS];
+    /** Headers of carved GSO segments; the payload is sent from the frame. */
+    uint8_t                 abXmitHdrs[DRVUDPTUNNEL_XMIT_HDRS];
+    /** @} */
+} DRVUDPTUNNELSOCK;
+/** Pointer to a tunnel socket. */
+typedef DRVUDPTUNNELSOCK *PDRVUDPTUNNELSOCK;
+#endif /* DRVUDPTUNNEL_WITH_MMSG */
+
 /**
  * UDP tunnel driver instance data.
  *
@@ -68,8 +182,22 @@ typedef struct DRVUDPTUNNEL
     RTNETADDR               DestAddress;
     /** Transmit lock used by drvUDPTunnelUp_BeginXmit. */
     RTCRITSECT              XmitLock;
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+    /** Serializes the sockets' calls to the device above, since
+     *  PDMINETWORKDOWN::pfnWaitReceiveAvail only wakes up one waiter. */
+    RTCRITSECT              RecvLock;
+    /** The number of sockets. */
+    uint32_t                cSocks;
+    /** The size of each receive buffer. */
+    uint32_t                cbRecvBuf;
+    /** Whether to use UDP GSO for sending and GRO for receiving. */
+    bool                    fUdpGso;
+    /** The sockets. */
+    PDRVUDPTUNNELSOCK       apSocks[DRVUDPTUNNEL_MAX_SOCKETS];
+#else
     /** Server data structure for UDP communication. */
     PRTUDPSERVER            pServer;
+#endif
 
     /** Flag whether the link is down. */
     bool volatile           fLinkDown;
@@ -85,8 +213,19 @@ typedef struct DRVUDPTUNNEL
     STAMCOUNTER             StatPktRecvBytes;
     /** Profiling packet transmit runs. */
     STAMPROFILE             StatTransmit;
+# ifdef DRVUDPTUNNEL_WITH_MMSG
+    /** Number of sendmmsg calls. */
+    STAMCOUNTER             StatXmitBatches;
+    /** Number of datagrams the host didn't take. */
+    STAMCOUNTER             StatXmitDropped;
+    /** Number of UDP GSO datagrams sent. */
+    STAMCOUNTER             StatXmitUdpGso;
+    /** Number of recvmmsg calls returning datagrams. */
+    STAMCOUNTER             StatRecvBatches;
+# else
     /** Profiling packet receive runs. */
     STAMPROFILEADV          StatReceive;
+# endif
 #endif /* VBOX_WITH_STATISTICS */
 
 #ifdef LOG_ENABLED
@@ -183,6 +322,257 @@ static DECLCALLBACK(int) drvUDPTunnelUp_FreeBuf(PPDMINETWORKUP pInterface, PPDMS
 }
 
 
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+
+/**
+ * Picks the socket for a frame by hashing its flow, so the frames of a flow
+ * stay in order.
+ *
+ * @returns The socket.
+ * @param   pThis           The instance data.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The frame size.
+ */
+static PDRVUDPTUNNELSOCK drvUDPTunnelXmitSock(PDRVUDPTUNNEL pThis, uint8_t const *pbFrame, size_t cbFrame)
+{
+    if (pThis->cSocks == 1 || cbFrame < sizeof(RTNETETHERHDR))
+        return pThis->apSocks[0];
+
+    PCRTNETETHERHDR pEthHdr = (PCRTNETETHERHDR)pbFrame;
+    uint32_t        uHash   = 0;
+    uint8_t         bProto  = 0;
+    size_t          offL4   = 0;
+    switch (RT_BE2H_U16(pEthHdr->EtherType))
+    {
+        case RTNET_ETHERTYPE_IPV4:
+            if (cbFrame >= sizeof(RTNETETHERHDR) + sizeof(RTNETIPV4))
+            {
+                PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)(pEthHdr + 1);
+                uHash = pIpHdr->ip_src.u ^ pIpHdr->ip_dst.u;
+                if (!(RT_BE2H_U16(pIpHdr->ip_off) & (RTNETIPV4_FLAGS_MF | UINT16_C(0x1fff))))
+                {
+                    bProto = pIpHdr->ip_p;
+                    offL4  = sizeof(RTNETETHERHDR) + pIpHdr->ip_hl * 4;
+                }
+            }
+            break;
+
+        case RTNET_ETHERTYPE_IPV6:
+            if (cbFrame >= sizeof(RTNETETHERHDR) + sizeof(RTNETIPV6))
+            {
+                PCRTNETIPV6 pIpHdr = (PCRTNETIPV6)(pEthHdr + 1);
+                for (unsigned i = 0; i < RT_ELEMENTS(pIpHdr->ip6_src.au32); i++)
+                    uHash ^= pIpHdr->ip6_src.au32[i] ^ pIpHdr->ip6_dst.au32[i];
+                bProto = pIpHdr->ip6_nxt;
+                offL4  = sizeof(RTNETETHERHDR) + sizeof(RTNETIPV6);
+            }
+            break;
+
+        default:
+            uHash = pEthHdr->DstMac.au16[1] ^ pEthHdr->DstMac.au16[2] ^ pEthHdr->SrcMac.au16[1] ^ pEthHdr->SrcMac.au16[2];
+            break;
+    }
+    if (   (bProto == RTNETIPV4_PROT_TCP || bProto == RTNETIPV4_PROT_UDP)
+        && offL4 + sizeof(uint32_t) <= cbFrame)
+    {
+        uint32_t u32Ports;
+        memcpy(&u32Ports, pbFrame + offL4, sizeof(u32Ports));
+        uHash ^= u32Ports;
+    }
+    return pThis->apSocks[((uHash * UINT32_C(0x9e3779b1)) >> 16) % pThis->cSocks];
+}
+
+
+/**
+ * Sends the datagrams staged on a socket.
+ *
+ * @returns VBox status code of the last failure, VINF_SUCCESS if none.
+ * @param   pThis           The instance data.
+ * @param   pSock           The socket.
+ */
+static int drvUDPTunnelXmitFlush(PDRVUDPTUNNEL pThis, PDRVUDPTUNNELSOCK pSock)
+{
+    int      rc   = VINF_SUCCESS;
+    uint32_t iMsg = 0;
+    while (iMsg < pSock->cXmitMsgs)
+    {
+        int cSent = sendmmsg(pSock->fd, &pSock->aXmitMsgs[iMsg], pSock->cXmitMsgs - iMsg, 0);
+        STAM_COUNTER_INC(&pThis->StatXmitBatches);
+        if (cSent > 0)
+        {
+            iMsg += cSent;
+            continue;
+        }
+        int iErr = errno;
+        if (cSent < 0 && iErr == EINTR)
+            continue;
+
+        /*
+         * Drop the datagram the host didn't take and carry on with the rest.
+         * When the host can't do UDP GSO after all, stop using it.
+         */
+        rc = RTErrConvertFromErrno(iErr);
+        LogFlowFunc(("sendmmsg -> %d errno=%d\n", cSent, iErr));
+        if (   pSock->aXmitMsgs[iMsg].msg_hdr.msg_control
+            && (iErr == EIO || iErr == EINVAL)
+            && pThis->fUdpGso)
+        {
+            LogRel(("UDPTunnel#%d: UDP GSO failed (errno=%d), disabled\n", pThis->pDrvIns->iInstance, iErr));
+            pThis->fUdpGso = false;
+        }
+        STAM_COUNTER_INC(&pThis->StatXmitDropped);
+        iMsg++;
+    }
+
+    pSock->cXmitMsgs   = 0;
+    pSock->cXmitIovs   = 0;
+    pSock->offXmitHdrs = 0;
+    return rc;
+}
+
+
+/**
+ * Sends the datagrams staged on all sockets.
+ *
+ * @returns VBox status code of the last failure, VINF_SUCCESS if none.
+ * @param   pThis           The instance data.
+ */
+static int drvUDPTunnelXmitFlushAll(PDRVUDPTUNNEL pThis)
+{
+    int rc = VINF_SUCCESS;
+    for (uint32_t iSock = 0; iSock < pThis->cSocks; iSock++)
+        if (pThis->apSocks[iSock]->cXmitMsgs)
+        {
+            int rc2 = drvUDPTunnelXmitFlush(pThis, pThis->apSocks[iSock]);
+            if (RT_FAILURE(rc2))
+                rc = rc2;
+        }
+    return rc;
+}
+
+
+/**
+ * Makes room for a datagram on a socket, flushing the staged ones if needed.
+ *
+ * @returns VBox status code of the flush.
+ * @param   pThis           The instance data.
+ * @param   pSock           The socket.
+ * @param   cIovs           The number of I/O vectors the datagram needs.
+ * @param   cbHdrs          The number of header bytes the datagram needs.
+ */
+static int drvUDPTunnelXmitReserve(PDRVUDPTUNNEL pThis, PDRVUDPTUNNELSOCK pSock, uint32_t cIovs, uint32_t cbHdrs)
+{
+    Assert(cIovs <= DRVUDPTUNNEL_XMIT_IOVS && cbHdrs <= DRVUDPTUNNEL_XMIT_HDRS);
+    if (   pSock->cXmitMsgs >= DRVUDPTUNNEL_XMIT_MSGS
+        || pSock->cXmitIovs + cIovs > DRVUDPTUNNEL_XMIT_IOVS
+        || pSock->offXmitHdrs + cbHdrs > DRVUDPTUNNEL_XMIT_HDRS)
+        return drvUDPTunnelXmitFlush(pThis, pSock);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Stages a datagram made up of the I/O vectors added since @a iFirstIov.
+ *
+ * @param   pSock           The socket.
+ * @param   iFirstIov       The first I/O vector of the datagram.
+ * @param   cbSegment       The UDP GSO segment size, 0 for a plain datagram.
+ */
+static void drvUDPTunnelXmitStage(PDRVUDPTUNNELSOCK pSock, uint32_t iFirstIov, uint16_t cbSegment)
+{
+    struct mmsghdr *pMsg = &pSock->aXmitMsgs[pSock->cXmitMsgs];
+    RT_ZERO(*pMsg);
+    pMsg->msg_hdr.msg_name    = &pSock->DestAddr;
+    pMsg->msg_hdr.msg_namelen = sizeof(pSock->DestAddr);
+    pMsg->msg_hdr.msg_iov     = &pSock->aXmitIovs[iFirstIov];
+    pMsg->msg_hdr.msg_iovlen  = pSock->cXmitIovs - iFirstIov;
+    if (cbSegment)
+    {
+        pMsg->msg_hdr.msg_control    = &pSock->aXmitCtls[pSock->cXmitMsgs];
+        pMsg->msg_hdr.msg_controllen = sizeof(pSock->aXmitCtls[0]);
+        struct cmsghdr *pCtl = CMSG_FIRSTHDR(&pMsg->msg_hdr);
+        pCtl->cmsg_level = SOL_UDP;
+        pCtl->cmsg_type  = UDP_SEGMENT;
+        pCtl->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+        memcpy(CMSG_DATA(pCtl), &cbSegment, sizeof(cbSegment));
+    }
+    pSock->cXmitMsgs++;
+}
+
+
+/**
+ * Stages a frame for sending.
+ *
+ * The frame data is sent from the S/G buffer, which must stay around until
+ * the next flush.  GSO frames are carved into segments with only the headers
+ * copied; with UDP GSO the segments of a TCP frame go out as few datagrams.
+ *
+ * @returns VBox status code of any flush done on the way.
+ * @param   pThis           The instance data.
+ * @param   pSgBuf          The frame.
+ */
+static int drvUDPTunnelXmitFrame(PDRVUDPTUNNEL pThis, PPDMSCATTERGATHER pSgBuf)
+{
+    uint8_t * const   pbFrame = (uint8_t *)pSgBuf->aSegs[0].pvSeg;
+    size_t const      cbFrame = pSgBuf->cbUsed;
+    PDRVUDPTUNNELSOCK pSock   = drvUDPTunnelXmitSock(pThis, pbFrame, cbFrame);
+    PCPDMNETWORKGSO   pGso    = (PCPDMNETWORKGSO)pSgBuf->pvUser;
+    int               rc;
+
+    if (!pGso)
+    {
+        rc = drvUDPTunnelXmitReserve(pThis, pSock, 1, 0);
+        uint32_t const iFirstIov = pSock->cXmitIovs++;
+        pSock->aXmitIovs[iFirstIov].iov_base = pbFrame;
+        pSock->aXmitIovs[iFirstIov].iov_len  = cbFrame;
+        drvUDPTunnelXmitStage(pSock, iFirstIov, 0);
+        return rc;
+    }
+
+    uint32_t const cSegs       = PDMNetGsoCalcSegmentCount(pGso, cbFrame);  Assert(cSegs > 1);
+    uint32_t const cbSegFrame  = pGso->cbHdrsTotal + pGso->cbMaxSeg;
+    uint32_t       cSegsPerMsg = 1;
+    if (    pThis->fUdpGso
+        &&  (   pGso->u8Type == PDMNETWORKGSOTYPE_IPV4_TCP
+             || pGso->u8Type == PDMNETWORKGSOTYPE_IPV6_TCP
+             || pGso->u8Type == PDMNETWORKGSOTYPE_IPV4_IPV6_TCP))
+        cSegsPerMsg = RT_MIN(DRVUDPTUNNEL_GSO_MAX_SEGS, DRVUDPTUNNEL_GSO_MAX_SIZE / cbSegFrame);
+    if (!cSegsPerMsg)
+        cSegsPerMsg = 1;
+
+    rc = VINF_SUCCESS;
+    for (uint32_t iSeg = 0; iSeg < cSegs; iSeg += cSegsPerMsg)
+    {
+        uint32_t const cSegsMsg = RT_MIN(cSegsPerMsg, cSegs - iSeg);
+        int rc2 = drvUDPTunnelXmitReserve(pThis, pSock, 2 * cSegsMsg, cSegsMsg * RT_ALIGN_32(pGso->cbHdrsTotal, 8));
+        if (RT_FAILURE(rc2))
+            rc = rc2;
+
+        uint32_t const iFirstIov = pSock->cXmitIovs;
+        for (uint32_t i = 0; i < cSegsMsg; i++)
+        {
+            uint8_t *pbSegHdrs = &pSock->abXmitHdrs[pSock->offXmitHdrs];
+            uint32_t cbSegHdrs;
+            uint32_t cbSegPayload;
+            uint32_t offSegPayload = PDMNetGsoCarveSegment(pGso, pbFrame, cbFrame, iSeg + i, cSegs,
+                                                           pbSegHdrs, &cbSegHdrs, &cbSegPayload);
+            pSock->offXmitHdrs += RT_ALIGN_32(cbSegHdrs, 8);
+            pSock->aXmitIovs[pSock->cXmitIovs].iov_base   = pbSegHdrs;
+            pSock->aXmitIovs[pSock->cXmitIovs].iov_len    = cbSegHdrs;
+            pSock->aXmitIovs[pSock->cXmitIovs + 1].iov_base = pbFrame + offSegPayload;
+            pSock->aXmitIovs[pSock->cXmitIovs + 1].iov_len  = cbSegPayload;
+            pSock->cXmitIovs += 2;
+        }
+        drvUDPTunnelXmitStage(pSock, iFirstIov, cSegsMsg > 1 ? (uint16_t)cbSegFrame : 0);
+        if (cSegsMsg > 1)
+            STAM_COUNTER_INC(&pThis->StatXmitUdpGso);
+    }
+    return rc;
+}
+
+#endif /* DRVUDPTUNNEL_WITH_MMSG */
+
+
 /**
  * @interface_method_impl{PDMINETWORKUP,pfnSendBuf}
  */
@@ -201,14 +591,20 @@ static DECLCALLBACK(int) drvUDPTunnelUp_SendBuf(PPDMINETWORKUP pInterface, PPDMS
     PDMDrvHlpFTSetCheckpoint(pThis->pDrvIns, FTMCHECKPOINTTYPE_NETWORK);
 
     int rc;
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+    rc = drvUDPTunnelXmitFrame(pThis, pSgBuf);
+    int rc2 = drvUDPTunnelXmitFlushAll(pThis);
+    if (RT_SUCCESS(rc))
+        rc = rc2;
+#else
     if (!pSgBuf->pvUser)
     {
-#ifdef LOG_ENABLED
+# ifdef LOG_ENABLED
         uint64_t u64Now = RTTimeProgramNanoTS();
         LogFunc(("%-4d bytes at %llu ns  deltas: r=%llu t=%llu\n",
                  pSgBuf->cbUsed, u64Now, u64Now - pThis->u64LastReceiveTS, u64Now - pThis->u64LastTransferTS));
         pThis->u64LastTransferTS = u64Now;
-#endif
+# endif
         Log2(("pSgBuf->aSegs[0].pvSeg=%p pSgBuf->cbUsed=%#x\n%.*Rhxd\n",
               pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed, pSgBuf->cbUsed, pSgBuf->aSegs[0].pvSeg));
 
@@ -229,6 +625,7 @@ static DECLCALLBACK(int) drvUDPTunnelUp_SendBuf(PPDMINETWORKUP pInterface, PPDMS
             rc = RTUdpWrite(pThis->pServer, pvSegFrame, cbSegFrame, &pThis->DestAddress);
         }
     }
+#endif
 
     pSgBuf->fFlags = 0;
     RTMemFree(pSgBuf);
@@ -246,6 +643,59 @@ static DECLCALLBACK(int) drvUDPTunnelUp_SendBuf(PPDMINETWORKUP pInterface, PPDMS
 }
 
 
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnSendBufs}
+ */
+static DECLCALLBACK(int) drvUDPTunnelUp_SendBufs(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER *papSgBufs, uint32_t cSgBufs,
+                                                 bool fOnWorkerThread)
+{
+    PDRVUDPTUNNEL pThis = PDMINETWORKUP_2_DRVUDPTUNNEL(pInterface);
+    STAM_PROFILE_START(&pThis->StatTransmit, a);
+    Assert(RTCritSectIsOwner(&pThis->XmitLock));
+    Assert(cSgBufs <= PDMNETWORK_MAX_BATCH);
+
+    PDMDrvHlpFTSetCheckpoint(pThis->pDrvIns, FTMCHECKPOINTTYPE_NETWORK);
+
+    /*
+     * Stage all the frames, send them, and only then free the buffers as the
+     * staged datagrams point into them.
+     */
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < cSgBufs; i++)
+    {
+        PPDMSCATTERGATHER pSgBuf = papSgBufs[i];
+        AssertPtr(pSgBuf);
+        Assert((pSgBuf->fFlags & PDMSCATTERGATHER_FLAGS_MAGIC_MASK) == PDMSCATTERGATHER_FLAGS_MAGIC);
+        STAM_COUNTER_INC(&pThis->StatPktSent);
+        STAM_COUNTER_ADD(&pThis->StatPktSentBytes, pSgBuf->cbUsed);
+        int rc2 = drvUDPTunnelXmitFrame(pThis, pSgBuf);
+        if (RT_FAILURE(rc2))
+            rc = rc2;
+    }
+    int rc2 = drvUDPTunnelXmitFlushAll(pThis);
+    if (RT_FAILURE(rc2))
+        rc = rc2;
+
+    for (uint32_t i = 0; i < cSgBufs; i++)
+    {
+        papSgBufs[i]->fFlags = 0;
+        RTMemFree(papSgBufs[i]);
+    }
+
+    STAM_PROFILE_STOP(&pThis->StatTransmit, a);
+    if (RT_FAILURE(rc))
+    {
+        if (rc == VERR_NO_MEMORY)
+            rc = VERR_NET_NO_BUFFER_SPACE;
+        else
+            rc = VERR_NET_DOWN;
+    }
+    return rc;
+}
+#endif /* DRVUDPTUNNEL_WITH_MMSG */
+
+
 /**
  * @interface_method_impl{PDMINETWORKUP,pfnEndXmit}
  */
@@ -295,6 +745,315 @@ static DECLCALLBACK(void) drvUDPTunnelUp_NotifyLinkChanged(PPDMINETWORKUP pInter
 }
 
 
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+
+/**
+ * Passes a run of frames up, using pfnReceiveFrames when the device above has
+ * it.
+ *
+ * @param   pThis           The instance data.
+ * @param   paFrames        The frames.
+ * @param   cFrames         The number of frames.
+ */
+static void drvUDPTunnelRecvFrames(PDRVUDPTUNNEL pThis, PCPDMNETWORKFRAME paFrames, uint32_t cFrames)
+{
+    uint32_t iFrame = 0;
+    while (iFrame < cFrames)
+    {
+        /*
+         * Wait for the device to have space for this frame.
+         * Most guests use frame-sized receive buffers, hence non-zero cbMax
+         * automatically means there is enough room for entire frame. Some
+         * guests (eg. Solaris) use large chains of small receive buffers
+         * (each 128 or so bytes large). We will still start receiving as soon
+         * as cbMax is non-zero because:
+         *  - it would be quite expensive for pfnCanReceive to accurately
+         *    determine free receive buffer space
+         *  - if we were waiting for enough free buffers, there is a risk
+         *    of deadlocking because the guest could be waiting for a receive
+         *    overflow error to allocate more receive buffers
+         */
+        int rc = pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, RT_INDEFINITE_WAIT);
+
+        /*
+         * A return code != VINF_SUCCESS means that we were woken up during a VM
+         * state transition. Drop the rest and wait for the next ones.
+         */
+        if (RT_FAILURE(rc))
+            return;
+
+        if (pThis->pIAboveNet->pfnReceiveFrames)
+        {
+            uint32_t cTaken = cFrames - iFrame;
+            rc = pThis->pIAboveNet->pfnReceiveFrames(pThis->pIAboveNet, &paFrames[iFrame], &cTaken);
+            AssertMsg(RT_SUCCESS(rc) || rc == VERR_NET_NO_BUFFER_SPACE, ("%Rrc\n", rc));
+            /* Nothing taken means we wait for buffers again, unless the
+               device is in real trouble. */
+            if (!cTaken && rc != VERR_NET_NO_BUFFER_SPACE)
+                cTaken = 1;
+            iFrame += cTaken;
+        }
+        else
+        {
+            rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, paFrames[iFrame].pvBuf, paFrames[iFrame].cb);
+            AssertRC(rc);
+            iFrame++;
+        }
+    }
+}
+
+
+/**
+ * Passes the datagrams received by recvmmsg up to the device.
+ *
+ * @param   pThis           The instance data.
+ * @param   paMsgs          The datagrams.
+ * @param   cMsgs           The number of datagrams.
+ */
+static void drvUDPTunnelRecvProcess(PDRVUDPTUNNEL pThis, struct mmsghdr *paMsgs, uint32_t cMsgs)
+{
+    if (pThis->fLinkDown)
+        return;
+
+    int rc = RTCritSectEnter(&pThis->RecvLock);
+    AssertRC(rc);
+
+    PDMNETWORKFRAME aFrames[PDMNETWORK_MAX_BATCH];
+    uint32_t        cFrames = 0;
+    for (uint32_t iMsg = 0; iMsg < cMsgs; iMsg++)
+    {
+        struct msghdr *pHdr    = &paMsgs[iMsg].msg_hdr;
+        uint8_t       *pbMsg   = (uint8_t *)pHdr->msg_iov[0].iov_base;
+        size_t const   cbMsg   = paMsgs[iMsg].msg_len;
+        if (pHdr->msg_flags & MSG_TRUNC)
+        {
+            LogFunc(("Dropping truncated datagram (%#x bytes)\n", cbMsg));
+            continue;
+        }
+
+        /* With GRO, a run of datagrams of the same size may come in one go. */
+        size_t cbFrame = cbMsg;
+        if (pHdr->msg_controllen)
+            for (struct cmsghdr *pCtl = CMSG_FIRSTHDR(pHdr); pCtl; pCtl = CMSG_NXTHDR(pHdr, pCtl))
+                if (pCtl->cmsg_level == SOL_UDP && pCtl->cmsg_type == UDP_GRO)
+                {
+                    int cbGro;
+                    memcpy(&cbGro, CMSG_DATA(pCtl), sizeof(cbGro));
+                    if (cbGro > 0)
+                        cbFrame = cbGro;
+                }
+
+        for (size_t off = 0; off < cbMsg; off += cbFrame)
+        {
+            if (cFrames == RT_ELEMENTS(aFrames))
+            {
+                drvUDPTunnelRecvFrames(pThis, aFrames, cFrames);
+                cFrames = 0;
+            }
+            aFrames[cFrames].pvBuf = pbMsg + off;
+            aFrames[cFrames].cb    = RT_MIN(cbFrame, cbMsg - off);
+#ifdef LOG_ENABLED
+            uint64_t u64Now = RTTimeProgramNanoTS();
+            LogFunc(("%-4d bytes at %llu ns  deltas: r=%llu t=%llu\n",
+                     aFrames[cFrames].cb, u64Now, u64Now - pThis->u64LastReceiveTS, u64Now - pThis->u64LastTransferTS));
+            pThis->u64LastReceiveTS = u64Now;
+#endif
+            Log2(("cbRead=%#x\n" "%.*Rhxd\n", aFrames[cFrames].cb, aFrames[cFrames].cb, aFrames[cFrames].pvBuf));
+            STAM_COUNTER_INC(&pThis->StatPktRecv);
+            STAM_COUNTER_ADD(&pThis->StatPktRecvBytes, aFrames[cFrames].cb);
+            cFrames++;
+        }
+    }
+    drvUDPTunnelRecvFrames(pThis, aFrames, cFrames);
+
+    rc = RTCritSectLeave(&pThis->RecvLock);
+    AssertRC(rc);
+}
+
+
+/**
+ * Receive thread of a tunnel socket.
+ *
+ * @returns VINF_SUCCESS (ignored).
+ * @param   pDrvIns         The driver instance.
+ * @param   pThread         The thread, pvUser points to the DRVUDPTUNNELSOCK.
+ */
+static DECLCALLBACK(int) drvUDPTunnelRecvThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PDRVUDPTUNNELSOCK pSock = (PDRVUDPTUNNELSOCK)pThread->pvUser;
+    PDRVUDPTUNNEL     pThis = pSock->pThis;
+    LogFlowFunc(("pThis=%p iSock=%u\n", pThis, pSock->iSock));
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    struct mmsghdr  aMsgs[PDMNETWORK_MAX_BATCH];
+    struct iovec    aIovs[PDMNETWORK_MAX_BATCH];
+    union
+    {
+        struct cmsghdr  Hdr;
+        uint8_t         ab[CMSG_SPACE(sizeof(int))];
+    }               aCtls[PDMNETWORK_MAX_BATCH];
+
+    STAM_PROFILE_ADV_START(&pSock->StatReceive, a);
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        /*
+         * Wait for something to become available.
+         */
+        struct pollfd aFDs[2];
+        aFDs[0].fd      = pSock->fd;
+        aFDs[0].events  = POLLIN;
+        aFDs[0].revents = 0;
+        aFDs[1].fd      = RTPipeToNative(pSock->hPipeRead);
+        aFDs[1].events  = POLLIN | POLLPRI | POLLERR | POLLHUP;
+        aFDs[1].revents = 0;
+        STAM_PROFILE_ADV_STOP(&pSock->StatReceive, a);
+        errno = 0;
+        int rc = poll(&aFDs[0], RT_ELEMENTS(aFDs), -1 /* infinite */);
+
+        /* this might have changed in the meantime */
+        if (pThread->enmState != PDMTHREADSTATE_RUNNING)
+            break;
+
+        STAM_PROFILE_ADV_START(&pSock->StatReceive, a);
+        if (   rc > 0
+            && (aFDs[0].revents & POLLIN)
+            && !aFDs[1].revents)
+        {
+            /*
+             * Read as many datagrams as there are buffers in the ring.
+             */
+            for (uint32_t i = 0; i < RT_ELEMENTS(aMsgs); i++)
+            {
+                aIovs[i].iov_base = pSock->pbRecvRing + i * pThis->cbRecvBuf;
+                aIovs[i].iov_len  = pThis->cbRecvBuf;
+                RT_ZERO(aMsgs[i]);
+                aMsgs[i].msg_hdr.msg_iov    = &aIovs[i];
+                aMsgs[i].msg_hdr.msg_iovlen = 1;
+                if (pThis->fUdpGso)
+                {
+                    aMsgs[i].msg_hdr.msg_control    = &aCtls[i];
+                    aMsgs[i].msg_hdr.msg_controllen = sizeof(aCtls[i]);
+                }
+            }
+            int cMsgs = recvmmsg(pSock->fd, &aMsgs[0], RT_ELEMENTS(aMsgs), MSG_DONTWAIT, NULL);
+            if (cMsgs > 0)
+            {
+                STAM_COUNTER_INC(&pThis->StatRecvBatches);
+                STAM_PROFILE_ADV_STOP(&pSock->StatReceive, a);
+                drvUDPTunnelRecvProcess(pThis, &aMsgs[0], cMsgs);
+                STAM_PROFILE_ADV_START(&pSock->StatReceive, a);
+            }
+            else
+            {
+                LogFunc(("recvmmsg -> %d errno=%d\n", cMsgs, errno));
+                if (errno == EBADF)
+                    break;
+                if (errno != EAGAIN && errno != EINTR)
+                    RTThreadYield();
+            }
+        }
+        else if (   rc > 0
+                 && aFDs[1].revents)
+        {
+            LogFlowFunc(("Control message: enmState=%d revents=%#x\n", pThread->enmState, aFDs[1].revents));
+            if (aFDs[1].revents & (POLLHUP | POLLERR | POLLNVAL))
+                break;
+
+            /* drain the pipe */
+            char ch;
+            size_t cbRead;
+            RTPipeRead(pSock->hPipeRead, &ch, 1, &cbRead);
+        }
+        else
+        {
+            /*
+             * poll() failed for some reason. Yield to avoid eating too much CPU.
+             */
+            if (errno == EINTR)
+                Log(("rc=%d revents=%#x,%#x errno=%d\n", rc, aFDs[0].revents, aFDs[1].revents, errno));
+            else
+                AssertMsgFailed(("rc=%d revents=%#x,%#x errno=%d\n", rc, aFDs[0].revents, aFDs[1].revents, errno));
+            RTThreadYield();
+        }
+    }
+
+    STAM_PROFILE_ADV_STOP(&pSock->StatReceive, a);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Unblocks the receive thread of a socket so it can respond to a state change.
+ *
+ * @returns VBox status code.
+ * @param   pDrvIns         The driver instance.
+ * @param   pThread         The receive thread.
+ */
+static DECLCALLBACK(int) drvUDPTunnelRecvWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PDRVUDPTUNNELSOCK pSock = (PDRVUDPTUNNELSOCK)pThread->pvUser;
+
+    size_t cbIgnored;
+    int rc = RTPipeWrite(pSock->hPipeWrite, "", 1, &cbIgnored);
+    AssertRC(rc);
+
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Opens and binds a tunnel socket.
+ *
+ * @returns VBox status code.
+ * @param   pThis           The instance data.
+ * @param   pSock           The socket.
+ */
+static int drvUDPTunnelSockOpen(PDRVUDPTUNNEL pThis, PDRVUDPTUNNELSOCK pSock)
+{
+    pSock->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (pSock->fd < 0)
+        return RTErrConvertFromErrno(errno);
+    fcntl(pSock->fd, F_SETFD, FD_CLOEXEC);
+
+    int fFlag = 1;
+    setsockopt(pSock->fd, SOL_SOCKET, SO_REUSEADDR, &fFlag, sizeof(fFlag));
+    int cbSockBuf = _1M;
+    setsockopt(pSock->fd, SOL_SOCKET, SO_SNDBUF, &cbSockBuf, sizeof(cbSockBuf));
+    setsockopt(pSock->fd, SOL_SOCKET, SO_RCVBUF, &cbSockBuf, sizeof(cbSockBuf));
+
+    struct sockaddr_in LocalAddr;
+    RT_ZERO(LocalAddr);
+    LocalAddr.sin_family      = AF_INET;
+    LocalAddr.sin_port        = RT_H2N_U16((uint16_t)(pThis->uSrcPort + pSock->iSock));
+    LocalAddr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(pSock->fd, (struct sockaddr *)&LocalAddr, sizeof(LocalAddr)) < 0)
+        return RTErrConvertFromErrno(errno);
+
+    RT_ZERO(pSock->DestAddr);
+    pSock->DestAddr.sin_family      = AF_INET;
+    pSock->DestAddr.sin_port        = RT_H2N_U16((uint16_t)(pThis->uDestPort + pSock->iSock));
+    pSock->DestAddr.sin_addr.s_addr = pThis->DestAddress.uAddr.IPv4.u;
+
+    /*
+     * UDP GSO is probed on the first socket and then applies to all of them.
+     */
+    if (pThis->fUdpGso)
+    {
+        int cbSegment = 0;
+        if (   (!pSock->iSock && setsockopt(pSock->fd, SOL_UDP, UDP_SEGMENT, &cbSegment, sizeof(cbSegment)) < 0)
+            || setsockopt(pSock->fd, SOL_UDP, UDP_GRO, &fFlag, sizeof(fFlag)) < 0)
+        {
+            LogRel(("UDPTunnel#%d: The host doesn't do UDP GSO/GRO (errno=%d)\n", pThis->pDrvIns->iInstance, errno));
+            pThis->fUdpGso = false;
+        }
+    }
+    return VINF_SUCCESS;
+}
+
+#else  /* !DRVUDPTUNNEL_WITH_MMSG */
+
 static DECLCALLBACK(int) drvUDPTunnelReceive(RTSOCKET Sock, void *pvUser)
 {
     PDRVUDPTUNNEL pThis = PDMINS_2_DATA((PPDMDRVINS)pvUser, PDRVUDPTUNNEL);
@@ -367,6 +1126,8 @@ static DECLCALLBACK(int) drvUDPTunnelReceive(RTSOCKET Sock, void *pvUser)
     return VINF_SUCCESS;
 }
 
+#endif /* !DRVUDPTUNNEL_WITH_MMSG */
+
 
 /* -=-=-=-=- PDMIBASE -=-=-=-=- */
 
@@ -402,17 +1163,50 @@ static DECLCALLBACK(void) drvUDPTunnelDestruct(PPDMDRVINS pDrvIns)
 
     ASMAtomicXchgSize(&pThis->fLinkDown, true);
 
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+    /*
+     * The receive threads use the sockets and rings, so they must be gone
+     * before these are freed.
+     */
+    for (uint32_t i = 0; i < RT_ELEMENTS(pThis->apSocks); i++)
+    {
+        PDRVUDPTUNNELSOCK pSock = pThis->apSocks[i];
+        if (!pSock)
+            continue;
+        if (pSock->pThread)
+        {
+            PDMR3ThreadDestroy(pSock->pThread, NULL);
+            pSock->pThread = NULL;
+        }
+        if (pSock->fd >= 0)
+            close(pSock->fd);
+        RTPipeClose(pSock->hPipeRead);
+        RTPipeClose(pSock->hPipeWrite);
+        RTMemFree(pSock->pbRecvRing);
+# ifdef VBOX_WITH_STATISTICS
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pSock->StatReceive);
+# endif
+        RTMemFree(pSock);
+        pThis->apSocks[i] = NULL;
+    }
+
+    if (RTCritSectIsInitialized(&pThis->RecvLock))
+        RTCritSectDelete(&pThis->RecvLock);
+#endif
+
     if (pThis->pszInstance)
         RTStrFree(pThis->pszInstance);
 
     if (pThis->pszDestIP)
         MMR3HeapFree(pThis->pszDestIP);
 
+#ifndef DRVUDPTUNNEL_WITH_MMSG
     if (pThis->pServer)
     {
         RTUdpServerDestroy(pThis->pServer);
         pThis->pServer = NULL;
     }
+#endif
 
     /*
      * Kill the xmit lock.
@@ -429,7 +1223,14 @@ static DECLCALLBACK(void) drvUDPTunnelDestruct(PPDMDRVINS pDrvIns)
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktRecv);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktRecvBytes);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatTransmit);
+# ifdef DRVUDPTUNNEL_WITH_MMSG
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatXmitBatches);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatXmitDropped);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatXmitUdpGso);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatRecvBatches);
+# else
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceive);
+# endif
 #endif /* VBOX_WITH_STATISTICS */
 }
 
@@ -458,6 +1259,9 @@ static DECLCALLBACK(int) drvUDPTunnelConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCf
     pThis->INetworkUp.pfnAllocBuf               = drvUDPTunnelUp_AllocBuf;
     pThis->INetworkUp.pfnFreeBuf                = drvUDPTunnelUp_FreeBuf;
     pThis->INetworkUp.pfnSendBuf                = drvUDPTunnelUp_SendBuf;
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+    pThis->INetworkUp.pfnSendBufs               = drvUDPTunnelUp_SendBufs;
+#endif
     pThis->INetworkUp.pfnEndXmit                = drvUDPTunnelUp_EndXmit;
     pThis->INetworkUp.pfnSetPromiscuousMode     = drvUDPTunnelUp_SetPromiscuousMode;
     pThis->INetworkUp.pfnNotifyLinkChanged      = drvUDPTunnelUp_NotifyLinkChanged;
@@ -471,13 +1275,20 @@ static DECLCALLBACK(int) drvUDPTunnelConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCf
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktRecv,       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "Number of received packets.",      "/Drivers/UDPTunnel%d/Packets/Received", pDrvIns->iInstance);
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktRecvBytes,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,             "Number of received bytes.",        "/Drivers/UDPTunnel%d/Bytes/Received", pDrvIns->iInstance);
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatTransmit,      STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,    "Profiling packet transmit runs.",  "/Drivers/UDPTunnel%d/Transmit", pDrvIns->iInstance);
+# ifdef DRVUDPTUNNEL_WITH_MMSG
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatXmitBatches,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_CALLS,             "Number of sendmmsg calls.",        "/Drivers/UDPTunnel%d/XmitBatches", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatXmitDropped,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "Number of datagrams the host didn't take.", "/Drivers/UDPTunnel%d/XmitDropped", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatXmitUdpGso,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "Number of UDP GSO datagrams sent.", "/Drivers/UDPTunnel%d/XmitUdpGso", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatRecvBatches,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_CALLS,             "Number of recvmmsg calls returning datagrams.", "/Drivers/UDPTunnel%d/RecvBatches", pDrvIns->iInstance);
+# else
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatReceive,       STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,    "Profiling packet receive runs.",   "/Drivers/UDPTunnel%d/Receive", pDrvIns->iInstance);
+# endif
 #endif /* VBOX_WITH_STATISTICS */
 
     /*
      * Validate the config.
      */
-    if (!CFGMR3AreValuesValid(pCfg, "sport\0dest\0dport"))
+    if (!CFGMR3AreValuesValid(pCfg, "sport\0dest\0dport\0sockets\0udpgso"))
         return PDMDRV_SET_ERROR(pDrvIns, VERR_PDM_DRVINS_UNKNOWN_CFG_VALUES, "");
 
     /*
@@ -527,7 +1338,27 @@ static DECLCALLBACK(int) drvUDPTunnelConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCf
         rc = PDMDRV_SET_ERROR(pDrvIns, rc,
                               N_("DrvUDPTunnel: Configuration error: Querying \"dest\" as string failed"));
 
-    LogRel(("UDPTunnel#%d: sport=%d;dest=%s;dport=%d\n", pDrvIns->iInstance, pThis->uSrcPort, pThis->pszDestIP, pThis->uDestPort));
+    uint32_t cSocks;
+    rc = CFGMR3QueryU32Def(pCfg, "sockets", &cSocks, 1);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("DrvUDPTunnel: Configuration error: Querying \"sockets\" as integer failed"));
+    if (   cSocks < 1
+        || cSocks > DRVUDPTUNNEL_MAX_SOCKETS
+        || pThis->uSrcPort  + cSocks - 1 > UINT16_MAX
+        || pThis->uDestPort + cSocks - 1 > UINT16_MAX)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("DrvUDPTunnel: Configuration error: \"sockets\" must be between 1 and %u and the port ranges must fit"),
+                                   DRVUDPTUNNEL_MAX_SOCKETS);
+
+    bool fUdpGso;
+    rc = CFGMR3QueryBoolDef(pCfg, "udpgso", &fUdpGso, false);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("DrvUDPTunnel: Configuration error: Querying \"udpgso\" as boolean failed"));
+
+    LogRel(("UDPTunnel#%d: sport=%d;dest=%s;dport=%d;sockets=%u;udpgso=%RTbool\n",
+            pDrvIns->iInstance, pThis->uSrcPort, pThis->pszDestIP, pThis->uDestPort, cSocks, fUdpGso));
 
     /*
      * Set up destination address for UDP.
@@ -541,6 +1372,58 @@ static DECLCALLBACK(int) drvUDPTunnelConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCf
     rc = RTStrAPrintf(&pThis->pszInstance, "UDPTunnel%d", pDrvIns->iInstance);
     AssertRC(rc);
 
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+    /*
+     * Open the sockets and start a receive thread for each.
+     */
+    rc = RTCritSectInit(&pThis->RecvLock);
+    AssertRCReturn(rc, rc);
+
+    pThis->cSocks    = cSocks;
+    pThis->fUdpGso   = fUdpGso;
+    pThis->cbRecvBuf = fUdpGso ? DRVUDPTUNNEL_RECV_BUF_SIZE_GRO : DRVUDPTUNNEL_RECV_BUF_SIZE;
+    for (uint32_t iSock = 0; iSock < cSocks; iSock++)
+    {
+        PDRVUDPTUNNELSOCK pSock = (PDRVUDPTUNNELSOCK)RTMemAllocZ(sizeof(*pSock));
+        if (!pSock)
+            return VERR_NO_MEMORY;
+        pSock->pThis      = pThis;
+        pSock->fd         = -1;
+        pSock->iSock      = iSock;
+        pSock->hPipeRead  = NIL_RTPIPE;
+        pSock->hPipeWrite = NIL_RTPIPE;
+        pThis->apSocks[iSock] = pSock;
+
+        pSock->pbRecvRing = (uint8_t *)RTMemAlloc(PDMNETWORK_MAX_BATCH * pThis->cbRecvBuf);
+        if (!pSock->pbRecvRing)
+            return VERR_NO_MEMORY;
+
+        rc = drvUDPTunnelSockOpen(pThis, pSock);
+        if (RT_FAILURE(rc))
+            return PDMDrvHlpVMSetError(pDrvIns, VERR_PDM_HIF_OPEN_FAILED, RT_SRC_POS,
+                                       N_("UDPTunnel: Failed to open UDP port %u (%Rrc)"), pThis->uSrcPort + iSock, rc);
+
+        rc = RTPipeCreate(&pSock->hPipeRead, &pSock->hPipeWrite, 0 /*fFlags*/);
+        AssertRCReturn(rc, rc);
+
+# ifdef VBOX_WITH_STATISTICS
+        if (!iSock)
+            PDMDrvHlpSTAMRegisterF(pDrvIns, &pSock->StatReceive, STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling packet receive runs.", "/Drivers/UDPTunnel%d/Receive", pDrvIns->iInstance);
+        else
+            PDMDrvHlpSTAMRegisterF(pDrvIns, &pSock->StatReceive, STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling packet receive runs.", "/Drivers/UDPTunnel%d/Receive%u", pDrvIns->iInstance, iSock);
+# endif
+
+        char szThread[16];
+        if (iSock)
+            RTStrPrintf(szThread, sizeof(szThread), "UDPTnl%d/%u", pDrvIns->iInstance, iSock);
+        rc = PDMDrvHlpThreadCreate(pDrvIns, &pSock->pThread, pSock, drvUDPTunnelRecvThread, drvUDPTunnelRecvWakeup,
+                                   128 * _1K, RTTHREADTYPE_IO, iSock ? szThread : pThis->pszInstance);
+        AssertRCReturn(rc, rc);
+    }
+#else
+    if (fUdpGso)
+        LogRel(("UDPTunnel#%d: UDP GSO/GRO is not supported on this host, ignoring \"udpgso\"\n", pDrvIns->iInstance));
+
     /*
      * Start the UDP receiving thread.
      */
@@ -549,6 +1432,7 @@ static DECLCALLBACK(int) drvUDPTunnelConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCf
     if (RT_FAILURE(rc))
         return PDMDrvHlpVMSetError(pThis->pDrvIns, VERR_PDM_HIF_OPEN_FAILED, RT_SRC_POS,
                                    N_("UDPTunnel: Failed to start the UDP tunnel server"));
+#endif
 
     /*
      * Create the transmit lock.
@@ -560,6 +1444,7 @@ static DECLCALLBACK(int) drvUDPTunnelConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCf
 }
 
 
+#ifndef DRVUDPTUNNEL_WITH_MMSG
 /**
  * Suspend notification.
  *
@@ -595,6 +1480,7 @@ static DECLCALLBACK(void) drvUDPTunnelResume(PPDMDRVINS pDrvIns)
                             N_("UDPTunnel: Failed to start the UDP tunnel server"));
 
 }
+#endif /* !DRVUDPTUNNEL_WITH_MMSG */
 
 
 /**
@@ -632,10 +1518,17 @@ const PDMDRVREG g_DrvUDPTunnel =
     NULL,
     /* pfnReset */
     NULL,
+#ifdef DRVUDPTUNNEL_WITH_MMSG
+    /* pfnSuspend */
+    NULL,
+    /* pfnResume */
+    NULL,
+#else
     /* pfnSuspend */
     drvUDPTunnelSuspend,
     /* pfnResume */
     drvUDPTunnelResume,
+#endif
     /* pfnAttach */
     NULL,
     /* pfnDetach */
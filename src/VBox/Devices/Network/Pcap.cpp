@@ -24,6 +24,7 @@
 #include <iprt/stream.h>
 #include <iprt/time.h>
 #include <iprt/err.h>
+#include <iprt/string.h>
 #include <VBox/vmm/pdmnetinline.h>
 
 
@@ -31,6 +32,23 @@
 *   Structures and Typedefs                                                    *
 *******************************************************************************/
 
+/** @name pcapng block types and option codes.
+ * @{ */
+#define PCAPNG_BT_SHB               UINT32_C(0x0a0d0d0a)
+#define PCAPNG_BT_IDB               UINT32_C(0x00000001)
+#define PCAPNG_BT_ISB               UINT32_C(0x00000005)
+#define PCAPNG_BT_EPB               UINT32_C(0x00000006)
+#define PCAPNG_BYTE_ORDER_MAGIC     UINT32_C(0x1a2b3c4d)
+#define PCAPNG_OPT_ENDOFOPT         0
+#define PCAPNG_OPT_SHB_USERAPPL     4
+#define PCAPNG_OPT_IF_NAME          2
+#define PCAPNG_OPT_IF_DESCRIPTION   3
+#define PCAPNG_OPT_IF_MACADDR       6
+#define PCAPNG_OPT_IF_TSRESOL       9
+#define PCAPNG_OPT_EPB_FLAGS        2
+#define PCAPNG_OPT_ISB_IFDROP       5
+/** @} */
+
 /* "libpcap" magic */
 #define PCAP_MAGIC  0xa1b2c3d4
 
@@ -254,3 +272,170 @@ int PcapFileGsoFrame(RTFILE File, uint64_t StartNanoTS, PCPDMNETWORKGSO pGso,
     return VINF_SUCCESS;
 }
 
+
+
+/**
+ * Internal pcapng helper that stores a 32-bit value.
+ */
+DECLINLINE(uint8_t *) pcapNgPutU32(uint8_t *pb, uint32_t u32)
+{
+    memcpy(pb, &u32, sizeof(u32));
+    return pb + sizeof(u32);
+}
+
+
+/**
+ * Internal pcapng helper that stores an option, padding it to 32 bits.
+ */
+static uint8_t *pcapNgPutOption(uint8_t *pb, uint16_t uCode, const void *pvValue, uint16_t cbValue)
+{
+    memcpy(pb, &uCode, sizeof(uCode));
+    memcpy(pb + 2, &cbValue, sizeof(cbValue));
+    memcpy(pb + 4, pvValue, cbValue);
+    memset(pb + 4 + cbValue, 0, RT_ALIGN_32(cbValue, 4) - cbValue);
+    return pb + 4 + RT_ALIGN_32(cbValue, 4);
+}
+
+
+/**
+ * Internal pcapng helper that terminates the options and the block, filling in
+ * both length fields.
+ *
+ * @returns The block size.
+ */
+static size_t pcapNgEndBlock(uint8_t *pbBlock, uint8_t *pb)
+{
+    pb = pcapNgPutU32(pb, PCAPNG_OPT_ENDOFOPT);
+    uint32_t const cbBlock = (uint32_t)(pb - pbBlock) + sizeof(uint32_t);
+    pcapNgPutU32(pb, cbBlock);
+    pcapNgPutU32(pbBlock + 4, cbBlock);
+    return cbBlock;
+}
+
+
+/**
+ * Formats a pcapng section header block.
+ *
+ * @returns Number of bytes stored, 0 if @a cbDst is too small.
+ *
+ * @param   pvDst           Where to store the block.
+ * @param   cbDst           The size of the buffer.
+ * @param   pszUserAppl     The name of the application writing the file.
+ */
+size_t PcapNgFormatSectionHdr(void *pvDst, size_t cbDst, const char *pszUserAppl)
+{
+    size_t const cchUserAppl = RT_MIN(strlen(pszUserAppl), 256);
+    if (cbDst < 40 + RT_ALIGN_Z(cchUserAppl, 4))
+        return 0;
+
+    uint8_t *pbBlock = (uint8_t *)pvDst;
+    uint8_t *pb = pcapNgPutU32(pbBlock, PCAPNG_BT_SHB);
+    pb = pcapNgPutU32(pb, 0);
+    pb = pcapNgPutU32(pb, PCAPNG_BYTE_ORDER_MAGIC);
+    pb = pcapNgPutU32(pb, RT_MAKE_U32(1, 0));           /* major 1, minor 0 */
+    pb = pcapNgPutU32(pb, UINT32_MAX);                  /* section length unknown (-1) */
+    pb = pcapNgPutU32(pb, UINT32_MAX);
+    pb = pcapNgPutOption(pb, PCAPNG_OPT_SHB_USERAPPL, pszUserAppl, (uint16_t)cchUserAppl);
+    return pcapNgEndBlock(pbBlock, pb);
+}
+
+
+/**
+ * Formats a pcapng interface description block for an ethernet interface with
+ * nanosecond timestamps.
+ *
+ * @returns Number of bytes stored, 0 if @a cbDst is too small.
+ *
+ * @param   pvDst           Where to store the block.
+ * @param   cbDst           The size of the buffer.
+ * @param   pszName         The interface name.
+ * @param   pszDesc         The interface description.
+ * @param   pMac            The MAC address of the interface, optional.
+ * @param   cbSnapLen       The max number of bytes captured per frame.
+ */
+size_t PcapNgFormatIfDesc(void *pvDst, size_t cbDst, const char *pszName, const char *pszDesc,
+                          PCRTMAC pMac, uint32_t cbSnapLen)
+{
+    size_t const cchName = RT_MIN(strlen(pszName), 256);
+    size_t const cchDesc = RT_MIN(strlen(pszDesc), 256);
+    if (cbDst < 48 + RT_ALIGN_Z(cchName, 4) + RT_ALIGN_Z(cchDesc, 4) + 12)
+        return 0;
+
+    uint8_t *pbBlock = (uint8_t *)pvDst;
+    uint8_t *pb = pcapNgPutU32(pbBlock, PCAPNG_BT_IDB);
+    pb = pcapNgPutU32(pb, 0);
+    pb = pcapNgPutU32(pb, 1);                           /* LINKTYPE_ETHERNET, reserved */
+    pb = pcapNgPutU32(pb, cbSnapLen);
+    pb = pcapNgPutOption(pb, PCAPNG_OPT_IF_NAME, pszName, (uint16_t)cchName);
+    pb = pcapNgPutOption(pb, PCAPNG_OPT_IF_DESCRIPTION, pszDesc, (uint16_t)cchDesc);
+    if (pMac)
+        pb = pcapNgPutOption(pb, PCAPNG_OPT_IF_MACADDR, pMac, sizeof(*pMac));
+    uint8_t const bTsResol = 9;                         /* 10^-9 s */
+    pb = pcapNgPutOption(pb, PCAPNG_OPT_IF_TSRESOL, &bTsResol, sizeof(bTsResol));
+    return pcapNgEndBlock(pbBlock, pb);
+}
+
+
+/**
+ * Formats a pcapng enhanced packet block.
+ *
+ * @returns Number of bytes stored, 0 if @a cbDst is too small.  This is at
+ *          most @a cbCaptured + PCAPNG_EPB_OVERHEAD.
+ *
+ * @param   pvDst           Where to store the block.
+ * @param   cbDst           The size of the buffer.
+ * @param   iIf             The interface index (order of the IDBs).
+ * @param   u64TimestampNs  The timestamp, nanoseconds since the epoch.
+ * @param   fFlags          PCAPNG_EPB_FLAGS_XXX, 0 if unknown.
+ * @param   pvFrame         The captured bytes.
+ * @param   cbCaptured      The number of captured bytes.
+ * @param   cbOrig          The original size of the frame.
+ */
+size_t PcapNgFormatPacket(void *pvDst, size_t cbDst, uint32_t iIf, uint64_t u64TimestampNs, uint32_t fFlags,
+                          const void *pvFrame, uint32_t cbCaptured, uint32_t cbOrig)
+{
+    if (cbDst < (size_t)cbCaptured + PCAPNG_EPB_OVERHEAD)
+        return 0;
+
+    uint8_t *pbBlock = (uint8_t *)pvDst;
+    uint8_t *pb = pcapNgPutU32(pbBlock, PCAPNG_BT_EPB);
+    pb = pcapNgPutU32(pb, 0);
+    pb = pcapNgPutU32(pb, iIf);
+    pb = pcapNgPutU32(pb, RT_HI_U32(u64TimestampNs));
+    pb = pcapNgPutU32(pb, RT_LO_U32(u64TimestampNs));
+    pb = pcapNgPutU32(pb, cbCaptured);
+    pb = pcapNgPutU32(pb, cbOrig);
+    memcpy(pb, pvFrame, cbCaptured);
+    memset(pb + cbCaptured, 0, RT_ALIGN_32(cbCaptured, 4) - cbCaptured);
+    pb += RT_ALIGN_32(cbCaptured, 4);
+    if (fFlags)
+        pb = pcapNgPutOption(pb, PCAPNG_OPT_EPB_FLAGS, &fFlags, sizeof(fFlags));
+    return pcapNgEndBlock(pbBlock, pb);
+}
+
+
+/**
+ * Formats a pcapng interface statistics block carrying the drop count.
+ *
+ * @returns Number of bytes stored, 0 if @a cbDst is too small.
+ *
+ * @param   pvDst           Where to store the block.
+ * @param   cbDst           The size of the buffer.
+ * @param   iIf             The interface index (order of the IDBs).
+ * @param   u64TimestampNs  The timestamp, nanoseconds since the epoch.
+ * @param   cDropped        Number of frames the capture had to drop.
+ */
+size_t PcapNgFormatIfStats(void *pvDst, size_t cbDst, uint32_t iIf, uint64_t u64TimestampNs, uint64_t cDropped)
+{
+    if (cbDst < 40)
+        return 0;
+
+    uint8_t *pbBlock = (uint8_t *)pvDst;
+    uint8_t *pb = pcapNgPutU32(pbBlock, PCAPNG_BT_ISB);
+    pb = pcapNgPutU32(pb, 0);
+    pb = pcapNgPutU32(pb, iIf);
+    pb = pcapNgPutU32(pb, RT_HI_U32(u64TimestampNs));
+    pb = pcapNgPutU32(pb, RT_LO_U32(u64TimestampNs));
+    pb = pcapNgPutOption(pb, PCAPNG_OPT_ISB_IFDROP, &cDropped, sizeof(cDropped));
+    return pcapNgEndBlock(pbBlock, pb);
+}
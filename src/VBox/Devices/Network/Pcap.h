@@ -18,6 +18,7 @@
 #ifndef ___VBox_Pcap_h
 #define ___VBox_Pcap_h
 
+#include <iprt/net.h>
 #include <iprt/stream.h>
 #include <VBox/types.h>
 
@@ -33,6 +34,21 @@ int PcapFileFrame(RTFILE File, uint64_t StartNanoTS, const void *pvFrame, size_t
 int PcapFileGsoFrame(RTFILE File, uint64_t StartNanoTS, PCPDMNETWORKGSO pGso,
                      const void *pvFrame, size_t cbFrame, size_t cbSegMax);
 
+/** @name pcapng enhanced packet block flags (PcapNgFormatPacket).
+ * @{ */
+#define PCAPNG_EPB_FLAGS_INBOUND    UINT32_C(1)
+#define PCAPNG_EPB_FLAGS_OUTBOUND   UINT32_C(2)
+/** @} */
+/** The max number of bytes PcapNgFormatPacket adds to the captured data. */
+#define PCAPNG_EPB_OVERHEAD         48
+
+size_t PcapNgFormatSectionHdr(void *pvDst, size_t cbDst, const char *pszUserAppl);
+size_t PcapNgFormatIfDesc(void *pvDst, size_t cbDst, const char *pszName, const char *pszDesc,
+                          PCRTMAC pMac, uint32_t cbSnapLen);
+size_t PcapNgFormatPacket(void *pvDst, size_t cbDst, uint32_t iIf, uint64_t u64TimestampNs, uint32_t fFlags,
+                          const void *pvFrame, uint32_t cbCaptured, uint32_t cbOrig);
+size_t PcapNgFormatIfStats(void *pvDst, size_t cbDst, uint32_t iIf, uint64_t u64TimestampNs, uint64_t cDropped);
+
 RT_C_DECLS_END
 
 #endif
@@ -28,6 +28,8 @@
 #include <VBox/log.h>
 
 #include <iprt/asm.h>
+#include <iprt/asm-amd64-x86.h>
+#include <iprt/asm-math.h>
 #include <iprt/assert.h>
 #include <iprt/handletable.h>
 #include <iprt/mp.h>
@@ -60,6 +62,43 @@
 /** The wakeup bit in the INTNETIF::cBusy and INTNETRUNKIF::cBusy counters. */
 #define INTNET_BUSY_WAKEUP_MASK     RT_BIT_32(30)
 
+/** The max number of receivers IntNetR0IfSend defers the wakeup of until it
+ * has pushed the whole send ring thru the switch. */
+#define INTNET_MAX_DEFERRED_WAKEUPS 8
+
+/** The number of buckets in the MAC address hash of INTNETMACTAB.
+ * Must be a power of two. */
+#define INTNET_MACTAB_HASH_SIZE     64
+/** Terminates a INTNETMACTAB hash chain and marks unused
+ * INTNETL3HASHENTRY::iMacTab values. */
+#define INTNET_MACTAB_HASH_END      UINT16_MAX
+/** How long an interface must have been silent before it forgets the MAC
+ * address it learned when another interface starts using it. */
+#define INTNET_MACTAB_MAX_AGE_NS    (UINT64_C(300) * 1000000000)
+
+/** The number of entries in the level-3 address hash of shared MAC networks.
+ * Must be a power of two. */
+#define INTNET_L3HASH_SIZE          256
+/** How long a level-3 address hash entry is used before the address caches of
+ * all the interfaces are searched again. */
+#define INTNET_L3HASH_MAX_AGE_NS    (UINT64_C(60) * 1000000000)
+/** INTNETL3HASHENTRY::iMacTab value for an address no interface has. */
+#define INTNET_L3HASH_NONE          (UINT16_MAX - 1)
+/** INTNETL3HASHENTRY::iMacTab value for an address several interfaces have. */
+#define INTNET_L3HASH_DUP           (UINT16_MAX - 2)
+
+/** The number of buckets in the hash of an address cache.
+ * Must be a power of two. */
+#define INTNET_ADDR_CACHE_HASH_SIZE 16
+/** Terminates an address cache hash chain. */
+#define INTNET_ADDR_CACHE_HASH_END  UINT8_MAX
+
+/** The QoS token buckets of an interface hold 1/INTNET_QOS_BURST_DIV second
+ * worth of traffic, which is the max burst it may send. */
+#define INTNET_QOS_BURST_DIV        10
+/** The min size of the QoS byte bucket, so that max sized GSO frames get thru. */
+#define INTNET_QOS_MIN_BURST_BYTES  _64K
+
 
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
@@ -80,6 +119,9 @@ typedef struct INTNETMACTABENTRY
      * to this interface onto the trunk.  The reasoning for this is that this could
      * be the interface of a VM that just has been teleported to a different host. */
     bool                    fActive;
+    /** The next entry in the same INTNETMACTAB::aiHash chain,
+     * INTNET_MACTAB_HASH_END if last. */
+    uint16_t                iHashNext;
     /** Pointer to the network interface. */
     struct INTNETIF        *pIf;
 } INTNETMACTABENTRY;
@@ -106,6 +148,15 @@ typedef struct INTNETMACTAB
     /** The number of interface entries currently in promicuous mode that
      * shall not see unrelated trunk traffic. */
     uint32_t                cPromiscuousNoTrunkEntries;
+    /** The number of active interface entries with a dummy MAC address.  Such
+     * entries see all unicast traffic, so the hash is no use while there are
+     * any. */
+    uint32_t                cActiveDummyEntries;
+    /** MAC address hash, the index of the first entry in each chain.
+     * Entries changing their address or activation state are relinked by
+     * intnetR0MacTabUnlinkEntry and intnetR0MacTabLinkEntry, removals have to
+     * call intnetR0NetworkMacTabRehash as they shift the entries. */
+    uint16_t                aiHash[INTNET_MACTAB_HASH_SIZE];
 
     /** The host MAC address (reported). */
     RTMAC                   HostMac;
@@ -131,6 +182,30 @@ typedef struct INTNETMACTAB
 /** Pointer to a MAC address .  */
 typedef INTNETMACTAB *PINTNETMACTAB;
 
+/**
+ * Level-3 address hash entry.
+ *
+ * This caches which interface has a network layer address in its address cache
+ * so that frames from the wire don't require searching the caches of all the
+ * interfaces.  The address caches remain authoritative, the entry is verified
+ * against them on use.
+ */
+typedef struct INTNETL3HASHENTRY
+{
+    /** The address. */
+    RTNETADDRU              Addr;
+    /** When the entry was last learned (RTTimeSystemNanoTS). */
+    uint64_t                u64Learned;
+    /** The MAC table index of the only interface having the address,
+     * INTNET_L3HASH_NONE if none has it, INTNET_L3HASH_DUP if several have it
+     * and INTNET_MACTAB_HASH_END if the entry is unused. */
+    uint16_t                iMacTab;
+    /** The address type (INTNETADDRTYPE). */
+    uint8_t                 enmType;
+} INTNETL3HASHENTRY;
+/** Pointer to a level-3 address hash entry. */
+typedef INTNETL3HASHENTRY *PINTNETL3HASHENTRY;
+
 /**
  * Destination table.
  */
@@ -209,6 +284,12 @@ typedef struct INTNETADDRCACHE
     uint8_t                 cbAddress;
     /** The size of an entry. */
     uint8_t                 cbEntry;
+    /** The hash chain links, one for each allocated entry.  This is allocated
+     * together with pbEntries. */
+    uint8_t                *pbHashNext;
+    /** The address hash, the index of the first entry in each chain.
+     * Rebuilt by intnetR0IfAddrCacheRehash whenever the entries change. */
+    uint8_t                 abHash[INTNET_ADDR_CACHE_HASH_SIZE];
 } INTNETADDRCACHE;
 /** Pointer to an address cache. */
 typedef INTNETADDRCACHE *PINTNETADDRCACHE;
@@ -216,6 +297,43 @@ typedef INTNETADDRCACHE *PINTNETADDRCACHE;
 typedef INTNETADDRCACHE const *PCINTNETADDRCACHE;
 
 
+/**
+ * QoS bandwidth group, the rate limits and token buckets shared by the
+ * interfaces in it.
+ *
+ * Named groups are kept in INTNET::pQoSGroups and shared by the interfaces of
+ * a session using the same name.  Unnamed groups belong to a single interface.
+ * The list, cRefs and the group membership of the interfaces are protected by
+ * INTNET::hMtxCreateOpenDestroy.  The limits and the token buckets are
+ * accessed atomically, as interfaces of a group send concurrently.
+ */
+typedef struct INTNETQOSGROUP
+{
+    /** The next group in the list. */
+    struct INTNETQOSGROUP  *pNext;
+    /** The session the group belongs to. */
+    PSUPDRVSESSION          pSession;
+    /** The number of interfaces in the group. */
+    uint32_t                cRefs;
+    /** The max number of frames per second the group may send, 0 if unlimited. */
+    uint32_t volatile       cMaxFramesPerSec;
+    /** The max number of bytes per second the group may send, 0 if unlimited. */
+    uint64_t volatile       cbMaxPerSec;
+    /** The byte token bucket, negative when overdrawn. */
+    int64_t volatile        cbTokens;
+    /** The frame token bucket in units of 1/RT_NS_1SEC frame, so that low frame
+     * rates don't lose the fractions between refills.  Negative when
+     * overdrawn. */
+    int64_t volatile        cFrameTokens;
+    /** When the token buckets were last refilled (RTTimeSystemNanoTS). */
+    uint64_t volatile       u64Refill;
+    /** The group name, empty if unnamed. */
+    char                    szName[INTNET_MAX_QOS_GROUP_NAME];
+} INTNETQOSGROUP;
+/** Pointer to a QoS bandwidth group. */
+typedef INTNETQOSGROUP *PINTNETQOSGROUP;
+
+
 /**
  * A network interface.
  *
@@ -270,8 +388,6 @@ typedef struct INTNETIF
     /** The network layer address cache. (Indexed by type, 0 entry isn't used.)
      * This is protected by the address spinlock of the network. */
     INTNETADDRCACHE         aAddrCache[kIntNetAddrType_End];
-    /** Spinlock protecting the input (producer) side of the receive ring. */
-    RTSPINLOCK              hRecvInSpinlock;
     /** Busy count for tracking destination table references and active sends.
      * Usually incremented while owning the switch table spinlock.  The 30th bit
      * is used to indicate wakeup. */
@@ -282,8 +398,29 @@ typedef struct INTNETIF
     PINTNETDSTTAB volatile  pDstTab;
     /** Pointer to the trunk's per interface data.  Can be NULL. */
     void                   *pvIfData;
-    /** Header buffer for when we're carving GSO frames. */
-    uint8_t                 abGsoHdrs[256];
+    /** Buffer for when we're carving GSO frames.  Holds whole segments when
+     * they fit, just the headers otherwise. */
+    uint8_t                 abGsoSeg[2048];
+    /** The number of entries in apDeferredWakeups. */
+    uint32_t                cDeferredWakeups;
+    /** Receivers of frames sent by this interface which haven't been woken up
+     * yet.  Each entry holds a busy reference to the interface.  Only used by
+     * IntNetR0IfSend, which isn't called concurrently for one interface. */
+    struct INTNETIF        *apDeferredWakeups[INTNET_MAX_DEFERRED_WAKEUPS];
+    /** QoS: The bandwidth group holding the rate limits of the interface, NULL
+     * if unlimited.  Changed by IntNetR0IfSetQoS while owning the destination
+     * table, so IntNetR0IfSend can use it without further ado. */
+    PINTNETQOSGROUP         pQoSGroup;
+    /** QoS: The priority class of the frames sent by this interface
+     * (INTNET_QOS_PRIORITY_XXX).  Changes are protected by the network address
+     * spinlock because of INTNETNETWORK::cQoSHighPriorityIfs. */
+    uint32_t volatile       uQoSPriority;
+    /** The size of the receive ring, as the copy in the buffer can be
+     * changed by ring-3. */
+    uint32_t                cbRecv;
+    /** When IntNetR0IfSend was last called for the interface
+     * (RTTimeSystemNanoTS).  Used for ageing the learned MAC address. */
+    uint64_t volatile       u64LastSend;
 } INTNETIF;
 /** Pointer to an internal network interface. */
 typedef INTNETIF *PINTNETIF;
@@ -369,6 +506,10 @@ typedef struct INTNETNETWORK
      * This is allocated after this structure if we're sharing the MAC address with
      * the host. The buffer is INTNETNETWORK_TMP_SIZE big and aligned on a 64-byte boundary. */
     uint8_t                *pbTmp;
+    /** The level-3 address hash, INTNET_L3HASH_SIZE entries.  Protected by
+     * hAddrSpinlock.  Only allocated (after pbTmp) if we're sharing the MAC
+     * address with the host. */
+    PINTNETL3HASHENTRY      paL3Hash;
     /** Network creation flags (INTNET_OPEN_FLAGS_*). */
     uint32_t                fFlags;
     /** Any restrictive policies required as a minimum by some interface.
@@ -376,6 +517,10 @@ typedef struct INTNETNETWORK
     uint32_t                fMinFlags;
     /** The number of active interfaces (excluding the trunk). */
     uint32_t                cActiveIFs;
+    /** The number of interfaces with the INTNET_QOS_PRIORITY_HIGH priority
+     * class.  While there are any, normal priority frames leave some room in
+     * the receive rings.  Protected by hAddrSpinlock. */
+    uint32_t volatile       cQoSHighPriorityIfs;
     /** The length of the network name. */
     uint8_t                 cchName;
     /** The network name. */
@@ -408,6 +553,9 @@ typedef struct INTNET
     PINTNETNETWORK volatile pNetworks;
     /** Handle table for the interfaces. */
     RTHANDLETABLE           hHtIfs;
+    /** List of named QoS bandwidth groups.
+     * Protected by INTNET::hMtxCreateOpenDestroy. */
+    PINTNETQOSGROUP         pQoSGroups;
 } INTNET;
 /** Pointer to an internal network ring-0 instance. */
 typedef struct INTNET *PINTNET;
@@ -822,6 +970,19 @@ DECL_FORCE_INLINE(bool) intnetR0IfHasMacAddr(PINTNETIF pIf)
 }
 
 
+/**
+ * Calculates the MAC address table hash bucket of a MAC address.
+ *
+ * @returns Bucket index.
+ * @param   pMacAddr        The MAC address.
+ */
+DECL_FORCE_INLINE(uint32_t) intnetR0MacTabHash(PCRTMAC pMacAddr)
+{
+    uint32_t u = pMacAddr->au16[0] ^ pMacAddr->au16[1] ^ pMacAddr->au16[2];
+    return (u ^ (u >> 8)) & (INTNET_MACTAB_HASH_SIZE - 1);
+}
+
+
 /**
  * Locates the MAC address table entry for the given interface.
  *
@@ -833,11 +994,21 @@ DECL_FORCE_INLINE(bool) intnetR0IfHasMacAddr(PINTNETIF pIf)
  */
 DECLINLINE(PINTNETMACTABENTRY) intnetR0NetworkFindMacAddrEntry(PINTNETNETWORK pNetwork, PINTNETIF pIf)
 {
-    uint32_t iIf = pNetwork->MacTab.cEntries;
+    PINTNETMACTAB pTab = &pNetwork->MacTab;
+    uint32_t      iIf  = pTab->aiHash[intnetR0MacTabHash(&pIf->MacAddr)];
+    while (iIf != INTNET_MACTAB_HASH_END)
+    {
+        if (pTab->paEntries[iIf].pIf == pIf)
+            return &pTab->paEntries[iIf];
+        iIf = pTab->paEntries[iIf].iHashNext;
+    }
+
+    /* The two address copies are out of sync while being updated. */
+    iIf = pTab->cEntries;
     while (iIf-- > 0)
     {
-        if (pNetwork->MacTab.paEntries[iIf].pIf == pIf)
-            return &pNetwork->MacTab.paEntries[iIf];
+        if (pTab->paEntries[iIf].pIf == pIf)
+            return &pTab->paEntries[iIf];
     }
     return NULL;
 }
@@ -921,9 +1092,29 @@ DECLINLINE(bool) intnetR0AddrUIsEqualEx(PCRTNETADDRU pAddr1, PCRTNETADDRU pAddr2
 
 
 /**
- * Worker for intnetR0IfAddrCacheLookup that performs the lookup
- * in the remaining cache entries after the caller has check the
- * most likely ones.
+ * Hashes a network layer address.
+ *
+ * @returns Hash value, the caller masks it to the table size.
+ * @param   pAddr           The address.
+ * @param   cbAddr          The address size.
+ */
+DECLINLINE(uint32_t) intnetR0AddrUHash(PCRTNETADDRU pAddr, uint8_t const cbAddr)
+{
+    uint32_t u = 0;
+    for (unsigned i = 0; i < cbAddr; i++)
+        u = u * 31 + pAddr->au8[i];
+    return u ^ (u >> 8) ^ (u >> 16);
+}
+
+
+/**
+ * Worker for intnetR0IfAddrCacheLookup and friends that performs the lookup
+ * in the remaining cache entries after the caller has check the most likely
+ * ones.
+ *
+ * This walks the hash chain of the address.  Since the cache is read without
+ * owning the spinlock in some places, the walk is bounded in case the chains
+ * are being rebuilt.
  *
  * @returns -1 if not found, the index of the cache entry if found.
  * @param   pCache      The cache.
@@ -932,19 +1123,41 @@ DECLINLINE(bool) intnetR0AddrUIsEqualEx(PCRTNETADDRU pAddr1, PCRTNETADDRU pAddr2
  */
 static int intnetR0IfAddrCacheLookupSlow(PCINTNETADDRCACHE pCache, PCRTNETADDRU pAddr, uint8_t const cbAddr)
 {
-    unsigned i = pCache->cEntries - 2;
-    uint8_t const *pbEntry = pCache->pbEntries + pCache->cbEntry * i;
-    while (i >= 1)
+    unsigned cLeft = pCache->cEntriesAlloc;
+    unsigned i     = pCache->abHash[intnetR0AddrUHash(pAddr, cbAddr) & (INTNET_ADDR_CACHE_HASH_SIZE - 1)];
+    while (   i < pCache->cEntries
+           && cLeft-- > 0)
     {
-        if (intnetR0AddrUIsEqualEx((PCRTNETADDRU)pbEntry, pAddr, cbAddr))
+        if (intnetR0AddrUIsEqualEx((PCRTNETADDRU)(pCache->pbEntries + pCache->cbEntry * i), pAddr, cbAddr))
             return i;
-        pbEntry -= pCache->cbEntry;
-        i--;
+        i = pCache->pbHashNext[i];
     }
 
     return -1;
 }
 
+
+/**
+ * Rebuilds the hash of an address cache after entries have been added or
+ * removed.
+ *
+ * The caller must own the network address spinlock.
+ *
+ * @param   pCache      The cache.
+ */
+static void intnetR0IfAddrCacheRehash(PINTNETADDRCACHE pCache)
+{
+    memset(&pCache->abHash[0], INTNET_ADDR_CACHE_HASH_END, sizeof(pCache->abHash));
+    unsigned i = pCache->cEntries;
+    while (i-- > 0)
+    {
+        uint32_t const iHash = intnetR0AddrUHash((PCRTNETADDRU)(pCache->pbEntries + pCache->cbEntry * i), pCache->cbAddress)
+                             & (INTNET_ADDR_CACHE_HASH_SIZE - 1);
+        pCache->pbHashNext[i] = pCache->abHash[iHash];
+        pCache->abHash[iHash] = (uint8_t)i;
+    }
+}
+
 /**
  * Lookup an address in a cache without any expectations.
  *
@@ -990,33 +1203,174 @@ DECLINLINE(int) intnetR0IfAddrCacheLookupLikely(PCINTNETADDRCACHE pCache, PCRTNE
 
 
 /**
- * Worker for intnetR0IfAddrCacheLookupUnlikely that performs
- * the lookup in the remaining cache entries after the caller
- * has check the most likely ones.
+ * Calculates the level-3 address hash slot of an address.
  *
- * The routine is expecting not to find the address.
+ * @returns Index into INTNETNETWORK::paL3Hash.
+ * @param   pAddr           The address.
+ * @param   cbAddr          The address size.
+ */
+DECLINLINE(uint32_t) intnetR0L3HashSlot(PCRTNETADDRU pAddr, uint8_t const cbAddr)
+{
+    return intnetR0AddrUHash(pAddr, cbAddr) & (INTNET_L3HASH_SIZE - 1);
+}
+
+
+/**
+ * Records which interface owns a level-3 address in the hash.
  *
- * @returns -1 if not found, the index of the cache entry if found.
- * @param   pCache      The cache.
- * @param   pAddr       The address.
- * @param   cbAddr      The address size (optimization).
+ * The caller must own the network address spinlock.
+ *
+ * @param   pNetwork        The network.
+ * @param   enmType         The address type.
+ * @param   pAddr           The address.
+ * @param   cbAddr          The address size.
+ * @param   iMacTab         The MAC table index of the owner, INTNET_L3HASH_NONE
+ *                          or INTNET_L3HASH_DUP.
  */
-static int intnetR0IfAddrCacheInCacheUnlikelySlow(PCINTNETADDRCACHE pCache, PCRTNETADDRU pAddr, uint8_t const cbAddr)
+static void intnetR0NetworkL3HashLearn(PINTNETNETWORK pNetwork, INTNETADDRTYPE enmType, PCRTNETADDRU pAddr,
+                                       uint8_t const cbAddr, uint32_t iMacTab)
 {
-    /*
-     * Perform a full table lookup.
-     */
-    unsigned i = pCache->cEntries - 2;
-    uint8_t const *pbEntry = pCache->pbEntries + pCache->cbEntry * i;
-    while (i >= 1)
-    {
-        if (RT_UNLIKELY(intnetR0AddrUIsEqualEx((PCRTNETADDRU)pbEntry, pAddr, cbAddr)))
-            return i;
-        pbEntry -= pCache->cbEntry;
-        i--;
+    PINTNETL3HASHENTRY pEntry = &pNetwork->paL3Hash[intnetR0L3HashSlot(pAddr, cbAddr)];
+    memcpy(&pEntry->Addr, pAddr, cbAddr);
+    pEntry->u64Learned = RTTimeSystemNanoTS();
+    pEntry->iMacTab    = (uint16_t)iMacTab;
+    pEntry->enmType    = (uint8_t)enmType;
+}
+
+
+/**
+ * Gets the level-3 hash entry of an address if it is in the hash.
+ *
+ * The caller must own the network address spinlock.
+ *
+ * @returns Pointer to the entry, NULL if the slot is unused or holds another
+ *          address.
+ * @param   pNetwork        The network.  Must have a level-3 hash.
+ * @param   enmType         The address type.
+ * @param   pAddr           The address.
+ * @param   cbAddr          The address size.
+ */
+DECLINLINE(PINTNETL3HASHENTRY) intnetR0NetworkL3HashGet(PINTNETNETWORK pNetwork, INTNETADDRTYPE enmType, PCRTNETADDRU pAddr,
+                                                        uint8_t const cbAddr)
+{
+    PINTNETL3HASHENTRY pEntry = &pNetwork->paL3Hash[intnetR0L3HashSlot(pAddr, cbAddr)];
+    if (   pEntry->iMacTab != INTNET_MACTAB_HASH_END
+        && pEntry->enmType == (uint8_t)enmType
+        && intnetR0AddrUIsEqualEx(&pEntry->Addr, pAddr, cbAddr))
+        return pEntry;
+    return NULL;
+}
+
+
+/**
+ * Updates the level-3 hash after an address was added to the cache of an
+ * interface.
+ *
+ * The caller must own the network address spinlock.
+ *
+ * @param   pNetwork        The network.  Must have a level-3 hash.
+ * @param   enmType         The address type.
+ * @param   pAddr           The address.
+ * @param   cbAddr          The address size.
+ * @param   iMacTab         The MAC table index of the interface,
+ *                          INTNET_MACTAB_HASH_END if not known.
+ */
+static void intnetR0NetworkL3HashAddOwner(PINTNETNETWORK pNetwork, INTNETADDRTYPE enmType, PCRTNETADDRU pAddr,
+                                          uint8_t const cbAddr, uint32_t iMacTab)
+{
+    PINTNETL3HASHENTRY pEntry = intnetR0NetworkL3HashGet(pNetwork, enmType, pAddr, cbAddr);
+    if (pEntry)
+    {
+        if (iMacTab == INTNET_MACTAB_HASH_END)
+            pEntry->iMacTab = INTNET_MACTAB_HASH_END;
+        else if (pEntry->iMacTab == INTNET_L3HASH_NONE)
+            intnetR0NetworkL3HashLearn(pNetwork, enmType, pAddr, cbAddr, iMacTab);
+        else if (pEntry->iMacTab != iMacTab)
+            pEntry->iMacTab = INTNET_L3HASH_DUP;
     }
+}
 
-    return -1;
+
+/**
+ * Updates the level-3 hash after an address was removed from the cache of an
+ * interface.
+ *
+ * The caller must own the network address spinlock.
+ *
+ * @param   pNetwork        The network.  Must have a level-3 hash.
+ * @param   enmType         The address type.
+ * @param   pAddr           The address.
+ * @param   cbAddr          The address size.
+ * @param   pIf             The interface.
+ */
+static void intnetR0NetworkL3HashDelOwner(PINTNETNETWORK pNetwork, INTNETADDRTYPE enmType, PCRTNETADDRU pAddr,
+                                          uint8_t const cbAddr, PINTNETIF pIf)
+{
+    PINTNETL3HASHENTRY pEntry = intnetR0NetworkL3HashGet(pNetwork, enmType, pAddr, cbAddr);
+    if (pEntry)
+    {
+        /* The remaining owners of a duplicate have to be counted again. */
+        if (pEntry->iMacTab == INTNET_L3HASH_DUP)
+            pEntry->iMacTab = INTNET_MACTAB_HASH_END;
+        else if (   pEntry->iMacTab < pNetwork->MacTab.cEntries
+                 && pNetwork->MacTab.paEntries[pEntry->iMacTab].pIf == pIf)
+            pEntry->iMacTab = INTNET_L3HASH_NONE;
+    }
+}
+
+
+/**
+ * Looks up the interface whose address cache holds the given level-3 address.
+ *
+ * The hash entries are kept up to date by intnetR0NetworkL3HashAddOwner and
+ * intnetR0NetworkL3HashDelOwner.  Still, an entry is only used while it is
+ * younger than INTNET_L3HASH_MAX_AGE_NS and an owner is verified against its
+ * address cache.  Otherwise all the address caches are searched, counting the
+ * owners, and the hash is updated with the result.
+ *
+ * The caller must own the network address spinlock.
+ *
+ * @returns MAC table index of the only interface having the address,
+ *          INTNET_L3HASH_NONE if none has it and INTNET_L3HASH_DUP if several
+ *          have it.
+ * @param   pNetwork        The network.  Must have a level-3 hash.
+ * @param   enmType         The address type.
+ * @param   pAddr           The address.
+ * @param   cbAddr          The address size.
+ */
+static uint32_t intnetR0NetworkL3HashLookup(PINTNETNETWORK pNetwork, INTNETADDRTYPE enmType, PCRTNETADDRU pAddr,
+                                            uint8_t const cbAddr)
+{
+    PINTNETMACTAB      pTab   = &pNetwork->MacTab;
+    PINTNETL3HASHENTRY pEntry = intnetR0NetworkL3HashGet(pNetwork, enmType, pAddr, cbAddr);
+    if (   pEntry
+        && RTTimeSystemNanoTS() - pEntry->u64Learned < INTNET_L3HASH_MAX_AGE_NS)
+    {
+        if (pEntry->iMacTab >= INTNET_L3HASH_DUP)
+            return pEntry->iMacTab;
+        Assert(pEntry->iMacTab < pTab->cEntries);
+        PINTNETIF pIf = pTab->paEntries[pEntry->iMacTab].pIf;
+        if (intnetR0IfAddrCacheLookupLikely(&pIf->aAddrCache[enmType], pAddr, cbAddr) >= 0)
+            return pEntry->iMacTab;
+    }
+
+    uint32_t iOwner = INTNET_L3HASH_NONE;
+    uint32_t iIfMac = pTab->cEntries;
+    while (iIfMac-- > 0)
+    {
+        PINTNETIF pIf = pTab->paEntries[iIfMac].pIf;
+        if (intnetR0IfAddrCacheLookup(&pIf->aAddrCache[enmType], pAddr, cbAddr) >= 0)
+        {
+            if (iOwner != INTNET_L3HASH_NONE)
+            {
+                iOwner = INTNET_L3HASH_DUP;
+                break;
+            }
+            iOwner = iIfMac;
+        }
+    }
+    intnetR0NetworkL3HashLearn(pNetwork, enmType, pAddr, cbAddr, iOwner);
+    return iOwner;
 }
 
 
@@ -1052,7 +1406,7 @@ DECLINLINE(int) intnetR0IfAddrCacheLookupUnlikely(PCINTNETADDRCACHE pCache, PCRT
     if (i <= 1)
         return -1;
 
-    return intnetR0IfAddrCacheInCacheUnlikelySlow(pCache, pAddr, cbAddr);
+    return intnetR0IfAddrCacheLookupSlow(pCache, pAddr, cbAddr);
 }
 
 
@@ -1061,7 +1415,9 @@ DECLINLINE(int) intnetR0IfAddrCacheLookupUnlikely(PCINTNETADDRCACHE pCache, PCRT
  *
  * Worker for intnetR0NetworkAddrCacheDelete and intnetR0NetworkAddrCacheDeleteMinusIf.
  *
- * @param   pIf             The interface (for logging).
+ * The caller must own the network address spinlock.
+ *
+ * @param   pIf             The interface.
  * @param   pCache          The cache.
  * @param   iEntry          The entry to delete.
  * @param   pszMsg          Log message.
@@ -1086,18 +1442,24 @@ static void intnetR0IfAddrCacheDeleteIt(PINTNETIF pIf, PINTNETADDRCACHE pCache,
     }
 #endif
 
+    PINTNETNETWORK pNetwork = pIf->pNetwork;
+    if (pNetwork && pNetwork->paL3Hash)
+        intnetR0NetworkL3HashDelOwner(pNetwork, (INTNETADDRTYPE)(uintptr_t)(pCache - &pIf->aAddrCache[0]),
+                                      (PCRTNETADDRU)(pCache->pbEntries + iEntry * pCache->cbEntry), pCache->cbAddress, pIf);
+
     pCache->cEntries--;
     if (iEntry < pCache->cEntries)
         memmove(pCache->pbEntries +      iEntry  * pCache->cbEntry,
                 pCache->pbEntries + (iEntry + 1) * pCache->cbEntry,
                 (pCache->cEntries - iEntry)      * pCache->cbEntry);
+    intnetR0IfAddrCacheRehash(pCache);
 }
 
 
 /**
  * Deletes an address from the cache, assuming it isn't actually in the cache.
  *
- * May or may not own the spinlock when calling this.
+ * The caller must own the network address spinlock.
  *
  * @param   pIf             The interface (for logging).
  * @param   pCache          The cache.
@@ -1130,13 +1492,25 @@ DECLINLINE(void) intnetR0NetworkAddrCacheDelete(PINTNETNETWORK pNetwork, PCRTNET
     RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
     RTSpinlockAcquireNoInts(pNetwork->hAddrSpinlock, &Tmp);
 
-    uint32_t iIf = pNetwork->MacTab.cEntries;
-    while (iIf--)
+    /* The level-3 hash knows if there is no more than one owner. */
+    uint32_t iIf = INTNET_L3HASH_DUP;
+    if (pNetwork->paL3Hash)
+        iIf = intnetR0NetworkL3HashLookup(pNetwork, enmType, pAddr, cbAddr);
+    if (iIf < INTNET_L3HASH_DUP)
     {
         PINTNETIF pIf = pNetwork->MacTab.paEntries[iIf].pIf;
-        int i = intnetR0IfAddrCacheLookup(&pIf->aAddrCache[enmType], pAddr, cbAddr);
-        if (RT_UNLIKELY(i >= 0))
-            intnetR0IfAddrCacheDeleteIt(pIf, &pIf->aAddrCache[enmType], i, pszMsg);
+        intnetR0IfAddrCacheDelete(pIf, &pIf->aAddrCache[enmType], pAddr, cbAddr, pszMsg);
+    }
+    else if (iIf == INTNET_L3HASH_DUP)
+    {
+        iIf = pNetwork->MacTab.cEntries;
+        while (iIf--)
+        {
+            PINTNETIF pIf = pNetwork->MacTab.paEntries[iIf].pIf;
+            int i = intnetR0IfAddrCacheLookup(&pIf->aAddrCache[enmType], pAddr, cbAddr);
+            if (RT_UNLIKELY(i >= 0))
+                intnetR0IfAddrCacheDeleteIt(pIf, &pIf->aAddrCache[enmType], i, pszMsg);
+        }
     }
 
     RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
@@ -1161,15 +1535,28 @@ DECLINLINE(void) intnetR0NetworkAddrCacheDeleteMinusIf(PINTNETNETWORK pNetwork,
     RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
     RTSpinlockAcquireNoInts(pNetwork->hAddrSpinlock, &Tmp);
 
-    uint32_t iIf = pNetwork->MacTab.cEntries;
-    while (iIf--)
+    /* The level-3 hash knows if there is no more than one owner. */
+    uint32_t iIf = INTNET_L3HASH_DUP;
+    if (pNetwork->paL3Hash)
+        iIf = intnetR0NetworkL3HashLookup(pNetwork, enmType, pAddr, cbAddr);
+    if (iIf < INTNET_L3HASH_DUP)
     {
         PINTNETIF pIf = pNetwork->MacTab.paEntries[iIf].pIf;
         if (pIf != pIfSender)
+            intnetR0IfAddrCacheDelete(pIf, &pIf->aAddrCache[enmType], pAddr, cbAddr, pszMsg);
+    }
+    else if (iIf == INTNET_L3HASH_DUP)
+    {
+        iIf = pNetwork->MacTab.cEntries;
+        while (iIf--)
         {
-            int i = intnetR0IfAddrCacheLookup(&pIf->aAddrCache[enmType], pAddr, cbAddr);
-            if (RT_UNLIKELY(i >= 0))
-                intnetR0IfAddrCacheDeleteIt(pIf, &pIf->aAddrCache[enmType], i, pszMsg);
+            PINTNETIF pIf = pNetwork->MacTab.paEntries[iIf].pIf;
+            if (pIf != pIfSender)
+            {
+                int i = intnetR0IfAddrCacheLookup(&pIf->aAddrCache[enmType], pAddr, cbAddr);
+                if (RT_UNLIKELY(i >= 0))
+                    intnetR0IfAddrCacheDeleteIt(pIf, &pIf->aAddrCache[enmType], i, pszMsg);
+            }
         }
     }
 
@@ -1193,6 +1580,24 @@ DECLINLINE(PINTNETIF) intnetR0NetworkAddrCacheLookupIf(PINTNETNETWORK pNetwork,
     RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
     RTSpinlockAcquireNoInts(pNetwork->hAddrSpinlock, &Tmp);
 
+    /* Only several owners require searching. */
+    if (pNetwork->paL3Hash)
+    {
+        uint32_t iIf = intnetR0NetworkL3HashLookup(pNetwork, enmType, pAddr, cbAddr);
+        if (iIf < INTNET_L3HASH_DUP)
+        {
+            PINTNETIF pIf = pNetwork->MacTab.paEntries[iIf].pIf;
+            intnetR0BusyIncIf(pIf);
+            RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
+            return pIf;
+        }
+        if (iIf == INTNET_L3HASH_NONE)
+        {
+            RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
+            return NULL;
+        }
+    }
+
     uint32_t iIf = pNetwork->MacTab.cEntries;
     while (iIf--)
     {
@@ -1236,11 +1641,21 @@ static void intnetR0IfAddrCacheAddIt(PINTNETIF pIf, PINTNETADDRCACHE pCache, PCR
         return;
     }
 
+    /* The caller looked without the spinlock, someone may have beaten us to it. */
+    if (RT_UNLIKELY(intnetR0IfAddrCacheLookup(pCache, pAddr, pCache->cbAddress) >= 0))
+    {
+        RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
+        return;
+    }
+
     /* When the table is full, drop the older entry (FIFO). Do proper ageing? */
+    INTNETADDRTYPE const enmAddrType = (INTNETADDRTYPE)(uintptr_t)(pCache - &pIf->aAddrCache[0]);
     if (pCache->cEntries >= pCache->cEntriesAlloc)
     {
         Log(("intnetR0IfAddrCacheAddIt: type=%d replacing %.*Rhxs\n",
-             (int)(uintptr_t)(pCache - &pIf->aAddrCache[0]), pCache->cbAddress, pCache->pbEntries));
+             (int)enmAddrType, pCache->cbAddress, pCache->pbEntries));
+        if (pNetwork->paL3Hash)
+            intnetR0NetworkL3HashDelOwner(pNetwork, enmAddrType, (PCRTNETADDRU)pCache->pbEntries, pCache->cbAddress, pIf);
         memmove(pCache->pbEntries, pCache->pbEntries + pCache->cbEntry, pCache->cbEntry * (pCache->cEntries - 1));
         pCache->cEntries--;
         Assert(pCache->cEntries < pCache->cEntriesAlloc);
@@ -1253,7 +1668,6 @@ static void intnetR0IfAddrCacheAddIt(PINTNETIF pIf, PINTNETADDRCACHE pCache, PCR
     memcpy(pbEntry, pAddr, pCache->cbAddress);
     memset(pbEntry + pCache->cbAddress, '\0', pCache->cbEntry - pCache->cbAddress);
 #ifdef LOG_ENABLED
-    INTNETADDRTYPE enmAddrType = (INTNETADDRTYPE)(uintptr_t)(pCache - &pIf->aAddrCache[0]);
     switch (enmAddrType)
     {
         case kIntNetAddrType_IPv4:
@@ -1268,6 +1682,15 @@ static void intnetR0IfAddrCacheAddIt(PINTNETIF pIf, PINTNETADDRCACHE pCache, PCR
 #endif
     pCache->cEntries++;
     Assert(pCache->cEntries <= pCache->cEntriesAlloc);
+    intnetR0IfAddrCacheRehash(pCache);
+
+    /* Tell the level-3 hash about the new owner. */
+    if (pNetwork->paL3Hash)
+    {
+        PINTNETMACTABENTRY pEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIf);
+        intnetR0NetworkL3HashAddOwner(pNetwork, enmAddrType, pAddr, pCache->cbAddress,
+                                      pEntry ? (uint32_t)(pEntry - &pNetwork->MacTab.paEntries[0]) : INTNET_MACTAB_HASH_END);
+    }
 
     RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
 }
@@ -1285,18 +1708,10 @@ static void intnetR0IfAddrCacheAddIt(PINTNETIF pIf, PINTNETADDRCACHE pCache, PCR
 static void intnetR0IfAddrCacheAddSlow(PINTNETIF pIf, PINTNETADDRCACHE pCache, PCRTNETADDRU pAddr, uint8_t const cbAddr, const char *pszMsg)
 {
     /*
-     * Check all but the first and last entries, the caller
-     * has already checked those.
+     * Check the hash, the caller has only looked at the first and last entries.
      */
-    int i = pCache->cEntries - 2;
-    uint8_t const *pbEntry = pCache->pbEntries + pCache->cbEntry;
-    while (i >= 1)
-    {
-        if (RT_LIKELY(intnetR0AddrUIsEqualEx((PCRTNETADDRU)pbEntry, pAddr, cbAddr)))
-            return;
-        pbEntry += pCache->cbEntry;
-        i--;
-    }
+    if (RT_LIKELY(intnetR0IfAddrCacheLookupSlow(pCache, pAddr, cbAddr) >= 0))
+        return;
 
     /*
      * Not found, add it.
@@ -1342,6 +1757,7 @@ static void intnetR0IfAddrCacheDestroy(PINTNETADDRCACHE pCache)
 {
     void *pvFree = pCache->pbEntries;
     pCache->pbEntries     = NULL;
+    pCache->pbHashNext    = NULL;
     pCache->cEntries      = 0;
     pCache->cEntriesAlloc = 0;
     RTMemFree(pvFree);
@@ -1364,17 +1780,21 @@ static int intnetR0IfAddrCacheInit(PINTNETADDRCACHE pCache, INTNETADDRTYPE enmAd
     pCache->cEntries  = 0;
     pCache->cbAddress = intnetR0AddrSize(enmAddrType);
     pCache->cbEntry   = RT_ALIGN(pCache->cbAddress, 4);
+    memset(&pCache->abHash[0], INTNET_ADDR_CACHE_HASH_END, sizeof(pCache->abHash));
     if (fEnabled)
     {
         pCache->cEntriesAlloc = 32;
-        pCache->pbEntries     = (uint8_t *)RTMemAllocZ(pCache->cEntriesAlloc * pCache->cbEntry);
+        AssertCompile(32 < INTNET_ADDR_CACHE_HASH_END);
+        pCache->pbEntries     = (uint8_t *)RTMemAllocZ(pCache->cEntriesAlloc * (pCache->cbEntry + 1));
         if (!pCache->pbEntries)
             return VERR_NO_MEMORY;
+        pCache->pbHashNext    = pCache->pbEntries + pCache->cEntriesAlloc * pCache->cbEntry;
     }
     else
     {
         pCache->cEntriesAlloc = 0;
         pCache->pbEntries     = NULL;
+        pCache->pbHashNext    = NULL;
     }
     return VINF_SUCCESS;
 }
@@ -1424,6 +1844,160 @@ DECL_FORCE_INLINE(bool) intnetR0AreMacAddrsEqual(PCRTMAC pDstAddr1, PCRTMAC pDst
 }
 
 
+/**
+ * Rebuilds the MAC address hash of the network and recounts the active entries
+ * with dummy addresses.
+ *
+ * This must be called after removing entries.  Since that shifts the entries,
+ * the level-3 hash is invalidated as well.
+ *
+ * The caller must own the network address spinlock (or have exclusive access
+ * to the network).
+ *
+ * @param   pNetwork            The network.
+ */
+static void intnetR0NetworkMacTabRehash(PINTNETNETWORK pNetwork)
+{
+    PINTNETMACTAB pTab = &pNetwork->MacTab;
+    for (unsigned i = 0; i < RT_ELEMENTS(pTab->aiHash); i++)
+        pTab->aiHash[i] = INTNET_MACTAB_HASH_END;
+
+    uint32_t cActiveDummyEntries = 0;
+    uint32_t iIfMac              = pTab->cEntries;
+    Assert(iIfMac < INTNET_L3HASH_DUP);
+    while (iIfMac-- > 0)
+    {
+        PINTNETMACTABENTRY pEntry = &pTab->paEntries[iIfMac];
+        uint32_t const     iHash  = intnetR0MacTabHash(&pEntry->MacAddr);
+        pEntry->iHashNext   = pTab->aiHash[iHash];
+        pTab->aiHash[iHash] = (uint16_t)iIfMac;
+        if (pEntry->fActive && intnetR0IsMacAddrDummy(&pEntry->MacAddr))
+            cActiveDummyEntries++;
+    }
+    pTab->cActiveDummyEntries = cActiveDummyEntries;
+
+    if (pNetwork->paL3Hash)
+        for (unsigned i = 0; i < INTNET_L3HASH_SIZE; i++)
+            pNetwork->paL3Hash[i].iMacTab = INTNET_MACTAB_HASH_END;
+}
+
+
+/**
+ * Removes a MAC table entry from its hash chain before its MAC address or
+ * activation state is changed.
+ *
+ * The caller must own the network address spinlock.
+ *
+ * @param   pTab                The MAC address table.
+ * @param   iEntry              The entry index.
+ */
+static void intnetR0MacTabUnlinkEntry(PINTNETMACTAB pTab, uint32_t iEntry)
+{
+    PINTNETMACTABENTRY pEntry = &pTab->paEntries[iEntry];
+    uint16_t          *piCur  = &pTab->aiHash[intnetR0MacTabHash(&pEntry->MacAddr)];
+    while (*piCur != INTNET_MACTAB_HASH_END)
+    {
+        if (*piCur == iEntry)
+        {
+            *piCur = pEntry->iHashNext;
+            break;
+        }
+        piCur = &pTab->paEntries[*piCur].iHashNext;
+    }
+    pEntry->iHashNext = INTNET_MACTAB_HASH_END;
+
+    if (pEntry->fActive && intnetR0IsMacAddrDummy(&pEntry->MacAddr))
+        pTab->cActiveDummyEntries--;
+}
+
+
+/**
+ * Adds a MAC table entry to the hash chain of its MAC address.
+ *
+ * The caller must own the network address spinlock (or have exclusive access
+ * to the network).
+ *
+ * @param   pTab                The MAC address table.
+ * @param   iEntry              The entry index.
+ */
+static void intnetR0MacTabLinkEntry(PINTNETMACTAB pTab, uint32_t iEntry)
+{
+    Assert(iEntry < INTNET_L3HASH_DUP);
+    PINTNETMACTABENTRY pEntry = &pTab->paEntries[iEntry];
+    uint32_t const     iHash  = intnetR0MacTabHash(&pEntry->MacAddr);
+    pEntry->iHashNext   = pTab->aiHash[iHash];
+    pTab->aiHash[iHash] = (uint16_t)iEntry;
+
+    if (pEntry->fActive && intnetR0IsMacAddrDummy(&pEntry->MacAddr))
+        pTab->cActiveDummyEntries++;
+}
+
+
+/**
+ * Ages out other users of a MAC address an interface has just learned.
+ *
+ * Interfaces that learned the address from the frames they sent forget it
+ * again when they have not sent anything for INTNET_MACTAB_MAX_AGE_NS, so
+ * that the address only leads to the new user.  This is typically a guest
+ * moving its address to another VM.  Addresses set explicitly don't age and
+ * a quiet interface keeps its address until someone else claims it, as
+ * unicast traffic for it would otherwise only go to the trunk.
+ *
+ * The caller must own the network address spinlock.
+ *
+ * @param   pNetwork            The network.
+ * @param   pIfNew              The interface that learned the address.
+ * @param   pMacAddr            The MAC address.
+ */
+static void intnetR0NetworkMacTabAgeAddr(PINTNETNETWORK pNetwork, PINTNETIF pIfNew, PCRTMAC pMacAddr)
+{
+    PINTNETMACTAB  pTab   = &pNetwork->MacTab;
+    uint64_t const u64Now = RTTimeSystemNanoTS();
+    uint32_t       iIfMac = pTab->aiHash[intnetR0MacTabHash(pMacAddr)];
+    while (iIfMac != INTNET_MACTAB_HASH_END)
+    {
+        PINTNETMACTABENTRY pEntry = &pTab->paEntries[iIfMac];
+        uint32_t const     iNext  = pEntry->iHashNext;
+        PINTNETIF          pIf    = pEntry->pIf;
+        if (   pIf != pIfNew
+            && !pIf->fMacSet
+            && intnetR0AreMacAddrsEqual(&pEntry->MacAddr, pMacAddr)
+            && u64Now - ASMAtomicReadU64(&pIf->u64LastSend) >= INTNET_MACTAB_MAX_AGE_NS)
+        {
+            Log(("intnetR0NetworkMacTabAgeAddr: hIf=%#x forgets %.6Rhxs to hIf=%#x\n", pIf->hIf, pMacAddr, pIfNew->hIf));
+            intnetR0MacTabUnlinkEntry(pTab, iIfMac);
+            memset(&pEntry->MacAddr, 0xff, sizeof(pEntry->MacAddr)); /* broadcast = unknown */
+            pIf->MacAddr = pEntry->MacAddr;
+            intnetR0MacTabLinkEntry(pTab, iIfMac);
+        }
+        iIfMac = iNext;
+    }
+}
+
+
+/**
+ * Checks whether an active interface has the given MAC address, using the hash.
+ *
+ * The caller must own the network address spinlock.
+ *
+ * @returns true if found, false if not.
+ * @param   pTab                The MAC address table.
+ * @param   pMacAddr            The MAC address.
+ */
+DECLINLINE(bool) intnetR0MacTabHasActiveAddr(PINTNETMACTAB pTab, PCRTMAC pMacAddr)
+{
+    uint32_t iIfMac = pTab->aiHash[intnetR0MacTabHash(pMacAddr)];
+    while (iIfMac != INTNET_MACTAB_HASH_END)
+    {
+        if (   pTab->paEntries[iIfMac].fActive
+            && intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pMacAddr))
+            return true;
+        iIfMac = pTab->paEntries[iIfMac].iHashNext;
+    }
+    return false;
+}
+
+
 /**
  * Switch a unicast frame based on the network layer address (OSI level 3) and
  * return a destination table.
@@ -1455,23 +2029,50 @@ static INTNETSWDECISION intnetR0NetworkSwitchLevel3(PINTNETNETWORK pNetwork, PCR
     pDstTab->pTrunk     = 0;
     pDstTab->cIfs       = 0;
 
-    /* Find exactly matching or promiscuous interfaces. */
+    /* Find exactly matching or promiscuous interfaces.  Without promiscuous
+       interfaces only the owners of the address are wanted.  The level-3 hash
+       knows whether there is a single or no owner, several owners or an
+       inactive one need the full search. */
     uint32_t cExactHits = 0;
-    uint32_t iIfMac     = pTab->cEntries;
-    while (iIfMac-- > 0)
+    uint32_t iIfMac;
+    bool     fSearch    = true;
+    if (   pNetwork->paL3Hash
+        && !pTab->cPromiscuousEntries)
+    {
+        iIfMac = intnetR0NetworkL3HashLookup(pNetwork, enmL3AddrType, pL3Addr, cbL3Addr);
+        if (iIfMac == INTNET_L3HASH_NONE)
+            fSearch = false;
+        else if (   iIfMac != INTNET_L3HASH_DUP
+                 && pTab->paEntries[iIfMac].fActive)
+        {
+            PINTNETIF pIf = pTab->paEntries[iIfMac].pIf;            AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
+            cExactHits++;
+
+            uint32_t iIfDst = pDstTab->cIfs++;
+            pDstTab->aIfs[iIfDst].pIf            = pIf;
+            pDstTab->aIfs[iIfDst].fReplaceDstMac = true;
+            intnetR0BusyIncIf(pIf);
+            fSearch = false;
+        }
+    }
+    if (fSearch)
     {
-        if (pTab->paEntries[iIfMac].fActive)
+        iIfMac = pTab->cEntries;
+        while (iIfMac-- > 0)
         {
-            PINTNETIF pIf    = pTab->paEntries[iIfMac].pIf;         AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
-            bool      fExact = intnetR0IfAddrCacheLookup(&pIf->aAddrCache[enmL3AddrType], pL3Addr, cbL3Addr) >= 0;
-            if (fExact || pTab->paEntries[iIfMac].fPromiscuousSeeTrunk)
+            if (pTab->paEntries[iIfMac].fActive)
             {
-                cExactHits += fExact;
+                PINTNETIF pIf    = pTab->paEntries[iIfMac].pIf;     AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
+                bool      fExact = intnetR0IfAddrCacheLookup(&pIf->aAddrCache[enmL3AddrType], pL3Addr, cbL3Addr) >= 0;
+                if (fExact || pTab->paEntries[iIfMac].fPromiscuousSeeTrunk)
+                {
+                    cExactHits += fExact;
 
-                uint32_t iIfDst = pDstTab->cIfs++;
-                pDstTab->aIfs[iIfDst].pIf            = pIf;
-                pDstTab->aIfs[iIfDst].fReplaceDstMac = fExact;
-                intnetR0BusyIncIf(pIf);
+                    uint32_t iIfDst = pDstTab->cIfs++;
+                    pDstTab->aIfs[iIfDst].pIf            = pIf;
+                    pDstTab->aIfs[iIfDst].fReplaceDstMac = fExact;
+                    intnetR0BusyIncIf(pIf);
+                }
             }
         }
     }
@@ -1555,6 +2156,22 @@ static INTNETSWDECISION intnetR0NetworkPreSwitchUnicast(PINTNETNETWORK pNetwork,
     RTSPINLOCKTMP       Tmp             = RTSPINLOCKTMP_INITIALIZER;
     RTSpinlockAcquireNoInts(pNetwork->hAddrSpinlock, &Tmp);
 
+    /* Without promiscuous interfaces or interfaces with unknown addresses,
+       only exact matches count and the hash will do. */
+    if (   !pTab->cPromiscuousEntries
+        && !pTab->cActiveDummyEntries)
+    {
+        /* Paranoia - the source shouldn't be one of ours. */
+        if (   (   !pSrcAddr
+                || !intnetR0MacTabHasActiveAddr(pTab, pSrcAddr))
+            && intnetR0MacTabHasActiveAddr(pTab, pDstAddr))
+            enmSwDecision = pTab->fHostPromiscuousEff && fSrc == INTNETTRUNKDIR_WIRE
+                          ? INTNETSWDECISION_BROADCAST
+                          : INTNETSWDECISION_INTNET;
+        RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
+        return enmSwDecision;
+    }
+
     /* Iterate the internal network interfaces and look for matching source and
        destination addresses. */
     uint32_t cExactHits = 0;
@@ -1621,21 +2238,21 @@ static INTNETSWDECISION intnetR0NetworkSwitchUnicast(PINTNETNETWORK pNetwork, ui
     pDstTab->pTrunk     = 0;
     pDstTab->cIfs       = 0;
 
-    /* Find exactly matching or promiscuous interfaces. */
+    /* Find exactly matching or promiscuous interfaces.  Without promiscuous
+       interfaces or interfaces with unknown addresses, only exact matches count
+       and we can go straight to the right hash chain. */
     uint32_t cExactHits = 0;
-    uint32_t iIfMac     = pTab->cEntries;
-    while (iIfMac-- > 0)
+    uint32_t iIfMac;
+    if (   !pTab->cPromiscuousEntries
+        && !pTab->cActiveDummyEntries)
     {
-        if (pTab->paEntries[iIfMac].fActive)
+        iIfMac = pTab->aiHash[intnetR0MacTabHash(pDstAddr)];
+        while (iIfMac != INTNET_MACTAB_HASH_END)
         {
-            bool fExact = intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr);
-            if (   fExact
-                || intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr)
-                || (   pTab->paEntries[iIfMac].fPromiscuousSeeTrunk
-                    || (!fSrc && pTab->paEntries[iIfMac].fPromiscuousEff) )
-               )
+            if (   pTab->paEntries[iIfMac].fActive
+                && intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr))
             {
-                cExactHits += fExact;
+                cExactHits++;
 
                 PINTNETIF pIf = pTab->paEntries[iIfMac].pIf;        AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
                 if (RT_LIKELY(pIf != pIfSender)) /* paranoia */
@@ -1646,6 +2263,35 @@ static INTNETSWDECISION intnetR0NetworkSwitchUnicast(PINTNETNETWORK pNetwork, ui
                     intnetR0BusyIncIf(pIf);
                 }
             }
+            iIfMac = pTab->paEntries[iIfMac].iHashNext;
+        }
+    }
+    else
+    {
+        iIfMac = pTab->cEntries;
+        while (iIfMac-- > 0)
+        {
+            if (pTab->paEntries[iIfMac].fActive)
+            {
+                bool fExact = intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr);
+                if (   fExact
+                    || intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr)
+                    || (   pTab->paEntries[iIfMac].fPromiscuousSeeTrunk
+                        || (!fSrc && pTab->paEntries[iIfMac].fPromiscuousEff) )
+                   )
+                {
+                    cExactHits += fExact;
+
+                    PINTNETIF pIf = pTab->paEntries[iIfMac].pIf;    AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
+                    if (RT_LIKELY(pIf != pIfSender)) /* paranoia */
+                    {
+                        uint32_t iIfDst = pDstTab->cIfs++;
+                        pDstTab->aIfs[iIfDst].pIf            = pIf;
+                        pDstTab->aIfs[iIfDst].fReplaceDstMac = false;
+                        intnetR0BusyIncIf(pIf);
+                    }
+                }
+            }
         }
     }
 
@@ -2096,8 +2742,8 @@ static void intnetR0NetworkSnoopDhcp(PINTNETNETWORK pNetwork, PCRTNETIPV4 pIpHdr
                 RTSPINLOCKTMP   Tmp         = RTSPINLOCKTMP_INITIALIZER;
                 RTSpinlockAcquireNoInts(pNetwork->hAddrSpinlock, &Tmp);
 
-                uint32_t iIf = pNetwork->MacTab.cEntries;
-                while (iIf-- > 0)
+                uint32_t iIf = pNetwork->MacTab.aiHash[intnetR0MacTabHash(&pDhcp->bp_chaddr.Mac)];
+                while (iIf != INTNET_MACTAB_HASH_END)
                 {
                     PINTNETIF pCur = pNetwork->MacTab.paEntries[iIf].pIf;
                     if (    intnetR0IfHasMacAddr(pCur)
@@ -2111,6 +2757,7 @@ static void intnetR0NetworkSnoopDhcp(PINTNETNETWORK pNetwork, PCRTNETIPV4 pIpHdr
                             intnetR0BusyIncIf(pMatchingIf);
                         }
                     }
+                    iIf = pNetwork->MacTab.paEntries[iIf].iHashNext;
                 }
 
                 RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
@@ -2133,8 +2780,8 @@ static void intnetR0NetworkSnoopDhcp(PINTNETNETWORK pNetwork, PCRTNETIPV4 pIpHdr
             RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
             RTSpinlockAcquireNoInts(pNetwork->hAddrSpinlock, &Tmp);
 
-            uint32_t iIf = pNetwork->MacTab.cEntries;
-            while (iIf-- > 0)
+            uint32_t iIf = pNetwork->MacTab.aiHash[intnetR0MacTabHash(&pDhcp->bp_chaddr.Mac)];
+            while (iIf != INTNET_MACTAB_HASH_END)
             {
                 PINTNETIF pCur = pNetwork->MacTab.paEntries[iIf].pIf;
                 if (    intnetR0IfHasMacAddr(pCur)
@@ -2145,6 +2792,7 @@ static void intnetR0NetworkSnoopDhcp(PINTNETNETWORK pNetwork, PCRTNETIPV4 pIpHdr
                     intnetR0IfAddrCacheDelete(pCur, &pCur->aAddrCache[kIntNetAddrType_IPv4],
                                               (PCRTNETADDRU)&pDhcp->bp_yiaddr, sizeof(RTNETADDRIPV4), "DHCP_MT_RELEASE");
                 }
+                iIf = pNetwork->MacTab.paEntries[iIf].iHashNext;
             }
 
             RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
@@ -2478,8 +3126,14 @@ static void intnetR0IfSnoopArpAddr(PINTNETIF pIf, PCRTNETARPIPV4 pArpIPv4, uint3
              || pArpIPv4->ar_tha.au16[1]
              || pArpIPv4->ar_tha.au16[2])
         &&  intnetR0IPv4AddrIsGood(pArpIPv4->ar_tpa))
+    {
+        PINTNETNETWORK  pNetwork = pIf->pNetwork;
+        RTSPINLOCKTMP   Tmp      = RTSPINLOCKTMP_INITIALIZER;
+        RTSpinlockAcquireNoInts(pNetwork->hAddrSpinlock, &Tmp);
         intnetR0IfAddrCacheDelete(pIf, &pIf->aAddrCache[kIntNetAddrType_IPv4],
                                   (PCRTNETADDRU)&pArpIPv4->ar_tpa, sizeof(RTNETADDRIPV4), "if/arp");
+        RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
+    }
 
     if (    !memcmp(&pArpIPv4->ar_sha, &pIf->MacAddr, sizeof(RTMAC))
         &&  intnetR0IPv4AddrIsGood(pArpIPv4->ar_spa))
@@ -2539,9 +3193,16 @@ static void intnetR0IfSnoopAddr(PINTNETIF pIf, uint8_t const *pbFrame, uint32_t
 /**
  * Writes a frame packet to the ring buffer.
  *
+ * Any number of producers may write to the same ring at the same time without
+ * a lock.  The space is reserved by the compare-and-exchange on offWriteInt in
+ * the allocator, the frames are copied in parallel, and each producer commits
+ * right after the one which reserved before it.  Interrupts are disabled from
+ * the reservation to the commit.  This keeps the wait for the producers ahead
+ * short, and keeps a trunk receive interrupting a producer on its own CPU from
+ * waiting for it forever.
+ *
  * @returns VBox status code.
- * @param   pBuf            The buffer.
- * @param   pRingBuf        The ring buffer to read from.
+ * @param   pRingBuf        The ring buffer to write to.
  * @param   pSG             The gather list.
  * @param   pNewDstMac      Set the destination MAC address to the address if specified.
  */
@@ -2550,45 +3211,175 @@ static int intnetR0RingWriteFrame(PINTNETRINGBUF pRingBuf, PCINTNETSG pSG, PCRTM
     PINTNETHDR  pHdr  = NULL; /* shut up gcc*/
     void       *pvDst = NULL; /* ditto */
     int         rc;
-    if (pSG->GsoCtx.u8Type == PDMNETWORKGSOTYPE_INVALID)
-        rc = IntNetRingAllocateFrame(pRingBuf, pSG->cbTotal, &pHdr, &pvDst);
-    else
-        rc = IntNetRingAllocateGsoFrame(pRingBuf, pSG->cbTotal, &pSG->GsoCtx, &pHdr, &pvDst);
+    RTCCUINTREG const fSavedFlags = ASMIntDisableFlags();
+    do
+    {
+        if (pSG->GsoCtx.u8Type == PDMNETWORKGSOTYPE_INVALID)
+            rc = IntNetRingAllocateFrame(pRingBuf, pSG->cbTotal, &pHdr, &pvDst);
+        else
+            rc = IntNetRingAllocateGsoFrame(pRingBuf, pSG->cbTotal, &pSG->GsoCtx, &pHdr, &pvDst);
+    } while (rc == VERR_WRONG_ORDER); /* another producer reserved first, retry */
     if (RT_SUCCESS(rc))
     {
         IntNetSgRead(pSG, pvDst);
         if (pNewDstMac)
             ((PRTNETETHERHDR)pvDst)->DstMac = *pNewDstMac;
 
+        /* Commit in reservation order. */
+        uint32_t const offHdr = (uint32_t)((uintptr_t)pHdr - (uintptr_t)pRingBuf);
+        while (ASMAtomicReadU32(&pRingBuf->offWriteCom) != offHdr)
+            ASMNopPause();
         IntNetRingCommitFrame(pRingBuf, pHdr);
-        return VINF_SUCCESS;
     }
+    ASMSetFlags(fSavedFlags);
     return rc;
 }
 
 
+/**
+ * Wakes up the consumer of the receive ring of an interface if it is waiting
+ * for the frames just committed.
+ *
+ * The consumer publishes the read offset it saw the ring empty at in
+ * INTNETBUF::offRecvEvent before it sleeps (IntNetR0IfWait).  Once the
+ * committed frames have moved offWriteCom away from it, the first producer to
+ * notice claims the wakeup by resetting the index and signals.  Everyone else
+ * leaves the consumer alone.  The index lives in the shared buffer, so a
+ * consumer messing with it only hurts itself.
+ *
+ * @param   pIf             The interface.
+ */
+DECLINLINE(void) intnetR0IfWakeUpRecv(PINTNETIF pIf)
+{
+    /* The commit wrote offWriteCom with a fully ordered write and the
+       consumer does the same with the index before checking the ring. */
+    PINTNETBUF     pIntBuf  = pIf->pIntBuf;
+    uint32_t const offEvent = ASMAtomicReadU32(&pIntBuf->offRecvEvent);
+    if (   offEvent != INTNETBUF_RECV_EVENT_NONE
+        && offEvent != ASMAtomicReadU32(&pIntBuf->Recv.offWriteCom)
+        && ASMAtomicCmpXchgU32(&pIntBuf->offRecvEvent, INTNETBUF_RECV_EVENT_NONE, offEvent))
+    {
+        STAM_REL_COUNTER_INC(&pIntBuf->cStatRecvWakeups);
+        RTSemEventSignal(pIf->hRecvEvent);
+    }
+    else
+        STAM_REL_COUNTER_INC(&pIntBuf->cStatRecvWakeupsSaved);
+}
+
+
+/**
+ * Defers waking up the receiver of a frame until the sender has pushed all its
+ * frames thru the switch.
+ *
+ * @returns true if deferred, in which case the busy reference to @a pIf has
+ *          been taken over. false if the table is full and the caller must do
+ *          the wakeup.
+ * @param   pIfSender       The interface sending the frame.
+ * @param   pIf             The receiving interface, busy referenced.
+ */
+static bool intnetR0IfDeferWakeUp(PINTNETIF pIfSender, PINTNETIF pIf)
+{
+    uint32_t i = pIfSender->cDeferredWakeups;
+    while (i-- > 0)
+        if (pIfSender->apDeferredWakeups[i] == pIf)
+        {
+            /* The table entry already holds a reference. */
+            intnetR0BusyDecIf(pIf);
+            return true;
+        }
+
+    i = pIfSender->cDeferredWakeups;
+    if (i >= RT_ELEMENTS(pIfSender->apDeferredWakeups))
+        return false;
+    pIfSender->apDeferredWakeups[i] = pIf;
+    pIfSender->cDeferredWakeups = i + 1;
+    return true;
+}
+
+
+/**
+ * Does the wakeups deferred by intnetR0IfDeferWakeUp.
+ *
+ * @param   pIfSender       The interface which sent the frames.
+ */
+static void intnetR0IfFlushDeferredWakeUps(PINTNETIF pIfSender)
+{
+    uint32_t const cDeferredWakeups = pIfSender->cDeferredWakeups;
+    for (uint32_t i = 0; i < cDeferredWakeups; i++)
+    {
+        PINTNETIF pIf = pIfSender->apDeferredWakeups[i];
+        pIfSender->apDeferredWakeups[i] = NULL;
+        intnetR0IfWakeUpRecv(pIf);
+        intnetR0BusyDecIf(pIf);
+    }
+    pIfSender->cDeferredWakeups = 0;
+}
+
+
+/**
+ * Checks whether the receive ring of an interface has room for a frame of the
+ * priority class of the sender.
+ *
+ * Low priority frames may only use the first half of the ring.  Normal
+ * priority frames may use all but the last 1/8 while there are high priority
+ * interfaces on the network, and the whole ring otherwise.  The frame itself
+ * must fit in front of the reserved part.
+ *
+ * @returns true if there is room, false if the frame should be dropped.
+ * @param   pIf             The receiving interface.
+ * @param   pIfSender       The sending interface.
+ * @param   pSG             The frame.
+ */
+DECLINLINE(bool) intnetR0IfQoSHasRoom(PINTNETIF pIf, PINTNETIF pIfSender, PCINTNETSG pSG)
+{
+    uint32_t cbReserved;
+    if (pIfSender->uQoSPriority == INTNET_QOS_PRIORITY_LOW)
+        cbReserved = pIf->cbRecv / 2;
+    else if (pIfSender->pNetwork && pIfSender->pNetwork->cQoSHighPriorityIfs)
+        cbReserved = pIf->cbRecv / 8;
+    else
+        return true;
+
+    uint32_t cbFrame = sizeof(INTNETHDR) + pSG->cbTotal;
+    if (pSG->GsoCtx.u8Type != PDMNETWORKGSOTYPE_INVALID)
+        cbFrame += sizeof(PDMNETWORKGSO);
+    cbFrame = RT_ALIGN_32(cbFrame, INTNETHDR_ALIGNMENT);
+    return IntNetRingGetWritable(&pIf->pIntBuf->Recv) >= cbReserved + cbFrame;
+}
+
+
 /**
  * Sends a frame to a specific interface.
  *
+ * @returns true if the frame was queued and the receiver should be woken up
+ *          (intnetR0IfWakeUpRecv), false if it was lost.
  * @param   pIf             The interface.
  * @param   pIfSender       The interface sending the frame. This is NULL if it's the trunk.
  * @param   pSG             The gather buffer which data is being sent to the interface.
  * @param   pNewDstMac      Set the destination MAC address to the address if specified.
  */
-static void intnetR0IfSend(PINTNETIF pIf, PINTNETIF pIfSender, PINTNETSG pSG, PCRTMAC pNewDstMac)
+static bool intnetR0IfSend(PINTNETIF pIf, PINTNETIF pIfSender, PINTNETSG pSG, PCRTMAC pNewDstMac)
 {
     /*
-     * Grab the receive/producer lock and copy over the frame.
+     * Lower priority frames must leave some room in the receive ring for
+     * higher priority ones.
+     */
+    if (    pIfSender
+        &&  pIfSender->uQoSPriority != INTNET_QOS_PRIORITY_HIGH
+        &&  !intnetR0IfQoSHasRoom(pIf, pIfSender, pSG))
+    {
+        STAM_REL_COUNTER_INC(&pIfSender->pIntBuf->cStatQoSDrops);
+        return false;
+    }
+
+    /*
+     * Copy over the frame.
      */
-    RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
-    RTSpinlockAcquireNoInts(pIf->hRecvInSpinlock, &Tmp);
     int rc = intnetR0RingWriteFrame(&pIf->pIntBuf->Recv, pSG, pNewDstMac);
-    RTSpinlockReleaseNoInts(pIf->hRecvInSpinlock, &Tmp);
     if (RT_SUCCESS(rc))
     {
         pIf->cYields = 0;
-        RTSemEventSignal(pIf->hRecvEvent);
-        return;
+        return true;
     }
 
     Log(("intnetR0IfSend: overflow cb=%d hIf=%RX32\n", pSG->cbTotal, pIf->hIf));
@@ -2605,17 +3396,14 @@ static void intnetR0IfSend(PINTNETIF pIf, PINTNETIF pIfSender, PINTNETSG pSG, PC
         unsigned cYields = 2;
         while (--cYields > 0)
         {
-            RTSemEventSignal(pIf->hRecvEvent);
+            intnetR0IfWakeUpRecv(pIf);
             RTThreadYield();
 
-            RTSpinlockAcquireNoInts(pIf->hRecvInSpinlock, &Tmp);
             rc = intnetR0RingWriteFrame(&pIf->pIntBuf->Recv, pSG, pNewDstMac);
-            RTSpinlockReleaseNoInts(pIf->hRecvInSpinlock, &Tmp);
             if (RT_SUCCESS(rc))
             {
                 STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatYieldsOk);
-                RTSemEventSignal(pIf->hRecvEvent);
-                return;
+                return true;
             }
             pIf->cYields++;
         }
@@ -2624,7 +3412,8 @@ static void intnetR0IfSend(PINTNETIF pIf, PINTNETIF pIfSender, PINTNETSG pSG, PC
 
     /* ok, the frame is lost. */
     STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatLost);
-    RTSemEventSignal(pIf->hRecvEvent);
+    intnetR0IfWakeUpRecv(pIf);
+    return false;
 }
 
 
@@ -2656,23 +3445,39 @@ static int intnetR0TrunkIfSendGsoFallback(PINTNETTRUNKIF pThis, PINTNETIF pIfSen
     } u;
 
     /*
-     * Carve out the frame segments with the header and frame in different
-     * scatter / gather segments.
+     * Carve out the frame segments.  Segments fitting into abGsoSeg are copied
+     * there with the payload checksummed on the way, so the trunk reads the
+     * cache hot copy instead of going over the payload in the frame a second
+     * time.  Bigger ones get the header and payload in different scatter /
+     * gather segments.
      */
-    uint32_t const cSegs = PDMNetGsoCalcSegmentCount(&pSG->GsoCtx, pSG->cbTotal);
+    uint32_t const cSegs     = PDMNetGsoCalcSegmentCount(&pSG->GsoCtx, pSG->cbTotal);
+    bool const     fCopySegs = (uint32_t)pSG->GsoCtx.cbHdrsTotal + pSG->GsoCtx.cbMaxSeg <= sizeof(pIfSender->abGsoSeg);
     for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
     {
-        uint32_t cbSegPayload, cbSegHdrs;
-        uint32_t offSegPayload = PDMNetGsoCarveSegment(&pSG->GsoCtx, (uint8_t *)pSG->aSegs[0].pv, pSG->cbTotal, iSeg, cSegs,
-                                                       pIfSender->abGsoHdrs, &cbSegHdrs, &cbSegPayload);
-
-        IntNetSgInitTempSegs(&u.SG, cbSegHdrs + cbSegPayload, 2, 2);
-        u.SG.aSegs[0].Phys = NIL_RTHCPHYS;
-        u.SG.aSegs[0].pv   = pIfSender->abGsoHdrs;
-        u.SG.aSegs[0].cb   = cbSegHdrs;
-        u.SG.aSegs[1].Phys = NIL_RTHCPHYS;
-        u.SG.aSegs[1].pv   = (uint8_t *)pSG->aSegs[0].pv + offSegPayload;
-        u.SG.aSegs[1].cb   = (uint32_t)cbSegPayload;
+        if (fCopySegs)
+        {
+            uint32_t cbSegFrame = PDMNetGsoCarveSegmentCopy(&pSG->GsoCtx, (uint8_t *)pSG->aSegs[0].pv, pSG->cbTotal,
+                                                            iSeg, cSegs, pIfSender->abGsoSeg);
+            IntNetSgInitTempSegs(&u.SG, cbSegFrame, 1, 1);
+            u.SG.aSegs[0].Phys = NIL_RTHCPHYS;
+            u.SG.aSegs[0].pv   = pIfSender->abGsoSeg;
+            u.SG.aSegs[0].cb   = cbSegFrame;
+        }
+        else
+        {
+            uint32_t cbSegPayload, cbSegHdrs;
+            uint32_t offSegPayload = PDMNetGsoCarveSegment(&pSG->GsoCtx, (uint8_t *)pSG->aSegs[0].pv, pSG->cbTotal, iSeg, cSegs,
+                                                           pIfSender->abGsoSeg, &cbSegHdrs, &cbSegPayload);
+
+            IntNetSgInitTempSegs(&u.SG, cbSegHdrs + cbSegPayload, 2, 2);
+            u.SG.aSegs[0].Phys = NIL_RTHCPHYS;
+            u.SG.aSegs[0].pv   = pIfSender->abGsoSeg;
+            u.SG.aSegs[0].cb   = cbSegHdrs;
+            u.SG.aSegs[1].Phys = NIL_RTHCPHYS;
+            u.SG.aSegs[1].pv   = (uint8_t *)pSG->aSegs[0].pv + offSegPayload;
+            u.SG.aSegs[1].cb   = (uint32_t)cbSegPayload;
+        }
 
         int rc = pThis->pIfPort->pfnXmit(pThis->pIfPort, pIfSender->pvIfData, &u.SG, fDst);
         if (RT_FAILURE(rc))
@@ -3304,9 +4109,20 @@ static void intnetR0NetworkDeliver(PINTNETNETWORK pNetwork, PINTNETDSTTAB pDstTa
     while (iIf-- > 0)
     {
         PINTNETIF pIf = pDstTab->aIfs[iIf].pIf;
-        intnetR0IfSend(pIf, pIfSender, pSG,
-                       pDstTab->aIfs[iIf].fReplaceDstMac ? &pIf->MacAddr: NULL);
-        intnetR0BusyDecIf(pIf);
+        if (intnetR0IfSend(pIf, pIfSender, pSG,
+                           pDstTab->aIfs[iIf].fReplaceDstMac ? &pIf->MacAddr: NULL))
+        {
+            /* Frames from an interface come in batches, so let the receiver
+               sleep until the sender is done with the batch. */
+            if (   !pIfSender
+                || !intnetR0IfDeferWakeUp(pIfSender, pIf))
+            {
+                intnetR0IfWakeUpRecv(pIf);
+                intnetR0BusyDecIf(pIf);
+            }
+        }
+        else
+            intnetR0BusyDecIf(pIf);
         pDstTab->aIfs[iIf].pIf = NULL;
     }
     pDstTab->cIfs = 0;
@@ -3401,8 +4217,14 @@ static INTNETSWDECISION intnetR0NetworkSend(PINTNETNETWORK pNetwork, PINTNETIF p
 
         PINTNETMACTABENTRY pIfEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIfSender);
         if (pIfEntry)
+        {
+            uint32_t const iIfEntry = (uint32_t)(pIfEntry - &pNetwork->MacTab.paEntries[0]);
+            intnetR0MacTabUnlinkEntry(&pNetwork->MacTab, iIfEntry);
             pIfEntry->MacAddr = EthHdr.SrcMac;
+            intnetR0MacTabLinkEntry(&pNetwork->MacTab, iIfEntry);
+        }
         pIfSender->MacAddr    = EthHdr.SrcMac;
+        intnetR0NetworkMacTabAgeAddr(pNetwork, pIfSender, &EthHdr.SrcMac);
 
         RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
     }
@@ -3444,6 +4266,139 @@ static INTNETSWDECISION intnetR0NetworkSend(PINTNETNETWORK pNetwork, PINTNETIF p
 }
 
 
+/**
+ * Adds tokens to a QoS token bucket, capping it at the given size.
+ *
+ * @param   pcTokens        The token bucket.
+ * @param   cTokens         The number of tokens to add.
+ * @param   cMax            The bucket size.
+ */
+static void intnetR0QoSBucketFill(int64_t volatile *pcTokens, int64_t cTokens, int64_t cMax)
+{
+    for (;;)
+    {
+        int64_t const cOld = ASMAtomicReadS64(pcTokens);
+        if (cOld >= cMax)
+            break;
+        int64_t const cNew = RT_MIN(cOld + cTokens, cMax);
+        if (ASMAtomicCmpXchgS64(pcTokens, cNew, cOld))
+            break;
+    }
+}
+
+
+/**
+ * Refills the token buckets of a QoS bandwidth group.
+ *
+ * The interfaces of a group send concurrently, the one updating the refill
+ * timestamp adds the tokens for the elapsed time.
+ *
+ * @param   pGroup          The bandwidth group.
+ * @param   u64Now          The current RTTimeSystemNanoTS time.
+ */
+static void intnetR0QoSGroupRefill(PINTNETQOSGROUP pGroup, uint64_t u64Now)
+{
+    /* Don't bother for tiny intervals, they'd just round down to nothing.  The
+       check also covers another sender having refilled with a later time. */
+    uint64_t const u64Prev     = ASMAtomicReadU64(&pGroup->u64Refill);
+    int64_t        cNsElapsed  = (int64_t)(u64Now - u64Prev);
+    if (cNsElapsed < (int64_t)RT_NS_1MS)
+        return;
+    if (!ASMAtomicCmpXchgU64(&pGroup->u64Refill, u64Now, u64Prev))
+        return;
+    if (cNsElapsed > (int64_t)RT_NS_1SEC)
+        cNsElapsed = RT_NS_1SEC;
+
+    uint64_t const cbMaxPerSec = ASMAtomicReadU64(&pGroup->cbMaxPerSec);
+    if (cbMaxPerSec)
+        intnetR0QoSBucketFill(&pGroup->cbTokens,
+                              ASMMultU64ByU32DivByU32(cbMaxPerSec, (uint32_t)cNsElapsed, RT_NS_1SEC),
+                              RT_MAX(cbMaxPerSec / INTNET_QOS_BURST_DIV, INTNET_QOS_MIN_BURST_BYTES));
+
+    uint32_t const cMaxFramesPerSec = ASMAtomicReadU32(&pGroup->cMaxFramesPerSec);
+    if (cMaxFramesPerSec)
+        intnetR0QoSBucketFill(&pGroup->cFrameTokens,
+                              (int64_t)cMaxFramesPerSec * cNsElapsed,
+                              (int64_t)RT_MAX(cMaxFramesPerSec / INTNET_QOS_BURST_DIV, 1) * RT_NS_1SEC);
+}
+
+
+/**
+ * Calculates how long it takes until the token buckets of a QoS bandwidth
+ * group let frames thru again.
+ *
+ * @returns Nanoseconds, at least the refill granularity and at most a second.
+ * @param   pGroup          The bandwidth group.
+ */
+static uint64_t intnetR0QoSGroupCalcDelay(PINTNETQOSGROUP pGroup)
+{
+    uint64_t cNsDelay = RT_NS_1MS;
+
+    uint64_t const cbMaxPerSec = ASMAtomicReadU64(&pGroup->cbMaxPerSec);
+    int64_t  const cbTokens    = ASMAtomicReadS64(&pGroup->cbTokens);
+    if (cbMaxPerSec && cbTokens <= 0)
+    {
+        /* Capping the deficit keeps the multiplication from overflowing. */
+        uint64_t const cbDeficit = RT_MIN(RT_MIN((uint64_t)(1 - cbTokens), cbMaxPerSec), _4G);
+        cNsDelay = RT_MAX(cNsDelay, cbDeficit * RT_NS_1SEC / cbMaxPerSec + 1);
+    }
+
+    uint32_t const cMaxFramesPerSec = ASMAtomicReadU32(&pGroup->cMaxFramesPerSec);
+    int64_t  const cFrameTokens     = ASMAtomicReadS64(&pGroup->cFrameTokens);
+    if (cMaxFramesPerSec && cFrameTokens <= 0)
+    {
+        uint64_t const cDeficit = RT_MIN((uint64_t)(1 - cFrameTokens), (uint64_t)cMaxFramesPerSec * RT_NS_1SEC);
+        cNsDelay = RT_MAX(cNsDelay, cDeficit / cMaxFramesPerSec + 1);
+    }
+
+    return RT_MIN(cNsDelay, RT_NS_1SEC);
+}
+
+
+/**
+ * Applies the QoS rate limits of the bandwidth group of the sending interface
+ * to a frame.
+ *
+ * A frame is let thru as long as neither bucket is empty, so a big frame may
+ * overdraw them.  Frames that don't get thru are dropped if they are broadcast
+ * or multicast or if the interface has the low priority class, otherwise they
+ * are delayed, i.e. left in the send ring for the next IntNetR0IfSend call.
+ *
+ * @returns true if the frame may be sent, false if not.
+ * @param   pIf             The sending interface.
+ * @param   pGroup          The bandwidth group of the interface.
+ * @param   pvFrame         The frame (starting with the ethernet header).
+ * @param   cbFrame         The frame size.
+ * @param   cWireFrames     The number of frames on the wire (GSO segments).
+ * @param   pfDelay         Where to return whether to delay (true) or drop
+ *                          (false) a frame that doesn't get thru.
+ */
+static bool intnetR0IfQoSAdmit(PINTNETIF pIf, PINTNETQOSGROUP pGroup, void const *pvFrame, uint32_t cbFrame,
+                               uint32_t cWireFrames, bool *pfDelay)
+{
+    bool const fBytes  = ASMAtomicReadU64(&pGroup->cbMaxPerSec)      != 0;
+    bool const fFrames = ASMAtomicReadU32(&pGroup->cMaxFramesPerSec) != 0;
+    if (   (fBytes  && ASMAtomicReadS64(&pGroup->cbTokens)     <= 0)
+        || (fFrames && ASMAtomicReadS64(&pGroup->cFrameTokens) <= 0))
+    {
+        *pfDelay = pIf->uQoSPriority != INTNET_QOS_PRIORITY_LOW
+                && cbFrame >= sizeof(RTNETETHERHDR)
+                && !intnetR0IsMacAddrMulticast(&((PCRTNETETHERHDR)pvFrame)->DstMac);
+        if (*pfDelay)
+            STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatQoSDelays);
+        else
+            STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatQoSDrops);
+        return false;
+    }
+
+    if (fBytes)
+        ASMAtomicAddS64(&pGroup->cbTokens, -(int64_t)cbFrame);
+    if (fFrames)
+        ASMAtomicAddS64(&pGroup->cFrameTokens, -(int64_t)cWireFrames * RT_NS_1SEC);
+    return true;
+}
+
+
 /**
  * Sends one or more frames.
  *
@@ -3497,30 +4452,60 @@ INTNETR0DECL(int) IntNetR0IfSend(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession)
                                      * with buffer sharing for some OS or service. Darwin copies everything so
                                      * I won't bother allocating and managing SGs right now. Sorry. */
             PINTNETHDR          pHdr;
+            bool                fDelay    = false;
+            PINTNETQOSGROUP     pQoSGroup = pIf->pQoSGroup;
+            bool const          fQoS      = pQoSGroup
+                                         && (   ASMAtomicReadU64(&pQoSGroup->cbMaxPerSec)
+                                             || ASMAtomicReadU32(&pQoSGroup->cMaxFramesPerSec));
+            uint64_t const      u64Now    = RTTimeSystemNanoTS();
+            ASMAtomicWriteU64(&pIf->u64LastSend, u64Now);
+            if (fQoS)
+                intnetR0QoSGroupRefill(pQoSGroup, u64Now);
             while ((pHdr = IntNetRingGetNextFrameToRead(&pIf->pIntBuf->Send)) != NULL)
             {
                 uint16_t const      u16Type = pHdr->u16Type;
                 if (u16Type == INTNETHDR_TYPE_FRAME)
                 {
-                    /* Send regular frame. */
+                    /* Send regular frame unless QoS says otherwise. */
                     void *pvCurFrame = IntNetHdrGetFramePtr(pHdr, pIf->pIntBuf);
-                    IntNetSgInitTemp(&Sg, pvCurFrame, pHdr->cbFrame);
-                    if (pNetwork->fFlags & INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE)
-                        intnetR0IfSnoopAddr(pIf, (uint8_t *)pvCurFrame, pHdr->cbFrame, false /*fGso*/, (uint16_t *)&Sg.fFlags);
-                    enmSwDecision = intnetR0NetworkSend(pNetwork, pIf,  0 /*fSrc*/, &Sg, pDstTab);
+                    if (   fQoS
+                        && !intnetR0IfQoSAdmit(pIf, pQoSGroup, pvCurFrame, pHdr->cbFrame, 1, &fDelay))
+                    {
+                        if (fDelay)
+                            break;
+                        enmSwDecision = INTNETSWDECISION_DROP;
+                    }
+                    else
+                    {
+                        IntNetSgInitTemp(&Sg, pvCurFrame, pHdr->cbFrame);
+                        if (pNetwork->fFlags & INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE)
+                            intnetR0IfSnoopAddr(pIf, (uint8_t *)pvCurFrame, pHdr->cbFrame, false /*fGso*/, (uint16_t *)&Sg.fFlags);
+                        enmSwDecision = intnetR0NetworkSend(pNetwork, pIf,  0 /*fSrc*/, &Sg, pDstTab);
+                    }
                 }
                 else if (u16Type == INTNETHDR_TYPE_GSO)
                 {
-                    /* Send GSO frame if sane. */
+                    /* Send GSO frame if sane and QoS doesn't say otherwise. */
                     PPDMNETWORKGSO  pGso       = IntNetHdrGetGsoContext(pHdr, pIf->pIntBuf);
                     uint32_t        cbFrame    = pHdr->cbFrame - sizeof(*pGso);
                     if (RT_LIKELY(PDMNetGsoIsValid(pGso, pHdr->cbFrame, cbFrame)))
                     {
                         void       *pvCurFrame = pGso + 1;
-                        IntNetSgInitTempGso(&Sg, pvCurFrame, cbFrame, pGso);
-                        if (pNetwork->fFlags & INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE)
-                            intnetR0IfSnoopAddr(pIf, (uint8_t *)pvCurFrame, cbFrame, true /*fGso*/, (uint16_t *)&Sg.fFlags);
-                        enmSwDecision = intnetR0NetworkSend(pNetwork, pIf, 0 /*fSrc*/, &Sg, pDstTab);
+                        if (   fQoS
+                            && !intnetR0IfQoSAdmit(pIf, pQoSGroup, pvCurFrame, cbFrame,
+                                                   PDMNetGsoCalcSegmentCount(pGso, cbFrame), &fDelay))
+                        {
+                            if (fDelay)
+                                break;
+                            enmSwDecision = INTNETSWDECISION_DROP;
+                        }
+                        else
+                        {
+                            IntNetSgInitTempGso(&Sg, pvCurFrame, cbFrame, pGso);
+                            if (pNetwork->fFlags & INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE)
+                                intnetR0IfSnoopAddr(pIf, (uint8_t *)pvCurFrame, cbFrame, true /*fGso*/, (uint16_t *)&Sg.fFlags);
+                            enmSwDecision = intnetR0NetworkSend(pNetwork, pIf, 0 /*fSrc*/, &Sg, pDstTab);
+                        }
                     }
                     else
                     {
@@ -3545,6 +4530,17 @@ INTNETR0DECL(int) IntNetR0IfSend(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession)
                 IntNetRingSkipFrame(&pIf->pIntBuf->Send);
             }
 
+            /*
+             * Tell the producer when to retry delayed frames.
+             */
+            if (fDelay)
+                ASMAtomicWriteU64(&pIf->pIntBuf->cNsQoSDelay, intnetR0QoSGroupCalcDelay(pQoSGroup));
+
+            /*
+             * Wake up the receivers of the batch.
+             */
+            intnetR0IfFlushDeferredWakeUps(pIf);
+
             /*
              * Put back the destination table.
              */
@@ -3846,7 +4842,12 @@ INTNETR0DECL(int) IntNetR0IfSetMacAddress(INTNETIFHANDLE hIf, PSUPDRVSESSION pSe
             /* Update the two copies. */
             PINTNETMACTABENTRY pEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIf); Assert(pEntry);
             if (RT_LIKELY(pEntry))
+            {
+                uint32_t const iEntry = (uint32_t)(pEntry - &pNetwork->MacTab.paEntries[0]);
+                intnetR0MacTabUnlinkEntry(&pNetwork->MacTab, iEntry);
                 pEntry->MacAddr = *pMac;
+                intnetR0MacTabLinkEntry(&pNetwork->MacTab, iEntry);
+            }
             pIf->MacAddr        = *pMac;
             pIf->fMacSet        = true;
 
@@ -3927,8 +4928,11 @@ static int intnetR0NetworkSetIfActive(PINTNETNETWORK pNetwork, PINTNETIF pIf, bo
         PINTNETMACTABENTRY pEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIf); Assert(pEntry);
         if (RT_LIKELY(pEntry))
         {
+            uint32_t const iEntry = (uint32_t)(pEntry - &pNetwork->MacTab.paEntries[0]);
+            intnetR0MacTabUnlinkEntry(&pNetwork->MacTab, iEntry);
             pEntry->fActive = fActive;
             pIf->fActive    = fActive;
+            intnetR0MacTabLinkEntry(&pNetwork->MacTab, iEntry);
 
             if (fActive)
             {
@@ -4091,11 +5095,16 @@ INTNETR0DECL(int) IntNetR0IfWait(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession, ui
     }
 
     /*
-     * It is tempting to check if there is data to be read here,
-     * but the problem with such an approach is that it will cause
-     * one unnecessary supervisor->user->supervisor trip. There is
-     * already a slight risk for such, so no need to increase it.
+     * Tell the producers where we saw the ring empty, they only signal us
+     * once frames are committed there (intnetR0IfWakeUpRecv).  Check the
+     * ring after publishing it: a frame committed before the producers
+     * could see the index would otherwise not wake us.  In that case we just
+     * eat any pending signal and return.
      */
+    PINTNETBUF     pIntBuf  = pIf->pIntBuf;
+    uint32_t const offEvent = ASMAtomicUoReadU32(&pIntBuf->Recv.offReadX);
+    ASMAtomicWriteU32(&pIntBuf->offRecvEvent, offEvent);
+    bool const     fMore    = IntNetRingHasMoreToRead(&pIntBuf->Recv);
 
     /*
      * Increment the number of waiters before starting the wait.
@@ -4104,9 +5113,14 @@ INTNETR0DECL(int) IntNetR0IfWait(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession, ui
      * code must be aligned with the waiting code in intnetR0IfDestruct.
      */
     ASMAtomicIncU32(&pIf->cSleepers);
-    int rc = RTSemEventWaitNoResume(hRecvEvent, cMillies);
+    int rc = RTSemEventWaitNoResume(hRecvEvent, fMore ? 0 : cMillies);
+    if (fMore)
+        rc = VINF_SUCCESS;
     if (pIf->hRecvEvent == hRecvEvent)
     {
+        /* The caller reads the ring now and needs no signals until it waits
+           again. */
+        ASMAtomicWriteU32(&pIntBuf->offRecvEvent, INTNETBUF_RECV_EVENT_NONE);
         ASMAtomicDecU32(&pIf->cSleepers);
         if (!pIf->fDestroying)
         {
@@ -4211,6 +5225,212 @@ INTNETR0DECL(int) IntNetR0IfAbortWaitReq(PSUPDRVSESSION pSession, PINTNETIFABORT
 }
 
 
+/**
+ * Gets a QoS bandwidth group and sets its rate limits.
+ *
+ * The caller must own the INTNET::hMtxCreateOpenDestroy.
+ *
+ * @returns VBox status code.
+ * @param   pIntNet             The instance data.
+ * @param   pSession            The session of the interface.
+ * @param   pszName             The group name, empty for a group of one.
+ * @param   cbMaxPerSec         The max number of bytes per second, 0 for no
+ *                              limit.
+ * @param   cMaxFramesPerSec    The max number of frames per second, 0 for no
+ *                              limit.
+ * @param   ppGroup             Where to return the retained group.
+ */
+static int intnetR0QoSGroupRetain(PINTNET pIntNet, PSUPDRVSESSION pSession, const char *pszName, uint64_t cbMaxPerSec,
+                                  uint32_t cMaxFramesPerSec, PINTNETQOSGROUP *ppGroup)
+{
+    int64_t const   cbBurst = RT_MAX(cbMaxPerSec / INTNET_QOS_BURST_DIV, INTNET_QOS_MIN_BURST_BYTES);
+    int64_t const   cBurst  = (int64_t)RT_MAX(cMaxFramesPerSec / INTNET_QOS_BURST_DIV, 1) * RT_NS_1SEC;
+
+    /*
+     * Named groups are shared by the interfaces of the session, the last one
+     * setting the limits wins.
+     */
+    PINTNETQOSGROUP pGroup;
+    if (*pszName)
+        for (pGroup = pIntNet->pQoSGroups; pGroup; pGroup = pGroup->pNext)
+            if (    pGroup->pSession == pSession
+                &&  !strcmp(pGroup->szName, pszName))
+            {
+                pGroup->cRefs++;
+                ASMAtomicWriteU64(&pGroup->cbMaxPerSec, cbMaxPerSec);
+                ASMAtomicWriteU32(&pGroup->cMaxFramesPerSec, cMaxFramesPerSec);
+                if (ASMAtomicReadS64(&pGroup->cbTokens) > cbBurst)
+                    ASMAtomicWriteS64(&pGroup->cbTokens, cbBurst);
+                if (ASMAtomicReadS64(&pGroup->cFrameTokens) > cBurst)
+                    ASMAtomicWriteS64(&pGroup->cFrameTokens, cBurst);
+                *ppGroup = pGroup;
+                return VINF_SUCCESS;
+            }
+
+    /*
+     * Create a new one, starting out with full buckets.
+     */
+    pGroup = (PINTNETQOSGROUP)RTMemAllocZ(sizeof(*pGroup));
+    if (!pGroup)
+        return VERR_NO_MEMORY;
+    pGroup->pSession            = pSession;
+    pGroup->cRefs               = 1;
+    pGroup->cMaxFramesPerSec    = cMaxFramesPerSec;
+    pGroup->cbMaxPerSec         = cbMaxPerSec;
+    pGroup->cbTokens            = cbBurst;
+    pGroup->cFrameTokens        = cBurst;
+    pGroup->u64Refill           = RTTimeSystemNanoTS();
+    if (*pszName)
+    {
+        strcpy(pGroup->szName, pszName);
+        pGroup->pNext           = pIntNet->pQoSGroups;
+        pIntNet->pQoSGroups     = pGroup;
+    }
+    *ppGroup = pGroup;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Releases a QoS bandwidth group, freeing it when the last interface is gone.
+ *
+ * The caller must own the INTNET::hMtxCreateOpenDestroy.
+ *
+ * @param   pIntNet             The instance data.
+ * @param   pGroup              The group.
+ */
+static void intnetR0QoSGroupRelease(PINTNET pIntNet, PINTNETQOSGROUP pGroup)
+{
+    Assert(pGroup->cRefs > 0);
+    if (--pGroup->cRefs > 0)
+        return;
+
+    if (pGroup->szName[0])
+    {
+        PINTNETQOSGROUP *ppPrev = &pIntNet->pQoSGroups;
+        while (*ppPrev != pGroup)
+        {
+            AssertReturnVoid(*ppPrev);
+            ppPrev = &(*ppPrev)->pNext;
+        }
+        *ppPrev = pGroup->pNext;
+    }
+    RTMemFree(pGroup);
+}
+
+
+/**
+ * Sets the QoS rate limits and priority class of an interface.
+ *
+ * The rate limits apply to the frames the interface sends.  Interfaces of the
+ * same session naming the same bandwidth group share them, otherwise the
+ * interface has them for itself.  The priority class decides what happens to
+ * frames exceeding them and how much of the receive rings of the other
+ * interfaces the frames may use, see INTNET_QOS_PRIORITY_XXX.
+ *
+ * Like IntNetR0IfSend, this must not be called concurrently with sending on the
+ * interface.
+ *
+ * @returns VBox status code.
+ * @param   hIf                 The interface handle.
+ * @param   pSession            The caller's session.
+ * @param   cbMaxPerSec         The max number of bytes per second, 0 for no
+ *                              limit.
+ * @param   cMaxFramesPerSec    The max number of frames per second, 0 for no
+ *                              limit.
+ * @param   uPriority           The priority class, INTNET_QOS_PRIORITY_XXX.
+ * @param   pszGroup            The bandwidth group name, empty if none.
+ */
+INTNETR0DECL(int) IntNetR0IfSetQoS(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession, uint64_t cbMaxPerSec,
+                                   uint32_t cMaxFramesPerSec, uint32_t uPriority, const char *pszGroup)
+{
+    LogFlow(("IntNetR0IfSetQoS: hIf=%RX32 cbMaxPerSec=%RU64 cMaxFramesPerSec=%RU32 uPriority=%RU32 pszGroup=%s\n",
+             hIf, cbMaxPerSec, cMaxFramesPerSec, uPriority, pszGroup));
+
+    /*
+     * Validate & translate input.
+     */
+    PINTNET pIntNet = g_pIntNet;
+    AssertPtrReturn(pIntNet, VERR_INVALID_PARAMETER);
+    AssertReturn(pIntNet->u32Magic, VERR_INVALID_MAGIC);
+    AssertReturn(uPriority < INTNET_QOS_PRIORITY_END, VERR_INVALID_PARAMETER);
+    AssertPtrReturn(pszGroup, VERR_INVALID_PARAMETER);
+    AssertReturn(RTStrEnd(pszGroup, INTNET_MAX_QOS_GROUP_NAME), VERR_INVALID_PARAMETER);
+
+    PINTNETIF pIf = (PINTNETIF)RTHandleTableLookupWithCtx(pIntNet->hHtIfs, hIf, pSession);
+    if (!pIf)
+    {
+        Log(("IntNetR0IfSetQoS: returns VERR_INVALID_HANDLE\n"));
+        return VERR_INVALID_HANDLE;
+    }
+
+    /*
+     * The mutex keeps the interface on the network and protects the groups.
+     */
+    int rc = RTSemMutexRequest(pIntNet->hMtxCreateOpenDestroy, RT_INDEFINITE_WAIT);
+    if (RT_SUCCESS(rc))
+    {
+        PINTNETNETWORK pNetwork = pIf->pNetwork;
+        if (pNetwork)
+        {
+            PINTNETQOSGROUP pGroup = NULL;
+            if (*pszGroup || cbMaxPerSec || cMaxFramesPerSec)
+                rc = intnetR0QoSGroupRetain(pIntNet, pSession, pszGroup, cbMaxPerSec, cMaxFramesPerSec, &pGroup);
+            if (RT_SUCCESS(rc))
+            {
+                /*
+                 * Switch groups while owning the destination table, so that
+                 * IntNetR0IfSend isn't using the old one.
+                 */
+                PINTNETDSTTAB pDstTab;
+                while ((pDstTab = ASMAtomicXchgPtrT(&pIf->pDstTab, NULL, PINTNETDSTTAB)) == NULL)
+                    RTThreadSleep(1);
+                PINTNETQOSGROUP pOldGroup = pIf->pQoSGroup;
+                pIf->pQoSGroup = pGroup;
+                ASMAtomicWritePtr(&pIf->pDstTab, pDstTab);
+                if (pOldGroup)
+                    intnetR0QoSGroupRelease(pIntNet, pOldGroup);
+
+                /*
+                 * Keep the high priority count of the network up to date.
+                 */
+                RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
+                RTSpinlockAcquireNoInts(pNetwork->hAddrSpinlock, &Tmp);
+                if (pIf->uQoSPriority == INTNET_QOS_PRIORITY_HIGH)
+                    pNetwork->cQoSHighPriorityIfs--;
+                if (uPriority == INTNET_QOS_PRIORITY_HIGH)
+                    pNetwork->cQoSHighPriorityIfs++;
+                pIf->uQoSPriority = uPriority;
+                RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
+            }
+        }
+        else
+            rc = VERR_WRONG_ORDER;
+
+        RTSemMutexRelease(pIntNet->hMtxCreateOpenDestroy);
+    }
+
+    intnetR0IfRelease(pIf, pSession);
+    LogFlow(("IntNetR0IfSetQoS: returns %Rrc\n", rc));
+    return rc;
+}
+
+
+/**
+ * VMMR0 request wrapper for IntNetR0IfSetQoS.
+ *
+ * @returns see IntNetR0IfSetQoS.
+ * @param   pSession        The caller's session.
+ * @param   pReq            The request packet.
+ */
+INTNETR0DECL(int) IntNetR0IfSetQoSReq(PSUPDRVSESSION pSession, PINTNETIFSETQOSREQ pReq)
+{
+    if (RT_UNLIKELY(pReq->Hdr.cbReq != sizeof(*pReq)))
+        return VERR_INVALID_PARAMETER;
+    return IntNetR0IfSetQoS(pReq->hIf, pSession, pReq->cbMaxPerSec, pReq->cMaxFramesPerSec, pReq->uPriority, pReq->szGroup);
+}
+
+
 /**
  * Close an interface.
  *
@@ -4336,12 +5556,15 @@ static DECLCALLBACK(void) intnetR0IfDestruct(void *pvObj, void *pvUser1, void *p
                 }
                 Assert(pNetwork->MacTab.cPromiscuousEntries        < pNetwork->MacTab.cEntries);
                 Assert(pNetwork->MacTab.cPromiscuousNoTrunkEntries < pNetwork->MacTab.cEntries);
+                if (pIf->uQoSPriority == INTNET_QOS_PRIORITY_HIGH)
+                    pNetwork->cQoSHighPriorityIfs--;
 
                 if (iIf + 1 < pNetwork->MacTab.cEntries)
                     memmove(&pNetwork->MacTab.paEntries[iIf],
                             &pNetwork->MacTab.paEntries[iIf + 1],
                             (pNetwork->MacTab.cEntries - iIf - 1) * sizeof(pNetwork->MacTab.paEntries[0]));
                 pNetwork->MacTab.cEntries--;
+                intnetR0NetworkMacTabRehash(pNetwork);
                 break;
             }
 
@@ -4379,6 +5602,13 @@ static DECLCALLBACK(void) intnetR0IfDestruct(void *pvObj, void *pvUser1, void *p
         SUPR0ObjRelease(pNetwork->pvObj, pIf->pSession);
     }
 
+    /* Leave the QoS bandwidth group. */
+    if (pIf->pQoSGroup)
+    {
+        intnetR0QoSGroupRelease(pIntNet, pIf->pQoSGroup);
+        pIf->pQoSGroup = NULL;
+    }
+
     RTSemMutexRelease(pIntNet->hMtxCreateOpenDestroy);
 
     /*
@@ -4435,9 +5665,6 @@ static DECLCALLBACK(void) intnetR0IfDestruct(void *pvObj, void *pvUser1, void *p
     /*
      * Free remaining resources
      */
-    RTSpinlockDestroy(pIf->hRecvInSpinlock);
-    pIf->hRecvInSpinlock = NIL_RTSPINLOCK;
-
     RTMemFree(pIf->pDstTab);
     pIf->pDstTab = NULL;
 
@@ -4520,10 +5747,11 @@ static int intnetR0NetworkCreateIf(PINTNETNETWORK pNetwork, PSUPDRVSESSION pSess
     pIf->pSession           = pSession;
     //pIf->pvObj            = NULL;
     //pIf->aAddrCache       = {0};
-    pIf->hRecvInSpinlock    = NIL_RTSPINLOCK;
     pIf->cBusy              = 0;
     //pIf->pDstTab          = NULL;
     //pIf->pvIfData         = NULL;
+    //pIf->pQoSGroup        = NULL;
+    pIf->uQoSPriority       = INTNET_QOS_PRIORITY_NORMAL;
 
     for (int i = kIntNetAddrType_Invalid + 1; i < kIntNetAddrType_End && RT_SUCCESS(rc); i++)
         rc = intnetR0IfAddrCacheInit(&pIf->aAddrCache[i], (INTNETADDRTYPE)i,
@@ -4532,8 +5760,6 @@ static int intnetR0NetworkCreateIf(PINTNETNETWORK pNetwork, PSUPDRVSESSION pSess
         rc = intnetR0AllocDstTab(pNetwork->MacTab.cEntriesAllocated, (PINTNETDSTTAB *)&pIf->pDstTab);
     if (RT_SUCCESS(rc))
         rc = RTSemEventCreate((PRTSEMEVENT)&pIf->hRecvEvent);
-    if (RT_SUCCESS(rc))
-        rc = RTSpinlockCreate(&pIf->hRecvInSpinlock);
     if (RT_SUCCESS(rc))
     {
         /*
@@ -4551,6 +5777,7 @@ static int intnetR0NetworkCreateIf(PINTNETNETWORK pNetwork, PSUPDRVSESSION pSess
             pIf->pIntBuf   = pIf->pIntBufDefault;
             pIf->pIntBufR3 = pIf->pIntBufDefaultR3;
             IntNetBufInit(pIf->pIntBuf, cbBuf, cbRecv, cbSend);
+            pIf->cbRecv    = cbRecv;
 
             /*
              * Register the interface with the session and create a handle for it.
@@ -4579,6 +5806,7 @@ static int intnetR0NetworkCreateIf(PINTNETNETWORK pNetwork, PSUPDRVSESSION pSess
                     pNetwork->MacTab.paEntries[iIf].pIf                  = pIf;
 
                     pNetwork->MacTab.cEntries = iIf + 1;
+                    intnetR0MacTabLinkEntry(&pNetwork->MacTab, iIf);
                     pIf->pNetwork = pNetwork;
 
                     /*
@@ -4622,8 +5850,6 @@ static int intnetR0NetworkCreateIf(PINTNETNETWORK pNetwork, PSUPDRVSESSION pSess
         }
     }
 
-    RTSpinlockDestroy(pIf->hRecvInSpinlock);
-    pIf->hRecvInSpinlock = NIL_RTSPINLOCK;
     RTSemEventDestroy(pIf->hRecvEvent);
     pIf->hRecvEvent = NIL_RTSEMEVENT;
     RTMemFree(pIf->pDstTab);
@@ -5246,6 +6472,7 @@ static DECLCALLBACK(void) intnetR0NetworkDestruct(void *pvObj, void *pvUser1, vo
         pNetwork->MacTab.paEntries[iIf].fActive      = false;
         pNetwork->MacTab.paEntries[iIf].pIf->fActive = false;
     }
+    intnetR0NetworkMacTabRehash(pNetwork);
 
     pNetwork->MacTab.fHostActive = false;
     pNetwork->MacTab.fWireActive = false;
@@ -5279,6 +6506,7 @@ static DECLCALLBACK(void) intnetR0NetworkDestruct(void *pvObj, void *pvUser1, vo
             pNetwork->MacTab.cEntries--;
         }
     }
+    intnetR0NetworkMacTabRehash(pNetwork);
 
     /*
      * Zap the trunk pointer while we still own the spinlock, destroy the
@@ -5645,7 +6873,7 @@ static int intnetR0CreateNetwork(PINTNET pIntNet, PSUPDRVSESSION pSession, const
      */
     size_t cb = sizeof(INTNETNETWORK);
     if (fFlags & INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE)
-        cb += INTNETNETWORK_TMP_SIZE + 64;
+        cb += INTNETNETWORK_TMP_SIZE + 64 + sizeof(INTNETL3HASHENTRY) * INTNET_L3HASH_SIZE;
     PINTNETNETWORK pNetwork = (PINTNETNETWORK)RTMemAllocZ(cb);
     if (!pNetwork)
         return VERR_NO_MEMORY;
@@ -5668,9 +6896,16 @@ static int intnetR0CreateNetwork(PINTNET pIntNet, PSUPDRVSESSION pSession, const
     pNetwork->pIntNet                       = pIntNet;
     //pNetwork->pvObj                       = NULL;
     if (fFlags & INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE)
+    {
         pNetwork->pbTmp                     = RT_ALIGN_PT(pNetwork + 1, 64, uint8_t *);
+        pNetwork->paL3Hash                  = (PINTNETL3HASHENTRY)(pNetwork->pbTmp + INTNETNETWORK_TMP_SIZE);
+    }
     //else
+    //{
     //    pNetwork->pbTmp                   = NULL;
+    //    pNetwork->paL3Hash                = NULL;
+    //}
+    intnetR0NetworkMacTabRehash(pNetwork);
     pNetwork->fFlags                        = fFlags;
     //pNetwork->fMinFlags                   = 0;
     //pNetwork->cActiveIFs                  = 0;
@@ -5936,6 +7171,7 @@ INTNETR0DECL(void) IntNetR0Term(void)
      */
     AssertReturnVoid(ASMAtomicCmpXchgU32(&pIntNet->u32Magic, ~INTNET_MAGIC, INTNET_MAGIC));
     Assert(pIntNet->pNetworks == NULL);
+    Assert(pIntNet->pQoSGroups == NULL);
     if (pIntNet->hMtxCreateOpenDestroy != NIL_RTSEMMUTEX)
     {
         RTSemMutexDestroy(pIntNet->hMtxCreateOpenDestroy);
@@ -5965,6 +7201,7 @@ INTNETR0DECL(int) IntNetR0Init(void)
     if (pIntNet)
     {
         //pIntNet->pNetworks = NULL;
+        //pIntNet->pQoSGroups = NULL;
 
         rc = RTSemMutexCreate(&pIntNet->hMtxCreateOpenDestroy);
         if (RT_SUCCESS(rc))
@@ -266,6 +266,12 @@ ip_input(struct pbuf *p, struct netif *inp) {
     }
   }
 #endif /* LWIP_DHCP */
+#if LWIP_CONNECTION_PROXY
+  /* A proxying interface takes packets for any destination. */
+  if (netif == NULL && (inp->flags & NETIF_FLAG_PROXY)) {
+    netif = inp;
+  }
+#endif /* LWIP_CONNECTION_PROXY */
   /* packet not for us? */
   if (netif == NULL) {
     /* packet not for us, route or discard */
@@ -33,6 +33,7 @@
 #include "lwip/opt.h"
 
 #include "lwip/memp.h"
+#include "lwip/mem.h"
 
 #include "lwip/pbuf.h"
 #include "lwip/udp.h"
@@ -199,6 +200,54 @@ memp_malloc(memp_t type)
   return mem;
 }
 
+/**
+ * Grows a pool by num elements taken from the heap, for the applications
+ * which need more than the static pools in memp_memory provide. The
+ * elements stay in the pool for good.
+ *
+ * @return the number of elements added
+ */
+u16_t
+memp_add(memp_t type, u16_t num)
+{
+  struct memp *memp;
+  u16_t i;
+#if SYS_LIGHTWEIGHT_PROT
+  SYS_ARCH_DECL_PROTECT(old_level);
+#endif /* SYS_LIGHTWEIGHT_PROT */
+
+  LWIP_ASSERT("memp_add: type < MEMP_MAX", type < MEMP_MAX);
+
+  for (i = 0; i < num; ++i) {
+    memp = (struct memp *)mem_malloc(MEMP_SIZE + memp_sizes[type]);
+    if (memp == NULL) {
+      break;
+    }
+    LWIP_ASSERT("memp_add: memp properly aligned",
+                ((mem_ptr_t)memp % MEM_ALIGNMENT) == 0);
+
+#if SYS_LIGHTWEIGHT_PROT
+    SYS_ARCH_PROTECT(old_level);
+#else /* SYS_LIGHTWEIGHT_PROT */
+    sys_sem_wait(mutex);
+#endif /* SYS_LIGHTWEIGHT_PROT */
+
+    memp->next = memp_tab[type];
+    memp_tab[type] = memp;
+#if MEMP_STATS
+    ++lwip_stats.memp[type].avail;
+#endif /* MEMP_STATS */
+
+#if SYS_LIGHTWEIGHT_PROT
+    SYS_ARCH_UNPROTECT(old_level);
+#else /* SYS_LIGHTWEIGHT_PROT */
+    sys_sem_signal(mutex);
+#endif /* SYS_LIGHTWEIGHT_PROT */
+  }
+
+  return i;
+}
+
 void
 memp_free(memp_t type, void *mem)
 {
@@ -57,6 +57,11 @@ u32_t tcp_ticks;
 const u8_t tcp_backoff[13] =
     { 1, 2, 3, 4, 5, 6, 7, 7, 7, 7, 7, 7, 7};
 
+#if LWIP_WND_SCALE
+/* Use the large windows and send buffers, see TCP_WND_SMALL. */
+u8_t tcp_large_wnd;
+#endif /* LWIP_WND_SCALE */
+
 /* The TCP PCB lists. */
 
 /** List of all TCP PCBs in LISTEN state */
@@ -336,8 +341,8 @@ tcp_listen(struct tcp_pcb *pcb)
 void
 tcp_recved(struct tcp_pcb *pcb, u16_t len)
 {
-  if ((u32_t)pcb->rcv_wnd + len > TCP_WND) {
-    pcb->rcv_wnd = TCP_WND;
+  if ((u32_t)pcb->rcv_wnd + len > TCP_WND_MAX(pcb)) {
+    pcb->rcv_wnd = TCP_WND_MAX(pcb);
   } else {
     pcb->rcv_wnd += len;
   }
@@ -355,7 +360,7 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
      */
     tcp_ack(pcb);
   } 
-  else if (pcb->flags & TF_ACK_DELAY && pcb->rcv_wnd >= TCP_WND/2) {
+  else if (pcb->flags & TF_ACK_DELAY && pcb->rcv_wnd >= TCP_WND_MAX(pcb)/2) {
     /* If we can send a window update such that there is a full
      * segment available in the window, do so now.  This is sort of
      * nagle-like in its goals, and tries to hit a compromise between
@@ -366,8 +371,8 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
     tcp_ack_now(pcb);
   }
 
-  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U16_F" (%"U16_F").\n",
-         len, pcb->rcv_wnd, TCP_WND - pcb->rcv_wnd));
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U32_F" (%"U32_F").\n",
+         len, (u32_t)pcb->rcv_wnd, (u32_t)(TCP_WND_MAX(pcb) - pcb->rcv_wnd)));
 }
 
 /**
@@ -416,7 +421,8 @@ err_t
 tcp_connect(struct tcp_pcb *pcb, struct ip_addr *ipaddr, u16_t port,
       err_t (* connected)(void *arg, struct tcp_pcb *tpcb, err_t err))
 {
-  u32_t optdata;
+  u32_t optdata[2];
+  u8_t optlen;
   err_t ret;
   u32_t iss;
 
@@ -435,8 +441,8 @@ tcp_connect(struct tcp_pcb *pcb, struct ip_addr *ipaddr, u16_t port,
   pcb->snd_nxt = iss;
   pcb->lastack = iss - 1;
   pcb->snd_lbb = iss - 1;
-  pcb->rcv_wnd = TCP_WND;
-  pcb->snd_wnd = TCP_WND;
+  pcb->rcv_wnd = TCP_WND_INIT;
+  pcb->snd_wnd = TCP_WND_INIT;
   pcb->mss = TCP_MSS;
   pcb->cwnd = 1;
   pcb->ssthresh = pcb->mss * 10;
@@ -448,19 +454,43 @@ tcp_connect(struct tcp_pcb *pcb, struct ip_addr *ipaddr, u16_t port,
 
   snmp_inc_tcpactiveopens();
   
-  /* Build an MSS option */
-  optdata = htonl(((u32_t)2 << 24) | 
-      ((u32_t)4 << 16) | 
-      (((u32_t)pcb->mss / 256) << 8) |
-      (pcb->mss & 255));
+  /* Build an MSS option, offering window scaling if we do it. */
+  optlen = tcp_build_syn_opts(pcb, optdata, TCP_LARGE_WND);
 
-  ret = tcp_enqueue(pcb, NULL, 0, TCP_SYN, 0, (u8_t *)&optdata, 4);
+  ret = tcp_enqueue(pcb, NULL, 0, TCP_SYN, 0, (u8_t *)optdata, optlen);
   if (ret == ERR_OK) { 
     tcp_output(pcb);
   }
   return ret;
 } 
 
+/**
+ * Builds the options of a SYN or SYN|ACK segment: the MSS option and,
+ * if wnd_scale is set, a NOP padded window scale option.
+ *
+ * @return the length of the options in bytes (a multiple of 4)
+ */
+u8_t
+tcp_build_syn_opts(struct tcp_pcb *pcb, u32_t *optdata, u8_t wnd_scale)
+{
+  optdata[0] = htonl(((u32_t)2 << 24) | 
+      ((u32_t)4 << 16) | 
+      (((u32_t)pcb->mss / 256) << 8) |
+      (pcb->mss & 255));
+#if LWIP_WND_SCALE
+  if (wnd_scale) {
+    optdata[1] = htonl(((u32_t)1 << 24) |
+        ((u32_t)3 << 16) |
+        ((u32_t)3 << 8) |
+        TCP_RCV_SCALE);
+    return 8;
+  }
+#else
+  (void)wnd_scale;
+#endif /* LWIP_WND_SCALE */
+  return 4;
+}
+
 /**
  * Called every 500 ms and implements the retransmission timer and the timer that
  * removes PCBs that have been in TIME-WAIT for enough time. It also increments
@@ -827,9 +857,9 @@ tcp_alloc(u8_t prio)
   if (pcb != NULL) {
     memset(pcb, 0, sizeof(struct tcp_pcb));
     pcb->prio = TCP_PRIO_NORMAL;
-    pcb->snd_buf = TCP_SND_BUF;
+    pcb->snd_buf = TCP_SND_BUF_INIT;
     pcb->snd_queuelen = 0;
-    pcb->rcv_wnd = TCP_WND;
+    pcb->rcv_wnd = TCP_WND_INIT;
     pcb->tos = 0;
     pcb->ttl = TCP_TTL;
     pcb->mss = TCP_MSS;
@@ -81,6 +81,13 @@ static void tcp_parseopt(struct tcp_pcb *pcb);
 static err_t tcp_listen_input(struct tcp_pcb_listen *pcb);
 static err_t tcp_timewait_input(struct tcp_pcb *pcb);
 
+#if LWIP_CONNECTION_PROXY
+static err_t tcp_proxy_listen_input(void);
+
+static tcp_proxy_syn_fn tcp_proxy_syn_hook;
+static void *tcp_proxy_syn_arg;
+#endif /* LWIP_CONNECTION_PROXY */
+
 /* tcp_input:
  *
  * The initial input processing of TCP. It verifies the TCP header, demultiplexes
@@ -234,6 +241,17 @@ tcp_input(struct pbuf *p, struct netif *inp)
       }
       prev = (struct tcp_pcb *)lpcb;
     }
+
+#if LWIP_CONNECTION_PROXY
+    /* Nobody listens there: a proxying interface terminates the
+       connection on behalf of the real destination. */
+    if (tcp_proxy_syn_hook != NULL && (inp->flags & NETIF_FLAG_PROXY)) {
+      LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for proxied connection.\n"));
+      tcp_proxy_listen_input();
+      pbuf_free(p);
+      return;
+    }
+#endif /* LWIP_CONNECTION_PROXY */
   }
 
 #if TCP_INPUT_DEBUG
@@ -285,9 +303,18 @@ tcp_input(struct pbuf *p, struct netif *inp)
         /* If the application has registered a "sent" function to be
            called when new send buffer space is available, we call it
            now. */
+#if LWIP_WND_SCALE
+        /* The callback takes at most 64K at a time. */
+        while (err == ERR_OK && pcb->acked > 0) {
+          u16_t acked16 = TCPWND_MIN16(pcb->acked);
+          pcb->acked -= acked16;
+          TCP_EVENT_SENT(pcb, acked16, err);
+        }
+#else
         if (pcb->acked > 0) {
           TCP_EVENT_SENT(pcb, pcb->acked, err);
         }
+#endif /* LWIP_WND_SCALE */
       
         if (recv_data != NULL) {
           /* Notify application that data has been received. */
@@ -348,7 +375,8 @@ static err_t
 tcp_listen_input(struct tcp_pcb_listen *pcb)
 {
   struct tcp_pcb *npcb;
-  u32_t optdata;
+  u32_t optdata[2];
+  u8_t optlen;
 
   /* In the LISTEN state, we check for incoming SYN segments,
      creates a new PCB, and responds with a SYN|ACK. */
@@ -395,18 +423,114 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 
     snmp_inc_tcppassiveopens();
 
-    /* Build an MSS option. */
-    optdata = htonl(((u32_t)2 << 24) |
-        ((u32_t)4 << 16) |
-        (((u32_t)npcb->mss / 256) << 8) |
-        (npcb->mss & 255));
+    /* Build an MSS option, and answer a window scale option. */
+    optlen = tcp_build_syn_opts(npcb, optdata, npcb->flags & TF_WND_SCALE);
     /* Send a SYN|ACK together with the MSS option. */
-    tcp_enqueue(npcb, NULL, 0, TCP_SYN | TCP_ACK, 0, (u8_t *)&optdata, 4);
+    tcp_enqueue(npcb, NULL, 0, TCP_SYN | TCP_ACK, 0, (u8_t *)optdata, optlen);
     return tcp_output(npcb);
   }
   return ERR_OK;
 }
 
+#if LWIP_CONNECTION_PROXY
+#if LWIP_CALLBACK_API
+static err_t
+tcp_proxy_accept_null(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  (void)arg;
+  (void)pcb;
+  (void)err;
+
+  return ERR_OK;
+}
+#endif /* LWIP_CALLBACK_API */
+
+/* tcp_proxy_listen_input():
+ *
+ * Called by tcp_input() when a segment arrives on a proxying
+ * interface and matches no PCB. Works like tcp_listen_input(), except
+ * that the SYN|ACK is left to tcp_proxy_accept().
+ */
+
+static err_t
+tcp_proxy_listen_input(void)
+{
+  struct tcp_pcb *npcb;
+
+  if (flags & TCP_RST) {
+    /* Nothing to reset. */
+  } else if (flags & TCP_ACK) {
+    LWIP_DEBUGF(TCP_RST_DEBUG, ("tcp_proxy_listen_input: ACK for unknown connection, sending reset\n"));
+    tcp_rst(ackno, seqno + tcplen,
+      &(iphdr->dest), &(iphdr->src),
+      tcphdr->dest, tcphdr->src);
+  } else if (flags & TCP_SYN) {
+    LWIP_DEBUGF(TCP_DEBUG, ("TCP proxy connection request %"U16_F" -> %"U16_F".\n", tcphdr->src, tcphdr->dest));
+    npcb = tcp_alloc(TCP_PRIO_NORMAL);
+    if (npcb == NULL) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_proxy_listen_input: could not allocate PCB\n"));
+      TCP_STATS_INC(tcp.memerr);
+      return ERR_MEM;
+    }
+    /* Set up the new PCB in the name of the original destination. */
+    ip_addr_set(&(npcb->local_ip), &(iphdr->dest));
+    npcb->local_port = tcphdr->dest;
+    ip_addr_set(&(npcb->remote_ip), &(iphdr->src));
+    npcb->remote_port = tcphdr->src;
+    npcb->state = SYN_RCVD;
+    npcb->rcv_nxt = seqno + 1;
+    npcb->snd_wnd = tcphdr->wnd;
+    npcb->ssthresh = npcb->snd_wnd;
+    npcb->snd_wl1 = seqno - 1;/* initialise to seqno-1 to force window update */
+#if LWIP_CALLBACK_API
+    npcb->accept = tcp_proxy_accept_null;
+#endif /* LWIP_CALLBACK_API */
+    TCP_REG(&tcp_active_pcbs, npcb);
+
+    tcp_parseopt(npcb);
+
+    snmp_inc_tcppassiveopens();
+
+    if (tcp_proxy_syn_hook(tcp_proxy_syn_arg, npcb) != ERR_OK) {
+      tcp_abort(npcb);
+      return ERR_ABRT;
+    }
+  }
+  return ERR_OK;
+}
+
+/**
+ * Installs the function which gets the connection requests arriving
+ * on proxying interfaces. Pass NULL to stop proxying.
+ */
+void
+tcp_proxy_syn(tcp_proxy_syn_fn syn, void *arg)
+{
+  tcp_proxy_syn_hook = syn;
+  tcp_proxy_syn_arg = arg;
+}
+
+/**
+ * Completes the handshake of a proxied connection by sending the
+ * SYN|ACK.
+ */
+err_t
+tcp_proxy_accept(struct tcp_pcb *pcb)
+{
+  u32_t optdata[2];
+  u8_t optlen;
+  err_t err;
+
+  LWIP_ASSERT("tcp_proxy_accept: pcb->state == SYN_RCVD", pcb->state == SYN_RCVD);
+  optlen = tcp_build_syn_opts(pcb, optdata, pcb->flags & TF_WND_SCALE);
+  err = tcp_enqueue(pcb, NULL, 0, TCP_SYN | TCP_ACK, 0, (u8_t *)optdata, optlen);
+  if (err == ERR_OK) {
+    err = tcp_output(pcb);
+  }
+  return err;
+}
+#endif /* LWIP_CONNECTION_PROXY */
+
 /* tcp_timewait_input():
  *
  * Called by tcp_input() when a segment arrives for a connection in
@@ -636,21 +760,24 @@ tcp_receive(struct tcp_pcb *pcb)
   u32_t right_wnd_edge;
   u16_t new_tot_len;
   u8_t accepted_inseq = 0;
+  u32_t wnd;
 
   if (flags & TCP_ACK) {
     right_wnd_edge = pcb->snd_wnd + pcb->snd_wl1;
+    /* The window in a SYN segment is never scaled. */
+    wnd = flags & TCP_SYN ? tcphdr->wnd : SND_WND_SCALE(pcb, tcphdr->wnd);
 
     /* Update window. */
     if (TCP_SEQ_LT(pcb->snd_wl1, seqno) ||
        (pcb->snd_wl1 == seqno && TCP_SEQ_LT(pcb->snd_wl2, ackno)) ||
-       (pcb->snd_wl2 == ackno && tcphdr->wnd > pcb->snd_wnd)) {
-      pcb->snd_wnd = tcphdr->wnd;
+       (pcb->snd_wl2 == ackno && wnd > pcb->snd_wnd)) {
+      pcb->snd_wnd = wnd;
       pcb->snd_wl1 = seqno;
       pcb->snd_wl2 = ackno;
       LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"U32_F"\n", pcb->snd_wnd));
 #if TCP_WND_DEBUG
     } else {
-      if (pcb->snd_wnd != tcphdr->wnd) {
+      if (pcb->snd_wnd != wnd) {
         LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: no window update lastack %"U32_F" snd_max %"U32_F" ackno %"U32_F" wl1 %"U32_F" seqno %"U32_F" wl2 %"U32_F"\n",
                                pcb->lastack, pcb->snd_max, ackno, pcb->snd_wl1, seqno, pcb->snd_wl2));
       }
@@ -684,7 +811,7 @@ tcp_receive(struct tcp_pcb *pcb)
           } else {
             /* Inflate the congestion window, but not if it means that
                the value overflows. */
-            if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+            if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
               pcb->cwnd += pcb->mss;
             }
           }
@@ -726,12 +853,12 @@ tcp_receive(struct tcp_pcb *pcb)
          ssthresh). */
       if (pcb->state >= ESTABLISHED) {
         if (pcb->cwnd < pcb->ssthresh) {
-          if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+          if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
             pcb->cwnd += pcb->mss;
           }
           LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"U16_F"\n", pcb->cwnd));
         } else {
-          u16_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
+          tcpwnd_size_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
           if (new_cwnd > pcb->cwnd) {
             pcb->cwnd = new_cwnd;
           }
@@ -1188,9 +1315,18 @@ tcp_parseopt(struct tcp_pcb *pcb)
         /* An MSS option with the right option length. */
         mss = (opts[c + 2] << 8) | opts[c + 3];
         pcb->mss = mss > TCP_MSS? TCP_MSS: mss;
-
-        /* And we are done processing options. */
-        break;
+        c += 4;
+#if LWIP_WND_SCALE
+      } else if (opt == 0x03 &&
+        opts[c + 1] == 0x03) {
+        /* A window scale option, which only counts in a SYN. */
+        if ((flags & TCP_SYN) && tcp_large_wnd) {
+          pcb->snd_scale = opts[c + 2] > 14 ? 14 : opts[c + 2];
+          pcb->rcv_scale = TCP_RCV_SCALE;
+          pcb->flags |= TF_WND_SCALE;
+        }
+        c += 3;
+#endif /* LWIP_WND_SCALE */
       } else {
   if (opts[c + 1] == 0) {
           /* If the length field is zero, the options are malformed
@@ -1203,6 +1339,14 @@ tcp_parseopt(struct tcp_pcb *pcb)
       }
     }
   }
+#if LWIP_WND_SCALE
+  if (!(pcb->flags & TF_WND_SCALE)) {
+    /* The peer cannot do window scaling, stick to 16 bit windows. */
+    pcb->snd_scale = 0;
+    pcb->rcv_scale = 0;
+    pcb->rcv_wnd = TCPWND_MIN16(pcb->rcv_wnd);
+  }
+#endif /* LWIP_WND_SCALE */
 }
 #endif /* LWIP_TCP */
 
@@ -122,7 +122,7 @@ tcp_enqueue(struct tcp_pcb *pcb, void *arg, u16_t len,
   u32_t left, seqno;
   u16_t seglen;
   void *ptr;
-  u8_t queuelen;
+  tcpqlen_t queuelen;
 
   LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_enqueue(pcb=%p, arg=%p, len=%"U16_F", flags=%"X16_F", copy=%"U16_F")\n",
     (void *)pcb, arg, len, (u16_t)flags, (u16_t)copy));
@@ -132,7 +132,7 @@ tcp_enqueue(struct tcp_pcb *pcb, void *arg, u16_t len,
       arg == NULL || optdata == NULL);
   /* fail on too much data */
   if (len > pcb->snd_buf) {
-    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_enqueue: too much data (len=%"U16_F" > snd_buf=%"U16_F")\n", len, pcb->snd_buf));
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_enqueue: too much data (len=%"U16_F" > snd_buf=%"U32_F")\n", len, (u32_t)pcb->snd_buf));
     return ERR_MEM;
   }
   left = len;
@@ -147,8 +147,8 @@ tcp_enqueue(struct tcp_pcb *pcb, void *arg, u16_t len,
   /* If total number of pbufs on the unsent/unacked queues exceeds the
    * configured maximum, return an error */
   queuelen = pcb->snd_queuelen;
-  if (queuelen >= TCP_SND_QUEUELEN) {
-    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_enqueue: too long queue %"U16_F" (max %"U16_F")\n", queuelen, TCP_SND_QUEUELEN));
+  if (queuelen >= TCP_SND_QUEUELEN_CUR) {
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_enqueue: too long queue %"U16_F" (max %"U16_F")\n", queuelen, TCP_SND_QUEUELEN_CUR));
     TCP_STATS_INC(tcp.memerr);
     return ERR_MEM;
   }
@@ -250,8 +250,8 @@ tcp_enqueue(struct tcp_pcb *pcb, void *arg, u16_t len,
 
     /* Now that there are more segments queued, we check again if the
     length of the queue exceeds the configured maximum. */
-    if (queuelen > TCP_SND_QUEUELEN) {
-      LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 2, ("tcp_enqueue: queue too long %"U16_F" (%"U16_F")\n", queuelen, TCP_SND_QUEUELEN));
+    if (queuelen > TCP_SND_QUEUELEN_CUR) {
+      LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 2, ("tcp_enqueue: queue too long %"U16_F" (%"U16_F")\n", queuelen, TCP_SND_QUEUELEN_CUR));
       goto memerr;
     }
 
@@ -424,7 +424,7 @@ tcp_output(struct tcp_pcb *pcb)
     tcphdr->seqno = htonl(pcb->snd_nxt);
     tcphdr->ackno = htonl(pcb->rcv_nxt);
     TCPH_FLAGS_SET(tcphdr, TCP_ACK);
-    tcphdr->wnd = htons(pcb->rcv_wnd);
+    tcphdr->wnd = htons(TCPWND_MIN16(RCV_WND_SCALE(pcb, pcb->rcv_wnd)));
     tcphdr->urgp = 0;
     TCPH_HDRLEN_SET(tcphdr, 5);
 
@@ -531,9 +531,12 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
   /* silly window avoidance */
   if (pcb->rcv_wnd < pcb->mss) {
     seg->tcphdr->wnd = 0;
+  } else if (TCPH_FLAGS(seg->tcphdr) & TCP_SYN) {
+    /* the window in a SYN segment is never scaled */
+    seg->tcphdr->wnd = htons(TCPWND_MIN16(pcb->rcv_wnd));
   } else {
     /* advertise our receive window size in this TCP segment */
-    seg->tcphdr->wnd = htons(pcb->rcv_wnd);
+    seg->tcphdr->wnd = htons(TCPWND_MIN16(RCV_WND_SCALE(pcb, pcb->rcv_wnd)));
   }
 
   /* If we don't have a local IP address, we get one by
@@ -597,7 +600,7 @@ tcp_rst(u32_t seqno, u32_t ackno,
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
   TCPH_FLAGS_SET(tcphdr, TCP_RST | TCP_ACK);
-  tcphdr->wnd = htons(TCP_WND);
+  tcphdr->wnd = htons(TCPWND_MIN16(TCP_WND_INIT));
   tcphdr->urgp = 0;
   TCPH_HDRLEN_SET(tcphdr, 5);
 
@@ -697,7 +700,7 @@ tcp_keepalive(struct tcp_pcb *pcb)
    tcphdr->dest = htons(pcb->remote_port);
    tcphdr->seqno = htonl(pcb->snd_nxt - 1);
    tcphdr->ackno = htonl(pcb->rcv_nxt);
-   tcphdr->wnd = htons(pcb->rcv_wnd);
+   tcphdr->wnd = htons(TCPWND_MIN16(RCV_WND_SCALE(pcb, pcb->rcv_wnd)));
    tcphdr->urgp = 0;
    TCPH_HDRLEN_SET(tcphdr, 5);
    
@@ -58,6 +58,7 @@ void memp_init(void);
 void *memp_malloc(memp_t type);
 void *memp_realloc(memp_t fromtype, memp_t totype, void *mem);
 void memp_free(memp_t type, void *mem);
+u16_t memp_add(memp_t type, u16_t num);
 
 #endif /* __LWIP_MEMP_H__  */
     
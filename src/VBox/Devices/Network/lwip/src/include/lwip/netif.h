@@ -64,6 +64,9 @@
 /** if set, the interface has an active link
  *  (set by the network interface driver) */
 #define NETIF_FLAG_LINK_UP 0x10U
+/** if set, the interface accepts IP packets for any destination
+ *  (only with LWIP_CONNECTION_PROXY) */
+#define NETIF_FLAG_PROXY 0x20U
 
 /** Generic data structure used for all lwIP network interfaces.
  *  The following fields should be filled in by the initialization
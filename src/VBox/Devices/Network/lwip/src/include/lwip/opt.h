@@ -353,6 +353,39 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCP_SNDLOWAT                    TCP_SND_BUF/2
 #endif
 
+/* Support the window scale option (RFC 1323). Needed for TCP_WND
+   above 64K. */
+#ifndef LWIP_WND_SCALE
+#define LWIP_WND_SCALE                  0
+#endif
+
+/* The shift we ask the peer to apply to our advertised window. It
+   must be large enough that TCP_WND >> TCP_RCV_SCALE fits 16 bits. */
+#ifndef TCP_RCV_SCALE
+#define TCP_RCV_SCALE                   0
+#endif
+
+/* With LWIP_WND_SCALE, TCP_WND, TCP_SND_BUF and TCP_SND_QUEUELEN are
+   only used once the application sets tcp_large_wnd, connections get
+   these and no window scaling otherwise. */
+#ifndef TCP_WND_SMALL
+#define TCP_WND_SMALL                   TCP_WND
+#endif
+
+#ifndef TCP_SND_BUF_SMALL
+#define TCP_SND_BUF_SMALL               TCP_SND_BUF
+#endif
+
+#ifndef TCP_SND_QUEUELEN_SMALL
+#define TCP_SND_QUEUELEN_SMALL          TCP_SND_QUEUELEN
+#endif
+
+/* Let interfaces flagged NETIF_FLAG_PROXY terminate TCP connections
+   to any destination, see tcp_proxy_syn(). */
+#ifndef LWIP_CONNECTION_PROXY
+#define LWIP_CONNECTION_PROXY           0
+#endif
+
 /* Support loop interface (127.0.0.1) */
 #ifndef LWIP_HAVE_LOOPIF
 #define LWIP_HAVE_LOOPIF                0
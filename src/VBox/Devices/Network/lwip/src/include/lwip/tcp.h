@@ -44,6 +44,18 @@
 
 struct tcp_pcb;
 
+#if LWIP_WND_SCALE
+/* Windows and the send buffer can exceed 64K with window scaling. */
+typedef u32_t tcpwnd_size_t;
+typedef u16_t tcpqlen_t;
+#if (TCP_WND >> TCP_RCV_SCALE) > 0xffff
+#error "TCP_RCV_SCALE is too small for TCP_WND"
+#endif
+#else
+typedef u16_t tcpwnd_size_t;
+typedef u8_t tcpqlen_t;
+#endif /* LWIP_WND_SCALE */
+
 /* Functions for interfacing with TCP: */
 
 /* Lower layer interface to TCP: */
@@ -83,6 +95,16 @@ err_t            tcp_connect (struct tcp_pcb *pcb, struct ip_addr *ipaddr,
                     struct tcp_pcb *tpcb,
                     err_t err));
 struct tcp_pcb * tcp_listen  (struct tcp_pcb *pcb);
+#if LWIP_CONNECTION_PROXY
+/* Called for a SYN arriving on a NETIF_FLAG_PROXY interface that no
+   listening PCB wants. The new PCB is in SYN_RCVD and nothing has been
+   sent yet: the application calls tcp_proxy_accept() once it has
+   reached the real destination, or tcp_abort() to refuse. Returning
+   an error refuses the connection right away. */
+typedef err_t (* tcp_proxy_syn_fn)(void *arg, struct tcp_pcb *newpcb);
+void             tcp_proxy_syn   (tcp_proxy_syn_fn syn, void *arg);
+err_t            tcp_proxy_accept(struct tcp_pcb *pcb);
+#endif /* LWIP_CONNECTION_PROXY */
 void             tcp_abort   (struct tcp_pcb *pcb);
 err_t            tcp_close   (struct tcp_pcb *pcb);
 err_t            tcp_write   (struct tcp_pcb *pcb, const void *dataptr, u16_t len,
@@ -234,10 +256,11 @@ struct tcp_pcb {
 #define TF_CLOSED    (u8_t)0x10U   /* Connection was sucessfully closed. */
 #define TF_GOT_FIN   (u8_t)0x20U   /* Connection was closed by the remote end. */
 #define TF_NODELAY   (u8_t)0x40U   /* Disable Nagle algorithm */
+#define TF_WND_SCALE (u8_t)0x80U   /* Window scale option in use. */
 
   /* receiver variables */
   u32_t rcv_nxt;   /* next seqno expected */
-  u16_t rcv_wnd;   /* receiver window */
+  tcpwnd_size_t rcv_wnd;   /* receiver window */
   
   /* Timers */
   u32_t tmr;
@@ -261,8 +284,8 @@ struct tcp_pcb {
   u8_t dupacks;
   
   /* congestion avoidance/control variables */
-  u16_t cwnd;  
-  u16_t ssthresh;
+  tcpwnd_size_t cwnd;  
+  tcpwnd_size_t ssthresh;
 
   /* sender variables */
   u32_t snd_nxt,       /* next seqno to be sent */
@@ -272,10 +295,15 @@ struct tcp_pcb {
        window update. */
     snd_lbb;       /* Sequence number of next byte to be buffered. */
 
-  u16_t acked;
+  tcpwnd_size_t acked;
   
-  u16_t snd_buf;   /* Available buffer space for sending (in bytes). */
-  u8_t snd_queuelen; /* Available buffer space for sending (in tcp_segs). */
+  tcpwnd_size_t snd_buf;   /* Available buffer space for sending (in bytes). */
+  tcpqlen_t snd_queuelen; /* Available buffer space for sending (in tcp_segs). */
+
+#if LWIP_WND_SCALE
+  u8_t snd_scale;  /* Shift applied to the peer's advertised window. */
+  u8_t rcv_scale;  /* Shift the peer applies to our advertised window. */
+#endif /* LWIP_WND_SCALE */
   
   
   /* These are ordered by sequence number: */
@@ -387,6 +415,26 @@ err_t lwip_tcp_event(void *arg, struct tcp_pcb *pcb,
                         (errf)((arg),(err))
 #endif /* LWIP_EVENT_API */
 
+#if LWIP_WND_SCALE
+/* Set by the application before creating any PCB to use TCP_WND,
+   TCP_SND_BUF and window scaling instead of the _SMALL values. */
+extern u8_t tcp_large_wnd;
+#define TCP_LARGE_WND           tcp_large_wnd
+#define RCV_WND_SCALE(pcb, wnd) ((wnd) >> (pcb)->rcv_scale)
+#define SND_WND_SCALE(pcb, wnd) ((u32_t)(wnd) << (pcb)->snd_scale)
+#define TCPWND_MIN16(x)         ((u16_t)((x) < 0xffff ? (x) : 0xffff))
+#else
+#define TCP_LARGE_WND           0
+#define RCV_WND_SCALE(pcb, wnd) (wnd)
+#define SND_WND_SCALE(pcb, wnd) (wnd)
+#define TCPWND_MIN16(x)         ((u16_t)(x))
+#endif /* LWIP_WND_SCALE */
+#define TCP_WND_INIT            ((tcpwnd_size_t)(TCP_LARGE_WND ? TCP_WND : TCP_WND_SMALL))
+#define TCP_SND_BUF_INIT        ((tcpwnd_size_t)(TCP_LARGE_WND ? TCP_SND_BUF : TCP_SND_BUF_SMALL))
+#define TCP_SND_QUEUELEN_CUR    (TCP_LARGE_WND ? TCP_SND_QUEUELEN : TCP_SND_QUEUELEN_SMALL)
+/* Without the option the window is limited to 16 bits. */
+#define TCP_WND_MAX(pcb)        ((tcpwnd_size_t)((pcb)->flags & TF_WND_SCALE ? TCP_WND : TCPWND_MIN16(TCP_WND_INIT)))
+
 /* This structure represents a TCP segment on the unsent and unacked queues */
 struct tcp_seg {
   struct tcp_seg *next;    /* used when putting segements on a queue */
@@ -423,6 +471,8 @@ err_t tcp_enqueue(struct tcp_pcb *pcb, void *dataptr, u16_t len,
 
 void tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg);
 
+u8_t tcp_build_syn_opts(struct tcp_pcb *pcb, u32_t *optdata, u8_t wnd_scale);
+
 void tcp_rst(u32_t seqno, u32_t ackno,
        struct ip_addr *local_ip, struct ip_addr *remote_ip,
        u16_t local_port, u16_t remote_port);
@@ -29,8 +29,21 @@
 /** Increase PBUF buffer size. */
 #define PBUF_POOL_BUFSIZE 1536
 
-/** Increase maximum TCP window size. */
-#define TCP_WND 32768
+/** Maximum TCP window size. Only the NAT engine (DrvNATlwIP.cpp) uses it,
+ * by setting tcp_large_wnd. It wants large windows towards the guest, which
+ * takes the window scale option. */
+#define TCP_WND (256 * 1024)
+
+/** Increase TCP window size, the window everyone else (DevINIP) uses. */
+#define TCP_WND_SMALL 32768
+
+/** Enable the window scale option, TCP_WND does not fit 16 bits. It is only
+ * offered and accepted with tcp_large_wnd set. */
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE 3
+
+/** Let the NAT engine terminate guest connections to any address. */
+#define LWIP_CONNECTION_PROXY 1
 
 /** Increase TCP maximum segment size. */
 #define TCP_MSS 1400
@@ -38,19 +51,29 @@
 /** Enable queueing of out-of-order segments. */
 #define TCP_QUEUE_OOSEQ 1
 
-/** TCP send buffer space. */
-#define TCP_SND_BUF 32768
+/** TCP send buffer space, with tcp_large_wnd set. */
+#define TCP_SND_BUF (256 * 1024)
 
-/** TCP send buffer space (in pbufs). */
+/** TCP send buffer space (in pbufs), with tcp_large_wnd set. */
 #define TCP_SND_QUEUELEN 2*TCP_SND_BUF/TCP_MSS
 
+/** TCP send buffer space, without tcp_large_wnd. */
+#define TCP_SND_BUF_SMALL 32768
+
+/** TCP send buffer space (in pbufs), without tcp_large_wnd. */
+#define TCP_SND_QUEUELEN_SMALL 2*TCP_SND_BUF_SMALL/TCP_MSS
+
+/** TCP writable space for the sockets API, which only DevINIP uses. */
+#define TCP_SNDLOWAT TCP_SND_BUF_SMALL/2
+
 /** Increase maximum pool size for PBUF. */
 #define MEMP_NUM_PBUF 64
 
 /** Increase maximum pool size for TCPIP messages. Default of 8 is too low. */
 #define MEMP_NUM_TCPIP_MSG 32
 
-/** Increase maximum number of queued TCP segments. Needed for large sends. */
+/** Increase maximum number of queued TCP segments. Needed for large sends.
+ * The NAT engine adds more with memp_add. */
 #define MEMP_NUM_TCP_SEG 255
 
 /** Turn on support for lightweight critical region protection. Leaving this
@@ -197,6 +220,7 @@
 #define memp_free lwip_memp_free
 #define memp_init lwip_memp_init
 #define memp_malloc lwip_memp_malloc
+#define memp_add lwip_memp_add
 #define pbuf_alloc lwip_pbuf_alloc
 #define pbuf_cat lwip_pbuf_cat
 #define pbuf_chain lwip_pbuf_chain
@@ -246,6 +270,7 @@
 #define tcp_arg lwip_tcp_arg
 #define tcp_backoff lwip_tcp_backoff
 #define tcp_bind lwip_tcp_bind
+#define tcp_build_syn_opts lwip_tcp_build_syn_opts
 #define tcp_close lwip_tcp_close
 #define tcp_connect lwip_tcp_connect
 #define tcp_enqueue lwip_tcp_enqueue
@@ -255,6 +280,7 @@
 #define tcp_input lwip_tcp_input
 #define tcp_input_pcb lwip_tcp_input_pcb
 #define tcp_keepalive lwip_tcp_keepalive
+#define tcp_large_wnd lwip_tcp_large_wnd
 #define tcp_listen lwip_tcp_listen
 #define tcp_listen_pcbs lwip_tcp_listen_pcbs
 #define tcp_new lwip_tcp_new
@@ -263,6 +289,8 @@
 #define tcp_pcb_purge lwip_tcp_pcb_purge
 #define tcp_pcb_remove lwip_tcp_pcb_remove
 #define tcp_poll lwip_tcp_poll
+#define tcp_proxy_accept lwip_tcp_proxy_accept
+#define tcp_proxy_syn lwip_tcp_proxy_syn
 #define tcp_recv lwip_tcp_recv
 #define tcp_recved lwip_tcp_recved
 #define tcp_rexmit lwip_tcp_rexmit
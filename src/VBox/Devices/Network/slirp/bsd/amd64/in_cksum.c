@@ -49,6 +49,7 @@ __FBSDID("$FreeBSD: src/sys/amd64/amd64/in_cksum.c,v 1.5.20.1 2009/04/15 03:14:2
 #include <netinet/ip.h>
 #include <machine/in_cksum.h>
 #else
+# include <iprt/net.h> /* before slirp.h, its icmp macros get in the way */
 # include "in_cksum.h"
 # include "slirp.h"
 #endif
@@ -195,6 +196,45 @@ in_pseudo(u_int32_t a, u_int32_t b, u_int32_t c)
 	return (sum);
 }
 
+#ifdef VBOX
+/*
+ * Leave the summing to IPRT which does it with SSE2 on this architecture.
+ * The odd flag plays the role of clen below, it keeps track of whether the
+ * next mbuf starts in the middle of a 16-bit word.
+ */
+u_short
+in_cksum_skip(struct mbuf *m, int len, int skip)
+{
+	uint32_t u32Sum = 0;
+	bool fOdd = false;
+	int mlen = 0;
+	caddr_t addr;
+
+        len -= skip;
+        for (; skip && m; m = m->m_next) {
+                if (m->m_len > skip) {
+                        mlen = m->m_len - skip;
+			addr = mtod(m, caddr_t) + skip;
+                        goto skip_start;
+                } else {
+                        skip -= m->m_len;
+                }
+        }
+
+	for (; m && len; m = m->m_next) {
+		if (m->m_len == 0)
+			continue;
+		mlen = m->m_len;
+		addr = mtod(m, caddr_t);
+skip_start:
+		if (len < mlen)
+			mlen = len;
+		u32Sum = RTNetIPv4AddDataChecksum(addr, mlen, u32Sum, &fOdd);
+		len -= mlen;
+	}
+	return RTNetIPv4FinalizeChecksum(u32Sum);
+}
+#else /* !VBOX */
 u_short
 in_cksum_skip(struct mbuf *m, int len, int skip)
 {
@@ -235,6 +275,7 @@ skip_start:
 	REDUCE16;
 	return (~sum & 0xffff);
 }
+#endif /* !VBOX */
 
 u_int in_cksum_hdr(const struct ip *ip)
 {
@@ -70,6 +70,13 @@ COUNTING_COUNTER(TCP, "TCP sockets");
 COUNTING_COUNTER(TCPHot, "TCP sockets active");
 COUNTING_COUNTER(UDP, "UDP sockets");
 COUNTING_COUNTER(UDPHot, "UDP sockets active");
+COUNTING_COUNTER(SoHashLookup, "Socket lookups done through the connection hash");
+COUNTING_COUNTER(SoHashProbe, "Sockets compared during hashed lookups");
+COUNTING_COUNTER(SoHashGrow, "Connection hash resizes");
+# ifdef VBOX_WITH_NAT_EPOLL
+COUNTING_COUNTER(EpollCtl, "epoll_ctl calls issued to update socket registrations");
+COUNTING_COUNTER(EpollReady, "Socket events returned by epoll_wait");
+# endif
 
 COUNTING_COUNTER(IORead_in_1, "SB IORead_in_1");
 COUNTING_COUNTER(IORead_in_1_bytes, "SB IORead_in_1_bytes");
@@ -99,9 +106,24 @@ COUNTING_COUNTER(IOSBAppendSB, "SB: AppendSB total");
 COUNTING_COUNTER(IOSBAppendSB_w_l_r, "SB: AppendSB (sb_wptr < sb_rptr)");
 COUNTING_COUNTER(IOSBAppendSB_w_ge_r, "SB: AppendSB (sb_wptr >= sb_rptr)");
 COUNTING_COUNTER(IOSBAppendSB_w_alter, "SB: AppendSB (altering of sb_wptr)");
+COUNTING_COUNTER(IOSBCopy_bytes, "SB: bytes copied into the buffer");
+COUNTING_COUNTER(IOSBRef, "SB: mbufs held by reference");
+COUNTING_COUNTER(IOSBRef_bytes, "SB: bytes held by reference");
+COUNTING_COUNTER(IOSBRefLimit, "SB: mbufs copied because too many are held by reference");
+COUNTING_COUNTER(IOUdpRecvTmp, "SB: UDP datagrams received through a temporary buffer");
 COUNTING_COUNTER(MBufAllocation,"MBUF::shows number of mbufs in used list");
 
+COUNTING_COUNTER(DnsCacheHit, "DNS: answered from the cache");
+COUNTING_COUNTER(DnsCacheNegHit, "DNS: answered from the cache (negative)");
+COUNTING_COUNTER(DnsCacheMiss, "DNS: not in the cache");
+COUNTING_COUNTER(DnsCacheExpired, "DNS: expired in the cache");
+COUNTING_COUNTER(DnsCacheStored, "DNS: responses stored in the cache");
+COUNTING_COUNTER(DnsCacheEvicted, "DNS: responses evicted from the full cache");
+COUNTING_COUNTER(DnsCoalesced, "DNS: queries coalesced with one in flight");
+COUNTING_COUNTER(DnsHostResAsync, "DNS: lookups passed to the host resolver thread");
+
 COUNTING_COUNTER(TCP_retransmit, "TCP::retransmit");
+COUNTING_COUNTER(TCP_gso, "TCP::segments larger than the MTU handed to the device");
 
 PROFILE_COUNTER(TCP_reassamble, "TCP::reasamble");
 PROFILE_COUNTER(TCP_input, "TCP::input");
@@ -116,6 +138,11 @@ PROFILE_COUNTER(ALIAS_output, "ALIAS::output");
 DRV_COUNTING_COUNTER(NATRecvWakeups, "counting wakeups of NAT RX thread");
 DRV_PROFILE_COUNTER(NATRecv,"Time spent in NATRecv worker");
 DRV_PROFILE_COUNTER(NATRecvWait,"Time spent in NATRecv worker in waiting of free RX buffers");
+DRV_COUNTING_COUNTER(NATRecvGso, "counting GSO frames passed to the device as is");
+DRV_COUNTING_COUNTER(NATRecvGsoSegmented, "counting GSO frames segmented because the device refused them");
+DRV_COUNTING_COUNTER(NATSendGso, "counting GSO frames received from the device");
+DRV_COUNTING_COUNTER(NATRecvBatch, "counting frame batches passed to the device");
+DRV_COUNTING_COUNTER(NATSendBatch, "counting frame batches received from the device");
 DRV_COUNTING_COUNTER(QueuePktSent, "counting packet sent via PDM Queue");
 DRV_COUNTING_COUNTER(QueuePktDropped, "counting packet drops by PDM Queue");
 DRV_COUNTING_COUNTER(ConsumerFalse, "counting consumer's reject number to process the queue's item");
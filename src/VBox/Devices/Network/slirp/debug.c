@@ -358,8 +358,9 @@ printSbuf(PFNRTSTROUTPUT pfnOutput, void *pvArgOutput,
     size_t cb = 0;
     const struct sbuf *sb = (struct sbuf *)pvValue;
     AssertReturn(RTStrCmp(pszType, "sbuf") == 0, 0);
-    cb += RTStrFormat(pfnOutput, pvArgOutput, NULL, 0, "[sbuf:%p cc:%d, datalen:%d, wprt:%p, rptr:%p data:%p]",
-                      sb, sb->sb_cc, sb->sb_datalen, sb->sb_wptr, sb->sb_rptr, sb->sb_data);
+    cb += RTStrFormat(pfnOutput, pvArgOutput, NULL, 0, "[sbuf:%p cc:%d, datalen:%d, wprt:%p, rptr:%p data:%p mbcc:%d mbcnt:%d]",
+                      sb, sb->sb_cc, sb->sb_datalen, sb->sb_wptr, sb->sb_rptr, sb->sb_data,
+                      sb->sb_mbcc, sb->sb_mbcnt);
     return cb;
 }
 
@@ -0,0 +1,338 @@
+/* $Id$ */
+/** @file
+ * NAT - DNS response cache used by dnsproxy and the host resolver.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*
+ * The cache keeps complete responses keyed by their (only) question. On a
+ * hit the stored response is handed out with the id, the RD bit and the
+ * spelling of the question taken from the query, and with all TTLs reduced
+ * by the time the response spent in the cache. Negative responses (NXDOMAIN
+ * and NODATA) are kept for the SOA minimum of the authority section (RFC 2308).
+ *
+ * The cache is only touched on the NAT thread.
+ */
+
+#include "slirp.h"
+#include <iprt/ctype.h>
+
+#define DNS_HDR_LEN         12
+#define DNS_TYPE_SOA        6
+#define DNS_TYPE_OPT        41
+#define DNS_RCODE_NXDOMAIN  3
+/* classic (non EDNS) limit of a response over UDP */
+#define DNS_UDP_MAXLEN      512
+
+struct dns_cache_entry
+{
+    LIST_ENTRY(dns_cache_entry) dce_hash;
+    TAILQ_ENTRY(dns_cache_entry) dce_lru;
+    uint32_t dce_qhash;         /* hash of the question */
+    uint32_t dce_stored;        /* curtime when the entry was stored */
+    uint32_t dce_expire;        /* curtime when the entry expires */
+    bool     dce_negative;      /* NXDOMAIN or NODATA */
+    int      dce_qlen;          /* length of the question */
+    int      dce_len;           /* length of the response */
+    uint8_t  dce_msg[1];        /* the response */
+};
+
+/*
+ * Returns the offset following the name at off or -1 if the name
+ * doesn't fit in the message
+ */
+static int
+dnscache_skip_name(const uint8_t *pb, int cb, int off)
+{
+    while (off < cb)
+    {
+        uint8_t cbLabel = pb[off];
+        if (cbLabel == 0)
+            return off + 1;
+        if ((cbLabel & 0xc0) == 0xc0)
+            return off + 2 <= cb ? off + 2 : -1;
+        if (cbLabel & 0xc0)
+            return -1;
+        off += cbLabel + 1;
+    }
+    return -1;
+}
+
+/*
+ * Returns the length of the question section of a message carrying exactly
+ * one question or -1
+ */
+int
+dnscache_qlen(const char *msg, int cb)
+{
+    const uint8_t *pb = (const uint8_t *)msg;
+    int off;
+
+    if (cb < DNS_HDR_LEN || pb[4] != 0 || pb[5] != 1)
+        return -1;
+    off = dnscache_skip_name(pb, cb, DNS_HDR_LEN);
+    if (off < 0 || off + 4 > cb)
+        return -1;
+    return off + 4 - DNS_HDR_LEN;
+}
+
+uint32_t
+dnscache_qhash(const char *msg, int qlen)
+{
+    const uint8_t *pb = (const uint8_t *)msg + DNS_HDR_LEN;
+    uint32_t u32Hash = 2166136261U;
+    int i;
+    for (i = 0; i < qlen; i++)
+        u32Hash = (u32Hash ^ RT_C_TO_LOWER(pb[i])) * 16777619U;
+    return u32Hash;
+}
+
+/*
+ * Names are compared ignoring the case, label lengths are never letters
+ */
+bool
+dnscache_qequal(const char *msg1, const char *msg2, int qlen)
+{
+    const uint8_t *pb1 = (const uint8_t *)msg1 + DNS_HDR_LEN;
+    const uint8_t *pb2 = (const uint8_t *)msg2 + DNS_HDR_LEN;
+    int i;
+    for (i = 0; i < qlen; i++)
+        if (RT_C_TO_LOWER(pb1[i]) != RT_C_TO_LOWER(pb2[i]))
+            return false;
+    return true;
+}
+
+/*
+ * Walks the resource records following the question. Subtracts cSecAge from
+ * every TTL and reports the smallest TTL and the SOA based negative TTL.
+ */
+static int
+dnscache_walk_rrs(uint8_t *pb, int cb, int qlen, uint32_t cSecAge,
+                  uint32_t *pcSecMin, uint32_t *pcSecNeg)
+{
+    int cRRs[3];
+    int iSection;
+    int off = DNS_HDR_LEN + qlen;
+
+    cRRs[0] = RT_MAKE_U16(pb[7], pb[6]);    /* answer */
+    cRRs[1] = RT_MAKE_U16(pb[9], pb[8]);    /* authority */
+    cRRs[2] = RT_MAKE_U16(pb[11], pb[10]);  /* additional */
+    *pcSecMin = UINT32_MAX;
+    *pcSecNeg = UINT32_MAX;
+
+    for (iSection = 0; iSection < 3; iSection++)
+    {
+        int i;
+        for (i = 0; i < cRRs[iSection]; i++)
+        {
+            uint16_t u16Type;
+            uint16_t cbRData;
+            uint32_t cSecTtl;
+
+            off = dnscache_skip_name(pb, cb, off);
+            if (off < 0 || off + 10 > cb)
+                return -1;
+            u16Type = RT_MAKE_U16(pb[off + 1], pb[off]);
+            cbRData = RT_MAKE_U16(pb[off + 9], pb[off + 8]);
+            if (off + 10 + cbRData > cb)
+                return -1;
+
+            /* the TTL of the OPT pseudo record carries flags */
+            if (u16Type != DNS_TYPE_OPT)
+            {
+                cSecTtl = RT_MAKE_U32_FROM_U8(pb[off + 7], pb[off + 6], pb[off + 5], pb[off + 4]);
+                if (cSecAge)
+                {
+                    cSecTtl = cSecTtl > cSecAge ? cSecTtl - cSecAge : 0;
+                    pb[off + 4] = (uint8_t)(cSecTtl >> 24);
+                    pb[off + 5] = (uint8_t)(cSecTtl >> 16);
+                    pb[off + 6] = (uint8_t)(cSecTtl >> 8);
+                    pb[off + 7] = (uint8_t)cSecTtl;
+                }
+                *pcSecMin = RT_MIN(*pcSecMin, cSecTtl);
+                if (   iSection == 1
+                    && u16Type == DNS_TYPE_SOA
+                    && cbRData >= 20)
+                {
+                    /* MINIMUM is the last field of the SOA rdata */
+                    const uint8_t *pbMin = &pb[off + 10 + cbRData - 4];
+                    uint32_t cSecSoaMin = RT_MAKE_U32_FROM_U8(pbMin[3], pbMin[2], pbMin[1], pbMin[0]);
+                    *pcSecNeg = RT_MIN(*pcSecNeg, RT_MIN(cSecTtl, cSecSoaMin));
+                }
+            }
+            off += 10 + cbRData;
+        }
+    }
+    return 0;
+}
+
+static void
+dnscache_remove(PNATState pData, struct dns_cache_entry *pEntry)
+{
+    LIST_REMOVE(pEntry, dce_hash);
+    TAILQ_REMOVE(&pData->dns_cache_lru, pEntry, dce_lru);
+    pData->cDnsCacheEntries--;
+    RTMemFree(pEntry);
+}
+
+static struct dns_cache_entry *
+dnscache_find(PNATState pData, const char *msg, int qlen, uint32_t u32Hash)
+{
+    struct dns_cache_entry *pEntry;
+    LIST_FOREACH(pEntry, &pData->dns_cache[u32Hash % DNS_CACHE_HASHSIZE], dce_hash)
+    {
+        if (   pEntry->dce_qhash == u32Hash
+            && pEntry->dce_qlen == qlen
+            && dnscache_qequal((const char *)pEntry->dce_msg, msg, qlen))
+            return pEntry;
+    }
+    return NULL;
+}
+
+void
+dnscache_init(PNATState pData)
+{
+    int i;
+    for (i = 0; i < DNS_CACHE_HASHSIZE; i++)
+        LIST_INIT(&pData->dns_cache[i]);
+    TAILQ_INIT(&pData->dns_cache_lru);
+    pData->cDnsCacheEntries = 0;
+}
+
+void
+dnscache_flush(PNATState pData)
+{
+    while (!TAILQ_EMPTY(&pData->dns_cache_lru))
+        dnscache_remove(pData, TAILQ_FIRST(&pData->dns_cache_lru));
+}
+
+/*
+ * Builds the answer to query in answer if the cache holds one. Returns
+ * the length of the answer or 0. query and answer may be the same buffer.
+ */
+int
+dnscache_answer(PNATState pData, const char *query, int cbQuery, char *answer, int cbAnswerMax)
+{
+    struct dns_cache_entry *pEntry;
+    uint8_t abHdr[DNS_HDR_LEN];
+    uint32_t cSecMin, cSecNeg;
+    int qlen;
+
+    qlen = dnscache_qlen(query, cbQuery);
+    if (qlen < 0)
+        return 0;
+    pEntry = dnscache_find(pData, query, qlen, dnscache_qhash(query, qlen));
+    if (!pEntry)
+    {
+        STAM_COUNTER_INC(&pData->StatDnsCacheMiss);
+        return 0;
+    }
+    if ((int32_t)(curtime - pEntry->dce_expire) >= 0)
+    {
+        STAM_COUNTER_INC(&pData->StatDnsCacheExpired);
+        dnscache_remove(pData, pEntry);
+        return 0;
+    }
+    /* without EDNS the client can't take more than 512 bytes */
+    if (   pEntry->dce_len > cbAnswerMax
+        || (   pEntry->dce_len > DNS_UDP_MAXLEN
+            && query[10] == 0 && query[11] == 0))
+    {
+        STAM_COUNTER_INC(&pData->StatDnsCacheMiss);
+        return 0;
+    }
+
+    memcpy(abHdr, query, sizeof(abHdr));
+    if (answer != query)
+        memcpy(&answer[DNS_HDR_LEN], &query[DNS_HDR_LEN], qlen);
+    memcpy(answer, pEntry->dce_msg, DNS_HDR_LEN);
+    memcpy(&answer[DNS_HDR_LEN + qlen], &pEntry->dce_msg[DNS_HDR_LEN + qlen],
+           pEntry->dce_len - DNS_HDR_LEN - qlen);
+    /* id and RD come from the query */
+    answer[0] = abHdr[0];
+    answer[1] = abHdr[1];
+    answer[2] = (answer[2] & ~0x01) | (abHdr[2] & 0x01);
+    dnscache_walk_rrs((uint8_t *)answer, pEntry->dce_len, qlen,
+                      (curtime - pEntry->dce_stored) / 1000, &cSecMin, &cSecNeg);
+
+    TAILQ_REMOVE(&pData->dns_cache_lru, pEntry, dce_lru);
+    TAILQ_INSERT_HEAD(&pData->dns_cache_lru, pEntry, dce_lru);
+    if (pEntry->dce_negative)
+        STAM_COUNTER_INC(&pData->StatDnsCacheNegHit);
+    else
+        STAM_COUNTER_INC(&pData->StatDnsCacheHit);
+    return pEntry->dce_len;
+}
+
+/*
+ * Stores a response, cSecTtlMax limits how long it is kept
+ */
+void
+dnscache_store(PNATState pData, const char *msg, int cb, uint32_t cSecTtlMax)
+{
+    struct dns_cache_entry *pEntry;
+    const uint8_t *pb = (const uint8_t *)msg;
+    uint32_t u32Hash;
+    uint32_t cSecMin, cSecNeg, cSecTtl;
+    uint8_t u8RCode;
+    bool fNegative;
+    int qlen;
+
+    qlen = dnscache_qlen(msg, cb);
+    if (qlen < 0)
+        return;
+    /* responses only, no truncated ones, no failures */
+    u8RCode = pb[3] & 0x0f;
+    if (   !(pb[2] & 0x80)
+        || (pb[2] & 0x02)
+        || (u8RCode != 0 && u8RCode != DNS_RCODE_NXDOMAIN))
+        return;
+    if (dnscache_walk_rrs((uint8_t *)msg, cb, qlen, 0, &cSecMin, &cSecNeg) < 0)
+        return;
+
+    fNegative = u8RCode == DNS_RCODE_NXDOMAIN || (pb[6] == 0 && pb[7] == 0);
+    if (fNegative)
+        cSecTtl = cSecNeg != UINT32_MAX ? cSecNeg : DNS_CACHE_NEG_TTL;
+    else
+        cSecTtl = cSecMin;
+    cSecTtl = RT_MIN(cSecTtl, fNegative ? DNS_CACHE_NEG_TTL_MAX : DNS_CACHE_TTL_MAX);
+    cSecTtl = RT_MIN(cSecTtl, cSecTtlMax);
+    if (cSecTtl == 0)
+        return;
+
+    u32Hash = dnscache_qhash(msg, qlen);
+    pEntry = dnscache_find(pData, msg, qlen, u32Hash);
+    if (pEntry)
+        dnscache_remove(pData, pEntry);
+    else if (pData->cDnsCacheEntries >= DNS_CACHE_MAX)
+    {
+        STAM_COUNTER_INC(&pData->StatDnsCacheEvicted);
+        dnscache_remove(pData, TAILQ_LAST(&pData->dns_cache_lru, dns_cache_lru));
+    }
+
+    pEntry = RTMemAlloc(sizeof(struct dns_cache_entry) + cb);
+    if (!pEntry)
+        return;
+    pEntry->dce_qhash = u32Hash;
+    pEntry->dce_stored = curtime;
+    pEntry->dce_expire = curtime + cSecTtl * 1000;
+    pEntry->dce_negative = fNegative;
+    pEntry->dce_qlen = qlen;
+    pEntry->dce_len = cb;
+    memcpy(pEntry->dce_msg, msg, cb);
+    LIST_INSERT_HEAD(&pData->dns_cache[u32Hash % DNS_CACHE_HASHSIZE], pEntry, dce_hash);
+    TAILQ_INSERT_HEAD(&pData->dns_cache_lru, pEntry, dce_lru);
+    pData->cDnsCacheEntries++;
+    STAM_COUNTER_INC(&pData->StatDnsCacheStored);
+}
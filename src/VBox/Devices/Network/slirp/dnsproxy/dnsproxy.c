@@ -85,6 +85,79 @@ signal_event(void)
 
 # define QUERYID queryid++
 
+/* max # of clients waiting for the answer to a query in flight */
+# define MAX_WAITERS 64
+
+/* dnsproxy_reply -- Sends a DNS message to a guest client on behalf of the
+ * DNS alias address, with the id replaced by clientid.
+ */
+static void
+dnsproxy_reply(PNATState pData, struct sockaddr_in *client, unsigned short clientid,
+               const char *buf, int byte)
+{
+    struct sockaddr_in src;
+    struct mbuf *m = slirpDnsMbufAlloc(pData);
+    if (m == NULL)
+    {
+        ++dropped_answers;
+        return;
+    }
+    m->m_data += if_maxlinkhdr + sizeof(struct udpiphdr);
+    if (byte > M_TRAILINGSPACE(m))
+    {
+        m_freem(pData, m);
+        ++dropped_answers;
+        return;
+    }
+    memcpy(mtod(m, char *), buf, byte);
+    memcpy(mtod(m, char *), &clientid, 2);
+    m->m_len = byte;
+
+    src.sin_addr.s_addr = RT_H2N_U32(RT_N2H_U32(pData->special_addr.s_addr) | CTL_DNS);
+    src.sin_port = RT_H2N_U16_C(53);
+    udp_output2(pData, NULL, m, &src, client, IPTOS_LOWDELAY);
+    ++answered_queries;
+}
+
+/* dnsproxy_cached -- Answers the query from the cache. Returns 1 if it did.
+ */
+static int
+dnsproxy_cached(PNATState pData, struct sockaddr_in *client, const char *buf, int byte)
+{
+    struct sockaddr_in src;
+    int cb;
+    struct mbuf *m = slirpDnsMbufAlloc(pData);
+    if (m == NULL)
+        return 0;
+    m->m_data += if_maxlinkhdr + sizeof(struct udpiphdr);
+    cb = dnscache_answer(pData, buf, byte, mtod(m, char *), M_TRAILINGSPACE(m));
+    if (cb == 0)
+    {
+        m_freem(pData, m);
+        return 0;
+    }
+    m->m_len = cb;
+
+    src.sin_addr.s_addr = RT_H2N_U32(RT_N2H_U32(pData->special_addr.s_addr) | CTL_DNS);
+    src.sin_port = RT_H2N_U16_C(53);
+    udp_output2(pData, NULL, m, &src, client, IPTOS_LOWDELAY);
+    ++answered_queries;
+    return 1;
+}
+
+/* request_free -- Frees the request together with its waiters.
+ */
+static void
+request_free(struct request *req)
+{
+    while (req->waiters)
+    {
+        struct waiter *w = req->waiters;
+        req->waiters = w->next;
+        RTMemFree(w);
+    }
+    RTMemFree(req);
+}
 #endif
 /* timeout -- Called by the event loop when a query times out. Removes the
  * query from the queue.
@@ -110,7 +183,7 @@ timeout(PNATState pData, struct socket *so, void *arg)
     if (de == NULL)
     {
         hash_remove_request(pData, req);
-        RTMemFree(req);
+        request_free(req);
         ++removed_queries;
     }
     else
@@ -158,6 +231,7 @@ timeout(PNATState pData, struct socket *so, void *arg)
         so1->so_lport = so->so_lport;
         so1->so_faddr = so->so_faddr;
         so1->so_fport = so->so_fport;
+        sohashinsert(pData, so1, &udb);
         req->dns_server = de;
         so1->so_timeout_arg = req;
         so1->so_timeout = timeout;
@@ -250,6 +324,37 @@ dnsproxy_query(PNATState pData, struct socket *so, struct mbuf *m, int iphlen)
     memcpy(&req->client, &fromaddr, sizeof(struct sockaddr_in));
     memcpy(&req->clientid, &buf[0], 2);
 #else
+    if (so->so_timeout_arg == NULL)
+    {
+        struct request *inflight;
+
+        /* we might know the answer already */
+        if (dnsproxy_cached(pData, &fromaddr, buf, byte))
+        {
+            so->so_expire = curtime + SO_EXPIREFAST;
+            return;
+        }
+
+        /* or somebody asked the same and waits for the answer */
+        inflight = hash_find_question(pData, buf, byte);
+        if (   inflight != NULL
+            && inflight->nwaiters < MAX_WAITERS)
+        {
+            struct waiter *w = RTMemAlloc(sizeof(struct waiter));
+            if (w != NULL)
+            {
+                memcpy(&w->client, &fromaddr, sizeof(struct sockaddr_in));
+                memcpy(&w->clientid, &buf[0], 2);
+                w->next = inflight->waiters;
+                inflight->waiters = w;
+                inflight->nwaiters++;
+                STAM_COUNTER_INC(&pData->StatDnsCoalesced);
+                so->so_expire = curtime + SO_EXPIREFAST;
+                return;
+            }
+        }
+    }
+
     /* allocate new request */
     req = so->so_timeout_arg; /* in slirp we might re-send the query*/
     if (req == NULL)
@@ -308,7 +413,10 @@ dnsproxy_query(PNATState pData, struct socket *so, struct mbuf *m, int iphlen)
     req->recursion = 0;
     DPRINTF(("External query RD=%d\n", RD(buf)));
     if (retransmit == 0)
+    {
         hash_add_request(pData, req);
+        hash_add_question(pData, req);
+    }
 #endif
 
     /* overwrite the original query id */
@@ -444,6 +552,19 @@ dnsproxy_answer(PNATState pData, struct socket *so, struct mbuf *m)
     /* restore original query id */
     memcpy(&buf[0], &query->clientid, 2);
 
+#ifdef VBOX
+    dnscache_store(pData, buf, byte, DNS_CACHE_TTL_MAX);
+
+    /* the clients which asked the same meanwhile get a copy */
+    while (query->waiters)
+    {
+        struct waiter *w = query->waiters;
+        query->waiters = w->next;
+        dnsproxy_reply(pData, &w->client, w->clientid, buf, byte);
+        RTMemFree(w);
+    }
+#endif
+
 #ifndef VBOX
     /* Slirp: will send mbuf to guest by itself */
     /* send answer back to querying host */
@@ -459,7 +580,7 @@ dnsproxy_answer(PNATState pData, struct socket *so, struct mbuf *m)
 #else
     ++answered_queries;
 
-    RTMemFree(query);
+    request_free(query);
 #endif
 }
 
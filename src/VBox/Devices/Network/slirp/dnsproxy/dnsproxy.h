@@ -63,6 +63,15 @@
 #endif
 #endif
 
+#ifdef VBOX
+/* a client whose query was coalesced with an identical one in flight */
+struct waiter {
+    struct waiter       *next;
+    struct sockaddr_in  client;
+    unsigned short      clientid;
+};
+#endif
+
 struct request {
     unsigned short      id;
 
@@ -83,6 +92,13 @@ struct request {
      * initializate with first server in the list
      */
     struct dns_entry    *dns_server;
+    /* chaining in the question hash */
+    struct request      **qprev;
+    struct request      *qnext;
+    unsigned int        qhash;
+    int                 qlen;
+    struct waiter       *waiters;
+    int                 nwaiters;
     int nbyte; /* length of dns request */
     char byte[1]; /* copy of original request */
 #endif
@@ -125,6 +141,23 @@ int daemon(int, int);
 void hash_add_request(PNATState, struct request *);
 void hash_remove_request(PNATState, struct request *);
 struct request *hash_find_request(PNATState, unsigned short);
+#ifdef VBOX
+void hash_add_question(PNATState, struct request *);
+struct request *hash_find_question(PNATState, const char *, int);
+
+/* cache.c */
+# define DNS_CACHE_MAX          512     /* max # of cached responses */
+# define DNS_CACHE_TTL_MAX      86400   /* seconds */
+# define DNS_CACHE_NEG_TTL      30      /* negative response without SOA */
+# define DNS_CACHE_NEG_TTL_MAX  900
+void dnscache_init(PNATState);
+void dnscache_flush(PNATState);
+int dnscache_answer(PNATState, const char *, int, char *, int);
+void dnscache_store(PNATState, const char *, int, uint32_t);
+int dnscache_qlen(const char *, int);
+uint32_t dnscache_qhash(const char *, int);
+bool dnscache_qequal(const char *, const char *, int);
+#endif
 
 /* internal.c */
 int add_internal(PNATState, char *);
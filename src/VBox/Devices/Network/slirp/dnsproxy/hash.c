@@ -57,6 +57,14 @@ hash_remove_request(PNATState pData, struct request *req)
         req->next->prev = req->prev;
     *req->prev = req->next;
     req->prev = NULL;
+#ifdef VBOX
+    if (req->qprev) {
+        if (req->qnext)
+            req->qnext->qprev = req->qprev;
+        *req->qprev = req->qnext;
+        req->qprev = NULL;
+    }
+#endif
 
     --active_queries;
 }
@@ -75,3 +83,46 @@ hash_find_request(PNATState pData, unsigned short id)
 
     return req;
 }
+
+#ifdef VBOX
+/*
+ * Makes the request findable by its question, the request has to be
+ * in the id hash already
+ */
+void
+hash_add_question(PNATState pData, struct request *req)
+{
+    struct request **p;
+
+    req->qlen = dnscache_qlen(req->byte, req->nbyte);
+    if (req->qlen < 0) return;
+    req->qhash = dnscache_qhash(req->byte, req->qlen);
+
+    p = &request_qhash[HASH(req->qhash)];
+    if ((req->qnext = *p) != NULL)
+        (*p)->qprev = &req->qnext;
+    *p = req;
+    req->qprev = p;
+}
+
+struct request *
+hash_find_question(PNATState pData, const char *buf, int byte)
+{
+    struct request *req;
+    unsigned int qhash;
+    int qlen;
+
+    qlen = dnscache_qlen(buf, byte);
+    if (qlen < 0) return NULL;
+    qhash = dnscache_qhash(buf, qlen);
+
+    for (req = request_qhash[HASH(qhash)]; req; req = req->qnext) {
+        if (   req->qhash == qhash
+            && req->qlen == qlen
+            && dnscache_qequal(req->byte, buf, qlen))
+            break;
+    }
+
+    return req;
+}
+#endif
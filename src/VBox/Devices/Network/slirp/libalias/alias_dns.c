@@ -66,6 +66,36 @@ struct dnsmsg_answer
     uint8_t  rdata[1];  /* depends on value at rdata_len */
 };
 
+/* a lookup handed to the host resolver thread */
+struct hostres_request
+{
+    struct hostres_request *next;
+    struct mbuf *m;             /* the query, answered in place */
+    struct sockaddr_in src;
+    struct sockaddr_in dst;
+    /* the following is only used on the NAT thread */
+    struct hostres_request *pending_next; /* in pHostResPending if qlen >= 0 */
+    struct hostres_request *waiters;    /* identical queries waiting for this one */
+    uint32_t qhash;
+    int qlen;                   /* length of the question, -1 if not comparable */
+    char query[1];              /* copy of the header and the question */
+};
+
+/* host resolver answers are kept shortly, they carry a made up TTL */
+#define DNS_HOSTRES_CACHE_TTL 60
+/* max # of addresses in an answer of the host resolver */
+#define DNS_HOSTRES_ADDRS_MAX 4
+
+/* what dns_hostres_lookup() returns, see gethostbyname() */
+struct hostres_hostent
+{
+    struct hostent h;
+    char *aliases[2];
+    char *addrs[DNS_HOSTRES_ADDRS_MAX + 1];
+    uint32_t au32Addrs[DNS_HOSTRES_ADDRS_MAX];
+    char szCanonName[256];
+};
+
 /* see RFC 1035(4.1) */
 static int dns_alias_handler(PNATState pData, int type);
 static void CStr2QStr(const char *pcszStr, char *pszQStr, size_t cQStr);
@@ -90,7 +120,10 @@ fingerprint(struct libalias *la, struct ip *pip, struct alias_data *ah)
     return -1;
 }
 
-static void doanswer(struct libalias *la, union dnsmsg_header *hdr, struct dns_meta_data *pReqMeta, char *qname, struct ip *pip, struct hostent *h)
+/*
+ * Turns the query into the response, returns the length of the response
+ */
+static int doanswer(union dnsmsg_header *hdr, int cbMsg, struct dns_meta_data *pReqMeta, char *qname, struct hostent *h)
 {
     int i;
 
@@ -100,6 +133,7 @@ static void doanswer(struct libalias *la, union dnsmsg_header *hdr, struct dns_m
         hdr->X.aa = 1;
         hdr->X.rd = 1;
         hdr->X.rcode = 3;
+        return cbMsg;
     }
     else
     {
@@ -116,11 +150,9 @@ static void doanswer(struct libalias *la, union dnsmsg_header *hdr, struct dns_m
         /* here is no compressed names+answers + new query */
         m_inc(m, h->h_length * sizeof(struct dnsmsg_answer) + strlen(qname) + 2 * sizeof(uint16_t));
 #endif
-        packet_len = (pip->ip_hl << 2)
-                   + sizeof(struct udphdr)
-                   + sizeof(union dnsmsg_header)
+        packet_len = sizeof(union dnsmsg_header)
                    + strlen(qname)
-                   + sizeof(struct dns_meta_data); /* ip + udp + header + query */
+                   + sizeof(struct dns_meta_data); /* header + query */
         query = (char *)&hdr[1];
 
         strcpy(query, qname);
@@ -180,30 +212,74 @@ static void doanswer(struct libalias *la, union dnsmsg_header *hdr, struct dns_m
         hdr->X.ra = 1;
         hdr->X.rcode = 0;
         HTONS(hdr->X.ancount);
-        /* don't forget update m_len */
-        pip->ip_len = htons(packet_len);
+        return packet_len;
     }
 }
-static int
-protohandler(struct libalias *la, struct ip *pip, struct alias_data *ah)
+
+/*
+ * Looks the name up with getaddrinfo() which, unlike gethostbyname(), can be
+ * used by the resolver threads of all NAT instances at the same time. The
+ * result looks like gethostbyname() reports it: the name asked for is an
+ * alias of the canonical name. Returns NULL if the name doesn't resolve.
+ */
+static struct hostent *dns_hostres_lookup(char *pszName, struct hostres_hostent *pHostEnt)
+{
+    struct addrinfo Hints;
+    struct addrinfo *pResults = NULL;
+    struct addrinfo *pAI;
+    int cAddrs = 0;
+
+    memset(&Hints, 0, sizeof(Hints));
+    Hints.ai_family = AF_INET;
+    Hints.ai_socktype = SOCK_DGRAM; /* one entry per address */
+    Hints.ai_flags = AI_CANONNAME;
+    if (getaddrinfo(pszName, NULL, &Hints, &pResults) != 0 || pResults == NULL)
+        return NULL;
+
+    for (pAI = pResults; pAI != NULL && cAddrs < DNS_HOSTRES_ADDRS_MAX; pAI = pAI->ai_next)
+    {
+        if (   pAI->ai_family != AF_INET
+            || pAI->ai_addrlen < sizeof(struct sockaddr_in))
+            continue;
+        pHostEnt->au32Addrs[cAddrs] = ((struct sockaddr_in *)pAI->ai_addr)->sin_addr.s_addr;
+        pHostEnt->addrs[cAddrs] = (char *)&pHostEnt->au32Addrs[cAddrs];
+        cAddrs++;
+    }
+    pHostEnt->addrs[cAddrs] = NULL;
+    RTStrCopy(pHostEnt->szCanonName, sizeof(pHostEnt->szCanonName),
+              pResults->ai_canonname ? pResults->ai_canonname : pszName);
+    freeaddrinfo(pResults);
+    if (!cAddrs)
+        return NULL;
+
+    pHostEnt->aliases[0] = RTStrICmp(pHostEnt->szCanonName, pszName) ? pszName : NULL;
+    pHostEnt->aliases[1] = NULL;
+    pHostEnt->h.h_name = pHostEnt->szCanonName;
+    pHostEnt->h.h_aliases = pHostEnt->aliases;
+    pHostEnt->h.h_addrtype = AF_INET;
+    pHostEnt->h.h_length = sizeof(uint32_t);
+    pHostEnt->h.h_addr_list = pHostEnt->addrs;
+    return &pHostEnt->h;
+}
+
+/*
+ * Resolves the query in hdr with the host resolver and replaces it with
+ * the response. Returns the length of the response or -1 if hdr isn't a
+ * query we can answer.
+ */
+static int dns_resolve(union dnsmsg_header *hdr, int cbMsg)
 {
     int i;
     /* Parse dns request */
     char *qw_qname = NULL;
-    uint16_t *qw_qtype = NULL;
-    uint16_t *qw_qclass = NULL;
     struct hostent *h = NULL;
+    struct hostres_hostent HostEnt;
     char cname[255];
     int cname_len = 0;
     struct dns_meta_data *meta;
 
-    struct udphdr *udp = NULL;
-    union dnsmsg_header *hdr = NULL;
-    udp = (struct udphdr *)ip_next(pip);
-    hdr = (union dnsmsg_header *)udp_next(udp);
-
     if (hdr->X.qr == 1)
-        return 0; /* this is respose */
+        return -1; /* this is respose */
 
     memset(cname, 0, sizeof(cname));
     qw_qname = (char *)&hdr[1];
@@ -216,7 +292,7 @@ protohandler(struct libalias *la, struct ip *pip, struct alias_data *ah)
             LogRel(("NAT:alias_dns: multiple quieries isn't supported\n"));
             fMultiWarn = true;
         }
-        return 1;
+        return -1;
     }
 
     for (i = 0; i < ntohs(hdr->X.qdcount); ++i)
@@ -238,10 +314,29 @@ protohandler(struct libalias *la, struct ip *pip, struct alias_data *ah)
             cname[cname_len - 1] = 0;
             cname[cname_len - 2] = 0;
         }
-        h = gethostbyname(cname);
-        fprintf(stderr, "cname:%s\n", cname);
-        doanswer(la, hdr, meta, qw_qname, pip, h);
+        h = dns_hostres_lookup(cname, &HostEnt);
+        cbMsg = doanswer(hdr, cbMsg, meta, qw_qname, h);
     }
+    return cbMsg;
+}
+static int
+protohandler(struct libalias *la, struct ip *pip, struct alias_data *ah)
+{
+    struct udphdr *udp = NULL;
+    union dnsmsg_header *hdr = NULL;
+    int cb;
+
+    /* the resolver thread answers the query, see dns_alias_query() */
+    if (la->pData->pHostResReqQueue != NULL)
+        return 0;
+
+    udp = (struct udphdr *)ip_next(pip);
+    hdr = (union dnsmsg_header *)udp_next(udp);
+
+    cb = dns_resolve(hdr, ntohs(pip->ip_len) - (pip->ip_hl << 2) - sizeof(struct udphdr));
+    if (cb < 0)
+        return hdr->X.qr == 1 ? 0 : 1;
+    pip->ip_len = htons((pip->ip_hl << 2) + sizeof(struct udphdr) + cb);
 
     /*
      * We have changed the size and the content of udp, to avoid double csum calculation
@@ -254,6 +349,272 @@ protohandler(struct libalias *la, struct ip *pip, struct alias_data *ah)
     return 0;
 }
 
+/*
+ * Runs on the resolver thread.
+ */
+static DECLCALLBACK(void) dns_alias_worker(PNATState pData, struct hostres_request *pReq)
+{
+    struct mbuf *m = pReq->m;
+    int cb;
+
+    cb = dns_resolve(mtod(m, union dnsmsg_header *), m->m_len);
+    if (cb > 0)
+        m->m_len = cb;
+
+    RTCritSectEnter(&pData->csHostResDone);
+    pReq->next = NULL;
+    if (pData->pHostResDoneTail)
+        pData->pHostResDoneTail->next = pReq;
+    else
+        pData->pHostResDoneHead = pReq;
+    pData->pHostResDoneTail = pReq;
+    RTCritSectLeave(&pData->csHostResDone);
+
+    slirp_wakeup_nat_thread(pData->pvUser);
+}
+
+/*
+ * Turns the query in m into the answer of an identical query in mAnswer,
+ * keeping the id, RD and the question of the query. Returns 0 if m can't
+ * take the answer.
+ */
+static int
+dns_alias_copy_answer(struct mbuf *mAnswer, struct mbuf *m, int qlen)
+{
+    char *pchQuery = mtod(m, char *);
+    const char *pchAnswer = mtod(mAnswer, const char *);
+    int cbHdrQ = sizeof(union dnsmsg_header) + qlen;
+    char abId[2];
+    char fRD;
+
+    if (   mAnswer->m_len < cbHdrQ
+        || !(pchAnswer[2] & 0x80)
+        || mAnswer->m_len > m->m_len + M_TRAILINGSPACE(m))
+        return 0;
+
+    abId[0] = pchQuery[0];
+    abId[1] = pchQuery[1];
+    fRD = pchQuery[2] & 0x01;
+    memcpy(pchQuery, pchAnswer, sizeof(union dnsmsg_header));
+    memcpy(pchQuery + cbHdrQ, pchAnswer + cbHdrQ, mAnswer->m_len - cbHdrQ);
+    pchQuery[0] = abId[0];
+    pchQuery[1] = abId[1];
+    pchQuery[2] = (pchQuery[2] & ~0x01) | fRD;
+    m->m_len = mAnswer->m_len;
+    return 1;
+}
+
+/*
+ * Hands the DNS query in m (which points at the UDP payload) to the host
+ * resolver. A query identical to one the resolver is busy with waits for
+ * that one instead. Returns 1 if the answer will be delivered by
+ * dns_alias_poll() and 0 if m holds the answer already.
+ */
+int
+dns_alias_query(PNATState pData, struct mbuf *m, struct sockaddr_in *src, struct sockaddr_in *dst)
+{
+    struct hostres_request *pReq;
+    struct hostres_request *pLead = NULL;
+    uint32_t u32Hash = 0;
+    int qlen;
+    int cb;
+    int rc;
+
+    /* without the thread libalias answered it already */
+    if (pData->pHostResReqQueue == NULL)
+        return 0;
+
+    cb = dnscache_answer(pData, mtod(m, char *), m->m_len,
+                         mtod(m, char *), m->m_len + M_TRAILINGSPACE(m));
+    if (cb > 0)
+    {
+        m->m_len = cb;
+        return 0;
+    }
+
+    qlen = dnscache_qlen(mtod(m, char *), m->m_len);
+    if (qlen >= 0 && (mtod(m, uint8_t *)[2] & 0x80))
+        qlen = -1; /* a response, dns_resolve() leaves it alone */
+    if (qlen >= 0)
+    {
+        u32Hash = dnscache_qhash(mtod(m, char *), qlen);
+        for (pLead = pData->pHostResPending; pLead != NULL; pLead = pLead->pending_next)
+            if (   pLead->qhash == u32Hash
+                && pLead->qlen == qlen
+                && dnscache_qequal(pLead->query, mtod(m, char *), qlen))
+                break;
+    }
+
+    pReq = RTMemAlloc(sizeof(struct hostres_request) + (qlen >= 0 ? sizeof(union dnsmsg_header) + qlen : 0));
+    if (pReq != NULL)
+    {
+        pReq->m = m;
+        pReq->src = *src;
+        pReq->dst = *dst;
+        pReq->pending_next = NULL;
+        pReq->waiters = NULL;
+        pReq->qhash = u32Hash;
+        pReq->qlen = qlen;
+        if (pLead != NULL)
+        {
+            pReq->next = pLead->waiters;
+            pLead->waiters = pReq;
+            STAM_COUNTER_INC(&pData->StatDnsCoalesced);
+            return 1;
+        }
+        if (qlen >= 0)
+            memcpy(pReq->query, mtod(m, char *), sizeof(union dnsmsg_header) + qlen);
+
+        rc = RTReqCallEx(pData->pHostResReqQueue, NULL /*ppReq*/, 0 /*cMillies*/,
+                         RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
+                         (PFNRT)dns_alias_worker, 2, pData, pReq);
+        if (RT_SUCCESS(rc))
+        {
+            if (qlen >= 0)
+            {
+                pReq->pending_next = pData->pHostResPending;
+                pData->pHostResPending = pReq;
+            }
+            STAM_COUNTER_INC(&pData->StatDnsHostResAsync);
+            return 1;
+        }
+        RTMemFree(pReq);
+    }
+
+    /* do it the blocking way then */
+    cb = dns_resolve(mtod(m, union dnsmsg_header *), m->m_len);
+    if (cb > 0)
+        m->m_len = cb;
+    return 0;
+}
+
+/*
+ * Sends the answers of the resolver thread to the guest, called on the
+ * NAT thread.
+ */
+void
+dns_alias_poll(PNATState pData)
+{
+    struct hostres_request *pReq;
+
+    if (pData->pHostResDoneHead == NULL)
+        return;
+
+    RTCritSectEnter(&pData->csHostResDone);
+    pReq = pData->pHostResDoneHead;
+    pData->pHostResDoneHead = NULL;
+    pData->pHostResDoneTail = NULL;
+    RTCritSectLeave(&pData->csHostResDone);
+
+    while (pReq)
+    {
+        struct hostres_request *pNext = pReq->next;
+        struct hostres_request *pWaiter;
+        struct mbuf *m = pReq->m;
+
+        if (pReq->qlen >= 0)
+        {
+            struct hostres_request **ppPrev = &pData->pHostResPending;
+            while (*ppPrev != pReq)
+                ppPrev = &(*ppPrev)->pending_next;
+            *ppPrev = pReq->pending_next;
+        }
+
+        dnscache_store(pData, mtod(m, char *), m->m_len, DNS_HOSTRES_CACHE_TTL);
+        while ((pWaiter = pReq->waiters) != NULL)
+        {
+            pReq->waiters = pWaiter->next;
+            if (dns_alias_copy_answer(m, pWaiter->m, pReq->qlen))
+                udp_output2(pData, NULL, pWaiter->m, &pWaiter->src, &pWaiter->dst, IPTOS_LOWDELAY);
+            else
+                m_freem(pData, pWaiter->m);
+            RTMemFree(pWaiter);
+        }
+        udp_output2(pData, NULL, m, &pReq->src, &pReq->dst, IPTOS_LOWDELAY);
+        RTMemFree(pReq);
+        pReq = pNext;
+    }
+}
+
+static DECLCALLBACK(int) dns_alias_thread(RTTHREAD hThread, void *pvUser)
+{
+    PNATState pData = (PNATState)pvUser;
+    NOREF(hThread);
+
+    while (!pData->fHostResTerminate)
+        RTReqProcess(pData->pHostResReqQueue, RT_INDEFINITE_WAIT);
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) dns_alias_thread_stop(PNATState pData)
+{
+    pData->fHostResTerminate = true;
+    /* makes RTReqProcess() return */
+    return VINF_INTERRUPTED;
+}
+
+static void
+dns_alias_start(PNATState pData)
+{
+    int rc = RTCritSectInit(&pData->csHostResDone);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTReqCreateQueue(&pData->pHostResReqQueue);
+        if (RT_SUCCESS(rc))
+        {
+            pData->fHostResTerminate = false;
+            rc = RTThreadCreate(&pData->hHostResThread, dns_alias_thread, pData, 0,
+                                RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "NATHostRes");
+            if (RT_SUCCESS(rc))
+                return;
+            RTReqDestroyQueue(pData->pHostResReqQueue);
+            pData->pHostResReqQueue = NULL;
+        }
+        RTCritSectDelete(&pData->csHostResDone);
+    }
+    /* libalias will resolve on the NAT thread */
+    LogRel(("NAT: can't start the host resolver thread (%Rrc), lookups will block\n", rc));
+}
+
+static void
+dns_alias_stop(PNATState pData)
+{
+    int rc;
+
+    if (pData->pHostResReqQueue == NULL)
+        return;
+
+    rc = RTReqCallEx(pData->pHostResReqQueue, NULL /*ppReq*/, 0 /*cMillies*/,
+                     RTREQFLAGS_IPRT_STATUS | RTREQFLAGS_NO_WAIT,
+                     (PFNRT)dns_alias_thread_stop, 1, pData);
+    AssertRC(rc);
+    /* a lookup in progress has to finish first */
+    rc = RTThreadWait(pData->hHostResThread, RT_INDEFINITE_WAIT, NULL);
+    AssertRC(rc);
+    RTReqDestroyQueue(pData->pHostResReqQueue);
+    pData->pHostResReqQueue = NULL;
+    pData->hHostResThread = NIL_RTTHREAD;
+
+    /* the lookups queued before the stop request are all done by now */
+    while (pData->pHostResDoneHead)
+    {
+        struct hostres_request *pReq = pData->pHostResDoneHead;
+        struct hostres_request *pWaiter;
+        pData->pHostResDoneHead = pReq->next;
+        while ((pWaiter = pReq->waiters) != NULL)
+        {
+            pReq->waiters = pWaiter->next;
+            m_freem(pData, pWaiter->m);
+            RTMemFree(pWaiter);
+        }
+        m_freem(pData, pReq->m);
+        RTMemFree(pReq);
+    }
+    pData->pHostResDoneTail = NULL;
+    pData->pHostResPending = NULL;
+    RTCritSectDelete(&pData->csHostResDone);
+}
+
 /*
  * qstr is z-string with -dot- replaced with \count to next -dot-
  * e.g. ya.ru is \02ya\02ru
@@ -349,10 +710,12 @@ dns_alias_handler(PNATState pData, int type)
         case MOD_LOAD:
             error = 0;
             LibAliasAttachHandlers(pData, handlers);
+            dns_alias_start(pData);
             break;
 
         case MOD_UNLOAD:
             error = 0;
+            dns_alias_stop(pData);
             LibAliasDetachHandlers(pData, handlers);
             RTMemFree(handlers);
             handlers = NULL;
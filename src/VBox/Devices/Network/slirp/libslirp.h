@@ -42,13 +42,42 @@ int inet_aton(const char *cp, struct in_addr *ia);
 typedef struct NATState *PNATState;
 struct mbuf;
 
+/**
+ * Distribution of guest frames over several slirp engines, see
+ * slirp_flow_select.
+ */
+typedef struct SLIRPFLOWSEL
+{
+    /** The NAT network (host byte order). */
+    uint32_t            u32Network;
+    /** The NAT netmask (host byte order). */
+    uint32_t            u32Netmask;
+    /** Number of engines. */
+    unsigned            cEngines;
+    /** Guest TCP ports with a port forwarding rule. */
+    uint32_t volatile   bmTcpFwd[65536 / 32];
+    /** Guest UDP ports with a port forwarding rule. */
+    uint32_t volatile   bmUdpFwd[65536 / 32];
+} SLIRPFLOWSEL;
+/** Pointer to a flow distribution. */
+typedef SLIRPFLOWSEL *PSLIRPFLOWSEL;
+/** Pointer to a const flow distribution. */
+typedef SLIRPFLOWSEL const *PCSLIRPFLOWSEL;
+
+/** slirp_flow_select: the frame goes to every engine. */
+#define SLIRP_FLOW_ALL_ENGINES  (~0U)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int slirp_init(PNATState *, uint32_t, uint32_t, bool, bool, int, void *);
-void slirp_register_statistics(PNATState pData, PPDMDRVINS pDrvIns);
+int slirp_init(PNATState *, uint32_t, uint32_t, bool, bool, int, bool, void *);
+void slirp_register_statistics(PNATState pData, PPDMDRVINS pDrvIns, unsigned iEngine);
 void slirp_deregister_statistics(PNATState pData, PPDMDRVINS pDrvIns);
+
+void slirp_flow_init(PSLIRPFLOWSEL pSel, uint32_t u32Network, uint32_t u32Netmask, unsigned cEngines);
+void slirp_flow_add_forward(PSLIRPFLOWSEL pSel, bool fUdp, uint16_t u16GuestPort);
+unsigned slirp_flow_select(PCSLIRPFLOWSEL pSel, const uint8_t *pbFrame, size_t cbFrame);
 void slirp_term(PNATState);
 void slirp_link_up(PNATState);
 void slirp_link_down(PNATState);
@@ -57,6 +86,11 @@ void slirp_link_down(PNATState);
 void slirp_select_fill(PNATState pData, int *pndfs);
 
 void slirp_select_poll(PNATState pData, int fTimeout, int fIcmp);
+#elif defined(VBOX_WITH_NAT_EPOLL)
+void slirp_select_fill(PNATState pData, int *pnfds);
+int  slirp_select_wait(PNATState pData, unsigned int cMillies, bool *pfWakeup);
+void slirp_select_poll(PNATState pData, int cEvents);
+int  slirp_register_wakeup_fd(PNATState pData, int fd);
 #else /* RT_OS_WINDOWS */
 void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls);
 void slirp_select_poll(PNATState pData, struct pollfd *polls, int ndfs);
@@ -72,6 +106,7 @@ void slirp_output(void * pvUser, struct mbuf *m, const uint8_t *pkt, int pkt_len
 void slirp_output_pending(void * pvUser);
 void slirp_urg_output(void *pvUser, struct mbuf *, const uint8_t *pu8Buf, int cb);
 void slirp_post_sent(PNATState pData, void *pvArg);
+void slirp_wakeup_nat_thread(void *pvUser);
 
 int slirp_add_redirect(PNATState pData, int is_udp, struct in_addr host_addr,
                 int host_port, struct in_addr guest_addr,
@@ -93,6 +128,7 @@ void slirp_set_tcp_sndspace(PNATState pData, int kilobytes);
 
 int  slirp_set_binding_address(PNATState, char *addr);
 void slirp_set_mtu(PNATState, int);
+void slirp_set_gso(PNATState pData, bool fEnabled);
 void slirp_info(PNATState pData, PCDBGFINFOHLP pHlp, const char *pszArgs);
 void slirp_set_somaxconn(PNATState pData, int iSoMaxConn);
 
@@ -134,6 +170,7 @@ void *slirp_get_queue(PNATState pData);
 
 struct mbuf *slirp_ext_m_get(PNATState pData, size_t cbMin, void **ppvBuf, size_t *pcbBuf);
 void slirp_ext_m_free(PNATState pData, struct mbuf *, uint8_t *pu8Buf);
+int slirp_ext_m_get_tso_segsz(PNATState pData, struct mbuf *m);
 
 /*
  * Returns the timeout.
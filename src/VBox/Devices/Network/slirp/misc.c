@@ -471,6 +471,18 @@ struct mbuf *slirp_ext_m_get(PNATState pData, size_t cbMin, void **ppvBuf, size_
     return m;
 }
 
+/**
+ * Returns the segment size the frame in @a m has to be cut into by the device,
+ * or 0 if the frame doesn't exceed the MTU.
+ */
+int slirp_ext_m_get_tso_segsz(PNATState pData, struct mbuf *m)
+{
+    NOREF(pData);
+    if (m->m_pkthdr.csum_flags & CSUM_TSO)
+        return m->m_pkthdr.tso_segsz;
+    return 0;
+}
+
 void slirp_ext_m_free(PNATState pData, struct mbuf *m, uint8_t *pu8Buf)
 {
 
@@ -516,4 +528,5 @@ if_init(PNATState pData)
     if_comp = IF_AUTOCOMP;
     if_mtu = 1500;
     if_mru = 1500;
+    if_gso = false;
 }
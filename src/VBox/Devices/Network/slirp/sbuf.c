@@ -36,8 +36,12 @@
  */
 
 void
-sbfree(struct sbuf *sb)
+sbfree(PNATState pData, struct sbuf *sb)
 {
+    /* Release the mbufs held by reference. */
+    if (sb->sb_mb)
+        sbdropref(pData, sb, sb->sb_mbcc);
+
     /*
      * Catch double frees. Actually tcp_close() already filters out listening sockets
      * passing NULL.
@@ -70,9 +74,43 @@ sbdrop(struct sbuf *sb, int num)
 
 }
 
+/*
+ * Drop num bytes from the mbufs held by reference, i.e. after
+ * the data in the buffer has been dropped
+ */
+void
+sbdropref(PNATState pData, struct sbuf *sb, int num)
+{
+    struct mbuf *m;
+
+    if (num > sb->sb_mbcc)
+        num = sb->sb_mbcc;
+    sb->sb_mbcc -= num;
+    while ((m = sb->sb_mb) != NULL)
+    {
+        int mlen = m_length(m, NULL);
+        if (num < mlen)
+        {
+            if (num)
+                m_adj(m, num);
+            break;
+        }
+        num -= mlen;
+        sb->sb_mb = m->m_nextpkt;
+        sb->sb_mbcnt--;
+        pData->cSbufRefs--;
+        m->m_nextpkt = NULL;
+        m_freem(pData, m);
+    }
+    if (!sb->sb_mb)
+        sb->sb_mblast = NULL;
+}
+
 void
 sbreserve(PNATState pData, struct sbuf *sb, int size)
 {
+    if (sb->sb_mb)
+        sbdropref(pData, sb, sb->sb_mbcc);
     if (sb->sb_data)
     {
         /* Already alloced, realloc if necessary */
@@ -99,6 +137,39 @@ sbreserve(PNATState pData, struct sbuf *sb, int size)
     }
 }
 
+/*
+ * Fill iov with the data of the mbuf chain m, returns the # of
+ * entries used
+ */
+static int
+sbmbufiov(struct mbuf *m, struct iovec *iov, int cIov)
+{
+    int i = 0;
+    for (; m && i < cIov; m = m->m_next)
+    {
+        if (m->m_len <= 0)
+            continue;
+        iov[i].iov_base = mtod(m, char *);
+        iov[i].iov_len = m->m_len;
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Fill iov with the data of the mbufs held by reference,
+ * returns the # of entries used
+ */
+int
+sbrefiov(struct sbuf *sb, struct iovec *iov, int cIov)
+{
+    struct mbuf *m;
+    int i = 0;
+    for (m = sb->sb_mb; m && i < cIov; m = m->m_nextpkt)
+        i += sbmbufiov(m, &iov[i], cIov - i);
+    return i;
+}
+
 /*
  * Try and write() to the socket, whatever doesn't get written
  * append to the buffer... for a host with a fast net connection,
@@ -110,7 +181,6 @@ sbappend(PNATState pData, struct socket *so, struct mbuf *m)
 {
     int ret = 0;
     int mlen = 0;
-    caddr_t buf = NULL;
 
     STAM_PROFILE_START(&pData->StatIOSBAppend_pf, a);
     LogFlow(("sbappend: so = %lx, m = %lx, m->m_len = %d\n", (long)so, (long)m, m ? m->m_len : 0));
@@ -121,7 +191,8 @@ sbappend(PNATState pData, struct socket *so, struct mbuf *m)
     if (mlen <= 0)
     {
         STAM_COUNTER_INC(&pData->StatIOSBAppend_zm);
-        goto done;
+        m_freem(pData, m);
+        return;
     }
 
     /*
@@ -141,25 +212,28 @@ sbappend(PNATState pData, struct socket *so, struct mbuf *m)
      * We only write if there's nothing in the buffer,
      * ottherwise it'll arrive out of order, and hence corrupt
      */
-    if (m->m_next)
+    if (!SBUF_LEN(&so->so_rcv))
     {
-        buf = RTMemAlloc(mlen);
-        if (buf == NULL)
+        if (m->m_next)
         {
-            ret = 0;
-            goto no_sent;
+#ifdef HAVE_READV
+            /* Gather the chain instead of linearizing it. */
+            struct iovec iov[SBUF_MAX_IOV];
+            ret = writev(so->s, iov, sbmbufiov(m, iov, RT_ELEMENTS(iov)));
+#else
+            caddr_t buf = RTMemAlloc(mlen);
+            if (buf != NULL)
+            {
+                m_copydata(m, 0, mlen, buf);
+                STAM_COUNTER_ADD(&pData->StatIOSBCopy_bytes, mlen);
+                ret = send(so->s, buf, mlen, 0);
+                RTMemFree(buf);
+            }
+#endif
         }
-        m_copydata(m, 0, mlen, buf);
+        else
+            ret = send(so->s, mtod(m, char *), mlen, 0);
     }
-    else
-        buf = mtod(m, char *);
-
-    if(!so->so_rcv.sb_cc)
-        ret = send(so->s, buf, mlen, 0);
-
-    if (m->m_next)
-        RTMemFree(buf);
-no_sent:
 
     if (ret <= 0)
     {
@@ -170,35 +244,34 @@ no_sent:
          * we don't need to check because if it has closed,
          * it will be detected in the normal way by soread()
          */
-        sbappendsb(pData, &so->so_rcv, m);
+        sbappendref(pData, &so->so_rcv, m);
         STAM_PROFILE_STOP(&pData->StatIOSBAppend_pf_wf, a);
-        goto done;
+        return;
     }
     else if (ret != mlen)
     {
         STAM_COUNTER_INC(&pData->StatIOSBAppend_wp);
         /*
          * Something was written, but not everything..
-         * sbappendsb the rest
+         * keep the rest
          */
         m_adj(m, ret);
-        sbappendsb(pData, &so->so_rcv, m);
+        sbappendref(pData, &so->so_rcv, m);
         STAM_PROFILE_STOP(&pData->StatIOSBAppend_pf_wp, a);
-        goto done;
+        return;
     } /* else */
     /* Whatever happened, we free the mbuf */
     STAM_COUNTER_INC(&pData->StatIOSBAppend_wa);
     STAM_PROFILE_STOP(&pData->StatIOSBAppend_pf_wa, a);
-done:
     m_freem(pData, m);
 }
 
 /*
- * Copy the data from m into sb
+ * Copy the data from m into the buffer
  * The caller is responsible to make sure there's enough room
  */
-void
-sbappendsb(PNATState pData, struct sbuf *sb, struct mbuf *m)
+static void
+sbcopyin(PNATState pData, struct sbuf *sb, struct mbuf *m)
 {
     int len, n,  nn;
 
@@ -232,6 +305,7 @@ sbappendsb(PNATState pData, struct sbuf *sb, struct mbuf *m)
             n += nn;
         }
     }
+    STAM_COUNTER_ADD(&pData->StatIOSBCopy_bytes, n);
 
     sb->sb_cc += n;
     sb->sb_wptr += n;
@@ -242,6 +316,68 @@ sbappendsb(PNATState pData, struct sbuf *sb, struct mbuf *m)
     }
 }
 
+/*
+ * Copy the data from m into sb
+ * The caller is responsible to make sure there's enough room
+ */
+void
+sbappendsb(PNATState pData, struct sbuf *sb, struct mbuf *m)
+{
+    /* What is held by reference goes first, keep the order */
+    if (sb->sb_mb)
+        sbpullup(pData, sb);
+    sbcopyin(pData, sb, m);
+}
+
+/*
+ * Keep m (and its data) by reference instead of copying it into
+ * the buffer. m is consumed.
+ */
+void
+sbappendref(PNATState pData, struct sbuf *sb, struct mbuf *m)
+{
+    if (   sb->sb_mbcnt >= SBUF_MAX_REFS
+        || pData->cSbufRefs >= SBUF_MAX_REFS_TOTAL)
+    {
+        /* Don't tie up too many mbufs in a single socket or in all of them */
+        STAM_COUNTER_INC(&pData->StatIOSBRefLimit);
+        sbappendsb(pData, sb, m);
+        m_freem(pData, m);
+        return;
+    }
+    STAM_COUNTER_INC(&pData->StatIOSBRef);
+    STAM_COUNTER_ADD(&pData->StatIOSBRef_bytes, m_length(m, NULL));
+    m->m_nextpkt = NULL;
+    if (sb->sb_mblast)
+        sb->sb_mblast->m_nextpkt = m;
+    else
+        sb->sb_mb = m;
+    sb->sb_mblast = m;
+    sb->sb_mbcc += m_length(m, NULL);
+    sb->sb_mbcnt++;
+    pData->cSbufRefs++;
+}
+
+/*
+ * Copy the mbufs held by reference into the buffer
+ */
+void
+sbpullup(PNATState pData, struct sbuf *sb)
+{
+    struct mbuf *m;
+    while ((m = sb->sb_mb) != NULL)
+    {
+        sb->sb_mb = m->m_nextpkt;
+        m->m_nextpkt = NULL;
+        sbcopyin(pData, sb, m);
+        m_freem(pData, m);
+    }
+    pData->cSbufRefs -= sb->sb_mbcnt;
+    sb->sb_mblast = NULL;
+    sb->sb_mbcc = 0;
+    sb->sb_mbcnt = 0;
+}
+
 /*
  * Copy data from sbuf to a normal, straight buffer
  * Don't update the sbuf rptr, this will be
@@ -29,10 +29,18 @@
 
 #ifndef VBOX_WITH_SLIRP_BSD_SBUF
 # define sbflush(sb) sbdrop((sb),(sb)->sb_cc)
-# define sbspace(sb) ((sb)->sb_datalen - (sb)->sb_cc)
-# define SBUF_LEN(sb) ((sb)->sb_cc)
+# define sbspace(sb) ((sb)->sb_datalen - (sb)->sb_cc - (sb)->sb_mbcc)
+# define SBUF_LEN(sb) ((sb)->sb_cc + (sb)->sb_mbcc)
 # define SBUF_SIZE(sb) ((sb)->sb_datalen)
 
+/* Max # of guest mbufs a socket holds by reference before copying */
+# define SBUF_MAX_REFS 32
+/* Max # of guest mbufs all sockets hold by reference, half of the
+ * smallest cluster zone so the guest can't starve itself of mbufs */
+# define SBUF_MAX_REFS_TOTAL (nmbjumbo16 / 2)
+/* Max # of iovecs sowrite() passes to writev() */
+# define SBUF_MAX_IOV (SBUF_MAX_REFS + 2)
+
 
 struct sbuf
 {
@@ -43,14 +51,24 @@ struct sbuf
     char    *sb_rptr;       /* read pointer. points to where the next
                              * byte should be read from the sbuf */
     char    *sb_data;       /* Actual data */
+    struct mbuf *sb_mb;     /* mbufs held by reference, their data follows
+                             * the data in the buffer (linked by m_nextpkt) */
+    struct mbuf *sb_mblast; /* last mbuf of sb_mb */
+    u_int   sb_mbcc;        /* chars held in sb_mb */
+    u_int   sb_mbcnt;       /* number of mbufs in sb_mb */
 };
 
-void sbfree (struct sbuf *);
+void sbfree (PNATState, struct sbuf *);
 void sbdrop (struct sbuf *, int);
+void sbdropref (PNATState, struct sbuf *, int);
 void sbreserve (PNATState, struct sbuf *, int);
 void sbappend (PNATState, struct socket *, struct mbuf *);
 void sbappendsb (PNATState, struct sbuf *, struct mbuf *);
+void sbappendref (PNATState, struct sbuf *, struct mbuf *);
+void sbpullup (PNATState, struct sbuf *);
 void sbcopy (struct sbuf *, int, int, char *);
+struct iovec;
+int sbrefiov (struct sbuf *, struct iovec *, int);
 #else
 void sbappend (PNATState, struct socket *, struct mbuf *);
 # include "bsd/sys/sbuf.h"
@@ -60,7 +60,52 @@
 #endif
 #include <alias.h>
 
-#ifndef RT_OS_WINDOWS
+#if !defined(RT_OS_WINDOWS) && defined(VBOX_WITH_NAT_EPOLL)
+
+/*
+ * With epoll the sockets stay registered between the rounds; fill only
+ * collects the wanted events in so_epoll_want and slirpEpollSync() pushes
+ * the difference to the kernel.
+ */
+# define DO_ENGAGE_EVENT1(so, fdset, label)                        \
+   do {                                                            \
+       (so)->so_epoll_want |= N_(fdset ## _poll);                  \
+   } while (0)
+
+# define DO_ENGAGE_EVENT2(so, fdset1, fdset2, label)               \
+   do {                                                            \
+       (so)->so_epoll_want |= N_(fdset1 ## _poll)                  \
+                            | N_(fdset2 ## _poll);                 \
+   } while (0)
+
+# define DO_POLL_EVENTS(rc, error, so, events, label) do {} while (0)
+
+/*
+ * Only events of the current round count, the generation check filters out
+ * leftovers of sockets which weren't reported this time.
+ */
+#  define DO_CHECK_FD_SET(so, events, fdset)                        \
+      (   (so)->so_epoll_gen == pData->uEpollGen                    \
+       && ((so)->so_epoll_revents & N_(fdset ## _poll)))
+
+# define DO_UNIX_CHECK_FD_SET(so, events, fdset) DO_CHECK_FD_SET((so), (events), fdset)
+# define DO_WIN_CHECK_FD_SET(so, events, fdset) 0
+
+# define readfds_poll   (EPOLLIN)
+# define writefds_poll  (EPOLLOUT)
+# define xfds_poll      (EPOLLPRI)
+# define closefds_poll  (EPOLLHUP)
+# define rderr_poll     (EPOLLERR)
+# define rdhup_poll     (EPOLLHUP)
+# define nval_poll      (0) /* closed descriptors silently leave the epoll set */
+
+# define ICMP_ENGAGE_EVENT(so, fdset)              \
+   do {                                            \
+       if (pData->icmp_socket.s != -1)             \
+           DO_ENGAGE_EVENT1((so), fdset, ICMP);    \
+   } while (0)
+
+#elif !defined(RT_OS_WINDOWS)
 
 # define DO_ENGAGE_EVENT1(so, fdset, label)                        \
    do {                                                            \
@@ -582,8 +627,17 @@ int get_dns_addr(PNATState pData, struct in_addr *pdns_addr)
     return get_dns_addr_domain(pData, false, pdns_addr, NULL);
 }
 
+/**
+ * Creates a slirp engine.
+ *
+ * @param   fSecondary  Set for the additional engines of a NAT instance which
+ *                      only get the flows slirp_flow_select hands them.  The
+ *                      DNS configuration, DNS proxy and host resolver stay
+ *                      with the primary engine.
+ */
 int slirp_init(PNATState *ppData, uint32_t u32NetAddr, uint32_t u32Netmask,
-               bool fPassDomain, bool fUseHostResolver, int i32AliasMode, void *pvUser)
+               bool fPassDomain, bool fUseHostResolver, int i32AliasMode,
+               bool fSecondary, void *pvUser)
 {
     int fNATfailed = 0;
     int rc;
@@ -595,6 +649,8 @@ int slirp_init(PNATState *ppData, uint32_t u32NetAddr, uint32_t u32Netmask,
     *ppData = pData;
     if (!pData)
         return VERR_NO_MEMORY;
+    if (fSecondary)
+        fUseHostResolver = false;
     pData->fPassDomain = !fUseHostResolver ? fPassDomain : false;
     pData->fUseHostResolver = fUseHostResolver;
     pData->pvUser = pvUser;
@@ -607,6 +663,22 @@ int slirp_init(PNATState *ppData, uint32_t u32NetAddr, uint32_t u32Netmask,
     tcp_rcvspace = 64 * _1K;
     pData->soMaxConn = 1; /* historical value */
 
+#ifdef VBOX_WITH_NAT_EPOLL
+    /* the size is only a hint for ancient kernels */
+    pData->iEpollFd = epoll_create(64);
+    if (pData->iEpollFd < 0)
+    {
+        rc = RTErrConvertFromErrno(errno);
+        LogRel(("NAT: epoll_create failed (%Rrc)\n", rc));
+        RTMemFree(pData);
+        *ppData = NULL;
+        return rc;
+    }
+    fcntl(pData->iEpollFd, F_SETFD, FD_CLOEXEC);
+    pData->icmp_socket.so_epoll_fd = -1;
+    LIST_INIT(&pData->EpollDirty);
+#endif
+
 #ifdef RT_OS_WINDOWS
     {
         WSADATA Data;
@@ -646,7 +718,13 @@ int slirp_init(PNATState *ppData, uint32_t u32NetAddr, uint32_t u32Netmask,
 
     /* set default addresses */
     inet_aton("127.0.0.1", &loopback_addr);
-    if (!pData->fUseHostResolver)
+    dnscache_init(pData);
+    if (fSecondary)
+    {
+        TAILQ_INIT(&pData->pDnsList);
+        LIST_INIT(&pData->pDomainList);
+    }
+    else if (!pData->fUseHostResolver)
     {
         if (slirp_init_dns_list(pData) < 0)
             fNATfailed = 1;
@@ -688,12 +766,21 @@ int slirp_init(PNATState *ppData, uint32_t u32NetAddr, uint32_t u32Netmask,
 /**
  * Register statistics.
  */
-void slirp_register_statistics(PNATState pData, PPDMDRVINS pDrvIns)
+void slirp_register_statistics(PNATState pData, PPDMDRVINS pDrvIns, unsigned iEngine)
 {
 #ifdef VBOX_WITH_STATISTICS
-# define PROFILE_COUNTER(name, dsc)     REGISTER_COUNTER(name, pData, STAMTYPE_PROFILE, STAMUNIT_TICKS_PER_CALL, dsc)
-# define COUNTING_COUNTER(name, dsc)    REGISTER_COUNTER(name, pData, STAMTYPE_COUNTER, STAMUNIT_COUNT,          dsc)
+    /* The primary engine keeps the historical names. */
+    char szPrefix[48];
+    if (!iEngine)
+        RTStrPrintf(szPrefix, sizeof(szPrefix), "/Drivers/NAT%u", pDrvIns->iInstance);
+    else
+        RTStrPrintf(szPrefix, sizeof(szPrefix), "/Drivers/NAT%u/Engine%u", pDrvIns->iInstance, iEngine);
+# define SLIRP_REGISTER_COUNTER(name, type, units, dsc) \
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pData->Stat ## name, type, STAMVISIBILITY_ALWAYS, units, dsc, "%s/" #name, szPrefix)
+# define PROFILE_COUNTER(name, dsc)     SLIRP_REGISTER_COUNTER(name, STAMTYPE_PROFILE, STAMUNIT_TICKS_PER_CALL, dsc)
+# define COUNTING_COUNTER(name, dsc)    SLIRP_REGISTER_COUNTER(name, STAMTYPE_COUNTER, STAMUNIT_COUNT,          dsc)
 # include "counters.h"
+# undef SLIRP_REGISTER_COUNTER
 # undef COUNTER
 /** @todo register statistics for the variables dumped by:
  *  ipstats(pData); tcpstats(pData); udpstats(pData); icmpstats(pData);
@@ -776,6 +863,7 @@ void slirp_term(PNATState pData)
     FreeLibrary(pData->hmIcmpLibrary);
     RTMemFree(pData->pvIcmpBuffer);
 #else
+    SOEPOLL_UNREGISTER(pData, &pData->icmp_socket);
     closesocket(pData->icmp_socket.s);
 #endif
 
@@ -785,6 +873,9 @@ void slirp_term(PNATState pData)
     nbt_alias_unload(pData);
     if (pData->fUseHostResolver)
         dns_alias_unload(pData);
+    dnscache_flush(pData);
+    sohashfini(pData, &tcb);
+    sohashfini(pData, &udb);
     while (!LIST_EMPTY(&instancehead))
     {
         struct libalias *la = LIST_FIRST(&instancehead);
@@ -818,6 +909,10 @@ void slirp_term(PNATState pData)
          "\n"
          "\n"));
 #endif
+#endif
+#ifdef VBOX_WITH_NAT_EPOLL
+    close(pData->iEpollFd);
+    RTMemFree(pData->papEpollReady);
 #endif
     RTMemFree(pData);
 }
@@ -848,7 +943,188 @@ static void updtime(PNATState pData)
 #endif
 }
 
-#ifdef RT_OS_WINDOWS
+#ifdef VBOX_WITH_NAT_EPOLL
+/**
+ * Brings the epoll registration of a socket in line with the events collected
+ * in so_epoll_want.
+ *
+ * Only changes cost a system call, so the steady state of an idle or a
+ * streaming connection doesn't touch the kernel at all.  Sockets which want
+ * nothing are removed from the set as epoll always reports EPOLLHUP/EPOLLERR
+ * and a level-triggered registration of a dead peer would spin the loop.
+ *
+ * @param   pData   The NAT instance.
+ * @param   so      The socket.
+ */
+static void slirpEpollSync(PNATState pData, struct socket *so)
+{
+    struct epoll_event Event;
+    uint32_t fWant = so->so_epoll_want;
+    int rc;
+
+    if (   so->so_epoll_fd != -1
+        && so->so_epoll_fd != so->s)
+        slirp_epoll_unregister(pData, so);
+
+    if (so->s == -1)
+        fWant = 0;
+    if (fWant == so->so_epoll_events)
+        return;
+
+    if (!fWant)
+    {
+        slirp_epoll_unregister(pData, so);
+        return;
+    }
+
+    STAM_COUNTER_INC(&pData->StatEpollCtl);
+    RT_ZERO(Event);
+    Event.events = fWant;
+    Event.data.ptr = so;
+    if (so->so_epoll_fd == -1)
+    {
+        rc = epoll_ctl(pData->iEpollFd, EPOLL_CTL_ADD, so->s, &Event);
+        if (rc < 0 && errno == EEXIST)
+            rc = epoll_ctl(pData->iEpollFd, EPOLL_CTL_MOD, so->s, &Event);
+    }
+    else
+    {
+        rc = epoll_ctl(pData->iEpollFd, EPOLL_CTL_MOD, so->s, &Event);
+        if (rc < 0 && errno == ENOENT)
+            rc = epoll_ctl(pData->iEpollFd, EPOLL_CTL_ADD, so->s, &Event);
+    }
+    if (rc < 0)
+    {
+        Log2(("NAT: epoll_ctl failed for %R[natsock] errno=%d\n", so, errno));
+        if (so->so_epoll_fd != -1)
+            pData->cEpollRegistered--;
+        so->so_epoll_fd = -1;
+        so->so_epoll_events = 0;
+        return;
+    }
+    if (so->so_epoll_fd == -1)
+        pData->cEpollRegistered++;
+    so->so_epoll_fd = so->s;
+    so->so_epoll_events = fWant;
+}
+
+/**
+ * Removes the socket from the epoll set.
+ *
+ * Must be called before the descriptor is closed, otherwise a recycled
+ * descriptor number could be mistaken for the old registration.
+ *
+ * @param   pData   The NAT instance.
+ * @param   so      The socket.
+ */
+void slirp_epoll_unregister(PNATState pData, struct socket *so)
+{
+    if (so->so_epoll_fd != -1)
+    {
+        struct epoll_event Event;
+        RT_ZERO(Event); /* pre 2.6.9 kernels insist on a non-NULL event */
+        STAM_COUNTER_INC(&pData->StatEpollCtl);
+        epoll_ctl(pData->iEpollFd, EPOLL_CTL_DEL, so->so_epoll_fd, &Event);
+        pData->cEpollRegistered--;
+    }
+    so->so_epoll_fd = -1;
+    so->so_epoll_events = 0;
+    so->so_epoll_revents = 0;
+
+    /* Don't let slirp_select_poll touch it if it goes away this round. */
+    if (   so->so_epoll_gen == pData->uEpollGen
+        && so->so_epoll_ready < pData->cEpollReady
+        && pData->papEpollReady[so->so_epoll_ready] == so)
+        pData->papEpollReady[so->so_epoll_ready] = NULL;
+}
+
+/**
+ * Puts a socket on the list slirp_select_poll processes this round.
+ *
+ * @param   pData   The NAT instance.
+ * @param   so      The socket, its so_epoll_revents must be set already.
+ */
+static void slirpEpollReadyAdd(PNATState pData, struct socket *so)
+{
+    if (so->so_epoll_gen == pData->uEpollGen)
+        return; /* already on the list */
+
+    if (pData->cEpollReady == pData->cEpollReadyMax)
+    {
+        uint32_t cNew = pData->cEpollReadyMax ? pData->cEpollReadyMax * 2 : NAT_EPOLL_EVENTS_MAX * 2;
+        struct socket **papNew = (struct socket **)RTMemRealloc(pData->papEpollReady, cNew * sizeof(papNew[0]));
+        if (!papNew)
+        {
+            /* Level-triggered registrations are reported again by the next wait. */
+            LogRel(("NAT: out of memory growing the epoll ready list\n"));
+            return;
+        }
+        pData->papEpollReady = papNew;
+        pData->cEpollReadyMax = cNew;
+    }
+    so->so_epoll_gen = pData->uEpollGen;
+    so->so_epoll_ready = pData->cEpollReady;
+    pData->papEpollReady[pData->cEpollReady++] = so;
+}
+
+/**
+ * Registers the descriptor the NAT thread is woken up with.
+ *
+ * Events on it are reported by slirp_select_wait via @a pfWakeup.
+ *
+ * @returns VBox status code.
+ * @param   pData   The NAT instance.
+ * @param   fd      The descriptor (read end of the wakeup pipe).
+ */
+int slirp_register_wakeup_fd(PNATState pData, int fd)
+{
+    struct epoll_event Event;
+    RT_ZERO(Event);
+    Event.events = EPOLLIN | EPOLLPRI;
+    Event.data.ptr = NULL;
+    if (epoll_ctl(pData->iEpollFd, EPOLL_CTL_ADD, fd, &Event) < 0)
+        return RTErrConvertFromErrno(errno);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Waits for events on the registered sockets.
+ *
+ * @returns Number of socket events, -1 and errno on failure.
+ * @param   pData       The NAT instance.
+ * @param   cMillies    How long to wait.
+ * @param   pfWakeup    Where to return whether the wakeup descriptor fired.
+ */
+int slirp_select_wait(PNATState pData, unsigned int cMillies, bool *pfWakeup)
+{
+    int cEvents, i;
+    int cSocketEvents = 0;
+
+    *pfWakeup = false;
+    cEvents = epoll_wait(pData->iEpollFd, &pData->aEpollEvents[0], NAT_EPOLL_EVENTS_MAX,
+                         cMillies > INT32_MAX ? -1 : (int)cMillies);
+    if (cEvents < 0)
+        return cEvents;
+
+    /* Everything freed since the last fill was unregistered, so the pointers are valid. */
+    for (i = 0; i < cEvents; i++)
+    {
+        struct socket *so = (struct socket *)pData->aEpollEvents[i].data.ptr;
+        if (so == NULL)
+        {
+            *pfWakeup = true;
+            continue;
+        }
+        so->so_epoll_revents = pData->aEpollEvents[i].events;
+        slirpEpollReadyAdd(pData, so);
+        cSocketEvents++;
+    }
+    STAM_COUNTER_ADD(&pData->StatEpollReady, cSocketEvents);
+    return cSocketEvents;
+}
+#endif /* VBOX_WITH_NAT_EPOLL */
+
+#if defined(RT_OS_WINDOWS) || defined(VBOX_WITH_NAT_EPOLL)
 void slirp_select_fill(PNATState pData, int *pnfds)
 #else /* RT_OS_WINDOWS */
 void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls)
@@ -872,6 +1148,9 @@ void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls)
      * First, TCP sockets
      */
     do_slowtimo = 0;
+#ifdef VBOX_WITH_NAT_EPOLL
+    pData->icmp_socket.so_epoll_want = 0;
+#endif
     if (!link_up)
         goto done;
 
@@ -895,7 +1174,7 @@ void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls)
         }
     }
     /* always add the ICMP socket */
-#ifndef RT_OS_WINDOWS
+#if !defined(RT_OS_WINDOWS) && !defined(VBOX_WITH_NAT_EPOLL)
     pData->icmp_socket.so_poll_index = -1;
 #endif
     ICMP_ENGAGE_EVENT(&pData->icmp_socket, readfds);
@@ -903,10 +1182,20 @@ void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls)
     STAM_COUNTER_RESET(&pData->StatTCP);
     STAM_COUNTER_RESET(&pData->StatTCPHot);
 
+#if defined(VBOX_WITH_NAT_EPOLL)
+    /*
+     * Only the TCP sockets on the dirty list, nothing happened to the others
+     * since they were last looked at so they still want the same.
+     */
+    LIST_FOREACH(so, &pData->EpollDirty, so_epoll_dirty)
+    {
+        so->so_epoll_want = 0;
+#else
     QSOCKET_FOREACH(so, so_next, tcp)
     /* { */
-#if !defined(RT_OS_WINDOWS)
+# if !defined(RT_OS_WINDOWS)
         so->so_poll_index = -1;
+# endif
 #endif
         STAM_COUNTER_INC(&pData->StatTCP);
 
@@ -989,7 +1278,9 @@ void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls)
     /* { */
 
         STAM_COUNTER_INC(&pData->StatUDP);
-#if !defined(RT_OS_WINDOWS)
+#if defined(VBOX_WITH_NAT_EPOLL)
+        so->so_epoll_want = 0;
+#elif !defined(RT_OS_WINDOWS)
         so->so_poll_index = -1;
 #endif
 
@@ -1035,6 +1326,43 @@ done:
 
 #if defined(RT_OS_WINDOWS)
     *pnfds = VBOX_EVENT_COUNT;
+#elif defined(VBOX_WITH_NAT_EPOLL)
+    /*
+     * Push the changed interest sets to the kernel.  Sockets closed while the
+     * link is down or which were skipped above want nothing and get dropped.
+     *
+     * A new round starts here: the ready list is reset and seeded with the
+     * TCP sockets which are still being drained after a close, they have to
+     * be looked at even if the wait doesn't report them.  Those and the ones
+     * with a delayed ACK for tcp_fasttimo stay on the dirty list, the others
+     * leave it until something happens to them again.
+     */
+    NOREF(nfds);
+    NOREF(poll_index);
+    pData->uEpollGen++;
+    pData->cEpollReady = 0;
+    if (pData->icmp_socket.s != -1)
+        slirpEpollSync(pData, &pData->icmp_socket);
+    LIST_FOREACH_SAFE(so, &pData->EpollDirty, so_epoll_dirty, so_next)
+    {
+        slirpEpollSync(pData, so);
+        if (   so->so_close
+            && so->s != -1
+            && !(so->so_state & SS_NOFDREF))
+        {
+            so->so_epoll_revents = 0;
+            slirpEpollReadyAdd(pData, so);
+        }
+        else if (   link_up
+                 && !(so->so_tcpcb && (so->so_tcpcb->t_flags & TF_DELACK)))
+            SOEPOLL_CLEAN(so);
+    }
+    QSOCKET_FOREACH(so, so_next, udp)
+    /* { */
+        slirpEpollSync(pData, so);
+        LOOP_LABEL(udp, so, so_next);
+    }
+    *pnfds = pData->cEpollRegistered;
 #else /* RT_OS_WINDOWS */
     AssertRelease(poll_index <= *pnfds);
     *pnfds = poll_index;
@@ -1102,6 +1430,8 @@ static bool slirpConnectOrWrite(PNATState pData, struct socket *so, bool fConnec
 
 #if defined(RT_OS_WINDOWS)
 void slirp_select_poll(PNATState pData, int fTimeout, int fIcmp)
+#elif defined(VBOX_WITH_NAT_EPOLL)
+void slirp_select_poll(PNATState pData, int cEvents)
 #else /* RT_OS_WINDOWS */
 void slirp_select_poll(PNATState pData, struct pollfd *polls, int ndfs)
 #endif /* !RT_OS_WINDOWS */
@@ -1115,12 +1445,20 @@ void slirp_select_poll(PNATState pData, struct pollfd *polls, int ndfs)
 #else
     int poll_index = 0;
 #endif
+#ifdef VBOX_WITH_NAT_EPOLL
+    uint32_t iReady;
+    NOREF(cEvents);
+#endif
 
     STAM_PROFILE_START(&pData->StatPoll, a);
 
     /* Update time */
     updtime(pData);
 
+    /* Deliver what the host resolver thread has answered */
+    if (pData->fUseHostResolver)
+        dns_alias_poll(pData);
+
     /*
      * See if anything has timed out
      */
@@ -1166,8 +1504,22 @@ void slirp_select_poll(PNATState pData, struct pollfd *polls, int ndfs)
     /*
      * Check TCP sockets
      */
+#ifdef VBOX_WITH_NAT_EPOLL
+    /* Only the sockets on the ready list, see slirp_select_fill and slirp_select_wait. */
+    for (iReady = 0; iReady < pData->cEpollReady; iReady++)
+    {
+        so = pData->papEpollReady[iReady];
+        if (   !so
+            || so == &pData->icmp_socket
+            || so->so_type != IPPROTO_TCP)
+            continue;
+        NOREF(so_next);
+        /* whatever happens below may change what it waits for */
+        SOEPOLL_DIRTY(pData, so);
+#else
     QSOCKET_FOREACH(so, so_next, tcp)
     /* { */
+#endif
 
 #ifdef VBOX_WITH_SLIRP_MT
         if (   so->so_state & SS_NOFDREF
@@ -1369,8 +1721,18 @@ void slirp_select_poll(PNATState pData, struct pollfd *polls, int ndfs)
      * Incoming packets are sent straight away, they're not buffered.
      * Incoming UDP data isn't buffered either.
      */
+#ifdef VBOX_WITH_NAT_EPOLL
+    for (iReady = 0; iReady < pData->cEpollReady; iReady++)
+    {
+        so = pData->papEpollReady[iReady];
+        if (   !so
+            || so == &pData->icmp_socket
+            || so->so_type != IPPROTO_UDP)
+            continue;
+#else
      QSOCKET_FOREACH(so, so_next, udp)
      /* { */
+#endif
 #ifdef VBOX_WITH_SLIRP_MT
         if (   so->so_state & SS_NOFDREF
             && so->so_deleted == 1)
@@ -1543,6 +1905,131 @@ static void arp_input(PNATState pData, struct mbuf *m)
     m_freem(pData, m);
 }
 
+/**
+ * Sets up the distribution of guest frames over several engines.
+ *
+ * @param   pSel        The distribution to initialize.
+ * @param   u32Network  The NAT network (host byte order).
+ * @param   u32Netmask  The NAT netmask (host byte order).
+ * @param   cEngines    Number of engines, the first one is the primary.
+ */
+void slirp_flow_init(PSLIRPFLOWSEL pSel, uint32_t u32Network, uint32_t u32Netmask, unsigned cEngines)
+{
+    memset(pSel, 0, sizeof(*pSel));
+    pSel->u32Network = u32Network & u32Netmask;
+    pSel->u32Netmask = u32Netmask;
+    pSel->cEngines   = cEngines;
+}
+
+/**
+ * Notes a port forwarding rule.
+ *
+ * The host side socket of a rule lives in the primary engine, so the guest
+ * side of the forwarded connections must not be distributed.  Ports are not
+ * removed again when a rule goes away, that only keeps a few flows on the
+ * primary engine.
+ *
+ * @param   pSel            The distribution.
+ * @param   fUdp            Whether it is a UDP or a TCP rule.
+ * @param   u16GuestPort    The guest port (host byte order).
+ */
+void slirp_flow_add_forward(PSLIRPFLOWSEL pSel, bool fUdp, uint16_t u16GuestPort)
+{
+    ASMAtomicBitSet(fUdp ? &pSel->bmUdpFwd[0] : &pSel->bmTcpFwd[0], u16GuestPort);
+}
+
+/**
+ * Picks the engine a guest frame is processed by.
+ *
+ * TCP flows are spread by a hash of both addresses and ports.  UDP flows are
+ * spread by the guest address and port only, so a guest socket keeps a
+ * single host socket and mapping no matter where it sends to, just like with
+ * one engine.  Everything else goes to the primary engine:
+ *   - ICMP: the replies arrive on the ICMP socket of every engine and are
+ *     matched against the engine's own requests, distributing would only
+ *     multiply that work;
+ *   - fragments, only the first one carries the ports;
+ *   - traffic to the NAT's own addresses (DNS, TFTP, host loopback), DHCP
+ *     and broadcasts;
+ *   - the guest side of forwarded ports, see slirp_flow_add_forward;
+ *   - FTP, whose alias handler keeps its state in the primary libalias.
+ * ARP replies and announcements go to every engine as each one keeps its
+ * own ARP cache, requests are only answered by the primary engine.
+ *
+ * @returns The engine index or SLIRP_FLOW_ALL_ENGINES.
+ * @param   pSel        The distribution.
+ * @param   pbFrame     The ethernet frame.
+ * @param   cbFrame     The size of the frame.
+ */
+unsigned slirp_flow_select(PCSLIRPFLOWSEL pSel, const uint8_t *pbFrame, size_t cbFrame)
+{
+    const struct ethhdr *eh = (const struct ethhdr *)pbFrame;
+    const struct ip *ip;
+    const uint16_t *pu16Ports;
+    size_t cbIpHdr;
+    uint32_t u32Dst, u32Hash;
+    uint16_t u16SrcPort, u16DstPort;
+
+    if (   pSel->cEngines <= 1
+        || cbFrame < ETH_HLEN + sizeof(struct arphdr))
+        return 0;
+
+    if (eh->h_proto == RT_H2N_U16_C(ETH_P_ARP))
+    {
+        const struct arphdr *ah = (const struct arphdr *)(pbFrame + ETH_HLEN);
+        if (   ah->ar_op == RT_H2N_U16_C(ARPOP_REPLY)
+            || !memcmp(ah->ar_sip, ah->ar_tip, sizeof(ah->ar_sip)))
+            return SLIRP_FLOW_ALL_ENGINES;
+        return 0;
+    }
+    if (eh->h_proto != RT_H2N_U16_C(ETH_P_IP))
+        return 0;
+
+    ip = (const struct ip *)(pbFrame + ETH_HLEN);
+    cbIpHdr = ip->ip_hl << 2;
+    if (   ip->ip_v != IPVERSION
+        || cbIpHdr < sizeof(struct ip)
+        || cbFrame < ETH_HLEN + cbIpHdr + 2 * sizeof(uint16_t)
+        || (ip->ip_off & RT_H2N_U16_C(IP_MF | IP_OFFMASK)))
+        return 0;
+
+    u32Dst = RT_N2H_U32(ip->ip_dst.s_addr);
+    if (   (u32Dst & pSel->u32Netmask) == pSel->u32Network
+        || u32Dst == INADDR_BROADCAST
+        || (u32Dst & UINT32_C(0xf0000000)) == UINT32_C(0xe0000000) /* multicast */)
+        return 0;
+
+    /* The ports are at the same place in the TCP and UDP headers. */
+    pu16Ports  = (const uint16_t *)((const uint8_t *)ip + cbIpHdr);
+    u16SrcPort = RT_N2H_U16(pu16Ports[0]);
+    u16DstPort = RT_N2H_U16(pu16Ports[1]);
+    switch (ip->ip_p)
+    {
+        case IPPROTO_TCP:
+            if (   u16DstPort == 21 || u16DstPort == 20
+                || u16SrcPort == 21 || u16SrcPort == 20
+                || ASMBitTest(&pSel->bmTcpFwd[0], u16SrcPort))
+                return 0;
+            u32Hash = ip->ip_src.s_addr ^ ip->ip_dst.s_addr ^ ((uint32_t)u16SrcPort << 16 | u16DstPort);
+            break;
+
+        case IPPROTO_UDP:
+            if (   u16DstPort == BOOTP_SERVER
+                || ASMBitTest(&pSel->bmUdpFwd[0], u16SrcPort))
+                return 0;
+            u32Hash = ip->ip_src.s_addr ^ u16SrcPort;
+            break;
+
+        default:
+            return 0;
+    }
+
+    u32Hash ^= u32Hash >> 16;
+    u32Hash *= UINT32_C(0x45d9f3b);
+    u32Hash ^= u32Hash >> 16;
+    return u32Hash % pSel->cEngines;
+}
+
 /**
  * Feed a packet into the slirp engine.
  *
@@ -2193,6 +2680,15 @@ void slirp_set_mtu(PNATState pData, int mtu)
     if_mru = mtu;
 }
 
+/**
+ * Tells the engine whether the device above accepts TCP frames larger than
+ * the MTU along with the segment size to cut them into (GSO).
+ */
+void slirp_set_gso(PNATState pData, bool fEnabled)
+{
+    if_gso = fEnabled;
+}
+
 /**
  * Info handler.
  */
@@ -251,6 +251,10 @@ int inet_aton (const char *cp, struct in_addr *ia);
 # include <sys/stropts.h>
 #endif
 
+#ifdef VBOX_WITH_NAT_EPOLL
+# include <sys/epoll.h>
+#endif
+
 #include "libslirp.h"
 
 #include "debug.h"
@@ -465,6 +469,8 @@ int nbt_alias_load(PNATState);
 int nbt_alias_unload(PNATState);
 int dns_alias_load(PNATState);
 int dns_alias_unload(PNATState);
+int dns_alias_query(PNATState, struct mbuf *, struct sockaddr_in *, struct sockaddr_in *);
+void dns_alias_poll(PNATState);
 int slirp_arp_lookup_ip_by_ether(PNATState, const uint8_t *, uint32_t *);
 int slirp_arp_lookup_ether_by_ip(PNATState, uint32_t, uint8_t *);
 
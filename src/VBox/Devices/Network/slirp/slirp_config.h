@@ -97,6 +97,9 @@
 
 /* Define if you have readv */
 #undef HAVE_READV
+#ifndef RT_OS_WINDOWS
+# define HAVE_READV
+#endif
 
 /* Define if iovec needs to be declared */
 #undef DECLARE_IOVEC
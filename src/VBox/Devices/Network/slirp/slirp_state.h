@@ -19,6 +19,7 @@
 
 #include <iprt/req.h>
 #include <iprt/critsect.h>
+#include <iprt/thread.h>
 
 #define COUNTERS_INIT
 #include "counters.h"
@@ -33,6 +34,12 @@
 /** DHCP Lease time. */
 #define LEASE_TIME (24 * 3600)
 
+#ifdef VBOX_WITH_NAT_EPOLL
+/** Number of events fetched by a single epoll_wait, the rest is picked up by
+ * the next round (the sockets are registered level-triggered). */
+# define NAT_EPOLL_EVENTS_MAX 128
+#endif
+
 /*
  * ARP cache this is naive implementaion of ARP
  * cache of mapping 4 byte IPv4 address to 6 byte
@@ -71,6 +78,8 @@ struct dns_entry
     TAILQ_ENTRY(dns_entry) de_list;
 };
 TAILQ_HEAD(dns_list_head, dns_entry);
+LIST_HEAD(dns_cache_bucket, dns_cache_entry);
+TAILQ_HEAD(dns_cache_lru, dns_cache_entry);
 TAILQ_HEAD(if_queue, mbuf);
 
 struct port_forward_rule
@@ -107,6 +116,8 @@ typedef struct NATState
     int if_maxlinkhdr;
     int if_queued;
     int if_thresh;
+    /** Whether the device above takes TCP frames larger than the MTU (GSO). */
+    bool if_gso;
     /* Stuff from icmp.c */
     struct icmpstat_t icmpstat;
     /* Stuff from ip_input.c */
@@ -159,6 +170,7 @@ typedef struct NATState
     RTCRITSECT      tcb_mutex;
 #endif
     struct socket *tcp_last_so;
+    struct sohashtab tcb_hash;
     tcp_seq tcp_iss;
     /* Stuff from tcp_timer.c */
     struct tcpstat_t tcpstat;
@@ -177,6 +189,7 @@ typedef struct NATState
     RTCRITSECT      udb_mutex;
 #endif
     struct socket *udp_last_so;
+    struct sohashtab udb_hash;
     struct socket icmp_socket;
     struct icmp_storage icmp_msg_head;
 # ifndef RT_OS_WINDOWS
@@ -191,6 +204,25 @@ typedef struct NATState
 #  define NSOCK_DEC() do {pData->nsock--;} while (0)
 #  define NSOCK_INC_EX(ex) do {ex->pData->nsock++;} while (0)
 #  define NSOCK_DEC_EX(ex) do {ex->pData->nsock--;} while (0)
+#  ifdef VBOX_WITH_NAT_EPOLL
+    /** The epoll instance all sockets stay registered with, see slirp_select_fill. */
+    int iEpollFd;
+    /** Incremented by every slirp_select_fill, tags the socket revents. */
+    uint32_t uEpollGen;
+    /** Event buffer for epoll_wait. */
+    struct epoll_event aEpollEvents[NAT_EPOLL_EVENTS_MAX];
+    /** The sockets slirp_select_poll has to look at this round: the ones
+     * reported by epoll_wait and the ones still being drained. */
+    struct socket **papEpollReady;
+    /** Number of entries in papEpollReady. */
+    uint32_t cEpollReady;
+    /** Number of entries papEpollReady has room for. */
+    uint32_t cEpollReadyMax;
+    /** The TCP sockets slirp_select_fill has to look at, see SOEPOLL_DIRTY. */
+    LIST_HEAD(RT_NOTHING, socket) EpollDirty;
+    /** Number of sockets registered with iEpollFd. */
+    int cEpollRegistered;
+#  endif
 # else
 #  define NSOCK_INC() do {} while (0)
 #  define NSOCK_DEC() do {} while (0)
@@ -244,6 +276,8 @@ typedef struct NATState
     struct mbstat mbstat;
 #endif
     uma_zone_t zone_ext_refcnt;
+    /** Number of guest mbufs held by reference by all sockets, see sbappendref. */
+    int cSbufRefs;
     bool fUseHostResolver;
     /* from dnsproxy/dnsproxy.h*/
     unsigned int authoritative_port;
@@ -273,6 +307,23 @@ typedef struct NATState
 #define HASHSIZE 10
 #define HASH(id) (id & ((1 << HASHSIZE) - 1))
     struct request *request_hash[1 << HASHSIZE];
+    /* in flight requests hashed by their question, for coalescing */
+    struct request *request_qhash[1 << HASHSIZE];
+    /* dnsproxy/cache.c */
+#define DNS_CACHE_HASHSIZE 256
+    struct dns_cache_bucket dns_cache[DNS_CACHE_HASHSIZE];
+    struct dns_cache_lru dns_cache_lru;
+    int cDnsCacheEntries;
+    /* libalias/alias_dns.c: lookups of the host resolver run on this thread */
+    RTTHREAD hHostResThread;
+    PRTREQQUEUE pHostResReqQueue;
+    /* answered lookups waiting for the NAT thread */
+    RTCRITSECT csHostResDone;
+    struct hostres_request *pHostResDoneHead;
+    struct hostres_request *pHostResDoneTail;
+    /* lookups the resolver thread is busy with, NAT thread only */
+    struct hostres_request *pHostResPending;
+    volatile bool fHostResTerminate;
     /* this field control behaviour of DHCP server */
     bool fUseDnsProxy;
 
@@ -339,6 +390,7 @@ typedef struct NATState
 #define if_maxlinkhdr pData->if_maxlinkhdr
 #define if_queued pData->if_queued
 #define if_thresh pData->if_thresh
+#define if_gso pData->if_gso
 
 #define icmpstat pData->icmpstat
 
@@ -372,6 +424,7 @@ typedef struct NATState
 
 #define tcb pData->tcb
 #define tcp_last_so pData->tcp_last_so
+#define tcb_hash pData->tcb_hash
 #define tcp_iss pData->tcp_iss
 
 #define tcpstat pData->tcpstat
@@ -383,6 +436,7 @@ typedef struct NATState
 #define udpstat pData->udpstat
 #define udb pData->udb
 #define udp_last_so pData->udp_last_so
+#define udb_hash pData->udb_hash
 
 #define maxfragsperpacket pData->maxfragsperpacket
 #define maxnipq pData->maxnipq
@@ -653,6 +707,7 @@ typedef struct NATState
 /* dnsproxy/hash.c */
 #define dns_port pData->port
 #define request_hash pData->request_hash
+#define request_qhash pData->request_qhash
 #define hash_collisions pData->hash_collisions
 #define active_queries pData->active_queries
 #define all_queries pData->all_queries
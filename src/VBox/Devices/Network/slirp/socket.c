@@ -68,6 +68,174 @@ solookup(struct socket *head, struct in_addr laddr,
     return (struct socket *)NULL;
 }
 
+static struct sohashtab *
+sohashtabof(PNATState pData, struct socket *head)
+{
+    if (head == &tcb)
+        return &tcb_hash;
+    if (head == &udb)
+        return &udb_hash;
+    return NULL;
+}
+
+static u_int
+sohashkey(struct sohashtab *pTab, struct in_addr laddr, u_int lport,
+          struct in_addr faddr, u_int fport)
+{
+    uint32_t u32 = laddr.s_addr ^ ((uint32_t)lport << 16);
+    if (!pTab->fGuestEnd)
+        u32 ^= RT_BSWAP_U32(faddr.s_addr) ^ fport;
+    /* fold the bits down so that sequential ports spread over the buckets */
+    u32 ^= u32 >> 16;
+    u32 *= 0x45d9f3b;
+    u32 ^= u32 >> 16;
+    return u32 & (pTab->cBuckets - 1);
+}
+
+static bool
+sohashmatch(struct sohashtab *pTab, struct socket *so, struct in_addr laddr,
+            u_int lport, struct in_addr faddr, u_int fport)
+{
+    return    so->so_lport        == lport
+           && so->so_laddr.s_addr == laddr.s_addr
+           && (   pTab->fGuestEnd
+               || (   so->so_faddr.s_addr == faddr.s_addr
+                   && so->so_fport        == fport));
+}
+
+static void
+sohashlink(struct sohashtab *pTab, struct socket *so)
+{
+    struct socket **ppHead = &pTab->ppHead[sohashkey(pTab, so->so_laddr, so->so_lport,
+                                                     so->so_faddr, so->so_fport)];
+    so->so_hnext = *ppHead;
+    if (so->so_hnext)
+        so->so_hnext->so_hpprev = &so->so_hnext;
+    so->so_hpprev = ppHead;
+    *ppHead = so;
+}
+
+/*
+ * Doubles the bucket array once the chains get longer than two entries on
+ * average.  If the allocation fails we just keep the old array.
+ */
+static void
+sohashgrow(PNATState pData, struct sohashtab *pTab)
+{
+    struct socket **ppOld = pTab->ppHead;
+    u_int cOld = pTab->cBuckets;
+    u_int i;
+
+    if (   pTab->cSockets <= 2 * cOld
+        || cOld >= SOHASH_MAX_BUCKETS)
+        return;
+
+    pTab->ppHead = (struct socket **)RTMemAllocZ(2 * cOld * sizeof(struct socket *));
+    if (!pTab->ppHead)
+    {
+        pTab->ppHead = ppOld;
+        return;
+    }
+    pTab->cBuckets = 2 * cOld;
+    for (i = 0; i < cOld; ++i)
+    {
+        struct socket *so = ppOld[i];
+        while (so)
+        {
+            struct socket *so_next = so->so_hnext;
+            sohashlink(pTab, so);
+            so = so_next;
+        }
+    }
+    RTMemFree(ppOld);
+    STAM_COUNTER_INC(&pData->StatSoHashGrow);
+}
+
+/*
+ * Sets up the connection hash of the tcb or udb queue.  Without the bucket
+ * array the lookups fall back to walking the queue.
+ */
+void
+sohashinit(PNATState pData, struct socket *head)
+{
+    struct sohashtab *pTab = sohashtabof(pData, head);
+    pTab->ppHead = (struct socket **)RTMemAllocZ(SOHASH_MIN_BUCKETS * sizeof(struct socket *));
+    pTab->cBuckets = SOHASH_MIN_BUCKETS;
+    pTab->cSockets = 0;
+    pTab->fGuestEnd = (head == &udb);
+}
+
+void
+sohashfini(PNATState pData, struct socket *head)
+{
+    struct sohashtab *pTab = sohashtabof(pData, head);
+    if (pTab->ppHead)
+        RTMemFree(pTab->ppHead);
+    pTab->ppHead = NULL;
+    pTab->cSockets = 0;
+}
+
+/*
+ * (Re)hashes a socket of the given queue under its current tuple.  Must be
+ * called whenever so_laddr/so_lport/so_faddr/so_fport of a queued socket
+ * change, sofree() takes it out again.
+ */
+void
+sohashinsert(PNATState pData, struct socket *so, struct socket *head)
+{
+    struct sohashtab *pTab = sohashtabof(pData, head);
+    if (!pTab || !pTab->ppHead)
+        return;
+    sohashremove(so);
+    sohashlink(pTab, so);
+    so->so_htab = pTab;
+    pTab->cSockets++;
+    sohashgrow(pData, pTab);
+}
+
+void
+sohashremove(struct socket *so)
+{
+    if (!so->so_hpprev)
+        return;
+    *so->so_hpprev = so->so_hnext;
+    if (so->so_hnext)
+        so->so_hnext->so_hpprev = so->so_hpprev;
+    so->so_htab->cSockets--;
+    so->so_hnext = NULL;
+    so->so_hpprev = NULL;
+    so->so_htab = NULL;
+}
+
+/*
+ * Finds the socket for a tuple seen on the guest side.  For udb faddr and
+ * fport are ignored.
+ */
+struct socket *
+sohashlookup(PNATState pData, struct socket *head, struct in_addr laddr,
+             u_int lport, struct in_addr faddr, u_int fport)
+{
+    struct sohashtab *pTab = sohashtabof(pData, head);
+    struct socket *so;
+
+    if (!pTab->ppHead)
+    {
+        for (so = head->so_next; so != head; so = so->so_next)
+            if (sohashmatch(pTab, so, laddr, lport, faddr, fport))
+                return so;
+        return NULL;
+    }
+
+    STAM_COUNTER_INC(&pData->StatSoHashLookup);
+    for (so = pTab->ppHead[sohashkey(pTab, laddr, lport, faddr, fport)]; so; so = so->so_hnext)
+    {
+        STAM_COUNTER_INC(&pData->StatSoHashProbe);
+        if (sohashmatch(pTab, so, laddr, lport, faddr, fport))
+            return so;
+    }
+    return NULL;
+}
+
 /*
  * Create a new socket, initialise the fields
  * It is the responsibility of the caller to
@@ -85,6 +253,9 @@ socreate()
         so->s = -1;
 #if !defined(RT_OS_WINDOWS)
         so->so_poll_index = -1;
+# ifdef VBOX_WITH_NAT_EPOLL
+        so->so_epoll_fd = -1;
+# endif
 #endif
     }
     return so;
@@ -99,6 +270,8 @@ void
 sofree(PNATState pData, struct socket *so)
 {
     struct socket *so_prev = NULL;
+    SOEPOLL_UNREGISTER(pData, so);
+    SOEPOLL_CLEAN(so);
     if (so == tcp_last_so)
         tcp_last_so = &tcb;
     else if (so == udp_last_so)
@@ -107,6 +280,7 @@ sofree(PNATState pData, struct socket *so)
     /* check if mbuf haven't been already freed  */
     if (so->so_m != NULL)
         m_freem(pData, so->so_m);
+    sohashremove(so);
 #ifndef VBOX_WITH_SLIRP_MT
     if (so->so_next && so->so_prev)
     {
@@ -497,10 +671,12 @@ sosendoob(struct socket *so)
 int
 sowrite(PNATState pData, struct socket *so)
 {
-    int n, nn;
+    int n, nn, i;
     struct sbuf *sb = &so->so_rcv;
     size_t len = sb->sb_cc;
-    struct iovec iov[2];
+    size_t cbRing;
+    size_t cbIov;
+    struct iovec iov[SBUF_MAX_IOV];
 
     STAM_PROFILE_START(&pData->StatIOwrite, a);
     STAM_COUNTER_RESET(&pData->StatIOWrite_in_1);
@@ -518,6 +694,9 @@ sowrite(PNATState pData, struct socket *so)
     QSOCKET_UNLOCK(tcb);
     if (so->so_urgc)
     {
+        /* urgent data is sent from the buffer */
+        if (sb->sb_mb)
+            sbpullup(pData, sb);
         sosendoob(so);
         if (sb->sb_cc == 0)
         {
@@ -535,9 +714,12 @@ sowrite(PNATState pData, struct socket *so)
     len = sb->sb_cc;
 
     iov[0].iov_base = sb->sb_rptr;
+    iov[0].iov_len  = 0;
     iov[1].iov_base = 0;
     iov[1].iov_len  = 0;
-    if (sb->sb_rptr < sb->sb_wptr)
+    if (!len)
+        n = 0;
+    else if (sb->sb_rptr < sb->sb_wptr)
     {
         iov[0].iov_len = sb->sb_wptr - sb->sb_rptr;
         /* Should never succeed, but... */
@@ -575,6 +757,20 @@ sowrite(PNATState pData, struct socket *so)
             STAM_COUNTER_ADD(&pData->StatIOWrite_in_2_2nd_bytes, iov[1].iov_len);
         }
     });
+
+    /* len was consumed by the wrap handling above */
+    cbRing = iov[0].iov_len + iov[1].iov_len;
+
+    /*
+     * The guest mbufs held by reference follow the buffered data,
+     * they are written straight from the mbufs
+     */
+    if (sb->sb_mb)
+        n += sbrefiov(sb, &iov[n], RT_ELEMENTS(iov) - n);
+    cbIov = 0;
+    for (i = 0; i < n; i++)
+        cbIov += iov[i].iov_len;
+
     /* Check if there's urgent data to send, and if so, send it */
 #ifdef HAVE_READV
     nn = writev(so->s, (const struct iovec *)iov, n);
@@ -593,7 +789,7 @@ sowrite(PNATState pData, struct socket *so)
         return 0;
     }
 
-    if (nn < 0 || (nn == 0 && iov[0].iov_len > 0))
+    if (nn < 0 || (nn == 0 && cbIov > 0))
     {
         Log2(("%s: disconnected, so->so_state = %x, errno = %d\n",
               __PRETTY_FUNCTION__, so->so_state, errno));
@@ -605,38 +801,44 @@ sowrite(PNATState pData, struct socket *so)
     }
 
 #ifndef HAVE_READV
-    if (n == 2 && nn == iov[0].iov_len)
+    /* No writev(), send the remaining pieces one by one until one is short */
+    for (i = (nn == iov[0].iov_len ? 1 : n); i < n; i++)
     {
         int ret;
-        ret = send(so->s, iov[1].iov_base, iov[1].iov_len, 0);
+        ret = send(so->s, iov[i].iov_base, iov[i].iov_len, 0);
         if (ret > 0)
             nn += ret;
         STAM_STATS({
-            if (ret > 0 && ret != iov[1].iov_len)
+            if (ret > 0 && ret != iov[i].iov_len)
             {
                 STAM_COUNTER_INC(&pData->StatIOWrite_rest);
-                STAM_COUNTER_ADD(&pData->StatIOWrite_rest_bytes, (iov[1].iov_len - ret));
+                STAM_COUNTER_ADD(&pData->StatIOWrite_rest_bytes, (iov[i].iov_len - ret));
             }
         });
+        if (ret != iov[i].iov_len)
+            break;
     }
     Log2(("%s: wrote(2) nn = %d bytes\n", __PRETTY_FUNCTION__, nn));
 #endif
 
-    /* Update sbuf */
-    sb->sb_cc -= nn;
-    sb->sb_rptr += nn;
+    /* Update sbuf, the buffered data goes first */
+    i = RT_MIN((size_t)nn, cbRing);
+    sb->sb_cc -= i;
+    sb->sb_rptr += i;
     Log2(("%s: update so_rcv (written nn = %d) %R[sbuf]\n", __PRETTY_FUNCTION__, nn, sb));
     if (sb->sb_rptr >= (sb->sb_data + sb->sb_datalen))
     {
         sb->sb_rptr -= sb->sb_datalen;
         Log2(("%s: alter sb_rptr of so_rcv %R[sbuf]\n", __PRETTY_FUNCTION__, sb));
     }
+    if (nn > i)
+        sbdropref(pData, sb, nn - i);
 
     /*
      * If in DRAIN mode, and there's no more data, set
      * it CANTSENDMORE
      */
-    if ((so->so_state & SS_FWDRAIN) && sb->sb_cc == 0)
+    if ((so->so_state & SS_FWDRAIN) && SBUF_LEN(sb) == 0)
         sofcantsendmore(so);
 
     SOCKET_UNLOCK(so);
@@ -757,7 +959,19 @@ sorecvfrom(PNATState pData, struct socket *so)
         }
 
         len = sizeof(struct udpiphdr);
-        m = m_getjcl(pData, M_NOWAIT, MT_HEADER, M_PKTHDR, slirp_size(pData));
+        /*
+         * Pick a cluster the datagram fits in so that it can be received
+         * straight into the mbuf without a temporary buffer.
+         */
+        size = slirp_size(pData);
+        if (n + sizeof(struct udpiphdr) + ETH_HLEN > size)
+        {
+            if (n + sizeof(struct udpiphdr) + ETH_HLEN <= MJUM9BYTES)
+                size = MJUM9BYTES;
+            else if (n + sizeof(struct udpiphdr) + ETH_HLEN <= MJUM16BYTES)
+                size = MJUM16BYTES;
+        }
+        m = m_getjcl(pData, M_NOWAIT, MT_HEADER, M_PKTHDR, size);
         if (m == NULL)
             return;
 
@@ -773,8 +987,9 @@ sorecvfrom(PNATState pData, struct socket *so)
          * Slirp will able fragment it, but we won't create temporal location
          * here.
          */
-        if (n > (slirp_size(pData) - sizeof(struct udpiphdr)))
+        if (n + sizeof(struct udpiphdr) + ETH_HLEN > size)
         {
+            STAM_COUNTER_INC(&pData->StatIOUdpRecvTmp);
             pchBuffer = RTMemAlloc((n) * sizeof(char));
             if (!pchBuffer)
             {
@@ -994,8 +1209,10 @@ solisten(PNATState pData, u_int32_t bind_addr, u_int port, u_int32_t laddr, u_in
     SOCKET_LOCK_CREATE(so);
     SOCKET_LOCK(so);
     QSOCKET_LOCK(tcb);
+    so->so_type = IPPROTO_TCP;
     insque(pData, so,&tcb);
     NSOCK_INC();
+    SOEPOLL_DIRTY(pData, so);
     QSOCKET_UNLOCK(tcb);
 
     /*
@@ -1072,6 +1289,7 @@ no_sockopt:
         so->so_faddr = addr.sin_addr;
 
     so->s = s;
+    sohashinsert(pData, so, &tcb);
     SOCKET_UNLOCK(so);
     return so;
 }
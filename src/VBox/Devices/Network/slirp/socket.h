@@ -35,6 +35,23 @@
 #define SO_EXPIRE 240000
 #define SO_EXPIREFAST 10000
 
+#define SOHASH_MIN_BUCKETS 64
+#define SOHASH_MAX_BUCKETS 65536
+
+/*
+ * Index over the sockets of one queue (tcb or udb).  The queue still owns
+ * the sockets, the hash only saves the input path from walking it.  TCP
+ * sockets are keyed on the full connection tuple, UDP sockets on the guest
+ * end only, matching what udp_input() looks for.
+ */
+struct sohashtab
+{
+    struct socket **ppHead;      /* bucket heads, NULL if allocation failed */
+    u_int           cBuckets;    /* always a power of two */
+    u_int           cSockets;    /* sockets currently hashed */
+    bool            fGuestEnd;   /* key on (so_laddr, so_lport) only */
+};
+
 /*
  * Our socket structure
  */
@@ -43,6 +60,9 @@ struct socket
 {
     struct socket   *so_next;
     struct socket   *so_prev;    /* For a linked list of sockets */
+    struct socket   *so_hnext;   /* next socket in the same hash bucket */
+    struct socket  **so_hpprev;  /* link pointing at us, NULL if not hashed */
+    struct sohashtab *so_htab;   /* hash the socket is linked into */
 
 #if !defined(RT_OS_WINDOWS)
     int s;                       /* The actual socket */
@@ -90,6 +110,15 @@ struct socket
 #endif
 #ifndef RT_OS_WINDOWS
     int so_poll_index;
+# ifdef VBOX_WITH_NAT_EPOLL
+    int so_epoll_fd;             /* descriptor registered with the epoll set, -1 if none */
+    uint32_t so_epoll_events;    /* events the descriptor is registered for */
+    uint32_t so_epoll_want;      /* events wanted, collected by slirp_select_fill */
+    uint32_t so_epoll_revents;   /* events returned by the last wait */
+    uint32_t so_epoll_gen;       /* wait generation so_epoll_revents belongs to */
+    uint32_t so_epoll_ready;     /* index into papEpollReady if so_epoll_gen is current */
+    LIST_ENTRY(socket) so_epoll_dirty; /* on EpollDirty if slirp_select_fill has to look at it */
+# endif
 #endif /* !RT_OS_WINDOWS */
     /*
      * FD_CLOSE/POLLHUP event has been occurred on socket
@@ -170,8 +199,39 @@ struct iovec
 
 void so_init (void);
 struct socket * solookup (struct socket *, struct in_addr, u_int, struct in_addr, u_int);
+void sohashinit (PNATState, struct socket *);
+void sohashfini (PNATState, struct socket *);
+void sohashinsert (PNATState, struct socket *, struct socket *);
+void sohashremove (struct socket *);
+struct socket * sohashlookup (PNATState, struct socket *, struct in_addr, u_int, struct in_addr, u_int);
 struct socket * socreate (void);
 void sofree (PNATState, struct socket *);
+#ifdef VBOX_WITH_NAT_EPOLL
+void slirp_epoll_unregister(PNATState, struct socket *);
+# define SOEPOLL_UNREGISTER(pData, so) slirp_epoll_unregister((pData), (so))
+/*
+ * The TCP sockets something happened to, by the guest, the host or a timer,
+ * go on EpollDirty.  slirp_select_fill only recomputes the interest of those,
+ * an idle connection costs nothing per round.
+ */
+# define SOEPOLL_DIRTY(pData, so)                                           \
+    do {                                                                    \
+        if ((so)->so_epoll_dirty.le_prev == NULL)                           \
+            LIST_INSERT_HEAD(&(pData)->EpollDirty, (so), so_epoll_dirty);   \
+    } while (0)
+# define SOEPOLL_CLEAN(so)                                                  \
+    do {                                                                    \
+        if ((so)->so_epoll_dirty.le_prev != NULL)                           \
+        {                                                                   \
+            LIST_REMOVE((so), so_epoll_dirty);                              \
+            (so)->so_epoll_dirty.le_prev = NULL;                            \
+        }                                                                   \
+    } while (0)
+#else
+# define SOEPOLL_UNREGISTER(pData, so) do {} while (0)
+# define SOEPOLL_DIRTY(pData, so) do {} while (0)
+# define SOEPOLL_CLEAN(so) do {} while (0)
+#endif
 #ifdef VBOX_WITH_SLIRP_MT
 void soread_queue (PNATState, struct socket *, int *);
 #endif
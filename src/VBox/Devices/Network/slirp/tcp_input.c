@@ -463,8 +463,8 @@ findso:
         QSOCKET_UNLOCK(tcb);
         /* @todo fix SOLOOKUP macrodefinition to be usable here */
 #ifndef VBOX_WITH_SLIRP_MT
-        so = solookup(&tcb, ti->ti_src, ti->ti_sport,
-                      ti->ti_dst, ti->ti_dport);
+        so = sohashlookup(pData, &tcb, ti->ti_src, ti->ti_sport,
+                          ti->ti_dst, ti->ti_dport);
 #else
         so = NULL;
         QSOCKET_FOREACH(so, sonxt, tcp)
@@ -495,6 +495,8 @@ findso:
         QSOCKET_UNLOCK(tcb);
     }
     LogFlowFunc(("(leave) findso: %R[natsock]\n", so));
+    if (so)
+        SOEPOLL_DIRTY(pData, so);
 
     /*
      * If the state is CLOSED (i.e., TCB does not exist) then
@@ -544,6 +546,7 @@ findso:
         so->so_lport = ti->ti_sport;
         so->so_faddr = ti->ti_dst;
         so->so_fport = ti->ti_dport;
+        sohashinsert(pData, so, &tcb);
 
         so->so_iptos = ((struct ip *)ti)->ip_tos;
 
@@ -1531,7 +1534,7 @@ step6:
          * soreceive.  It's hard to imagine someone
          * actually wanting to send this much urgent data.
          */
-        if (ti->ti_urp + so->so_rcv.sb_cc > so->so_rcv.sb_datalen)
+        if (ti->ti_urp + SBUF_LEN(&so->so_rcv) > SBUF_SIZE(&so->so_rcv))
         {
             ti->ti_urp = 0;
             tiflags &= ~TH_URG;
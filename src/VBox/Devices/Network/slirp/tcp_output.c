@@ -84,6 +84,9 @@ static const u_char  tcp_outflags[TCP_NSTATES] =
 
 
 #define MAX_TCPOPTLEN   32      /* max # bytes that go in options */
+/* max # data bytes in a frame left to the device to segment (GSO), the
+ * headers and the data have to fit into a 16K jumbo cluster */
+#define TCP_GSO_MAXLEN  (MJUM16BYTES - ETH_HLEN - sizeof(struct tcpiphdr) - 1)
 
 /*
  * Tcp output routine: figure out what should be sent and send it.
@@ -93,6 +96,7 @@ tcp_output(PNATState pData, register struct tcpcb *tp)
 {
     register struct socket *so = tp->t_socket;
     register long len, win;
+    long maxlen, segsz;
     int off, flags, error;
     register struct mbuf *m = NULL;
     register struct tcpiphdr *ti;
@@ -184,9 +188,29 @@ again:
             tp->snd_nxt = tp->snd_una;
         }
     }
-    if (len > tp->t_maxseg)
+    /*
+     * If the device takes large frames, hand it as many full segments
+     * as fit into a cluster and leave the segmentation to it.  Not for
+     * SYNs (options), probes, or with urgent data as the device doesn't
+     * adjust the urgent pointer of the segments.
+     */
+    maxlen = tp->t_maxseg;
+    if (   if_gso
+        && (flags & (TH_SYN|TH_RST)) == 0
+        && tp->t_force == 0
+        && !SEQ_GT(tp->snd_up, tp->snd_una))
+        maxlen = RT_MAX(TCP_GSO_MAXLEN / tp->t_maxseg, 1) * tp->t_maxseg;
+    if (len > maxlen)
     {
-        len = tp->t_maxseg;
+        len = maxlen;
+        sendalot = 1;
+    }
+    /* Don't put a short segment in the middle of the stream. */
+    if (   len > tp->t_maxseg
+        && len % tp->t_maxseg
+        && off + len < SBUF_LEN(&so->so_snd))
+    {
+        len -= len % tp->t_maxseg;
         sendalot = 1;
     }
     if (SEQ_LT(tp->snd_nxt + len, tp->snd_una + SBUF_LEN(&so->so_snd)))
@@ -206,7 +230,7 @@ again:
      */
     if (len)
     {
-        if (len == tp->t_maxseg)
+        if (len >= tp->t_maxseg)
             goto send;
         if ((1 || idle || tp->t_flags & TF_NODELAY) &&
                 len + off >= SBUF_LEN(&so->so_snd))
@@ -364,10 +388,20 @@ send:
     /*
      * Adjust data length if insertion of options will
      * bump the packet length beyond the t_maxseg length.
+     * The device repeats the options in every segment it
+     * cuts from a large frame, so they reduce each of them.
      */
-    if (len > tp->t_maxseg - optlen)
+    segsz = tp->t_maxseg - optlen;
+    if (len > maxlen / tp->t_maxseg * segsz)
     {
-        len = tp->t_maxseg - optlen;
+        len = maxlen / tp->t_maxseg * segsz;
+        sendalot = 1;
+    }
+    if (   len > segsz
+        && len % segsz
+        && off + len < SBUF_LEN(&so->so_snd))
+    {
+        len -= len % segsz;
         sendalot = 1;
     }
 
@@ -564,7 +598,19 @@ send:
     if (len + optlen)
         ti->ti_len = RT_H2N_U16((u_int16_t)(sizeof (struct tcphdr)
                                             + optlen + len));
-    ti->ti_sum = cksum(m, (int)(hdrlen + len));
+    if (len > segsz)
+    {
+        /*
+         * The segments are checksummed when the frame is cut, libalias
+         * adjusts whatever it finds here.
+         */
+        m->m_pkthdr.csum_flags |= CSUM_TSO;
+        m->m_pkthdr.tso_segsz = (u_int16_t)segsz;
+        ti->ti_sum = 0;
+        STAM_COUNTER_INC(&pData->StatTCP_gso);
+    }
+    else
+        ti->ti_sum = cksum(m, (int)(hdrlen + len));
 
     /*
      * In transmit state, time the transmission and arrange for
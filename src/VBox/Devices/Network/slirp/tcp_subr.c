@@ -74,6 +74,7 @@ tcp_init(PNATState pData)
     tcp_iss = 1;            /* wrong */
     tcb.so_next = tcb.so_prev = &tcb;
     tcp_last_so = &tcb;
+    sohashinit(pData, &tcb);
     tcp_reass_maxqlen = 48;
     tcp_reass_maxseg  = 256;
 }
@@ -292,14 +293,15 @@ tcp_close(PNATState pData, register struct tcpcb *tp)
     /* clobber input socket cache if we're closing the cached connection */
     if (so == tcp_last_so)
         tcp_last_so = &tcb;
+    SOEPOLL_UNREGISTER(pData, so);
     closesocket(so->s);
     /* Avoid double free if the socket is listening and therefore doesn't have
      * any sbufs reserved. */
     if (!(so->so_state & SS_FACCEPTCONN))
     {
 #ifndef VBOX_WITH_SLIRP_BSD_SBUF
-        sbfree(&so->so_rcv);
-        sbfree(&so->so_snd);
+        sbfree(pData, &so->so_rcv);
+        sbfree(pData, &so->so_snd);
 #else
         sbuf_delete(&so->so_rcv);
         sbuf_delete(&so->so_snd);
@@ -560,10 +562,12 @@ tcp_connect(PNATState pData, struct socket *inso)
     /* Translate connections from localhost to the real hostname */
     if (so->so_faddr.s_addr == 0 || so->so_faddr.s_addr == loopback_addr.s_addr)
         so->so_faddr = alias_addr;
+    sohashinsert(pData, so, &tcb);
 
     /* Close the accept() socket, set right state */
     if (inso->so_state & SS_FACCEPTONCE)
     {
+        SOEPOLL_UNREGISTER(pData, so);
         closesocket(so->s);        /* If we only accept once, close the accept() socket */
         so->so_state = SS_NOFDREF; /* Don't select it yet, even though we have an FD */
                                    /* if it's not FACCEPTONCE, it's already NOFDREF */
@@ -602,8 +606,10 @@ tcp_attach(PNATState pData, struct socket *so)
 
     SOCKET_LOCK_CREATE(so);
     QSOCKET_LOCK(tcb);
+    so->so_type = IPPROTO_TCP;
     insque(pData, so, &tcb);
     NSOCK_INC();
+    SOEPOLL_DIRTY(pData, so);
     QSOCKET_UNLOCK(tcb);
     return 0;
 }
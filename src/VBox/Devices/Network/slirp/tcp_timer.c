@@ -67,10 +67,16 @@ tcp_fasttimo(PNATState pData)
 
     LogFlowFuncEnter();
 
+#ifdef VBOX_WITH_NAT_EPOLL
+    /* A delayed ACK keeps the socket on the dirty list, see slirp_select_fill. */
+    LIST_FOREACH_SAFE(so, &pData->EpollDirty, so_epoll_dirty, so_next)
+    {
+#else
     so = tcb.so_next;
     if (so)
         QSOCKET_FOREACH (so, so_next, tcp)
         /* { */
+#endif
             if (   (tp = (struct tcpcb *)so->so_tcpcb)
                 && (tp->t_flags & TF_DELACK))
             {
@@ -113,6 +119,7 @@ tcp_slowtimo(PNATState pData)
         {
             if (tp->t_timer[i] && --tp->t_timer[i] == 0)
             {
+                SOEPOLL_DIRTY(pData, ip);
                 tcp_timers(pData, tp, i);
                 if (ipnxt->so_prev != ip)
                     goto tpgone;
@@ -77,6 +77,7 @@ udp_init(PNATState pData)
 {
     udp_last_so = &udb;
     udb.so_next = udb.so_prev = &udb;
+    sohashinit(pData, &udb);
 }
 
 /* m->m_data  points at ip packet header
@@ -192,6 +193,12 @@ udp_input(PNATState pData, register struct mbuf *m, int iphlen)
         /* udp_output2() expects a pointer to the body of UDP packet. */
         m->m_data += sizeof(struct udpiphdr);
         m->m_len -= sizeof(struct udpiphdr);
+        /* the lookup might be answered later by the resolver thread */
+        if (dns_alias_query(pData, m, &src, &dst))
+        {
+            LogFlowFuncLeave();
+            return;
+        }
         udp_output2(pData, NULL, m, &src, &dst, IPTOS_LOWDELAY);
         LogFlowFuncLeave();
         return;
@@ -213,20 +220,9 @@ udp_input(PNATState pData, register struct mbuf *m, int iphlen)
     if (   so->so_lport != uh->uh_sport
         || so->so_laddr.s_addr != ip->ip_src.s_addr)
     {
-        struct socket *tmp;
-
-        for (tmp = udb.so_next; tmp != &udb; tmp = tmp->so_next)
-        {
-            if (   tmp->so_lport        == uh->uh_sport
-                && tmp->so_laddr.s_addr == ip->ip_src.s_addr)
-            {
-                so = tmp;
-                break;
-            }
-        }
-        if (tmp == &udb)
-            so = NULL;
-        else
+        so = sohashlookup(pData, &udb, ip->ip_src, uh->uh_sport,
+                          ip->ip_dst, uh->uh_dport);
+        if (so != NULL)
         {
             udpstat.udpps_pcbcachemiss++;
             udp_last_so = so;
@@ -258,6 +254,7 @@ udp_input(PNATState pData, register struct mbuf *m, int iphlen)
         /* udp_last_so = so; */
         so->so_laddr = ip->ip_src;
         so->so_lport = uh->uh_sport;
+        sohashinsert(pData, so, &udb);
 
         so->so_iptos = ip->ip_tos;
 
@@ -443,6 +440,7 @@ udp_attach(PNATState pData, struct socket *so, int service_port)
     if (bind(so->s, &sa_addr, sizeof(struct sockaddr_in)) < 0)
     {
         int lasterrno = errno;
+        SOEPOLL_UNREGISTER(pData, so);
         closesocket(so->s);
         so->s = -1;
 #ifdef RT_OS_WINDOWS
@@ -462,6 +460,7 @@ udp_attach(PNATState pData, struct socket *so, int service_port)
     so->so_hladdr.s_addr = ((struct sockaddr_in *)&sa_addr)->sin_addr.s_addr;
     SOCKET_LOCK_CREATE(so);
     QSOCKET_LOCK(udb);
+    so->so_type = IPPROTO_UDP;
     insque(pData, so, &udb);
     NSOCK_INC();
     QSOCKET_UNLOCK(udb);
@@ -479,6 +478,7 @@ udp_detach(PNATState pData, struct socket *so)
         QSOCKET_LOCK(udb);
         SOCKET_LOCK(so);
         QSOCKET_UNLOCK(udb);
+        SOEPOLL_UNREGISTER(pData, so);
         closesocket(so->s);
         sofree(pData, so);
         SOCKET_UNLOCK(so);
@@ -513,6 +513,7 @@ udp_listen(PNATState pData, u_int32_t bind_addr, u_int port, u_int32_t laddr, u_
     fd_nonblock(so->s);
     SOCKET_LOCK_CREATE(so);
     QSOCKET_LOCK(udb);
+    so->so_type = IPPROTO_UDP;
     insque(pData, so, &udb);
     NSOCK_INC();
     QSOCKET_UNLOCK(udb);
@@ -547,6 +548,7 @@ udp_listen(PNATState pData, u_int32_t bind_addr, u_int port, u_int32_t laddr, u_
 
     so->so_lport = lport;
     so->so_laddr.s_addr = laddr;
+    sohashinsert(pData, so, &udb);
     if (flags != SS_FACCEPTONCE)
         so->so_expire = 0;
 
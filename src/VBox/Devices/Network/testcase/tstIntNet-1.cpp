@@ -26,7 +26,10 @@
 #include <VBox/err.h>
 #include <iprt/initterm.h>
 #include <iprt/alloc.h>
+#include <iprt/file.h>
 #include <iprt/path.h>
+#include <iprt/env.h>
+#include <iprt/process.h>
 #include <iprt/stream.h>
 #include <iprt/string.h>
 #include <iprt/thread.h>
@@ -414,6 +417,461 @@ static void doPingTest(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession, PINTNETBUF p
 }
 
 
+/**
+ * A simulated DHCP client of the load test.
+ */
+typedef struct TSTDHCPCLIENT
+{
+    /** The client MAC address. */
+    RTMAC           Mac;
+    /** Whether the client is bound. */
+    bool            fBound;
+    /** Whether we're in the REQUEST phase (got an OFFER). */
+    bool            fRequesting;
+    /** The transaction ID. */
+    uint32_t        uXid;
+    /** The offered address. */
+    RTNETADDRIPV4   OfferedAddr;
+    /** The server identifier from the offer. */
+    RTNETADDRIPV4   ServerId;
+    /** When the client started (RTTimeNanoTS). */
+    uint64_t        NanoTSStart;
+    /** When the client last sent something, 0 if it should send right away. */
+    uint64_t        NanoTSLastSend;
+    /** How long it took to get bound. */
+    uint64_t        cNsLatency;
+} TSTDHCPCLIENT;
+/** Pointer to a simulated DHCP client. */
+typedef TSTDHCPCLIENT *PTSTDHCPCLIENT;
+
+
+/**
+ * Pushes the frames queued up in the send ring to the network.
+ *
+ * @param   hIf             The interface handle.
+ * @param   pSession        The session.
+ */
+static void dhcpLoadFlush(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession)
+{
+    INTNETIFSENDREQ SendReq;
+    SendReq.Hdr.u32Magic = SUPVMMR0REQHDR_MAGIC;
+    SendReq.Hdr.cbReq = sizeof(SendReq);
+    SendReq.pSession = pSession;
+    SendReq.hIf = hIf;
+    int rc = SUPR3CallVMMR0Ex(NIL_RTR0PTR, NIL_VMCPUID, VMMR0_DO_INTNET_IF_SEND, 0, &SendReq.Hdr);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstIntNet-1: SUPR3CallVMMR0Ex(,VMMR0_DO_INTNET_IF_SEND,) failed, rc=%Rrc\n", rc);
+        g_cErrors++;
+    }
+}
+
+
+/**
+ * Queues a DHCP DISCOVER or REQUEST for a simulated client.
+ *
+ * Unlike doXmitFrame, this doesn't push the frame, the caller does that once
+ * for the whole batch.  The ring is only flushed early if it fills up.
+ *
+ * @param   hIf             The interface handle.
+ * @param   pSession        The session.
+ * @param   pBuf            The shared interface buffer.
+ * @param   pClient         The client.
+ * @param   uMsgType        RTNET_DHCP_MT_DISCOVER or RTNET_DHCP_MT_REQUEST.
+ */
+static void dhcpLoadQueue(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession, PINTNETBUF pBuf, PTSTDHCPCLIENT pClient, uint8_t uMsgType)
+{
+    uint8_t abFrame[sizeof(RTNETETHERHDR) + sizeof(RTNETIPV4) + sizeof(RTNETUDP) + RTNET_DHCP_NORMAL_SIZE];
+    PRTNETETHERHDR      pEthHdr  = (PRTNETETHERHDR)&abFrame[0];
+    PRTNETIPV4          pIpHdr   = (PRTNETIPV4)    (pEthHdr + 1);
+    PRTNETUDP           pUdpHdr  = (PRTNETUDP)     (pIpHdr  + 1);
+    PRTNETBOOTP         pDhcpMsg = (PRTNETBOOTP)   (pUdpHdr + 1);
+    memset(&abFrame, 0, sizeof(abFrame));
+
+    pDhcpMsg->bp_op = RTNETBOOTP_OP_REQUEST;
+    pDhcpMsg->bp_htype = 1; /* ethernet */
+    pDhcpMsg->bp_hlen = sizeof(RTMAC);
+    pDhcpMsg->bp_xid = pClient->uXid;
+    pDhcpMsg->bp_flags = RT_H2BE_U16(RTNET_DHCP_FLAG_BROADCAST);
+    pDhcpMsg->bp_chaddr.Mac = pClient->Mac;
+    pDhcpMsg->bp_vend.Dhcp.dhcp_cookie = RT_H2N_U32_C(RTNET_DHCP_COOKIE);
+
+    uint8_t *pbOpt = &pDhcpMsg->bp_vend.Dhcp.dhcp_opts[0];
+    *pbOpt++ = RTNET_DHCP_OPT_MSG_TYPE;
+    *pbOpt++ = 1;
+    *pbOpt++ = uMsgType;
+    if (uMsgType == RTNET_DHCP_MT_REQUEST)
+    {
+        *pbOpt++ = RTNET_DHCP_OPT_REQ_ADDR;
+        *pbOpt++ = sizeof(RTNETADDRIPV4);
+        memcpy(pbOpt, &pClient->OfferedAddr, sizeof(RTNETADDRIPV4));
+        pbOpt += sizeof(RTNETADDRIPV4);
+
+        *pbOpt++ = RTNET_DHCP_OPT_SERVER_ID;
+        *pbOpt++ = sizeof(RTNETADDRIPV4);
+        memcpy(pbOpt, &pClient->ServerId, sizeof(RTNETADDRIPV4));
+        pbOpt += sizeof(RTNETADDRIPV4);
+    }
+    *pbOpt = RTNET_DHCP_OPT_END;
+
+    /* UDP */
+    size_t const cbDhcp = RTNET_DHCP_NORMAL_SIZE;
+    pUdpHdr->uh_sport = RT_H2BE_U16(68); /* bootp */
+    pUdpHdr->uh_dport = RT_H2BE_U16(67); /* bootps */
+    pUdpHdr->uh_ulen = RT_H2BE_U16((uint16_t)(cbDhcp + sizeof(*pUdpHdr)));
+
+    /* IP */
+    pIpHdr->ip_v = 4;
+    pIpHdr->ip_hl = sizeof(*pIpHdr) / sizeof(uint32_t);
+    pIpHdr->ip_len = RT_H2BE_U16((uint16_t)(cbDhcp + sizeof(*pUdpHdr) + sizeof(*pIpHdr)));
+    pIpHdr->ip_id = (uint16_t)RTRandU32();
+    pIpHdr->ip_ttl = 255;
+    pIpHdr->ip_p = 0x11; /* UDP */
+    pIpHdr->ip_src.u = 0;
+    pIpHdr->ip_dst.u = UINT32_C(0xffffffff); /* broadcast */
+    pIpHdr->ip_sum = RTNetIPv4HdrChecksum(pIpHdr);
+    pUdpHdr->uh_sum = RTNetIPv4UDPChecksum(pIpHdr, pUdpHdr, pUdpHdr + 1);
+
+    /* Ethernet */
+    memset(&pEthHdr->DstMac, 0xff, sizeof(pEthHdr->DstMac)); /* broadcast */
+    pEthHdr->SrcMac = pClient->Mac;
+    pEthHdr->EtherType = RT_H2BE_U16(RTNET_ETHERTYPE_IPV4);
+
+    int rc = IntNetRingWriteFrame(&pBuf->Send, &abFrame[0], sizeof(abFrame));
+    if (rc == VERR_BUFFER_OVERFLOW)
+    {
+        dhcpLoadFlush(hIf, pSession);
+        rc = IntNetRingWriteFrame(&pBuf->Send, &abFrame[0], sizeof(abFrame));
+    }
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstIntNet-1: IntNetRingWriteFrame failed, %Rrc; pBuf->cbSend=%d\n", rc, pBuf->cbSend);
+        g_cErrors++;
+    }
+    pClient->NanoTSLastSend = RTTimeNanoTS();
+}
+
+
+/**
+ * Looks up an IPv4 address option in a DHCP message.
+ *
+ * @returns true if found, false if not.
+ * @param   pDhcpMsg        The message.
+ * @param   cbDhcp          The size of the message.
+ * @param   uOpt            The option.
+ * @param   pAddr           Where to return the address.
+ */
+static bool dhcpLoadGetAddrOpt(PCRTNETBOOTP pDhcpMsg, size_t cbDhcp, uint8_t uOpt, PRTNETADDRIPV4 pAddr)
+{
+    uint8_t const *pbOpt = &pDhcpMsg->bp_vend.Dhcp.dhcp_opts[0];
+    uint8_t const *pbEnd = (uint8_t const *)pDhcpMsg + cbDhcp;
+    while (pbOpt < pbEnd && *pbOpt != RTNET_DHCP_OPT_END)
+    {
+        if (*pbOpt == RTNET_DHCP_OPT_PAD)
+        {
+            pbOpt++;
+            continue;
+        }
+        if (pbOpt + 2 > pbEnd || pbOpt + 2 + pbOpt[1] > pbEnd)
+            break;
+        if (*pbOpt == uOpt && pbOpt[1] == sizeof(RTNETADDRIPV4))
+        {
+            memcpy(pAddr, &pbOpt[2], sizeof(RTNETADDRIPV4));
+            return true;
+        }
+        pbOpt += 2 + pbOpt[1];
+    }
+    return false;
+}
+
+
+/**
+ * Starts a DHCP server on the test network for the load test.
+ *
+ * The server hands out addresses from 10.1.0.1 and up, enough for all the
+ * clients, and journals the leases to a database in the temporary directory
+ * so the journal gets its share of the load too.
+ *
+ * @returns true on success, false on failure (error counted).
+ * @param   pszServer       The path to VBoxNetDHCP.
+ * @param   pszNetwork      The network name.
+ * @param   cClients        The number of clients to cater for.
+ * @param   pszLeaseDb      Where to return the lease database name.
+ * @param   cbLeaseDb       The size of the buffer @a pszLeaseDb points to.
+ * @param   pProcess        Where to return the server process.
+ */
+static bool dhcpLoadStartServer(const char *pszServer, const char *pszNetwork, uint32_t cClients,
+                                char *pszLeaseDb, size_t cbLeaseDb, PRTPROCESS pProcess)
+{
+    int rc = RTPathTemp(pszLeaseDb, cbLeaseDb);
+    if (RT_SUCCESS(rc))
+    {
+        char szName[64];
+        RTStrPrintf(szName, sizeof(szName), "tstIntNet-1-%u.leases", (unsigned)RTProcSelf());
+        rc = RTPathAppend(pszLeaseDb, cbLeaseDb, szName);
+    }
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstIntNet-1: failed to make the lease database name, %Rrc\n", rc);
+        g_cErrors++;
+        return false;
+    }
+    RTFileDelete(pszLeaseDb);
+
+    uint32_t const uLower = RT_MAKE_U32_FROM_U8(1, 0, 1, 10);
+    uint32_t const uUpper = uLower + cClients;
+    char szUpper[32];
+    RTStrPrintf(szUpper, sizeof(szUpper), "%u.%u.%u.%u",
+                (uUpper >> 24) & 0xff, (uUpper >> 16) & 0xff, (uUpper >> 8) & 0xff, uUpper & 0xff);
+
+    const char *apszArgs[] =
+    {
+        pszServer,
+        "--network",        pszNetwork,
+        "--trunk-type",     "whatever",
+        "--ip-address",     "10.0.0.1",
+        "--lease-db",       pszLeaseDb,
+        "--begin-config",
+        "--lower-ip",       "10.1.0.1",
+        "--upper-ip",       szUpper,
+        "--netmask",        "255.0.0.0",
+        NULL
+    };
+    rc = RTProcCreate(pszServer, apszArgs, RTENV_DEFAULT, 0 /*fFlags*/, pProcess);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstIntNet-1: failed to start the DHCP server '%s', %Rrc\n", pszServer, rc);
+        g_cErrors++;
+        return false;
+    }
+    RTPrintf("tstIntNet-1: started the DHCP server '%s' on \"%s\"\n", pszServer, pszNetwork);
+    return true;
+}
+
+
+/**
+ * Stops the DHCP server started by dhcpLoadStartServer and cleans up after it.
+ *
+ * It's an error if the server has already gone away.
+ *
+ * @param   Process         The server process.
+ * @param   pszLeaseDb      The lease database name.
+ */
+static void dhcpLoadStopServer(RTPROCESS Process, const char *pszLeaseDb)
+{
+    RTPROCSTATUS Status;
+    int rc = RTProcWait(Process, RTPROCWAIT_FLAGS_NOBLOCK, &Status);
+    if (rc == VERR_PROCESS_RUNNING)
+    {
+        RTProcTerminate(Process);
+        RTProcWait(Process, RTPROCWAIT_FLAGS_BLOCK, &Status);
+    }
+    else
+    {
+        RTPrintf("tstIntNet-1: Error! The DHCP server quit during the test (rc=%Rrc status=%d reason=%d)\n",
+                 rc, Status.iStatus, Status.enmReason);
+        g_cErrors++;
+    }
+
+    RTFileDelete(pszLeaseDb);
+    char szTmp[RTPATH_MAX];
+    RTStrPrintf(szTmp, sizeof(szTmp), "%s.tmp", pszLeaseDb);
+    RTFileDelete(szTmp);
+}
+
+
+/**
+ * DHCP server load test.
+ *
+ * Simulates @a cClients clients which all go thru DISCOVER/OFFER/REQUEST/ACK
+ * at the same time, retransmitting after a second without an answer.  The
+ * requests are queued up and pushed once per round, like a busy network would
+ * present them to the server.
+ *
+ * @param   hIf             The interface handle.
+ * @param   pSession        The session.
+ * @param   pBuf            The shared interface buffer.
+ * @param   cClients        The number of clients to simulate.
+ * @param   cMillies        How long to keep trying, ms.
+ */
+static void doDhcpLoadTest(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession, PINTNETBUF pBuf, uint32_t cClients, uint32_t cMillies)
+{
+    PTSTDHCPCLIENT paClients = (PTSTDHCPCLIENT)RTMemAllocZ(cClients * sizeof(TSTDHCPCLIENT));
+    if (!paClients)
+    {
+        RTPrintf("tstIntNet-1: out of memory\n");
+        g_cErrors++;
+        return;
+    }
+
+    uint32_t const uXidBase = RTRandU32();
+    uint64_t const NanoTSStart = RTTimeNanoTS();
+    for (uint32_t i = 0; i < cClients; i++)
+    {
+        paClients[i].Mac.au8[0] = 0x02; /* locally administered */
+        paClients[i].Mac.au8[1] = 0x00;
+        paClients[i].Mac.au8[2] = (uint8_t)(i >> 24);
+        paClients[i].Mac.au8[3] = (uint8_t)(i >> 16);
+        paClients[i].Mac.au8[4] = (uint8_t)(i >> 8);
+        paClients[i].Mac.au8[5] = (uint8_t)i;
+        paClients[i].uXid = uXidBase + i;
+        paClients[i].NanoTSStart = NanoTSStart;
+    }
+
+    uint32_t cBound = 0;
+    uint32_t cSent = 0;
+    PINTNETRINGBUF pRingBuf = &pBuf->Recv;
+    for (;;)
+    {
+        /*
+         * Queue (re)transmissions and push them in one go.
+         */
+        uint64_t NanoTSNow = RTTimeNanoTS();
+        uint32_t cQueued = 0;
+        for (uint32_t i = 0; i < cClients; i++)
+        {
+            PTSTDHCPCLIENT pClient = &paClients[i];
+            if (    !pClient->fBound
+                &&  (   !pClient->NanoTSLastSend
+                     || NanoTSNow - pClient->NanoTSLastSend >= UINT64_C(1000000000)))
+            {
+                /* A lost request means starting over. */
+                pClient->fRequesting = false;
+                dhcpLoadQueue(hIf, pSession, pBuf, pClient, RTNET_DHCP_MT_DISCOVER);
+                cQueued++;
+            }
+        }
+        if (cQueued)
+        {
+            dhcpLoadFlush(hIf, pSession);
+            cSent += cQueued;
+        }
+
+        uint64_t cElapsedMillies = (RTTimeNanoTS() - NanoTSStart) / 1000000;
+        if (cBound == cClients || cElapsedMillies >= cMillies)
+            break;
+
+        /*
+         * Wait for replies.
+         */
+        INTNETIFWAITREQ WaitReq;
+        WaitReq.Hdr.u32Magic = SUPVMMR0REQHDR_MAGIC;
+        WaitReq.Hdr.cbReq = sizeof(WaitReq);
+        WaitReq.pSession = pSession;
+        WaitReq.hIf = hIf;
+        WaitReq.cMillies = RT_MIN(100, cMillies - (uint32_t)cElapsedMillies);
+        int rc = SUPR3CallVMMR0Ex(NIL_RTR0PTR, NIL_VMCPUID, VMMR0_DO_INTNET_IF_WAIT, 0, &WaitReq.Hdr);
+        if (rc == VERR_INTERRUPTED)
+            break;
+        if (RT_FAILURE(rc) && rc != VERR_TIMEOUT)
+        {
+            g_cErrors++;
+            RTPrintf("tstIntNet-1: VMMR0_DO_INTNET_IF_WAIT returned %Rrc\n", rc);
+            break;
+        }
+
+        /*
+         * Process the replies, answering offers right away.
+         */
+        cQueued = 0;
+        PINTNETHDR pHdr;
+        while ((pHdr = IntNetRingGetNextFrameToRead(pRingBuf)))
+        {
+            if (pHdr->u16Type == INTNETHDR_TYPE_FRAME)
+            {
+                size_t          cbFrame = pHdr->cbFrame;
+                PCRTNETETHERHDR pEthHdr = (PCRTNETETHERHDR)IntNetHdrGetFramePtr(pHdr, pBuf);
+                PCRTNETIPV4     pIpHdr  = (PCRTNETIPV4)(pEthHdr + 1);
+                PCRTNETUDP      pUdpHdr = NULL;
+                uint8_t         uMsgType = 0;
+                /* Don't look at the IP header before knowing it's there, nor
+                   past it before knowing the frame covers its full length. */
+                if (    cbFrame > sizeof(*pEthHdr) + sizeof(RTNETIPV4) + sizeof(RTNETUDP) + RTNETBOOTP_DHCP_MIN_LEN
+                    &&  RT_BE2H_U16(pEthHdr->EtherType) == RTNET_ETHERTYPE_IPV4
+                    &&  pIpHdr->ip_hl >= RTNETIPV4_MIN_LEN / 4
+                    &&  cbFrame > sizeof(*pEthHdr) + pIpHdr->ip_hl * 4 + sizeof(RTNETUDP) + RTNETBOOTP_DHCP_MIN_LEN)
+                    pUdpHdr = (PCRTNETUDP)((uint32_t *)pIpHdr + pIpHdr->ip_hl);
+                if (    pUdpHdr
+                    &&  pIpHdr->ip_p == 0x11 /*UDP*/
+                    &&  RT_BE2H_U16(pUdpHdr->uh_dport) == 68 /* bootp */
+                    &&  RT_BE2H_U16(pUdpHdr->uh_sport) == 67 /* bootps */)
+                {
+                    PCRTNETBOOTP pDhcpMsg = (PCRTNETBOOTP)(pUdpHdr + 1);
+                    size_t       cbDhcp   = cbFrame - ((uint8_t const *)pDhcpMsg - (uint8_t const *)pEthHdr);
+                    uint32_t     i        = pDhcpMsg->bp_xid - uXidBase;
+                    if (    i < cClients
+                        &&  pDhcpMsg->bp_op == RTNETBOOTP_OP_REPLY
+                        &&  !memcmp(&pDhcpMsg->bp_chaddr.Mac, &paClients[i].Mac, sizeof(RTMAC))
+                        &&  RTNetIPv4IsDHCPValid(pUdpHdr, pDhcpMsg, cbDhcp, &uMsgType))
+                    {
+                        PTSTDHCPCLIENT pClient = &paClients[i];
+                        if (uMsgType == RTNET_DHCP_MT_OFFER && !pClient->fRequesting && !pClient->fBound)
+                        {
+                            pClient->OfferedAddr = pDhcpMsg->bp_yiaddr;
+                            if (!dhcpLoadGetAddrOpt(pDhcpMsg, cbDhcp, RTNET_DHCP_OPT_SERVER_ID, &pClient->ServerId))
+                                pClient->ServerId = pDhcpMsg->bp_siaddr;
+                            pClient->fRequesting = true;
+                            dhcpLoadQueue(hIf, pSession, pBuf, pClient, RTNET_DHCP_MT_REQUEST);
+                            cQueued++;
+                        }
+                        else if (uMsgType == RTNET_DHCP_MT_ACK && pClient->fRequesting && !pClient->fBound)
+                        {
+                            pClient->fBound = true;
+                            pClient->OfferedAddr = pDhcpMsg->bp_yiaddr;
+                            pClient->cNsLatency = RTTimeNanoTS() - pClient->NanoTSStart;
+                            cBound++;
+                        }
+                        else if (uMsgType == RTNET_DHCP_MT_NAC && !pClient->fBound)
+                        {
+                            pClient->fRequesting = false;
+                            pClient->NanoTSLastSend = 0;
+                        }
+                    }
+                }
+            }
+            IntNetRingSkipFrame(pRingBuf);
+        }
+        if (cQueued)
+        {
+            dhcpLoadFlush(hIf, pSession);
+            cSent += cQueued;
+        }
+    }
+
+    /*
+     * Report.
+     */
+    uint64_t cNsTotal = RTTimeNanoTS() - NanoTSStart;
+    uint64_t cNsMax = 0;
+    uint64_t cNsSum = 0;
+    uint32_t cDups = 0;
+    for (uint32_t i = 0; i < cClients; i++)
+        if (paClients[i].fBound)
+        {
+            cNsSum += paClients[i].cNsLatency;
+            cNsMax = RT_MAX(cNsMax, paClients[i].cNsLatency);
+            for (uint32_t j = i + 1; j < cClients; j++)
+                if (    paClients[j].fBound
+                    &&  paClients[j].OfferedAddr.u == paClients[i].OfferedAddr.u)
+                    cDups++;
+        }
+    RTPrintf("tstIntNet-1: DHCP load: %u of %u clients bound in %RU64 ms, %u requests sent; latency avg %RU64 us, max %RU64 us\n",
+             cBound, cClients, cNsTotal / 1000000, cSent, cBound ? cNsSum / cBound / 1000 : 0, cNsMax / 1000);
+    if (cBound != cClients)
+    {
+        RTPrintf("tstIntNet-1: Error! %u clients didn't get a lease\n", cClients - cBound);
+        g_cErrors++;
+    }
+    if (cDups)
+    {
+        RTPrintf("tstIntNet-1: Error! %u addresses were handed out more than once\n", cDups);
+        g_cErrors++;
+    }
+
+    RTMemFree(paClients);
+}
+
+
 /**
  * Does packet sniffing for a given period of time.
  *
@@ -617,6 +1075,8 @@ int main(int argc, char **argv)
         { "--text-file",    't', RTGETOPT_REQ_STRING },
         { "--xmit-test",    'x', RTGETOPT_REQ_NOTHING },
         { "--ping-test",    'P', RTGETOPT_REQ_NOTHING },
+        { "--dhcp-load",    'L', RTGETOPT_REQ_UINT32 },
+        { "--dhcp-server",  'D', RTGETOPT_REQ_STRING },
     };
 
     uint32_t    cMillies = 1000;
@@ -639,6 +1099,8 @@ int main(int argc, char **argv)
     PRTSTREAM   pFileText = g_pStdOut;
     bool        fXmitTest = false;
     bool        fPingTest = false;
+    uint32_t    cDhcpClients = 0;
+    const char *pszDhcpServer = NULL;
     RTMAC       SrcMac;
     SrcMac.au8[0] = 0x08;
     SrcMac.au8[1] = 0x03;
@@ -736,6 +1198,14 @@ int main(int argc, char **argv)
                 fPingTest = true;
                 break;
 
+            case 'L':
+                cDhcpClients = Value.u32;
+                break;
+
+            case 'D':
+                pszDhcpServer = Value.psz;
+                break;
+
             case 'h':
                 RTPrintf("syntax: tstIntNet-1 <options>\n"
                          "\n"
@@ -745,7 +1215,9 @@ int main(int argc, char **argv)
                 RTPrintf("\n"
                          "Examples:\n"
                          "    tstIntNet-1 -r 8192 -s 4096 -xS\n"
-                         "    tstIntNet-1 -n VBoxNetDhcp -r 4096 -s 4096 -i \"\" -xS\n");
+                         "    tstIntNet-1 -n VBoxNetDhcp -r 4096 -s 4096 -i \"\" -xS\n"
+                         "    tstIntNet-1 -n VBoxNetDhcp -r 65536 -s 65536 -i \"\" -d 30 -L 1000\n"
+                         "    tstIntNet-1 -r 65536 -s 65536 -d 30 -L 1000 -D ../VBoxNetDHCP\n");
                 return 1;
 
             case 'V':
@@ -756,6 +1228,14 @@ int main(int argc, char **argv)
                 return RTGetOptPrintError(ch, &Value);
         }
 
+    /* A server of our own stays off the wire and needs clients to serve. */
+    if (pszDhcpServer)
+    {
+        pszIf = "";
+        if (!cDhcpClients)
+            cDhcpClients = 1000;
+    }
+
     RTPrintf("tstIntNet-1: TESTING...\n");
 
     /*
@@ -873,9 +1353,23 @@ int main(int argc, char **argv)
                         doPingTest(OpenReq.hIf, pSession, pBuf, &SrcMac, pFileRaw, pFileText);
 
                     /*
-                     * Either enter sniffing mode or do a timeout thing.
+                     * Either run the DHCP load test, enter sniffing mode or do
+                     * a timeout thing.
                      */
-                    if (fSniffer)
+                    if (cDhcpClients)
+                    {
+                        char        szLeaseDb[RTPATH_MAX];
+                        RTPROCESS   ServerProcess = NIL_RTPROCESS;
+                        if (    !pszDhcpServer
+                            ||  dhcpLoadStartServer(pszDhcpServer, pszNetwork, cDhcpClients,
+                                                    szLeaseDb, sizeof(szLeaseDb), &ServerProcess))
+                        {
+                            doDhcpLoadTest(OpenReq.hIf, pSession, pBuf, cDhcpClients, cMillies);
+                            if (pszDhcpServer)
+                                dhcpLoadStopServer(ServerProcess, szLeaseDb);
+                        }
+                    }
+                    else if (fSniffer)
                     {
                         doPacketSniffing(OpenReq.hIf, pSession, pBuf, cMillies, pFileRaw, pFileText, &SrcMac);
                         if (   fXmitTest
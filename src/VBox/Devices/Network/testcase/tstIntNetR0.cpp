@@ -37,6 +37,7 @@ typedef void *MYPSUPDRVSESSION;
 #include <VBox/sup.h>
 #include <VBox/err.h>
 #include <iprt/asm.h>
+#include <iprt/asm-amd64-x86.h>
 #include <iprt/getopt.h>
 #include <iprt/initterm.h>
 #include <iprt/mem.h>
@@ -175,6 +176,8 @@ INTNETR3DECL(int) SUPR0MemFree(PSUPDRVSESSION pSession, RTHCUINTPTR uPtr)
 /* No CLI/POPF, please. */
 #define RTSpinlockAcquireNoInts             RTSpinlockAcquire
 #define RTSpinlockReleaseNoInts             RTSpinlockRelease
+#define ASMIntDisableFlags()                ((RTCCUINTREG)0)
+#define ASMSetFlags(fFlags)                 NOREF(fFlags)
 
 
 /* ugly but necessary for making R0 code compilable for R3. */
@@ -542,11 +545,13 @@ static void tstBidirectionalTransfer(PTSTSTATE pThis, uint32_t cbFrame)
      * Display statistics.
      */
     RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS,
-                 "Buf0: Yields-OK=%llu Yields-NOK=%llu Lost=%llu Bad=%llu\n",
+                 "Buf0: Yields-OK=%llu Yields-NOK=%llu Lost=%llu Bad=%llu Wakeups=%llu Wakeups-Saved=%llu\n",
                  pThis->pBuf0->cStatYieldsOk.c,
                  pThis->pBuf0->cStatYieldsNok.c,
                  pThis->pBuf0->cStatLost.c,
-                 pThis->pBuf0->cStatBadFrames.c);
+                 pThis->pBuf0->cStatBadFrames.c,
+                 pThis->pBuf0->cStatRecvWakeups.c,
+                 pThis->pBuf0->cStatRecvWakeupsSaved.c);
     RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS,
                  "Buf0.Recv: Frames=%llu Bytes=%llu Overflows=%llu\n",
                  pThis->pBuf0->Recv.cStatFrames,
@@ -559,11 +564,13 @@ static void tstBidirectionalTransfer(PTSTSTATE pThis, uint32_t cbFrame)
                  pThis->pBuf0->Send.cOverflows.c);
 
     RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS,
-                 "Buf1: Yields-OK=%llu Yields-NOK=%llu Lost=%llu Bad=%llu\n",
+                 "Buf1: Yields-OK=%llu Yields-NOK=%llu Lost=%llu Bad=%llu Wakeups=%llu Wakeups-Saved=%llu\n",
                  pThis->pBuf1->cStatYieldsOk.c,
                  pThis->pBuf1->cStatYieldsNok.c,
                  pThis->pBuf1->cStatLost.c,
-                 pThis->pBuf1->cStatBadFrames.c);
+                 pThis->pBuf1->cStatBadFrames.c,
+                 pThis->pBuf1->cStatRecvWakeups.c,
+                 pThis->pBuf1->cStatRecvWakeupsSaved.c);
     RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS,
                  "Buf1.Recv: Frames=%llu Bytes=%llu Overflows=%llu\n",
                  pThis->pBuf1->Recv.cStatFrames,
@@ -655,6 +662,406 @@ static void doUnicastTest(PTSTSTATE pThis, bool fHeadGuard)
                       cb, pvBuf, sizeof(s_au16Frame), s_au16Frame);
 }
 
+/**
+ * Sends a batch of unicast frames with a single IntNetR0IfSend call and checks
+ * that a waiting receiver is woken up once for the lot, and a busy one not at
+ * all.
+ *
+ * @param   pThis               The test instance.
+ */
+static void doBatchTest(PTSTSTATE pThis)
+{
+    static uint16_t const s_au16Frame[7] = { /* dst:*/ 0x8086, 0, 0,      /*src:*/0x8086, 0, 1, 0x0800 };
+    uint32_t const        cFrames        = 4;
+
+    /* Pretend the receiver went to sleep on the empty ring like IntNetR0IfWait does. */
+    RTTESTI_CHECK_RETV(!IntNetRingHasMoreToRead(&pThis->pBuf0->Recv));
+    ASMAtomicWriteU32(&pThis->pBuf0->offRecvEvent, pThis->pBuf0->Recv.offReadX);
+
+    uint64_t const cWakeups = pThis->pBuf0->cStatRecvWakeups.c;
+    for (uint32_t i = 0; i < cFrames; i++)
+    {
+        INTNETSG Sg;
+        IntNetSgInitTemp(&Sg, (void *)&s_au16Frame[0], sizeof(s_au16Frame));
+        RTTESTI_CHECK_RC_RETV(intnetR0RingWriteFrame(&pThis->pBuf1->Send, &Sg, NULL), VINF_SUCCESS);
+    }
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfSend(pThis->hIf1, g_pSession), VINF_SUCCESS);
+
+    /* One wakeup for the whole batch, which claimed the event index. */
+    RTTESTI_CHECK_MSG(pThis->pBuf0->cStatRecvWakeups.c == cWakeups + 1,
+                      ("%llu vs. %llu\n", pThis->pBuf0->cStatRecvWakeups.c, cWakeups + 1));
+    RTTESTI_CHECK(pThis->pBuf0->offRecvEvent == INTNETBUF_RECV_EVENT_NONE);
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfWait(pThis->hIf0, g_pSession, 0), VINF_SUCCESS);
+
+    /* All the frames should be there. */
+    for (uint32_t i = 0; i < cFrames; i++)
+    {
+        uint16_t au16Frame[RT_ELEMENTS(s_au16Frame)];
+        uint32_t cb;
+        RTTESTI_CHECK_MSG_RETV(IntNetRingHasMoreToRead(&pThis->pBuf0->Recv), ("i=%u\n", i));
+        RTTESTI_CHECK_MSG_RETV((cb = IntNetRingReadAndSkipFrame(&pThis->pBuf0->Recv, au16Frame)) == sizeof(s_au16Frame),
+                               ("%#x vs. %#x\n", cb, sizeof(s_au16Frame)));
+        RTTESTI_CHECK(!memcmp(au16Frame, s_au16Frame, sizeof(s_au16Frame)));
+    }
+    RTTESTI_CHECK(!IntNetRingHasMoreToRead(&pThis->pBuf0->Recv));
+
+    /* The signal was eaten along with the frames. */
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfWait(pThis->hIf0, g_pSession, 0), VERR_TIMEOUT);
+    RTTESTI_CHECK(pThis->pBuf0->offRecvEvent == INTNETBUF_RECV_EVENT_NONE);
+
+    /* A receiver that isn't waiting doesn't get signalled, it finds the
+       frame when it comes to wait. */
+    uint64_t const cSaved = pThis->pBuf0->cStatRecvWakeupsSaved.c;
+    INTNETSG Sg;
+    IntNetSgInitTemp(&Sg, (void *)&s_au16Frame[0], sizeof(s_au16Frame));
+    RTTESTI_CHECK_RC_RETV(intnetR0RingWriteFrame(&pThis->pBuf1->Send, &Sg, NULL), VINF_SUCCESS);
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfSend(pThis->hIf1, g_pSession), VINF_SUCCESS);
+    RTTESTI_CHECK(pThis->pBuf0->cStatRecvWakeups.c == cWakeups + 1);
+    RTTESTI_CHECK(pThis->pBuf0->cStatRecvWakeupsSaved.c == cSaved + 1);
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfWait(pThis->hIf0, g_pSession, RT_INDEFINITE_WAIT), VINF_SUCCESS);
+    IntNetRingSkipFrame(&pThis->pBuf0->Recv);
+    RTTESTI_CHECK(!IntNetRingHasMoreToRead(&pThis->pBuf0->Recv));
+}
+
+/**
+ * Checks that every MAC table entry is in the hash chain of its address and
+ * that the dummy address count is right.
+ *
+ * @param   pNetwork            The network.
+ */
+static void tstCheckMacTab(PINTNETNETWORK pNetwork)
+{
+    PINTNETMACTAB pTab         = &pNetwork->MacTab;
+    uint32_t      cDummies     = 0;
+    uint32_t      cLinked      = 0;
+    for (uint32_t iHash = 0; iHash < INTNET_MACTAB_HASH_SIZE; iHash++)
+        for (uint32_t i = pTab->aiHash[iHash]; i != INTNET_MACTAB_HASH_END; i = pTab->paEntries[i].iHashNext)
+        {
+            RTTESTI_CHECK_RETV(i < pTab->cEntries);
+            RTTESTI_CHECK(intnetR0MacTabHash(&pTab->paEntries[i].MacAddr) == iHash);
+            RTTESTI_CHECK_RETV(++cLinked <= pTab->cEntries);
+        }
+    for (uint32_t i = 0; i < pTab->cEntries; i++)
+        if (pTab->paEntries[i].fActive && intnetR0IsMacAddrDummy(&pTab->paEntries[i].MacAddr))
+            cDummies++;
+    RTTESTI_CHECK_MSG(cLinked == pTab->cEntries, ("%u vs. %u\n", cLinked, pTab->cEntries));
+    RTTESTI_CHECK_MSG(cDummies == pTab->cActiveDummyEntries, ("%u vs. %u\n", cDummies, pTab->cActiveDummyEntries));
+}
+
+/**
+ * Sends a frame and checks whether the receiver got it.
+ *
+ * @param   pBufSrc             The buffer of the sender.
+ * @param   hIfSrc              The sender.
+ * @param   pBufDst             The buffer of the receiver.
+ * @param   hIfDst              The receiver.
+ * @param   pau16Frame          The frame, 7 words.
+ * @param   fExpect             Whether the receiver should get it.
+ */
+static void tstSendFrameCheck(PINTNETBUF pBufSrc, INTNETIFHANDLE hIfSrc, PINTNETBUF pBufDst, INTNETIFHANDLE hIfDst,
+                              uint16_t const *pau16Frame, bool fExpect)
+{
+    RTTESTI_CHECK_RC_RETV(tstIntNetSendBuf(&pBufSrc->Send, hIfSrc, g_pSession, pau16Frame, 7 * sizeof(uint16_t)), VINF_SUCCESS);
+    if (fExpect)
+    {
+        RTTESTI_CHECK_RC_RETV(IntNetR0IfWait(hIfDst, g_pSession, 1), VINF_SUCCESS);
+        RTTESTI_CHECK_RETV(IntNetRingHasMoreToRead(&pBufDst->Recv));
+        IntNetRingSkipFrame(&pBufDst->Recv);
+    }
+    else
+        RTTESTI_CHECK_RC(IntNetR0IfWait(hIfDst, g_pSession, 0), VERR_TIMEOUT);
+    RTTESTI_CHECK(!IntNetRingHasMoreToRead(&pBufDst->Recv));
+}
+
+/**
+ * Tests MAC address learning, the MAC address hash and the ageing of learned
+ * addresses.  Expects the 1st interface to have learned 80:86:00:00:00:00 and
+ * the 2nd 80:86:00:00:00:01, which is how they are left.
+ *
+ * @param   pThis               The test instance.
+ */
+static void doMacTabTest(PTSTSTATE pThis)
+{
+    static uint16_t const s_au16To2From1[7]     = { /* dst:*/ 0x8086, 0, 0x200,  /*src:*/0x8086, 0, 0,      0x0800 };
+    static uint16_t const s_au16To1From0[7]     = { /* dst:*/ 0x8086, 0, 0x100,  /*src:*/0x8086, 0, 0,      0x0800 };
+    static uint16_t const s_au16BcastFrom0[7]   = { /* dst:*/ 0xffff, 0xffff, 0xffff, /*src:*/0x8086, 0, 0, 0x0800 };
+    static uint16_t const s_au16BcastFrom1[7]   = { /* dst:*/ 0xffff, 0xffff, 0xffff, /*src:*/0x8086, 0, 0x100, 0x0800 };
+    static uint16_t const s_au16BcastFrom2[7]   = { /* dst:*/ 0xffff, 0xffff, 0xffff, /*src:*/0x8086, 0, 0x200, 0x0800 };
+    static RTMAC const    s_Mac0                = { { 0x80, 0x86, 0, 0, 0, 0 } };
+
+    PINTNETIF pIf0 = (PINTNETIF)RTHandleTableLookupWithCtx(g_pIntNet->hHtIfs, pThis->hIf0, g_pSession);
+    PINTNETIF pIf1 = (PINTNETIF)RTHandleTableLookupWithCtx(g_pIntNet->hHtIfs, pThis->hIf1, g_pSession);
+    RTTESTI_CHECK_RETV(pIf0 && pIf1);
+    PINTNETNETWORK pNetwork = pIf0->pNetwork;
+    tstCheckMacTab(pNetwork);
+
+    /* The 2nd interface moves to 80:86:00:00:00:02, unicast follows it. */
+    tstSendFrameCheck(pThis->pBuf1, pThis->hIf1, pThis->pBuf0, pThis->hIf0, s_au16BcastFrom2, true);
+    RTTESTI_CHECK(pIf1->MacAddr.au16[2] == 0x200);
+    tstCheckMacTab(pNetwork);
+    tstSendFrameCheck(pThis->pBuf0, pThis->hIf0, pThis->pBuf1, pThis->hIf1, s_au16To2From1, true);
+    tstSendFrameCheck(pThis->pBuf0, pThis->hIf0, pThis->pBuf1, pThis->hIf1, s_au16To1From0, false);
+
+    /* Taking over the address of an interface that is still sending leaves it alone. */
+    tstSendFrameCheck(pThis->pBuf1, pThis->hIf1, pThis->pBuf0, pThis->hIf0, s_au16BcastFrom0, true);
+    RTTESTI_CHECK(intnetR0AreMacAddrsEqual(&pIf0->MacAddr, &s_Mac0));
+    RTTESTI_CHECK(intnetR0AreMacAddrsEqual(&pIf1->MacAddr, &s_Mac0));
+    tstCheckMacTab(pNetwork);
+
+    /* A silent one forgets it. */
+    tstSendFrameCheck(pThis->pBuf1, pThis->hIf1, pThis->pBuf0, pThis->hIf0, s_au16BcastFrom1, true);
+    ASMAtomicWriteU64(&pIf0->u64LastSend, RTTimeSystemNanoTS() - INTNET_MACTAB_MAX_AGE_NS - 1);
+    tstSendFrameCheck(pThis->pBuf1, pThis->hIf1, pThis->pBuf0, pThis->hIf0, s_au16BcastFrom0, true);
+    RTTESTI_CHECK(intnetR0IsMacAddrDummy(&pIf0->MacAddr));
+    RTTESTI_CHECK(pNetwork->MacTab.cActiveDummyEntries == 1);
+    tstCheckMacTab(pNetwork);
+
+    /* Back to the start. */
+    tstSendFrameCheck(pThis->pBuf1, pThis->hIf1, pThis->pBuf0, pThis->hIf0, s_au16BcastFrom1, true);
+    tstSendFrameCheck(pThis->pBuf0, pThis->hIf0, pThis->pBuf1, pThis->hIf1, s_au16BcastFrom0, true);
+    RTTESTI_CHECK(intnetR0AreMacAddrsEqual(&pIf0->MacAddr, &s_Mac0));
+    RTTESTI_CHECK(pIf1->MacAddr.au16[2] == 0x100);
+    RTTESTI_CHECK(pNetwork->MacTab.cActiveDummyEntries == 0);
+    tstCheckMacTab(pNetwork);
+
+    intnetR0IfRelease(pIf0, g_pSession);
+    intnetR0IfRelease(pIf1, g_pSession);
+}
+
+/**
+ * Switches a frame from the wire by its IPv4 destination address on a network
+ * sharing the MAC address with the host.
+ *
+ * @returns The number of interfaces it went to, UINT32_MAX on failure.
+ * @param   pNetwork            The network.
+ * @param   pAddr               The IPv4 address.
+ * @param   ppIf                Where to return the first destination.
+ */
+static uint32_t tstSwitchLevel3(PINTNETNETWORK pNetwork, PCRTNETADDRU pAddr, PINTNETIF *ppIf)
+{
+    static RTMAC const  s_HostMac = { { 0x80, 0x86, 0, 0, 0xff, 0xff } };
+    PINTNETDSTTAB       pDstTab;
+    RTTESTI_CHECK_RC_OK_RET(intnetR0AllocDstTab(pNetwork->MacTab.cEntriesAllocated, &pDstTab), UINT32_MAX);
+
+    intnetR0NetworkSwitchLevel3(pNetwork, &s_HostMac, kIntNetAddrType_IPv4, pAddr, sizeof(RTNETADDRIPV4),
+                                INTNETTRUNKDIR_WIRE, pDstTab);
+    uint32_t const cIfs = pDstTab->cIfs;
+    *ppIf = cIfs ? pDstTab->aIfs[0].pIf : NULL;
+
+    intnetR0NetworkReleaseDstTab(pNetwork, pDstTab);
+    RTMemFree(pDstTab);
+    return cIfs;
+}
+
+/**
+ * Looks up an IPv4 address in the level-3 hash, taking the address spinlock.
+ *
+ * @returns See intnetR0NetworkL3HashLookup.
+ * @param   pNetwork            The network.
+ * @param   pAddr               The IPv4 address.
+ */
+static uint32_t tstL3HashLookup(PINTNETNETWORK pNetwork, PCRTNETADDRU pAddr)
+{
+    RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
+    RTSpinlockAcquireNoInts(pNetwork->hAddrSpinlock, &Tmp);
+    uint32_t const iIf = intnetR0NetworkL3HashLookup(pNetwork, kIntNetAddrType_IPv4, pAddr, sizeof(RTNETADDRIPV4));
+    RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
+    return iIf;
+}
+
+/**
+ * Tests the hashed address caches and the level-3 address hash of networks
+ * sharing the MAC address with the host, including duplicate addresses and
+ * inactive owners.
+ *
+ * @param   cbSend              The send buffer size.
+ * @param   cbRecv              The receive buffer size.
+ */
+static void doL3HashTest(uint32_t cbSend, uint32_t cbRecv)
+{
+    INTNETIFHANDLE hIf0 = INTNET_HANDLE_INVALID;
+    INTNETIFHANDLE hIf1 = INTNET_HANDLE_INVALID;
+    RTTESTI_CHECK_RC_OK_RETV(IntNetR0Open(g_pSession, "test-l3", kIntNetTrunkType_None, "",
+                                          INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE, cbSend, cbRecv, &hIf0));
+    RTTESTI_CHECK_RC_OK_RETV(IntNetR0Open(g_pSession, "test-l3", kIntNetTrunkType_None, "",
+                                          INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE, cbSend, cbRecv, &hIf1));
+    RTTESTI_CHECK_RC(IntNetR0IfSetActive(hIf0, g_pSession, true), VINF_SUCCESS);
+    RTTESTI_CHECK_RC(IntNetR0IfSetActive(hIf1, g_pSession, true), VINF_SUCCESS);
+
+    PINTNETIF pIf0 = (PINTNETIF)RTHandleTableLookupWithCtx(g_pIntNet->hHtIfs, hIf0, g_pSession);
+    PINTNETIF pIf1 = (PINTNETIF)RTHandleTableLookupWithCtx(g_pIntNet->hHtIfs, hIf1, g_pSession);
+    if (pIf0 && pIf1 && pIf0->pNetwork->paL3Hash)
+    {
+        PINTNETNETWORK   pNetwork = pIf0->pNetwork;
+        PINTNETADDRCACHE pCache0  = &pIf0->aAddrCache[kIntNetAddrType_IPv4];
+        PINTNETADDRCACHE pCache1  = &pIf1->aAddrCache[kIntNetAddrType_IPv4];
+        PINTNETIF        pIfDst;
+        RTNETADDRU       Addr;
+        RT_ZERO(Addr);
+        Addr.au32[0] = RT_H2N_U32_C(0x0a000205); /* 10.0.2.5 */
+
+        /* Nobody has it. */
+        RTTESTI_CHECK(tstSwitchLevel3(pNetwork, &Addr, &pIfDst) == 0);
+        RTTESTI_CHECK(tstL3HashLookup(pNetwork, &Addr) == INTNET_L3HASH_NONE);
+
+        /* A single owner. */
+        intnetR0IfAddrCacheAdd(pIf0, pCache0, &Addr, 4, "test");
+        RTTESTI_CHECK(tstSwitchLevel3(pNetwork, &Addr, &pIfDst) == 1 && pIfDst == pIf0);
+
+        /* Duplicates go to both. */
+        intnetR0IfAddrCacheAdd(pIf1, pCache1, &Addr, 4, "test");
+        RTTESTI_CHECK(tstL3HashLookup(pNetwork, &Addr) == INTNET_L3HASH_DUP);
+        RTTESTI_CHECK(tstSwitchLevel3(pNetwork, &Addr, &pIfDst) == 2);
+
+        /* And back to a single owner. */
+        RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
+        RTSpinlockAcquireNoInts(pNetwork->hAddrSpinlock, &Tmp);
+        intnetR0IfAddrCacheDelete(pIf0, pCache0, &Addr, 4, "test");
+        RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock, &Tmp);
+        RTTESTI_CHECK(tstSwitchLevel3(pNetwork, &Addr, &pIfDst) == 1 && pIfDst == pIf1);
+
+        /* An inactive owner doesn't get anything. */
+        RTTESTI_CHECK_RC(IntNetR0IfSetActive(hIf1, g_pSession, false), VINF_SUCCESS);
+        RTTESTI_CHECK(tstSwitchLevel3(pNetwork, &Addr, &pIfDst) == 0);
+        RTTESTI_CHECK_RC(IntNetR0IfSetActive(hIf1, g_pSession, true), VINF_SUCCESS);
+        intnetR0NetworkAddrCacheDelete(pNetwork, &Addr, kIntNetAddrType_IPv4, 4, "test");
+        RTTESTI_CHECK(intnetR0IfAddrCacheLookup(pCache1, &Addr, 4) < 0);
+        RTTESTI_CHECK(tstSwitchLevel3(pNetwork, &Addr, &pIfDst) == 0);
+
+        /* Overflow the cache of the 1st interface, the oldest addresses go. */
+        uint32_t const cAddrs = pCache0->cEntriesAlloc + 8;
+        for (uint32_t i = 0; i < cAddrs; i++)
+        {
+            Addr.au32[0] = RT_H2N_U32(UINT32_C(0x0a000300) + i);
+            intnetR0IfAddrCacheAdd(pIf0, pCache0, &Addr, 4, "test");
+        }
+        RTTESTI_CHECK(pCache0->cEntries == pCache0->cEntriesAlloc);
+        for (uint32_t i = 0; i < cAddrs; i++)
+        {
+            Addr.au32[0] = RT_H2N_U32(UINT32_C(0x0a000300) + i);
+            bool const fPresent = i >= cAddrs - pCache0->cEntriesAlloc;
+            RTTESTI_CHECK_MSG((intnetR0IfAddrCacheLookup(pCache0, &Addr, 4) >= 0) == fPresent, ("i=%u\n", i));
+            RTTESTI_CHECK_MSG(tstSwitchLevel3(pNetwork, &Addr, &pIfDst) == (uint32_t)fPresent, ("i=%u\n", i));
+        }
+    }
+    else
+        RTTestIFailed("no interfaces or level-3 hash\n");
+
+    if (pIf0)
+        intnetR0IfRelease(pIf0, g_pSession);
+    if (pIf1)
+        intnetR0IfRelease(pIf1, g_pSession);
+    RTTESTI_CHECK_RC_OK(IntNetR0IfClose(hIf0, g_pSession));
+    RTTESTI_CHECK_RC_OK(IntNetR0IfClose(hIf1, g_pSession));
+}
+
+/**
+ * Measures the small frame rate from the 2nd interface to the 1st one when the
+ * send ring is committed every @a cBatch frames, which is what DrvIntNet does
+ * for a PDMINETWORKUP::pfnSendBufs batch.  A batch of 1 is the old one frame
+ * per pfnSendBuf call path.
+ *
+ * @param   pThis               The test instance.
+ * @param   cBatch              Number of frames per IntNetR0IfSend call.
+ */
+static void doSmallFrameRateTest(PTSTSTATE pThis, uint32_t cBatch)
+{
+    /* Minimum size ethernet frame without the FCS. */
+    static uint16_t const s_au16Frame[30] = { /* dst:*/ 0x8086, 0, 0,      /*src:*/0x8086, 0, 1, 0x0800 };
+    uint32_t const        cFrames         = _256K;
+
+    uint64_t const cWakeups  = pThis->pBuf0->cStatRecvWakeups.c;
+    uint32_t       cSends    = 0;
+    uint32_t       cReceived = 0;
+    uint64_t const nsStart   = RTTimeNanoTS();
+    for (uint32_t iFrame = 0; iFrame < cFrames; )
+    {
+        for (uint32_t i = 0; i < cBatch && iFrame < cFrames; i++, iFrame++)
+        {
+            INTNETSG Sg;
+            IntNetSgInitTemp(&Sg, (void *)&s_au16Frame[0], sizeof(s_au16Frame));
+            int rc = intnetR0RingWriteFrame(&pThis->pBuf1->Send, &Sg, NULL);
+            if (rc == VERR_BUFFER_OVERFLOW && i > 0)
+                break; /* the send ring is smaller than the batch */
+            RTTESTI_CHECK_RC_OK_RETV(rc);
+        }
+        RTTESTI_CHECK_RC_RETV(IntNetR0IfSend(pThis->hIf1, g_pSession), VINF_SUCCESS);
+        cSends++;
+
+        while (IntNetRingHasMoreToRead(&pThis->pBuf0->Recv))
+        {
+            IntNetRingSkipFrame(&pThis->pBuf0->Recv);
+            cReceived++;
+        }
+    }
+    uint64_t const cNsElapsed = RTTimeNanoTS() - nsStart;
+
+    RTTESTI_CHECK_MSG(cReceived == cFrames, ("%u vs. %u\n", cReceived, cFrames));
+    RTTestIValueF((uint64_t)cReceived * RT_NS_1SEC / RT_MAX(cNsElapsed, 1), RTTESTUNIT_FRAMES_PER_SEC,
+                  "%u frames per send", cBatch);
+    RTTestIValueF(cNsElapsed / cFrames, RTTESTUNIT_NS_PER_FRAME, "%u frames per send", cBatch);
+    RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "%u sends, %llu wakeups\n",
+                 cSends, pThis->pBuf0->cStatRecvWakeups.c - cWakeups);
+}
+
+static void doQoSTest(PTSTSTATE pThis)
+{
+    static uint16_t const s_au16Frame[7] = { /* dst:*/ 0x8086, 0, 0,      /*src:*/0x8086, 0, 1, 0x0800 };
+    uint16_t              au16Frame[RT_ELEMENTS(s_au16Frame)];
+
+    /* One frame per second leaves room for a single frame, the rest is delayed. */
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfSetQoS(pThis->hIf1, g_pSession, 0, 1, INTNET_QOS_PRIORITY_NORMAL, ""), VINF_SUCCESS);
+    uint64_t const cDelays = pThis->pBuf1->cStatQoSDelays.c;
+    uint64_t const cDrops  = pThis->pBuf1->cStatQoSDrops.c;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        INTNETSG Sg;
+        IntNetSgInitTemp(&Sg, (void *)&s_au16Frame[0], sizeof(s_au16Frame));
+        RTTESTI_CHECK_RC_RETV(intnetR0RingWriteFrame(&pThis->pBuf1->Send, &Sg, NULL), VINF_SUCCESS);
+    }
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfSend(pThis->hIf1, g_pSession), VINF_SUCCESS);
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfWait(pThis->hIf0, g_pSession, 1), VINF_SUCCESS);
+    RTTESTI_CHECK(IntNetRingReadAndSkipFrame(&pThis->pBuf0->Recv, au16Frame) == sizeof(s_au16Frame));
+    RTTESTI_CHECK(!IntNetRingHasMoreToRead(&pThis->pBuf0->Recv));
+    RTTESTI_CHECK(IntNetRingHasMoreToRead(&pThis->pBuf1->Send));
+    RTTESTI_CHECK(pThis->pBuf1->cStatQoSDelays.c == cDelays + 1);
+
+    /* Low priority frames are dropped instead. */
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfSetQoS(pThis->hIf1, g_pSession, 0, 1, INTNET_QOS_PRIORITY_LOW, ""), VINF_SUCCESS);
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfSend(pThis->hIf1, g_pSession), VINF_SUCCESS);
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfWait(pThis->hIf0, g_pSession, 1), VINF_SUCCESS);
+    RTTESTI_CHECK(IntNetRingReadAndSkipFrame(&pThis->pBuf0->Recv, au16Frame) == sizeof(s_au16Frame));
+    RTTESTI_CHECK(!IntNetRingHasMoreToRead(&pThis->pBuf0->Recv));
+    RTTESTI_CHECK(!IntNetRingHasMoreToRead(&pThis->pBuf1->Send));
+    RTTESTI_CHECK(pThis->pBuf1->cStatQoSDrops.c == cDrops + 1);
+
+    /* Interfaces in the same bandwidth group share the limit. */
+    static uint16_t const s_au16FrameTo1[7] = { /* dst:*/ 0x8086, 0, 1,      /*src:*/0x8086, 0, 0, 0x0800 };
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfSetQoS(pThis->hIf0, g_pSession, 0, 1, INTNET_QOS_PRIORITY_NORMAL, "grp"), VINF_SUCCESS);
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfSetQoS(pThis->hIf1, g_pSession, 0, 1, INTNET_QOS_PRIORITY_NORMAL, "grp"), VINF_SUCCESS);
+    RTTESTI_CHECK_RC_RETV(tstIntNetSendBuf(&pThis->pBuf0->Send, pThis->hIf0, g_pSession, s_au16FrameTo1, sizeof(s_au16FrameTo1)),
+                          VINF_SUCCESS);
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfWait(pThis->hIf1, g_pSession, 1), VINF_SUCCESS);
+    RTTESTI_CHECK(IntNetRingReadAndSkipFrame(&pThis->pBuf1->Recv, au16Frame) == sizeof(s_au16FrameTo1));
+    RTTESTI_CHECK_RC_RETV(tstIntNetSendBuf(&pThis->pBuf1->Send, pThis->hIf1, g_pSession, s_au16Frame, sizeof(s_au16Frame)),
+                          VINF_SUCCESS);
+    RTTESTI_CHECK(!IntNetRingHasMoreToRead(&pThis->pBuf0->Recv));
+    RTTESTI_CHECK(IntNetRingHasMoreToRead(&pThis->pBuf1->Send));
+    RTTESTI_CHECK(pThis->pBuf1->cStatQoSDelays.c == cDelays + 2);
+    RTTESTI_CHECK(pThis->pBuf1->cNsQoSDelay >= RT_NS_1MS && pThis->pBuf1->cNsQoSDelay <= RT_NS_1SEC);
+
+    /* Leaving the group lifts the limit, the delayed frame goes thru. */
+    RTTESTI_CHECK_RC(IntNetR0IfSetQoS(pThis->hIf0, g_pSession, 0, 0, INTNET_QOS_PRIORITY_NORMAL, ""), VINF_SUCCESS);
+    RTTESTI_CHECK_RC(IntNetR0IfSetQoS(pThis->hIf1, g_pSession, 0, 0, INTNET_QOS_PRIORITY_NORMAL, ""), VINF_SUCCESS);
+    RTTESTI_CHECK(g_pIntNet->pQoSGroups == NULL);
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfSend(pThis->hIf1, g_pSession), VINF_SUCCESS);
+    RTTESTI_CHECK_RC_RETV(IntNetR0IfWait(pThis->hIf0, g_pSession, 1), VINF_SUCCESS);
+    RTTESTI_CHECK(IntNetRingReadAndSkipFrame(&pThis->pBuf0->Recv, au16Frame) == sizeof(s_au16Frame));
+    RTTESTI_CHECK(!IntNetRingHasMoreToRead(&pThis->pBuf1->Send));
+
+    RTTESTI_CHECK_RC(IntNetR0IfSetQoS(pThis->hIf1, g_pSession, 0, 0, INTNET_QOS_PRIORITY_END, ""), VERR_INVALID_PARAMETER);
+}
+
 static void doTest(PTSTSTATE pThis, uint32_t cbRecv, uint32_t cbSend)
 {
 
@@ -699,6 +1106,41 @@ static void doTest(PTSTSTATE pThis, uint32_t cbRecv, uint32_t cbSend)
     doUnicastTest(pThis, false /*fHeadGuard*/);
     doUnicastTest(pThis, true /*fHeadGuard*/);
 
+    /*
+     * Several frames in one send call.
+     */
+    RTTestISub("Batch");
+    doBatchTest(pThis);
+
+    /*
+     * MAC address learning, hashing and ageing.
+     */
+    RTTestISub("MAC table");
+    doMacTabTest(pThis);
+
+    /*
+     * Level-3 switching on a network sharing the host MAC address.
+     */
+    RTTestISub("Level-3 hash");
+    doL3HashTest(cbSend, cbRecv);
+
+    /*
+     * QoS rate limiting.
+     */
+    RTTestISub("QoS");
+    doQoSTest(pThis);
+
+    /*
+     * Small frame rate, one frame per send vs. device batches.
+     */
+    if (!RTTestIErrorCount())
+    {
+        RTTestISub("Small frame rate");
+        doSmallFrameRateTest(pThis, 1);
+        doSmallFrameRateTest(pThis, 8);
+        doSmallFrameRateTest(pThis, 32 /* PDMNETWORK_MAX_BATCH */);
+    }
+
     /*
      * Do the big bi-directional transfer test if the basics worked out.
      */
@@ -0,0 +1,664 @@
+/* $Id$ */
+/** @file
+ * VBox - Testcase for the DNS cache and query coalescing of the NAT engine.
+ *
+ * "tstNatDns --server" is a stub DNS server which answers every A query
+ * itself and counts the queries it sees.  Run it on the host so that the
+ * host's resolver configuration points at it (e.g. as root with a
+ * "nameserver 127.0.0.1" resolv.conf), then run "tstNatDns --client 10.0.2.3"
+ * in a NAT guest.  The client checks that identical queries in flight are
+ * coalesced, that answers and NXDOMAIN are served from the cache and that
+ * entries expire with their TTL, by asking the stub how many queries reached
+ * it.  Without arguments both ends run here over loopback with nothing in
+ * between, which only checks the tool itself.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <iprt/test.h>
+#include <iprt/udp.h>
+#include <iprt/asm.h>
+#include <iprt/ctype.h>
+#include <iprt/err.h>
+#include <iprt/getopt.h>
+#include <iprt/rand.h>
+#include <iprt/semaphore.h>
+#include <iprt/socket.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The port of the loopback self test. */
+#define TSTNATDNS_PORT              5353
+/** The local port of the client. */
+#define TSTNATDNS_CLIENT_PORT       5354
+/** The size of the DNS header. */
+#define TSTNATDNS_HDR_LEN           12
+/** The max size of a DNS message over UDP without EDNS. */
+#define TSTNATDNS_MSG_MAX           512
+/** The number of identical queries sent at once. */
+#define TSTNATDNS_BURST             8
+/** How long the stub server delays the answers to "slow-" names (ms). */
+#define TSTNATDNS_SLOW_MS           250
+/** The address the stub server answers with (192.0.2.1, host byte order). */
+#define TSTNATDNS_ADDR              RT_MAKE_U32_FROM_U8(1, 2, 0, 192)
+/** The names the stub server answers with its query count. */
+#define TSTNATDNS_COUNT_DOMAIN      ".count.stub.test"
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * A query of the client and its answer.
+ */
+typedef struct TSTNATDNSQUERY
+{
+    /** The DNS id. */
+    uint16_t            idQuery;
+    /** Set once answered. */
+    bool volatile       fAnswered;
+    /** The response code. */
+    uint8_t             bRCode;
+    /** The first address of the answer, 0 if none. */
+    uint32_t            u32Addr;
+    /** The name as sent. */
+    char                szName[128];
+    /** The name of the question section of the answer. */
+    char                szAnswerName[128];
+} TSTNATDNSQUERY;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+static RTTEST               g_hTest;
+/** The UDP endpoint of the stub server. */
+static PRTUDPSERVER         g_pServer;
+/** Number of queries the stub server answered, not counting its count queries. */
+static uint32_t volatile    g_cServerQueries;
+/** The UDP endpoint of the client. */
+static PRTUDPSERVER         g_pClient;
+/** Where the client sends its queries. */
+static RTNETADDR            g_ServerAddr;
+/** The queries of the client in flight. */
+static TSTNATDNSQUERY       g_aQueries[TSTNATDNS_BURST];
+/** Number of entries used in g_aQueries. */
+static uint32_t volatile    g_cQueries;
+/** Number of answered entries in g_aQueries. */
+static uint32_t volatile    g_cAnswered;
+/** Signalled for every answer the client receives. */
+static RTSEMEVENT           g_hEvtAnswer;
+/** The next DNS id of the client. */
+static uint16_t             g_idNext;
+
+
+/**
+ * Turns a DNS name at off into a dotted string.
+ *
+ * @returns The offset following the name, -1 on failure.
+ */
+static int tstNatDnsGetName(uint8_t const *pb, size_t cb, int off, char *pszName, size_t cchName)
+{
+    size_t offName = 0;
+    int    offEnd  = -1;
+    for (unsigned cJumps = 0; cJumps < 16; )
+    {
+        if ((size_t)off >= cb)
+            return -1;
+        uint8_t cbLabel = pb[off];
+        if ((cbLabel & 0xc0) == 0xc0)
+        {
+            if ((size_t)off + 2 > cb)
+                return -1;
+            if (offEnd < 0)
+                offEnd = off + 2;
+            off = ((cbLabel & 0x3f) << 8) | pb[off + 1];
+            cJumps++;
+            continue;
+        }
+        if (!cbLabel)
+        {
+            pszName[offName] = '\0';
+            return offEnd < 0 ? off + 1 : offEnd;
+        }
+        if (   (size_t)off + 1 + cbLabel > cb
+            || offName + cbLabel + 2 > cchName)
+            return -1;
+        if (offName)
+            pszName[offName++] = '.';
+        memcpy(&pszName[offName], &pb[off + 1], cbLabel);
+        offName += cbLabel;
+        off += 1 + cbLabel;
+    }
+    return -1;
+}
+
+
+/**
+ * Puts the dotted name into a DNS message.
+ *
+ * @returns The offset following the name.
+ */
+static int tstNatDnsPutName(uint8_t *pb, int off, const char *pszName)
+{
+    while (*pszName)
+    {
+        const char *pszDot = strchr(pszName, '.');
+        size_t cch = pszDot ? (size_t)(pszDot - pszName) : strlen(pszName);
+        pb[off++] = (uint8_t)cch;
+        memcpy(&pb[off], pszName, cch);
+        off += (int)cch;
+        pszName += cch;
+        if (*pszName == '.')
+            pszName++;
+    }
+    pb[off++] = 0;
+    return off;
+}
+
+
+/**
+ * Appends a resource record referring to the question name.
+ */
+static int tstNatDnsPutRR(uint8_t *pb, int off, uint16_t u16Type, uint32_t cSecTtl,
+                          void const *pvRData, uint16_t cbRData)
+{
+    pb[off++] = 0xc0;
+    pb[off++] = TSTNATDNS_HDR_LEN;
+    *(uint16_t *)&pb[off] = RT_H2N_U16(u16Type);
+    *(uint16_t *)&pb[off + 2] = RT_H2N_U16_C(1);
+    *(uint32_t *)&pb[off + 4] = RT_H2N_U32(cSecTtl);
+    *(uint16_t *)&pb[off + 8] = RT_H2N_U16(cbRData);
+    memcpy(&pb[off + 10], pvRData, cbRData);
+    return off + 10 + cbRData;
+}
+
+
+/**
+ * Answers one query, the stub server.
+ *
+ * Names ending in TSTNATDNS_COUNT_DOMAIN are answered with 127.x.y.z where
+ * x.y.z is the number of the other queries seen so far, with a TTL of 0 so
+ * nobody keeps them.  Names starting with "nx-" don't exist (SOA minimum of
+ * 30s), "ttl-" names live for a second, "slow-" names are answered after
+ * TSTNATDNS_SLOW_MS and everything else lives for a minute.
+ */
+static DECLCALLBACK(int) tstNatDnsServe(RTSOCKET hSock, void *pvUser)
+{
+    NOREF(pvUser);
+    uint8_t   abMsg[TSTNATDNS_MSG_MAX];
+    size_t    cbMsg;
+    RTNETADDR Client;
+    int rc = RTUdpRead(hSock, abMsg, sizeof(abMsg), &cbMsg, &Client);
+    if (RT_FAILURE(rc) || cbMsg < TSTNATDNS_HDR_LEN)
+        return VINF_SUCCESS;
+    if ((abMsg[2] & 0x80) || abMsg[4] != 0 || abMsg[5] != 1)
+        return VINF_SUCCESS; /* only queries with a single question */
+
+    char szName[256];
+    int off = tstNatDnsGetName(abMsg, cbMsg, TSTNATDNS_HDR_LEN, szName, sizeof(szName));
+    if (off < 0 || (size_t)off + 4 > cbMsg)
+        return VINF_SUCCESS;
+    uint16_t const u16Type = RT_MAKE_U16(abMsg[off + 1], abMsg[off]);
+    off += 4;
+    RTStrToLower(szName);
+
+    uint8_t  bRCode  = 0;
+    uint32_t cSecTtl = 60;
+    uint32_t u32Addr = TSTNATDNS_ADDR;
+    size_t   cchName = strlen(szName);
+    if (   cchName > sizeof(TSTNATDNS_COUNT_DOMAIN) - 1
+        && !strcmp(&szName[cchName - sizeof(TSTNATDNS_COUNT_DOMAIN) + 1], TSTNATDNS_COUNT_DOMAIN))
+    {
+        cSecTtl = 0;
+        u32Addr = RT_MAKE_U32_FROM_U8(0, 0, 0, 127) | (ASMAtomicReadU32(&g_cServerQueries) & UINT32_C(0x00ffffff));
+    }
+    else
+    {
+        ASMAtomicIncU32(&g_cServerQueries);
+        if (!strncmp(szName, "nx-", 3))
+            bRCode = 3;
+        else if (!strncmp(szName, "ttl-", 4))
+            cSecTtl = 1;
+        else if (!strncmp(szName, "slow-", 5))
+            RTThreadSleep(TSTNATDNS_SLOW_MS);
+    }
+
+    /* The question stays, everything following it is replaced. */
+    abMsg[2]  = 0x84 | (abMsg[2] & 0x01);   /* QR, AA, RD of the query */
+    abMsg[3]  = 0x80 | bRCode;              /* RA */
+    abMsg[6]  = 0;
+    abMsg[7]  = 0;
+    abMsg[8]  = 0;
+    abMsg[9]  = 0;
+    abMsg[10] = 0;
+    abMsg[11] = 0;
+    if (bRCode)
+    {
+        /* MNAME and RNAME are the root, then serial, refresh, retry, expire and minimum. */
+        uint8_t abSoa[2 + 5 * 4];
+        RT_ZERO(abSoa);
+        *(uint32_t *)&abSoa[2 + 4 * 4] = RT_H2N_U32_C(30);
+        off = tstNatDnsPutRR(abMsg, off, 6 /* SOA */, 30, abSoa, sizeof(abSoa));
+        abMsg[9] = 1;
+    }
+    else if (u16Type == 1 /* A */)
+    {
+        uint32_t const u32AddrN = RT_H2N_U32(u32Addr);
+        off = tstNatDnsPutRR(abMsg, off, 1 /* A */, cSecTtl, &u32AddrN, sizeof(u32AddrN));
+        abMsg[7] = 1;
+    }
+
+    RTUdpWrite(g_pServer, abMsg, off, &Client);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Receives the answers, the client.
+ */
+static DECLCALLBACK(int) tstNatDnsClientReceive(RTSOCKET hSock, void *pvUser)
+{
+    NOREF(pvUser);
+    uint8_t   abMsg[TSTNATDNS_MSG_MAX];
+    size_t    cbMsg;
+    RTNETADDR Server;
+    int rc = RTUdpRead(hSock, abMsg, sizeof(abMsg), &cbMsg, &Server);
+    if (RT_FAILURE(rc) || cbMsg < TSTNATDNS_HDR_LEN || !(abMsg[2] & 0x80))
+        return VINF_SUCCESS;
+
+    uint16_t const  idQuery = RT_MAKE_U16(abMsg[1], abMsg[0]);
+    TSTNATDNSQUERY *pQuery  = NULL;
+    uint32_t const  cQueries = ASMAtomicReadU32(&g_cQueries);
+    for (uint32_t i = 0; i < cQueries; i++)
+        if (g_aQueries[i].idQuery == idQuery && !g_aQueries[i].fAnswered)
+        {
+            pQuery = &g_aQueries[i];
+            break;
+        }
+    if (!pQuery)
+    {
+        RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "unexpected answer with id %#x\n", idQuery);
+        return VINF_SUCCESS;
+    }
+
+    pQuery->bRCode  = abMsg[3] & 0x0f;
+    pQuery->u32Addr = 0;
+    int off = tstNatDnsGetName(abMsg, cbMsg, TSTNATDNS_HDR_LEN, pQuery->szAnswerName, sizeof(pQuery->szAnswerName));
+    if (off >= 0)
+        off += 4;
+    /* The first A record, host resolver answers start with CNAMEs. */
+    uint16_t cAnswers = RT_MAKE_U16(abMsg[7], abMsg[6]);
+    while (off >= 0 && cAnswers-- > 0)
+    {
+        char szOwner[256];
+        off = tstNatDnsGetName(abMsg, cbMsg, off, szOwner, sizeof(szOwner));
+        if (off < 0 || (size_t)off + 10 > cbMsg)
+            break;
+        uint16_t const u16Type = RT_MAKE_U16(abMsg[off + 1], abMsg[off]);
+        uint16_t const cbRData = RT_MAKE_U16(abMsg[off + 9], abMsg[off + 8]);
+        off += 10;
+        if ((size_t)off + cbRData > cbMsg)
+            break;
+        if (u16Type == 1 && cbRData == 4)
+        {
+            pQuery->u32Addr = RT_MAKE_U32_FROM_U8(abMsg[off + 3], abMsg[off + 2], abMsg[off + 1], abMsg[off]);
+            break;
+        }
+        off += cbRData;
+    }
+
+    ASMAtomicWriteBool(&pQuery->fAnswered, true);
+    ASMAtomicIncU32(&g_cAnswered);
+    RTSemEventSignal(g_hEvtAnswer);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Sends A queries for the given names and waits for all answers.
+ *
+ * @returns IPRT status code, VERR_TIMEOUT if an answer is missing.
+ */
+static int tstNatDnsQuery(const char * const *papszNames, uint32_t cNames)
+{
+    AssertReturn(cNames <= RT_ELEMENTS(g_aQueries), VERR_INVALID_PARAMETER);
+    ASMAtomicWriteU32(&g_cQueries, 0);
+    ASMAtomicWriteU32(&g_cAnswered, 0);
+    for (uint32_t i = 0; i < cNames; i++)
+    {
+        RT_ZERO(g_aQueries[i]);
+        g_aQueries[i].idQuery = ++g_idNext;
+        RTStrCopy(g_aQueries[i].szName, sizeof(g_aQueries[i].szName), papszNames[i]);
+    }
+    ASMAtomicWriteU32(&g_cQueries, cNames);
+
+    for (uint32_t i = 0; i < cNames; i++)
+    {
+        uint8_t abMsg[TSTNATDNS_MSG_MAX];
+        RT_ZERO(abMsg);
+        abMsg[0] = RT_HI_U8(g_aQueries[i].idQuery);
+        abMsg[1] = RT_LO_U8(g_aQueries[i].idQuery);
+        abMsg[2] = 0x01; /* RD */
+        abMsg[5] = 1;    /* one question */
+        int off = tstNatDnsPutName(abMsg, TSTNATDNS_HDR_LEN, papszNames[i]);
+        abMsg[off + 1] = 1; /* A */
+        abMsg[off + 3] = 1; /* IN */
+        int rc = RTUdpWrite(g_pClient, abMsg, off + 4, &g_ServerAddr);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    uint64_t const u64Start = RTTimeMilliTS();
+    while (ASMAtomicReadU32(&g_cAnswered) < cNames)
+    {
+        uint64_t const cMsElapsed = RTTimeMilliTS() - u64Start;
+        if (cMsElapsed >= 10000)
+            return VERR_TIMEOUT;
+        RTSemEventWait(g_hEvtAnswer, (RTMSINTERVAL)(10000 - cMsElapsed));
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Queries a single name.
+ */
+static int tstNatDnsQueryOne(const char *pszName)
+{
+    return tstNatDnsQuery(&pszName, 1);
+}
+
+
+/**
+ * Asks the stub server how many queries reached it.
+ *
+ * @returns The count, UINT32_MAX on failure.
+ */
+static uint32_t tstNatDnsServerCount(uint32_t uNonce)
+{
+    static uint32_t s_iSeq = 0;
+    char szName[64];
+    RTStrPrintf(szName, sizeof(szName), "%08x-%u" TSTNATDNS_COUNT_DOMAIN, uNonce, ++s_iSeq);
+    int rc = tstNatDnsQueryOne(szName);
+    if (RT_FAILURE(rc) || (g_aQueries[0].u32Addr >> 24) != 127)
+    {
+        RTTestFailed(g_hTest, "the stub server didn't answer the count query (%Rrc, %RTnaipv4), is it the upstream server?",
+                     rc, RT_H2N_U32(g_aQueries[0].u32Addr));
+        return UINT32_MAX;
+    }
+    return g_aQueries[0].u32Addr & UINT32_C(0x00ffffff);
+}
+
+
+/**
+ * Checks the answers of the last tstNatDnsQuery call.
+ */
+static void tstNatDnsCheckAnswers(uint8_t bRCode)
+{
+    uint32_t const cQueries = ASMAtomicReadU32(&g_cQueries);
+    for (uint32_t i = 0; i < cQueries; i++)
+    {
+        TSTNATDNSQUERY const *pQuery = &g_aQueries[i];
+        if (pQuery->bRCode != bRCode)
+            RTTestFailed(g_hTest, "%s: rcode %u, expected %u", pQuery->szName, pQuery->bRCode, bRCode);
+        else if (!bRCode && pQuery->u32Addr != TSTNATDNS_ADDR)
+            RTTestFailed(g_hTest, "%s: answered with %RTnaipv4", pQuery->szName, RT_H2N_U32(pQuery->u32Addr));
+        /* The question has to come back the way it was asked. */
+        if (strcmp(pQuery->szAnswerName, pQuery->szName))
+            RTTestFailed(g_hTest, "%s: the answer asks for '%s'", pQuery->szName, pQuery->szAnswerName);
+    }
+}
+
+
+/**
+ * Checks how many of the queries since uCountBefore reached the stub server.
+ */
+static void tstNatDnsCheckUpstream(uint32_t uNonce, uint32_t uCountBefore, uint32_t cExpected, const char *pszWhat)
+{
+    uint32_t const uCountAfter = tstNatDnsServerCount(uNonce);
+    if (uCountBefore == UINT32_MAX || uCountAfter == UINT32_MAX)
+        return;
+    uint32_t const cUpstream = uCountAfter - uCountBefore;
+    RTTestValue(g_hTest, pszWhat, cUpstream, RTTESTUNIT_OCCURRENCES);
+    if (cUpstream != cExpected)
+        RTTestFailed(g_hTest, "%s: %u queries went upstream, expected %u", pszWhat, cUpstream, cExpected);
+}
+
+
+/**
+ * Identical queries sent at once go upstream once.
+ */
+static void tstNatDnsCoalescing(uint32_t uNonce, bool fProxy)
+{
+    RTTestSub(g_hTest, "Coalescing");
+
+    char szName[64];
+    RTStrPrintf(szName, sizeof(szName), "slow-%08x.stub.test", uNonce);
+    const char *apszNames[TSTNATDNS_BURST];
+    for (unsigned i = 0; i < RT_ELEMENTS(apszNames); i++)
+        apszNames[i] = szName;
+
+    uint32_t const uCountBefore = tstNatDnsServerCount(uNonce);
+    int rc = tstNatDnsQuery(apszNames, RT_ELEMENTS(apszNames));
+    if (RT_FAILURE(rc))
+    {
+        RTTestFailed(g_hTest, "%s: %Rrc, %u of %u answered", szName, rc, g_cAnswered, RT_ELEMENTS(apszNames));
+        return;
+    }
+    tstNatDnsCheckAnswers(0);
+    tstNatDnsCheckUpstream(uNonce, uCountBefore, fProxy ? 1 : RT_ELEMENTS(apszNames), "Upstream queries");
+}
+
+
+/**
+ * Repeated queries are answered from the cache, whatever their case.
+ */
+static void tstNatDnsCache(uint32_t uNonce, bool fProxy)
+{
+    RTTestSub(g_hTest, "Cache");
+
+    char szName[64];
+    RTStrPrintf(szName, sizeof(szName), "cached-%08x.stub.test", uNonce);
+    uint32_t const uCountBefore = tstNatDnsServerCount(uNonce);
+    uint64_t const u64Start = RTTimeNanoTS();
+    for (unsigned i = 0; i < TSTNATDNS_BURST; i++)
+    {
+        /* every other query shouts */
+        char szQuery[64];
+        RTStrCopy(szQuery, sizeof(szQuery), szName);
+        if (i & 1)
+            RTStrToUpper(szQuery);
+        int rc = tstNatDnsQueryOne(szQuery);
+        if (RT_FAILURE(rc))
+        {
+            RTTestFailed(g_hTest, "%s: %Rrc", szQuery, rc);
+            return;
+        }
+        tstNatDnsCheckAnswers(0);
+    }
+    RTTestValue(g_hTest, "Average", (RTTimeNanoTS() - u64Start) / TSTNATDNS_BURST, RTTESTUNIT_NS_PER_CALL);
+    tstNatDnsCheckUpstream(uNonce, uCountBefore, fProxy ? 1 : TSTNATDNS_BURST, "Upstream queries");
+}
+
+
+/**
+ * Names which don't exist are cached too.
+ */
+static void tstNatDnsNegative(uint32_t uNonce, bool fProxy)
+{
+    RTTestSub(g_hTest, "Negative cache");
+
+    char szName[64];
+    RTStrPrintf(szName, sizeof(szName), "nx-%08x.stub.test", uNonce);
+    uint32_t const uCountBefore = tstNatDnsServerCount(uNonce);
+    for (unsigned i = 0; i < 2; i++)
+    {
+        int rc = tstNatDnsQueryOne(szName);
+        if (RT_FAILURE(rc))
+        {
+            RTTestFailed(g_hTest, "%s: %Rrc", szName, rc);
+            return;
+        }
+        tstNatDnsCheckAnswers(3 /* NXDOMAIN */);
+    }
+    tstNatDnsCheckUpstream(uNonce, uCountBefore, fProxy ? 1 : 2, "Upstream queries");
+}
+
+
+/**
+ * Entries go away with their TTL.
+ */
+static void tstNatDnsExpiry(uint32_t uNonce, bool fProxy)
+{
+    RTTestSub(g_hTest, "Expiry");
+
+    char szName[64];
+    RTStrPrintf(szName, sizeof(szName), "ttl-%08x.stub.test", uNonce);
+    uint32_t const uCountBefore = tstNatDnsServerCount(uNonce);
+    for (unsigned i = 0; i < 3; i++)
+    {
+        /* the TTL is a second, the last query comes after it */
+        if (i == 2)
+            RTThreadSleep(2500);
+        int rc = tstNatDnsQueryOne(szName);
+        if (RT_FAILURE(rc))
+        {
+            RTTestFailed(g_hTest, "%s: %Rrc", szName, rc);
+            return;
+        }
+        tstNatDnsCheckAnswers(0);
+    }
+    tstNatDnsCheckUpstream(uNonce, uCountBefore, fProxy ? 2 : 3, "Upstream queries");
+}
+
+
+int main(int argc, char **argv)
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstNatDns", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+
+    static RTGETOPTDEF const s_aOptions[] =
+    {
+        { "--server",       's', RTGETOPT_REQ_NOTHING },
+        { "--client",       'c', RTGETOPT_REQ_STRING  },
+        { "--bind",         'b', RTGETOPT_REQ_STRING  },
+        { "--port",         'p', RTGETOPT_REQ_UINT32  },
+        { "--client-port",  'P', RTGETOPT_REQ_UINT32  },
+    };
+
+    bool        fServer     = false;
+    const char *pszClient   = NULL;
+    const char *pszBind     = NULL;
+    uint32_t    uPort       = 0;
+    uint32_t    uClientPort = TSTNATDNS_CLIENT_PORT;
+
+    int ch;
+    RTGETOPTUNION Value;
+    RTGETOPTSTATE GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0 /* fFlags */);
+    while ((ch = RTGetOpt(&GetState, &Value)))
+    {
+        switch (ch)
+        {
+            case 's': fServer = true; break;
+            case 'c': pszClient = Value.psz; break;
+            case 'b': pszBind = Value.psz; break;
+            case 'p': uPort = Value.u32; break;
+            case 'P': uClientPort = Value.u32; break;
+
+            case 'h':
+                RTPrintf("Usage: tstNatDns [--server [--bind <addr>]] [--client <addr>] [--port <port>]\n"
+                         "                 [--client-port <port>]\n"
+                         "The server and the client default to port 53.  Without --server and --client\n"
+                         "both ends run here over loopback on port %u.\n", TSTNATDNS_PORT);
+                return RTEXITCODE_SUCCESS;
+
+            default:
+                return RTGetOptPrintError(ch, &Value);
+        }
+    }
+
+    /*
+     * Server only.
+     */
+    if (fServer)
+    {
+        if (!uPort)
+            uPort = 53;
+        RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "serving on %s:%u\n", pszBind ? pszBind : "*", uPort);
+        int rc = RTUdpServerCreateEx(pszBind, uPort, &g_pServer);
+        if (RT_SUCCESS(rc))
+        {
+            rc = RTUdpServerListen(g_pServer, tstNatDnsServe, NULL);
+            if (RT_FAILURE(rc) && rc != VERR_UDP_SERVER_STOP)
+                RTTestFailed(g_hTest, "RTUdpServerListen failed: %Rrc", rc);
+            RTUdpServerDestroy(g_pServer);
+        }
+        else
+            RTTestFailed(g_hTest, "RTUdpServerCreateEx failed: %Rrc", rc);
+        return RTTestSummaryAndDestroy(g_hTest);
+    }
+
+    /*
+     * Client, with a local server and no proxy in between if no address was given.
+     */
+    bool const fProxy = pszClient != NULL;
+    if (!fProxy)
+    {
+        pszClient = "127.0.0.1";
+        if (!uPort)
+            uPort = TSTNATDNS_PORT;
+        int rc = RTUdpServerCreate(pszClient, uPort, RTTHREADTYPE_IO, "DNSSTUB", tstNatDnsServe, NULL, &g_pServer);
+        if (RT_FAILURE(rc))
+        {
+            RTTestFailed(g_hTest, "RTUdpServerCreate failed: %Rrc", rc);
+            return RTTestSummaryAndDestroy(g_hTest);
+        }
+    }
+    else if (!uPort)
+        uPort = 53;
+
+    int rc = RTSocketParseInetAddress(pszClient, uPort, &g_ServerAddr);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&g_hEvtAnswer);
+    if (RT_SUCCESS(rc))
+        rc = RTUdpServerCreate(NULL, uClientPort, RTTHREADTYPE_IO, "DNSCLNT", tstNatDnsClientReceive, NULL, &g_pClient);
+    if (RT_SUCCESS(rc))
+    {
+        /* A new name space for every run, the cache outlives us. */
+        uint32_t const uNonce = RTRandU32();
+        tstNatDnsCoalescing(uNonce, fProxy);
+        tstNatDnsCache(uNonce, fProxy);
+        tstNatDnsNegative(uNonce, fProxy);
+        tstNatDnsExpiry(uNonce, fProxy);
+        RTUdpServerDestroy(g_pClient);
+    }
+    else
+        RTTestFailed(g_hTest, "setting up the client failed: %Rrc", rc);
+
+    RTSemEventDestroy(g_hEvtAnswer);
+    if (g_pServer)
+        RTUdpServerDestroy(g_pServer);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
@@ -0,0 +1,817 @@
+/* $Id$ */
+/** @file
+ * VBox - Flow lookup benchmark for the slirp NAT engine.
+ *
+ * Opens a number of guest UDP and TCP flows to the host through slirp_input
+ * and then feeds frames of all of them round robin, reporting the time per
+ * frame for each flow count.  With a constant socket lookup the numbers stay
+ * flat as the flow count grows.  The UDP numbers include the sendto() to the
+ * host loopback, the TCP ones are repeated SYNs of connections which are
+ * still being set up, slirp drops them right after the lookup.
+ *
+ * It starts out checking how slirp_flow_select, which DrvNAT and VBoxNetNAT
+ * use to spread the guest frames over their engines, distributes them.
+ *
+ * With the epoll event loop it ends with the cost of a round of the NAT
+ * thread (fill, wait, poll) with a few busy connections streaming to the host
+ * next to a growing number of idle established ones.  As slirp only looks at
+ * the sockets something happened to, the numbers stay flat there too.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include "../slirp/libslirp.h"
+
+#include <iprt/test.h>
+#include <iprt/asm.h>
+#include <iprt/err.h>
+#include <iprt/getopt.h>
+#include <iprt/mem.h>
+#include <iprt/net.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/tcp.h>
+#include <iprt/time.h>
+#include <iprt/udp.h>
+
+#ifdef VBOX_WITH_NAT_EPOLL
+# include <errno.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <netinet/in.h>
+# include <sys/epoll.h>
+# include <sys/resource.h>
+# include <sys/socket.h>
+#endif
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The NAT network, 10.0.2.0/24, host byte order. */
+#define TSTNATFLOWS_NETWORK         UINT32_C(0x0a000200)
+/** The NAT netmask. */
+#define TSTNATFLOWS_NETMASK         UINT32_C(0xffffff00)
+/** The guest address, host byte order. */
+#define TSTNATFLOWS_GUEST_IP        UINT32_C(0x0a00020f)
+/** The alias of the host loopback, host byte order. */
+#define TSTNATFLOWS_HOST_IP         UINT32_C(0x0a000202)
+/** The first guest port, flow i uses this plus i. */
+#define TSTNATFLOWS_GUEST_PORT      20000
+/** The default host port of the UDP sink and the TCP listener. */
+#define TSTNATFLOWS_PORT            5011
+/** The UDP payload size. */
+#define TSTNATFLOWS_PAYLOAD         64
+/** The size of the frames. */
+#define TSTNATFLOWS_FRAME_SIZE      (  sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN \
+                                     + RT_MAX(sizeof(RTNETUDP) + TSTNATFLOWS_PAYLOAD, sizeof(RTNETTCP)))
+/** The default number of frames timed for each flow count. */
+#define TSTNATFLOWS_FRAMES          _64K
+/** The payload of the segments of the busy connections. */
+#define TSTNATFLOWS_SEGMENT         1024
+/** How much a busy connection keeps in flight at most. */
+#define TSTNATFLOWS_IN_FLIGHT       (16 * TSTNATFLOWS_SEGMENT)
+/** The size of the frames of the busy connections. */
+#define TSTNATFLOWS_SEGMENT_FRAME_SIZE  (  sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + sizeof(RTNETTCP) \
+                                         + TSTNATFLOWS_SEGMENT)
+/** The default number of rounds timed for each idle connection count. */
+#define TSTNATFLOWS_ROUNDS          4096
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * A guest TCP connection of the idle/busy benchmark, the guest port is
+ * TSTNATFLOWS_GUEST_PORT plus its index.
+ */
+typedef struct TSTNATFLOWSCONN
+{
+    /** The sequence number of slirp's SYN plus one, valid if fSynAck is set. */
+    uint32_t        uSlirpSeq;
+    /** The next sequence number of the guest. */
+    uint32_t        uGuestSeq;
+    /** Up to where slirp acknowledged the guest data. */
+    uint32_t        uAcked;
+    /** Set once slirp's SYN-ACK came. */
+    bool            fSynAck;
+} TSTNATFLOWSCONN;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+static RTTEST           g_hTest;
+/** The guest MAC address. */
+static RTMAC const      g_GuestMac = { { 0x08, 0x00, 0x27, 0x00, 0x00, 0x01 } };
+/** The engine being measured. */
+static PNATState        g_pNATState;
+/** Number of frames slirp sent to the guest. */
+static uint32_t volatile g_cFramesOut;
+/** The connections of the idle/busy benchmark, NULL outside of it. */
+static TSTNATFLOWSCONN *g_paConns;
+/** Number of entries in g_paConns. */
+static uint32_t         g_cConns;
+/** Number of resets slirp sent on them. */
+static uint32_t         g_cConnResets;
+
+
+/**
+ * Tracks the connections of the idle/busy benchmark in what slirp sends
+ * to the guest.
+ */
+static void tstNatFlowsGuestRecv(const uint8_t *pbFrame, int cbFrame)
+{
+    if (   !g_paConns
+        || cbFrame < (int)(sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + sizeof(RTNETTCP)))
+        return;
+    PCRTNETETHERHDR pEth = (PCRTNETETHERHDR)pbFrame;
+    PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)(pEth + 1);
+    if (   pEth->EtherType != RT_H2N_U16_C(RTNET_ETHERTYPE_IPV4)
+        || pIpHdr->ip_p != RTNETIPV4_PROT_TCP)
+        return;
+    PCRTNETTCP pTcpHdr = (PCRTNETTCP)((uint8_t const *)pIpHdr + pIpHdr->ip_hl * 4);
+    uint32_t const iConn = (uint32_t)RT_N2H_U16(pTcpHdr->th_dport) - TSTNATFLOWS_GUEST_PORT;
+    if (iConn >= g_cConns)
+        return;
+
+    TSTNATFLOWSCONN *pConn = &g_paConns[iConn];
+    if (pTcpHdr->th_flags & RTNETTCP_F_RST)
+        g_cConnResets++;
+    else if ((pTcpHdr->th_flags & (RTNETTCP_F_SYN | RTNETTCP_F_ACK)) == (RTNETTCP_F_SYN | RTNETTCP_F_ACK))
+    {
+        pConn->uSlirpSeq = RT_N2H_U32(pTcpHdr->th_seq) + 1;
+        pConn->uAcked    = RT_N2H_U32(pTcpHdr->th_ack);
+        pConn->fSynAck   = true;
+    }
+    else if (   (pTcpHdr->th_flags & RTNETTCP_F_ACK)
+             && (int32_t)(RT_N2H_U32(pTcpHdr->th_ack) - pConn->uAcked) > 0)
+        pConn->uAcked = RT_N2H_U32(pTcpHdr->th_ack);
+}
+
+
+/** slirp's hooks */
+extern "C" int slirp_can_output(void *pvUser)
+{
+    NOREF(pvUser);
+    return 1;
+}
+
+extern "C" void slirp_urg_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
+{
+    NOREF(pvUser);
+    ASMAtomicIncU32(&g_cFramesOut);
+    tstNatFlowsGuestRecv(pu8Buf, cb);
+    slirp_ext_m_free(g_pNATState, m, (uint8_t *)pu8Buf);
+}
+
+extern "C" void slirp_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
+{
+    NOREF(pvUser);
+    ASMAtomicIncU32(&g_cFramesOut);
+    tstNatFlowsGuestRecv(pu8Buf, cb);
+    slirp_ext_m_free(g_pNATState, m, (uint8_t *)pu8Buf);
+}
+
+extern "C" void slirp_output_pending(void *pvUser)
+{
+    NOREF(pvUser);
+}
+
+extern "C" void slirp_wakeup_nat_thread(void *pvUser)
+{
+    NOREF(pvUser);
+}
+
+
+/**
+ * Builds the guest frame of one flow.
+ *
+ * @returns The size of the frame.
+ * @param   pbFrame     Where to build it, TSTNATFLOWS_FRAME_SIZE bytes.
+ * @param   fTcp        A TCP SYN if set, a UDP datagram otherwise.
+ * @param   uGuestPort  The source port of the flow.
+ * @param   uHostPort   The destination port of the flow.
+ */
+static size_t tstNatFlowsBuildFrame(uint8_t *pbFrame, bool fTcp, uint16_t uGuestPort, uint16_t uHostPort)
+{
+    size_t const cbL4 = fTcp ? sizeof(RTNETTCP) : sizeof(RTNETUDP) + TSTNATFLOWS_PAYLOAD;
+    memset(pbFrame, 0, TSTNATFLOWS_FRAME_SIZE);
+
+    PRTNETETHERHDR pEth = (PRTNETETHERHDR)pbFrame;
+    memset(&pEth->DstMac, 0xff, sizeof(pEth->DstMac));
+    pEth->SrcMac    = g_GuestMac;
+    pEth->EtherType = RT_H2N_U16_C(RTNET_ETHERTYPE_IPV4);
+
+    PRTNETIPV4 pIpHdr = (PRTNETIPV4)(pEth + 1);
+    pIpHdr->ip_v        = 4;
+    pIpHdr->ip_hl       = RTNETIPV4_MIN_LEN / 4;
+    pIpHdr->ip_len      = RT_H2N_U16((uint16_t)(RTNETIPV4_MIN_LEN + cbL4));
+    pIpHdr->ip_id       = RT_H2N_U16(uGuestPort);
+    pIpHdr->ip_ttl      = 64;
+    pIpHdr->ip_p        = fTcp ? RTNETIPV4_PROT_TCP : RTNETIPV4_PROT_UDP;
+    pIpHdr->ip_src.u    = RT_H2N_U32_C(TSTNATFLOWS_GUEST_IP);
+    pIpHdr->ip_dst.u    = RT_H2N_U32_C(TSTNATFLOWS_HOST_IP);
+    pIpHdr->ip_sum      = RTNetIPv4HdrChecksum(pIpHdr);
+
+    if (fTcp)
+    {
+        PRTNETTCP pTcpHdr = (PRTNETTCP)((uint8_t *)pIpHdr + RTNETIPV4_MIN_LEN);
+        pTcpHdr->th_sport   = RT_H2N_U16(uGuestPort);
+        pTcpHdr->th_dport   = RT_H2N_U16(uHostPort);
+        pTcpHdr->th_seq     = RT_H2N_U32((uint32_t)uGuestPort << 16);
+        pTcpHdr->th_off     = sizeof(RTNETTCP) / 4;
+        pTcpHdr->th_flags   = RTNETTCP_F_SYN;
+        pTcpHdr->th_win     = RT_H2N_U16_C(8192);
+        pTcpHdr->th_sum     = RTNetIPv4TCPChecksum(pIpHdr, pTcpHdr, NULL);
+    }
+    else
+    {
+        /* No checksum, slirp skips the verification then. */
+        PRTNETUDP pUdpHdr = (PRTNETUDP)((uint8_t *)pIpHdr + RTNETIPV4_MIN_LEN);
+        pUdpHdr->uh_sport   = RT_H2N_U16(uGuestPort);
+        pUdpHdr->uh_dport   = RT_H2N_U16(uHostPort);
+        pUdpHdr->uh_ulen    = RT_H2N_U16((uint16_t)cbL4);
+        memset(pUdpHdr + 1, 'f', TSTNATFLOWS_PAYLOAD);
+    }
+    return sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + cbL4;
+}
+
+
+/**
+ * Builds the guest frame of a flow to an outside address.
+ *
+ * @returns The size of the frame.
+ * @param   pbFrame     Where to build it, TSTNATFLOWS_FRAME_SIZE bytes.
+ * @param   fTcp        TCP or UDP.
+ * @param   uDstIp      The destination address, host byte order.
+ * @param   uGuestPort  The source port of the flow.
+ * @param   uDstPort    The destination port of the flow.
+ */
+static size_t tstNatFlowsBuildOutFrame(uint8_t *pbFrame, bool fTcp, uint32_t uDstIp, uint16_t uGuestPort, uint16_t uDstPort)
+{
+    size_t cbFrame = tstNatFlowsBuildFrame(pbFrame, fTcp, uGuestPort, uDstPort);
+    PRTNETIPV4 pIpHdr = (PRTNETIPV4)(pbFrame + sizeof(RTNETETHERHDR));
+    pIpHdr->ip_dst.u = RT_H2N_U32(uDstIp);
+    return cbFrame;
+}
+
+
+/**
+ * Builds an ARP frame from the guest.
+ *
+ * @returns The size of the frame.
+ * @param   pbFrame     Where to build it, TSTNATFLOWS_FRAME_SIZE bytes.
+ * @param   uOper       The ARP operation.
+ * @param   uTargetIp   The target address, host byte order.
+ */
+static size_t tstNatFlowsBuildArpFrame(uint8_t *pbFrame, uint16_t uOper, uint32_t uTargetIp)
+{
+    memset(pbFrame, 0, TSTNATFLOWS_FRAME_SIZE);
+    PRTNETETHERHDR pEth = (PRTNETETHERHDR)pbFrame;
+    memset(&pEth->DstMac, 0xff, sizeof(pEth->DstMac));
+    pEth->SrcMac    = g_GuestMac;
+    pEth->EtherType = RT_H2N_U16_C(RTNET_ETHERTYPE_ARP);
+
+    PRTNETARPIPV4 pArp = (PRTNETARPIPV4)(pEth + 1);
+    pArp->Hdr.ar_htype  = RT_H2N_U16_C(RTNET_ARP_ETHER);
+    pArp->Hdr.ar_ptype  = RT_H2N_U16_C(RTNET_ETHERTYPE_IPV4);
+    pArp->Hdr.ar_hlen   = sizeof(RTMAC);
+    pArp->Hdr.ar_plen   = sizeof(RTNETADDRIPV4);
+    pArp->Hdr.ar_oper   = RT_H2N_U16(uOper);
+    pArp->ar_sha        = g_GuestMac;
+    pArp->ar_spa.u      = RT_H2N_U32_C(TSTNATFLOWS_GUEST_IP);
+    pArp->ar_tpa.u      = RT_H2N_U32(uTargetIp);
+    return sizeof(RTNETETHERHDR) + sizeof(RTNETARPIPV4);
+}
+
+
+/**
+ * Builds a TCP segment of a connection of the idle/busy benchmark.
+ *
+ * @returns The size of the frame.
+ * @param   pbFrame     Where to build it, TSTNATFLOWS_SEGMENT_FRAME_SIZE bytes.
+ * @param   iConn       The connection.
+ * @param   uHostPort   The destination port.
+ * @param   cbPayload   The payload size, at most TSTNATFLOWS_SEGMENT.
+ */
+static size_t tstNatFlowsBuildSegment(uint8_t *pbFrame, uint32_t iConn, uint16_t uHostPort, size_t cbPayload)
+{
+    TSTNATFLOWSCONN const *pConn = &g_paConns[iConn];
+    size_t cbFrame = tstNatFlowsBuildFrame(pbFrame, true /*fTcp*/, (uint16_t)(TSTNATFLOWS_GUEST_PORT + iConn), uHostPort);
+
+    PRTNETIPV4 pIpHdr  = (PRTNETIPV4)(pbFrame + sizeof(RTNETETHERHDR));
+    PRTNETTCP  pTcpHdr = (PRTNETTCP)((uint8_t *)pIpHdr + RTNETIPV4_MIN_LEN);
+    memset(pTcpHdr + 1, 'b', cbPayload);
+    pIpHdr->ip_len      = RT_H2N_U16((uint16_t)(RTNETIPV4_MIN_LEN + sizeof(RTNETTCP) + cbPayload));
+    pIpHdr->ip_sum      = 0;
+    pIpHdr->ip_sum      = RTNetIPv4HdrChecksum(pIpHdr);
+    pTcpHdr->th_seq     = RT_H2N_U32(pConn->uGuestSeq);
+    pTcpHdr->th_ack     = RT_H2N_U32(pConn->uSlirpSeq);
+    pTcpHdr->th_flags   = RTNETTCP_F_ACK | (cbPayload ? RTNETTCP_F_PSH : 0);
+    pTcpHdr->th_win     = RT_H2N_U16_C(32768);
+    pTcpHdr->th_sum     = 0;
+    pTcpHdr->th_sum     = RTNetIPv4TCPChecksum(pIpHdr, pTcpHdr, NULL);
+    return cbFrame + cbPayload;
+}
+
+
+/**
+ * Checks the distribution of guest frames over several engines.
+ */
+static void tstNatFlowsSelect(void)
+{
+    RTTestSub(g_hTest, "Flow distribution");
+
+    static SLIRPFLOWSEL s_Sel; /* the port bitmaps make it big */
+    uint8_t abFrame[TSTNATFLOWS_FRAME_SIZE];
+    uint32_t const uOutIp = UINT32_C(0xc0a80101); /* 192.168.1.1 */
+    size_t cbFrame;
+
+    /* One engine gets everything. */
+    slirp_flow_init(&s_Sel, TSTNATFLOWS_GUEST_IP, TSTNATFLOWS_NETMASK, 1);
+    for (uint16_t uPort = 1024; uPort < 1024 + 64; uPort++)
+    {
+        cbFrame = tstNatFlowsBuildOutFrame(abFrame, true /*fTcp*/, uOutIp, uPort, 80);
+        RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == 0);
+    }
+
+    unsigned const cEngines = 4;
+    slirp_flow_init(&s_Sel, TSTNATFLOWS_GUEST_IP, TSTNATFLOWS_NETMASK, cEngines);
+
+    /* TCP to the outside is spread over all engines, a flow sticks to one. */
+    uint32_t acFlows[4] = { 0, 0, 0, 0 };
+    uint16_t uSecondaryPort = 0;
+    for (uint16_t uPort = 1024; uPort < 1024 + 256; uPort++)
+    {
+        cbFrame = tstNatFlowsBuildOutFrame(abFrame, true /*fTcp*/, uOutIp, uPort, 80);
+        unsigned iEngine = slirp_flow_select(&s_Sel, abFrame, cbFrame);
+        RTTESTI_CHECK_RETV(iEngine < cEngines);
+        RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == iEngine);
+        acFlows[iEngine]++;
+        if (iEngine != 0 && !uSecondaryPort)
+            uSecondaryPort = uPort;
+    }
+    for (unsigned iEngine = 0; iEngine < cEngines; iEngine++)
+        RTTESTI_CHECK_MSG(acFlows[iEngine] >= 256 / cEngines / 4, ("engine %u got %u of 256 flows\n", iEngine, acFlows[iEngine]));
+    RTTESTI_CHECK_RETV(uSecondaryPort != 0);
+
+    /* A guest UDP socket keeps its engine whoever it talks to. */
+    cbFrame = tstNatFlowsBuildOutFrame(abFrame, false /*fTcp*/, uOutIp, 5353, 53);
+    unsigned const iUdpEngine = slirp_flow_select(&s_Sel, abFrame, cbFrame);
+    RTTESTI_CHECK(iUdpEngine < cEngines);
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        cbFrame = tstNatFlowsBuildOutFrame(abFrame, false /*fTcp*/, uOutIp + i * 0x100, 5353, (uint16_t)(1000 + i));
+        RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == iUdpEngine);
+    }
+
+    /* The NAT's own addresses, DHCP and FTP stay on the primary engine. */
+    cbFrame = tstNatFlowsBuildOutFrame(abFrame, false /*fTcp*/, TSTNATFLOWS_HOST_IP + 1 /* DNS */, uSecondaryPort, 53);
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == 0);
+    cbFrame = tstNatFlowsBuildOutFrame(abFrame, true /*fTcp*/, TSTNATFLOWS_HOST_IP, uSecondaryPort, 80);
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == 0);
+    cbFrame = tstNatFlowsBuildOutFrame(abFrame, false /*fTcp*/, UINT32_MAX, 68, 67);
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == 0);
+    cbFrame = tstNatFlowsBuildOutFrame(abFrame, true /*fTcp*/, uOutIp, uSecondaryPort, 21);
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == 0);
+
+    /* Fragments, ICMP and runts too. */
+    cbFrame = tstNatFlowsBuildOutFrame(abFrame, true /*fTcp*/, uOutIp, uSecondaryPort, 80);
+    PRTNETIPV4 pIpHdr = (PRTNETIPV4)&abFrame[sizeof(RTNETETHERHDR)];
+    pIpHdr->ip_off = RT_H2N_U16_C(RTNETIPV4_FLAGS_MF);
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == 0);
+    pIpHdr->ip_off = 0;
+    pIpHdr->ip_p   = RTNETIPV4_PROT_ICMP;
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == 0);
+    pIpHdr->ip_p   = RTNETIPV4_PROT_TCP;
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) != 0);
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN) == 0);
+
+    /* A forwarded guest port is pinned to the primary engine owning the rule. */
+    slirp_flow_add_forward(&s_Sel, false /*fUdp*/, uSecondaryPort);
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == 0);
+
+    /* ARP replies and announcements go everywhere, requests to the primary engine. */
+    cbFrame = tstNatFlowsBuildArpFrame(abFrame, RTNET_ARPOP_REPLY, TSTNATFLOWS_HOST_IP);
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == SLIRP_FLOW_ALL_ENGINES);
+    cbFrame = tstNatFlowsBuildArpFrame(abFrame, RTNET_ARPOP_REQUEST, TSTNATFLOWS_GUEST_IP);
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == SLIRP_FLOW_ALL_ENGINES);
+    cbFrame = tstNatFlowsBuildArpFrame(abFrame, RTNET_ARPOP_REQUEST, TSTNATFLOWS_HOST_IP);
+    RTTESTI_CHECK(slirp_flow_select(&s_Sel, abFrame, cbFrame) == 0);
+}
+
+
+/**
+ * Hands one frame to slirp the way the NAT driver does.
+ */
+static int tstNatFlowsInput(PNATState pNATState, uint8_t const *pbFrame, size_t cbFrame)
+{
+    void  *pvBuf;
+    size_t cbBuf;
+    struct mbuf *m = slirp_ext_m_get(pNATState, cbFrame, &pvBuf, &cbBuf);
+    if (!m)
+        return VERR_NO_MEMORY;
+    memcpy(pvBuf, pbFrame, cbFrame);
+    slirp_input(pNATState, m, cbFrame);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Opens @a cFlows flows on a new engine and times @a cFrames frames spread
+ * over all of them.
+ */
+static void tstNatFlowsRun(bool fTcp, uint32_t cFlows, uint32_t cFrames, uint16_t uHostPort)
+{
+    RTTestSubF(g_hTest, "%s, %u flows", fTcp ? "TCP" : "UDP", cFlows);
+
+    uint8_t *pabFrames = (uint8_t *)RTMemAlloc(cFlows * TSTNATFLOWS_FRAME_SIZE);
+    RTTESTI_CHECK_RETV(pabFrames != NULL);
+    size_t cbFrame = 0;
+    for (uint32_t iFlow = 0; iFlow < cFlows; iFlow++)
+        cbFrame = tstNatFlowsBuildFrame(&pabFrames[iFlow * TSTNATFLOWS_FRAME_SIZE], fTcp,
+                                        (uint16_t)(TSTNATFLOWS_GUEST_PORT + iFlow), uHostPort);
+
+    PNATState pNATState = NULL;
+    int rc = slirp_init(&pNATState, RT_H2N_U32_C(TSTNATFLOWS_NETWORK), TSTNATFLOWS_NETMASK,
+                        false /* fPassDomain */, true /* fUseHostResolver */, 0 /* aliasMode */,
+                        false /* fSecondary */, NULL);
+    if (RT_FAILURE(rc))
+    {
+        RTTestFailed(g_hTest, "slirp_init failed: %Rrc", rc);
+        RTMemFree(pabFrames);
+        return;
+    }
+    slirp_set_ethaddr_and_activate_port_forwarding(pNATState, g_GuestMac.au8, RT_H2N_U32_C(TSTNATFLOWS_GUEST_IP));
+    slirp_link_up(pNATState);
+    g_pNATState = pNATState;
+
+    /*
+     * Set up the flows.  The TCP ones stay half open as nobody polls the
+     * host sockets.
+     */
+    for (uint32_t iFlow = 0; iFlow < cFlows && RT_SUCCESS(rc); iFlow++)
+        rc = tstNatFlowsInput(pNATState, &pabFrames[iFlow * TSTNATFLOWS_FRAME_SIZE], cbFrame);
+    if (RT_SUCCESS(rc))
+    {
+        /*
+         * Round robin over the flows, each frame misses the last socket cache.
+         */
+        uint32_t const cFramesOut = g_cFramesOut;
+        uint64_t const nsStart    = RTTimeNanoTS();
+        for (uint32_t iFrame = 0; iFrame < cFrames && RT_SUCCESS(rc); iFrame++)
+            rc = tstNatFlowsInput(pNATState, &pabFrames[(iFrame % cFlows) * TSTNATFLOWS_FRAME_SIZE], cbFrame);
+        uint64_t const cNsElapsed = RTTimeNanoTS() - nsStart;
+
+        if (RT_SUCCESS(rc))
+        {
+            RTTestValueF(g_hTest, cNsElapsed / cFrames, RTTESTUNIT_NS_PER_FRAME, "%s, %u flows",
+                         fTcp ? "TCP" : "UDP", cFlows);
+            /* Resets or ICMP errors mean the flows didn't get set up. */
+            if (g_cFramesOut != cFramesOut)
+                RTTestFailed(g_hTest, "%u frames went back to the guest", g_cFramesOut - cFramesOut);
+        }
+    }
+    if (RT_FAILURE(rc))
+        RTTestFailed(g_hTest, "feeding the frames failed: %Rrc", rc);
+
+    slirp_term(pNATState);
+    g_pNATState = NULL;
+    RTMemFree(pabFrames);
+}
+
+#ifdef VBOX_WITH_NAT_EPOLL
+
+/**
+ * Accepts what is pending on the listener of the idle/busy benchmark.
+ */
+static void tstNatFlowsAccept(int hListener, int hHostEpoll, int *pahAccepted, uint32_t *pcAccepted, uint32_t cMax)
+{
+    while (*pcAccepted < cMax)
+    {
+        int hSock = accept(hListener, NULL, NULL);
+        if (hSock < 0)
+            break;
+        fcntl(hSock, F_SETFL, fcntl(hSock, F_GETFL) | O_NONBLOCK);
+        struct epoll_event Event;
+        RT_ZERO(Event);
+        Event.events  = EPOLLIN;
+        Event.data.fd = hSock;
+        epoll_ctl(hHostEpoll, EPOLL_CTL_ADD, hSock, &Event);
+        pahAccepted[(*pcAccepted)++] = hSock;
+    }
+}
+
+
+/**
+ * One round of the NAT thread the way DrvNAT runs it.
+ */
+static void tstNatFlowsNatRound(PNATState pNATState, unsigned cMillies)
+{
+    int  cFds = -1;
+    bool fWakeup;
+    slirp_select_fill(pNATState, &cFds);
+    int cEvents = slirp_select_wait(pNATState, cMillies, &fWakeup);
+    slirp_select_poll(pNATState, RT_MAX(cEvents, 0));
+}
+
+
+/**
+ * Opens @a cIdle + @a cBusy connections to the host on a new engine and times
+ * @a cRounds rounds of the NAT thread while the busy ones stream data.
+ *
+ * @param   cIdle       Number of connections which stay idle.
+ * @param   cBusy       Number of connections which send all the time.
+ * @param   cRounds     Number of rounds to time.
+ * @param   hListener   The host listener, non-blocking.
+ * @param   uHostPort   Its port.
+ */
+static void tstNatFlowsIdleBusy(uint32_t cIdle, uint32_t cBusy, uint32_t cRounds, int hListener, uint16_t uHostPort)
+{
+    uint32_t const cConns = cIdle + cBusy;
+    if (!cConns)
+        return;
+    RTTestSubF(g_hTest, "%u idle + %u busy connections", cIdle, cBusy);
+
+    int const hHostEpoll = epoll_create(64);
+    RTTESTI_CHECK_RETV(hHostEpoll >= 0);
+    int *pahAccepted = (int *)RTMemAlloc(cConns * sizeof(int));
+    uint8_t *pbFrame = (uint8_t *)RTMemAlloc(TSTNATFLOWS_SEGMENT_FRAME_SIZE);
+    g_paConns = (TSTNATFLOWSCONN *)RTMemAllocZ(cConns * sizeof(TSTNATFLOWSCONN));
+    if (!pahAccepted || !pbFrame || !g_paConns)
+    {
+        RTTestFailed(g_hTest, "out of memory");
+        RTMemFree(g_paConns);
+        g_paConns = NULL;
+        RTMemFree(pbFrame);
+        RTMemFree(pahAccepted);
+        close(hHostEpoll);
+        return;
+    }
+    g_cConns = cConns;
+    g_cConnResets = 0;
+    uint32_t cAccepted = 0;
+
+    PNATState pNATState = NULL;
+    int rc = slirp_init(&pNATState, RT_H2N_U32_C(TSTNATFLOWS_NETWORK), TSTNATFLOWS_NETMASK,
+                        false /* fPassDomain */, true /* fUseHostResolver */, 0 /* aliasMode */,
+                        false /* fSecondary */, NULL);
+    if (RT_SUCCESS(rc))
+    {
+        slirp_set_ethaddr_and_activate_port_forwarding(pNATState, g_GuestMac.au8, RT_H2N_U32_C(TSTNATFLOWS_GUEST_IP));
+        slirp_link_up(pNATState);
+        g_pNATState = pNATState;
+
+        /*
+         * Connect, a batch at a time so the listen backlog keeps up.  The
+         * busy connections come last.
+         */
+        uint64_t const msDeadline = RTTimeMilliTS() + RT_MAX(cConns, 1000) * 10;
+        for (uint32_t iFirst = 0; iFirst < cConns && RT_SUCCESS(rc); iFirst += 64)
+        {
+            uint32_t const iEnd = RT_MIN(iFirst + 64, cConns);
+            for (uint32_t iConn = iFirst; iConn < iEnd && RT_SUCCESS(rc); iConn++)
+            {
+                size_t cbFrame = tstNatFlowsBuildFrame(pbFrame, true /*fTcp*/, (uint16_t)(TSTNATFLOWS_GUEST_PORT + iConn), uHostPort);
+                g_paConns[iConn].uGuestSeq = ((uint32_t)(TSTNATFLOWS_GUEST_PORT + iConn) << 16) + 1;
+                rc = tstNatFlowsInput(pNATState, pbFrame, cbFrame);
+            }
+            for (uint32_t iConn = iFirst; iConn < iEnd && RT_SUCCESS(rc); iConn++)
+            {
+                while (!g_paConns[iConn].fSynAck && !g_cConnResets && RTTimeMilliTS() < msDeadline)
+                {
+                    tstNatFlowsNatRound(pNATState, 10);
+                    tstNatFlowsAccept(hListener, hHostEpoll, pahAccepted, &cAccepted, cConns);
+                }
+                if (!g_paConns[iConn].fSynAck)
+                {
+                    RTTestFailed(g_hTest, "connection %u wasn't set up (%u resets)", iConn, g_cConnResets);
+                    rc = VERR_TIMEOUT;
+                    break;
+                }
+                /* The handshake's ACK, the connection is established then. */
+                rc = tstNatFlowsInput(pNATState, pbFrame, tstNatFlowsBuildSegment(pbFrame, iConn, uHostPort, 0));
+            }
+        }
+        while (RT_SUCCESS(rc) && cAccepted < cConns && RTTimeMilliTS() < msDeadline)
+        {
+            tstNatFlowsNatRound(pNATState, 10);
+            tstNatFlowsAccept(hListener, hHostEpoll, pahAccepted, &cAccepted, cConns);
+        }
+        if (RT_SUCCESS(rc) && cAccepted < cConns)
+        {
+            RTTestFailed(g_hTest, "only %u of %u connections were accepted", cAccepted, cConns);
+            rc = VERR_TIMEOUT;
+        }
+
+        if (RT_SUCCESS(rc))
+        {
+            /* Settle: let the delayed ACKs and the slow timer go by once. */
+            for (unsigned i = 0; i < 4; i++)
+                tstNatFlowsNatRound(pNATState, 200);
+
+            /*
+             * The timed rounds: every busy connection sends a segment if its
+             * window allows, the NAT thread runs and the host drains.
+             */
+            uint64_t cbReceived = 0;
+            uint64_t const nsStart = RTTimeNanoTS();
+            for (uint32_t iRound = 0; iRound < cRounds && RT_SUCCESS(rc); iRound++)
+            {
+                for (uint32_t iConn = cIdle; iConn < cConns && RT_SUCCESS(rc); iConn++)
+                {
+                    TSTNATFLOWSCONN *pConn = &g_paConns[iConn];
+                    if (pConn->uGuestSeq - pConn->uAcked >= TSTNATFLOWS_IN_FLIGHT)
+                        continue;
+                    rc = tstNatFlowsInput(pNATState, pbFrame, tstNatFlowsBuildSegment(pbFrame, iConn, uHostPort, TSTNATFLOWS_SEGMENT));
+                    pConn->uGuestSeq += TSTNATFLOWS_SEGMENT;
+                }
+                tstNatFlowsNatRound(pNATState, 0);
+
+                struct epoll_event aEvents[64];
+                int cEvents = epoll_wait(hHostEpoll, aEvents, RT_ELEMENTS(aEvents), 0);
+                for (int i = 0; i < cEvents; i++)
+                {
+                    static uint8_t s_abBuf[_64K];
+                    ssize_t cbRead;
+                    while ((cbRead = recv(aEvents[i].data.fd, s_abBuf, sizeof(s_abBuf), 0)) > 0)
+                        cbReceived += cbRead;
+                }
+            }
+            uint64_t const cNsElapsed = RTTimeNanoTS() - nsStart;
+
+            if (RT_SUCCESS(rc))
+            {
+                RTTestValueF(g_hTest, cNsElapsed / cRounds, RTTESTUNIT_NS_PER_CALL, "Round, %u idle + %u busy", cIdle, cBusy);
+                if (cBusy)
+                {
+                    RTTestValueF(g_hTest, cbReceived / cRounds, RTTESTUNIT_BYTES, "Host received per round, %u idle + %u busy",
+                                 cIdle, cBusy);
+                    if (!cbReceived)
+                        RTTestFailed(g_hTest, "nothing reached the host");
+                }
+                if (g_cConnResets)
+                    RTTestFailed(g_hTest, "slirp reset %u connections", g_cConnResets);
+            }
+        }
+        if (RT_FAILURE(rc) && rc != VERR_TIMEOUT)
+            RTTestFailed(g_hTest, "feeding the frames failed: %Rrc", rc);
+
+        slirp_term(pNATState);
+        g_pNATState = NULL;
+    }
+    else
+        RTTestFailed(g_hTest, "slirp_init failed: %Rrc", rc);
+
+    for (uint32_t i = 0; i < cAccepted; i++)
+        close(pahAccepted[i]);
+    close(hHostEpoll);
+    RTMemFree(g_paConns);
+    g_paConns = NULL;
+    g_cConns = 0;
+    RTMemFree(pbFrame);
+    RTMemFree(pahAccepted);
+}
+
+#endif /* VBOX_WITH_NAT_EPOLL */
+
+
+int main(int argc, char **argv)
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstNatFlows", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    static RTGETOPTDEF const s_aOptions[] =
+    {
+        { "--flows",        'f', RTGETOPT_REQ_UINT32  },
+        { "--frames",       'n', RTGETOPT_REQ_UINT32  },
+        { "--port",         'p', RTGETOPT_REQ_UINT32  },
+        { "--busy",         'b', RTGETOPT_REQ_UINT32  },
+        { "--rounds",       'r', RTGETOPT_REQ_UINT32  },
+    };
+
+    uint32_t cMaxFlows = 512;
+    uint32_t cFrames   = TSTNATFLOWS_FRAMES;
+    uint32_t uPort     = TSTNATFLOWS_PORT;
+    uint32_t cBusy     = 4;
+    uint32_t cRounds   = TSTNATFLOWS_ROUNDS;
+
+    int ch;
+    RTGETOPTUNION Value;
+    RTGETOPTSTATE GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0 /* fFlags */);
+    while ((ch = RTGetOpt(&GetState, &Value)))
+    {
+        switch (ch)
+        {
+            case 'f': cMaxFlows = RT_MIN(RT_MAX(Value.u32, 1), 32768); break;
+            case 'n': cFrames = RT_MAX(Value.u32, 1); break;
+            case 'p': uPort = Value.u32; break;
+            case 'b': cBusy = RT_MIN(Value.u32, 1024); break;
+            case 'r': cRounds = RT_MAX(Value.u32, 1); break;
+
+            case 'h':
+                RTPrintf("Usage: tstNatFlows [--flows <max>] [--frames <count>] [--port <port>]\n"
+                         "                   [--busy <count>] [--rounds <count>]\n"
+                         "Times %u frames (--frames) through slirp_input for 1, 8, 64, ... flows up to\n"
+                         "--flows, which defaults to 512.  Every flow holds a host socket, mind the\n"
+                         "descriptor limit.  The host end listens on 127.0.0.1:%u (--port).\n"
+                         "With the epoll loop it then times %u rounds (--rounds) of the NAT thread\n"
+                         "with 4 busy connections (--busy) and 0, 8, 64, ... idle ones up to --flows,\n"
+                         "the host end of those listens on the next port.\n",
+                         TSTNATFLOWS_FRAMES, TSTNATFLOWS_PORT, TSTNATFLOWS_ROUNDS);
+                return RTEXITCODE_SUCCESS;
+
+            default:
+                return RTGetOptPrintError(ch, &Value);
+        }
+    }
+
+    /*
+     * The host ends.  Nobody reads from them, the kernel drops the datagrams
+     * once the receive buffer is full and the listener never accepts.
+     */
+    PRTUDPSERVER pUdpSink = NULL;
+    int rc = RTUdpServerCreateEx("127.0.0.1", uPort, &pUdpSink);
+    if (RT_FAILURE(rc))
+    {
+        RTTestFailed(g_hTest, "RTUdpServerCreateEx failed: %Rrc", rc);
+        return RTTestSummaryAndDestroy(g_hTest);
+    }
+    PRTTCPSERVER pTcpListener = NULL;
+    rc = RTTcpServerCreateEx("127.0.0.1", uPort, &pTcpListener);
+    if (RT_FAILURE(rc))
+    {
+        RTTestFailed(g_hTest, "RTTcpServerCreateEx failed: %Rrc", rc);
+        RTUdpServerDestroy(pUdpSink);
+        return RTTestSummaryAndDestroy(g_hTest);
+    }
+
+    tstNatFlowsSelect();
+
+    for (unsigned iProto = 0; iProto < 2; iProto++)
+        for (uint32_t cFlows = 1; ; cFlows *= 8)
+        {
+            tstNatFlowsRun(iProto != 0, RT_MIN(cFlows, cMaxFlows), cFrames, (uint16_t)uPort);
+            if (cFlows >= cMaxFlows)
+                break;
+        }
+
+#ifdef VBOX_WITH_NAT_EPOLL
+    /*
+     * Idle and busy connections.  Each takes two descriptors, slirp's and the
+     * accepted one, so raise the limit as far as we may.
+     */
+    struct rlimit Limit;
+    if (getrlimit(RLIMIT_NOFILE, &Limit) == 0 && Limit.rlim_cur < Limit.rlim_max)
+    {
+        Limit.rlim_cur = Limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &Limit);
+    }
+    int hListener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in ListenAddr;
+    RT_ZERO(ListenAddr);
+    ListenAddr.sin_family      = AF_INET;
+    ListenAddr.sin_port        = RT_H2N_U16((uint16_t)(uPort + 1));
+    ListenAddr.sin_addr.s_addr = RT_H2N_U32_C(INADDR_LOOPBACK);
+    int fReuse = 1;
+    if (   hListener >= 0
+        && setsockopt(hListener, SOL_SOCKET, SO_REUSEADDR, &fReuse, sizeof(fReuse)) == 0
+        && bind(hListener, (struct sockaddr *)&ListenAddr, sizeof(ListenAddr)) == 0
+        && listen(hListener, SOMAXCONN) == 0)
+    {
+        fcntl(hListener, F_SETFL, fcntl(hListener, F_GETFL) | O_NONBLOCK);
+        for (uint32_t cIdle = 0; ; cIdle = cIdle ? cIdle * 8 : 8)
+        {
+            tstNatFlowsIdleBusy(RT_MIN(cIdle, cMaxFlows), cBusy, cRounds, hListener, (uint16_t)(uPort + 1));
+            if (cIdle >= cMaxFlows)
+                break;
+        }
+    }
+    else
+        RTTestFailed(g_hTest, "listening on 127.0.0.1:%u failed: errno=%d", uPort + 1, errno);
+    if (hListener >= 0)
+        close(hListener);
+#endif
+
+    RTTcpServerDestroy(pTcpListener);
+    RTUdpServerDestroy(pUdpSink);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
+
@@ -0,0 +1,1165 @@
+/* $Id$ */
+/** @file
+ * VBox - Testcase for the lwIP TCP engine of the NAT driver, with a
+ *        comparison against slirp.
+ *
+ * A minimal guest TCP in this process talks to the engines through their
+ * frame interfaces, the host end is a loopback listener.  The first part
+ * checks the proxying and the window scaling of the lwIP engine: connections
+ * to the host alias end up at 127.0.0.1, data goes both ways, the window is
+ * scaled only if the guest asked for it and a connection nobody accepts on
+ * the host is reset.  The second part measures the bulk guest to host
+ * throughput, the round trip latency and the connection setup rate of lwIP
+ * and of slirp the same way, so the numbers can be put side by side.  Unlike
+ * tstNetBench there is no VM, the device emulation and the guest's stack are
+ * left out.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include "../slirp/libslirp.h"
+#include "../DrvNATlwIP.h"
+
+#include <iprt/test.h>
+#include <iprt/assert.h>
+#include <iprt/err.h>
+#include <iprt/getopt.h>
+#include <iprt/mem.h>
+#include <iprt/net.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The NAT network, 10.0.2.0/24, host byte order. */
+#define TSTNATLWIP_NETWORK          UINT32_C(0x0a000200)
+/** The NAT netmask. */
+#define TSTNATLWIP_NETMASK          UINT32_C(0xffffff00)
+/** The guest address, host byte order. */
+#define TSTNATLWIP_GUEST_IP         UINT32_C(0x0a00020f)
+/** The alias of the host loopback, host byte order. */
+#define TSTNATLWIP_HOST_IP          UINT32_C(0x0a000202)
+/** The MSS the guest offers. */
+#define TSTNATLWIP_GUEST_MSS        1460
+/** The window scale the guest offers. */
+#define TSTNATLWIP_GUEST_WND_SHIFT  7
+/** The size of the buffer the frames to the engines are built in. */
+#define TSTNATLWIP_FRAME_MAX        2048
+/** The number of frames from the engines which can be queued for the guest. */
+#define TSTNATLWIP_QUEUE_SIZE       8192
+/** How long to wait for the engine or the host, in milliseconds. */
+#define TSTNATLWIP_TIMEOUT_MS       5000
+/** How long the guest waits for an ACK before sending everything
+ * unacknowledged again, in milliseconds. */
+#define TSTNATLWIP_RTO_MS           200
+/** The size of a round trip message. */
+#define TSTNATLWIP_PING_SIZE        64
+/** The default bulk transfer size in megabytes. */
+#define TSTNATLWIP_BULK_MB          64
+/** The default number of round trips. */
+#define TSTNATLWIP_ROUND_TRIPS      10000
+/** The default number of connections set up. */
+#define TSTNATLWIP_CONNECTS         1000
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * One of the engines under test.
+ */
+typedef struct TSTNATLWIPENGINE
+{
+    /** The name, as in the TcpEngine setting. */
+    const char     *pszName;
+    /** Creates the engine. */
+    int           (*pfnCreate)(void);
+    /** Destroys the engine. */
+    void          (*pfnDestroy)(void);
+    /** Hands a guest frame to the engine. */
+    void          (*pfnInput)(uint8_t const *pbFrame, size_t cbFrame);
+    /** Runs the engine for one round, waiting at most @a cMillies. */
+    void          (*pfnPoll)(RTMSINTERVAL cMillies);
+} TSTNATLWIPENGINE;
+/** Pointer to a const engine. */
+typedef TSTNATLWIPENGINE const *PCTSTNATLWIPENGINE;
+
+/**
+ * The guest end of a TCP connection.  Only what the tests need: one stream of
+ * filler data to the host with go-back-N retransmission, and in order data
+ * from the host.
+ */
+typedef struct TSTNATLWIPCONN
+{
+    /** The guest port. */
+    uint16_t        uGuestPort;
+    /** The host port. */
+    uint16_t        uHostPort;
+    /** Whether the guest offers window scaling. */
+    bool            fOfferWndScale;
+    /** Got the SYN|ACK. */
+    bool            fSynAck;
+    /** Got a reset. */
+    bool            fRst;
+    /** Got a FIN. */
+    bool            fFin;
+    /** An ACK has to go out. */
+    bool            fAckPending;
+    /** Whether the SYN|ACK had a window scale option. */
+    bool            fWndScale;
+    /** The shift of the engine's window, 0 unless both sides agreed on
+     * scaling. */
+    uint8_t         cSndWndShift;
+    /** The MSS of the engine. */
+    uint16_t        cbMss;
+    /** The initial send sequence number. */
+    uint32_t        uSndIss;
+    /** The oldest unacknowledged sequence number. */
+    uint32_t        uSndUna;
+    /** The next sequence number to send. */
+    uint32_t        uSndNxt;
+    /** The highest sequence number sent so far. */
+    uint32_t        uSndMax;
+    /** The window of the engine, scaled. */
+    uint32_t        cbSndWnd;
+    /** The next sequence number expected from the engine. */
+    uint32_t        uRcvNxt;
+    /** When the last ACK making progress came in (or we started sending). */
+    uint64_t        msLastAck;
+    /** Number of times everything unacknowledged was sent again. */
+    uint32_t        cRetransmits;
+    /** Number of bytes received from the host. */
+    uint64_t        cbRcvd;
+    /** The first bytes received from the host. */
+    uint8_t         abRcvd[64];
+} TSTNATLWIPCONN;
+/** Pointer to the guest end of a connection. */
+typedef TSTNATLWIPCONN *PTSTNATLWIPCONN;
+
+/**
+ * A frame from the engine for the guest.
+ */
+typedef struct TSTNATLWIPFRAME
+{
+    /** The frame, allocated by RTMemAlloc. */
+    uint8_t        *pbFrame;
+    /** The size of the frame. */
+    size_t          cbFrame;
+} TSTNATLWIPFRAME;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+static RTTEST           g_hTest;
+/** The guest MAC address. */
+static RTMAC const      g_GuestMac = { { 0x08, 0x00, 0x27, 0x00, 0x00, 0x01 } };
+/** The lwIP engine. */
+static PDRVNATLWIP      g_pLwIP;
+/** The slirp engine. */
+static PNATState        g_pNATState;
+/** The frames for the guest. */
+static TSTNATLWIPFRAME  g_aFrames[TSTNATLWIP_QUEUE_SIZE];
+/** The oldest frame in g_aFrames. */
+static uint32_t         g_iFrameHead;
+/** Number of frames in g_aFrames. */
+static uint32_t         g_cFrames;
+/** Filler data sent by the guest. */
+static uint8_t          g_abFiller[TSTNATLWIP_GUEST_MSS];
+/** The host listener. */
+static int              g_hListen = -1;
+/** The last connection accepted on the host. */
+static int              g_hHostConn = -1;
+/** Number of connections accepted on the host. */
+static uint32_t         g_cHostAccepted;
+/** Whether the host echoes what it receives. */
+static bool             g_fHostEcho;
+/** Number of bytes the host received on the current connection. */
+static uint64_t         g_cbHostRcvd;
+/** The first bytes the host received on the current connection. */
+static uint8_t          g_abHostRcvd[64];
+/** The host receive buffer. */
+static uint8_t          g_abHostBuf[_64K];
+
+
+/**
+ * DevINIP is not linked in, lwIP is all ours.
+ */
+bool DevINIPConfigured(void)
+{
+    return false;
+}
+
+
+/**
+ * Queues a frame from the engine for the guest.
+ *
+ * @param   pbFrame     The frame, allocated by RTMemAlloc.  Consumed.
+ * @param   cbFrame     The size of the frame.
+ */
+static void tstNatLwIPQueueFrame(uint8_t *pbFrame, size_t cbFrame)
+{
+    if (g_cFrames >= TSTNATLWIP_QUEUE_SIZE)
+    {
+        /* Like a full device queue, the guest retransmits. */
+        RTMemFree(pbFrame);
+        return;
+    }
+    TSTNATLWIPFRAME *pFrame = &g_aFrames[(g_iFrameHead + g_cFrames) % TSTNATLWIP_QUEUE_SIZE];
+    pFrame->pbFrame = pbFrame;
+    pFrame->cbFrame = cbFrame;
+    g_cFrames++;
+}
+
+
+/**
+ * Drops the frames nobody picked up.
+ */
+static void tstNatLwIPFlushFrames(void)
+{
+    while (g_cFrames)
+    {
+        RTMemFree(g_aFrames[g_iFrameHead].pbFrame);
+        g_iFrameHead = (g_iFrameHead + 1) % TSTNATLWIP_QUEUE_SIZE;
+        g_cFrames--;
+    }
+}
+
+
+/**
+ * Copies a frame from slirp to the guest queue.
+ */
+static void tstNatLwIPSlirpOutput(struct mbuf *m, const uint8_t *pu8Buf, int cb)
+{
+    uint8_t *pbFrame = (uint8_t *)RTMemDup(pu8Buf, cb);
+    slirp_ext_m_free(g_pNATState, m, (uint8_t *)pu8Buf);
+    if (pbFrame)
+        tstNatLwIPQueueFrame(pbFrame, cb);
+}
+
+
+/** slirp's hooks */
+extern "C" int slirp_can_output(void *pvUser)
+{
+    NOREF(pvUser);
+    return 1;
+}
+
+extern "C" void slirp_urg_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
+{
+    NOREF(pvUser);
+    tstNatLwIPSlirpOutput(m, pu8Buf, cb);
+}
+
+extern "C" void slirp_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
+{
+    NOREF(pvUser);
+    tstNatLwIPSlirpOutput(m, pu8Buf, cb);
+}
+
+extern "C" void slirp_output_pending(void *pvUser)
+{
+    NOREF(pvUser);
+}
+
+extern "C" void slirp_wakeup_nat_thread(void *pvUser)
+{
+    NOREF(pvUser);
+}
+
+
+/**
+ * @interface_method_impl{TSTNATLWIPENGINE,pfnCreate, slirp}
+ */
+static int tstNatLwIPSlirpCreate(void)
+{
+    int rc = slirp_init(&g_pNATState, RT_H2N_U32_C(TSTNATLWIP_NETWORK), TSTNATLWIP_NETMASK,
+                        false /* fPassDomain */, true /* fUseHostResolver */, 0 /* aliasMode */,
+                        false /* fSecondary */, NULL);
+    if (RT_SUCCESS(rc))
+    {
+        slirp_set_ethaddr_and_activate_port_forwarding(g_pNATState, g_GuestMac.au8, RT_H2N_U32_C(TSTNATLWIP_GUEST_IP));
+        slirp_link_up(g_pNATState);
+    }
+    return rc;
+}
+
+
+/**
+ * @interface_method_impl{TSTNATLWIPENGINE,pfnDestroy, slirp}
+ */
+static void tstNatLwIPSlirpDestroy(void)
+{
+    slirp_term(g_pNATState);
+    g_pNATState = NULL;
+}
+
+
+/**
+ * @interface_method_impl{TSTNATLWIPENGINE,pfnInput, slirp}
+ */
+static void tstNatLwIPSlirpInput(uint8_t const *pbFrame, size_t cbFrame)
+{
+    void  *pvBuf;
+    size_t cbBuf;
+    struct mbuf *m = slirp_ext_m_get(g_pNATState, cbFrame, &pvBuf, &cbBuf);
+    if (!m)
+        return;
+    memcpy(pvBuf, pbFrame, cbFrame);
+    slirp_input(g_pNATState, m, cbFrame);
+}
+
+
+/**
+ * @interface_method_impl{TSTNATLWIPENGINE,pfnPoll, slirp}
+ *
+ * The same steps as the NAT thread of the driver.
+ */
+static void tstNatLwIPSlirpPoll(RTMSINTERVAL cMillies)
+{
+    RTMSINTERVAL cMsTimeout = RT_MIN(cMillies, slirp_get_timeout_ms(g_pNATState));
+#if defined(VBOX_WITH_NAT_EPOLL)
+    int nFDs = -1;
+    slirp_select_fill(g_pNATState, &nFDs);
+    bool fWakeup = false;
+    int cEvents = slirp_select_wait(g_pNATState, cMsTimeout, &fWakeup);
+    if (cEvents >= 0)
+        slirp_select_poll(g_pNATState, cEvents);
+#else
+    int nFDs = slirp_get_nsock(g_pNATState);
+    struct pollfd *paPolls = (struct pollfd *)RTMemAlloc((1 + nFDs) * sizeof(struct pollfd));
+    if (!paPolls)
+        return;
+    slirp_select_fill(g_pNATState, &nFDs, paPolls);
+    if (poll(paPolls, nFDs, (int)cMsTimeout) >= 0)
+        slirp_select_poll(g_pNATState, paPolls, nFDs);
+    RTMemFree(paPolls);
+#endif
+}
+
+
+/**
+ * Output callback of the lwIP engine, see FNDRVNATLWIPOUTPUT.
+ */
+static DECLCALLBACK(void) tstNatLwIPOutput(void *pvUser, void *pvFrame, size_t cbFrame, uint16_t cbMaxSeg)
+{
+    NOREF(pvUser); NOREF(cbMaxSeg);
+    tstNatLwIPQueueFrame((uint8_t *)pvFrame, cbFrame);
+}
+
+
+/**
+ * @interface_method_impl{TSTNATLWIPENGINE,pfnCreate, lwIP}
+ */
+static int tstNatLwIPLwIPCreate(void)
+{
+    DRVNATLWIPCFG Cfg;
+    RT_ZERO(Cfg);
+    Cfg.Network       = TSTNATLWIP_NETWORK;
+    Cfg.Netmask       = TSTNATLWIP_NETMASK;
+    Cfg.pszBindIP     = NULL;
+    Cfg.fLargeReceive = false;
+    Cfg.pfnOutput     = tstNatLwIPOutput;
+    Cfg.pvUser        = NULL;
+    int rc = DrvNATlwIPCreate(&g_pLwIP, &Cfg);
+    if (RT_SUCCESS(rc))
+        DrvNATlwIPSetGuestMac(g_pLwIP, &g_GuestMac);
+    return rc;
+}
+
+
+/**
+ * @interface_method_impl{TSTNATLWIPENGINE,pfnDestroy, lwIP}
+ */
+static void tstNatLwIPLwIPDestroy(void)
+{
+    DrvNATlwIPDestroy(g_pLwIP);
+    g_pLwIP = NULL;
+}
+
+
+/**
+ * @interface_method_impl{TSTNATLWIPENGINE,pfnInput, lwIP}
+ */
+static void tstNatLwIPLwIPInput(uint8_t const *pbFrame, size_t cbFrame)
+{
+    DrvNATlwIPInput(g_pLwIP, pbFrame, cbFrame, NULL);
+}
+
+
+/**
+ * @interface_method_impl{TSTNATLWIPENGINE,pfnPoll, lwIP}
+ */
+static void tstNatLwIPLwIPPoll(RTMSINTERVAL cMillies)
+{
+    int rc = DrvNATlwIPPoll(g_pLwIP, cMillies);
+    if (RT_FAILURE(rc))
+        RTTestFailed(g_hTest, "DrvNATlwIPPoll failed: %Rrc", rc);
+}
+
+
+/** The engines, lwIP first as the functional tests run on it. */
+static TSTNATLWIPENGINE const g_aEngines[] =
+{
+    { "lwip",  tstNatLwIPLwIPCreate, tstNatLwIPLwIPDestroy, tstNatLwIPLwIPInput, tstNatLwIPLwIPPoll },
+    { "slirp", tstNatLwIPSlirpCreate, tstNatLwIPSlirpDestroy, tstNatLwIPSlirpInput, tstNatLwIPSlirpPoll },
+};
+
+
+/**
+ * Sends a TCP segment from the guest.
+ *
+ * @param   pEngine     The engine.
+ * @param   pConn       The connection.
+ * @param   uSeq        The sequence number.
+ * @param   fFlags      The TCP flags.  The SYN carries the MSS and, if
+ *                      offered, the window scale options.
+ * @param   pvData      The payload.
+ * @param   cbData      The size of the payload.
+ */
+static void tstNatLwIPGuestSend(PCTSTNATLWIPENGINE pEngine, PTSTNATLWIPCONN pConn, uint32_t uSeq, uint8_t fFlags,
+                                void const *pvData, size_t cbData)
+{
+    uint8_t abFrame[TSTNATLWIP_FRAME_MAX];
+    size_t const cbOpts = fFlags & RTNETTCP_F_SYN ? (pConn->fOfferWndScale ? 8 : 4) : 0;
+    size_t const cbTcp  = sizeof(RTNETTCP) + cbOpts + cbData;
+    AssertReturnVoid(sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + cbTcp <= sizeof(abFrame));
+    memset(abFrame, 0, sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + sizeof(RTNETTCP) + cbOpts);
+
+    PRTNETETHERHDR pEth = (PRTNETETHERHDR)abFrame;
+    memset(&pEth->DstMac, 0xff, sizeof(pEth->DstMac));
+    pEth->SrcMac    = g_GuestMac;
+    pEth->EtherType = RT_H2N_U16_C(RTNET_ETHERTYPE_IPV4);
+
+    PRTNETIPV4 pIpHdr = (PRTNETIPV4)(pEth + 1);
+    pIpHdr->ip_v        = 4;
+    pIpHdr->ip_hl       = RTNETIPV4_MIN_LEN / 4;
+    pIpHdr->ip_len      = RT_H2N_U16((uint16_t)(RTNETIPV4_MIN_LEN + cbTcp));
+    pIpHdr->ip_ttl      = 64;
+    pIpHdr->ip_p        = RTNETIPV4_PROT_TCP;
+    pIpHdr->ip_src.u    = RT_H2N_U32_C(TSTNATLWIP_GUEST_IP);
+    pIpHdr->ip_dst.u    = RT_H2N_U32_C(TSTNATLWIP_HOST_IP);
+    pIpHdr->ip_sum      = RTNetIPv4HdrChecksum(pIpHdr);
+
+    PRTNETTCP pTcpHdr = (PRTNETTCP)((uint8_t *)pIpHdr + RTNETIPV4_MIN_LEN);
+    pTcpHdr->th_sport   = RT_H2N_U16(pConn->uGuestPort);
+    pTcpHdr->th_dport   = RT_H2N_U16(pConn->uHostPort);
+    pTcpHdr->th_seq     = RT_H2N_U32(uSeq);
+    pTcpHdr->th_ack     = fFlags & RTNETTCP_F_ACK ? RT_H2N_U32(pConn->uRcvNxt) : 0;
+    pTcpHdr->th_off     = (uint8_t)((sizeof(RTNETTCP) + cbOpts) / 4);
+    pTcpHdr->th_flags   = fFlags;
+    pTcpHdr->th_win     = RT_H2N_U16_C(0xffff); /* scaled or not, we always keep up */
+
+    uint8_t *pbOpts = (uint8_t *)(pTcpHdr + 1);
+    if (cbOpts)
+    {
+        pbOpts[0] = 2; /* MSS */
+        pbOpts[1] = 4;
+        pbOpts[2] = RT_HIBYTE(TSTNATLWIP_GUEST_MSS);
+        pbOpts[3] = RT_LOBYTE(TSTNATLWIP_GUEST_MSS);
+        if (pConn->fOfferWndScale)
+        {
+            pbOpts[4] = 1; /* NOP */
+            pbOpts[5] = 3; /* window scale */
+            pbOpts[6] = 3;
+            pbOpts[7] = TSTNATLWIP_GUEST_WND_SHIFT;
+        }
+    }
+    if (cbData)
+        memcpy(pbOpts + cbOpts, pvData, cbData);
+    pTcpHdr->th_sum     = RTNetIPv4TCPChecksum(pIpHdr, pTcpHdr, NULL);
+
+    pEngine->pfnInput(abFrame, sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + cbTcp);
+}
+
+
+/**
+ * Answers an ARP request for the guest address.
+ */
+static void tstNatLwIPGuestArp(PCTSTNATLWIPENGINE pEngine, uint8_t const *pbFrame, size_t cbFrame)
+{
+    if (cbFrame < sizeof(RTNETETHERHDR) + sizeof(RTNETARPIPV4))
+        return;
+    PCRTNETARPIPV4 pReq = (PCRTNETARPIPV4)((PCRTNETETHERHDR)pbFrame + 1);
+    if (   pReq->Hdr.ar_oper != RT_H2N_U16_C(RTNET_ARPOP_REQUEST)
+        || pReq->ar_tpa.u    != RT_H2N_U32_C(TSTNATLWIP_GUEST_IP))
+        return;
+
+    uint8_t abFrame[sizeof(RTNETETHERHDR) + sizeof(RTNETARPIPV4)];
+    PRTNETETHERHDR pEth = (PRTNETETHERHDR)abFrame;
+    pEth->DstMac    = pReq->ar_sha;
+    pEth->SrcMac    = g_GuestMac;
+    pEth->EtherType = RT_H2N_U16_C(RTNET_ETHERTYPE_ARP);
+
+    PRTNETARPIPV4 pReply = (PRTNETARPIPV4)(pEth + 1);
+    pReply->Hdr         = pReq->Hdr;
+    pReply->Hdr.ar_oper = RT_H2N_U16_C(RTNET_ARPOP_REPLY);
+    pReply->ar_sha      = g_GuestMac;
+    pReply->ar_spa      = pReq->ar_tpa;
+    pReply->ar_tha      = pReq->ar_sha;
+    pReply->ar_tpa      = pReq->ar_spa;
+    pEngine->pfnInput(abFrame, sizeof(abFrame));
+}
+
+
+/**
+ * Picks the MSS and the window scale out of the options of the SYN|ACK.
+ */
+static void tstNatLwIPGuestParseOpts(PTSTNATLWIPCONN pConn, uint8_t const *pbOpts, size_t cbOpts)
+{
+    size_t off = 0;
+    while (off < cbOpts)
+    {
+        uint8_t const bKind = pbOpts[off];
+        if (bKind == 0 /* end */)
+            break;
+        if (bKind == 1 /* NOP */)
+        {
+            off++;
+            continue;
+        }
+        if (off + 1 >= cbOpts || pbOpts[off + 1] < 2 || off + pbOpts[off + 1] > cbOpts)
+            break;
+        if (bKind == 2 /* MSS */ && pbOpts[off + 1] == 4)
+            pConn->cbMss = RT_MAKE_U16(pbOpts[off + 3], pbOpts[off + 2]);
+        else if (bKind == 3 /* window scale */ && pbOpts[off + 1] == 3)
+        {
+            pConn->fWndScale = true;
+            if (pConn->fOfferWndScale)
+                pConn->cSndWndShift = RT_MIN(pbOpts[off + 2], 14);
+        }
+        off += pbOpts[off + 1];
+    }
+}
+
+
+/**
+ * Processes a frame from the engine.
+ */
+static void tstNatLwIPGuestRecv(PCTSTNATLWIPENGINE pEngine, PTSTNATLWIPCONN pConn, uint8_t const *pbFrame, size_t cbFrame)
+{
+    if (cbFrame < sizeof(RTNETETHERHDR))
+        return;
+    PCRTNETETHERHDR pEth = (PCRTNETETHERHDR)pbFrame;
+    if (pEth->EtherType == RT_H2N_U16_C(RTNET_ETHERTYPE_ARP))
+    {
+        tstNatLwIPGuestArp(pEngine, pbFrame, cbFrame);
+        return;
+    }
+    if (   pEth->EtherType != RT_H2N_U16_C(RTNET_ETHERTYPE_IPV4)
+        || cbFrame < sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN)
+        return;
+
+    PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)(pEth + 1);
+    size_t const cbIpHdr = pIpHdr->ip_hl * 4;
+    size_t const cbIp    = RT_MIN(RT_N2H_U16(pIpHdr->ip_len), cbFrame - sizeof(RTNETETHERHDR));
+    if (   pIpHdr->ip_p != RTNETIPV4_PROT_TCP
+        || cbIpHdr < RTNETIPV4_MIN_LEN
+        || cbIp < cbIpHdr + RTNETTCP_MIN_LEN)
+        return;
+    PCRTNETTCP pTcpHdr = (PCRTNETTCP)((uint8_t const *)pIpHdr + cbIpHdr);
+    size_t const cbTcpHdr = pTcpHdr->th_off * 4;
+    if (   cbTcpHdr < RTNETTCP_MIN_LEN
+        || cbIpHdr + cbTcpHdr > cbIp
+        || !pConn
+        || RT_N2H_U16(pTcpHdr->th_dport) != pConn->uGuestPort)
+        return;
+
+    uint8_t const  fFlags = pTcpHdr->th_flags;
+    uint32_t const uSeq   = RT_N2H_U32(pTcpHdr->th_seq);
+    uint32_t const uAck   = RT_N2H_U32(pTcpHdr->th_ack);
+    size_t const   cbData = cbIp - cbIpHdr - cbTcpHdr;
+
+    if (fFlags & RTNETTCP_F_RST)
+    {
+        pConn->fRst = true;
+        return;
+    }
+    if (fFlags & RTNETTCP_F_SYN)
+    {
+        if (!(fFlags & RTNETTCP_F_ACK) || pConn->fSynAck)
+            return;
+        pConn->fSynAck     = true;
+        pConn->uRcvNxt     = uSeq + 1;
+        pConn->uSndUna     = uAck;
+        pConn->cbMss       = 536;
+        tstNatLwIPGuestParseOpts(pConn, (uint8_t const *)(pTcpHdr + 1), cbTcpHdr - sizeof(RTNETTCP));
+        pConn->cbMss       = RT_MIN(pConn->cbMss, TSTNATLWIP_GUEST_MSS);
+        pConn->cbSndWnd    = RT_N2H_U16(pTcpHdr->th_win); /* never scaled in a SYN */
+        pConn->fAckPending = true;
+        return;
+    }
+    if (!pConn->fSynAck)
+        return;
+
+    if (fFlags & RTNETTCP_F_ACK)
+    {
+        if (   (int32_t)(uAck - pConn->uSndUna) > 0
+            && (int32_t)(uAck - pConn->uSndMax) <= 0)
+        {
+            pConn->uSndUna   = uAck;
+            pConn->msLastAck = RTTimeMilliTS();
+            if ((int32_t)(uAck - pConn->uSndNxt) > 0)
+                pConn->uSndNxt = uAck;
+        }
+        pConn->cbSndWnd = (uint32_t)RT_N2H_U16(pTcpHdr->th_win) << pConn->cSndWndShift;
+    }
+
+    if (cbData || (fFlags & RTNETTCP_F_FIN))
+    {
+        if (uSeq == pConn->uRcvNxt)
+        {
+            if (pConn->cbRcvd < sizeof(pConn->abRcvd))
+                memcpy(&pConn->abRcvd[pConn->cbRcvd], (uint8_t const *)pTcpHdr + cbTcpHdr,
+                       RT_MIN(cbData, sizeof(pConn->abRcvd) - pConn->cbRcvd));
+            pConn->cbRcvd  += cbData;
+            pConn->uRcvNxt += (uint32_t)cbData;
+            if (fFlags & RTNETTCP_F_FIN)
+            {
+                pConn->uRcvNxt++;
+                pConn->fFin = true;
+            }
+        }
+        pConn->fAckPending = true;
+    }
+}
+
+
+/**
+ * Sends as much of the guest's stream of filler data as the window of the
+ * engine allows.  If nothing was acknowledged for a while, everything
+ * unacknowledged goes out again.
+ *
+ * @param   pEngine     The engine.
+ * @param   pConn       The connection.
+ * @param   cbStream    The size of the stream so far.
+ */
+static void tstNatLwIPGuestPush(PCTSTNATLWIPENGINE pEngine, PTSTNATLWIPCONN pConn, uint32_t cbStream)
+{
+    uint32_t const uSndEnd = pConn->uSndIss + 1 + cbStream;
+    uint64_t const msNow   = RTTimeMilliTS();
+    if (pConn->uSndUna == uSndEnd)
+        return;
+    if (   (pConn->uSndMax != pConn->uSndUna || !pConn->cbSndWnd)
+        && msNow - pConn->msLastAck >= TSTNATLWIP_RTO_MS)
+    {
+        /* Probes a closed window too. */
+        pConn->uSndNxt   = pConn->uSndUna;
+        pConn->cbSndWnd  = RT_MAX(pConn->cbSndWnd, pConn->cbMss);
+        pConn->msLastAck = msNow;
+        pConn->cRetransmits++;
+    }
+    else if (pConn->uSndMax == pConn->uSndUna)
+        pConn->msLastAck = msNow;
+
+    while (pConn->uSndNxt != uSndEnd)
+    {
+        uint32_t const cbInFlight = pConn->uSndNxt - pConn->uSndUna;
+        if (cbInFlight >= pConn->cbSndWnd)
+            break;
+        uint32_t const cbLeft = uSndEnd - pConn->uSndNxt;
+        uint32_t const cb     = RT_MIN(RT_MIN(pConn->cbMss, cbLeft), pConn->cbSndWnd - cbInFlight);
+        if (cb < pConn->cbMss && cb < cbLeft)
+            break; /* no silly windows */
+        tstNatLwIPGuestSend(pEngine, pConn, pConn->uSndNxt, RTNETTCP_F_ACK | RTNETTCP_F_PSH, g_abFiller, cb);
+        pConn->uSndNxt += cb;
+        if ((int32_t)(pConn->uSndNxt - pConn->uSndMax) > 0)
+            pConn->uSndMax = pConn->uSndNxt;
+    }
+}
+
+
+/**
+ * Accepts connections on the host and reads (and echoes) what arrives.
+ */
+static void tstNatLwIPHostService(void)
+{
+    for (;;)
+    {
+        int hSock = accept(g_hListen, NULL, NULL);
+        if (hSock < 0)
+            break;
+        fcntl(hSock, F_SETFL, fcntl(hSock, F_GETFL) | O_NONBLOCK);
+        if (g_hHostConn >= 0)
+            close(g_hHostConn);
+        g_hHostConn   = hSock;
+        g_cbHostRcvd  = 0;
+        g_cHostAccepted++;
+    }
+    if (g_hHostConn < 0)
+        return;
+
+    for (;;)
+    {
+        ssize_t cbRead = recv(g_hHostConn, g_abHostBuf, sizeof(g_abHostBuf), 0);
+        if (cbRead <= 0)
+            break;
+        if (g_cbHostRcvd < sizeof(g_abHostRcvd))
+            memcpy(&g_abHostRcvd[g_cbHostRcvd], g_abHostBuf, RT_MIN((size_t)cbRead, sizeof(g_abHostRcvd) - g_cbHostRcvd));
+        g_cbHostRcvd += cbRead;
+        /* The round trip messages are small, the socket buffer takes them. */
+        if (g_fHostEcho)
+            send(g_hHostConn, g_abHostBuf, cbRead, 0);
+    }
+}
+
+
+/**
+ * Closes the host end of the last connection and resets the counters.
+ */
+static void tstNatLwIPHostReset(bool fEcho)
+{
+    if (g_hHostConn >= 0)
+        close(g_hHostConn);
+    g_hHostConn    = -1;
+    g_cHostAccepted = 0;
+    g_cbHostRcvd   = 0;
+    g_fHostEcho    = fEcho;
+    RT_ZERO(g_abHostRcvd);
+}
+
+
+/**
+ * Runs the engine for a round, hands what it sent to the guest, lets the
+ * guest acknowledge it and services the host end.
+ *
+ * @param   pEngine     The engine.
+ * @param   pConn       The guest end of the connection, NULL if none.
+ * @param   cMillies    How long the engine may wait for something to do.
+ */
+static void tstNatLwIPPump(PCTSTNATLWIPENGINE pEngine, PTSTNATLWIPCONN pConn, RTMSINTERVAL cMillies)
+{
+    pEngine->pfnPoll(cMillies);
+    while (g_cFrames)
+    {
+        TSTNATLWIPFRAME Frame = g_aFrames[g_iFrameHead];
+        g_iFrameHead = (g_iFrameHead + 1) % TSTNATLWIP_QUEUE_SIZE;
+        g_cFrames--;
+        tstNatLwIPGuestRecv(pEngine, pConn, Frame.pbFrame, Frame.cbFrame);
+        RTMemFree(Frame.pbFrame);
+    }
+    if (   pConn
+        && pConn->fAckPending
+        && !pConn->fRst)
+    {
+        tstNatLwIPGuestSend(pEngine, pConn, pConn->uSndNxt, RTNETTCP_F_ACK, NULL, 0);
+        pConn->fAckPending = false;
+    }
+    tstNatLwIPHostService();
+}
+
+
+/**
+ * Sends a SYN to the host alias and waits for the answer.
+ *
+ * @returns true if the engine answered with a SYN|ACK, which the guest
+ *          acknowledged, false on reset or timeout.
+ * @param   pEngine         The engine.
+ * @param   pConn           The guest end of the connection to set up.
+ * @param   uGuestPort      The guest port.
+ * @param   uHostPort       The port on the host.
+ * @param   fOfferWndScale  Whether the guest offers window scaling.
+ */
+static bool tstNatLwIPConnect(PCTSTNATLWIPENGINE pEngine, PTSTNATLWIPCONN pConn, uint16_t uGuestPort, uint16_t uHostPort,
+                              bool fOfferWndScale)
+{
+    RT_ZERO(*pConn);
+    pConn->uGuestPort     = uGuestPort;
+    pConn->uHostPort      = uHostPort;
+    pConn->fOfferWndScale = fOfferWndScale;
+    pConn->uSndIss        = (uint32_t)uGuestPort << 16;
+    pConn->uSndUna        = pConn->uSndIss + 1;
+    pConn->uSndNxt        = pConn->uSndIss + 1;
+    pConn->uSndMax        = pConn->uSndIss + 1;
+    tstNatLwIPGuestSend(pEngine, pConn, pConn->uSndIss, RTNETTCP_F_SYN, NULL, 0);
+
+    uint64_t const msStart = RTTimeMilliTS();
+    while (   !pConn->fSynAck
+           && !pConn->fRst
+           && RTTimeMilliTS() - msStart < TSTNATLWIP_TIMEOUT_MS)
+        tstNatLwIPPump(pEngine, pConn, 0);
+    pConn->msLastAck = RTTimeMilliTS();
+    return pConn->fSynAck && !pConn->fRst;
+}
+
+
+/**
+ * Resets the connection from the guest side and closes the host end.
+ */
+static void tstNatLwIPDisconnect(PCTSTNATLWIPENGINE pEngine, PTSTNATLWIPCONN pConn)
+{
+    if (pConn->fSynAck && !pConn->fRst)
+        tstNatLwIPGuestSend(pEngine, pConn, pConn->uSndMax, RTNETTCP_F_RST, NULL, 0);
+    for (unsigned i = 0; i < 4; i++)
+        tstNatLwIPPump(pEngine, NULL, 0);
+    tstNatLwIPHostReset(false /*fEcho*/);
+}
+
+
+/**
+ * Sends data from the guest and waits until the host got it all and the
+ * engine acknowledged it.
+ *
+ * @returns true on success, false on timeout or reset.
+ */
+static bool tstNatLwIPGuestWrite(PCTSTNATLWIPENGINE pEngine, PTSTNATLWIPCONN pConn, void const *pvData, uint32_t cbData)
+{
+    uint64_t const cbHostWant = g_cbHostRcvd + cbData;
+    tstNatLwIPGuestSend(pEngine, pConn, pConn->uSndNxt, RTNETTCP_F_ACK | RTNETTCP_F_PSH, pvData, cbData);
+    pConn->uSndNxt += cbData;
+    pConn->uSndMax  = pConn->uSndNxt;
+
+    uint64_t const msStart = RTTimeMilliTS();
+    while (   (g_cbHostRcvd < cbHostWant || pConn->uSndUna != pConn->uSndNxt)
+           && !pConn->fRst
+           && RTTimeMilliTS() - msStart < TSTNATLWIP_TIMEOUT_MS)
+        tstNatLwIPPump(pEngine, pConn, 1);
+    return g_cbHostRcvd == cbHostWant && pConn->uSndUna == pConn->uSndNxt;
+}
+
+
+/**
+ * Waits for the host to accept the connection.
+ */
+static bool tstNatLwIPHostWaitAccept(PCTSTNATLWIPENGINE pEngine, PTSTNATLWIPCONN pConn)
+{
+    uint64_t const msStart = RTTimeMilliTS();
+    while (   g_hHostConn < 0
+           && RTTimeMilliTS() - msStart < TSTNATLWIP_TIMEOUT_MS)
+        tstNatLwIPPump(pEngine, pConn, 1);
+    return g_hHostConn >= 0;
+}
+
+
+/**
+ * Checks the proxying and the window scaling of the lwIP engine.
+ *
+ * @param   pEngine         The lwIP engine.
+ * @param   uPort           The port of the host listener.
+ * @param   uClosedPort     A port nobody listens on.
+ */
+static void tstNatLwIPProxy(PCTSTNATLWIPENGINE pEngine, uint16_t uPort, uint16_t uClosedPort)
+{
+    RTTestSub(g_hTest, "Proxy and window scaling");
+    TSTNATLWIPCONN Conn;
+    tstNatLwIPHostReset(false /*fEcho*/);
+
+    /*
+     * Window scaling offered: the engine answers with its own shift once the
+     * host accepted, and opens a window beyond 64K.
+     */
+    RTTESTI_CHECK_RETV(tstNatLwIPConnect(pEngine, &Conn, 10000, uPort, true /*fOfferWndScale*/));
+    RTTESTI_CHECK(Conn.fWndScale && Conn.cSndWndShift > 0);
+    RTTESTI_CHECK(Conn.cbMss > 0 && Conn.cbMss <= TSTNATLWIP_GUEST_MSS);
+    RTTESTI_CHECK_RETV(tstNatLwIPHostWaitAccept(pEngine, &Conn));
+    RTTESTI_CHECK(g_cHostAccepted == 1);
+
+    RTTESTI_CHECK(tstNatLwIPGuestWrite(pEngine, &Conn, "hello", 5));
+    RTTESTI_CHECK(!memcmp(g_abHostRcvd, "hello", 5));
+    RTTESTI_CHECK_MSG(Conn.cbSndWnd > _64K, ("cbSndWnd=%#x\n", Conn.cbSndWnd));
+
+    /* The other way round. */
+    RTTESTI_CHECK(send(g_hHostConn, "world", 5, 0) == 5);
+    uint64_t msStart = RTTimeMilliTS();
+    while (Conn.cbRcvd < 5 && !Conn.fRst && RTTimeMilliTS() - msStart < TSTNATLWIP_TIMEOUT_MS)
+        tstNatLwIPPump(pEngine, &Conn, 1);
+    RTTESTI_CHECK(Conn.cbRcvd == 5 && !memcmp(Conn.abRcvd, "world", 5));
+
+    /* The host closes, the guest gets the FIN. */
+    shutdown(g_hHostConn, SHUT_WR);
+    msStart = RTTimeMilliTS();
+    while (!Conn.fFin && !Conn.fRst && RTTimeMilliTS() - msStart < TSTNATLWIP_TIMEOUT_MS)
+        tstNatLwIPPump(pEngine, &Conn, 1);
+    RTTESTI_CHECK(Conn.fFin && !Conn.fRst);
+    tstNatLwIPDisconnect(pEngine, &Conn);
+
+    /*
+     * No window scaling offered: none in the SYN|ACK either.  The window is
+     * still the large one clamped to 16 bits, not DevINIP's 32K.
+     */
+    RTTESTI_CHECK_RETV(tstNatLwIPConnect(pEngine, &Conn, 10001, uPort, false /*fOfferWndScale*/));
+    RTTESTI_CHECK(!Conn.fWndScale && Conn.cSndWndShift == 0);
+    RTTESTI_CHECK(tstNatLwIPGuestWrite(pEngine, &Conn, "hi", 2));
+    RTTESTI_CHECK(!memcmp(g_abHostRcvd, "hi", 2));
+    RTTESTI_CHECK_MSG(Conn.cbSndWnd > _32K && Conn.cbSndWnd <= 0xffff, ("cbSndWnd=%#x\n", Conn.cbSndWnd));
+    tstNatLwIPDisconnect(pEngine, &Conn);
+
+    /*
+     * Nobody listening on the host: the SYN is answered with a reset.
+     */
+    RTTESTI_CHECK(!tstNatLwIPConnect(pEngine, &Conn, 10002, uClosedPort, true /*fOfferWndScale*/));
+    RTTESTI_CHECK(Conn.fRst && !Conn.fSynAck);
+    tstNatLwIPDisconnect(pEngine, &Conn);
+}
+
+
+/**
+ * Measures the bulk throughput from the guest to the host.
+ */
+static void tstNatLwIPBulk(PCTSTNATLWIPENGINE pEngine, uint16_t uPort, uint32_t cbTotal)
+{
+    RTTestSubF(g_hTest, "%s: throughput", pEngine->pszName);
+    TSTNATLWIPCONN Conn;
+    tstNatLwIPHostReset(false /*fEcho*/);
+    if (!tstNatLwIPConnect(pEngine, &Conn, 20000, uPort, true /*fOfferWndScale*/))
+    {
+        RTTestFailed(g_hTest, "connecting failed (%s)", Conn.fRst ? "reset" : "timeout");
+        tstNatLwIPDisconnect(pEngine, &Conn);
+        return;
+    }
+
+    uint64_t const nsStart       = RTTimeNanoTS();
+    uint64_t       cbHostLast    = 0;
+    uint64_t       msHostLast    = RTTimeMilliTS();
+    while (g_cbHostRcvd < cbTotal && !Conn.fRst)
+    {
+        tstNatLwIPGuestPush(pEngine, &Conn, cbTotal);
+        tstNatLwIPPump(pEngine, &Conn, 0);
+        if (g_cbHostRcvd != cbHostLast)
+        {
+            cbHostLast = g_cbHostRcvd;
+            msHostLast = RTTimeMilliTS();
+        }
+        else if (RTTimeMilliTS() - msHostLast >= TSTNATLWIP_TIMEOUT_MS)
+            break;
+    }
+    uint64_t const cNsElapsed = RTTimeNanoTS() - nsStart;
+
+    if (g_cbHostRcvd == cbTotal)
+    {
+        RTTestValue(g_hTest, "Throughput", (uint64_t)cbTotal * RT_NS_1SEC / RT_MAX(cNsElapsed, 1) / _1K,
+                    RTTESTUNIT_KILOBYTES_PER_SEC);
+        RTTestValue(g_hTest, "Retransmissions", Conn.cRetransmits, RTTESTUNIT_OCCURRENCES);
+    }
+    else
+        RTTestFailed(g_hTest, "the host got %llu of %u bytes%s", g_cbHostRcvd, cbTotal, Conn.fRst ? " (reset)" : "");
+    tstNatLwIPDisconnect(pEngine, &Conn);
+}
+
+
+/**
+ * Measures the round trip time of small messages the host echoes.
+ */
+static void tstNatLwIPPing(PCTSTNATLWIPENGINE pEngine, uint16_t uPort, uint32_t cRoundTrips)
+{
+    RTTestSubF(g_hTest, "%s: latency", pEngine->pszName);
+    TSTNATLWIPCONN Conn;
+    tstNatLwIPHostReset(true /*fEcho*/);
+    if (   !tstNatLwIPConnect(pEngine, &Conn, 20001, uPort, true /*fOfferWndScale*/)
+        || !tstNatLwIPHostWaitAccept(pEngine, &Conn))
+    {
+        RTTestFailed(g_hTest, "connecting failed (%s)", Conn.fRst ? "reset" : "timeout");
+        tstNatLwIPDisconnect(pEngine, &Conn);
+        return;
+    }
+
+    uint64_t cNsTotal = 0;
+    uint64_t cNsMin   = UINT64_MAX;
+    uint64_t cNsMax   = 0;
+    uint32_t i;
+    for (i = 0; i < cRoundTrips; i++)
+    {
+        uint64_t const cbWant  = (uint64_t)(i + 1) * TSTNATLWIP_PING_SIZE;
+        uint64_t const nsStart = RTTimeNanoTS();
+        uint64_t const msStart = RTTimeMilliTS();
+        while (   Conn.cbRcvd < cbWant
+               && !Conn.fRst
+               && RTTimeMilliTS() - msStart < TSTNATLWIP_TIMEOUT_MS)
+        {
+            tstNatLwIPGuestPush(pEngine, &Conn, (uint32_t)cbWant);
+            tstNatLwIPPump(pEngine, &Conn, 0);
+        }
+        if (Conn.cbRcvd < cbWant)
+            break;
+        uint64_t const cNs = RTTimeNanoTS() - nsStart;
+        cNsTotal += cNs;
+        cNsMin    = RT_MIN(cNsMin, cNs);
+        cNsMax    = RT_MAX(cNsMax, cNs);
+    }
+
+    if (i == cRoundTrips)
+    {
+        RTTestValue(g_hTest, "Average", cNsTotal / cRoundTrips, RTTESTUNIT_NS_PER_ROUND_TRIP);
+        RTTestValue(g_hTest, "Minimum", cNsMin, RTTESTUNIT_NS_PER_ROUND_TRIP);
+        RTTestValue(g_hTest, "Maximum", cNsMax, RTTESTUNIT_NS_PER_ROUND_TRIP);
+    }
+    else
+        RTTestFailed(g_hTest, "round trip %u of %u didn't complete%s", i + 1, cRoundTrips, Conn.fRst ? " (reset)" : "");
+    tstNatLwIPDisconnect(pEngine, &Conn);
+}
+
+
+/**
+ * Measures the connection setup rate: SYN, SYN|ACK once the host connection
+ * is up, ACK and a reset from the guest to tear it down again.
+ */
+static void tstNatLwIPConnects(PCTSTNATLWIPENGINE pEngine, uint16_t uPort, uint32_t cConnects)
+{
+    RTTestSubF(g_hTest, "%s: connection setup", pEngine->pszName);
+    TSTNATLWIPCONN Conn;
+    tstNatLwIPHostReset(false /*fEcho*/);
+
+    uint64_t const nsStart = RTTimeNanoTS();
+    uint32_t i;
+    for (i = 0; i < cConnects; i++)
+    {
+        bool fOk = tstNatLwIPConnect(pEngine, &Conn, (uint16_t)(30000 + i % 30000), uPort, true /*fOfferWndScale*/);
+        if (Conn.fSynAck && !Conn.fRst)
+            tstNatLwIPGuestSend(pEngine, &Conn, Conn.uSndMax, RTNETTCP_F_RST, NULL, 0);
+        if (!fOk)
+            break;
+        tstNatLwIPPump(pEngine, NULL, 0);
+    }
+    uint64_t const cNsElapsed = RTTimeNanoTS() - nsStart;
+
+    if (i == cConnects)
+    {
+        RTTestValue(g_hTest, "Connections", cConnects, RTTESTUNIT_OCCURRENCES);
+        RTTestValue(g_hTest, "Rate", (uint64_t)cConnects * RT_NS_1SEC / RT_MAX(cNsElapsed, 1), RTTESTUNIT_OCCURRENCES_PER_SEC);
+    }
+    else
+        RTTestFailed(g_hTest, "connection %u of %u failed (%s)", i + 1, cConnects, Conn.fRst ? "reset" : "timeout");
+    tstNatLwIPDisconnect(pEngine, &Conn);
+}
+
+
+/**
+ * Creates the non-blocking host listener on a free loopback port.
+ *
+ * @returns The socket, -1 on failure.
+ * @param   puPort      Where to return the port.
+ */
+static int tstNatLwIPListen(uint16_t *puPort)
+{
+    int hSock = socket(AF_INET, SOCK_STREAM, 0);
+    if (hSock < 0)
+        return -1;
+    struct sockaddr_in Addr;
+    RT_ZERO(Addr);
+    Addr.sin_family      = AF_INET;
+    Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t cbAddr = sizeof(Addr);
+    if (   bind(hSock, (struct sockaddr *)&Addr, sizeof(Addr)) == 0
+        && listen(hSock, 128) == 0
+        && getsockname(hSock, (struct sockaddr *)&Addr, &cbAddr) == 0
+        && fcntl(hSock, F_SETFL, fcntl(hSock, F_GETFL) | O_NONBLOCK) == 0)
+    {
+        *puPort = ntohs(Addr.sin_port);
+        return hSock;
+    }
+    close(hSock);
+    return -1;
+}
+
+
+int main(int argc, char **argv)
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstNatLwIP", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    static RTGETOPTDEF const s_aOptions[] =
+    {
+        { "--size",         's', RTGETOPT_REQ_UINT32  },
+        { "--round-trips",  'r', RTGETOPT_REQ_UINT32  },
+        { "--connects",     'c', RTGETOPT_REQ_UINT32  },
+    };
+
+    uint32_t cMBytes     = TSTNATLWIP_BULK_MB;
+    uint32_t cRoundTrips = TSTNATLWIP_ROUND_TRIPS;
+    uint32_t cConnects   = TSTNATLWIP_CONNECTS;
+
+    int ch;
+    RTGETOPTUNION Value;
+    RTGETOPTSTATE GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0 /* fFlags */);
+    while ((ch = RTGetOpt(&GetState, &Value)))
+    {
+        switch (ch)
+        {
+            case 's': cMBytes = RT_MIN(RT_MAX(Value.u32, 1), 1024); break;
+            case 'r': cRoundTrips = RT_MAX(Value.u32, 1); break;
+            case 'c': cConnects = RT_MAX(Value.u32, 1); break;
+
+            case 'h':
+                RTPrintf("Usage: tstNatLwIP [--size <MB>] [--round-trips <count>] [--connects <count>]\n"
+                         "Checks the proxying of the lwIP NAT engine, then compares it with slirp:\n"
+                         "a bulk transfer of --size MB (default %u) to the host, --round-trips (default %u)\n"
+                         "%u byte messages the host echoes and --connects (default %u) connections set up.\n",
+                         TSTNATLWIP_BULK_MB, TSTNATLWIP_ROUND_TRIPS, TSTNATLWIP_PING_SIZE, TSTNATLWIP_CONNECTS);
+                return RTEXITCODE_SUCCESS;
+
+            default:
+                return RTGetOptPrintError(ch, &Value);
+        }
+    }
+
+    /* The engines reset host sockets, writing to one mustn't kill us. */
+    signal(SIGPIPE, SIG_IGN);
+    memset(g_abFiller, 'x', sizeof(g_abFiller));
+
+    /*
+     * The host listener, and a port which was free a moment ago for the
+     * refused connection.
+     */
+    uint16_t uPort = 0;
+    g_hListen = tstNatLwIPListen(&uPort);
+    if (g_hListen < 0)
+    {
+        RTTestFailed(g_hTest, "creating the host listener failed: errno=%d", errno);
+        return RTTestSummaryAndDestroy(g_hTest);
+    }
+    uint16_t uClosedPort = 0;
+    int hClosed = tstNatLwIPListen(&uClosedPort);
+    if (hClosed >= 0)
+        close(hClosed);
+
+    for (unsigned iEngine = 0; iEngine < RT_ELEMENTS(g_aEngines); iEngine++)
+    {
+        PCTSTNATLWIPENGINE pEngine = &g_aEngines[iEngine];
+        int rc = pEngine->pfnCreate();
+        if (RT_FAILURE(rc))
+        {
+            RTTestFailed(g_hTest, "creating the %s engine failed: %Rrc", pEngine->pszName, rc);
+            continue;
+        }
+
+        if (pEngine->pfnCreate == tstNatLwIPLwIPCreate && hClosed >= 0)
+            tstNatLwIPProxy(pEngine, uPort, uClosedPort);
+        tstNatLwIPBulk(pEngine, uPort, cMBytes * _1M);
+        tstNatLwIPPing(pEngine, uPort, cRoundTrips);
+        tstNatLwIPConnects(pEngine, uPort, cConnects);
+
+        pEngine->pfnDestroy();
+        tstNatLwIPFlushFrames();
+    }
+
+    close(g_hListen);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
@@ -0,0 +1,256 @@
+/* $Id$ */
+/** @file
+ * VBox - Testcase for the receive buffer of the slirp NAT engine.
+ *
+ * Queues data in so_rcv of a socket the way tcp_input does, some of it copied
+ * into the ring and the rest held by reference in the guest mbufs, and drains
+ * it with sowrite() into a socket pair whose far end is read in small pieces,
+ * so most writev() calls are short.  The bytes coming out must be the stream
+ * that went in, whether the ring wraps, ends right at the end of the buffer
+ * or does not wrap at all.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <slirp.h>
+
+#include <iprt/test.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The NAT network, 10.0.2.0/24, host byte order. */
+#define TSTNATSBUF_NETWORK          UINT32_C(0x0a000200)
+/** The NAT netmask. */
+#define TSTNATSBUF_NETMASK          UINT32_C(0xffffff00)
+/** The size of the ring of so_rcv. */
+#define TSTNATSBUF_RING_SIZE        _64K
+/** The number of bytes copied into the ring, more than the socket pair
+ * takes at once. */
+#define TSTNATSBUF_RING_DATA        40000
+/** The number of guest mbufs held by reference. */
+#define TSTNATSBUF_REFS             12
+/** The number of bytes in each of them. */
+#define TSTNATSBUF_REF_DATA         1400
+/** The size of the pieces read from the far end of the socket pair. */
+#define TSTNATSBUF_READ_SIZE        777
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+static RTTEST           g_hTest;
+static PNATState        g_pNATState;
+
+
+/** slirp's hooks, nothing goes to the guest here */
+int slirp_can_output(void *pvUser)
+{
+    NOREF(pvUser);
+    return 1;
+}
+
+void slirp_urg_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
+{
+    NOREF(pvUser); NOREF(cb);
+    slirp_ext_m_free(g_pNATState, m, (uint8_t *)pu8Buf);
+}
+
+void slirp_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
+{
+    NOREF(pvUser); NOREF(cb);
+    slirp_ext_m_free(g_pNATState, m, (uint8_t *)pu8Buf);
+}
+
+void slirp_output_pending(void *pvUser)
+{
+    NOREF(pvUser);
+}
+
+void slirp_wakeup_nat_thread(void *pvUser)
+{
+    NOREF(pvUser);
+}
+
+
+/**
+ * The byte at the given offset of the stream.
+ *
+ * A shift of the stream by anything but a multiple of 16GB changes it, so
+ * both dropped and repeated data show.
+ */
+static uint8_t tstNatSbufByte(uint32_t off)
+{
+    uint32_t u32 = (off >> 2) * UINT32_C(2654435761);
+    return (uint8_t)(u32 >> ((off & 3) * 8));
+}
+
+/**
+ * Gets a guest mbuf holding the next cb bytes of the stream.
+ */
+static struct mbuf *tstNatSbufMbuf(uint32_t *poff, int cb)
+{
+    PNATState pData = g_pNATState;
+    struct mbuf *m = m_getcl(pData, M_DONTWAIT, MT_HEADER, M_PKTHDR);
+    int i;
+    if (!m)
+        return NULL;
+    for (i = 0; i < cb; i++)
+        mtod(m, uint8_t *)[i] = tstNatSbufByte((*poff)++);
+    m->m_len = cb;
+    m->m_pkthdr.len = cb;
+    return m;
+}
+
+/**
+ * Runs one case.
+ *
+ * @param   pszName     The name of the case.
+ * @param   offRing     Where the ring data starts in the buffer.
+ */
+static void tstNatSbufRun(const char *pszName, int offRing)
+{
+    PNATState       pData = g_pNATState;
+    struct socket  *so;
+    struct sbuf    *sb;
+    int             aSocks[2];
+    int             cbSndBuf = 4096;
+    uint32_t        offIn  = 0;
+    uint32_t        offOut = 0;
+    uint32_t        cShortInRing = 0;
+    uint32_t        cShortInRefs = 0;
+    unsigned        cLoops;
+    int             i;
+
+    RTTestSub(g_hTest, pszName);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, aSocks) != 0)
+    {
+        RTTestFailed(g_hTest, "socketpair failed: errno=%d", errno);
+        return;
+    }
+    setsockopt(aSocks[0], SOL_SOCKET, SO_SNDBUF, &cbSndBuf, sizeof(cbSndBuf));
+    fd_nonblock(aSocks[0]);
+    fd_nonblock(aSocks[1]);
+
+    so = socreate();
+    RTTEST_CHECK_RETV(g_hTest, so != NULL);
+    so->s = aSocks[0];
+    so->so_state = SS_ISFCONNECTED;
+    sb = &so->so_rcv;
+    sbreserve(pData, sb, TSTNATSBUF_RING_SIZE);
+    sb->sb_rptr = sb->sb_wptr = sb->sb_data + offRing;
+
+    /* The ring first, in pieces the size of a segment, then the references. */
+    for (i = 0; i < TSTNATSBUF_RING_DATA; i += 1500)
+    {
+        struct mbuf *m = tstNatSbufMbuf(&offIn, RT_MIN(1500, TSTNATSBUF_RING_DATA - i));
+        RTTEST_CHECK_RETV(g_hTest, m != NULL);
+        sbappendsb(pData, sb, m);
+        m_freem(pData, m);
+    }
+    for (i = 0; i < TSTNATSBUF_REFS; i++)
+    {
+        struct mbuf *m = tstNatSbufMbuf(&offIn, TSTNATSBUF_REF_DATA);
+        RTTEST_CHECK_RETV(g_hTest, m != NULL);
+        sbappendref(pData, sb, m);
+    }
+    RTTEST_CHECK(g_hTest, sb->sb_cc == TSTNATSBUF_RING_DATA);
+    RTTEST_CHECK(g_hTest, sb->sb_mbcnt == TSTNATSBUF_REFS);
+    RTTEST_CHECK(g_hTest, SBUF_LEN(sb) == offIn);
+
+    /* Drain it, a piece at a time from the far end. */
+    for (cLoops = 0; offOut < offIn && cLoops < 100000; cLoops++)
+    {
+        uint8_t         abBuf[TSTNATSBUF_READ_SIZE];
+        ssize_t         cbRead;
+        uint32_t const  cbRing = sb->sb_cc;
+        uint32_t const  cbQueued = SBUF_LEN(sb);
+
+        if (cbQueued)
+        {
+            int cbWritten = sowrite(pData, so);
+            RTTEST_CHECK_MSG_RETV(g_hTest, cbWritten >= 0, (g_hTest, "sowrite -> %d\n", cbWritten));
+            if (cbWritten > 0 && (uint32_t)cbWritten < cbQueued)
+            {
+                if ((uint32_t)cbWritten < cbRing)
+                    cShortInRing++;
+                else
+                    cShortInRefs++;
+            }
+            RTTEST_CHECK_MSG_RETV(g_hTest, SBUF_LEN(sb) == cbQueued - cbWritten,
+                                  (g_hTest, "%u bytes queued, %d written, %u left\n",
+                                   cbQueued, cbWritten, SBUF_LEN(sb)));
+        }
+
+        cbRead = recv(aSocks[1], abBuf, sizeof(abBuf), 0);
+        if (cbRead > 0)
+        {
+            for (i = 0; i < cbRead; i++, offOut++)
+                if (abBuf[i] != tstNatSbufByte(offOut))
+                {
+                    RTTestFailed(g_hTest, "byte %u: %#x, expected %#x", offOut, abBuf[i], tstNatSbufByte(offOut));
+                    offIn = offOut; /* stop */
+                    break;
+                }
+        }
+        else if (!SBUF_LEN(sb))
+            break;
+    }
+    RTTEST_CHECK_MSG(g_hTest, offOut == offIn, (g_hTest, "%u of %u bytes came out\n", offOut, offIn));
+    RTTEST_CHECK(g_hTest, SBUF_LEN(sb) == 0);
+    RTTEST_CHECK(g_hTest, sb->sb_mb == NULL && sb->sb_mbcnt == 0);
+    RTTEST_CHECK(g_hTest, pData->cSbufRefs == 0);
+    /* Make sure the short writes this is about actually happened. */
+    RTTEST_CHECK_MSG(g_hTest, cShortInRing > 0 && cShortInRefs > 0,
+                     (g_hTest, "short writes: %u in the ring, %u in the references\n", cShortInRing, cShortInRefs));
+
+    sbfree(pData, sb);
+    closesocket(aSocks[0]);
+    closesocket(aSocks[1]);
+    so->s = -1;
+    sofree(pData, so);
+}
+
+
+int main(int argc, char **argv)
+{
+    int rc;
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstNatSbuf", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+    NOREF(argc); NOREF(argv);
+
+    rc = slirp_init(&g_pNATState, RT_H2N_U32_C(TSTNATSBUF_NETWORK), TSTNATSBUF_NETMASK,
+                    false /* fPassDomain */, false /* fUseHostResolver */, 0 /* aliasMode */,
+                    false /* fSecondary */, NULL);
+    if (RT_FAILURE(rc))
+    {
+        RTTestFailed(g_hTest, "slirp_init failed: %Rrc", rc);
+        return RTTestSummaryAndDestroy(g_hTest);
+    }
+
+    /* Only a little wraps, so the writes cover the first edge, the wrapped
+       part and references. */
+    tstNatSbufRun("Wrapped ring", TSTNATSBUF_RING_SIZE - TSTNATSBUF_RING_DATA + 100);
+    tstNatSbufRun("Ring ending at the buffer end", TSTNATSBUF_RING_SIZE - TSTNATSBUF_RING_DATA);
+    tstNatSbufRun("Flat ring", 0);
+
+    slirp_term(g_pNATState);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
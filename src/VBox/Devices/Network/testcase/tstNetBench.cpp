@@ -0,0 +1,495 @@
+/* $Id$ */
+/** @file
+ * VBox - TCP benchmark for comparing the NAT engines.
+ *
+ * Measures bulk throughput, round trip latency and the connection setup rate
+ * against a server.  Run "tstNetBench --server" on the host and
+ * "tstNetBench --client 10.0.2.2" in a NAT guest, once with the adapter's
+ * TcpEngine set to "slirp" and once with "lwip".  Without arguments both
+ * ends run here over the loopback interface, which gives the baseline.
+ *
+ * With --streams the throughput is also measured over several connections in
+ * parallel, one port per stream starting with --port.  Give the server the
+ * same option.  This spreads the flows over the queues of a multi-queue
+ * adapter (e.g. virtio-net with QueuePairs > 1).
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <iprt/test.h>
+#include <iprt/tcp.h>
+#include <iprt/err.h>
+#include <iprt/getopt.h>
+#include <iprt/mem.h>
+#include <iprt/message.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The default port. */
+#define TSTNETBENCH_PORT            5001
+/** The size of the buffers used for bulk transfers. */
+#define TSTNETBENCH_CHUNK           _64K
+/** The size of a latency test message. */
+#define TSTNETBENCH_PING_SIZE       64
+/** The maximum number of parallel streams. */
+#define TSTNETBENCH_MAX_STREAMS     16
+
+/** @name Test requests, the first byte the client sends.
+ * @{ */
+/** Bulk transfer: a 64-bit byte count follows, then the data.  The server
+ * answers with a single byte once everything was received. */
+#define TSTNETBENCH_REQ_BULK        'B'
+/** Round trips: the server echoes TSTNETBENCH_PING_SIZE byte messages until
+ * the client closes. */
+#define TSTNETBENCH_REQ_PING        'P'
+/** Connection setup: the server answers with a single byte and closes. */
+#define TSTNETBENCH_REQ_CONNECT     'C'
+/** @} */
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * A bulk transfer stream of the parallel throughput test.
+ */
+typedef struct TSTNETBENCHSTREAM
+{
+    /** The server address. */
+    const char     *pszAddress;
+    /** The server port of this stream. */
+    uint32_t        uPort;
+    /** The number of bytes to transfer. */
+    uint64_t        cbTotal;
+    /** The transfer status. */
+    int             rc;
+    /** The thread doing the transfer. */
+    RTTHREAD        hThread;
+} TSTNETBENCHSTREAM;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+static RTTEST g_hTest;
+
+
+/**
+ * Reads exactly the given number of bytes.
+ */
+static int tstNetBenchReadAll(RTSOCKET hSock, void *pvBuf, size_t cb)
+{
+    return RTTcpRead(hSock, pvBuf, cb, NULL);
+}
+
+
+/**
+ * Serves one client, see TSTNETBENCH_REQ_XXX.
+ */
+static DECLCALLBACK(int) tstNetBenchServe(RTSOCKET hSock, void *pvUser)
+{
+    NOREF(pvUser);
+    char chReq;
+    int rc = tstNetBenchReadAll(hSock, &chReq, 1);
+    if (RT_FAILURE(rc))
+        return VINF_SUCCESS;
+
+    switch (chReq)
+    {
+        case TSTNETBENCH_REQ_BULK:
+        {
+            uint64_t cbLeft;
+            rc = tstNetBenchReadAll(hSock, &cbLeft, sizeof(cbLeft));
+            void *pvBuf = RTMemAlloc(TSTNETBENCH_CHUNK);
+            while (RT_SUCCESS(rc) && pvBuf && cbLeft > 0)
+            {
+                size_t cbRead;
+                rc = RTTcpRead(hSock, pvBuf, (size_t)RT_MIN(cbLeft, TSTNETBENCH_CHUNK), &cbRead);
+                if (RT_SUCCESS(rc) && !cbRead)
+                    rc = VERR_NET_CONNECTION_RESET_BY_PEER;
+                if (RT_SUCCESS(rc))
+                    cbLeft -= cbRead;
+            }
+            RTMemFree(pvBuf);
+            if (RT_SUCCESS(rc))
+                RTTcpWrite(hSock, "!", 1);
+            break;
+        }
+
+        case TSTNETBENCH_REQ_PING:
+        {
+            uint8_t abMsg[TSTNETBENCH_PING_SIZE];
+            while (   RT_SUCCESS(tstNetBenchReadAll(hSock, abMsg, sizeof(abMsg)))
+                   && RT_SUCCESS(RTTcpWrite(hSock, abMsg, sizeof(abMsg))))
+                /* nothing */;
+            break;
+        }
+
+        case TSTNETBENCH_REQ_CONNECT:
+            RTTcpWrite(hSock, "!", 1);
+            break;
+
+        default:
+            break;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Connects to the server and sends the request byte.
+ */
+static int tstNetBenchConnect(const char *pszAddress, uint32_t uPort, char chReq, PRTSOCKET phSock)
+{
+    int rc = RTTcpClientConnect(pszAddress, uPort, phSock);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTTcpWrite(*phSock, &chReq, 1);
+        if (RT_FAILURE(rc))
+            RTTcpClientClose(*phSock);
+    }
+    return rc;
+}
+
+
+/**
+ * Sends cbTotal bytes to the server and waits for the acknowledgement.
+ */
+static int tstNetBenchBulkTransfer(const char *pszAddress, uint32_t uPort, uint64_t cbTotal)
+{
+    RTSOCKET hSock;
+    int rc = tstNetBenchConnect(pszAddress, uPort, TSTNETBENCH_REQ_BULK, &hSock);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    uint8_t *pbBuf = (uint8_t *)RTMemAlloc(TSTNETBENCH_CHUNK);
+    if (!pbBuf)
+    {
+        RTTcpClientClose(hSock);
+        return VERR_NO_MEMORY;
+    }
+    for (size_t i = 0; i < TSTNETBENCH_CHUNK; i++)
+        pbBuf[i] = (uint8_t)i;
+
+    rc = RTTcpWrite(hSock, &cbTotal, sizeof(cbTotal));
+    uint64_t cbLeft = cbTotal;
+    while (RT_SUCCESS(rc) && cbLeft > 0)
+    {
+        size_t cbChunk = (size_t)RT_MIN(cbLeft, TSTNETBENCH_CHUNK);
+        rc = RTTcpWrite(hSock, pbBuf, cbChunk);
+        cbLeft -= cbChunk;
+    }
+    char chAck;
+    if (RT_SUCCESS(rc))
+        rc = tstNetBenchReadAll(hSock, &chAck, 1);
+
+    RTMemFree(pbBuf);
+    RTTcpClientClose(hSock);
+    return rc;
+}
+
+
+/**
+ * Measures the bulk throughput from the client to the server.
+ */
+static void tstNetBenchBulk(const char *pszAddress, uint32_t uPort, uint64_t cbTotal)
+{
+    RTTestSub(g_hTest, "Throughput");
+
+    uint64_t const u64Start   = RTTimeNanoTS();
+    int            rc         = tstNetBenchBulkTransfer(pszAddress, uPort, cbTotal);
+    uint64_t const cNsElapsed = RTTimeNanoTS() - u64Start;
+
+    if (RT_SUCCESS(rc))
+    {
+        RTTestValue(g_hTest, "Transferred", cbTotal, RTTESTUNIT_BYTES);
+        RTTestValue(g_hTest, "Throughput", cbTotal * RT_NS_1SEC / RT_MAX(cNsElapsed, 1) / _1K, RTTESTUNIT_KILOBYTES_PER_SEC);
+    }
+    else
+        RTTestFailed(g_hTest, "bulk transfer to %s:%u failed: %Rrc", pszAddress, uPort, rc);
+}
+
+
+/**
+ * Thread doing one stream of the parallel throughput test.
+ */
+static DECLCALLBACK(int) tstNetBenchStreamThread(RTTHREAD hThread, void *pvUser)
+{
+    TSTNETBENCHSTREAM *pStream = (TSTNETBENCHSTREAM *)pvUser;
+    NOREF(hThread);
+    pStream->rc = tstNetBenchBulkTransfer(pStream->pszAddress, pStream->uPort, pStream->cbTotal);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Measures the combined bulk throughput of several parallel streams, stream
+ * i connects to port uPort + i.
+ */
+static void tstNetBenchStreams(const char *pszAddress, uint32_t uPort, uint32_t cStreams, uint64_t cbTotal)
+{
+    RTTestSubF(g_hTest, "Throughput, %u streams", cStreams);
+
+    TSTNETBENCHSTREAM aStreams[TSTNETBENCH_MAX_STREAMS];
+    uint64_t const    u64Start = RTTimeNanoTS();
+    uint32_t          cStarted = 0;
+    int               rc       = VINF_SUCCESS;
+    for (; cStarted < cStreams; cStarted++)
+    {
+        TSTNETBENCHSTREAM *pStream = &aStreams[cStarted];
+        pStream->pszAddress = pszAddress;
+        pStream->uPort      = uPort + cStarted;
+        pStream->cbTotal    = cbTotal / cStreams;
+        pStream->rc         = VERR_INTERNAL_ERROR;
+        rc = RTThreadCreateF(&pStream->hThread, tstNetBenchStreamThread, pStream, 0, RTTHREADTYPE_DEFAULT,
+                             RTTHREADFLAGS_WAITABLE, "STREAM%u", cStarted);
+        if (RT_FAILURE(rc))
+        {
+            RTTestFailed(g_hTest, "RTThreadCreateF failed: %Rrc", rc);
+            break;
+        }
+    }
+
+    uint64_t cbDone = 0;
+    for (uint32_t i = 0; i < cStarted; i++)
+    {
+        RTThreadWait(aStreams[i].hThread, RT_INDEFINITE_WAIT, NULL);
+        if (RT_SUCCESS(aStreams[i].rc))
+            cbDone += aStreams[i].cbTotal;
+        else
+        {
+            RTTestFailed(g_hTest, "stream to %s:%u failed: %Rrc", pszAddress, aStreams[i].uPort, aStreams[i].rc);
+            rc = aStreams[i].rc;
+        }
+    }
+    uint64_t const cNsElapsed = RTTimeNanoTS() - u64Start;
+
+    if (RT_SUCCESS(rc))
+    {
+        RTTestValue(g_hTest, "Transferred", cbDone, RTTESTUNIT_BYTES);
+        RTTestValue(g_hTest, "Throughput", cbDone * RT_NS_1SEC / RT_MAX(cNsElapsed, 1) / _1K, RTTESTUNIT_KILOBYTES_PER_SEC);
+    }
+}
+
+
+/**
+ * Measures the round trip latency with small messages.
+ */
+static void tstNetBenchPing(const char *pszAddress, uint32_t uPort, uint32_t cRoundTrips)
+{
+    RTTestSub(g_hTest, "Latency");
+
+    RTSOCKET hSock;
+    int rc = tstNetBenchConnect(pszAddress, uPort, TSTNETBENCH_REQ_PING, &hSock);
+    if (RT_FAILURE(rc))
+    {
+        RTTestFailed(g_hTest, "connecting to %s:%u failed: %Rrc", pszAddress, uPort, rc);
+        return;
+    }
+
+    uint8_t  abMsg[TSTNETBENCH_PING_SIZE];
+    uint64_t cNsMin = UINT64_MAX;
+    uint64_t cNsMax = 0;
+    uint64_t cNsTotal = 0;
+    memset(abMsg, 0x55, sizeof(abMsg));
+    for (uint32_t i = 0; i < cRoundTrips && RT_SUCCESS(rc); i++)
+    {
+        uint64_t const u64Start = RTTimeNanoTS();
+        rc = RTTcpWrite(hSock, abMsg, sizeof(abMsg));
+        if (RT_SUCCESS(rc))
+            rc = tstNetBenchReadAll(hSock, abMsg, sizeof(abMsg));
+        uint64_t const cNs = RTTimeNanoTS() - u64Start;
+        cNsTotal += cNs;
+        cNsMin = RT_MIN(cNsMin, cNs);
+        cNsMax = RT_MAX(cNsMax, cNs);
+    }
+
+    if (RT_SUCCESS(rc) && cRoundTrips)
+    {
+        RTTestValue(g_hTest, "Average", cNsTotal / cRoundTrips, RTTESTUNIT_NS_PER_ROUND_TRIP);
+        RTTestValue(g_hTest, "Minimum", cNsMin, RTTESTUNIT_NS_PER_ROUND_TRIP);
+        RTTestValue(g_hTest, "Maximum", cNsMax, RTTESTUNIT_NS_PER_ROUND_TRIP);
+    }
+    else if (RT_FAILURE(rc))
+        RTTestFailed(g_hTest, "round trip failed: %Rrc", rc);
+
+    RTTcpClientClose(hSock);
+}
+
+
+/**
+ * Measures how many connections per second can be set up and torn down.
+ */
+static void tstNetBenchConnectRate(const char *pszAddress, uint32_t uPort, uint32_t cConnections)
+{
+    RTTestSub(g_hTest, "Connection setup");
+
+    int            rc       = VINF_SUCCESS;
+    uint32_t       cDone    = 0;
+    uint64_t const u64Start = RTTimeNanoTS();
+    for (; cDone < cConnections; cDone++)
+    {
+        RTSOCKET hSock;
+        rc = tstNetBenchConnect(pszAddress, uPort, TSTNETBENCH_REQ_CONNECT, &hSock);
+        if (RT_FAILURE(rc))
+            break;
+        char chAck;
+        rc = tstNetBenchReadAll(hSock, &chAck, 1);
+        RTTcpClientClose(hSock);
+        if (RT_FAILURE(rc))
+            break;
+    }
+    uint64_t const cNsElapsed = RTTimeNanoTS() - u64Start;
+
+    if (RT_SUCCESS(rc))
+    {
+        RTTestValue(g_hTest, "Connections", cDone, RTTESTUNIT_OCCURRENCES);
+        RTTestValue(g_hTest, "Rate", (uint64_t)cDone * RT_NS_1SEC / RT_MAX(cNsElapsed, 1), RTTESTUNIT_OCCURRENCES_PER_SEC);
+    }
+    else
+        RTTestFailed(g_hTest, "connection #%u failed: %Rrc", cDone, rc);
+}
+
+
+int main(int argc, char **argv)
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstNetBench", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+
+    static RTGETOPTDEF const s_aOptions[] =
+    {
+        { "--server",       's', RTGETOPT_REQ_NOTHING },
+        { "--client",       'c', RTGETOPT_REQ_STRING  },
+        { "--bind",         'b', RTGETOPT_REQ_STRING  },
+        { "--port",         'p', RTGETOPT_REQ_UINT32  },
+        { "--bytes",        'n', RTGETOPT_REQ_UINT64  },
+        { "--round-trips",  'r', RTGETOPT_REQ_UINT32  },
+        { "--connections",  'C', RTGETOPT_REQ_UINT32  },
+        { "--streams",      'S', RTGETOPT_REQ_UINT32  },
+    };
+
+    bool        fServer      = false;
+    const char *pszClient    = NULL;
+    const char *pszBind      = NULL;
+    uint32_t    uPort        = TSTNETBENCH_PORT;
+    uint64_t    cbBulk       = 64 * _1M;
+    uint32_t    cRoundTrips  = 10000;
+    uint32_t    cConnections = 1000;
+    uint32_t    cStreams     = 1;
+
+    int ch;
+    RTGETOPTUNION Value;
+    RTGETOPTSTATE GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0 /* fFlags */);
+    while ((ch = RTGetOpt(&GetState, &Value)))
+    {
+        switch (ch)
+        {
+            case 's': fServer = true; break;
+            case 'c': pszClient = Value.psz; break;
+            case 'b': pszBind = Value.psz; break;
+            case 'p': uPort = Value.u32; break;
+            case 'n': cbBulk = Value.u64; break;
+            case 'r': cRoundTrips = Value.u32; break;
+            case 'C': cConnections = Value.u32; break;
+            case 'S':
+                if (Value.u32 < 1 || Value.u32 > TSTNETBENCH_MAX_STREAMS)
+                    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "--streams must be between 1 and %u", TSTNETBENCH_MAX_STREAMS);
+                cStreams = Value.u32;
+                break;
+
+            case 'h':
+                RTPrintf("Usage: tstNetBench [--server [--bind <addr>]] [--client <addr>] [--port <port>]\n"
+                         "                   [--bytes <n>] [--round-trips <n>] [--connections <n>] [--streams <n>]\n"
+                         "Without --server and --client both ends run here over loopback.\n");
+                return RTEXITCODE_SUCCESS;
+
+            default:
+                return RTGetOptPrintError(ch, &Value);
+        }
+    }
+
+    /*
+     * Server only.  The first port is served here, the other streams get
+     * server threads.
+     */
+    PRTTCPSERVER apServers[TSTNETBENCH_MAX_STREAMS] = { NULL };
+    if (fServer)
+    {
+        RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "serving on %s:%u-%u\n", pszBind ? pszBind : "*", uPort, uPort + cStreams - 1);
+        int rc = VINF_SUCCESS;
+        for (uint32_t i = 1; i < cStreams && RT_SUCCESS(rc); i++)
+        {
+            rc = RTTcpServerCreate(pszBind, uPort + i, RTTHREADTYPE_IO, "NETBENCH", tstNetBenchServe, NULL, &apServers[i]);
+            if (RT_FAILURE(rc))
+                RTTestFailed(g_hTest, "RTTcpServerCreate failed for port %u: %Rrc", uPort + i, rc);
+        }
+        if (RT_SUCCESS(rc))
+        {
+            rc = RTTcpServerCreateEx(pszBind, uPort, &apServers[0]);
+            if (RT_SUCCESS(rc))
+            {
+                rc = RTTcpServerListen(apServers[0], tstNetBenchServe, NULL);
+                if (RT_FAILURE(rc) && rc != VERR_TCP_SERVER_STOP)
+                    RTTestFailed(g_hTest, "RTTcpServerListen failed: %Rrc", rc);
+            }
+            else
+                RTTestFailed(g_hTest, "RTTcpServerCreateEx failed: %Rrc", rc);
+        }
+        for (uint32_t i = 0; i < cStreams; i++)
+            if (apServers[i])
+                RTTcpServerDestroy(apServers[i]);
+        return RTTestSummaryAndDestroy(g_hTest);
+    }
+
+    /*
+     * Client, with local servers if no address was given.
+     */
+    if (!pszClient)
+    {
+        pszClient = "127.0.0.1";
+        for (uint32_t i = 0; i < cStreams; i++)
+        {
+            int rc = RTTcpServerCreate(pszClient, uPort + i, RTTHREADTYPE_IO, "NETBENCH", tstNetBenchServe, NULL, &apServers[i]);
+            if (RT_FAILURE(rc))
+            {
+                RTTestFailed(g_hTest, "RTTcpServerCreate failed for port %u: %Rrc", uPort + i, rc);
+                break;
+            }
+        }
+    }
+
+    if (!RTTestErrorCount(g_hTest))
+    {
+        tstNetBenchBulk(pszClient, uPort, cbBulk);
+        if (cStreams > 1)
+            tstNetBenchStreams(pszClient, uPort, cStreams, cbBulk);
+        tstNetBenchPing(pszClient, uPort, cRoundTrips);
+        tstNetBenchConnectRate(pszClient, uPort, cConnections);
+    }
+
+    for (uint32_t i = 0; i < cStreams; i++)
+        if (apServers[i])
+            RTTcpServerDestroy(apServers[i]);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
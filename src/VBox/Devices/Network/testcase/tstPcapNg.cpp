@@ -0,0 +1,228 @@
+/* $Id$ */
+/** @file
+ * VBox - Testcase for the pcapng block formatters used by the network sniffer.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <iprt/test.h>
+#include <iprt/net.h>
+#include <iprt/string.h>
+
+#include "../Pcap.h"
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The test handle. */
+static RTTEST g_hTest;
+
+
+/**
+ * Reads a 32-bit value in host byte order, which is what pcapng is written in.
+ */
+static uint32_t tstGetU32(uint8_t const *pb, size_t off)
+{
+    uint32_t u32;
+    memcpy(&u32, &pb[off], sizeof(u32));
+    return u32;
+}
+
+
+/**
+ * Checks the framing of a block: the type, the total length at both ends and
+ * the 32-bit alignment.
+ *
+ * @returns The offset of the end of the fixed part + options area, i.e. where
+ *          the trailing length starts, 0 on failure.
+ * @param   pb              The block.
+ * @param   cb              The size returned by the formatter.
+ * @param   uType           The expected block type.
+ */
+static size_t tstCheckBlock(uint8_t const *pb, size_t cb, uint32_t uType)
+{
+    RTTESTI_CHECK_RET(cb >= 16, 0);
+    RTTESTI_CHECK_RET(!(cb & 3), 0);
+    RTTESTI_CHECK_RET(tstGetU32(pb, 0) == uType, 0);
+    RTTESTI_CHECK_RET(tstGetU32(pb, 4) == cb, 0);
+    RTTESTI_CHECK_RET(tstGetU32(pb, cb - 4) == cb, 0);
+    return cb - 4;
+}
+
+
+/**
+ * Finds an option in the options area of a block.
+ *
+ * @returns Pointer to the option value, NULL if not found or malformed.
+ * @param   pb              The block.
+ * @param   offOptions      Where the options start.
+ * @param   offEnd          Where the options area ends.
+ * @param   uCode           The option code to look for.
+ * @param   pcbValue        Where to return the value size.
+ */
+static uint8_t const *tstFindOption(uint8_t const *pb, size_t offOptions, size_t offEnd, uint16_t uCode, uint16_t *pcbValue)
+{
+    size_t off = offOptions;
+    while (off + 4 <= offEnd)
+    {
+        uint16_t uOptCode, cbValue;
+        memcpy(&uOptCode, &pb[off], sizeof(uOptCode));
+        memcpy(&cbValue, &pb[off + 2], sizeof(cbValue));
+        if (uOptCode == 0 /* opt_endofopt */)
+            return NULL;
+        if (off + 4 + RT_ALIGN_32(cbValue, 4) > offEnd)
+            break;
+        if (uOptCode == uCode)
+        {
+            *pcbValue = cbValue;
+            return &pb[off + 4];
+        }
+        off += 4 + RT_ALIGN_32(cbValue, 4);
+    }
+    RTTestIFailed("option %u not found or options malformed\n", uCode);
+    return NULL;
+}
+
+
+static void tstSectionHdr(void)
+{
+    RTTestISub("Section header");
+    uint8_t abBuf[512];
+
+    size_t cb = PcapNgFormatSectionHdr(abBuf, sizeof(abBuf), "VirtualBox");
+    size_t offEnd = tstCheckBlock(abBuf, cb, UINT32_C(0x0a0d0d0a));
+    RTTESTI_CHECK_RETV(offEnd);
+    RTTESTI_CHECK(tstGetU32(abBuf, 8) == UINT32_C(0x1a2b3c4d));
+    RTTESTI_CHECK(tstGetU32(abBuf, 12) == RT_MAKE_U32(1, 0));
+    RTTESTI_CHECK(tstGetU32(abBuf, 16) == UINT32_MAX && tstGetU32(abBuf, 20) == UINT32_MAX);
+
+    uint16_t cbValue = 0;
+    uint8_t const *pbValue = tstFindOption(abBuf, 24, offEnd, 4 /* shb_userappl */, &cbValue);
+    RTTESTI_CHECK(pbValue && cbValue == 10 && !memcmp(pbValue, "VirtualBox", 10));
+
+    RTTESTI_CHECK(PcapNgFormatSectionHdr(abBuf, cb - 1, "VirtualBox") == 0);
+}
+
+
+static void tstIfDesc(void)
+{
+    RTTestISub("Interface description");
+    static RTMAC const s_Mac = { { 0x08, 0x00, 0x27, 0x12, 0x34, 0x56 } };
+    uint8_t abBuf[512];
+
+    size_t cb = PcapNgFormatIfDesc(abBuf, sizeof(abBuf), "NetSniffer#0", "desc", &s_Mac, 1514);
+    size_t offEnd = tstCheckBlock(abBuf, cb, 1);
+    RTTESTI_CHECK_RETV(offEnd);
+    RTTESTI_CHECK(tstGetU32(abBuf, 8) == 1 /* LINKTYPE_ETHERNET */);
+    RTTESTI_CHECK(tstGetU32(abBuf, 12) == 1514);
+
+    uint16_t cbValue = 0;
+    uint8_t const *pbValue = tstFindOption(abBuf, 16, offEnd, 2 /* if_name */, &cbValue);
+    RTTESTI_CHECK(pbValue && cbValue == 12 && !memcmp(pbValue, "NetSniffer#0", 12));
+    pbValue = tstFindOption(abBuf, 16, offEnd, 3 /* if_description */, &cbValue);
+    RTTESTI_CHECK(pbValue && cbValue == 4 && !memcmp(pbValue, "desc", 4));
+    pbValue = tstFindOption(abBuf, 16, offEnd, 6 /* if_MACaddr */, &cbValue);
+    RTTESTI_CHECK(pbValue && cbValue == 6 && !memcmp(pbValue, &s_Mac, 6));
+    pbValue = tstFindOption(abBuf, 16, offEnd, 9 /* if_tsresol */, &cbValue);
+    RTTESTI_CHECK(pbValue && cbValue == 1 && *pbValue == 9);
+
+    /* No MAC address, no option. */
+    size_t cb2 = PcapNgFormatIfDesc(abBuf, sizeof(abBuf), "NetSniffer#0", "desc", NULL, 1514);
+    RTTESTI_CHECK(cb2 == cb - 12);
+    RTTESTI_CHECK(tstCheckBlock(abBuf, cb2, 1) != 0);
+
+    RTTESTI_CHECK(PcapNgFormatIfDesc(abBuf, 16, "NetSniffer#0", "desc", &s_Mac, 1514) == 0);
+}
+
+
+static void tstPacket(void)
+{
+    RTTestISub("Enhanced packet");
+    uint8_t abFrame[61];
+    for (unsigned i = 0; i < sizeof(abFrame); i++)
+        abFrame[i] = (uint8_t)(i * 7 + 1);
+    uint8_t abBuf[256];
+    memset(abBuf, 0xcc, sizeof(abBuf));
+
+    uint64_t const u64Ts = UINT64_C(0x0123456789abcdef);
+    size_t cb = PcapNgFormatPacket(abBuf, sizeof(abBuf), 0, u64Ts, PCAPNG_EPB_FLAGS_INBOUND,
+                                   abFrame, sizeof(abFrame), 1514);
+    RTTESTI_CHECK(cb <= sizeof(abFrame) + PCAPNG_EPB_OVERHEAD);
+    size_t offEnd = tstCheckBlock(abBuf, cb, 6);
+    RTTESTI_CHECK_RETV(offEnd);
+    RTTESTI_CHECK(tstGetU32(abBuf, 8) == 0);
+    RTTESTI_CHECK(tstGetU32(abBuf, 12) == RT_HI_U32(u64Ts));
+    RTTESTI_CHECK(tstGetU32(abBuf, 16) == RT_LO_U32(u64Ts));
+    RTTESTI_CHECK(tstGetU32(abBuf, 20) == sizeof(abFrame));
+    RTTESTI_CHECK(tstGetU32(abBuf, 24) == 1514);
+    RTTESTI_CHECK(!memcmp(&abBuf[28], abFrame, sizeof(abFrame)));
+    for (size_t off = 28 + sizeof(abFrame); off < 28 + RT_ALIGN_Z(sizeof(abFrame), 4); off++)
+        RTTESTI_CHECK_MSG(abBuf[off] == 0, ("off=%zu\n", off));
+
+    uint16_t cbValue = 0;
+    uint8_t const *pbValue = tstFindOption(abBuf, 28 + RT_ALIGN_Z(sizeof(abFrame), 4), offEnd, 2 /* epb_flags */, &cbValue);
+    RTTESTI_CHECK(pbValue && cbValue == 4 && tstGetU32(pbValue, 0) == PCAPNG_EPB_FLAGS_INBOUND);
+    RTTESTI_CHECK(abBuf[cb] == 0xcc);
+
+    /* No flags, no options but the end marker. */
+    cb = PcapNgFormatPacket(abBuf, sizeof(abBuf), 1, u64Ts, 0, abFrame, 60, 60);
+    RTTESTI_CHECK(tstCheckBlock(abBuf, cb, 6) == 28 + 60 + 4);
+    RTTESTI_CHECK(tstGetU32(abBuf, 8) == 1);
+
+    RTTESTI_CHECK(PcapNgFormatPacket(abBuf, sizeof(abFrame) + PCAPNG_EPB_OVERHEAD - 1, 0, u64Ts,
+                                     PCAPNG_EPB_FLAGS_OUTBOUND, abFrame, sizeof(abFrame), sizeof(abFrame)) == 0);
+}
+
+
+static void tstIfStats(void)
+{
+    RTTestISub("Interface statistics");
+    uint8_t abBuf[64];
+
+    uint64_t const u64Ts = UINT64_C(0x1122334455667788);
+    size_t cb = PcapNgFormatIfStats(abBuf, sizeof(abBuf), 0, u64Ts, 4242);
+    size_t offEnd = tstCheckBlock(abBuf, cb, 5);
+    RTTESTI_CHECK_RETV(offEnd);
+    RTTESTI_CHECK(tstGetU32(abBuf, 8) == 0);
+    RTTESTI_CHECK(tstGetU32(abBuf, 12) == RT_HI_U32(u64Ts));
+    RTTESTI_CHECK(tstGetU32(abBuf, 16) == RT_LO_U32(u64Ts));
+
+    uint16_t cbValue = 0;
+    uint8_t const *pbValue = tstFindOption(abBuf, 20, offEnd, 5 /* isb_ifdrop */, &cbValue);
+    uint64_t cDropped = 0;
+    if (pbValue && cbValue == sizeof(cDropped))
+        memcpy(&cDropped, pbValue, sizeof(cDropped));
+    RTTESTI_CHECK(cDropped == 4242);
+
+    RTTESTI_CHECK(PcapNgFormatIfStats(abBuf, 39, 0, u64Ts, 4242) == 0);
+}
+
+
+int main()
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstPcapNg", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    tstSectionHdr();
+    tstIfDesc();
+    tstPacket();
+    tstIfStats();
+
+    return RTTestSummaryAndDestroy(g_hTest);
+}
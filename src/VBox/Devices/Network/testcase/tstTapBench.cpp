@@ -0,0 +1,568 @@
+/* $Id$ */
+/** @file
+ * VBox - Loopback throughput benchmark for the Linux TAP I/O DrvTAP uses.
+ *
+ * Creates a TAP device in IFF_VNET_HDR mode, optionally with several
+ * IFF_MULTI_QUEUE queues, gives the host end an address and then measures
+ * both directions the way DrvTAP does them: frames written with writev()
+ * behind a virtio-net header and delivered to a host UDP socket, and
+ * datagrams sent by the host read back in readv() batches on one thread per
+ * queue.  Needs CAP_NET_ADMIN, the test is skipped without it.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <iprt/test.h>
+#include <iprt/asm.h>
+#include <iprt/err.h>
+#include <iprt/getopt.h>
+#include <iprt/message.h>
+#include <iprt/net.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/if_tun.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+#ifndef IFF_VNET_HDR
+# define IFF_VNET_HDR               0x4000
+#endif
+#ifndef IFF_MULTI_QUEUE
+# define IFF_MULTI_QUEUE            0x0100
+#endif
+
+/** The max number of queues. */
+#define TSTTAPBENCH_MAX_QUEUES      8
+/** The UDP port the frames are sent to, in both directions. */
+#define TSTTAPBENCH_PORT            5101
+/** The address of the host end of the TAP device. */
+#define TSTTAPBENCH_HOST_ADDR       "10.200.0.1"
+/** The address of the pretend guest behind the TAP device. */
+#define TSTTAPBENCH_GUEST_ADDR      "10.200.0.2"
+/** The UDP payload size. */
+#define TSTTAPBENCH_PAYLOAD         1400
+/** The size of the frames we build. */
+#define TSTTAPBENCH_FRAME_SIZE      (sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + sizeof(RTNETUDP) + TSTTAPBENCH_PAYLOAD)
+/** How long the receivers wait for more frames before giving up, in ms. */
+#define TSTTAPBENCH_IDLE_MS         1000
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/** The virtio-net header preceding each frame (IFF_VNET_HDR). */
+#pragma pack(1)
+typedef struct TSTTAPVNETHDR
+{
+    uint8_t     u8Flags;
+    uint8_t     u8GsoType;
+    uint16_t    u16HdrLen;
+    uint16_t    u16GsoSize;
+    uint16_t    u16CSumStart;
+    uint16_t    u16CSumOffset;
+} TSTTAPVNETHDR;
+#pragma pack()
+AssertCompileSize(TSTTAPVNETHDR, 10);
+
+/**
+ * Per queue state.
+ */
+typedef struct TSTTAPQUEUE
+{
+    /** The TAP file descriptor of the queue. */
+    int             fd;
+    /** The queue number. */
+    uint32_t        iQueue;
+    /** The number of frames to write (transmit test). */
+    uint32_t        cFrames;
+    /** The number of matching frames read (receive test). */
+    uint32_t volatile cReceived;
+    /** The thread. */
+    RTTHREAD        hThread;
+} TSTTAPQUEUE;
+typedef TSTTAPQUEUE *PTSTTAPQUEUE;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+static RTTEST       g_hTest;
+/** The queues. */
+static TSTTAPQUEUE  g_aQueues[TSTTAPBENCH_MAX_QUEUES];
+/** The number of queues. */
+static uint32_t     g_cQueues = 1;
+/** The name of the TAP device. */
+static char         g_szIfName[IFNAMSIZ];
+/** The MAC address of the host end. */
+static RTMAC        g_HostMac;
+/** The MAC address of the pretend guest. */
+static RTMAC const  g_GuestMac = {{ 0x02, 0x00, 0x0a, 0xc8, 0x00, 0x02 }};
+/** Total number of matching frames read in the receive test. */
+static uint32_t volatile g_cRecvTotal;
+/** The number of frames the receive test expects. */
+static uint32_t     g_cRecvExpected;
+
+
+/**
+ * Creates the TAP device with g_cQueues queues.
+ *
+ * @returns IPRT status code, VERR_ACCESS_DENIED if we lack the privileges.
+ */
+static int tstTapBenchCreate(void)
+{
+    for (uint32_t i = 0; i < g_cQueues; i++)
+    {
+        int fd = open("/dev/net/tun", O_RDWR);
+        if (fd < 0)
+            return errno == EACCES || errno == EPERM ? VERR_ACCESS_DENIED : RTErrConvertFromErrno(errno);
+
+        struct ifreq IfReq;
+        RT_ZERO(IfReq);
+        IfReq.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_VNET_HDR | (g_cQueues > 1 ? IFF_MULTI_QUEUE : 0);
+        RTStrCopy(IfReq.ifr_name, sizeof(IfReq.ifr_name), i ? g_szIfName : "vboxtapbench%d");
+        if (ioctl(fd, TUNSETIFF, &IfReq) < 0)
+        {
+            int rc = errno == EACCES || errno == EPERM ? VERR_ACCESS_DENIED : RTErrConvertFromErrno(errno);
+            close(fd);
+            return rc;
+        }
+        RTStrCopy(g_szIfName, sizeof(g_szIfName), IfReq.ifr_name);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        g_aQueues[i].fd     = fd;
+        g_aQueues[i].iQueue = i;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Gives the host end its address, brings it up and adds a neighbour entry
+ * for the pretend guest so the host doesn't need to ARP for it.
+ *
+ * @returns IPRT status code.
+ */
+static int tstTapBenchConfigure(void)
+{
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0)
+        return RTErrConvertFromErrno(errno);
+
+    int                 rc = VINF_SUCCESS;
+    struct ifreq        IfReq;
+    struct sockaddr_in *pAddr = (struct sockaddr_in *)&IfReq.ifr_addr;
+    RT_ZERO(IfReq);
+    RTStrCopy(IfReq.ifr_name, sizeof(IfReq.ifr_name), g_szIfName);
+    pAddr->sin_family      = AF_INET;
+    pAddr->sin_addr.s_addr = inet_addr(TSTTAPBENCH_HOST_ADDR);
+    if (ioctl(s, SIOCSIFADDR, &IfReq) < 0)
+        rc = RTErrConvertFromErrno(errno);
+    pAddr->sin_addr.s_addr = inet_addr("255.255.255.0");
+    if (RT_SUCCESS(rc) && ioctl(s, SIOCSIFNETMASK, &IfReq) < 0)
+        rc = RTErrConvertFromErrno(errno);
+    if (RT_SUCCESS(rc) && ioctl(s, SIOCGIFFLAGS, &IfReq) < 0)
+        rc = RTErrConvertFromErrno(errno);
+    IfReq.ifr_flags |= IFF_UP;
+    if (RT_SUCCESS(rc) && ioctl(s, SIOCSIFFLAGS, &IfReq) < 0)
+        rc = RTErrConvertFromErrno(errno);
+    if (RT_SUCCESS(rc) && ioctl(s, SIOCGIFHWADDR, &IfReq) < 0)
+        rc = RTErrConvertFromErrno(errno);
+    if (RT_SUCCESS(rc))
+        memcpy(&g_HostMac, IfReq.ifr_hwaddr.sa_data, sizeof(g_HostMac));
+
+    if (RT_SUCCESS(rc))
+    {
+        struct arpreq ArpReq;
+        RT_ZERO(ArpReq);
+        pAddr = (struct sockaddr_in *)&ArpReq.arp_pa;
+        pAddr->sin_family      = AF_INET;
+        pAddr->sin_addr.s_addr = inet_addr(TSTTAPBENCH_GUEST_ADDR);
+        ArpReq.arp_ha.sa_family = ARPHRD_ETHER;
+        memcpy(ArpReq.arp_ha.sa_data, &g_GuestMac, sizeof(g_GuestMac));
+        ArpReq.arp_flags = ATF_COM;
+        RTStrCopy(ArpReq.arp_dev, sizeof(ArpReq.arp_dev), g_szIfName);
+        if (ioctl(s, SIOCSARP, &ArpReq) < 0)
+            rc = RTErrConvertFromErrno(errno);
+    }
+    close(s);
+    return rc;
+}
+
+
+/**
+ * Builds a UDP frame from the pretend guest to the host.
+ *
+ * @param   pbFrame         Where to build it, TSTTAPBENCH_FRAME_SIZE bytes.
+ * @param   uSrcPort        The source port, one per queue so each queue
+ *                          carries its own flow.
+ */
+static void tstTapBenchBuildFrame(uint8_t *pbFrame, uint16_t uSrcPort)
+{
+    memset(pbFrame, 0, TSTTAPBENCH_FRAME_SIZE);
+    PRTNETETHERHDR pEthHdr = (PRTNETETHERHDR)pbFrame;
+    pEthHdr->DstMac    = g_HostMac;
+    pEthHdr->SrcMac    = g_GuestMac;
+    pEthHdr->EtherType = RT_H2BE_U16_C(RTNET_ETHERTYPE_IPV4);
+
+    PRTNETIPV4 pIpHdr = (PRTNETIPV4)(pEthHdr + 1);
+    pIpHdr->ip_v       = 4;
+    pIpHdr->ip_hl      = RTNETIPV4_MIN_LEN / 4;
+    pIpHdr->ip_len     = RT_H2BE_U16((uint16_t)(RTNETIPV4_MIN_LEN + sizeof(RTNETUDP) + TSTTAPBENCH_PAYLOAD));
+    pIpHdr->ip_ttl     = 64;
+    pIpHdr->ip_p       = RTNETIPV4_PROT_UDP;
+    pIpHdr->ip_src.u   = inet_addr(TSTTAPBENCH_GUEST_ADDR);
+    pIpHdr->ip_dst.u   = inet_addr(TSTTAPBENCH_HOST_ADDR);
+    pIpHdr->ip_sum     = RTNetIPv4HdrChecksum(pIpHdr);
+
+    PRTNETUDP pUdpHdr = (PRTNETUDP)(pIpHdr + 1);
+    pUdpHdr->uh_sport = RT_H2BE_U16(uSrcPort);
+    pUdpHdr->uh_dport = RT_H2BE_U16_C(TSTTAPBENCH_PORT);
+    pUdpHdr->uh_ulen  = RT_H2BE_U16((uint16_t)(sizeof(RTNETUDP) + TSTTAPBENCH_PAYLOAD));
+    pUdpHdr->uh_sum   = 0; /* optional for IPv4 */
+}
+
+
+/**
+ * Transmit test thread: writes the frames of one queue like drvTAPWriteFrame.
+ */
+static DECLCALLBACK(int) tstTapBenchWriterThread(RTTHREAD hThread, void *pvUser)
+{
+    PTSTTAPQUEUE    pQueue = (PTSTTAPQUEUE)pvUser;
+    uint8_t         abFrame[TSTTAPBENCH_FRAME_SIZE];
+    TSTTAPVNETHDR   Hdr;
+    RT_ZERO(Hdr);
+    tstTapBenchBuildFrame(abFrame, (uint16_t)(TSTTAPBENCH_PORT + 1 + pQueue->iQueue));
+
+    struct iovec aIov[2];
+    aIov[0].iov_base = &Hdr;
+    aIov[0].iov_len  = sizeof(Hdr);
+    aIov[1].iov_base = abFrame;
+    aIov[1].iov_len  = sizeof(abFrame);
+    for (uint32_t i = 0; i < pQueue->cFrames; i++)
+    {
+        while (writev(pQueue->fd, &aIov[0], RT_ELEMENTS(aIov)) < 0)
+        {
+            if (errno != EAGAIN && errno != EINTR)
+                return RTErrConvertFromErrno(errno);
+            RTThreadYield();
+        }
+    }
+    NOREF(hThread);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Measures guest to host throughput: frames written to the queues and
+ * received on a host UDP socket.
+ *
+ * @param   cFrames         The number of frames to write.
+ */
+static void tstTapBenchTransmit(uint32_t cFrames)
+{
+    RTTestSub(g_hTest, "Transmit (writev)");
+
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    RTTESTI_CHECK_RETV(s >= 0);
+    int cbRcvBuf = 8 * _1M;
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, &cbRcvBuf, sizeof(cbRcvBuf));
+    struct timeval Timeout = { 0, TSTTAPBENCH_IDLE_MS * 1000 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+    struct sockaddr_in Addr;
+    RT_ZERO(Addr);
+    Addr.sin_family      = AF_INET;
+    Addr.sin_port        = htons(TSTTAPBENCH_PORT);
+    Addr.sin_addr.s_addr = inet_addr(TSTTAPBENCH_HOST_ADDR);
+    if (bind(s, (struct sockaddr *)&Addr, sizeof(Addr)) < 0)
+    {
+        RTTestFailed(g_hTest, "bind failed: %d", errno);
+        close(s);
+        return;
+    }
+
+    uint64_t const u64Start = RTTimeNanoTS();
+    for (uint32_t i = 0; i < g_cQueues; i++)
+    {
+        g_aQueues[i].cFrames = cFrames / g_cQueues + (i < cFrames % g_cQueues);
+        int rc = RTThreadCreateF(&g_aQueues[i].hThread, tstTapBenchWriterThread, &g_aQueues[i], 0,
+                                 RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "TAPTX%u", i);
+        if (RT_FAILURE(rc))
+        {
+            RTTestFailed(g_hTest, "RTThreadCreateF failed: %Rrc", rc);
+            g_aQueues[i].hThread = NIL_RTTHREAD;
+        }
+    }
+
+    /* Count until nothing arrived for a while; UDP may drop some. */
+    uint8_t  abBuf[TSTTAPBENCH_PAYLOAD + 64];
+    uint32_t cReceived = 0;
+    uint64_t u64Last   = u64Start;
+    while (cReceived < cFrames)
+    {
+        ssize_t cb = recv(s, abBuf, sizeof(abBuf), 0);
+        if (cb < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (cb == TSTTAPBENCH_PAYLOAD)
+        {
+            cReceived++;
+            u64Last = RTTimeNanoTS();
+        }
+    }
+
+    for (uint32_t i = 0; i < g_cQueues; i++)
+        if (g_aQueues[i].hThread != NIL_RTTHREAD)
+        {
+            int rcThread = VINF_SUCCESS;
+            RTThreadWait(g_aQueues[i].hThread, RT_INDEFINITE_WAIT, &rcThread);
+            if (RT_FAILURE(rcThread))
+                RTTestFailed(g_hTest, "writing to queue %u failed: %Rrc", i, rcThread);
+        }
+    close(s);
+
+    uint64_t const cNsElapsed = RT_MAX(u64Last - u64Start, 1);
+    RTTestValue(g_hTest, "Written", cFrames, RTTESTUNIT_PACKETS);
+    RTTestValue(g_hTest, "Received", cReceived, RTTESTUNIT_PACKETS);
+    RTTestValue(g_hTest, "Rate", (uint64_t)cReceived * RT_NS_1SEC / cNsElapsed, RTTESTUNIT_PACKETS_PER_SEC);
+    RTTestValue(g_hTest, "Throughput", (uint64_t)cReceived * TSTTAPBENCH_FRAME_SIZE * RT_NS_1SEC / cNsElapsed / _1K,
+                RTTESTUNIT_KILOBYTES_PER_SEC);
+    if (!cReceived)
+        RTTestFailed(g_hTest, "nothing arrived at %s:%u", TSTTAPBENCH_HOST_ADDR, TSTTAPBENCH_PORT);
+}
+
+
+/**
+ * Receive test thread: reads the frames of one queue in batches like the
+ * DrvTAP reader threads, until nothing comes for a while.
+ */
+static DECLCALLBACK(int) tstTapBenchReaderThread(RTTHREAD hThread, void *pvUser)
+{
+    PTSTTAPQUEUE    pQueue = (PTSTTAPQUEUE)pvUser;
+    uint8_t         abFrame[2048];
+    TSTTAPVNETHDR   Hdr;
+    struct iovec    aIov[2];
+    aIov[0].iov_base = &Hdr;
+    aIov[0].iov_len  = sizeof(Hdr);
+    aIov[1].iov_base = abFrame;
+    aIov[1].iov_len  = sizeof(abFrame);
+
+    while (ASMAtomicReadU32(&g_cRecvTotal) < g_cRecvExpected)
+    {
+        struct pollfd PollFd;
+        PollFd.fd      = pQueue->fd;
+        PollFd.events  = POLLIN;
+        PollFd.revents = 0;
+        int cReady = poll(&PollFd, 1, TSTTAPBENCH_IDLE_MS);
+        if (cReady == 0)
+            break;
+        if (cReady < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return RTErrConvertFromErrno(errno);
+        }
+
+        /* Drain everything that is there. */
+        ssize_t cb;
+        while ((cb = readv(pQueue->fd, &aIov[0], RT_ELEMENTS(aIov))) > 0)
+        {
+            size_t const   cbFrame = (size_t)cb - sizeof(Hdr);
+            PCRTNETIPV4    pIpHdr  = (PCRTNETIPV4)&abFrame[sizeof(RTNETETHERHDR)];
+            PCRTNETUDP     pUdpHdr = (PCRTNETUDP)(pIpHdr + 1);
+            if (   (size_t)cb > sizeof(Hdr)
+                && cbFrame >= sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + sizeof(RTNETUDP)
+                && ((PCRTNETETHERHDR)abFrame)->EtherType == RT_H2BE_U16_C(RTNET_ETHERTYPE_IPV4)
+                && pIpHdr->ip_p == RTNETIPV4_PROT_UDP
+                && pUdpHdr->uh_dport == RT_H2BE_U16_C(TSTTAPBENCH_PORT))
+            {
+                pQueue->cReceived++;
+                ASMAtomicIncU32(&g_cRecvTotal);
+            }
+        }
+    }
+    NOREF(hThread);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Measures host to guest throughput: datagrams sent by the host and read off
+ * the queues.
+ *
+ * @param   cFrames         The number of datagrams to send.
+ */
+static void tstTapBenchReceive(uint32_t cFrames)
+{
+    RTTestSub(g_hTest, "Receive (readv)");
+
+    /* One socket per queue so the kernel has a flow for each to steer. */
+    int aSocks[TSTTAPBENCH_MAX_QUEUES];
+    for (uint32_t i = 0; i < g_cQueues; i++)
+    {
+        aSocks[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        RTTESTI_CHECK(aSocks[i] >= 0);
+    }
+
+    g_cRecvTotal    = 0;
+    g_cRecvExpected = cFrames;
+    for (uint32_t i = 0; i < g_cQueues; i++)
+    {
+        g_aQueues[i].cReceived = 0;
+        int rc = RTThreadCreateF(&g_aQueues[i].hThread, tstTapBenchReaderThread, &g_aQueues[i], 0,
+                                 RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "TAPRX%u", i);
+        if (RT_FAILURE(rc))
+        {
+            RTTestFailed(g_hTest, "RTThreadCreateF failed: %Rrc", rc);
+            g_aQueues[i].hThread = NIL_RTTHREAD;
+        }
+    }
+
+    struct sockaddr_in Addr;
+    RT_ZERO(Addr);
+    Addr.sin_family      = AF_INET;
+    Addr.sin_port        = htons(TSTTAPBENCH_PORT);
+    Addr.sin_addr.s_addr = inet_addr(TSTTAPBENCH_GUEST_ADDR);
+    static uint8_t s_abPayload[TSTTAPBENCH_PAYLOAD];
+    uint64_t const u64Start = RTTimeNanoTS();
+    for (uint32_t i = 0; i < cFrames; i++)
+    {
+        int s = aSocks[i % g_cQueues];
+        while (sendto(s, s_abPayload, sizeof(s_abPayload), 0, (struct sockaddr *)&Addr, sizeof(Addr)) < 0)
+        {
+            if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR)
+            {
+                RTTestFailed(g_hTest, "sendto failed: %d", errno);
+                i = cFrames;
+                break;
+            }
+            RTThreadYield();
+        }
+    }
+
+    for (uint32_t i = 0; i < g_cQueues; i++)
+        if (g_aQueues[i].hThread != NIL_RTTHREAD)
+        {
+            int rcThread = VINF_SUCCESS;
+            RTThreadWait(g_aQueues[i].hThread, RT_INDEFINITE_WAIT, &rcThread);
+            if (RT_FAILURE(rcThread))
+                RTTestFailed(g_hTest, "reading queue %u failed: %Rrc", i, rcThread);
+        }
+    uint64_t cNsElapsed = RTTimeNanoTS() - u64Start;
+    if (g_cRecvTotal < cFrames) /* the readers idled out, don't count that */
+        cNsElapsed = cNsElapsed > TSTTAPBENCH_IDLE_MS * RT_NS_1MS ? cNsElapsed - TSTTAPBENCH_IDLE_MS * RT_NS_1MS : 1;
+    for (uint32_t i = 0; i < g_cQueues; i++)
+        close(aSocks[i]);
+
+    RTTestValue(g_hTest, "Sent", cFrames, RTTESTUNIT_PACKETS);
+    RTTestValue(g_hTest, "Received", g_cRecvTotal, RTTESTUNIT_PACKETS);
+    for (uint32_t i = 0; i < g_cQueues && g_cQueues > 1; i++)
+        RTTestValueF(g_hTest, g_aQueues[i].cReceived, RTTESTUNIT_PACKETS, "Received on queue %u", i);
+    RTTestValue(g_hTest, "Rate", (uint64_t)g_cRecvTotal * RT_NS_1SEC / RT_MAX(cNsElapsed, 1), RTTESTUNIT_PACKETS_PER_SEC);
+    RTTestValue(g_hTest, "Throughput", (uint64_t)g_cRecvTotal * TSTTAPBENCH_FRAME_SIZE * RT_NS_1SEC / RT_MAX(cNsElapsed, 1) / _1K,
+                RTTESTUNIT_KILOBYTES_PER_SEC);
+    if (!g_cRecvTotal)
+        RTTestFailed(g_hTest, "nothing was read from %s", g_szIfName);
+}
+
+
+int main(int argc, char **argv)
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstTapBench", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+
+    static RTGETOPTDEF const s_aOptions[] =
+    {
+        { "--frames",       'n', RTGETOPT_REQ_UINT32  },
+        { "--queues",       'q', RTGETOPT_REQ_UINT32  },
+    };
+
+    uint32_t cFrames = 200000;
+
+    int ch;
+    RTGETOPTUNION Value;
+    RTGETOPTSTATE GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0 /* fFlags */);
+    while ((ch = RTGetOpt(&GetState, &Value)))
+    {
+        switch (ch)
+        {
+            case 'n': cFrames = RT_MAX(Value.u32, 1); break;
+            case 'q':
+                if (Value.u32 < 1 || Value.u32 > TSTTAPBENCH_MAX_QUEUES)
+                    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "--queues must be between 1 and %u", TSTTAPBENCH_MAX_QUEUES);
+                g_cQueues = Value.u32;
+                break;
+
+            case 'h':
+                RTPrintf("Usage: tstTapBench [--frames <n>] [--queues <n>]\n"
+                         "Needs CAP_NET_ADMIN to create the TAP device.\n");
+                return RTEXITCODE_SUCCESS;
+
+            default:
+                return RTGetOptPrintError(ch, &Value);
+        }
+    }
+
+    for (uint32_t i = 0; i < RT_ELEMENTS(g_aQueues); i++)
+        g_aQueues[i].fd = -1;
+    int rc = tstTapBenchCreate();
+    if (rc == VERR_ACCESS_DENIED || rc == VERR_FILE_NOT_FOUND)
+    {
+        for (uint32_t i = 0; i < RT_ELEMENTS(g_aQueues); i++)
+            if (g_aQueues[i].fd >= 0)
+                close(g_aQueues[i].fd);
+        return RTTestSkipAndDestroy(g_hTest, "cannot create a TAP device: %Rrc", rc);
+    }
+    if (RT_FAILURE(rc))
+        RTTestFailed(g_hTest, "creating the TAP device failed: %Rrc", rc);
+    else
+    {
+        RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "%s with %u queue(s), %u frames of %u bytes\n",
+                     g_szIfName, g_cQueues, cFrames, (unsigned)TSTTAPBENCH_FRAME_SIZE);
+        rc = tstTapBenchConfigure();
+        if (RT_SUCCESS(rc))
+        {
+            tstTapBenchTransmit(cFrames);
+            tstTapBenchReceive(cFrames);
+        }
+        else
+            RTTestFailed(g_hTest, "configuring %s failed: %Rrc", g_szIfName, rc);
+    }
+
+    for (uint32_t i = 0; i < RT_ELEMENTS(g_aQueues); i++)
+        if (g_aQueues[i].fd >= 0)
+            close(g_aQueues[i].fd);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
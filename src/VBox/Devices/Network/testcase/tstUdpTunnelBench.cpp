@@ -0,0 +1,478 @@
+/* $Id$ */
+/** @file
+ * VBox - Loopback benchmark for the UDP tunnel transport.
+ *
+ * Pushes Ethernet sized datagrams between two sets of tunnel sockets over
+ * the loopback interface, the way two DrvUDPTunnel instances pointed at each
+ * other exchange frames.  It measures each transport the driver has: one
+ * syscall per datagram (the RTUdpWrite/RTUdpRead path of the other hosts),
+ * sendmmsg/recvmmsg batches of PDMNETWORK_MAX_BATCH, and UDP_SEGMENT/UDP_GRO
+ * when the host supports it.  With --sockets the datagrams are spread over
+ * several socket pairs on consecutive ports, like the driver's "sockets"
+ * key.
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/vmm/pdmnetifs.h>
+
+#include <iprt/test.h>
+#include <iprt/err.h>
+#include <iprt/getopt.h>
+#include <iprt/mem.h>
+#include <iprt/message.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <unistd.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+#ifndef SOL_UDP
+# define SOL_UDP                    17
+#endif
+#ifndef UDP_SEGMENT
+# define UDP_SEGMENT                103
+#endif
+#ifndef UDP_GRO
+# define UDP_GRO                    104
+#endif
+
+/** The max number of socket pairs, DRVUDPTUNNEL_MAX_SOCKETS. */
+#define TSTUDPTUNNEL_MAX_SOCKETS    8
+/** The default first port of the receiving end. */
+#define TSTUDPTUNNEL_PORT           5201
+/** The sending end uses the receiving end's ports plus this. */
+#define TSTUDPTUNNEL_PORT_OFFSET    100
+/** The largest UDP_SEGMENT datagram, DRVUDPTUNNEL_GSO_MAX_SIZE. */
+#define TSTUDPTUNNEL_GSO_MAX_SIZE   65000
+/** The max number of segments in a UDP_SEGMENT datagram. */
+#define TSTUDPTUNNEL_GSO_MAX_SEGS   64
+/** How long a receiver waits for more datagrams before giving up, in ms. */
+#define TSTUDPTUNNEL_IDLE_MS        1000
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * The transports being compared.
+ */
+typedef enum TSTUDPTUNNELMODE
+{
+    /** One send/recv per datagram. */
+    TSTUDPTUNNELMODE_SINGLE = 0,
+    /** sendmmsg/recvmmsg batches. */
+    TSTUDPTUNNELMODE_MMSG,
+    /** UDP_SEGMENT on send, UDP_GRO and recvmmsg on receive. */
+    TSTUDPTUNNELMODE_GSO
+} TSTUDPTUNNELMODE;
+
+/**
+ * One socket pair and its two threads.
+ */
+typedef struct TSTUDPTUNNELPAIR
+{
+    /** The sending socket. */
+    int                 fdSend;
+    /** The receiving socket. */
+    int                 fdRecv;
+    /** The transport. */
+    TSTUDPTUNNELMODE    enmMode;
+    /** The frame size. */
+    uint32_t            cbFrame;
+    /** The number of frames to send. */
+    uint32_t            cFrames;
+    /** The number of frames received. */
+    uint32_t            cReceived;
+    /** When the last frame arrived (RTTimeNanoTS). */
+    uint64_t            u64LastRecv;
+    /** The status of the sender. */
+    int                 rcSend;
+    /** The status of the receiver. */
+    int                 rcRecv;
+    /** The sender thread. */
+    RTTHREAD            hSender;
+    /** The receiver thread. */
+    RTTHREAD            hReceiver;
+} TSTUDPTUNNELPAIR;
+typedef TSTUDPTUNNELPAIR *PTSTUDPTUNNELPAIR;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+static RTTEST g_hTest;
+
+
+/**
+ * Creates a UDP socket bound to a loopback port, connected to another one
+ * if uPeerPort isn't zero.
+ *
+ * @returns The socket, -1 on failure.
+ */
+static int tstUdpTunnelSocket(uint32_t uPort, uint32_t uPeerPort)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -1;
+
+    int cbBuf = 8 * _1M;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &cbBuf, sizeof(cbBuf));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &cbBuf, sizeof(cbBuf));
+    struct timeval Timeout = { 0, TSTUDPTUNNEL_IDLE_MS * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+
+    struct sockaddr_in Addr;
+    RT_ZERO(Addr);
+    Addr.sin_family      = AF_INET;
+    Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Addr.sin_port        = htons((uint16_t)uPort);
+    if (bind(fd, (struct sockaddr *)&Addr, sizeof(Addr)) == 0)
+    {
+        if (!uPeerPort)
+            return fd;
+        Addr.sin_port = htons((uint16_t)uPeerPort);
+        if (connect(fd, (struct sockaddr *)&Addr, sizeof(Addr)) == 0)
+            return fd;
+    }
+    close(fd);
+    return -1;
+}
+
+
+/**
+ * Checks whether the host does UDP_SEGMENT and UDP_GRO.
+ */
+static bool tstUdpTunnelHasGso(void)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return false;
+    int  cbSegment = 1500;
+    int  fFlag     = 1;
+    bool fOk =    setsockopt(fd, SOL_UDP, UDP_SEGMENT, &cbSegment, sizeof(cbSegment)) == 0
+               && setsockopt(fd, SOL_UDP, UDP_GRO, &fFlag, sizeof(fFlag)) == 0;
+    close(fd);
+    return fOk;
+}
+
+
+/**
+ * Sender thread.
+ */
+static DECLCALLBACK(int) tstUdpTunnelSender(RTTHREAD hThread, void *pvUser)
+{
+    PTSTUDPTUNNELPAIR pPair = (PTSTUDPTUNNELPAIR)pvUser;
+    NOREF(hThread);
+
+    /* Frames per syscall and bytes per datagram. */
+    uint32_t cSegs = 1;
+    if (pPair->enmMode == TSTUDPTUNNELMODE_GSO)
+    {
+        cSegs = RT_MIN(TSTUDPTUNNEL_GSO_MAX_SIZE / pPair->cbFrame, TSTUDPTUNNEL_GSO_MAX_SEGS);
+        int cbSegment = (int)pPair->cbFrame;
+        if (setsockopt(pPair->fdSend, SOL_UDP, UDP_SEGMENT, &cbSegment, sizeof(cbSegment)) < 0)
+            return pPair->rcSend = RTErrConvertFromErrno(errno);
+    }
+    uint8_t *pbBuf = (uint8_t *)RTMemAllocZ(pPair->cbFrame * cSegs);
+    if (!pbBuf)
+        return pPair->rcSend = VERR_NO_MEMORY;
+
+    struct iovec   aIovs[PDMNETWORK_MAX_BATCH];
+    struct mmsghdr aMsgs[PDMNETWORK_MAX_BATCH];
+    RT_ZERO(aMsgs);
+    for (unsigned i = 0; i < RT_ELEMENTS(aMsgs); i++)
+    {
+        aIovs[i].iov_base           = pbBuf;
+        aIovs[i].iov_len            = pPair->cbFrame;
+        aMsgs[i].msg_hdr.msg_iov    = &aIovs[i];
+        aMsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int      rc    = VINF_SUCCESS;
+    uint32_t cLeft = pPair->cFrames;
+    while (cLeft > 0)
+    {
+        ssize_t cDone;
+        switch (pPair->enmMode)
+        {
+            case TSTUDPTUNNELMODE_SINGLE:
+                cDone = send(pPair->fdSend, pbBuf, pPair->cbFrame, 0) >= 0 ? 1 : -1;
+                break;
+            case TSTUDPTUNNELMODE_MMSG:
+                cDone = sendmmsg(pPair->fdSend, &aMsgs[0], RT_MIN(cLeft, RT_ELEMENTS(aMsgs)), 0);
+                break;
+            default:
+            {
+                uint32_t const cThis = RT_MIN(cLeft, cSegs);
+                cDone = send(pPair->fdSend, pbBuf, pPair->cbFrame * cThis, 0) >= 0 ? cThis : -1;
+                break;
+            }
+        }
+        if (cDone > 0)
+            cLeft -= (uint32_t)cDone;
+        else if (errno == ENOBUFS || errno == EAGAIN || errno == EINTR || errno == ECONNREFUSED)
+            RTThreadYield();
+        else
+        {
+            rc = RTErrConvertFromErrno(errno);
+            break;
+        }
+    }
+
+    RTMemFree(pbBuf);
+    return pPair->rcSend = rc;
+}
+
+
+/**
+ * Receiver thread, runs until it has all frames or none came for
+ * TSTUDPTUNNEL_IDLE_MS.
+ */
+static DECLCALLBACK(int) tstUdpTunnelReceiver(RTTHREAD hThread, void *pvUser)
+{
+    PTSTUDPTUNNELPAIR pPair = (PTSTUDPTUNNELPAIR)pvUser;
+    NOREF(hThread);
+
+    size_t const cbBuf = pPair->enmMode == TSTUDPTUNNELMODE_GSO ? _64K : pPair->cbFrame;
+    uint8_t     *pbRing = (uint8_t *)RTMemAlloc(cbBuf * PDMNETWORK_MAX_BATCH);
+    if (!pbRing)
+        return pPair->rcRecv = VERR_NO_MEMORY;
+    if (pPair->enmMode == TSTUDPTUNNELMODE_GSO)
+    {
+        int fFlag = 1;
+        setsockopt(pPair->fdRecv, SOL_UDP, UDP_GRO, &fFlag, sizeof(fFlag));
+    }
+
+    struct iovec   aIovs[PDMNETWORK_MAX_BATCH];
+    struct mmsghdr aMsgs[PDMNETWORK_MAX_BATCH];
+    union
+    {
+        struct cmsghdr  Hdr;
+        uint8_t         ab[CMSG_SPACE(sizeof(int))];
+    }              aCtls[PDMNETWORK_MAX_BATCH];
+
+    RT_ZERO(aMsgs);
+    for (unsigned i = 0; i < RT_ELEMENTS(aMsgs); i++)
+    {
+        aIovs[i].iov_base           = pbRing + i * cbBuf;
+        aIovs[i].iov_len            = cbBuf;
+        aMsgs[i].msg_hdr.msg_iov    = &aIovs[i];
+        aMsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int rc = VINF_SUCCESS;
+    while (pPair->cReceived < pPair->cFrames)
+    {
+        if (pPair->enmMode == TSTUDPTUNNELMODE_GSO)
+            for (unsigned i = 0; i < RT_ELEMENTS(aMsgs); i++)
+            {
+                aMsgs[i].msg_hdr.msg_control    = &aCtls[i];
+                aMsgs[i].msg_hdr.msg_controllen = sizeof(aCtls[i]);
+            }
+
+        int cMsgs;
+        if (pPair->enmMode == TSTUDPTUNNELMODE_SINGLE)
+        {
+            ssize_t cb = recv(pPair->fdRecv, pbRing, cbBuf, 0);
+            cMsgs = cb >= 0 ? 1 : -1;
+            aMsgs[0].msg_len = (unsigned)cb;
+        }
+        else
+            cMsgs = recvmmsg(pPair->fdRecv, &aMsgs[0], RT_ELEMENTS(aMsgs), MSG_WAITFORONE, NULL);
+        if (cMsgs < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                rc = RTErrConvertFromErrno(errno);
+            break; /* idle */
+        }
+
+        for (int i = 0; i < cMsgs; i++)
+        {
+            /* A coalesced datagram says what the segment size was. */
+            uint32_t cbSegment = pPair->cbFrame;
+            if (pPair->enmMode == TSTUDPTUNNELMODE_GSO)
+                for (struct cmsghdr *pCtl = CMSG_FIRSTHDR(&aMsgs[i].msg_hdr); pCtl; pCtl = CMSG_NXTHDR(&aMsgs[i].msg_hdr, pCtl))
+                    if (pCtl->cmsg_level == SOL_UDP && pCtl->cmsg_type == UDP_GRO)
+                    {
+                        int cbGro;
+                        memcpy(&cbGro, CMSG_DATA(pCtl), sizeof(cbGro));
+                        if (cbGro > 0)
+                            cbSegment = (uint32_t)cbGro;
+                    }
+            pPair->cReceived += (aMsgs[i].msg_len + cbSegment - 1) / cbSegment;
+        }
+        pPair->u64LastRecv = RTTimeNanoTS();
+    }
+
+    RTMemFree(pbRing);
+    return pPair->rcRecv = rc;
+}
+
+
+/**
+ * Runs one transport over cSockets socket pairs.
+ *
+ * @param   enmMode         The transport.
+ * @param   pszName         The sub-test name.
+ * @param   uPort           The first receiving port.
+ * @param   cSockets        The number of socket pairs.
+ * @param   cFrames         The total number of frames to send.
+ * @param   cbFrame         The frame size.
+ */
+static void tstUdpTunnelRun(TSTUDPTUNNELMODE enmMode, const char *pszName, uint32_t uPort, uint32_t cSockets,
+                            uint32_t cFrames, uint32_t cbFrame)
+{
+    RTTestSubF(g_hTest, "%s, %u socket(s)", pszName, cSockets);
+
+    TSTUDPTUNNELPAIR aPairs[TSTUDPTUNNEL_MAX_SOCKETS];
+    RT_ZERO(aPairs);
+    uint32_t i;
+    for (i = 0; i < cSockets; i++)
+    {
+        aPairs[i].enmMode   = enmMode;
+        aPairs[i].cbFrame   = cbFrame;
+        aPairs[i].cFrames   = cFrames / cSockets + (i < cFrames % cSockets);
+        aPairs[i].hSender   = NIL_RTTHREAD;
+        aPairs[i].hReceiver = NIL_RTTHREAD;
+        aPairs[i].fdRecv    = tstUdpTunnelSocket(uPort + i, 0);
+        aPairs[i].fdSend    = tstUdpTunnelSocket(uPort + TSTUDPTUNNEL_PORT_OFFSET + i, uPort + i);
+        if (aPairs[i].fdRecv < 0 || aPairs[i].fdSend < 0)
+        {
+            RTTestFailed(g_hTest, "setting up the sockets on port %u failed: %d", uPort + i, errno);
+            break;
+        }
+    }
+
+    uint64_t const u64Start = RTTimeNanoTS();
+    if (i == cSockets)
+        for (i = 0; i < cSockets; i++)
+        {
+            int rc = RTThreadCreateF(&aPairs[i].hReceiver, tstUdpTunnelReceiver, &aPairs[i], 0,
+                                     RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "UDPRX%u", i);
+            if (RT_SUCCESS(rc))
+                rc = RTThreadCreateF(&aPairs[i].hSender, tstUdpTunnelSender, &aPairs[i], 0,
+                                     RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "UDPTX%u", i);
+            if (RT_FAILURE(rc))
+            {
+                RTTestFailed(g_hTest, "RTThreadCreateF failed: %Rrc", rc);
+                break;
+            }
+        }
+
+    uint64_t u64Last   = u64Start;
+    uint64_t cReceived = 0;
+    for (i = 0; i < cSockets; i++)
+    {
+        if (aPairs[i].hSender != NIL_RTTHREAD)
+            RTThreadWait(aPairs[i].hSender, RT_INDEFINITE_WAIT, NULL);
+        if (aPairs[i].hReceiver != NIL_RTTHREAD)
+            RTThreadWait(aPairs[i].hReceiver, RT_INDEFINITE_WAIT, NULL);
+        if (RT_FAILURE(aPairs[i].rcSend))
+            RTTestFailed(g_hTest, "sending on socket %u failed: %Rrc", i, aPairs[i].rcSend);
+        if (RT_FAILURE(aPairs[i].rcRecv))
+            RTTestFailed(g_hTest, "receiving on socket %u failed: %Rrc", i, aPairs[i].rcRecv);
+        cReceived += aPairs[i].cReceived;
+        u64Last    = RT_MAX(u64Last, aPairs[i].u64LastRecv);
+        if (aPairs[i].fdSend >= 0)
+            close(aPairs[i].fdSend);
+        if (aPairs[i].fdRecv >= 0)
+            close(aPairs[i].fdRecv);
+    }
+
+    uint64_t const cNsElapsed = RT_MAX(u64Last - u64Start, 1);
+    RTTestValue(g_hTest, "Sent", cFrames, RTTESTUNIT_PACKETS);
+    RTTestValue(g_hTest, "Received", cReceived, RTTESTUNIT_PACKETS);
+    RTTestValue(g_hTest, "Rate", cReceived * RT_NS_1SEC / cNsElapsed, RTTESTUNIT_PACKETS_PER_SEC);
+    RTTestValue(g_hTest, "Throughput", cReceived * cbFrame * RT_NS_1SEC / cNsElapsed / _1K, RTTESTUNIT_KILOBYTES_PER_SEC);
+    if (!cReceived)
+        RTTestFailed(g_hTest, "nothing arrived");
+}
+
+
+int main(int argc, char **argv)
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstUdpTunnelBench", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+
+    static RTGETOPTDEF const s_aOptions[] =
+    {
+        { "--port",         'p', RTGETOPT_REQ_UINT32  },
+        { "--frames",       'n', RTGETOPT_REQ_UINT32  },
+        { "--size",         's', RTGETOPT_REQ_UINT32  },
+        { "--sockets",      'S', RTGETOPT_REQ_UINT32  },
+    };
+
+    uint32_t uPort    = TSTUDPTUNNEL_PORT;
+    uint32_t cFrames  = 500000;
+    uint32_t cbFrame  = 1514;
+    uint32_t cSockets = 1;
+
+    int ch;
+    RTGETOPTUNION Value;
+    RTGETOPTSTATE GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0 /* fFlags */);
+    while ((ch = RTGetOpt(&GetState, &Value)))
+    {
+        switch (ch)
+        {
+            case 'p': uPort = Value.u32; break;
+            case 'n': cFrames = RT_MAX(Value.u32, 1); break;
+            case 's':
+                if (Value.u32 < 60 || Value.u32 > 9000)
+                    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "--size must be between 60 and 9000");
+                cbFrame = Value.u32;
+                break;
+            case 'S':
+                if (Value.u32 < 1 || Value.u32 > TSTUDPTUNNEL_MAX_SOCKETS)
+                    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "--sockets must be between 1 and %u", TSTUDPTUNNEL_MAX_SOCKETS);
+                cSockets = Value.u32;
+                break;
+
+            case 'h':
+                RTPrintf("Usage: tstUdpTunnelBench [--port <port>] [--frames <n>] [--size <bytes>] [--sockets <n>]\n");
+                return RTEXITCODE_SUCCESS;
+
+            default:
+                return RTGetOptPrintError(ch, &Value);
+        }
+    }
+    if (uPort + TSTUDPTUNNEL_PORT_OFFSET + cSockets > 65535)
+        return RTMsgErrorExit(RTEXITCODE_SYNTAX, "--port is too large");
+
+    tstUdpTunnelRun(TSTUDPTUNNELMODE_SINGLE, "Per datagram", uPort, cSockets, cFrames, cbFrame);
+    tstUdpTunnelRun(TSTUDPTUNNELMODE_MMSG, "sendmmsg/recvmmsg", uPort, cSockets, cFrames, cbFrame);
+    if (tstUdpTunnelHasGso())
+        tstUdpTunnelRun(TSTUDPTUNNELMODE_GSO, "UDP_SEGMENT/UDP_GRO", uPort, cSockets, cFrames, cbFrame);
+    else
+        RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "UDP_SEGMENT/UDP_GRO not supported by the host, skipped\n");
+
+    return RTTestSummaryAndDestroy(g_hTest);
+}
@@ -88,6 +88,12 @@
 /** ATAPI sense info size. */
 #define ATAPI_SENSE_SIZE 64
 
+/** Maximum number of guest pages mapped at once by the direct DMA path. */
+#define ATA_DMA_DIRECT_PAGES_MAX 64
+
+/** Default size of the ATAPI read-ahead buffer. */
+#define ATAPI_READ_AHEAD_SIZE_DEFAULT _512K
+
 /** The maximum number of release log entries per device. */
 #define MAX_LOG_REL_ERRORS  1024
 
@@ -258,6 +264,29 @@ typedef struct ATADevState
     /** Timestamp of last started command. 0 if no command pending. */
     uint64_t        u64CmdTS;
 
+    /** Statistics: number of DMA transfers done directly in guest memory. */
+    STAMCOUNTER     StatDMADirect;
+    /** Statistics: number of DMA transfers which had to go through the I/O buffer. */
+    STAMCOUNTER     StatDMABounce;
+    /** Statistics: number of ATAPI reads served from the read-ahead buffer. */
+    STAMCOUNTER     StatReadAheadHits;
+    /** Pointer to the ATAPI read-ahead buffer. NULL if read-ahead is disabled. */
+    R3PTRTYPE(uint8_t *)            pbReadAhead;
+    /** Size of the read-ahead buffer in 2048 byte sectors. */
+    uint32_t        cReadAheadSectorsMax;
+    /** First LBA which is currently in the read-ahead buffer. */
+    uint32_t        iReadAheadLBA;
+    /** Number of valid sectors in the read-ahead buffer. */
+    uint32_t        cReadAheadSectors;
+    /** LBA following the last ATAPI read, used to detect sequential access. */
+    uint32_t        iATAPILBANext;
+    /** Read-ahead generation, incremented on every invalidation so that a fill
+     * which raced an invalidation is not committed. Protected by the controller lock. */
+    uint32_t        uReadAheadGen;
+#if HC_ARCH_BITS == 64
+    uint32_t        Alignment4; /**< Align pDrvBase correctly. */
+#endif
+
     /** Pointer to the attached driver's base interface. */
     R3PTRTYPE(PPDMIBASE)            pDrvBase;
     /** Pointer to the attached driver's block interface. */
@@ -267,12 +296,17 @@ typedef struct ATADevState
     /** Pointer to the attached driver's mount interface.
      * This is NULL if the driver isn't a removable unit. */
     R3PTRTYPE(PPDMIMOUNT)           pDrvMount;
+    /** Pointer to the attached driver's async block interface.
+     * This is NULL if the driver doesn't support async I/O. */
+    R3PTRTYPE(PPDMIBLOCKASYNC)      pDrvBlockAsync;
     /** The base interface. */
     PDMIBASE                        IBase;
     /** The block port interface. */
     PDMIBLOCKPORT                   IPort;
     /** The mount notify interface. */
     PDMIMOUNTNOTIFY                 IMountNotify;
+    /** The async block port interface, used by the direct DMA path. */
+    PDMIBLOCKASYNCPORT              IPortAsync;
     /** The LUN #. */
     RTUINT                          iLUN;
     RTUINT                          Alignment2; /**< Align pDevInsR3 correctly. */
@@ -307,6 +341,7 @@ typedef struct ATADevState
 AssertCompileMemberAlignment(ATADevState, cTotalSectors, 8);
 AssertCompileMemberAlignment(ATADevState, StatATADMA, 8);
 AssertCompileMemberAlignment(ATADevState, u64CmdTS, 8);
+AssertCompileMemberAlignment(ATADevState, StatDMADirect, 8);
 AssertCompileMemberAlignment(ATADevState, pDevInsR3, 8);
 AssertCompileMemberAlignment(ATADevState, szSerialNumber, 8);
 AssertCompileSizeAlignment(ATADevState, 8);
@@ -419,13 +454,21 @@ typedef struct ATACONTROLLER
     volatile uint8_t    AsyncIOReqTail;
     /** Whether to call PDMDevHlpAsyncNotificationCompleted when idle. */
     bool volatile       fSignalIdle;
-    uint8_t             Alignment3[1]; /**< Explicit padding of the 1 byte gap. */
+    /** Whether READ/WRITE DMA may transfer directly from/to guest memory. */
+    bool                fDirectDMA;
     /** Magic delay before triggering interrupts in DMA mode. */
     uint32_t            DelayIRQMillies;
     /** The mutex protecting the request queue. */
     RTSEMMUTEX          AsyncIORequestMutex;
     /** The event semaphore the thread is waiting on during suspended I/O. */
     RTSEMEVENT          SuspendIOSem;
+    /** The event semaphore signalled when an async direct DMA request completes. */
+    RTSEMEVENT          DirectDMASem;
+    /** Status code of the last async direct DMA request. */
+    int32_t volatile    rcDirectDMA;
+#if HC_ARCH_BITS == 64
+    uint32_t            Alignment1;
+#endif
 #if 0 /*HC_ARCH_BITS == 32*/
     uint32_t            Alignment0;
 #endif
@@ -491,6 +534,7 @@ typedef struct PCIATAState
 #define PDMIBLOCKPORT_2_ATASTATE(pInterface)    ( (ATADevState *)((uintptr_t)(pInterface) - RT_OFFSETOF(ATADevState, IPort)) )
 #define PDMIMOUNT_2_ATASTATE(pInterface)        ( (ATADevState *)((uintptr_t)(pInterface) - RT_OFFSETOF(ATADevState, IMount)) )
 #define PDMIMOUNTNOTIFY_2_ATASTATE(pInterface)  ( (ATADevState *)((uintptr_t)(pInterface) - RT_OFFSETOF(ATADevState, IMountNotify)) )
+#define PDMIBLOCKASYNCPORT_2_ATASTATE(pInterface) ( (ATADevState *)((uintptr_t)(pInterface) - RT_OFFSETOF(ATADevState, IPortAsync)) )
 #define PCIDEV_2_PCIATASTATE(pPciDev)           ( (PCIATAState *)(pPciDev) )
 
 #define ATACONTROLLER_IDX(pController) ( (pController) - PDMINS_2_DATA(CONTROLLER_2_DEVINS(pController), PCIATAState *)->aCts )
@@ -1773,6 +1817,99 @@ static void atapiPassthroughCmdBT(ATADevState *s)
 }
 
 
+/**
+ * Invalidates the ATAPI read-ahead buffer, e.g. on medium changes.
+ *
+ * This is called on EMT while the async I/O thread may be reading into the
+ * buffer, so the state is changed under the controller lock and the
+ * generation is bumped to keep a concurrent fill from being committed.
+ *
+ * @param s     The ATA device state.
+ */
+static void atapiReadAheadInvalidate(ATADevState *s)
+{
+    PATACONTROLLER pCtl = ATADEVSTATE_2_CONTROLLER(s);
+
+    PDMCritSectEnter(&pCtl->lock, VINF_SUCCESS);
+    s->cReadAheadSectors = 0;
+    s->iATAPILBANext = 0;
+    s->uReadAheadGen++;
+    PDMCritSectLeave(&pCtl->lock);
+}
+
+
+/**
+ * Reads 2048 byte sectors from the medium, using the read-ahead buffer to
+ * serve sequential reads. Must be called without holding the controller lock.
+ *
+ * Only the async I/O thread reads and fills the buffer, the bookkeeping is
+ * shared with atapiReadAheadInvalidate and protected by the controller lock.
+ *
+ * @returns VBox status code.
+ * @param s             The ATA device state.
+ * @param iATAPILBA     The first sector to read.
+ * @param pbBuf         Where to store the data.
+ * @param cSectors      Number of sectors to read.
+ */
+static int atapiReadSectorsCached(ATADevState *s, uint32_t iATAPILBA, uint8_t *pbBuf, uint32_t cSectors)
+{
+    PATACONTROLLER pCtl = ATADEVSTATE_2_CONTROLLER(s);
+    uint32_t cSectorsFill = 0;
+    uint32_t uGen;
+    int rc;
+
+    PDMCritSectEnter(&pCtl->lock, VINF_SUCCESS);
+    if (   s->cReadAheadSectors
+        && iATAPILBA >= s->iReadAheadLBA
+        && (uint64_t)iATAPILBA + cSectors <= (uint64_t)s->iReadAheadLBA + s->cReadAheadSectors)
+    {
+        size_t offBuf = (size_t)(iATAPILBA - s->iReadAheadLBA) * 2048;
+        s->iATAPILBANext = iATAPILBA + cSectors;
+        PDMCritSectLeave(&pCtl->lock);
+
+        memcpy(pbBuf, s->pbReadAhead + offBuf, (size_t)cSectors * 2048);
+        STAM_REL_COUNTER_INC(&s->StatReadAheadHits);
+        return VINF_SUCCESS;
+    }
+
+    /* Only fill the read-ahead buffer if the guest is streaming, random
+     * access would just waste bandwidth on data nobody is asking for. */
+    if (   s->pbReadAhead
+        && iATAPILBA == s->iATAPILBANext
+        && iATAPILBA < s->cTotalSectors)
+        cSectorsFill = (uint32_t)RT_MIN((uint64_t)s->cReadAheadSectorsMax, s->cTotalSectors - iATAPILBA);
+    if (cSectorsFill > cSectors)
+        s->cReadAheadSectors = 0;
+    uGen = s->uReadAheadGen;
+    PDMCritSectLeave(&pCtl->lock);
+
+    if (cSectorsFill > cSectors)
+    {
+        rc = s->pDrvBlock->pfnRead(s->pDrvBlock, (uint64_t)iATAPILBA * 2048, s->pbReadAhead, (size_t)cSectorsFill * 2048);
+        if (RT_SUCCESS(rc))
+            memcpy(pbBuf, s->pbReadAhead, (size_t)cSectors * 2048);
+    }
+    else
+        rc = s->pDrvBlock->pfnRead(s->pDrvBlock, (uint64_t)iATAPILBA * 2048, pbBuf, (size_t)cSectors * 2048);
+
+    if (RT_SUCCESS(rc))
+    {
+        PDMCritSectEnter(&pCtl->lock, VINF_SUCCESS);
+        if (s->uReadAheadGen == uGen)
+        {
+            if (cSectorsFill > cSectors)
+            {
+                s->iReadAheadLBA = iATAPILBA;
+                s->cReadAheadSectors = cSectorsFill;
+            }
+            s->iATAPILBANext = iATAPILBA + cSectors;
+        }
+        PDMCritSectLeave(&pCtl->lock);
+    }
+    return rc;
+}
+
+
 static bool atapiReadSS(ATADevState *s)
 {
     PATACONTROLLER pCtl = ATADEVSTATE_2_CONTROLLER(s);
@@ -1792,7 +1929,7 @@ static bool atapiReadSS(ATADevState *s)
     switch (s->cbATAPISector)
     {
         case 2048:
-            rc = s->pDrvBlock->pfnRead(s->pDrvBlock, (uint64_t)s->iATAPILBA * s->cbATAPISector, s->CTX_SUFF(pbIOBuffer), s->cbATAPISector * cSectors);
+            rc = atapiReadSectorsCached(s, s->iATAPILBA, s->CTX_SUFF(pbIOBuffer), cSectors);
             break;
         case 2352:
             {
@@ -3664,6 +3801,8 @@ static DECLCALLBACK(void) ataMountNotify(PPDMIMOUNTNOTIFY pInterface)
 
     LogRel(("PIIX3 ATA: LUN#%d: CD/DVD, total number of sectors %Ld, passthrough unchanged\n", pIf->iLUN, pIf->cTotalSectors));
 
+    atapiReadAheadInvalidate(pIf);
+
     /* Report media changed in TEST UNIT and other (probably incorrect) places. */
     if (pIf->cNotifiedMediaChange < 2)
         pIf->cNotifiedMediaChange = 2;
@@ -3680,6 +3819,7 @@ static DECLCALLBACK(void) ataUnmountNotify(PPDMIMOUNTNOTIFY pInterface)
     ATADevState *pIf = PDMIMOUNTNOTIFY_2_ATASTATE(pInterface);
     Log(("%s:\n", __FUNCTION__));
     pIf->cTotalSectors = 0;
+    atapiReadAheadInvalidate(pIf);
 
     /*
      * Whatever I do, XP will not use the GET MEDIA STATUS nor the EVENT stuff.
@@ -3721,6 +3861,7 @@ static void ataResetDevice(ATADevState *s)
     s->fDMA = false;
     s->fATAPITransfer = false;
     s->uATATransferMode = ATA_MODE_UDMA | 2; /* PIIX3 supports only up to UDMA2 */
+    atapiReadAheadInvalidate(s);
 
     s->uATARegFeature = 0;
 }
@@ -4740,6 +4881,310 @@ static void ataDMATransfer(PATACONTROLLER pCtl)
     s->iIOBufferEnd = iIOBufferEnd;
 }
 
+/**
+ * @interface_method_impl{PDMIBLOCKASYNCPORT,pfnTransferCompleteNotify}
+ */
+static DECLCALLBACK(int) ataR3DMADirectCompleteNotify(PPDMIBLOCKASYNCPORT pInterface, void *pvUser, int rcReq)
+{
+    ATADevState *pIf = PDMIBLOCKASYNCPORT_2_ATASTATE(pInterface);
+    PATACONTROLLER pCtl = ATADEVSTATE_2_CONTROLLER(pIf);
+    NOREF(pvUser);
+
+    ASMAtomicWriteS32(&pCtl->rcDirectDMA, rcReq);
+    return RTSemEventSignal(pCtl->DirectDMASem);
+}
+
+
+/**
+ * Passes one batch of a direct DMA transfer to the driver.
+ *
+ * If the driver offers the async block interface the segments are submitted
+ * as a single S/G request and the async I/O thread waits for its completion.
+ * Otherwise the segments are transferred one by one.
+ *
+ * @returns VBox status code.
+ * @param s             The ATA device state.
+ * @param fWrite        Whether to write (true) or read (false).
+ * @param off           Start offset on the medium.
+ * @param paSegs        The mapped guest memory segments.
+ * @param cSegs         Number of segments.
+ * @param cbTransfer    Number of bytes described by the segments.
+ */
+static int ataDMADirectSubmit(ATADevState *s, bool fWrite, uint64_t off, PCRTSGSEG paSegs, unsigned cSegs, size_t cbTransfer)
+{
+    PATACONTROLLER pCtl = ATADEVSTATE_2_CONTROLLER(s);
+    int rc = VINF_SUCCESS;
+
+    if (s->pDrvBlockAsync)
+    {
+        if (fWrite)
+            rc = s->pDrvBlockAsync->pfnStartWrite(s->pDrvBlockAsync, off, paSegs, cSegs, cbTransfer, s);
+        else
+            rc = s->pDrvBlockAsync->pfnStartRead(s->pDrvBlockAsync, off, paSegs, cSegs, cbTransfer, s);
+        if (rc == VINF_VD_ASYNC_IO_FINISHED)
+            rc = VINF_SUCCESS;
+        else if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+        {
+            rc = RTSemEventWait(pCtl->DirectDMASem, RT_INDEFINITE_WAIT);
+            AssertLogRelRC(rc);
+            if (RT_SUCCESS(rc))
+                rc = ASMAtomicReadS32(&pCtl->rcDirectDMA);
+        }
+        return rc;
+    }
+
+    for (unsigned i = 0; i < cSegs && RT_SUCCESS(rc); i++)
+    {
+        if (fWrite)
+            rc = s->pDrvBlock->pfnWrite(s->pDrvBlock, off, paSegs[i].pvSeg, paSegs[i].cbSeg);
+        else
+            rc = s->pDrvBlock->pfnRead(s->pDrvBlock, off, paSegs[i].pvSeg, paSegs[i].cbSeg);
+        off += paSegs[i].cbSeg;
+    }
+    return rc;
+}
+
+
+/**
+ * Performs a READ/WRITE DMA transfer directly on the guest memory described
+ * by the PRD table, i.e. without copying the data through the I/O buffer.
+ *
+ * Only the common case is handled here: sector aligned PRD entries covering
+ * the whole transfer and guest RAM which can be mapped. Everything else,
+ * including errors reported by the driver, is left to ataDMATransfer. In
+ * that case the state is set up as if a new DMA transfer starts at
+ * pCtl->pFirstDMADesc with an empty I/O buffer.
+ *
+ * @returns true if the transfer was completed or aborted, false if the
+ *          (remaining) transfer has to be done by ataDMATransfer.
+ * @param pCtl      Controller for which to perform the transfer.
+ */
+static bool ataDMATransferDirect(PATACONTROLLER pCtl)
+{
+    PPDMDEVINS pDevIns = CONTROLLER_2_DEVINS(pCtl);
+    ATADevState *s = &pCtl->aIfs[pCtl->iAIOIf];
+    BMDMADesc aDMADesc[_4K / sizeof(BMDMADesc)];
+    PGMPAGEMAPLOCK aPageLocks[ATA_DMA_DIRECT_PAGES_MAX];
+    RTSGSEG aSegs[ATA_DMA_DIRECT_PAGES_MAX];
+    unsigned cDesc, iDesc, cDescValid;
+    uint32_t cbTotalTransfer, cbLeft;
+    uint64_t iLBA;
+    bool fWrite;
+    bool fLastDesc = false;
+    int rc = VINF_SUCCESS;
+
+    if (   !pCtl->fDirectDMA
+        || pCtl->fRedo
+        || s->fATAPI
+        || !s->cbTotalTransfer)
+        return false;
+    if (s->iSourceSink == ATAFN_SS_READ_SECTORS)
+    {
+        /* The initial read must have been deferred, see ataAsyncIOLoop. */
+        if (s->iIOBufferEnd)
+            return false;
+        fWrite = false;
+    }
+    else if (s->iSourceSink == ATAFN_SS_WRITE_SECTORS)
+    {
+        if (s->iIOBufferCur)
+            return false;
+        fWrite = true;
+    }
+    else
+        return false;
+
+    cbTotalTransfer = s->cbTotalTransfer;
+    iLBA = ataGetSector(s);
+    cDesc = (pCtl->pLastDMADesc - pCtl->pFirstDMADesc) / sizeof(BMDMADesc) + 1;
+    Assert(cDesc <= RT_ELEMENTS(aDMADesc));
+
+    PDMCritSectLeave(&pCtl->lock);
+
+    /*
+     * Fetch the entire PRD table in one go and check that it describes the
+     * transfer in a way we can pass straight to the driver.
+     */
+    PDMDevHlpPhysRead(pDevIns, pCtl->pFirstDMADesc, &aDMADesc[0], cDesc * sizeof(BMDMADesc));
+    cbLeft = cbTotalTransfer;
+    for (cDescValid = 0; cDescValid < cDesc && cbLeft; cDescValid++)
+    {
+        RTGCPHYS32 GCPhysBuffer = RT_LE2H_U32(aDMADesc[cDescValid].pBuffer);
+        uint32_t cbBuffer = RT_LE2H_U32(aDMADesc[cDescValid].cbBuffer);
+
+        fLastDesc = !!(cbBuffer & 0x80000000);
+        cbBuffer &= 0xfffe;
+        if (cbBuffer == 0)
+            cbBuffer = 0x10000;
+        if (cbBuffer > cbLeft)
+            cbBuffer = cbLeft;
+        if ((GCPhysBuffer | cbBuffer) & 511)
+            break;
+        aDMADesc[cDescValid].pBuffer  = GCPhysBuffer;
+        aDMADesc[cDescValid].cbBuffer = cbBuffer;
+        cbLeft -= cbBuffer;
+        if (fLastDesc)
+        {
+            cDescValid++;
+            break;
+        }
+    }
+
+    if (cbLeft)
+    {
+        STAM_PROFILE_START(&pCtl->StatLockWait, a);
+        PDMCritSectEnter(&pCtl->lock, VINF_SUCCESS);
+        STAM_PROFILE_STOP(&pCtl->StatLockWait, a);
+        STAM_REL_COUNTER_INC(&s->StatDMABounce);
+        return false;
+    }
+
+    /*
+     * Process the descriptors in batches of mapped guest pages. A batch
+     * always consists of complete descriptors so that the bounce buffer
+     * code can take over at a descriptor boundary.
+     */
+    iDesc = 0;
+    while (cbTotalTransfer)
+    {
+        unsigned iDescBatch = iDesc;
+        unsigned cPages = 0;
+        unsigned cSegs = 0;
+        uint32_t cbBatch = 0;
+
+        while (iDesc < cDescValid && RT_SUCCESS(rc))
+        {
+            RTGCPHYS32 GCPhysBuffer = aDMADesc[iDesc].pBuffer;
+            uint32_t cbBuffer = aDMADesc[iDesc].cbBuffer;
+            unsigned cPagesDesc = (unsigned)(((GCPhysBuffer & PAGE_OFFSET_MASK) + cbBuffer + PAGE_OFFSET_MASK) >> PAGE_SHIFT);
+
+            if (cPages + cPagesDesc > RT_ELEMENTS(aPageLocks))
+                break;
+
+            while (cbBuffer)
+            {
+                uint32_t cbChunk = RT_MIN(cbBuffer, PAGE_SIZE - (GCPhysBuffer & PAGE_OFFSET_MASK));
+                void *pv;
+
+                if (fWrite)
+                    rc = PDMDevHlpPhysGCPhys2CCPtrReadOnly(pDevIns, GCPhysBuffer, 0, (const void **)&pv, &aPageLocks[cPages]);
+                else
+                    rc = PDMDevHlpPhysGCPhys2CCPtr(pDevIns, GCPhysBuffer, 0, &pv, &aPageLocks[cPages]);
+                if (RT_FAILURE(rc))
+                    break;
+                cPages++;
+
+                /* Merge with the previous segment if the mappings are adjacent. */
+                if (   cSegs
+                    && (uint8_t *)aSegs[cSegs - 1].pvSeg + aSegs[cSegs - 1].cbSeg == (uint8_t *)pv)
+                    aSegs[cSegs - 1].cbSeg += cbChunk;
+                else
+                {
+                    aSegs[cSegs].pvSeg = pv;
+                    aSegs[cSegs].cbSeg = cbChunk;
+                    cSegs++;
+                }
+                GCPhysBuffer += cbChunk;
+                cbBuffer -= cbChunk;
+            }
+
+            if (RT_SUCCESS(rc))
+            {
+                cbBatch += aDMADesc[iDesc].cbBuffer;
+                iDesc++;
+            }
+        }
+
+        if (RT_SUCCESS(rc))
+        {
+            uint64_t off = iLBA * 512;
+
+            Log2(("%s: %s %u bytes at LBA %llu in %u segments\n", __FUNCTION__,
+                  fWrite ? "I2T" : "T2I", cbBatch, iLBA, cSegs));
+            if (fWrite)
+            {
+                STAM_PROFILE_ADV_START(&s->StatWrites, w);
+                s->Led.Asserted.s.fWriting = s->Led.Actual.s.fWriting = 1;
+                rc = ataDMADirectSubmit(s, true /*fWrite*/, off, &aSegs[0], cSegs, cbBatch);
+                s->Led.Actual.s.fWriting = 0;
+                STAM_PROFILE_ADV_STOP(&s->StatWrites, w);
+                if (RT_SUCCESS(rc))
+                    STAM_REL_COUNTER_ADD(&s->StatBytesWritten, cbBatch);
+            }
+            else
+            {
+                STAM_PROFILE_ADV_START(&s->StatReads, r);
+                s->Led.Asserted.s.fReading = s->Led.Actual.s.fReading = 1;
+                rc = ataDMADirectSubmit(s, false /*fWrite*/, off, &aSegs[0], cSegs, cbBatch);
+                s->Led.Actual.s.fReading = 0;
+                STAM_PROFILE_ADV_STOP(&s->StatReads, r);
+                if (RT_SUCCESS(rc))
+                    STAM_REL_COUNTER_ADD(&s->StatBytesRead, cbBatch);
+            }
+        }
+
+        for (unsigned i = 0; i < cPages; i++)
+            PDMDevHlpPhysReleasePageMappingLock(pDevIns, &aPageLocks[i]);
+
+        STAM_PROFILE_START(&pCtl->StatLockWait, a);
+        PDMCritSectEnter(&pCtl->lock, VINF_SUCCESS);
+        STAM_PROFILE_STOP(&pCtl->StatLockWait, a);
+
+        /* The RESET handler could have cleared the transfer state while the
+         * lock was not held, in which case there is nothing left to do. */
+        if (s->iSourceSink == ATAFN_SS_NULL)
+            return true;
+
+        if (RT_FAILURE(rc) || !cbBatch)
+        {
+            /* Let the bounce buffer code redo the failed batch (which takes
+             * care of error reporting and suspending the VM if necessary)
+             * and the rest of the transfer. */
+            Log(("%s: falling back to the I/O buffer at descriptor %u, rc=%Rrc\n", __FUNCTION__, iDescBatch, rc));
+            pCtl->pFirstDMADesc += iDescBatch * sizeof(BMDMADesc);
+            ataSetSector(s, iLBA);
+            s->cbTotalTransfer = cbTotalTransfer;
+            s->cbElementaryTransfer = RT_MIN(cbTotalTransfer, s->cSectorsPerIRQ * 512);
+            s->iIOBufferCur = 0;
+            s->iIOBufferEnd = fWrite ? s->cbElementaryTransfer : 0;
+            STAM_REL_COUNTER_INC(&s->StatDMABounce);
+            return false;
+        }
+
+        iLBA += cbBatch / 512;
+        cbTotalTransfer -= cbBatch;
+
+        if (!(pCtl->BmDma.u8Cmd & BM_CMD_START) || pCtl->fReset)
+        {
+            LogRel(("PIIX3 ATA: Ctl#%d: ABORT DMA%s\n", ATACONTROLLER_IDX(pCtl), pCtl->fReset ? " due to RESET" : ""));
+            if (!pCtl->fReset)
+            {
+                ataSetSector(s, iLBA);
+                ataDMATransferStop(s);
+            }
+            return true;
+        }
+
+        if (cbTotalTransfer)
+            PDMCritSectLeave(&pCtl->lock);
+    }
+
+    STAM_REL_COUNTER_INC(&s->StatDMADirect);
+    ataSetSector(s, iLBA);
+    if (fLastDesc)
+        pCtl->BmDma.u8Status &= ~BM_STATUS_DMAING;
+    s->cbTotalTransfer = 0;
+    s->cbElementaryTransfer = 0;
+    s->iIOBufferCur = 0;
+    s->iIOBufferEnd = 0;
+    s->iSourceSink = ATAFN_SS_NULL;
+    /* A read was completed when it was deferred to the DMA phase, a write
+     * completes here just like ataWriteSectorsSS does it. */
+    if (fWrite)
+        ataCmdOK(s, ATA_STAT_SEEK);
+    return true;
+}
+
 /**
  * Signal PDM that we're idle (if we actually are).
  *
@@ -4904,7 +5349,17 @@ static DECLCALLBACK(int) ataAsyncIOLoop(RTTHREAD ThreadSelf, void *pvUser)
 
                 if (s->uTxDir != PDMBLOCKTXDIR_TO_DEVICE)
                 {
-                    if (s->iSourceSink != ATAFN_SS_NULL)
+                    if (   s->fDMA
+                        && pCtl->fDirectDMA
+                        && s->iSourceSink == ATAFN_SS_READ_SECTORS)
+                    {
+                        /* Defer the read to the DMA phase, so that the data
+                         * can go straight into guest memory. An empty I/O
+                         * buffer marks the transfer for ataDMATransferDirect. */
+                        ataCmdOK(s, ATA_STAT_SEEK);
+                        s->iIOBufferEnd = 0;
+                    }
+                    else if (s->iSourceSink != ATAFN_SS_NULL)
                     {
                         bool fRedo;
                         Log2(("%s: Ctl#%d: calling source/sink function\n", __FUNCTION__, ATACONTROLLER_IDX(pCtl)));
@@ -4919,11 +5374,13 @@ static DECLCALLBACK(int) ataAsyncIOLoop(RTTHREAD ThreadSelf, void *pvUser)
                             ataAsyncIOPutRequest(pCtl, pReq);
                             break;
                         }
+                        s->iIOBufferEnd = s->cbElementaryTransfer;
                     }
                     else
+                    {
                         ataCmdOK(s, 0);
-                    s->iIOBufferEnd = s->cbElementaryTransfer;
-
+                        s->iIOBufferEnd = s->cbElementaryTransfer;
+                    }
                 }
 
                 /* Do not go into the transfer phase if RESET is asserted.
@@ -5015,7 +5472,31 @@ static DECLCALLBACK(int) ataAsyncIOLoop(RTTHREAD ThreadSelf, void *pvUser)
                     pCtl->pFirstDMADesc = bm->pvAddr;
                     pCtl->pLastDMADesc = RT_ALIGN_32(bm->pvAddr + 1, _4K) - sizeof(BMDMADesc);
                 }
-                ataDMATransfer(pCtl);
+
+                if (!ataDMATransferDirect(pCtl))
+                {
+                    bool fTransfer = true;
+
+                    /* Fill the I/O buffer if the initial read was deferred
+                     * for the direct path but the bounce buffer must be used. */
+                    if (   s->uTxDir == PDMBLOCKTXDIR_FROM_DEVICE
+                        && !s->iIOBufferEnd
+                        && s->iSourceSink != ATAFN_SS_NULL)
+                    {
+                        Log2(("%s: Ctl#%d: calling deferred source/sink function\n", __FUNCTION__, ATACONTROLLER_IDX(pCtl)));
+                        pCtl->fRedo = g_apfnSourceSinkFuncs[s->iSourceSink](s);
+                        s->iIOBufferCur = 0;
+                        s->iIOBufferEnd = s->cbElementaryTransfer;
+                        /* Nothing to transfer if the read has to be redone
+                         * or failed (the error status is already set). */
+                        fTransfer = !pCtl->fRedo && s->cbTotalTransfer != 0;
+                        if (pCtl->fRedo)
+                            s->iIOBufferEnd = 0;
+                    }
+
+                    if (fTransfer)
+                        ataDMATransfer(pCtl);
+                }
 
                 if (RT_UNLIKELY(pCtl->fRedo && !pCtl->fReset))
                 {
@@ -5528,6 +6009,7 @@ static DECLCALLBACK(void *)  ataQueryInterface(PPDMIBASE pInterface, const char
     PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBASE, &pIf->IBase);
     PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBLOCKPORT, &pIf->IPort);
     PDMIBASE_RETURN_INTERFACE(pszIID, PDMIMOUNTNOTIFY, &pIf->IMountNotify);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBLOCKASYNCPORT, &pIf->IPortAsync);
     return NULL;
 }
 
@@ -5907,6 +6389,19 @@ static DECLCALLBACK(int) ataR3Destruct(PPDMDEVINS pDevIns)
             RTSemEventDestroy(pThis->aCts[i].SuspendIOSem);
             pThis->aCts[i].SuspendIOSem = NIL_RTSEMEVENT;
         }
+        if (pThis->aCts[i].DirectDMASem != NIL_RTSEMEVENT)
+        {
+            RTSemEventDestroy(pThis->aCts[i].DirectDMASem);
+            pThis->aCts[i].DirectDMASem = NIL_RTSEMEVENT;
+        }
+        for (uint32_t j = 0; j < RT_ELEMENTS(pThis->aCts[i].aIfs); j++)
+        {
+            if (pThis->aCts[i].aIfs[j].pbReadAhead)
+            {
+                RTMemFree(pThis->aCts[i].aIfs[j].pbReadAhead);
+                pThis->aCts[i].aIfs[j].pbReadAhead = NULL;
+            }
+        }
 
         /* try one final time */
         if (pThis->aCts[i].AsyncIOThread != NIL_RTTHREAD)
@@ -5961,6 +6456,7 @@ static DECLCALLBACK(void) ataR3Detach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_
     pIf->pDrvBlock = NULL;
     pIf->pDrvBlockBios = NULL;
     pIf->pDrvMount = NULL;
+    pIf->pDrvBlockAsync = NULL;
 
     /*
      * In case there was a medium inserted.
@@ -5999,6 +6495,8 @@ static int ataConfigLun(PPDMDEVINS pDevIns, ATADevState *pIf)
         return VERR_PDM_MISSING_INTERFACE;
     }
     pIf->pDrvMount = PDMIBASE_QUERY_INTERFACE(pIf->pDrvBase, PDMIMOUNT);
+    /* Optional, only used to pass direct DMA transfers down as one S/G request. */
+    pIf->pDrvBlockAsync = PDMIBASE_QUERY_INTERFACE(pIf->pDrvBase, PDMIBLOCKASYNC);
 
     /*
      * Validate type.
@@ -6051,6 +6549,21 @@ static int ataConfigLun(PPDMDEVINS pDevIns, ATADevState *pIf)
         pIf->pbIOBufferRC = MMHyperR3ToRC(pVM, pIf->pbIOBufferR3);
     }
 
+    /*
+     * Allocate the read-ahead buffer for CD/DVD drives. Passthrough drives
+     * don't need one, as the host drive does its own read-ahead.
+     */
+    if (   pIf->fATAPI
+        && !pIf->fATAPIPassthrough
+        && pIf->cReadAheadSectorsMax
+        && !pIf->pbReadAhead)
+    {
+        pIf->pbReadAhead = (uint8_t *)RTMemAlloc((size_t)pIf->cReadAheadSectorsMax * 2048);
+        if (!pIf->pbReadAhead)
+            return VERR_NO_MEMORY;
+    }
+    atapiReadAheadInvalidate(pIf);
+
     /*
      * Init geometry (only for non-CD/DVD media).
      */
@@ -6159,6 +6672,7 @@ static DECLCALLBACK(int)  ataR3Attach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_
     {
         pIf->pDrvBase = NULL;
         pIf->pDrvBlock = NULL;
+        pIf->pDrvBlockAsync = NULL;
     }
     return rc;
 }
@@ -6799,6 +7313,7 @@ static DECLCALLBACK(int)   ataR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
     {
         pThis->aCts[i].AsyncIOSem = NIL_RTSEMEVENT;
         pThis->aCts[i].SuspendIOSem = NIL_RTSEMEVENT;
+        pThis->aCts[i].DirectDMASem = NIL_RTSEMEVENT;
         pThis->aCts[i].AsyncIORequestMutex = NIL_RTSEMMUTEX;
         pThis->aCts[i].AsyncIOThread = NIL_RTTHREAD;
     }
@@ -6810,7 +7325,9 @@ static DECLCALLBACK(int)   ataR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
                               "GCEnabled\0"
                               "R0Enabled\0"
                               "IRQDelay\0"
-                              "Type\0")
+                              "Type\0"
+                              "DirectDMA\0"
+                              "ATAPIReadAheadSize\0")
         /** @todo || invalid keys */)
         return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
                                 N_("PIIX3 configuration error: unknown option specified"));
@@ -6834,6 +7351,23 @@ static DECLCALLBACK(int)   ataR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
     Log(("%s: DelayIRQMillies=%d\n", __FUNCTION__, DelayIRQMillies));
     Assert(DelayIRQMillies < 50);
 
+    bool fDirectDMA;
+    rc = CFGMR3QueryBoolDef(pCfg, "DirectDMA", &fDirectDMA, true);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("PIIX3 configuration error: failed to read DirectDMA as boolean"));
+    Log(("%s: fDirectDMA=%d\n", __FUNCTION__, fDirectDMA));
+
+    uint32_t cbReadAhead;
+    rc = CFGMR3QueryU32Def(pCfg, "ATAPIReadAheadSize", &cbReadAhead, ATAPI_READ_AHEAD_SIZE_DEFAULT);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("PIIX3 configuration error: failed to read ATAPIReadAheadSize as integer"));
+    if (cbReadAhead > 16 * _1M)
+        return PDMDEV_SET_ERROR(pDevIns, VERR_INVALID_PARAMETER,
+                                N_("PIIX3 configuration error: ATAPIReadAheadSize must not exceed 16MB"));
+    Log(("%s: cbReadAhead=%u\n", __FUNCTION__, cbReadAhead));
+
     CHIPSET enmChipset = CHIPSET_PIIX3;
     rc = ataControllerFromCfg(pDevIns, pCfg, &enmChipset);
     if (RT_FAILURE(rc))
@@ -6904,6 +7438,7 @@ static DECLCALLBACK(int)   ataR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
         pThis->aCts[i].pDevInsR0 = PDMDEVINS_2_R0PTR(pDevIns);
         pThis->aCts[i].pDevInsRC = PDMDEVINS_2_RCPTR(pDevIns);
         pThis->aCts[i].DelayIRQMillies = (uint32_t)DelayIRQMillies;
+        pThis->aCts[i].fDirectDMA = fDirectDMA;
         for (uint32_t j = 0; j < RT_ELEMENTS(pThis->aCts[i].aIfs); j++)
         {
             ATADevState *pIf = &pThis->aCts[i].aIfs[j];
@@ -6919,7 +7454,9 @@ static DECLCALLBACK(int)   ataR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
             pIf->IMountNotify.pfnMountNotify   = ataMountNotify;
             pIf->IMountNotify.pfnUnmountNotify = ataUnmountNotify;
             pIf->IPort.pfnQueryDeviceLocation  = ataR3QueryDeviceLocation;
+            pIf->IPortAsync.pfnTransferCompleteNotify = ataR3DMADirectCompleteNotify;
             pIf->Led.u32Magic                  = PDMLED_MAGIC;
+            pIf->cReadAheadSectorsMax          = cbReadAhead / 2048;
         }
     }
 
@@ -7009,6 +7546,12 @@ static DECLCALLBACK(int)   ataR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
                                    "Number of ATAPI DMA transfers.",            "/Devices/IDE%d/ATA%d/Unit%d/AtapiDMA", iInstance, i, j);
             PDMDevHlpSTAMRegisterF(pDevIns, &pIf->StatATAPIPIO,     STAMTYPE_COUNTER,    STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                                    "Number of ATAPI PIO transfers.",            "/Devices/IDE%d/ATA%d/Unit%d/AtapiPIO", iInstance, i, j);
+            PDMDevHlpSTAMRegisterF(pDevIns, &pIf->StatDMADirect,    STAMTYPE_COUNTER,    STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                                   "Number of DMA transfers done directly in guest memory.", "/Devices/IDE%d/ATA%d/Unit%d/DMADirect", iInstance, i, j);
+            PDMDevHlpSTAMRegisterF(pDevIns, &pIf->StatDMABounce,    STAMTYPE_COUNTER,    STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                                   "Number of DMA transfers which fell back to the I/O buffer.", "/Devices/IDE%d/ATA%d/Unit%d/DMABounce", iInstance, i, j);
+            PDMDevHlpSTAMRegisterF(pDevIns, &pIf->StatReadAheadHits, STAMTYPE_COUNTER,   STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                                   "Number of ATAPI reads served from the read-ahead buffer.", "/Devices/IDE%d/ATA%d/Unit%d/ReadAheadHits", iInstance, i, j);
 #ifdef VBOX_WITH_STATISTICS /** @todo release too. */
             PDMDevHlpSTAMRegisterF(pDevIns, &pIf->StatReads,        STAMTYPE_PROFILE_ADV, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,
                                    "Profiling of the read operations.",         "/Devices/IDE%d/ATA%d/Unit%d/Reads", iInstance, i, j);
@@ -7083,6 +7626,8 @@ static DECLCALLBACK(int)   ataR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
         AssertLogRelRCReturn(rc, rc);
         rc = RTSemEventCreate(&pCtl->SuspendIOSem);
         AssertLogRelRCReturn(rc, rc);
+        rc = RTSemEventCreate(&pCtl->DirectDMASem);
+        AssertLogRelRCReturn(rc, rc);
         rc = RTSemMutexCreate(&pCtl->AsyncIORequestMutex);
         AssertLogRelRCReturn(rc, rc);
         ataAsyncIOClearRequests(pCtl);
@@ -7222,6 +7767,7 @@ static DECLCALLBACK(int)   ataR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
             {
                 pIf->pDrvBase = NULL;
                 pIf->pDrvBlock = NULL;
+                pIf->pDrvBlockAsync = NULL;
                 pIf->cbIOBuffer = 0;
                 pIf->pbIOBufferR3 = NULL;
                 pIf->pbIOBufferR0 = NIL_RTR0PTR;
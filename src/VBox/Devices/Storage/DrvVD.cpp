@@ -36,6 +36,10 @@
 #include <iprt/poll.h>
 #include <iprt/pipe.h>
 #include <iprt/system.h>
+#include <iprt/memcache.h>
+#include <iprt/time.h>
+#include <iprt/avl.h>
+#include <iprt/critsect.h>
 
 #ifdef VBOX_WITH_INIP
 /* All lwip header files are not C++ safe. So hack around this. */
@@ -74,6 +78,127 @@ extern bool DevINIPConfigured(void);
 #define PDMIMEDIAASYNC_2_VBOXDISK(pInterface) \
     ( (PVBOXDISK)((uintptr_t)pInterface - RT_OFFSETOF(VBOXDISK, IMediaAsync)) )
 
+/** Number of buckets of the latency histograms. Bucket i counts requests
+ * which completed in less than 2^i microseconds, the last one takes all. */
+#define DRVVD_LATENCY_BUCKETS       24
+
+/** Size of the I/O trace buffer which is written to the trace file in one go.
+ * There are two of them, one being filled and one being written. */
+#define DRVVD_IOTRACE_BUFFER_SIZE   _64K
+/** Number of records in one I/O trace buffer. */
+#define DRVVD_IOTRACE_RECS          (DRVVD_IOTRACE_BUFFER_SIZE / sizeof(DRVVDIOTRACEREC))
+
+/** Maximum number of ranges waiting for a background discard. If the guest
+ * issues more the discard request is processed synchronously. */
+#define DRVVD_DISCARD_RANGES_MAX    8192
+/** Maximum number of ranges passed to the image in one go. Guest I/O is
+ * blocked while a batch is discarded, so keep it small. */
+#define DRVVD_DISCARD_BATCH_RANGES  16
+/** Maximum number of bytes discarded in one go. */
+#define DRVVD_DISCARD_BATCH_SIZE    (4 * _1M)
+
+/** Magic of the I/O trace file header. */
+#define DRVVD_IOTRACE_MAGIC         "VDIOTRC"
+/** Version of the I/O trace file format. */
+#define DRVVD_IOTRACE_VERSION       1
+
+/**
+ * I/O request types tracked by the statistics.
+ */
+typedef enum DRVVDIOREQTYPE
+{
+    DRVVDIOREQTYPE_READ = 0,
+    DRVVDIOREQTYPE_WRITE,
+    DRVVDIOREQTYPE_FLUSH,
+    DRVVDIOREQTYPE_DISCARD,
+    DRVVDIOREQTYPE_MAX,
+    DRVVDIOREQTYPE_32BIT_HACK = 0x7fffffff
+} DRVVDIOREQTYPE;
+
+/**
+ * Per request type I/O statistics.
+ */
+typedef struct DRVVDIOSTATS
+{
+    /** Number of completed requests. */
+    STAMCOUNTER             StatReqs;
+    /** Number of failed requests. */
+    STAMCOUNTER             StatReqsFailed;
+    /** Sum of all request latencies in nanoseconds. */
+    STAMCOUNTER             StatLatencyTotalNs;
+    /** Latency histogram, log2 scale in microseconds. */
+    STAMCOUNTER             aStatLatency[DRVVD_LATENCY_BUCKETS];
+} DRVVDIOSTATS, *PDRVVDIOSTATS;
+
+/**
+ * Tracking data for an asynchronous request, passed down as the user
+ * argument instead of the one from the device.
+ */
+typedef struct DRVVDIOREQ
+{
+    /** The user argument of the device above. */
+    void                   *pvUser;
+    /** Request type. */
+    DRVVDIOREQTYPE          enmType;
+    /** Start offset. */
+    uint64_t                off;
+    /** Transfer size. */
+    size_t                  cbXfer;
+    /** Submit timestamp in nanoseconds. */
+    uint64_t                tsSubmit;
+    /** Number of requests in flight when this one was submitted. */
+    uint32_t                cReqsInFlight;
+} DRVVDIOREQ, *PDRVVDIOREQ;
+
+/**
+ * I/O trace file header.
+ */
+typedef struct DRVVDIOTRACEHDR
+{
+    /** Magic, DRVVD_IOTRACE_MAGIC including the terminator. */
+    char                    szMagic[8];
+    /** Format version. */
+    uint32_t                u32Version;
+    /** Size of one record. */
+    uint32_t                cbRecord;
+    /** The disk size in bytes. */
+    uint64_t                cbDisk;
+    /** Wall clock time the trace was started at, nanoseconds since the epoch. */
+    uint64_t                u64StartTimeNs;
+} DRVVDIOTRACEHDR;
+AssertCompileSize(DRVVDIOTRACEHDR, 32);
+
+/**
+ * I/O trace record, written when a request completes.
+ */
+typedef struct DRVVDIOTRACEREC
+{
+    /** Submit timestamp in nanoseconds relative to the start of the trace. */
+    uint64_t                tsSubmit;
+    /** Start offset. */
+    uint64_t                off;
+    /** Transfer size. */
+    uint32_t                cbXfer;
+    /** Latency in microseconds. */
+    uint32_t                cUsLatency;
+    /** Request type, DRVVDIOREQTYPE. */
+    uint16_t                u16Type;
+    /** Number of requests in flight when this one was submitted. */
+    uint16_t                cReqsInFlight;
+    /** Status code of the request. */
+    int32_t                 rcReq;
+} DRVVDIOTRACEREC, *PDRVVDIOTRACEREC;
+AssertCompileSize(DRVVDIOTRACEREC, 32);
+
+/**
+ * A range waiting to be discarded by the background worker.
+ */
+typedef struct DRVVDDISCARDRANGE
+{
+    /** AVL core, the key range is the byte range to discard. */
+    AVLRU64NODECORE         Core;
+} DRVVDDISCARDRANGE, *PDRVVDDISCARDRANGE;
+
 /**
  * VBox disk container, image information, private part.
  */
@@ -189,6 +314,68 @@ typedef struct VBOXDISK
 
     /** The block cache handle if configured. */
     PPDMBLKCACHE             pBlkCache;
+
+    /** Memory cache for the async request tracking structures. */
+    RTMEMCACHE               hIoReqCache;
+    /** Number of requests currently in flight. */
+    volatile uint32_t        cReqsInFlight;
+    /** Maximum number of requests in flight since the last statistics reset. */
+    volatile uint32_t        cReqsInFlightMax;
+    /** Per request type statistics. */
+    DRVVDIOSTATS             aIoStats[DRVVDIOREQTYPE_MAX];
+
+    /** The I/O trace file, NIL_RTFILE if tracing is disabled. */
+    RTFILE                   hIoTraceFile;
+    /** Protects the trace buffers. */
+    RTSEMFASTMUTEX           IoTraceMutex;
+    /** Timestamp the trace was started at. */
+    uint64_t                 tsIoTraceStart;
+    /** Number of records in the trace buffer being filled. */
+    uint32_t                 cIoTraceRecs;
+    /** Number of records in the buffer handed to the writer, 0 if idle. */
+    uint32_t                 cIoTraceRecsWrite;
+    /** Number of records which could not be written. */
+    STAMCOUNTER              StatIoTraceDropped;
+    /** The trace buffer being filled by the completion path. */
+    PDRVVDIOTRACEREC         paIoTraceRecs;
+    /** The trace buffer being written to the file by the writer thread. */
+    PDRVVDIOTRACEREC         paIoTraceRecsWrite;
+    /** The trace writer thread. */
+    PPDMTHREAD               pThreadIoTrace;
+    /** Event semaphore the trace writer waits on. */
+    RTSEMEVENT               hEvtIoTrace;
+
+    /** Flag whether discards are queued and applied in the background. */
+    bool                     fDiscardAsync;
+    /** Flag whether the worker must not touch the image (VM suspended). */
+    bool volatile            fDiscardPaused;
+    /** Serializes image access with the discards: guest requests take it
+     * shared, the discards exclusively. Only used if fDiscardAsync is set. */
+    RTSEMRW                  hSemRWDiscard;
+    /** Protects the pending ranges, never held across image access. */
+    RTCRITSECT               CritSectDiscard;
+    /** Ranges waiting for the discard, merged and sorted by offset. */
+    AVLRU64TREE              TreeDiscardPending;
+    /** Number of ranges in the tree. */
+    uint32_t                 cDiscardRangesPending;
+    /** Number of bytes waiting for the discard. */
+    uint64_t                 cbDiscardPending;
+    /** Maximum number of bytes to discard per second, 0 if unlimited. */
+    uint32_t                 cbDiscardPerSec;
+    /** The discard worker thread. */
+    PPDMTHREAD               pThreadDiscard;
+    /** Event the discard worker waits on. */
+    RTSEMEVENT               hEvtDiscard;
+    /** Number of bytes queued for the discard. */
+    STAMCOUNTER              StatDiscardQueued;
+    /** Number of bytes discarded by the worker. */
+    STAMCOUNTER              StatDiscardApplied;
+    /** Number of bytes not discarded because they were written to first. */
+    STAMCOUNTER              StatDiscardCanceled;
+    /** Number of ranges merged with a pending one. */
+    STAMCOUNTER              StatDiscardMerged;
+    /** Number of requests processed synchronously because the queue was full. */
+    STAMCOUNTER              StatDiscardSync;
 } VBOXDISK, *PVBOXDISK;
 
 
@@ -1438,6 +1625,802 @@ static DECLCALLBACK(int) drvvdTcpPoke(VDSOCKET Sock)
 }
 
 
+/*******************************************************************************
+*   I/O statistics and tracing                                                 *
+*******************************************************************************/
+
+/**
+ * Writes the trace buffer being filled to the trace file synchronously.
+ * Only used when tracing stops, the writer thread does it otherwise.
+ *
+ * @param   pThis       The disk instance data.
+ *
+ * @note    Caller must own the trace mutex.
+ */
+static void drvvdIoTraceFlushLocked(PVBOXDISK pThis)
+{
+    if (pThis->cIoTraceRecs)
+    {
+        int rc = RTFileWrite(pThis->hIoTraceFile, pThis->paIoTraceRecs,
+                             pThis->cIoTraceRecs * sizeof(DRVVDIOTRACEREC), NULL);
+        if (RT_FAILURE(rc))
+            STAM_REL_COUNTER_ADD(&pThis->StatIoTraceDropped, pThis->cIoTraceRecs);
+        pThis->cIoTraceRecs = 0;
+    }
+}
+
+/**
+ * Hands the trace buffer to the writer thread if it is full and the writer
+ * is idle.
+ *
+ * @returns true if the writer has to be woken up.
+ * @param   pThis       The disk instance data.
+ *
+ * @note    Caller must own the trace mutex.
+ */
+static bool drvvdIoTraceSwapLocked(PVBOXDISK pThis)
+{
+    if (   pThis->cIoTraceRecs < DRVVD_IOTRACE_RECS
+        || pThis->cIoTraceRecsWrite)
+        return false;
+
+    PDRVVDIOTRACEREC paRecs = pThis->paIoTraceRecsWrite;
+    pThis->paIoTraceRecsWrite = pThis->paIoTraceRecs;
+    pThis->cIoTraceRecsWrite  = pThis->cIoTraceRecs;
+    pThis->paIoTraceRecs      = paRecs;
+    pThis->cIoTraceRecs       = 0;
+    return true;
+}
+
+/**
+ * @copydoc FNPDMTHREADDRV
+ */
+static DECLCALLBACK(int) drvvdIoTraceWriter(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PVBOXDISK pThis = PDMINS_2_DATA(pDrvIns, PVBOXDISK);
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        RTSemEventWait(pThis->hEvtIoTrace, RT_INDEFINITE_WAIT);
+
+        RTSemFastMutexRequest(pThis->IoTraceMutex);
+        while (pThis->cIoTraceRecsWrite)
+        {
+            PDRVVDIOTRACEREC paRecs = pThis->paIoTraceRecsWrite;
+            uint32_t         cRecs  = pThis->cIoTraceRecsWrite;
+            RTSemFastMutexRelease(pThis->IoTraceMutex);
+
+            /* Only this thread touches the buffer until cIoTraceRecsWrite is reset. */
+            int rc = RTFileWrite(pThis->hIoTraceFile, paRecs, cRecs * sizeof(DRVVDIOTRACEREC), NULL);
+            if (RT_FAILURE(rc))
+                STAM_REL_COUNTER_ADD(&pThis->StatIoTraceDropped, cRecs);
+
+            RTSemFastMutexRequest(pThis->IoTraceMutex);
+            pThis->cIoTraceRecsWrite = 0;
+            drvvdIoTraceSwapLocked(pThis);
+        }
+        RTSemFastMutexRelease(pThis->IoTraceMutex);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @copydoc FNPDMTHREADWAKEUPDRV
+ */
+static DECLCALLBACK(int) drvvdIoTraceWriterWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PVBOXDISK pThis = PDMINS_2_DATA(pDrvIns, PVBOXDISK);
+    NOREF(pThread);
+    return RTSemEventSignal(pThis->hEvtIoTrace);
+}
+
+/**
+ * Notes that a new request was submitted.
+ *
+ * @returns Number of requests in flight including the new one.
+ * @param   pThis       The disk instance data.
+ */
+DECLINLINE(uint32_t) drvvdIoReqSubmitted(PVBOXDISK pThis)
+{
+    uint32_t cReqsInFlight    = ASMAtomicIncU32(&pThis->cReqsInFlight);
+    uint32_t cReqsInFlightMax = ASMAtomicReadU32(&pThis->cReqsInFlightMax);
+    while (   cReqsInFlight > cReqsInFlightMax
+           && !ASMAtomicCmpXchgU32(&pThis->cReqsInFlightMax, cReqsInFlight, cReqsInFlightMax))
+        cReqsInFlightMax = ASMAtomicReadU32(&pThis->cReqsInFlightMax);
+    return cReqsInFlight;
+}
+
+/**
+ * Records a completed request in the statistics and the I/O trace.
+ *
+ * @param   pThis           The disk instance data.
+ * @param   enmType         The request type.
+ * @param   off             Start offset of the request.
+ * @param   cbXfer          Transfer size of the request.
+ * @param   tsSubmit        Submit timestamp of the request (RTTimeNanoTS).
+ * @param   cReqsInFlight   Number of requests in flight at submit time.
+ * @param   rcReq           Completion status of the request.
+ */
+static void drvvdIoReqCompleted(PVBOXDISK pThis, DRVVDIOREQTYPE enmType, uint64_t off, size_t cbXfer,
+                                uint64_t tsSubmit, uint32_t cReqsInFlight, int rcReq)
+{
+    PDRVVDIOSTATS pIoStats = &pThis->aIoStats[enmType];
+    uint64_t      cNs      = RTTimeNanoTS() - tsSubmit;
+    uint32_t      cUs32    = (uint32_t)RT_MIN(cNs / 1000, UINT32_MAX);
+    unsigned      iBucket  = RT_MIN(ASMBitLastSetU32(cUs32), DRVVD_LATENCY_BUCKETS - 1);
+
+    ASMAtomicDecU32(&pThis->cReqsInFlight);
+
+    STAM_REL_COUNTER_INC(&pIoStats->StatReqs);
+    STAM_REL_COUNTER_ADD(&pIoStats->StatLatencyTotalNs, cNs);
+    STAM_REL_COUNTER_INC(&pIoStats->aStatLatency[iBucket]);
+    if (RT_FAILURE(rcReq))
+        STAM_REL_COUNTER_INC(&pIoStats->StatReqsFailed);
+
+    if (pThis->hIoTraceFile != NIL_RTFILE)
+    {
+        int rc = RTSemFastMutexRequest(pThis->IoTraceMutex);
+        AssertRC(rc);
+
+        /* The buffer stays full while the writer is still busy with the
+         * other one, drop the record rather than block the completion. */
+        if (pThis->cIoTraceRecs < DRVVD_IOTRACE_RECS)
+        {
+            PDRVVDIOTRACEREC pRec = &pThis->paIoTraceRecs[pThis->cIoTraceRecs++];
+            pRec->tsSubmit      = tsSubmit - pThis->tsIoTraceStart;
+            pRec->off           = off;
+            pRec->cbXfer        = (uint32_t)cbXfer;
+            pRec->cUsLatency    = cUs32;
+            pRec->u16Type       = (uint16_t)enmType;
+            pRec->cReqsInFlight = (uint16_t)RT_MIN(cReqsInFlight, UINT16_MAX);
+            pRec->rcReq         = rcReq;
+            if (drvvdIoTraceSwapLocked(pThis))
+                RTSemEventSignal(pThis->hEvtIoTrace);
+        }
+        else
+            STAM_REL_COUNTER_INC(&pThis->StatIoTraceDropped);
+
+        rc = RTSemFastMutexRelease(pThis->IoTraceMutex);
+        AssertRC(rc);
+    }
+}
+
+/**
+ * Allocates the tracking structure for an asynchronous request.
+ *
+ * @returns Pointer to the request, NULL if out of memory.
+ * @param   pThis       The disk instance data.
+ * @param   enmType     The request type.
+ * @param   off         Start offset of the request.
+ * @param   cbXfer      Transfer size of the request.
+ * @param   pvUser      The user argument of the device.
+ */
+static PDRVVDIOREQ drvvdIoReqAlloc(PVBOXDISK pThis, DRVVDIOREQTYPE enmType, uint64_t off,
+                                   size_t cbXfer, void *pvUser)
+{
+    PDRVVDIOREQ pIoReq = (PDRVVDIOREQ)RTMemCacheAlloc(pThis->hIoReqCache);
+    if (RT_LIKELY(pIoReq))
+    {
+        pIoReq->pvUser        = pvUser;
+        pIoReq->enmType       = enmType;
+        pIoReq->off           = off;
+        pIoReq->cbXfer        = cbXfer;
+        pIoReq->tsSubmit      = RTTimeNanoTS();
+        pIoReq->cReqsInFlight = drvvdIoReqSubmitted(pThis);
+    }
+    return pIoReq;
+}
+
+/**
+ * Completes an asynchronous request, recording it and freeing the tracking
+ * structure.
+ *
+ * @returns The user argument of the device.
+ * @param   pThis       The disk instance data.
+ * @param   pIoReq      The request.
+ * @param   rcReq       Completion status of the request.
+ */
+static void *drvvdIoReqFree(PVBOXDISK pThis, PDRVVDIOREQ pIoReq, int rcReq)
+{
+    void *pvUser = pIoReq->pvUser;
+
+    drvvdIoReqCompleted(pThis, pIoReq->enmType, pIoReq->off, pIoReq->cbXfer,
+                        pIoReq->tsSubmit, pIoReq->cReqsInFlight, rcReq);
+    RTMemCacheFree(pThis->hIoReqCache, pIoReq);
+    return pvUser;
+}
+
+/**
+ * Registers the I/O statistics of the disk.
+ *
+ * @param   pThis       The disk instance data.
+ */
+static void drvvdIoStatsRegister(PVBOXDISK pThis)
+{
+    static const char * const s_apszTypes[DRVVDIOREQTYPE_MAX] = { "Read", "Write", "Flush", "Discard" };
+    PPDMDRVINS  pDrvIns = pThis->pDrvIns;
+    const char *pcszController;
+    uint32_t    iInstance, iLUN;
+
+    int rc = pThis->pDrvMediaPort->pfnQueryDeviceLocation(pThis->pDrvMediaPort, &pcszController,
+                                                          &iInstance, &iLUN);
+    if (RT_FAILURE(rc))
+    {
+        /* Fall back to the driver instance number. */
+        pcszController = "VD";
+        iInstance      = 0;
+        iLUN           = pDrvIns->iInstance;
+    }
+
+    PDMDrvHlpSTAMRegisterF(pDrvIns, (void *)&pThis->cReqsInFlight, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                           "Number of requests in flight.", "/Devices/%s%u/LUN%u/VD/QueueDepth",
+                           pcszController, iInstance, iLUN);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, (void *)&pThis->cReqsInFlightMax, STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                           "Maximum number of requests in flight.", "/Devices/%s%u/LUN%u/VD/QueueDepthMax",
+                           pcszController, iInstance, iLUN);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatIoTraceDropped, STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
+                           "Number of trace records which could not be written.", "/Devices/%s%u/LUN%u/VD/TraceDropped",
+                           pcszController, iInstance, iLUN);
+
+    if (pThis->fDiscardAsync)
+    {
+        PDMDrvHlpSTAMRegisterF(pDrvIns, (void *)&pThis->cbDiscardPending, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                               "Number of bytes waiting for the discard.", "/Devices/%s%u/LUN%u/VD/Discard/Pending",
+                               pcszController, iInstance, iLUN);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatDiscardQueued, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                               "Number of bytes queued for the discard.", "/Devices/%s%u/LUN%u/VD/Discard/Queued",
+                               pcszController, iInstance, iLUN);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatDiscardApplied, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                               "Number of bytes discarded in the background.", "/Devices/%s%u/LUN%u/VD/Discard/Applied",
+                               pcszController, iInstance, iLUN);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatDiscardCanceled, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                               "Number of pending bytes written to before the discard.", "/Devices/%s%u/LUN%u/VD/Discard/Canceled",
+                               pcszController, iInstance, iLUN);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatDiscardMerged, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                               "Number of ranges merged with a pending one.", "/Devices/%s%u/LUN%u/VD/Discard/Merged",
+                               pcszController, iInstance, iLUN);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatDiscardSync, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                               "Number of requests processed synchronously because the queue was full.",
+                               "/Devices/%s%u/LUN%u/VD/Discard/Sync", pcszController, iInstance, iLUN);
+    }
+
+    for (unsigned iType = 0; iType < DRVVDIOREQTYPE_MAX; iType++)
+    {
+        PDRVVDIOSTATS pIoStats = &pThis->aIoStats[iType];
+
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pIoStats->StatReqs, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                               "Number of completed requests.", "/Devices/%s%u/LUN%u/VD/%s/Requests",
+                               pcszController, iInstance, iLUN, s_apszTypes[iType]);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pIoStats->StatReqsFailed, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                               "Number of failed requests.", "/Devices/%s%u/LUN%u/VD/%s/Failed",
+                               pcszController, iInstance, iLUN, s_apszTypes[iType]);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pIoStats->StatLatencyTotalNs, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_NS,
+                               "Sum of all request latencies.", "/Devices/%s%u/LUN%u/VD/%s/LatencyTotal",
+                               pcszController, iInstance, iLUN, s_apszTypes[iType]);
+        for (unsigned iBucket = 0; iBucket < DRVVD_LATENCY_BUCKETS; iBucket++)
+        {
+            if (iBucket < DRVVD_LATENCY_BUCKETS - 1)
+                PDMDrvHlpSTAMRegisterF(pDrvIns, &pIoStats->aStatLatency[iBucket], STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
+                                       "Number of requests completed below the given latency.",
+                                       "/Devices/%s%u/LUN%u/VD/%s/Latency/%08uus",
+                                       pcszController, iInstance, iLUN, s_apszTypes[iType], RT_BIT_32(iBucket));
+            else
+                PDMDrvHlpSTAMRegisterF(pDrvIns, &pIoStats->aStatLatency[iBucket], STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
+                                       "Number of requests which took longer than the other buckets.",
+                                       "/Devices/%s%u/LUN%u/VD/%s/Latency/Above",
+                                       pcszController, iInstance, iLUN, s_apszTypes[iType]);
+        }
+    }
+}
+
+/**
+ * Opens the I/O trace file and writes the header.
+ *
+ * @returns VBox status code.
+ * @param   pThis           The disk instance data.
+ * @param   pszIoTraceFile  Path of the trace file.
+ */
+static int drvvdIoTraceCreate(PVBOXDISK pThis, const char *pszIoTraceFile)
+{
+    int rc = RTSemFastMutexCreate(&pThis->IoTraceMutex);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    rc = RTSemEventCreate(&pThis->hEvtIoTrace);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    pThis->paIoTraceRecs      = (PDRVVDIOTRACEREC)RTMemAlloc(DRVVD_IOTRACE_BUFFER_SIZE);
+    pThis->paIoTraceRecsWrite = (PDRVVDIOTRACEREC)RTMemAlloc(DRVVD_IOTRACE_BUFFER_SIZE);
+    if (!pThis->paIoTraceRecs || !pThis->paIoTraceRecsWrite)
+        return VERR_NO_MEMORY;
+
+    rc = RTFileOpen(&pThis->hIoTraceFile, pszIoTraceFile,
+                    RTFILE_O_WRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_WRITE);
+    if (RT_SUCCESS(rc))
+    {
+        DRVVDIOTRACEHDR Hdr;
+        RTTIMESPEC      Now;
+
+        RT_ZERO(Hdr);
+        memcpy(Hdr.szMagic, DRVVD_IOTRACE_MAGIC, sizeof(DRVVD_IOTRACE_MAGIC));
+        Hdr.u32Version     = DRVVD_IOTRACE_VERSION;
+        Hdr.cbRecord       = sizeof(DRVVDIOTRACEREC);
+        Hdr.cbDisk         = VDGetSize(pThis->pDisk, VD_LAST_IMAGE);
+        Hdr.u64StartTimeNs = RTTimeSpecGetNano(RTTimeNow(&Now));
+        pThis->tsIoTraceStart = RTTimeNanoTS();
+        rc = RTFileWrite(pThis->hIoTraceFile, &Hdr, sizeof(Hdr), NULL);
+        if (RT_SUCCESS(rc))
+            rc = PDMDrvHlpThreadCreate(pThis->pDrvIns, &pThis->pThreadIoTrace, pThis, drvvdIoTraceWriter,
+                                       drvvdIoTraceWriterWakeup, 0, RTTHREADTYPE_IO, "VDIoTrace");
+        if (RT_FAILURE(rc))
+        {
+            RTFileClose(pThis->hIoTraceFile);
+            pThis->hIoTraceFile = NIL_RTFILE;
+        }
+    }
+    else
+        pThis->hIoTraceFile = NIL_RTFILE;
+
+    return rc;
+}
+
+/**
+ * Flushes and closes the I/O trace file.
+ *
+ * @param   pThis       The disk instance data.
+ */
+static void drvvdIoTraceDestroy(PVBOXDISK pThis)
+{
+    if (pThis->pThreadIoTrace)
+    {
+        int rcThread;
+        int rc = PDMR3ThreadDestroy(pThis->pThreadIoTrace, &rcThread);
+        AssertRC(rc);
+        pThis->pThreadIoTrace = NULL;
+    }
+    if (pThis->hIoTraceFile != NIL_RTFILE)
+    {
+        /* The writer is gone, write what it left behind in order. */
+        if (pThis->cIoTraceRecsWrite)
+        {
+            int rc = RTFileWrite(pThis->hIoTraceFile, pThis->paIoTraceRecsWrite,
+                                 pThis->cIoTraceRecsWrite * sizeof(DRVVDIOTRACEREC), NULL);
+            if (RT_FAILURE(rc))
+                STAM_REL_COUNTER_ADD(&pThis->StatIoTraceDropped, pThis->cIoTraceRecsWrite);
+            pThis->cIoTraceRecsWrite = 0;
+        }
+        drvvdIoTraceFlushLocked(pThis);
+        RTFileClose(pThis->hIoTraceFile);
+        pThis->hIoTraceFile = NIL_RTFILE;
+    }
+    if (pThis->hEvtIoTrace != NIL_RTSEMEVENT)
+    {
+        RTSemEventDestroy(pThis->hEvtIoTrace);
+        pThis->hEvtIoTrace = NIL_RTSEMEVENT;
+    }
+    if (pThis->IoTraceMutex != NIL_RTSEMFASTMUTEX)
+    {
+        RTSemFastMutexDestroy(pThis->IoTraceMutex);
+        pThis->IoTraceMutex = NIL_RTSEMFASTMUTEX;
+    }
+    if (pThis->paIoTraceRecs)
+    {
+        RTMemFree(pThis->paIoTraceRecs);
+        pThis->paIoTraceRecs = NULL;
+    }
+    if (pThis->paIoTraceRecsWrite)
+    {
+        RTMemFree(pThis->paIoTraceRecsWrite);
+        pThis->paIoTraceRecsWrite = NULL;
+    }
+}
+
+/*******************************************************************************
+*   Background discard                                                         *
+*******************************************************************************/
+
+/**
+ * Takes the image lock shared if discards are processed in the background.
+ * Every access to the image must be serialized with the discards, other
+ * guest requests may run concurrently as before.
+ *
+ * @param   pThis       The disk instance data.
+ */
+DECLINLINE(void) drvvdDiscardLock(PVBOXDISK pThis)
+{
+    if (pThis->fDiscardAsync)
+    {
+        int rc = RTSemRWRequestRead(pThis->hSemRWDiscard, RT_INDEFINITE_WAIT);
+        AssertRC(rc);
+    }
+}
+
+/**
+ * Releases the shared image lock.
+ *
+ * @param   pThis       The disk instance data.
+ */
+DECLINLINE(void) drvvdDiscardUnlock(PVBOXDISK pThis)
+{
+    if (pThis->fDiscardAsync)
+    {
+        int rc = RTSemRWReleaseRead(pThis->hSemRWDiscard);
+        AssertRC(rc);
+    }
+}
+
+/**
+ * Inserts a range into the pending tree, merging it with all ranges it
+ * overlaps or touches.
+ *
+ * @returns VBox status code.
+ * @param   pThis       The disk instance data.
+ * @param   offStart    Start offset of the range.
+ * @param   offLast     Last byte of the range.
+ *
+ * @note    Caller must own the discard critical section.
+ */
+static int drvvdDiscardRangeInsert(PVBOXDISK pThis, uint64_t offStart, uint64_t offLast)
+{
+    PDRVVDDISCARDRANGE pRange = NULL;
+
+    /* Absorb a range ending right before or overlapping the start. */
+    if (offStart > 0)
+        pRange = (PDRVVDDISCARDRANGE)RTAvlrU64RangeGet(&pThis->TreeDiscardPending, offStart - 1);
+    if (pRange)
+    {
+        RTAvlrU64Remove(&pThis->TreeDiscardPending, pRange->Core.Key);
+        pThis->cbDiscardPending -= pRange->Core.KeyLast - pRange->Core.Key + 1;
+        pThis->cDiscardRangesPending--;
+        offStart = pRange->Core.Key;
+        offLast  = RT_MAX(offLast, pRange->Core.KeyLast);
+        STAM_REL_COUNTER_INC(&pThis->StatDiscardMerged);
+    }
+
+    /* Absorb all ranges starting inside or right after the new one. */
+    for (;;)
+    {
+        PDRVVDDISCARDRANGE pNext = (PDRVVDDISCARDRANGE)RTAvlrU64GetBestFit(&pThis->TreeDiscardPending, offStart, true);
+        if (!pNext || pNext->Core.Key > offLast + 1)
+            break;
+
+        RTAvlrU64Remove(&pThis->TreeDiscardPending, pNext->Core.Key);
+        pThis->cbDiscardPending -= pNext->Core.KeyLast - pNext->Core.Key + 1;
+        pThis->cDiscardRangesPending--;
+        offLast = RT_MAX(offLast, pNext->Core.KeyLast);
+        STAM_REL_COUNTER_INC(&pThis->StatDiscardMerged);
+        if (pRange)
+            RTMemFree(pNext);
+        else
+            pRange = pNext;
+    }
+
+    if (!pRange)
+    {
+        pRange = (PDRVVDDISCARDRANGE)RTMemAllocZ(sizeof(DRVVDDISCARDRANGE));
+        if (!pRange)
+            return VERR_NO_MEMORY;
+    }
+
+    pRange->Core.Key     = offStart;
+    pRange->Core.KeyLast = offLast;
+    bool fInserted = RTAvlrU64Insert(&pThis->TreeDiscardPending, &pRange->Core);
+    Assert(fInserted); NOREF(fInserted);
+    pThis->cbDiscardPending += offLast - offStart + 1;
+    pThis->cDiscardRangesPending++;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Removes the given range from the pending discards because the guest
+ * writes to it, splitting pending ranges where necessary.
+ *
+ * @param   pThis       The disk instance data.
+ * @param   off         Start offset of the write.
+ * @param   cb          Size of the write.
+ *
+ * @note    Caller must own the discard critical section.
+ */
+static void drvvdDiscardRangeCancel(PVBOXDISK pThis, uint64_t off, size_t cb)
+{
+    uint64_t offLast = off + cb - 1;
+
+    if (!pThis->cDiscardRangesPending || !cb)
+        return;
+
+    for (;;)
+    {
+        PDRVVDDISCARDRANGE pRange = (PDRVVDDISCARDRANGE)RTAvlrU64RangeGet(&pThis->TreeDiscardPending, off);
+        if (!pRange)
+        {
+            pRange = (PDRVVDDISCARDRANGE)RTAvlrU64GetBestFit(&pThis->TreeDiscardPending, off, true);
+            if (!pRange || pRange->Core.Key > offLast)
+                break;
+        }
+
+        uint64_t offRangeStart = pRange->Core.Key;
+        uint64_t offRangeLast  = pRange->Core.KeyLast;
+        uint64_t cbOverlap     = RT_MIN(offRangeLast, offLast) - RT_MAX(offRangeStart, off) + 1;
+
+        RTAvlrU64Remove(&pThis->TreeDiscardPending, offRangeStart);
+        pThis->cbDiscardPending -= offRangeLast - offRangeStart + 1;
+        pThis->cDiscardRangesPending--;
+        RTMemFree(pRange);
+        STAM_REL_COUNTER_ADD(&pThis->StatDiscardCanceled, cbOverlap);
+
+        /* Put back the parts outside of the write, dropping them if out of memory is fine. */
+        if (offRangeStart < off)
+            drvvdDiscardRangeInsert(pThis, offRangeStart, off - 1);
+        if (offRangeLast > offLast)
+            drvvdDiscardRangeInsert(pThis, offLast + 1, offRangeLast);
+    }
+}
+
+/**
+ * Prepares a write: takes the image lock shared and cancels all pending
+ * discards for the written range.
+ *
+ * @param   pThis       The disk instance data.
+ * @param   off         Start offset of the write.
+ * @param   cb          Size of the write.
+ */
+DECLINLINE(void) drvvdDiscardLockForWrite(PVBOXDISK pThis, uint64_t off, size_t cb)
+{
+    if (pThis->fDiscardAsync)
+    {
+        drvvdDiscardLock(pThis);
+        RTCritSectEnter(&pThis->CritSectDiscard);
+        drvvdDiscardRangeCancel(pThis, off, cb);
+        RTCritSectLeave(&pThis->CritSectDiscard);
+    }
+}
+
+/**
+ * Discards a batch of the pending ranges, starting with the lowest offset.
+ *
+ * The batch is detached from the pending tree under the critical section
+ * which is left before the image is touched, so the guest can keep queueing
+ * discards. Guest reads and writes wait for the image lock; a write racing
+ * with the batch either cancels its ranges before they are detached or runs
+ * after the discard.
+ *
+ * @returns Number of bytes discarded, 0 if nothing is pending or the worker
+ *          is paused.
+ * @param   pThis       The disk instance data.
+ */
+static uint64_t drvvdDiscardProcessBatch(PVBOXDISK pThis)
+{
+    VDRANGE  aRanges[DRVVD_DISCARD_BATCH_RANGES];
+    unsigned cRanges = 0;
+    uint64_t cbBatch = 0;
+
+    int rc = RTSemRWRequestWrite(pThis->hSemRWDiscard, RT_INDEFINITE_WAIT);
+    AssertRC(rc);
+    if (ASMAtomicReadBool(&pThis->fDiscardPaused))
+    {
+        RTSemRWReleaseWrite(pThis->hSemRWDiscard);
+        return 0;
+    }
+
+    RTCritSectEnter(&pThis->CritSectDiscard);
+
+    while (   cRanges < RT_ELEMENTS(aRanges)
+           && cbBatch < DRVVD_DISCARD_BATCH_SIZE)
+    {
+        PDRVVDDISCARDRANGE pRange = (PDRVVDDISCARDRANGE)RTAvlrU64GetBestFit(&pThis->TreeDiscardPending, 0, true);
+        if (!pRange)
+            break;
+
+        uint64_t cbRange = pRange->Core.KeyLast - pRange->Core.Key + 1;
+        uint64_t cbThis  = RT_MIN(cbRange, DRVVD_DISCARD_BATCH_SIZE - cbBatch);
+
+        aRanges[cRanges].offStart = pRange->Core.Key;
+        aRanges[cRanges].cbRange  = (size_t)cbThis;
+        cRanges++;
+        cbBatch += cbThis;
+
+        RTAvlrU64Remove(&pThis->TreeDiscardPending, pRange->Core.Key);
+        pThis->cbDiscardPending -= cbThis;
+        if (cbThis < cbRange)
+        {
+            /* Keep the rest for the next batch. */
+            pRange->Core.Key += cbThis;
+            RTAvlrU64Insert(&pThis->TreeDiscardPending, &pRange->Core);
+        }
+        else
+        {
+            pThis->cDiscardRangesPending--;
+            RTMemFree(pRange);
+        }
+    }
+
+    RTCritSectLeave(&pThis->CritSectDiscard);
+
+    if (cRanges)
+    {
+        uint64_t tsSubmit = RTTimeNanoTS();
+        uint32_t cReqsInFlight = drvvdIoReqSubmitted(pThis);
+        rc = VDDiscardRanges(pThis->pDisk, aRanges, cRanges);
+        drvvdIoReqCompleted(pThis, DRVVDIOREQTYPE_DISCARD, aRanges[0].offStart, (size_t)cbBatch,
+                            tsSubmit, cReqsInFlight, rc);
+        if (RT_FAILURE(rc))
+            LogRel(("VD: Discarding %u ranges in the background failed with %Rrc\n", cRanges, rc));
+        STAM_REL_COUNTER_ADD(&pThis->StatDiscardApplied, cbBatch);
+    }
+
+    RTSemRWReleaseWrite(pThis->hSemRWDiscard);
+    return cbBatch;
+}
+
+/**
+ * Discards all pending ranges synchronously.
+ *
+ * @param   pThis       The disk instance data.
+ */
+static void drvvdDiscardDrain(PVBOXDISK pThis)
+{
+    if (pThis->fDiscardAsync)
+        while (drvvdDiscardProcessBatch(pThis))
+            ;
+}
+
+/**
+ * Stops the worker from touching the image, waiting for the batch in
+ * progress. The pending ranges are kept for drvvdDiscardResume.
+ *
+ * @param   pThis       The disk instance data.
+ */
+static void drvvdDiscardPause(PVBOXDISK pThis)
+{
+    if (!pThis->fDiscardAsync)
+        return;
+
+    ASMAtomicWriteBool(&pThis->fDiscardPaused, true);
+    int rc = RTSemRWRequestWrite(pThis->hSemRWDiscard, RT_INDEFINITE_WAIT);
+    AssertRC(rc);
+    RTSemRWReleaseWrite(pThis->hSemRWDiscard);
+}
+
+/**
+ * Lets the worker continue with the pending ranges.
+ *
+ * @param   pThis       The disk instance data.
+ */
+static void drvvdDiscardResume(PVBOXDISK pThis)
+{
+    if (!pThis->fDiscardAsync)
+        return;
+
+    ASMAtomicWriteBool(&pThis->fDiscardPaused, false);
+    RTSemEventSignal(pThis->hEvtDiscard);
+}
+
+/**
+ * @copydoc FNPDMTHREADDRV
+ */
+static DECLCALLBACK(int) drvvdDiscardWorker(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PVBOXDISK pThis = PDMINS_2_DATA(pDrvIns, PVBOXDISK);
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        uint64_t cbDiscarded = drvvdDiscardProcessBatch(pThis);
+        if (!cbDiscarded)
+            RTSemEventWait(pThis->hEvtDiscard, RT_INDEFINITE_WAIT);
+        else if (pThis->cbDiscardPerSec)
+        {
+            /* Sleep until the rate allows the next batch. */
+            RTMSINTERVAL cMsSleep = (RTMSINTERVAL)RT_MIN(cbDiscarded * RT_MS_1SEC / pThis->cbDiscardPerSec, 10 * RT_MS_1SEC);
+            uint64_t     tsEnd    = RTTimeMilliTS() + cMsSleep;
+
+            while (   pThread->enmState == PDMTHREADSTATE_RUNNING
+                   && RTTimeMilliTS() < tsEnd)
+                RTSemEventWait(pThis->hEvtDiscard, (RTMSINTERVAL)(tsEnd - RTTimeMilliTS()));
+        }
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @copydoc FNPDMTHREADWAKEUPDRV
+ */
+static DECLCALLBACK(int) drvvdDiscardWorkerWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PVBOXDISK pThis = PDMINS_2_DATA(pDrvIns, PVBOXDISK);
+    NOREF(pThread);
+    return RTSemEventSignal(pThis->hEvtDiscard);
+}
+
+/**
+ * Sets up discarding in the background.
+ *
+ * @returns VBox status code.
+ * @param   pThis       The disk instance data.
+ */
+static int drvvdDiscardAsyncCreate(PVBOXDISK pThis)
+{
+    int rc = RTCritSectInit(&pThis->CritSectDiscard);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    rc = RTSemRWCreate(&pThis->hSemRWDiscard);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTSemEventCreate(&pThis->hEvtDiscard);
+        if (RT_SUCCESS(rc))
+        {
+            pThis->TreeDiscardPending    = NULL;
+            pThis->cDiscardRangesPending = 0;
+            pThis->cbDiscardPending      = 0;
+            pThis->fDiscardPaused        = false;
+
+            rc = PDMDrvHlpThreadCreate(pThis->pDrvIns, &pThis->pThreadDiscard, pThis, drvvdDiscardWorker,
+                                       drvvdDiscardWorkerWakeup, 0, RTTHREADTYPE_IO, "VDDiscard");
+            if (RT_SUCCESS(rc))
+            {
+                pThis->fDiscardAsync = true;
+                return VINF_SUCCESS;
+            }
+
+            RTSemEventDestroy(pThis->hEvtDiscard);
+            pThis->hEvtDiscard = NIL_RTSEMEVENT;
+        }
+
+        RTSemRWDestroy(pThis->hSemRWDiscard);
+        pThis->hSemRWDiscard = NIL_RTSEMRW;
+    }
+
+    RTCritSectDelete(&pThis->CritSectDiscard);
+    return rc;
+}
+
+/**
+ * Destroys the background discard worker, discarding everything still pending
+ * unless the image was made read-only by drvvdSuspend.
+ *
+ * @param   pThis       The disk instance data.
+ */
+static void drvvdDiscardAsyncDestroy(PVBOXDISK pThis)
+{
+    if (!pThis->fDiscardAsync)
+        return;
+
+    if (pThis->pThreadDiscard)
+    {
+        int rcThread;
+        int rc = PDMR3ThreadDestroy(pThis->pThreadDiscard, &rcThread);
+        AssertRC(rc);
+        pThis->pThreadDiscard = NULL;
+    }
+
+    if (VALID_PTR(pThis->pDisk))
+        drvvdDiscardDrain(pThis); /* Does nothing while paused. */
+
+    /* Free what couldn't be discarded. */
+    PDRVVDDISCARDRANGE pRange;
+    while ((pRange = (PDRVVDDISCARDRANGE)RTAvlrU64GetBestFit(&pThis->TreeDiscardPending, 0, true)) != NULL)
+    {
+        RTAvlrU64Remove(&pThis->TreeDiscardPending, pRange->Core.Key);
+        RTMemFree(pRange);
+    }
+
+    pThis->fDiscardAsync = false;
+    RTSemEventDestroy(pThis->hEvtDiscard);
+    pThis->hEvtDiscard = NIL_RTSEMEVENT;
+    RTSemRWDestroy(pThis->hSemRWDiscard);
+    pThis->hSemRWDiscard = NIL_RTSEMRW;
+    RTCritSectDelete(&pThis->CritSectDiscard);
+}
+
 /*******************************************************************************
 *   Media interface methods                                                    *
 *******************************************************************************/
@@ -1450,6 +2433,12 @@ static DECLCALLBACK(int) drvvdRead(PPDMIMEDIA pInterface,
 
     LogFlowFunc(("off=%#llx pvBuf=%p cbRead=%d\n", off, pvBuf, cbRead));
     PVBOXDISK pThis = PDMIMEDIA_2_VBOXDISK(pInterface);
+    uint64_t const offStart = off;
+    size_t const   cbStart  = cbRead;
+    uint64_t const tsSubmit = RTTimeNanoTS();
+    uint32_t const cReqsInFlight = drvvdIoReqSubmitted(pThis);
+
+    drvvdDiscardLock(pThis);
 
     if (!pThis->fBootAccelActive)
         rc = VDRead(pThis->pDisk, off, pvBuf, cbRead);
@@ -1485,6 +2474,9 @@ static DECLCALLBACK(int) drvvdRead(PPDMIMEDIA pInterface,
         }
     }
 
+    drvvdDiscardUnlock(pThis);
+    drvvdIoReqCompleted(pThis, DRVVDIOREQTYPE_READ, offStart, cbStart, tsSubmit, cReqsInFlight, rc);
+
     if (RT_SUCCESS(rc))
         Log2(("%s: off=%#llx pvBuf=%p cbRead=%d %.*Rhxd\n", __FUNCTION__,
               off, pvBuf, cbRead, cbRead, pvBuf));
@@ -1509,7 +2501,12 @@ static DECLCALLBACK(int) drvvdWrite(PPDMIMEDIA pInterface,
         pThis->offDisk     = 0;
     }
 
+    uint64_t tsSubmit = RTTimeNanoTS();
+    uint32_t cReqsInFlight = drvvdIoReqSubmitted(pThis);
+    drvvdDiscardLockForWrite(pThis, off, cbWrite);
     int rc = VDWrite(pThis->pDisk, off, pvBuf, cbWrite);
+    drvvdDiscardUnlock(pThis);
+    drvvdIoReqCompleted(pThis, DRVVDIOREQTYPE_WRITE, off, cbWrite, tsSubmit, cReqsInFlight, rc);
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
 }
@@ -1519,7 +2516,12 @@ static DECLCALLBACK(int) drvvdFlush(PPDMIMEDIA pInterface)
 {
     LogFlowFunc(("\n"));
     PVBOXDISK pThis = PDMIMEDIA_2_VBOXDISK(pInterface);
+    uint64_t tsSubmit = RTTimeNanoTS();
+    uint32_t cReqsInFlight = drvvdIoReqSubmitted(pThis);
+    drvvdDiscardLock(pThis);
     int rc = VDFlush(pThis->pDisk);
+    drvvdDiscardUnlock(pThis);
+    drvvdIoReqCompleted(pThis, DRVVDIOREQTYPE_FLUSH, 0, 0, tsSubmit, cReqsInFlight, rc);
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
 }
@@ -1678,8 +2680,51 @@ static DECLCALLBACK(int) drvvdDiscard(PPDMIMEDIA pInterface, PPDMRANGE paRanges,
     LogFlowFunc(("\n"));
     PVBOXDISK pThis = PDMIMEDIA_2_VBOXDISK(pInterface);
 
+    uint64_t tsSubmit = RTTimeNanoTS();
+    uint32_t cReqsInFlight = drvvdIoReqSubmitted(pThis);
+    size_t   cbDiscard = 0;
+    for (unsigned i = 0; i < cRanges; i++)
+        cbDiscard += paRanges[i].cbRange;
+
+    int rc = VINF_SUCCESS;
+    if (pThis->fDiscardAsync)
+    {
+        /*
+         * Queue the ranges for the worker and complete the request right away,
+         * unless too many ranges are waiting already.
+         */
+        RTCritSectEnter(&pThis->CritSectDiscard);
+        if (pThis->cDiscardRangesPending + cRanges <= DRVVD_DISCARD_RANGES_MAX)
+        {
+            for (unsigned i = 0; i < cRanges && RT_SUCCESS(rc); i++)
+                if (paRanges[i].cbRange)
+                    rc = drvvdDiscardRangeInsert(pThis, paRanges[i].offStart,
+                                                 paRanges[i].offStart + paRanges[i].cbRange - 1);
+            RTCritSectLeave(&pThis->CritSectDiscard);
+
+            if (RT_SUCCESS(rc))
+            {
+                STAM_REL_COUNTER_ADD(&pThis->StatDiscardQueued, cbDiscard);
+                RTSemEventSignal(pThis->hEvtDiscard);
+                LogFlowFunc(("returns %Rrc (queued)\n", rc));
+                return rc;
+            }
+        }
+        else
+            RTCritSectLeave(&pThis->CritSectDiscard);
+        STAM_REL_COUNTER_INC(&pThis->StatDiscardSync);
+
+        /* Exclusive like the worker's batches. */
+        rc = RTSemRWRequestWrite(pThis->hSemRWDiscard, RT_INDEFINITE_WAIT);
+        AssertRC(rc);
+    }
+
     /** @todo: Fix the cast properly without allocating temporary memory (maybe move the type to IPRT). */
-    int rc = VDDiscardRanges(pThis->pDisk, (PVDRANGE)paRanges, cRanges);
+    rc = VDDiscardRanges(pThis->pDisk, (PVDRANGE)paRanges, cRanges);
+    if (pThis->fDiscardAsync)
+        RTSemRWReleaseWrite(pThis->hSemRWDiscard);
+    drvvdIoReqCompleted(pThis, DRVVDIOREQTYPE_DISCARD, cRanges ? paRanges[0].offStart : 0, cbDiscard,
+                        tsSubmit, cReqsInFlight, rc);
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
 }
@@ -1694,8 +2739,9 @@ static void drvvdAsyncReqComplete(void *pvUser1, void *pvUser2, int rcReq)
 
     if (!pThis->pBlkCache)
     {
+        void *pvUser = drvvdIoReqFree(pThis, (PDRVVDIOREQ)pvUser2, rcReq);
         int rc = pThis->pDrvMediaAsyncPort->pfnTransferCompleteNotify(pThis->pDrvMediaAsyncPort,
-                                                                      pvUser2, rcReq);
+                                                                      pvUser, rcReq);
         AssertRC(rc);
     }
     else
@@ -1713,19 +2759,28 @@ static DECLCALLBACK(int) drvvdStartRead(PPDMIMEDIAASYNC pInterface, uint64_t uOf
 
     pThis->fBootAccelActive = false;
 
+    PDRVVDIOREQ pIoReq = drvvdIoReqAlloc(pThis, DRVVDIOREQTYPE_READ, uOffset, cbRead, pvUser);
+    if (RT_UNLIKELY(!pIoReq))
+        return VERR_NO_MEMORY;
+
     RTSGBUF SgBuf;
     RTSgBufInit(&SgBuf, paSeg, cSeg);
+    drvvdDiscardLock(pThis);
     if (!pThis->pBlkCache)
         rc = VDAsyncRead(pThis->pDisk, uOffset, cbRead, &SgBuf,
-                         drvvdAsyncReqComplete, pThis, pvUser);
+                         drvvdAsyncReqComplete, pThis, pIoReq);
     else
     {
-        rc = PDMR3BlkCacheRead(pThis->pBlkCache, uOffset, &SgBuf, cbRead, pvUser);
+        rc = PDMR3BlkCacheRead(pThis->pBlkCache, uOffset, &SgBuf, cbRead, pIoReq);
         if (rc == VINF_AIO_TASK_PENDING)
             rc = VERR_VD_ASYNC_IO_IN_PROGRESS;
         else if (rc == VINF_SUCCESS)
             rc = VINF_VD_ASYNC_IO_FINISHED;
     }
+    drvvdDiscardUnlock(pThis);
+
+    if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+        drvvdIoReqFree(pThis, pIoReq, rc == VINF_VD_ASYNC_IO_FINISHED ? VINF_SUCCESS : rc);
 
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
@@ -1742,20 +2797,29 @@ static DECLCALLBACK(int) drvvdStartWrite(PPDMIMEDIAASYNC pInterface, uint64_t uO
 
     pThis->fBootAccelActive = false;
 
+    PDRVVDIOREQ pIoReq = drvvdIoReqAlloc(pThis, DRVVDIOREQTYPE_WRITE, uOffset, cbWrite, pvUser);
+    if (RT_UNLIKELY(!pIoReq))
+        return VERR_NO_MEMORY;
+
     RTSGBUF SgBuf;
     RTSgBufInit(&SgBuf, paSeg, cSeg);
 
+    drvvdDiscardLockForWrite(pThis, uOffset, cbWrite);
     if (!pThis->pBlkCache)
         rc = VDAsyncWrite(pThis->pDisk, uOffset, cbWrite, &SgBuf,
-                          drvvdAsyncReqComplete, pThis, pvUser);
+                          drvvdAsyncReqComplete, pThis, pIoReq);
     else
     {
-        rc = PDMR3BlkCacheWrite(pThis->pBlkCache, uOffset, &SgBuf, cbWrite, pvUser);
+        rc = PDMR3BlkCacheWrite(pThis->pBlkCache, uOffset, &SgBuf, cbWrite, pIoReq);
         if (rc == VINF_AIO_TASK_PENDING)
             rc = VERR_VD_ASYNC_IO_IN_PROGRESS;
         else if (rc == VINF_SUCCESS)
             rc = VINF_VD_ASYNC_IO_FINISHED;
     }
+    drvvdDiscardUnlock(pThis);
+
+    if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+        drvvdIoReqFree(pThis, pIoReq, rc == VINF_VD_ASYNC_IO_FINISHED ? VINF_SUCCESS : rc);
 
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
@@ -1767,16 +2831,25 @@ static DECLCALLBACK(int) drvvdStartFlush(PPDMIMEDIAASYNC pInterface, void *pvUse
     int rc = VINF_SUCCESS;
     PVBOXDISK pThis = PDMIMEDIAASYNC_2_VBOXDISK(pInterface);
 
+    PDRVVDIOREQ pIoReq = drvvdIoReqAlloc(pThis, DRVVDIOREQTYPE_FLUSH, 0, 0, pvUser);
+    if (RT_UNLIKELY(!pIoReq))
+        return VERR_NO_MEMORY;
+
+    drvvdDiscardLock(pThis);
     if (!pThis->pBlkCache)
-        rc = VDAsyncFlush(pThis->pDisk, drvvdAsyncReqComplete, pThis, pvUser);
+        rc = VDAsyncFlush(pThis->pDisk, drvvdAsyncReqComplete, pThis, pIoReq);
     else
     {
-        rc = PDMR3BlkCacheFlush(pThis->pBlkCache, pvUser);
+        rc = PDMR3BlkCacheFlush(pThis->pBlkCache, pIoReq);
         if (rc == VINF_AIO_TASK_PENDING)
             rc = VERR_VD_ASYNC_IO_IN_PROGRESS;
         else if (rc == VINF_SUCCESS)
             rc = VINF_VD_ASYNC_IO_FINISHED;
     }
+    drvvdDiscardUnlock(pThis);
+
+    if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+        drvvdIoReqFree(pThis, pIoReq, rc == VINF_VD_ASYNC_IO_FINISHED ? VINF_SUCCESS : rc);
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
 }
@@ -1786,6 +2859,7 @@ static void drvvdBlkCacheXferComplete(PPDMDRVINS pDrvIns, void *pvUser, int rcRe
 {
     PVBOXDISK pThis = PDMINS_2_DATA(pDrvIns, PVBOXDISK);
 
+    pvUser = drvvdIoReqFree(pThis, (PDRVVDIOREQ)pvUser, rcReq);
     int rc = pThis->pDrvMediaAsyncPort->pfnTransferCompleteNotify(pThis->pDrvMediaAsyncPort,
                                                                   pvUser, rcReq);
     AssertRC(rc);
@@ -1900,6 +2974,7 @@ static DECLCALLBACK(void) drvvdResume(PPDMDRVINS pDrvIns)
 
     drvvdSetWritable(pThis);
     pThis->fErrorUseRuntime = true;
+    drvvdDiscardResume(pThis);
 
     if (pThis->pBlkCache)
     {
@@ -1934,6 +3009,9 @@ static DECLCALLBACK(void) drvvdSuspend(PPDMDRVINS pDrvIns)
         AssertRC(rc);
     }
 
+    /* The image becomes read-only; only wait for the discard batch in
+       progress, the pending ranges are applied after resuming. */
+    drvvdDiscardPause(pThis);
     drvvdSetReadonly(pThis);
 }
 
@@ -2000,12 +3078,21 @@ static DECLCALLBACK(void) drvvdDestruct(PPDMDRVINS pDrvIns)
         pThis->pBlkCache = NULL;
     }
 
+    drvvdDiscardAsyncDestroy(pThis);
+
     if (VALID_PTR(pThis->pDisk))
     {
         VDDestroy(pThis->pDisk);
         pThis->pDisk = NULL;
     }
     drvvdFreeImages(pThis);
+    drvvdIoTraceDestroy(pThis);
+
+    if (pThis->hIoReqCache != NIL_RTMEMCACHE)
+    {
+        RTMemCacheDestroy(pThis->hIoReqCache);
+        pThis->hIoReqCache = NIL_RTMEMCACHE;
+    }
 
     if (pThis->MergeLock != NIL_RTSEMRW)
     {
@@ -2038,6 +3125,7 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns,
     char *pszFormat = NULL;      /**< The format backed to use for this image. */
     char *pszCachePath = NULL;   /**< The path to the cache image. */
     char *pszCacheFormat = NULL; /**< The format backend to use for the cache image. */
+    char *pszIoTraceFile = NULL; /**< The path of the I/O trace file. */
     bool fReadOnly;              /**< True if the media is read-only. */
     bool fMaybeReadOnly;         /**< True if the media may or may not be read-only. */
     bool fHonorZeroWrites;       /**< True if zero blocks should be written. */
@@ -2056,6 +3144,13 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns,
     pThis->MergeCompleteMutex           = NIL_RTSEMFASTMUTEX;
     pThis->uMergeSource                 = VD_LAST_IMAGE;
     pThis->uMergeTarget                 = VD_LAST_IMAGE;
+    pThis->hIoReqCache                  = NIL_RTMEMCACHE;
+    pThis->hIoTraceFile                 = NIL_RTFILE;
+    pThis->IoTraceMutex                 = NIL_RTSEMFASTMUTEX;
+    pThis->hEvtIoTrace                  = NIL_RTSEMEVENT;
+    pThis->fDiscardAsync                = false;
+    pThis->hSemRWDiscard                = NIL_RTSEMRW;
+    pThis->hEvtDiscard                  = NIL_RTSEMEVENT;
 
     /* IMedia */
     pThis->IMedia.pfnRead               = drvvdRead;
@@ -2104,6 +3199,7 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns,
     bool        fUseNewIo = false;
     bool        fUseBlockCache = false;
     bool        fDiscard = false;
+    bool        fDiscardAsync = false;
     unsigned    iLevel = 0;
     PCFGMNODE   pCurNode = pCfg;
     VDTYPE      enmType = VDTYPE_HDD;
@@ -2121,7 +3217,8 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns,
                                           "ReadOnly\0MaybeReadOnly\0TempReadOnly\0Shareable\0HonorZeroWrites\0"
                                           "HostIPStack\0UseNewIo\0BootAcceleration\0BootAccelerationBuffer\0"
                                           "SetupMerge\0MergeSource\0MergeTarget\0BwGroup\0Type\0BlockCache\0"
-                                          "CachePath\0CacheFormat\0Discard\0");
+                                          "CachePath\0CacheFormat\0Discard\0DiscardAsync\0DiscardRate\0"
+                                          "IoTraceFile\0");
         }
         else
         {
@@ -2250,6 +3347,29 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns,
                                       N_("DrvVD: Configuration error: Querying \"Discard\" as boolean failed"));
                 break;
             }
+            rc = CFGMR3QueryBoolDef(pCurNode, "DiscardAsync", &fDiscardAsync, false);
+            if (RT_FAILURE(rc))
+            {
+                rc = PDMDRV_SET_ERROR(pDrvIns, rc,
+                                      N_("DrvVD: Configuration error: Querying \"DiscardAsync\" as boolean failed"));
+                break;
+            }
+            rc = CFGMR3QueryU32Def(pCurNode, "DiscardRate", &pThis->cbDiscardPerSec, 0);
+            if (RT_FAILURE(rc))
+            {
+                rc = PDMDRV_SET_ERROR(pDrvIns, rc,
+                                      N_("DrvVD: Configuration error: Querying \"DiscardRate\" as integer failed"));
+                break;
+            }
+            rc = CFGMR3QueryStringAlloc(pCurNode, "IoTraceFile", &pszIoTraceFile);
+            if (RT_FAILURE(rc) && rc != VERR_CFGM_VALUE_NOT_FOUND)
+            {
+                rc = PDMDRV_SET_ERROR(pDrvIns, rc,
+                                      N_("DrvVD: Configuration error: Querying \"IoTraceFile\" as string failed"));
+                break;
+            }
+            else
+                rc = VINF_SUCCESS;
             if (fReadOnly && fDiscard)
             {
                 rc = PDMDRV_SET_ERROR(pDrvIns, VERR_PDM_DRIVER_INVALID_PROPERTIES,
@@ -2738,6 +3858,50 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns,
             LogRel(("VD: Boot acceleration, out of memory, disabled\n"));
     }
 
+    /* Set up the background discard if enabled. */
+    if (   RT_SUCCESS(rc)
+        && pThis->IMedia.pfnDiscard
+        && fDiscardAsync)
+    {
+        rc = drvvdDiscardAsyncCreate(pThis);
+        if (RT_SUCCESS(rc))
+            LogRel(("VD: Discarding in the background (rate limit %u bytes/s)\n", pThis->cbDiscardPerSec));
+        else
+            rc = PDMDRV_SET_ERROR(pDrvIns, rc, N_("DrvVD: Failed to create the discard worker"));
+    }
+
+    /* Set up the per request statistics and the optional I/O trace. */
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTMemCacheCreate(&pThis->hIoReqCache, sizeof(DRVVDIOREQ), 0, UINT32_MAX,
+                              NULL, NULL, NULL, 0);
+        if (RT_FAILURE(rc))
+            rc = PDMDRV_SET_ERROR(pDrvIns, rc, N_("DrvVD: Failed to create the request cache"));
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        drvvdIoStatsRegister(pThis);
+
+        if (pszIoTraceFile)
+        {
+            rc = drvvdIoTraceCreate(pThis, pszIoTraceFile);
+            if (RT_SUCCESS(rc))
+                LogRel(("VD: Tracing I/O requests to '%s'\n", pszIoTraceFile));
+            else
+            {
+                /* Not fatal, the VM works fine without the trace. */
+                LogRel(("VD: Failed to create I/O trace file '%s' (%Rrc), tracing disabled\n",
+                        pszIoTraceFile, rc));
+                drvvdIoTraceDestroy(pThis);
+                rc = VINF_SUCCESS;
+            }
+        }
+    }
+
+    if (pszIoTraceFile)
+        MMR3HeapFree(pszIoTraceFile);
+
     if (RT_FAILURE(rc))
     {
         if (VALID_PTR(pszName))
@@ -215,7 +215,7 @@ void vqueueNotify(PVPCISTATE pState, PVQUEUE pQueue)
     if (!(vringReadAvailFlags(pState, &pQueue->VRing) & VRINGAVAIL_F_NO_INTERRUPT)
         || ((pState->uGuestFeatures & VPCI_F_NOTIFY_ON_EMPTY) && vqueueIsEmpty(pState, pQueue)))
     {
-        int rc = vpciRaiseInterrupt(pState, VERR_INTERNAL_ERROR, VPCI_ISR_QUEUE);
+        int rc = vpciRaiseInterruptVector(pState, VPCI_ISR_QUEUE, pQueue->uVector);
         if (RT_FAILURE(rc))
             Log(("%s vqueueNotify: Failed to raise an interrupt (%Rrc).\n", INSTANCE(pState), rc));
     }
@@ -226,12 +226,13 @@ void vqueueNotify(PVPCISTATE pState, PVQUEUE pQueue)
 
 }
 
-void vqueueSync(PVPCISTATE pState, PVQUEUE pQueue)
+void vqueueSync(PVPCISTATE pState, PVQUEUE pQueue, bool fNotify)
 {
     Log2(("%s vqueueSync: %s old_used_idx=%u new_used_idx=%u\n", INSTANCE(pState),
           QUEUENAME(pState, pQueue), vringReadUsedIndex(pState, &pQueue->VRing), pQueue->uNextUsedIndex));
     vringWriteUsedIndex(pState, &pQueue->VRing, pQueue->uNextUsedIndex);
-    vqueueNotify(pState, pQueue);
+    if (fNotify)
+        vqueueNotify(pState, pQueue);
 }
 
 void vpciReset(PVPCISTATE pState)
@@ -240,9 +241,12 @@ void vpciReset(PVPCISTATE pState)
     pState->uQueueSelector = 0;
     pState->uStatus        = 0;
     pState->uISR           = 0;
+    pState->uConfigVector  = VPCI_NO_VECTOR;
 
     for (unsigned i = 0; i < pState->nQueues; i++)
         vqueueReset(&pState->Queues[i]);
+    for (unsigned i = 0; i < RT_ELEMENTS(pState->Queues); i++)
+        pState->Queues[i].uVector = VPCI_NO_VECTOR;
 }
 
 
@@ -263,12 +267,50 @@ int vpciRaiseInterrupt(VPCISTATE *pState, int rcBusy, uint8_t u8IntCause)
     LogFlow(("%s vpciRaiseInterrupt: u8IntCause=%x\n",
              INSTANCE(pState), u8IntCause));
 
-    pState->uISR |= u8IntCause;
+    if (vpciIsMsixEnabled(pState))
+    {
+        /* Only configuration changes are signalled this way. */
+        if (pState->uConfigVector != VPCI_NO_VECTOR)
+            PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), pState->uConfigVector, 1);
+        return VINF_SUCCESS;
+    }
+
+    /* The ISR is read and cleared without the lock, see vpciIOPortIn. */
+    uint8_t uISR;
+    do
+        uISR = ASMAtomicUoReadU8(&pState->uISR);
+    while (!ASMAtomicCmpXchgU8(&pState->uISR, uISR | u8IntCause, uISR));
     PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), 0, 1);
     // vpciCsLeave(pState);
     return VINF_SUCCESS;
 }
 
+/**
+ * Raise interrupt through the given MSI-X vector, falls back to INTx and ISR
+ * if the guest has not enabled MSI-X.
+ *
+ * @param   pState      The device state structure.
+ * @param   u8IntCause  Interrupt cause bit mask to set in PCI ISR port.
+ * @param   uVector     The MSI-X vector assigned to the source.
+ */
+int vpciRaiseInterruptVector(VPCISTATE *pState, uint8_t u8IntCause, uint16_t uVector)
+{
+    if (!vpciIsMsixEnabled(pState))
+        return vpciRaiseInterrupt(pState, VERR_INTERNAL_ERROR, u8IntCause);
+
+    /* The ISR is not used with MSI-X, every source has a vector of its own. */
+    if (uVector == VPCI_NO_VECTOR)
+    {
+        STAM_COUNTER_INC(&pState->StatIntsSkipped);
+        return VINF_SUCCESS;
+    }
+    STAM_COUNTER_INC(&pState->StatIntsRaised);
+    LogFlow(("%s vpciRaiseInterruptVector: uVector=%u\n",
+             INSTANCE(pState), uVector));
+    PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), uVector, 1);
+    return VINF_SUCCESS;
+}
+
 /**
  * Lower interrupt.
  *
@@ -277,9 +319,30 @@ int vpciRaiseInterrupt(VPCISTATE *pState, int rcBusy, uint8_t u8IntCause)
 PDMBOTHCBDECL(void) vpciLowerInterrupt(VPCISTATE *pState)
 {
     LogFlow(("%s vpciLowerInterrupt\n", INSTANCE(pState)));
+    if (vpciIsMsixEnabled(pState))
+        return; /* MSI-X messages are edge triggered. */
     PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), 0, 0);
 }
 
+/**
+ * Returns the offset of the device specific registers in the I/O space,
+ * they move up to make room for the vector registers when MSI-X is on.
+ */
+DECLINLINE(uint32_t) vpciConfigOffset(PVPCISTATE pState)
+{
+    return vpciIsMsixEnabled(pState) ? VPCI_CONFIG_MSIX : VPCI_CONFIG;
+}
+
+/**
+ * Checks the vector written by the guest, the spec wants VPCI_NO_VECTOR read
+ * back if the device cannot use it.
+ */
+DECLINLINE(uint16_t) vpciValidVector(PVPCISTATE pState, uint32_t u32)
+{
+    u32 &= 0xFFFF;
+    return u32 < pState->cMsixVectors ? (uint16_t)u32 : VPCI_NO_VECTOR;
+}
+
 DECLINLINE(uint32_t) vpciGetHostFeatures(PVPCISTATE pState,
                                          PFNGETHOSTFEATURES pfnGetHostFeatures)
 {
@@ -362,15 +425,24 @@ int vpciIOPortIn(PPDMDEVINS         pDevIns,
 
         case VPCI_ISR:
             Assert(cb == 1);
-            *(uint8_t*)pu32 = pState->uISR;
-            pState->uISR = 0; /* read clears all interrupts */
+            *(uint8_t*)pu32 = ASMAtomicXchgU8(&pState->uISR, 0); /* read clears all interrupts */
             vpciLowerInterrupt(pState);
             break;
 
         default:
-            if (port >= VPCI_CONFIG)
+            if (vpciIsMsixEnabled(pState) && port == VPCI_CONFIG_VECTOR)
+            {
+                Assert(cb == 2);
+                *(uint16_t*)pu32 = pState->uConfigVector;
+            }
+            else if (vpciIsMsixEnabled(pState) && port == VPCI_QUEUE_VECTOR)
+            {
+                Assert(cb == 2);
+                *(uint16_t*)pu32 = pState->Queues[pState->uQueueSelector].uVector;
+            }
+            else if (port >= vpciConfigOffset(pState))
             {
-                rc = pfnGetConfig(pState, port - VPCI_CONFIG, cb, pu32);
+                rc = pfnGetConfig(pState, port - vpciConfigOffset(pState), cb, pu32);
             }
             else
             {
@@ -426,6 +498,11 @@ int vpciIOPortOut(PPDMDEVINS                pDevIns,
     switch (port)
     {
         case VPCI_GUEST_FEATURES:
+#ifndef IN_RING3
+            /* The device may rearrange its queues depending on the features. */
+            rc = VINF_IOM_HC_IOPORT_WRITE;
+            break;
+#else
             /* Check if the guest negotiates properly, fall back to basics if it does not. */
             if (VPCI_F_BAD_FEATURE & u32)
             {
@@ -446,6 +523,7 @@ int vpciIOPortOut(PPDMDEVINS                pDevIns,
                 pState->uGuestFeatures = u32;
             pfnSetHostFeatures(pState, pState->uGuestFeatures);
             break;
+#endif
 
         case VPCI_QUEUE_PFN:
             /*
@@ -507,8 +585,18 @@ int vpciIOPortOut(PPDMDEVINS                pDevIns,
             break;
 
         default:
-            if (port >= VPCI_CONFIG)
-                rc = pfnSetConfig(pState, port - VPCI_CONFIG, cb, &u32);
+            if (vpciIsMsixEnabled(pState) && port == VPCI_CONFIG_VECTOR)
+            {
+                Assert(cb == 2);
+                pState->uConfigVector = vpciValidVector(pState, u32);
+            }
+            else if (vpciIsMsixEnabled(pState) && port == VPCI_QUEUE_VECTOR)
+            {
+                Assert(cb == 2);
+                pState->Queues[pState->uQueueSelector].uVector = vpciValidVector(pState, u32);
+            }
+            else if (port >= vpciConfigOffset(pState))
+                rc = pfnSetConfig(pState, port - vpciConfigOffset(pState), cb, &u32);
             else
                 rc = PDMDevHlpDBGFStop(pDevIns, RT_SRC_POS, "%s vpciIOPortOut: no valid port at offset port=%RTiop cb=%08x\n", szInst, port, cb);
             break;
@@ -700,6 +788,15 @@ int vpciSaveExec(PVPCISTATE pState, PSSMHANDLE pSSM)
         AssertRCReturn(rc, rc);
     }
 
+    /* Save MSI-X vector assignment */
+    rc = SSMR3PutU16(pSSM, pState->uConfigVector);
+    AssertRCReturn(rc, rc);
+    for (unsigned i = 0; i < pState->nQueues; i++)
+    {
+        rc = SSMR3PutU16(pSSM, pState->Queues[i].uVector);
+        AssertRCReturn(rc, rc);
+    }
+
     return VINF_SUCCESS;
 }
 
@@ -736,6 +833,9 @@ int vpciLoadExec(PVPCISTATE pState, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
         }
         else
             pState->nQueues = nQueues;
+        AssertLogRelMsgReturn(pState->nQueues <= VIRTIO_MAX_NQUEUES,
+                              ("%u queues\n", pState->nQueues),
+                              VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
         for (unsigned i = 0; i < pState->nQueues; i++)
         {
             rc = SSMR3GetU16(pSSM, &pState->Queues[i].VRing.uSize);
@@ -751,6 +851,24 @@ int vpciLoadExec(PVPCISTATE pState, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
             rc = SSMR3GetU16(pSSM, &pState->Queues[i].uNextUsedIndex);
             AssertRCReturn(rc, rc);
         }
+
+        /* Restore MSI-X vectors */
+        if (uVersion > VIRTIO_SAVEDSTATE_VERSION_PRE_MSIX)
+        {
+            rc = SSMR3GetU16(pSSM, &pState->uConfigVector);
+            AssertRCReturn(rc, rc);
+            for (unsigned i = 0; i < pState->nQueues; i++)
+            {
+                rc = SSMR3GetU16(pSSM, &pState->Queues[i].uVector);
+                AssertRCReturn(rc, rc);
+            }
+        }
+        else
+        {
+            pState->uConfigVector = VPCI_NO_VECTOR;
+            for (unsigned i = 0; i < pState->nQueues; i++)
+                pState->Queues[i].uVector = VPCI_NO_VECTOR;
+        }
     }
 
     vpciDumpState(pState, "vpciLoadExec");
@@ -806,7 +924,7 @@ static const char *vpciCounter(const char *pszDevFmt,
 DECLCALLBACK(int) vpciConstruct(PPDMDEVINS pDevIns, VPCISTATE *pState,
                                 int iInstance, const char *pcszNameFmt,
                                 uint16_t uSubsystemId, uint16_t uClass,
-                                uint32_t nQueues)
+                                uint32_t nQueues, uint16_t cMsixVectors)
 {
     /* Init handles and log related stuff. */
     RTStrPrintf(pState->szInstance, sizeof(pState->szInstance),
@@ -832,21 +950,31 @@ DECLCALLBACK(int) vpciConstruct(PPDMDEVINS pDevIns, VPCISTATE *pState,
         return rc;
 
 #ifdef VBOX_WITH_MSI_DEVICES
-#if 0
+    if (cMsixVectors)
     {
         PDMMSIREG aMsiReg;
 
         RT_ZERO(aMsiReg);
-        aMsiReg.cMsixVectors = 1;
-        aMsiReg.iMsixCapOffset = 0x80;
+        aMsiReg.cMsixVectors = cMsixVectors;
+        aMsiReg.iMsixCapOffset = VPCI_MSIX_CAP_OFFSET;
         aMsiReg.iMsixNextOffset = 0x0;
-        aMsiReg.iMsixBar = 0;
+        aMsiReg.iMsixBar = VPCI_MSIX_BAR;
         rc = PDMDevHlpPCIRegisterMsi(pDevIns, &aMsiReg);
         if (RT_FAILURE (rc))
+        {
+            /* That's OK, we can work without MSI-X */
+            LogRel(("%s: Chipset cannot do MSI-X: %Rrc\n", pState->szInstance, rc));
             PCIDevSetCapabilityList(&pState->pciDevice, 0x0);
+            cMsixVectors = 0;
+        }
     }
+    else
+        PCIDevSetCapabilityList(&pState->pciDevice, 0x0);
+#else
+    cMsixVectors = 0;
 #endif
-#endif
+    pState->cMsixVectors  = cMsixVectors;
+    pState->uConfigVector = VPCI_NO_VECTOR;
 
     /* Status driver */
     PPDMIBASE pBase;
@@ -938,11 +1066,40 @@ PVQUEUE vpciAddQueue(VPCISTATE* pState, unsigned uSize,
         pQueue->uPageNumber = 0;
         pQueue->pfnCallback = pfnCallback;
         pQueue->pcszName = pcszName;
+        pQueue->uVector = VPCI_NO_VECTOR;
     }
 
     return pQueue;
 }
 
+/**
+ * Puts a queue into the given slot, for devices whose queue layout depends
+ * on the negotiated features.
+ *
+ * Unlike vpciAddQueue this leaves the ring addresses and the vector alone, so
+ * it may be called again after the guest has set up the queue or when loading
+ * a saved state.
+ *
+ * @returns Pointer to the queue.
+ * @param   pState      The device state structure.
+ * @param   iQueue      The slot, must be below VIRTIO_MAX_NQUEUES.
+ * @param   uSize       The number of descriptors in the ring.
+ * @param   pfnCallback Called when the guest notifies the queue.
+ * @param   pcszName    Queue name for logging.
+ */
+PVQUEUE vpciSetQueue(VPCISTATE* pState, unsigned iQueue, unsigned uSize,
+                     void (*pfnCallback)(void *pvState, PVQUEUE pQueue),
+                     const char *pcszName)
+{
+    AssertReturn(iQueue < RT_ELEMENTS(pState->Queues), NULL);
+    PVQUEUE pQueue = &pState->Queues[iQueue];
+
+    pQueue->VRing.uSize = uSize;
+    pQueue->pfnCallback = pfnCallback;
+    pQueue->pcszName    = pcszName;
+    return pQueue;
+}
+
 #endif /* IN_RING3 */
 
 #endif /* VBOX_DEVICE_STRUCT_TESTCASE */
@@ -18,6 +18,7 @@
 #ifndef ___VBox_Virtio_h
 #define ___VBox_Virtio_h
 
+#include <VBox/msi.h>
 #include <iprt/ctype.h>
 
 #define VIRTIO_RELOCATE(p, o) *(RTHCUINTPTR *)&p += o
@@ -29,13 +30,15 @@
  * for example.
  */
 #define VIRTIO_SAVEDSTATE_VERSION_3_1_BETA1 1
-#define VIRTIO_SAVEDSTATE_VERSION           2
+#define VIRTIO_SAVEDSTATE_VERSION_PRE_MSIX  2
+#define VIRTIO_SAVEDSTATE_VERSION           3
 
 #define DEVICE_PCI_VENDOR_ID                0x1AF4
 #define DEVICE_PCI_DEVICE_ID                0x1000
 #define DEVICE_PCI_SUBSYSTEM_VENDOR_ID      0x1AF4
 
-#define VIRTIO_MAX_NQUEUES                  3
+/* Enough for a network device with four RX/TX queue pairs and a control queue. */
+#define VIRTIO_MAX_NQUEUES                  9
 
 #define VPCI_HOST_FEATURES                  0x0
 #define VPCI_GUEST_FEATURES                 0x4
@@ -46,6 +49,14 @@
 #define VPCI_STATUS                         0x12
 #define VPCI_ISR                            0x13
 #define VPCI_CONFIG                         0x14
+/* The following two registers only exist while MSI-X is enabled. */
+#define VPCI_CONFIG_VECTOR                  0x14
+#define VPCI_QUEUE_VECTOR                   0x16
+#define VPCI_CONFIG_MSIX                    0x18
+
+#define VPCI_NO_VECTOR                      0xFFFF
+#define VPCI_MSIX_CAP_OFFSET                0x80
+#define VPCI_MSIX_BAR                       1
 
 #define VPCI_ISR_QUEUE                      0x1
 #define VPCI_ISR_CONFIG                     0x3
@@ -119,6 +130,9 @@ struct VQueue
     uint16_t uNextAvailIndex;
     uint16_t uNextUsedIndex;
     uint32_t uPageNumber;
+    /** MSI-X vector signalled for this queue, VPCI_NO_VECTOR if none. */
+    uint16_t uVector;
+    uint16_t padding[3];
 #ifdef IN_RING3
     void   (*pfnCallback)(void *pvState, struct VQueue *pQueue);
 #else
@@ -205,6 +219,12 @@ struct VPCIState_st
     uint32_t               padding3;
 #endif
 
+    /** MSI-X vector signalled on configuration changes, VPCI_NO_VECTOR if none. */
+    uint16_t               uConfigVector;
+    /** Number of MSI-X vectors the device has, 0 if MSI-X is not available. */
+    uint16_t               cMsixVectors;
+    uint32_t               padding4;
+
     uint32_t               nQueues;       /**< Actual number of queues used. */
     VQUEUE                 Queues[VIRTIO_MAX_NQUEUES];
 
@@ -233,6 +253,7 @@ typedef void     (*PFNREADY)(void *pState);
 /*****************************************************************************/
 
 int vpciRaiseInterrupt(VPCISTATE *pState, int rcBusy, uint8_t u8IntCause);
+int vpciRaiseInterruptVector(VPCISTATE *pState, uint8_t u8IntCause, uint16_t uVector);
 int vpciIOPortIn(PPDMDEVINS         pDevIns,
                  void              *pvUser,
                  RTIOPORT           port,
@@ -262,7 +283,7 @@ int   vpciLoadExec(PVPCISTATE pState, PSSMHANDLE pSSM,
 int   vpciConstruct(PPDMDEVINS pDevIns, VPCISTATE *pState,
                     int iInstance, const char *pcszNameFmt,
                     uint16_t uSubsystemId, uint16_t uClass,
-                    uint32_t nQueues);
+                    uint32_t nQueues, uint16_t cMsixVectors);
 int   vpciDestruct(VPCISTATE* pState);
 void  vpciRelocate(PPDMDEVINS pDevIns, RTGCINTPTR offDelta);
 void  vpciReset(PVPCISTATE pState);
@@ -270,6 +291,9 @@ void *vpciQueryInterface(struct PDMIBASE *pInterface, const char *pszIID);
 PVQUEUE vpciAddQueue(VPCISTATE* pState, unsigned uSize,
                      void (*pfnCallback)(void *pvState, PVQUEUE pQueue),
                      const char *pcszName);
+PVQUEUE vpciSetQueue(VPCISTATE* pState, unsigned iQueue, unsigned uSize,
+                     void (*pfnCallback)(void *pvState, PVQUEUE pQueue),
+                     const char *pcszName);
 
 #define VPCI_CS
 DECLINLINE(int) vpciCsEnter(VPCISTATE *pState, int iBusyRc)
@@ -306,8 +330,21 @@ DECLINLINE(uint16_t) vringReadAvailIndex(PVPCISTATE pState, PVRING pVRing)
 bool vqueueGet(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem);
 void vqueuePut(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, uint32_t uLen, uint32_t uReserved = 0);
 void vqueueNotify(PVPCISTATE pState, PVQUEUE pQueue);
-void vqueueSync(PVPCISTATE pState, PVQUEUE pQueue);
+void vqueueSync(PVPCISTATE pState, PVQUEUE pQueue, bool fNotify = true);
+
 
+/**
+ * Checks whether the guest has switched the device to MSI-X.
+ *
+ * @returns true if interrupts go through MSI-X vectors.
+ * @param   pState      The device state structure.
+ */
+DECLINLINE(bool) vpciIsMsixEnabled(PVPCISTATE pState)
+{
+    return pState->cMsixVectors
+        && (PCIDevGetWord(&pState->pciDevice, VPCI_MSIX_CAP_OFFSET + VBOX_MSIX_CAP_MESSAGE_CONTROL)
+            & VBOX_PCI_MSIX_FLAGS_ENABLE);
+}
 
 DECLINLINE(bool) vqueueIsReady(PVPCISTATE pState, PVQUEUE pQueue)
 {
@@ -768,6 +768,14 @@ int main()
     GEN_CHECK_OFF(ATADevState, StatFlushes);
     GEN_CHECK_OFF(ATADevState, fATAPIPassthrough);
     GEN_CHECK_OFF(ATADevState, cErrors);
+    GEN_CHECK_OFF(ATADevState, StatDMADirect);
+    GEN_CHECK_OFF(ATADevState, StatDMABounce);
+    GEN_CHECK_OFF(ATADevState, StatReadAheadHits);
+    GEN_CHECK_OFF(ATADevState, pbReadAhead);
+    GEN_CHECK_OFF(ATADevState, cReadAheadSectorsMax);
+    GEN_CHECK_OFF(ATADevState, iReadAheadLBA);
+    GEN_CHECK_OFF(ATADevState, cReadAheadSectors);
+    GEN_CHECK_OFF(ATADevState, iATAPILBANext);
     GEN_CHECK_OFF(ATADevState, pDrvBase);
     GEN_CHECK_OFF(ATADevState, pDrvBlock);
     GEN_CHECK_OFF(ATADevState, pDrvBlockBios);
@@ -840,6 +848,7 @@ int main()
     GEN_CHECK_OFF(ATACONTROLLER, AsyncIORequestMutex);
     GEN_CHECK_OFF(ATACONTROLLER, SuspendIOSem);
     GEN_CHECK_OFF(ATACONTROLLER, fSignalIdle);
+    GEN_CHECK_OFF(ATACONTROLLER, fDirectDMA);
     GEN_CHECK_OFF(ATACONTROLLER, DelayIRQMillies);
     GEN_CHECK_OFF(ATACONTROLLER, u64ResetTime);
     GEN_CHECK_OFF(ATACONTROLLER, StatAsyncOps);
@@ -1423,8 +1432,22 @@ int main()
     GEN_CHECK_OFF(E1KSTATE, u16HdrRemain);
     GEN_CHECK_OFF(E1KSTATE, u16SavedFlags);
     GEN_CHECK_OFF(E1KSTATE, u32SavedCsum);
+    GEN_CHECK_OFF(E1KSTATE, aTxDescriptors);
+    GEN_CHECK_OFF(E1KSTATE, aTxDescriptors[E1K_TXD_CACHE_SIZE]);
+    GEN_CHECK_OFF(E1KSTATE, GCPhysTxDCache);
+    GEN_CHECK_OFF(E1KSTATE, nTxDFetched);
+    GEN_CHECK_OFF(E1KSTATE, iTxDCurrent);
+    GEN_CHECK_OFF(E1KSTATE, iTxDWbFirst);
+    GEN_CHECK_OFF(E1KSTATE, iTxDWbEnd);
+    GEN_CHECK_OFF(E1KSTATE, fTxDReport);
+    GEN_CHECK_OFF(E1KSTATE, aRxDescriptors);
+    GEN_CHECK_OFF(E1KSTATE, aRxDescriptors[E1K_RXD_CACHE_SIZE]);
+    GEN_CHECK_OFF(E1KSTATE, nRxDFetched);
+    GEN_CHECK_OFF(E1KSTATE, iRxDCurrent);
+    GEN_CHECK_OFF(E1KSTATE, iRxDWbFirst);
     GEN_CHECK_OFF(E1KSTATE, eeprom);
     GEN_CHECK_OFF(E1KSTATE, phy);
+    GEN_CHECK_OFF(E1KSTATE, IntMod);
     GEN_CHECK_OFF(E1KSTATE, StatReceiveBytes);
 #endif /* VBOX_WITH_E1000 */
 
@@ -1444,7 +1467,10 @@ int main()
     GEN_CHECK_OFF(VPCISTATE, uQueueSelector);
     GEN_CHECK_OFF(VPCISTATE, uStatus);
     GEN_CHECK_OFF(VPCISTATE, uISR);
+    GEN_CHECK_OFF(VPCISTATE, uConfigVector);
+    GEN_CHECK_OFF(VPCISTATE, cMsixVectors);
     GEN_CHECK_OFF(VPCISTATE, Queues);
+    GEN_CHECK_OFF(VPCISTATE, Queues[1].uVector);
     GEN_CHECK_OFF(VPCISTATE, Queues[VIRTIO_MAX_NQUEUES]);
     GEN_CHECK_OFF(VNETSTATE, VPCI);
     GEN_CHECK_OFF(VNETSTATE, INetworkDown);
@@ -1465,11 +1491,21 @@ int main()
     GEN_CHECK_OFF(VNETSTATE, u32PktNo);
     GEN_CHECK_OFF(VNETSTATE, fPromiscuous);
     GEN_CHECK_OFF(VNETSTATE, fAllMulti);
-    GEN_CHECK_OFF(VNETSTATE, pRxQueue);
-    GEN_CHECK_OFF(VNETSTATE, pTxQueue);
     GEN_CHECK_OFF(VNETSTATE, pCtlQueue);
     GEN_CHECK_OFF(VNETSTATE, fMaybeOutOfSpace);
     GEN_CHECK_OFF(VNETSTATE, hEventMoreRxDescAvail);
+    GEN_CHECK_OFF(VNETSTATE, cQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, cActivePairs);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1]);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1].pRxIntTimer);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1].pTxStage);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1].hEventTxKick);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1].fTxWaiting);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1].RxIntMod);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1].StatReceivePackets);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1].StatReceiveOverflows);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[VNET_MAX_QUEUE_PAIRS - 1]);
 #endif /* VBOX_WITH_VIRTIO */
 
 #ifdef VBOX_WITH_SCSI
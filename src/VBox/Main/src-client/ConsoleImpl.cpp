@@ -7893,8 +7893,34 @@ HRESULT Console::attachToTapInterface(INetworkAdapter *networkAdapter)
                 strcpy(IfReq.ifr_name, str.c_str());
             else
                 memcpy(IfReq.ifr_name, str.c_str(), sizeof(IfReq.ifr_name) - 1); /** @todo bitch about names which are too long... */
-            IfReq.ifr_flags = IFF_TAP | IFF_NO_PI;
-            rcVBox = ioctl(maTapFD[slot], TUNSETIFF, &IfReq);
+            /* With VBoxInternal2/TapOffloads set ask for the virtio-net header
+               and multiple queues so the driver can offload segmentation and
+               checksumming and read from several threads.  A persistent device
+               created with other flags and older kernels refuse some of this,
+               so fall back step by step to the plain device whatever the
+               reason. */
+            static const short s_afFlags[] =
+            {
+#  if defined(IFF_VNET_HDR) && defined(IFF_MULTI_QUEUE)
+                IFF_TAP | IFF_NO_PI | IFF_VNET_HDR | IFF_MULTI_QUEUE,
+#  endif
+#  ifdef IFF_VNET_HDR
+                IFF_TAP | IFF_NO_PI | IFF_VNET_HDR,
+#  endif
+                IFF_TAP | IFF_NO_PI
+            };
+            Bstr bstrOffloads;
+            mMachine->GetExtraData(Bstr("VBoxInternal2/TapOffloads").raw(), bstrOffloads.asOutParam());
+            size_t i = bstrOffloads == "1" ? 0 : RT_ELEMENTS(s_afFlags) - 1;
+            for (; i < RT_ELEMENTS(s_afFlags); i++)
+            {
+                IfReq.ifr_flags = s_afFlags[i];
+                rcVBox = ioctl(maTapFD[slot], TUNSETIFF, &IfReq);
+                if (rcVBox == 0)
+                    break;
+                LogRel(("TUNSETIFF with flags %#x failed for %ls: %s\n",
+                        s_afFlags[i], tapDeviceName.raw(), strerror(errno)));
+            }
             if (rcVBox != 0)
             {
                 LogRel(("Failed to open the host network interface %ls\n", tapDeviceName.raw()));
@@ -4242,6 +4242,25 @@ int Console::configNetwork(const char *pszDevice,
                     InsertConfigString(pCfg, "Network", bstr);
                     InsertConfigInteger(pCfg, "TrunkType", kIntNetTrunkType_WhateverNone);
                     InsertConfigString(pCfg, "IfPolicyPromisc", pszPromiscuousGuestPolicy);
+
+                    /* A network bandwidth group caps what the adapters in it may
+                       send together. */
+                    ComPtr<IBandwidthGroup> pBwGroup;
+                    hrc = aNetworkAdapter->COMGETTER(BandwidthGroup)(pBwGroup.asOutParam());       H();
+                    if (!pBwGroup.isNull())
+                    {
+                        BandwidthGroupType_T enmBwType;
+                        ULONG cMaxMbPerSec;
+                        Bstr strBwGroup;
+                        hrc = pBwGroup->COMGETTER(Type)(&enmBwType);                                H();
+                        hrc = pBwGroup->COMGETTER(MaxMbPerSec)(&cMaxMbPerSec);                      H();
+                        hrc = pBwGroup->COMGETTER(Name)(strBwGroup.asOutParam());                   H();
+                        if (enmBwType == BandwidthGroupType_Network && cMaxMbPerSec)
+                        {
+                            InsertConfigInteger(pCfg, "MaxBytesPerSec", (uint64_t)cMaxMbPerSec * _1M);
+                            InsertConfigString(pCfg, "BwGroup", strBwGroup);
+                        }
+                    }
                     networkName = bstr;
                     trunkType = Bstr(TRUNKTYPE_WHATEVER);
                 }
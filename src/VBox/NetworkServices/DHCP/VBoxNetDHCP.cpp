@@ -26,7 +26,9 @@
 *******************************************************************************/
 #include <iprt/alloca.h>
 #include <iprt/buildconfig.h>
+#include <iprt/crc.h>
 #include <iprt/err.h>
+#include <iprt/file.h>
 #include <iprt/net.h>                   /* must come before getopt */
 #include <iprt/getopt.h>
 #include <iprt/initterm.h>
@@ -36,6 +38,7 @@
 #include <iprt/stream.h>
 #include <iprt/time.h>
 #include <iprt/string.h>
+#include <iprt/thread.h>
 
 #include <VBox/sup.h>
 #include <VBox/intnet.h>
@@ -47,6 +50,8 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <set>
 
 #ifdef RT_OS_WINDOWS /* WinMain */
 # include <Windows.h>
@@ -58,6 +63,41 @@
 *   Structures and Typedefs                                                    *
 *******************************************************************************/
 
+/**
+ * Lease database journal record.
+ *
+ * The lease database is an append-only sequence of these, the last record for
+ * an address wins.  It's rewritten with just the leases in use when it has
+ * grown too much (compaction).  A torn record at the end, which is what a
+ * crash leaves behind, fails the CRC check and is ignored.
+ *
+ * Compaction while serving requests is done by a worker thread writing a
+ * snapshot of the leases to a temporary file.  Records journaled meanwhile go
+ * to the old database as usual and are also kept aside, once the worker is
+ * done they're appended to the new database and it's renamed over the old one.
+ */
+typedef struct VBOXNETDHCPLEASEREC
+{
+    /** VBOXNETDHCPLEASEREC_MAGIC. */
+    uint32_t        u32Magic;
+    /** The IPv4 address. */
+    RTNETADDRIPV4   IPv4Address;
+    /** The client MAC address. */
+    RTMAC           MacAddress;
+    /** The lease state (VBoxNetDhcpLease::State). */
+    uint8_t         u8State;
+    uint8_t         u8Reserved;
+    /** The lease expiration time, seconds since the epoch. */
+    int64_t         i64ExpireTime;
+    uint32_t        u32Reserved;
+    /** CRC-32 of the preceding fields. */
+    uint32_t        u32Crc;
+} VBOXNETDHCPLEASEREC;
+AssertCompileSize(VBOXNETDHCPLEASEREC, 32);
+/** VBOXNETDHCPLEASEREC::u32Magic value ('DHLS'). */
+#define VBOXNETDHCPLEASEREC_MAGIC   UINT32_C(0x53484c44)
+
+
 /**
  * DHCP configuration item.
  *
@@ -386,6 +426,20 @@ protected:
     VBoxNetDhcpLease   *findLeaseByMacAddress(PCRTMAC pMacAddress, bool fAnyState);
     VBoxNetDhcpLease   *findLeaseByIpv4AndMacAddresses(RTNETADDRIPV4 IPv4Addr, PCRTMAC pMacAddress, bool fAnyState);
     VBoxNetDhcpLease   *newLease(PCRTNETBOOTP pDhcpMsg, size_t cb);
+    void                leaseChanged(VBoxNetDhcpLease *pLease, VBoxNetDhcpLease const &rOld);
+    void                rebuildLeaseIndexes(void);
+    static uint64_t     macKey(PCRTMAC pMac);
+
+    int                 loadLeaseDb(void);
+    int                 compactLeaseDb(void);
+    void                startLeaseDbCompaction(void);
+    void                completeLeaseDbCompaction(RTMSINTERVAL cMillies);
+    void                journalLease(VBoxNetDhcpLease const *pLease);
+    void                snapshotLeases(std::vector<VBOXNETDHCPLEASEREC> &rRecs) const;
+    int                 reopenLeaseDb(void);
+    static void         makeLeaseRec(VBoxNetDhcpLease const *pLease, VBOXNETDHCPLEASEREC *pRec);
+    static int          writeLeaseDbFile(const char *pszFilename, std::vector<VBOXNETDHCPLEASEREC> const &rRecs);
+    static DECLCALLBACK(int) compactLeaseDbThread(RTTHREAD hThreadSelf, void *pvUser);
 
     static uint8_t const *findOption(uint8_t uOption, PCRTNETBOOTP pDhcpMsg, size_t cb, size_t *pcbMaxOpt);
     static bool         findOptionIPv4Addr(uint8_t uOption, PCRTNETBOOTP pDhcpMsg, size_t cb, PRTNETADDRIPV4 pIPv4Addr);
@@ -411,6 +465,33 @@ protected:
 
     /** The current leases. */
     std::vector<VBoxNetDhcpLease> m_Leases;
+    /** m_Leases indexes by client MAC address (macKey).  Only the most recent
+     * lease of a client is indexed. */
+    std::map<uint64_t, size_t> m_LeaseIdxByMac;
+    /** m_Leases indexes by IPv4 address (host byte order). */
+    std::map<uint32_t, size_t> m_LeaseIdxByIp;
+    /** m_Leases indexes ordered by expiration time, for finding free leases. */
+    std::set<std::pair<int64_t, size_t> > m_LeasesByExpire;
+    /** m_Leases indexes of the configs for one specific client. */
+    std::vector<size_t> m_SpecificLeases;
+
+    /** @name The lease database journal.
+     * @{ */
+    RTFILE              m_hLeaseDb;
+    /** Records in the journal. */
+    uint32_t            m_cLeaseDbRecs;
+    /** Whether there are records to flush. */
+    bool                m_fLeaseDbDirty;
+    /** The compaction worker, NIL_RTTHREAD if none is running. */
+    RTTHREAD            m_hCompactThread;
+    /** The leases the worker is writing, owned by it while it runs. */
+    std::vector<VBOXNETDHCPLEASEREC> m_CompactRecs;
+    /** Records journaled while the worker runs. */
+    std::vector<VBOXNETDHCPLEASEREC> m_CompactTail;
+    /** @} */
+
+    /** Replies left in the send ring for the end of the batch. */
+    uint32_t            m_cRepliesPending;
 
     /** @name The network interface
      * @{ */
@@ -531,6 +612,12 @@ VBoxNetDhcp::VBoxNetDhcp()
     m_hIf                   = INTNET_HANDLE_INVALID;
     m_pIfBuf                = NULL;
 
+    m_hLeaseDb              = NIL_RTFILE;
+    m_cLeaseDbRecs          = 0;
+    m_fLeaseDbDirty         = false;
+    m_hCompactThread        = NIL_RTTHREAD;
+    m_cRepliesPending       = 0;
+
     m_cVerbosity            = 0;
     m_uCurMsgType           = UINT8_MAX;
     m_cbCurMsg              = 0;
@@ -584,6 +671,14 @@ VBoxNetDhcp::~VBoxNetDhcp()
         SUPR3Term(false /*fForced*/);
         m_pSession = NIL_RTR0PTR;
     }
+
+    if (m_hCompactThread != NIL_RTTHREAD)
+        completeLeaseDbCompaction(RT_INDEFINITE_WAIT);
+    if (m_hLeaseDb != NIL_RTFILE)
+    {
+        RTFileClose(m_hLeaseDb);
+        m_hLeaseDb = NIL_RTFILE;
+    }
 }
 
 
@@ -639,6 +734,7 @@ void VBoxNetDhcp::explodeConfig(void)
             Itr++;
         }
     }
+    rebuildLeaseIndexes();
 
     /*
      * Loop thru the configurations in reverse order, giving the last
@@ -657,15 +753,10 @@ void VBoxNetDhcp::explodeConfig(void)
             IPv4Addr.u = RT_H2N_U32(i);
 
             /* Check if it exists and is configured. */
-            VBoxNetDhcpLease *pLease = NULL;
-            for (size_t j = 0; j < m_Leases.size(); j++)
-                if (m_Leases[j].m_IPv4Address.u == IPv4Addr.u)
-                {
-                    pLease = &m_Leases[j];
-                    break;
-                }
-            if (pLease)
+            std::map<uint32_t, size_t>::const_iterator It = m_LeaseIdxByIp.find(i);
+            if (It != m_LeaseIdxByIp.end())
             {
+                VBoxNetDhcpLease *pLease = &m_Leases[It->second];
                 if (!pLease->m_pCfg)
                     pLease->m_pCfg = pCfg;
             }
@@ -673,12 +764,408 @@ void VBoxNetDhcp::explodeConfig(void)
             {
                 /* add it. */
                 VBoxNetDhcpLease NewLease(IPv4Addr, pCfg);
+                m_LeaseIdxByIp[i] = m_Leases.size();
                 m_Leases.push_back(NewLease);
                 debugPrint(10, false, "exploseConfig: new lease %d.%d.%d.%d",
                            IPv4Addr.au8[0], IPv4Addr.au8[1], IPv4Addr.au8[2], IPv4Addr.au8[3]);
             }
         }
     }
+
+    rebuildLeaseIndexes();
+}
+
+
+/**
+ * Rebuilds all the m_Leases indexes.
+ *
+ * This is necessary whenever leases have been added, removed or modified
+ * behind leaseChanged's back.
+ */
+void VBoxNetDhcp::rebuildLeaseIndexes(void)
+{
+    m_LeaseIdxByMac.clear();
+    m_LeaseIdxByIp.clear();
+    m_LeasesByExpire.clear();
+    m_SpecificLeases.clear();
+
+    for (size_t i = 0; i < m_Leases.size(); i++)
+    {
+        VBoxNetDhcpLease const *pLease = &m_Leases[i];
+        uint64_t const uMacKey = macKey(&pLease->m_MacAddress);
+        std::map<uint64_t, size_t>::iterator It = m_LeaseIdxByMac.find(uMacKey);
+        if (   It == m_LeaseIdxByMac.end()
+            || RTTimeSpecGetSeconds(&m_Leases[It->second].m_ExpireTime) < RTTimeSpecGetSeconds(&pLease->m_ExpireTime))
+            m_LeaseIdxByMac[uMacKey] = i;
+        m_LeaseIdxByIp[RT_N2H_U32(pLease->m_IPv4Address.u)] = i;
+        m_LeasesByExpire.insert(std::make_pair(RTTimeSpecGetSeconds(&pLease->m_ExpireTime), i));
+        if (pLease->isOneSpecificClient())
+            m_SpecificLeases.push_back(i);
+    }
+}
+
+
+/**
+ * Updates the indexes and the lease database after a lease has changed.
+ *
+ * @param   pLease          The lease, an element of m_Leases.
+ * @param   rOld            Copy of the lease from before the change.
+ */
+void VBoxNetDhcp::leaseChanged(VBoxNetDhcpLease *pLease, VBoxNetDhcpLease const &rOld)
+{
+    size_t const iLease = pLease - &m_Leases[0];
+    Assert(iLease < m_Leases.size());
+
+    if (macKey(&pLease->m_MacAddress) != macKey(&rOld.m_MacAddress))
+    {
+        std::map<uint64_t, size_t>::iterator It = m_LeaseIdxByMac.find(macKey(&rOld.m_MacAddress));
+        if (It != m_LeaseIdxByMac.end() && It->second == iLease)
+            m_LeaseIdxByMac.erase(It);
+        m_LeaseIdxByMac[macKey(&pLease->m_MacAddress)] = iLease;
+    }
+
+    int64_t const iOldExpire = RTTimeSpecGetSeconds(&rOld.m_ExpireTime);
+    int64_t const iNewExpire = RTTimeSpecGetSeconds(&pLease->m_ExpireTime);
+    if (iOldExpire != iNewExpire)
+    {
+        m_LeasesByExpire.erase(std::make_pair(iOldExpire, iLease));
+        m_LeasesByExpire.insert(std::make_pair(iNewExpire, iLease));
+    }
+
+    /* Offers are too short lived to be worth persisting. */
+    if (   pLease->m_enmState == VBoxNetDhcpLease::kState_Active
+        ? rOld.m_enmState != VBoxNetDhcpLease::kState_Active || iOldExpire != iNewExpire
+        : pLease->m_enmState == VBoxNetDhcpLease::kState_Free && rOld.m_enmState == VBoxNetDhcpLease::kState_Active)
+        journalLease(pLease);
+}
+
+
+/**
+ * Makes a m_LeaseIdxByMac key out of a MAC address.
+ *
+ * @returns The key.
+ * @param   pMac            The MAC address.
+ */
+/* static */ uint64_t VBoxNetDhcp::macKey(PCRTMAC pMac)
+{
+    return RT_MAKE_U64_FROM_U16(pMac->au16[0], pMac->au16[1], pMac->au16[2], 0);
+}
+
+
+/**
+ * Loads the lease database and reopens it for appending.
+ *
+ * The database is compacted on the way, so it starts out with one record per
+ * lease in use.  Records for addresses outside the current configuration and
+ * expired ones are dropped.
+ *
+ * @returns 0 on success, exit code + error message to stderr on failure.
+ */
+int VBoxNetDhcp::loadLeaseDb(void)
+{
+    if (m_LeaseDBName.empty())
+        return 0;
+
+    void   *pvDb = NULL;
+    size_t  cbDb = 0;
+    int rc = RTFileReadAll(m_LeaseDBName.c_str(), &pvDb, &cbDb);
+    if (RT_SUCCESS(rc))
+    {
+        RTTIMESPEC Now;
+        int64_t const iNow = RTTimeSpecGetSeconds(RTTimeNow(&Now));
+        uint32_t cLoaded = 0;
+
+        VBOXNETDHCPLEASEREC const *paRecs = (VBOXNETDHCPLEASEREC const *)pvDb;
+        size_t const               cRecs  = cbDb / sizeof(VBOXNETDHCPLEASEREC);
+        for (size_t i = 0; i < cRecs; i++)
+        {
+            VBOXNETDHCPLEASEREC const *pRec = &paRecs[i];
+            if (   pRec->u32Magic != VBOXNETDHCPLEASEREC_MAGIC
+                || pRec->u32Crc != RTCrc32(pRec, RT_OFFSETOF(VBOXNETDHCPLEASEREC, u32Crc)))
+            {
+                debugPrint(0, false, "lease database '%s' is damaged at record %zu, ignoring the rest",
+                           m_LeaseDBName.c_str(), i);
+                break;
+            }
+
+            std::map<uint32_t, size_t>::const_iterator It = m_LeaseIdxByIp.find(RT_N2H_U32(pRec->IPv4Address.u));
+            if (It == m_LeaseIdxByIp.end())
+                continue;
+            VBoxNetDhcpLease *pLease = &m_Leases[It->second];
+            if (!pLease->m_pCfg)
+                continue;
+            pLease->m_MacAddress = pRec->MacAddress;
+            RTTimeSpecSetSeconds(&pLease->m_ExpireTime, pRec->i64ExpireTime);
+            pLease->m_enmState = pRec->u8State == VBoxNetDhcpLease::kState_Active && pRec->i64ExpireTime > iNow
+                               ? VBoxNetDhcpLease::kState_Active
+                               : VBoxNetDhcpLease::kState_Free;
+            cLoaded++;
+        }
+        RTFileReadAllFree(pvDb, cbDb);
+        rebuildLeaseIndexes();
+        debugPrint(1, false, "loaded %u lease records from '%s'", cLoaded, m_LeaseDBName.c_str());
+    }
+    else if (rc != VERR_FILE_NOT_FOUND)
+    {
+        RTStrmPrintf(g_pStdErr, "VBoxNetDHCP: Failed to read the lease database '%s': %Rrc\n", m_LeaseDBName.c_str(), rc);
+        return 1;
+    }
+
+    rc = compactLeaseDb();
+    if (RT_FAILURE(rc))
+    {
+        RTStrmPrintf(g_pStdErr, "VBoxNetDHCP: Failed to write the lease database '%s': %Rrc\n", m_LeaseDBName.c_str(), rc);
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Makes a journal record for a lease.
+ *
+ * @param   pLease          The lease.
+ * @param   pRec            Where to store the record.
+ */
+/* static */ void VBoxNetDhcp::makeLeaseRec(VBoxNetDhcpLease const *pLease, VBOXNETDHCPLEASEREC *pRec)
+{
+    RT_ZERO(*pRec);
+    pRec->u32Magic      = VBOXNETDHCPLEASEREC_MAGIC;
+    pRec->IPv4Address   = pLease->m_IPv4Address;
+    pRec->MacAddress    = pLease->m_MacAddress;
+    pRec->u8State       = (uint8_t)pLease->m_enmState;
+    pRec->i64ExpireTime = RTTimeSpecGetSeconds(&pLease->m_ExpireTime);
+    pRec->u32Crc        = RTCrc32(pRec, RT_OFFSETOF(VBOXNETDHCPLEASEREC, u32Crc));
+}
+
+
+/**
+ * Makes journal records for the active leases.
+ *
+ * @param   rRecs           Where to put the records.
+ */
+void VBoxNetDhcp::snapshotLeases(std::vector<VBOXNETDHCPLEASEREC> &rRecs) const
+{
+    RTTIMESPEC Now;
+    RTTimeNow(&Now);
+    rRecs.clear();
+    for (size_t i = 0; i < m_Leases.size(); i++)
+    {
+        VBoxNetDhcpLease const *pLease = &m_Leases[i];
+        if (   pLease->m_enmState != VBoxNetDhcpLease::kState_Active
+            || !pLease->isInUse(&Now))
+            continue;
+
+        VBOXNETDHCPLEASEREC Rec;
+        makeLeaseRec(pLease, &Rec);
+        rRecs.push_back(Rec);
+    }
+}
+
+
+/**
+ * Writes a set of records to a new file and flushes it to disk.
+ *
+ * @returns IPRT status code.  The file is deleted on failure.
+ * @param   pszFilename     The file, replaced if it exists.
+ * @param   rRecs           The records.
+ */
+/* static */ int VBoxNetDhcp::writeLeaseDbFile(const char *pszFilename, std::vector<VBOXNETDHCPLEASEREC> const &rRecs)
+{
+    RTFILE hFile;
+    int rc = RTFileOpen(&hFile, pszFilename, RTFILE_O_WRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_WRITE);
+    if (RT_FAILURE(rc))
+        return rc;
+    if (!rRecs.empty())
+        rc = RTFileWrite(hFile, &rRecs[0], rRecs.size() * sizeof(VBOXNETDHCPLEASEREC), NULL);
+    if (RT_SUCCESS(rc))
+        rc = RTFileFlush(hFile);
+    RTFileClose(hFile);
+    if (RT_FAILURE(rc))
+        RTFileDelete(pszFilename);
+    return rc;
+}
+
+
+/**
+ * Opens the lease database for appending.
+ *
+ * @returns IPRT status code.
+ */
+int VBoxNetDhcp::reopenLeaseDb(void)
+{
+    int rc = RTFileOpen(&m_hLeaseDb, m_LeaseDBName.c_str(), RTFILE_O_WRITE | RTFILE_O_OPEN | RTFILE_O_APPEND | RTFILE_O_DENY_WRITE);
+    if (RT_FAILURE(rc))
+        m_hLeaseDb = NIL_RTFILE;
+    m_fLeaseDbDirty = false;
+    return rc;
+}
+
+
+/**
+ * Rewrites the lease database with one record per lease in use and reopens it
+ * for appending.
+ *
+ * This is the synchronous version used at startup, see
+ * startLeaseDbCompaction for the one used while serving requests.
+ *
+ * The new database is written next to the old one and renamed over it, so
+ * there is always a complete one on disk.
+ *
+ * @returns IPRT status code.
+ */
+int VBoxNetDhcp::compactLeaseDb(void)
+{
+    if (m_hLeaseDb != NIL_RTFILE)
+    {
+        RTFileClose(m_hLeaseDb);
+        m_hLeaseDb = NIL_RTFILE;
+    }
+
+    std::vector<VBOXNETDHCPLEASEREC> Recs;
+    snapshotLeases(Recs);
+    m_cLeaseDbRecs = (uint32_t)Recs.size();
+
+    std::string strTmp = m_LeaseDBName + ".tmp";
+    int rc = writeLeaseDbFile(strTmp.c_str(), Recs);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTFileRename(strTmp.c_str(), m_LeaseDBName.c_str(), RTPATHRENAME_FLAGS_REPLACE);
+        if (RT_FAILURE(rc))
+            RTFileDelete(strTmp.c_str());
+    }
+    if (RT_FAILURE(rc))
+        return rc;
+
+    return reopenLeaseDb();
+}
+
+
+/**
+ * The lease database compaction worker, writes m_CompactRecs to the temporary
+ * file.
+ *
+ * @returns IPRT status code.
+ * @param   hThreadSelf     The thread handle.
+ * @param   pvUser          The DHCP server.
+ */
+/* static */ DECLCALLBACK(int) VBoxNetDhcp::compactLeaseDbThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    VBoxNetDhcp *pThis = (VBoxNetDhcp *)pvUser;
+    std::string strTmp = pThis->m_LeaseDBName + ".tmp";
+    NOREF(hThreadSelf);
+    return writeLeaseDbFile(strTmp.c_str(), pThis->m_CompactRecs);
+}
+
+
+/**
+ * Starts compacting the lease database in the background.
+ *
+ * Falls back on compacting it synchronously if the worker can't be created.
+ */
+void VBoxNetDhcp::startLeaseDbCompaction(void)
+{
+    snapshotLeases(m_CompactRecs);
+    m_CompactTail.clear();
+    int rc = RTThreadCreate(&m_hCompactThread, compactLeaseDbThread, this, 0, RTTHREADTYPE_IO,
+                            RTTHREADFLAGS_WAITABLE, "DhcpCompact");
+    if (RT_FAILURE(rc))
+    {
+        m_hCompactThread = NIL_RTTHREAD;
+        debugPrint(0, false, "failed to create the lease database compaction thread: %Rrc", rc);
+        rc = compactLeaseDb();
+        if (RT_FAILURE(rc))
+            debugPrint(0, false, "compacting the lease database failed: %Rrc", rc);
+    }
+}
+
+
+/**
+ * Completes a background compaction of the lease database once the worker is
+ * done.
+ *
+ * The records journaled while the worker ran are appended to the new database
+ * before it replaces the old one.  Should anything fail the old database,
+ * which has all the records, is kept.
+ *
+ * @param   cMillies        How long to wait for the worker.
+ */
+void VBoxNetDhcp::completeLeaseDbCompaction(RTMSINTERVAL cMillies)
+{
+    int rcThread = VERR_INTERNAL_ERROR;
+    int rc = RTThreadWait(m_hCompactThread, cMillies, &rcThread);
+    if (rc == VERR_TIMEOUT)
+        return;
+    m_hCompactThread = NIL_RTTHREAD;
+    if (RT_SUCCESS(rc))
+        rc = rcThread;
+
+    std::string strTmp = m_LeaseDBName + ".tmp";
+    if (RT_SUCCESS(rc) && !m_CompactTail.empty())
+    {
+        RTFILE hFile;
+        rc = RTFileOpen(&hFile, strTmp.c_str(), RTFILE_O_WRITE | RTFILE_O_OPEN | RTFILE_O_APPEND | RTFILE_O_DENY_WRITE);
+        if (RT_SUCCESS(rc))
+        {
+            rc = RTFileWrite(hFile, &m_CompactTail[0], m_CompactTail.size() * sizeof(VBOXNETDHCPLEASEREC), NULL);
+            if (RT_SUCCESS(rc))
+                rc = RTFileFlush(hFile);
+            RTFileClose(hFile);
+        }
+    }
+    if (RT_SUCCESS(rc))
+    {
+        if (m_hLeaseDb != NIL_RTFILE)
+        {
+            RTFileClose(m_hLeaseDb);
+            m_hLeaseDb = NIL_RTFILE;
+        }
+        rc = RTFileRename(strTmp.c_str(), m_LeaseDBName.c_str(), RTPATHRENAME_FLAGS_REPLACE);
+        if (RT_SUCCESS(rc))
+            m_cLeaseDbRecs = (uint32_t)(m_CompactRecs.size() + m_CompactTail.size());
+        int rc2 = reopenLeaseDb();
+        if (RT_SUCCESS(rc))
+            rc = rc2;
+    }
+    if (RT_FAILURE(rc))
+    {
+        RTFileDelete(strTmp.c_str());
+        debugPrint(0, false, "compacting the lease database failed: %Rrc", rc);
+    }
+
+    m_CompactRecs.clear();
+    m_CompactTail.clear();
+}
+
+
+/**
+ * Appends a lease record to the lease database, kicking off a compaction if
+ * it has grown much larger than the lease table.
+ *
+ * The records are flushed to disk at the end of each batch of requests.
+ *
+ * @param   pLease          The lease.
+ */
+void VBoxNetDhcp::journalLease(VBoxNetDhcpLease const *pLease)
+{
+    if (m_hLeaseDb == NIL_RTFILE)
+        return;
+
+    VBOXNETDHCPLEASEREC Rec;
+    makeLeaseRec(pLease, &Rec);
+    int rc = RTFileWrite(m_hLeaseDb, &Rec, sizeof(Rec), NULL);
+    if (RT_SUCCESS(rc))
+    {
+        m_cLeaseDbRecs++;
+        m_fLeaseDbDirty = true;
+    }
+    else
+        debugPrint(0, false, "writing to the lease database failed: %Rrc", rc);
+
+    if (m_hCompactThread != NIL_RTTHREAD)
+        m_CompactTail.push_back(Rec);
+    else if (m_cLeaseDbRecs >= RT_MAX(_4K, 4 * m_Leases.size()))
+        startLeaseDbCompaction();
 }
 
 
@@ -755,7 +1242,7 @@ int VBoxNetDhcp::parseArgs(int argc, char **argv)
             case 'i':
                 m_Ipv4Address = Val.IPv4Addr;
                 break;
-            case 'd':
+            case 'D':
                 m_LeaseDBName = Val.psz;
                 break;
 
@@ -839,7 +1326,10 @@ int VBoxNetDhcp::parseArgs(int argc, char **argv)
      * Do the reconfig. (move this later)
      */
     if (!rc)
+    {
         explodeConfig();
+        rc = loadLeaseDb();
+    }
 
     return rc;
 }
@@ -983,6 +1473,10 @@ int VBoxNetDhcp::run(void)
 
         /*
          * Process the receive buffer.
+         *
+         * Everything queued up is handled as one batch: the replies are left
+         * in the send ring and lease changes in the OS buffers until the
+         * batch is done.
          */
         while (IntNetRingHasMoreToRead(pRingBuf))
         {
@@ -1018,6 +1512,21 @@ int VBoxNetDhcp::run(void)
             /* Advance to the next frame. */
             IntNetRingSkipFrame(pRingBuf);
         }
+
+        if (m_cRepliesPending)
+        {
+            m_cRepliesPending = 0;
+            rc = VBoxNetIntIfFlush(m_pSession, m_hIf);
+            if (RT_FAILURE(rc))
+                debugPrint(0, false, "error %Rrc when flushing the replies", rc);
+        }
+        if (m_fLeaseDbDirty)
+        {
+            m_fLeaseDbDirty = false;
+            RTFileFlush(m_hLeaseDb);
+        }
+        if (m_hCompactThread != NIL_RTTHREAD)
+            completeLeaseDbCompaction(0);
     }
 
     return 0;
@@ -1087,7 +1596,9 @@ bool VBoxNetDhcp::handleDhcpReqDiscover(PCRTNETBOOTP pDhcpMsg, size_t cb)
                pLease->m_IPv4Address.au8[3],
                &pDhcpMsg->bp_chaddr.Mac,
                pDhcpMsg->bp_xid);
+    VBoxNetDhcpLease const Old = *pLease;
     pLease->offer(pDhcpMsg->bp_xid);
+    leaseChanged(pLease, Old);
 
     makeDhcpReply(RTNET_DHCP_MT_OFFER, pLease, pDhcpMsg, cb);
     return true;
@@ -1165,7 +1676,9 @@ bool VBoxNetDhcp::handleDhcpReqRequest(PCRTNETBOOTP pDhcpMsg, size_t cb)
             else
                 debugPrint(2, true, "REQUEST for offered lease, xid mismatch. Expected %#x, got %#x.",
                            pLease->m_xid, pDhcpMsg->bp_xid);
+            VBoxNetDhcpLease const Old = *pLease;
             pLease->activate(pDhcpMsg->bp_xid);
+            leaseChanged(pLease, Old);
             fAckIt = true;
         }
         else if (!pLease->isInCurrentConfig())
@@ -1176,7 +1689,9 @@ bool VBoxNetDhcp::handleDhcpReqRequest(PCRTNETBOOTP pDhcpMsg, size_t cb)
             debugPrint(1, true, "REQUEST for lease not on offer, assuming renewal. lease_xid=%#x bp_xid=%#x",
                        pLease->m_xid, pDhcpMsg->bp_xid);
             fAckIt = true;
+            VBoxNetDhcpLease const Old = *pLease;
             pLease->activate(pDhcpMsg->bp_xid);
+            leaseChanged(pLease, Old);
         }
         else
             debugPrint(1, true, "REQUEST for lease not on offer, NAK it.");
@@ -1239,25 +1754,28 @@ bool VBoxNetDhcp::handleDhcpReqRelease(PCRTNETBOOTP pDhcpMsg, size_t cb)
      *        other servers. */
 
     /*
-     * The client may pass us option 61, client identifier, which we should
-     * use to find the lease by.
-     *
-     * We're matching MAC address and lease state as well.
+     * Leases are keyed by IP + MAC and we don't record the client identifier
+     * (option 61), so look it up by the client IP and MAC addresses like
+     * handleDhcpReqRequest does.
      */
-
-    /*
-     * If no client identifier or if we couldn't find a lease by using it,
-     * we will try look it up by the client IP address.
-     */
-
+    VBoxNetDhcpLease *pLease = findLeaseByIpv4AndMacAddresses(pDhcpMsg->bp_ciaddr, &pDhcpMsg->bp_chaddr.Mac,
+                                                              false /* fAnyState */);
 
     /*
      * If found, release it.
      */
-
-
-    /** @todo this is not required in the initial implementation, do it later. */
-    debugPrint(1, true, "RELEASE is not implemented");
+    if (pLease)
+    {
+        debugPrint(1, true, "RELEASE of %d.%d.%d.%d",
+                   pLease->m_IPv4Address.au8[0], pLease->m_IPv4Address.au8[1],
+                   pLease->m_IPv4Address.au8[2], pLease->m_IPv4Address.au8[3]);
+        VBoxNetDhcpLease const Old = *pLease;
+        pLease->release();
+        leaseChanged(pLease, Old);
+    }
+    else
+        debugPrint(1, true, "RELEASE for unknown lease");
+    NOREF(cb);
     return true;
 }
 
@@ -1661,11 +2179,13 @@ void VBoxNetDhcp::makeDhcpReply(uint8_t uMsgType, VBoxNetDhcpLease *pLease, PCRT
     }
     else
 #endif
-        rc = VBoxNetUDPBroadcast(m_pSession, m_hIf, m_pIfBuf,
-                                 m_Ipv4Address, &m_MacAddress, RTNETIPV4_PORT_BOOTPS,               /* sender */
-                                 RTNETIPV4_PORT_BOOTPC,                                             /* receiver port */
-                                 pReply, cbReply);
-    if (RT_FAILURE(rc))
+        rc = VBoxNetUDPBroadcastEx(m_pSession, m_hIf, m_pIfBuf,
+                                   m_Ipv4Address, &m_MacAddress, RTNETIPV4_PORT_BOOTPS,             /* sender */
+                                   RTNETIPV4_PORT_BOOTPC,                                           /* receiver port */
+                                   pReply, cbReply, false /* fFlush - run() does it */);
+    if (RT_SUCCESS(rc))
+        m_cRepliesPending++;
+    else
         debugPrint(0, true, "error %Rrc when sending the reply", rc);
 }
 
@@ -1679,16 +2199,12 @@ void VBoxNetDhcp::makeDhcpReply(uint8_t uMsgType, VBoxNetDhcpLease *pLease, PCRT
  */
 VBoxNetDhcpLease *VBoxNetDhcp::findLeaseByMacAddress(PCRTMAC pMacAddress, bool fAnyState)
 {
-    size_t iLease = m_Leases.size();
-    while (iLease-- > 0)
+    std::map<uint64_t, size_t>::const_iterator It = m_LeaseIdxByMac.find(macKey(pMacAddress));
+    if (It != m_LeaseIdxByMac.end())
     {
-        VBoxNetDhcpLease *pLease = &m_Leases[iLease];
-        if (    pLease
-            &&  pLease->m_MacAddress.au16[0] == pMacAddress->au16[0]
-            &&  pLease->m_MacAddress.au16[1] == pMacAddress->au16[1]
-            &&  pLease->m_MacAddress.au16[2] == pMacAddress->au16[2]
-            &&  (   fAnyState
-                 || (pLease->m_enmState != VBoxNetDhcpLease::kState_Free)) )
+        VBoxNetDhcpLease *pLease = &m_Leases[It->second];
+        if (   fAnyState
+            || pLease->m_enmState != VBoxNetDhcpLease::kState_Free)
             return pLease;
     }
 
@@ -1706,13 +2222,11 @@ VBoxNetDhcpLease *VBoxNetDhcp::findLeaseByMacAddress(PCRTMAC pMacAddress, bool f
  */
 VBoxNetDhcpLease *VBoxNetDhcp::findLeaseByIpv4AndMacAddresses(RTNETADDRIPV4 IPv4Addr, PCRTMAC pMacAddress, bool fAnyState)
 {
-    size_t iLease = m_Leases.size();
-    while (iLease-- > 0)
+    std::map<uint32_t, size_t>::const_iterator It = m_LeaseIdxByIp.find(RT_N2H_U32(IPv4Addr.u));
+    if (It != m_LeaseIdxByIp.end())
     {
-        VBoxNetDhcpLease *pLease = &m_Leases[iLease];
-        if (    pLease
-            &&  pLease->m_IPv4Address.u      == IPv4Addr.u
-            &&  pLease->m_MacAddress.au16[0] == pMacAddress->au16[0]
+        VBoxNetDhcpLease *pLease = &m_Leases[It->second];
+        if (    pLease->m_MacAddress.au16[0] == pMacAddress->au16[0]
             &&  pLease->m_MacAddress.au16[1] == pMacAddress->au16[1]
             &&  pLease->m_MacAddress.au16[2] == pMacAddress->au16[2]
             &&  (   fAnyState
@@ -1740,57 +2254,51 @@ VBoxNetDhcpLease *VBoxNetDhcp::newLease(PCRTNETBOOTP pDhcpMsg, size_t cb)
     RTTimeNow(&Now);
 
     /*
-     * Search the possible leases.
-     *
-     * We'll try do all the searches in one pass, that is to say, perfect
-     * match, old lease, and next free/expired lease.
+     * Search the possible leases in order of preference: perfect match,
+     * old lease, and next free/expired lease.  Only leases in the current
+     * config (m_pCfg set) qualify.
      */
-    VBoxNetDhcpLease *pBest = NULL;
-    VBoxNetDhcpLease *pOld  = NULL;
-    VBoxNetDhcpLease *pFree = NULL;
+    VBoxNetDhcpLease *pNew = NULL;
 
-    size_t cLeases = m_Leases.size();
-    for (size_t i = 0; i < cLeases; i++)
+    /* best */
+    for (size_t i = 0; i < m_SpecificLeases.size(); i++)
     {
-        VBoxNetDhcpLease *pCur = &m_Leases[i];
-
-        /* Skip it if no configuration, that means its not in the current config. */
-        if (!pCur->m_pCfg)
-            continue;
-
-        /* best */
-        if (    pCur->isOneSpecificClient()
+        VBoxNetDhcpLease *pCur = &m_Leases[m_SpecificLeases[i]];
+        if (    pCur->m_pCfg
             &&  pCur->m_pCfg->matchesMacAddress(&MacAddr))
         {
-            if (    !pBest
-                ||  pBest->m_pCfg->m_MacAddresses.size() < pCur->m_pCfg->m_MacAddresses.size())
-                pBest = pCur;
+            if (    !pNew
+                ||  pNew->m_pCfg->m_MacAddresses.size() < pCur->m_pCfg->m_MacAddresses.size())
+                pNew = pCur;
         }
+    }
 
-        /* old lease */
-        if (    pCur->m_MacAddress.au16[0] == MacAddr.au16[0]
-            &&  pCur->m_MacAddress.au16[1] == MacAddr.au16[1]
-            &&  pCur->m_MacAddress.au16[2] == MacAddr.au16[2])
-        {
-            if (    !pOld
-                ||  RTTimeSpecGetSeconds(&pCur->m_ExpireTime) > RTTimeSpecGetSeconds(&pFree->m_ExpireTime))
-                pOld = pCur;
-        }
+    /* old lease */
+    if (!pNew)
+    {
+        std::map<uint64_t, size_t>::const_iterator It = m_LeaseIdxByMac.find(macKey(&MacAddr));
+        if (    It != m_LeaseIdxByMac.end()
+            &&  m_Leases[It->second].m_pCfg)
+            pNew = &m_Leases[It->second];
+    }
 
-        /* expired lease */
-        if (!pCur->isInUse(&Now))
+    /* expired lease, the one that expired first. */
+    if (!pNew)
+    {
+        for (std::set<std::pair<int64_t, size_t> >::const_iterator It = m_LeasesByExpire.begin();
+             It != m_LeasesByExpire.end();
+             ++It)
         {
-            if (    !pFree
-                ||  RTTimeSpecGetSeconds(&pCur->m_ExpireTime) < RTTimeSpecGetSeconds(&pFree->m_ExpireTime))
-                pFree = pCur;
+            VBoxNetDhcpLease *pCur = &m_Leases[It->second];
+            if (    pCur->m_pCfg
+                &&  !pCur->isInUse(&Now))
+            {
+                pNew = pCur;
+                break;
+            }
         }
     }
 
-    VBoxNetDhcpLease *pNew = pBest;
-    if (!pNew)
-        pNew = pOld;
-    if (!pNew)
-        pNew = pFree;
     if (!pNew)
     {
         debugPrint(0, true, "No more leases.");
@@ -1800,9 +2308,11 @@ VBoxNetDhcpLease *VBoxNetDhcp::newLease(PCRTNETBOOTP pDhcpMsg, size_t cb)
     /*
      * Init the lease.
      */
+    VBoxNetDhcpLease const Old = *pNew;
     pNew->m_MacAddress = MacAddr;
     pNew->m_xid        = pDhcpMsg->bp_xid;
     /** @todo extract the client id. */
+    leaseChanged(pNew, Old);
 
     return pNew;
 }
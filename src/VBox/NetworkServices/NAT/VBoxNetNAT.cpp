@@ -17,8 +17,26 @@
 
 /** @page pg_net_nat       VBoxNetNAT
  *
- * Write a few words...
+ * The NAT service serves all the VMs attached to an internal network, so
+ * dense hosts don't have to run a NAT driver with its own slirp instance and
+ * threads per VM.
  *
+ * The threads:
+ *      - The main thread (run()) takes the frames the VMs send off the
+ *        interface buffer and queues them for the slirp engines.
+ *      - One thread per slirp engine (NAT, NAT1, ...).  Guest flows are
+ *        spread over the engines by slirp_flow_select, the same way DrvNAT
+ *        does it.  DHCP, DNS (and with it the DNS cache), ICMP and port
+ *        forwarding stay with the primary engine and are thus shared by all
+ *        the VMs.
+ *      - The transmit thread (NATTX) collects what the engines produce and
+ *        pushes it to the network, one send request per batch.
+ *
+ * The port forwarding rules are given with --port-forward, each rule naming
+ * the MAC address of the VM it's for.  Per VM traffic statistics are written
+ * to the release log every --stats-interval seconds.  Each direction is
+ * counted by the one thread handling it (NATSERVICEVMSTATS), so counting
+ * takes neither a lock nor a map lookup.
  */
 
 /*******************************************************************************
@@ -27,6 +45,8 @@
 #include <iprt/net.h>
 #include <iprt/initterm.h>
 #include <iprt/alloca.h>
+#include <iprt/asm.h>
+#include <iprt/critsect.h>
 #include <iprt/err.h>
 #include <iprt/time.h>
 #include <iprt/timer.h>
@@ -38,6 +58,7 @@
 #include <iprt/getopt.h>
 #include <iprt/string.h>
 #include <iprt/mem.h>
+#include <iprt/memcache.h>
 #include <iprt/message.h>
 #include <iprt/req.h>
 #include <iprt/file.h>
@@ -54,6 +75,7 @@
 
 #include <vector>
 #include <string>
+#include <map>
 
 #include "../NetLib/VBoxNetLib.h"
 #include "../NetLib/VBoxNetBaseService.h"
@@ -67,10 +89,107 @@
 #endif
 
 
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** Maximum number of slirp engines (flow shards), same as DrvNAT. */
+#define NATSERVICE_SHARDS_MAX   8
+/** Number of VMs the traffic statistics are kept for, a power of two.
+ * Traffic of any further VMs is only counted in total. */
+#define NATSERVICE_VMSTATS_MAX  256
+
 
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
 *******************************************************************************/
+class VBoxNetNAT;
+
+/**
+ * A slirp engine together with the thread driving it, see DRVNATSHARD.
+ */
+typedef struct NATSERVICESHARD
+{
+    /** The NAT service. */
+    VBoxNetNAT             *pNAT;
+    /** NAT state of this engine. */
+    PNATState               pNATState;
+    /** Polling thread. */
+    RTTHREAD                hThread;
+    /** Queue for NAT-thread-external events. */
+    PRTREQQUEUE             pReqQueue;
+    /** Index of the shard, 0 is the primary engine. */
+    uint32_t                iShard;
+#ifndef RT_OS_WINDOWS
+    /** The write end of the control pipe. */
+    RTPIPE                  hPipeWrite;
+    /** The read end of the control pipe. */
+    RTPIPE                  hPipeRead;
+#else
+    /** for external notification */
+    HANDLE                  hWakeupEvent;
+#endif
+    /** Number of guest frames handed to this engine. */
+    uint64_t volatile       cFramesIn;
+} NATSERVICESHARD;
+/** Pointer to a NAT engine. */
+typedef NATSERVICESHARD *PNATSERVICESHARD;
+
+/**
+ * A frame on its way from a NAT engine to the network, see
+ * VBoxNetNAT::m_pXmitHead.
+ */
+typedef struct NATSERVICEFRAME
+{
+    /** The next frame in the FIFO. */
+    struct NATSERVICEFRAME *pNext;
+    /** The engine owning the mbuf. */
+    PNATSERVICESHARD        pShard;
+    /** The mbuf holding the frame. */
+    struct mbuf            *m;
+    /** The frame bits. */
+    uint8_t                *pu8Buf;
+    /** The frame size. */
+    int                     cb;
+} NATSERVICEFRAME;
+/** Pointer to a frame on its way to the network. */
+typedef NATSERVICEFRAME *PNATSERVICEFRAME;
+
+/**
+ * A port forwarding rule (--port-forward).
+ */
+typedef struct NATSERVICEPORTFWDRULE
+{
+    /** UDP (true) or TCP (false). */
+    bool                    fUdp;
+    /** The host address to bind to, INADDR_ANY for all. */
+    struct in_addr          BindIP;
+    /** The host port. */
+    uint16_t                u16HostPort;
+    /** The MAC address of the VM the rule is for. */
+    RTMAC                   GuestMac;
+    /** The guest port. */
+    uint16_t                u16GuestPort;
+} NATSERVICEPORTFWDRULE;
+
+/**
+ * Traffic statistics of a VM in one direction, see
+ * VBoxNetNAT::m_aStatsFromGuest and VBoxNetNAT::m_aStatsToGuest.
+ *
+ * Only the thread handling the direction writes them and nothing is ever
+ * removed, so the report can read them without a lock.
+ */
+typedef struct NATSERVICEVMSTATS
+{
+    /** The VM MAC address (VBoxNetNAT::macKey), 0 if the entry is free. */
+    uint64_t volatile       u64Key;
+    /** Number of frames. */
+    uint64_t volatile       cFrames;
+    /** Number of bytes. */
+    uint64_t volatile       cbFrames;
+} NATSERVICEVMSTATS;
+/** Pointer to the statistics of a VM. */
+typedef NATSERVICEVMSTATS *PNATSERVICEVMSTATS;
+
 
 class VBoxNetNAT : public VBoxNetBaseService
 {
@@ -79,33 +198,80 @@ public:
     virtual ~VBoxNetNAT();
     void usage(void);
     void run(void);
-    void init(void);
+    int  init(void);
+    void term(void);
+    int  parseOpt(int rc, const RTGETOPTUNION &Val);
+
+    void queueXmit(PNATSERVICESHARD pShard, struct mbuf *m, uint8_t *pu8Buf, int cb, bool fUrgent);
+    void xmitPending(void);
+    void notifyShard(PNATSERVICESHARD pShard);
+
+private:
+    int  initInternal(void);
+    int  addPortForwardRule(const char *pszRule);
+    bool queueGuestFrame(uint8_t const *pbFrame, size_t cbFrame, uint32_t *pfShards);
+    bool queueFrameForShard(PNATSERVICESHARD pShard, uint8_t const *pbFrame, size_t cbFrame);
+    void learnGuest(uint8_t const *pbFrame, size_t cbFrame);
+    void reportStats(void);
+    uint32_t xmitList(PNATSERVICEFRAME pHead, uint32_t *pfShards);
+    void freeList(PNATSERVICEFRAME pHead);
+    static void countFrame(PNATSERVICEVMSTATS paStats, uint64_t volatile *pcOther, PCRTMAC pMac, size_t cbFrame);
+    static uint64_t macKey(PCRTMAC pMac);
 
 public:
-    PNATState m_pNATState;
-    RTNETADDRIPV4    m_Ipv4Netmask;
-    bool m_fPassDomain;
-    RTTHREAD m_ThrNAT;
-    RTTHREAD m_ThrSndNAT;
-    RTTHREAD m_ThrUrgSndNAT;
-#ifdef RT_OS_WINDOWS
-    HANDLE m_hWakeupEvent;
-#else
-    RTPIPE m_hPipeWrite;
-    RTPIPE m_hPipeRead;
-#endif
-    /** Queue for NAT-thread-external events. */
-    /** event to wakeup the guest receive thread */
-    RTSEMEVENT              m_EventSend;
-    /** event to wakeup the guest urgent receive thread */
-    RTSEMEVENT              m_EventUrgSend;
-
-    PRTREQQUEUE             m_pReqQueue;
-    PRTREQQUEUE             m_pSendQueue;
-    PRTREQQUEUE             m_pUrgSendQueue;
-    volatile uint32_t       cUrgPkt;
-    volatile uint32_t       cPkt;
-    bool                    fIsRunning;
+    RTNETADDRIPV4           m_Ipv4Netmask;
+    bool                    m_fPassDomain;
+    bool                    m_fUseHostResolver;
+    bool                    m_fDnsProxy;
+    volatile bool           m_fShutdown;
+
+    /** Number of engines in m_aShards. */
+    uint32_t                m_cShards;
+    /** The NAT engines. */
+    NATSERVICESHARD         m_aShards[NATSERVICE_SHARDS_MAX];
+    /** The distribution of the guest frames over m_aShards. */
+    SLIRPFLOWSEL            m_FlowSel;
+    /** The port forwarding rules, they all go to the primary engine. */
+    std::vector<NATSERVICEPORTFWDRULE> m_vecPortFwdRules;
+
+    /** @name Transmit (engines -> network).
+     * @{ */
+    RTTHREAD                m_hThrXmit;
+    /** Event the transmit thread waits on. */
+    RTSEMEVENT              m_EventXmit;
+    /** Lock protecting the FIFOs. */
+    RTCRITSECT              m_XmitLock;
+    /** Head of the FIFO of urgent (TCP OOB) frames, these go first. */
+    PNATSERVICEFRAME        m_pXmitUrgHead;
+    /** Where to link in the next urgent frame. */
+    PNATSERVICEFRAME       *m_ppXmitUrgTail;
+    /** Head of the FIFO of regular frames. */
+    PNATSERVICEFRAME        m_pXmitHead;
+    /** Where to link in the next regular frame. */
+    PNATSERVICEFRAME       *m_ppXmitTail;
+    /** Cache for NATSERVICEFRAME. */
+    RTMEMCACHE              m_hFrameCache;
+    /** @} */
+
+    /** The guest addresses handed to the secondary engines, by MAC (macKey).
+     * Only used by the main thread. */
+    std::map<uint64_t, uint32_t> m_GuestIps;
+
+    /** @name Per VM statistics.
+     * @{ */
+    /** Traffic from the VMs, open addressed by macKey.  Main thread only. */
+    NATSERVICEVMSTATS       m_aStatsFromGuest[NATSERVICE_VMSTATS_MAX];
+    /** Traffic from VMs without an entry in m_aStatsFromGuest. */
+    uint64_t volatile       m_cFramesFromOtherGuests;
+    /** Traffic to the VMs, open addressed by macKey.  NATTX only. */
+    NATSERVICEVMSTATS       m_aStatsToGuest[NATSERVICE_VMSTATS_MAX];
+    /** Traffic to VMs without an entry in m_aStatsToGuest. */
+    uint64_t volatile       m_cFramesToOtherGuests;
+    /** Seconds between two reports, 0 for none. */
+    uint32_t                m_cSecsStatsInterval;
+    /** When the next report is due (RTTimeMilliTS). */
+    uint64_t                m_u64NextStatsReport;
+    /** @} */
 };
 
 
@@ -116,26 +282,11 @@ public:
 /** Pointer to the NAT server. */
 class VBoxNetNAT *g_pNAT;
 static DECLCALLBACK(int) AsyncIoThread(RTTHREAD pThread, void *pvUser);
-static DECLCALLBACK(int) natSndThread(RTTHREAD pThread, void *pvUser);
-static DECLCALLBACK(int) natUrgSndThread(RTTHREAD pThread, void *pvUser);
-static void SendWorker(struct mbuf *m, size_t cb);
-static void IntNetSendWorker(bool urg, void *pvFrame, size_t cbFrame, struct mbuf *m);
+static DECLCALLBACK(int) natXmitThread(RTTHREAD pThread, void *pvUser);
+static void SendWorker(PNATSERVICESHARD pShard, struct mbuf *m, size_t cb);
+static void GuestWorker(PNATSERVICESHARD pShard, PRTMAC pMac, uint32_t u32GuestIp);
 
 
-static void natNotifyNATThread(void)
-{
-    int rc;
-#ifndef RT_OS_WINDOWS
-    /* kick select() */
-    size_t cbIgnored;
-    rc = RTPipeWrite(g_pNAT->m_hPipeWrite, "", 1, &cbIgnored);
-#else
-    /* kick WSAWaitForMultipleEvents */
-    rc = WSASetEvent(g_pNAT->hWakeupEvent);
-#endif
-    AssertRC(rc);
-}
-
 VBoxNetNAT::VBoxNetNAT()
 {
 #if defined(RT_OS_WINDOWS)
@@ -152,48 +303,565 @@ VBoxNetNAT::VBoxNetNAT()
     m_MacAddress.au8[5]     = 0x42;
     m_Ipv4Address.u         = RT_H2N_U32_C(RT_BSWAP_U32_C(RT_MAKE_U32_FROM_U8( 10,  0,  2,  1)));
     m_Ipv4Netmask.u         = 0xffff0000;
-    cPkt = 0;
-    cUrgPkt = 0;
+    m_fPassDomain           = true;
+    m_fUseHostResolver      = false;
+    m_fDnsProxy             = false;
+    m_fShutdown             = false;
+    m_cShards               = 1;
+    RT_ZERO(m_aShards);
+    for (unsigned iShard = 0; iShard < RT_ELEMENTS(m_aShards); iShard++)
+    {
+        m_aShards[iShard].hThread    = NIL_RTTHREAD;
+#ifndef RT_OS_WINDOWS
+        m_aShards[iShard].hPipeWrite = NIL_RTPIPE;
+        m_aShards[iShard].hPipeRead  = NIL_RTPIPE;
+#endif
+    }
+    m_hThrXmit              = NIL_RTTHREAD;
+    m_EventXmit             = NIL_RTSEMEVENT;
+    m_pXmitUrgHead          = NULL;
+    m_ppXmitUrgTail         = &m_pXmitUrgHead;
+    m_pXmitHead             = NULL;
+    m_ppXmitTail            = &m_pXmitHead;
+    m_hFrameCache           = NIL_RTMEMCACHE;
+    RT_ZERO(m_XmitLock);
+    RT_ZERO(m_aStatsFromGuest);
+    RT_ZERO(m_aStatsToGuest);
+    m_cFramesFromOtherGuests = 0;
+    m_cFramesToOtherGuests  = 0;
+    m_cSecsStatsInterval    = 0;
+    m_u64NextStatsReport    = 0;
+
+    static RTGETOPTDEF const s_aOptionDefs[] =
+    {
+        { "--port-forward",   'p',   RTGETOPT_REQ_STRING },
+        { "--worker-threads", 'w',   RTGETOPT_REQ_UINT32 },
+        { "--dns-proxy",      'D',   RTGETOPT_REQ_NOTHING },
+        { "--host-resolver",  'H',   RTGETOPT_REQ_NOTHING },
+        { "--stats-interval", 's',   RTGETOPT_REQ_UINT32 },
+    };
+    m_vecOptionDefs.insert(m_vecOptionDefs.end(), &s_aOptionDefs[0], &s_aOptionDefs[RT_ELEMENTS(s_aOptionDefs)]);
 }
 
-VBoxNetNAT::~VBoxNetNAT() { }
-void VBoxNetNAT::init()
+VBoxNetNAT::~VBoxNetNAT()
+{
+    term();
+}
+
+/**
+ * Handles the NAT service specific options.
+ *
+ * @returns 0 if handled, VERR_NOT_FOUND if not ours, exit code on failure.
+ * @param   rc      The RTGetOpt return value.
+ * @param   Val     The option value.
+ */
+int VBoxNetNAT::parseOpt(int rc, const RTGETOPTUNION &Val)
+{
+    switch (rc)
+    {
+        case 'p':
+            return addPortForwardRule(Val.psz);
+
+        case 'w':
+            if (Val.u32 < 1 || Val.u32 > NATSERVICE_SHARDS_MAX)
+            {
+                RTStrmPrintf(g_pStdErr, "--worker-threads must be between 1 and %u\n", NATSERVICE_SHARDS_MAX);
+                return 1;
+            }
+            m_cShards = Val.u32;
+            return 0;
+
+        case 'D':
+            m_fDnsProxy = true;
+            return 0;
+
+        case 'H':
+            m_fUseHostResolver = true;
+            return 0;
+
+        case 's':
+            m_cSecsStatsInterval = Val.u32;
+            return 0;
+
+        default:
+            return VERR_NOT_FOUND;
+    }
+}
+
+/**
+ * Parses a --port-forward rule and adds it to m_vecPortFwdRules.
+ *
+ * The syntax is "tcp|udp,[host-ip],host-port,guest-mac,guest-port".  The VM
+ * is identified by its MAC address as its address isn't known until it has
+ * asked the DHCP server for one.
+ *
+ * @returns 0 on success, exit code + error message to stderr on failure.
+ * @param   pszRule     The rule.
+ */
+int VBoxNetNAT::addPortForwardRule(const char *pszRule)
+{
+    char szRule[128];
+    char *apszFields[5];
+    unsigned cFields = 0;
+    int rc = RTStrCopy(szRule, sizeof(szRule), pszRule);
+    if (RT_SUCCESS(rc))
+    {
+        char *psz = szRule;
+        apszFields[cFields++] = psz;
+        while ((psz = strchr(psz, ',')) != NULL && cFields < RT_ELEMENTS(apszFields))
+        {
+            *psz++ = '\0';
+            apszFields[cFields++] = psz;
+        }
+        if (psz || cFields != RT_ELEMENTS(apszFields))
+            rc = VERR_INVALID_PARAMETER;
+    }
+
+    NATSERVICEPORTFWDRULE Rule;
+    RT_ZERO(Rule);
+    if (RT_SUCCESS(rc))
+    {
+        if (!RTStrICmp(apszFields[0], "tcp"))
+            Rule.fUdp = false;
+        else if (!RTStrICmp(apszFields[0], "udp"))
+            Rule.fUdp = true;
+        else
+            rc = VERR_INVALID_PARAMETER;
+    }
+    if (RT_SUCCESS(rc))
+    {
+        Rule.BindIP.s_addr = INADDR_ANY;
+        if (*apszFields[1] && inet_aton(apszFields[1], &Rule.BindIP) == 0)
+            rc = VERR_INVALID_PARAMETER;
+    }
+    if (RT_SUCCESS(rc))
+        rc = RTStrToUInt16Full(apszFields[2], 10, &Rule.u16HostPort);
+    if (rc == VINF_SUCCESS)
+    {
+        const char *psz = apszFields[3];
+        for (unsigned i = 0; i < sizeof(Rule.GuestMac) && rc == VINF_SUCCESS; i++)
+        {
+            char *pszNext;
+            rc = RTStrToUInt8Ex(psz, &pszNext, 16, &Rule.GuestMac.au8[i]);
+            if (rc == VWRN_TRAILING_CHARS && *pszNext == ':' && i + 1 < sizeof(Rule.GuestMac))
+            {
+                psz = pszNext + 1;
+                rc = VINF_SUCCESS;
+            }
+        }
+    }
+    if (rc == VINF_SUCCESS)
+        rc = RTStrToUInt16Full(apszFields[4], 10, &Rule.u16GuestPort);
+    if (rc != VINF_SUCCESS || !Rule.u16HostPort || !Rule.u16GuestPort)
+    {
+        RTStrmPrintf(g_pStdErr, "Invalid port forwarding rule '%s', expected tcp|udp,[host-ip],host-port,guest-mac,guest-port\n",
+                     pszRule);
+        return 1;
+    }
+
+    m_vecPortFwdRules.push_back(Rule);
+    return 0;
+}
+
+/**
+ * Sets up the engines and the threads.
+ *
+ * @returns 0 on success, exit code on failure with everything set up so far
+ *          torn down again.
+ */
+int VBoxNetNAT::init()
+{
+    int rc = initInternal();
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("VBoxNetNAT: initialization failed: %Rrc\n", rc));
+        term();
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Worker for init().
+ *
+ * @returns IPRT status code, term() cleans up on failure.
+ */
+int VBoxNetNAT::initInternal()
 {
     int rc;
 
     /*
-     * Initialize slirp.
+     * Initialize slirp, one engine per worker thread.
      */
-    rc = slirp_init(&m_pNATState, m_Ipv4Address.u, m_Ipv4Netmask.u, m_fPassDomain, false, 0, this);
-    AssertReleaseRC(rc);
+    for (uint32_t iShard = 0; iShard < m_cShards; iShard++)
+    {
+        PNATSERVICESHARD pShard = &m_aShards[iShard];
+        pShard->pNAT   = this;
+        pShard->iShard = iShard;
+        rc = slirp_init(&pShard->pNATState, m_Ipv4Address.u, m_Ipv4Netmask.u, m_fPassDomain, m_fUseHostResolver,
+                        0, iShard != 0, pShard);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("VBoxNetNAT: slirp_init failed for engine %u: %Rrc\n", iShard, rc));
+            pShard->pNATState = NULL;
+            return rc;
+        }
+        slirp_set_dhcp_dns_proxy(pShard->pNATState, m_fDnsProxy);
+        slirp_set_ethaddr_and_activate_port_forwarding(pShard->pNATState, &m_MacAddress.au8[0], INADDR_ANY);
+    }
 
-    slirp_set_ethaddr_and_activate_port_forwarding(m_pNATState, &m_MacAddress.au8[0], INADDR_ANY);
+    /* m_Ipv4Netmask is in host byte order, see slirp_init. */
+    slirp_flow_init(&m_FlowSel, RT_N2H_U32(m_Ipv4Address.u), m_Ipv4Netmask.u, m_cShards);
+    for (size_t i = 0; i < m_vecPortFwdRules.size(); i++)
+    {
+        NATSERVICEPORTFWDRULE const *pRule = &m_vecPortFwdRules[i];
+        struct in_addr GuestIP;
+        GuestIP.s_addr = INADDR_ANY;
+        slirp_flow_add_forward(&m_FlowSel, pRule->fUdp, pRule->u16GuestPort);
+        if (slirp_add_redirect(m_aShards[0].pNATState, pRule->fUdp, pRule->BindIP, pRule->u16HostPort,
+                               GuestIP, pRule->u16GuestPort, &pRule->GuestMac.au8[0]) != 0)
+            LogRel(("VBoxNetNAT: failed to add the %s port forwarding rule for host port %u\n",
+                    pRule->fUdp ? "UDP" : "TCP", pRule->u16HostPort));
+    }
+
+    rc = RTCritSectInit(&m_XmitLock);
+    AssertRCReturn(rc, rc);
+    rc = RTMemCacheCreate(&m_hFrameCache, sizeof(NATSERVICEFRAME), 0, UINT32_MAX, NULL, NULL, NULL, 0);
+    AssertRCReturn(rc, rc);
+    rc = RTSemEventCreate(&m_EventXmit);
+    AssertRCReturn(rc, rc);
+    rc = RTThreadCreate(&m_hThrXmit, natXmitThread, this, 128 * _1K, RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "NATTX");
+    if (RT_FAILURE(rc))
+    {
+        m_hThrXmit = NIL_RTTHREAD;
+        return rc;
+    }
+
+    for (uint32_t iShard = 0; iShard < m_cShards; iShard++)
+    {
+        PNATSERVICESHARD pShard = &m_aShards[iShard];
 #ifndef RT_OS_WINDOWS
+        /*
+         * Create the control pipe.
+         */
+        rc = RTPipeCreate(&pShard->hPipeRead, &pShard->hPipeWrite, 0 /*fFlags*/);
+        AssertRCReturn(rc, rc);
+# ifdef VBOX_WITH_NAT_EPOLL
+        rc = slirp_register_wakeup_fd(pShard->pNATState, RTPipeToNative(pShard->hPipeRead));
+        AssertRCReturn(rc, rc);
+# endif
+#else
+        pShard->hWakeupEvent = CreateEvent(NULL, FALSE, FALSE, NULL); /* auto-reset event */
+        AssertReturn(pShard->hWakeupEvent != NULL, VERR_NO_MEMORY);
+        slirp_register_external_event(pShard->pNATState, pShard->hWakeupEvent, VBOX_WAKEUP_EVENT_INDEX);
+#endif
+        rc = RTReqCreateQueue(&pShard->pReqQueue);
+        AssertRCReturn(rc, rc);
+
+        char szThread[16];
+        if (iShard == 0)
+            RTStrCopy(szThread, sizeof(szThread), "NAT");
+        else
+            RTStrPrintf(szThread, sizeof(szThread), "NAT%u", iShard);
+        rc = RTThreadCreate(&pShard->hThread, AsyncIoThread, pShard, 128 * _1K, RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE,
+                            szThread);
+        if (RT_FAILURE(rc))
+        {
+            pShard->hThread = NIL_RTTHREAD;
+            return rc;
+        }
+    }
+
+    if (m_cShards > 1)
+        LogRel(("VBoxNetNAT: guest flows are distributed over %u engines\n", m_cShards));
+    return VINF_SUCCESS;
+}
+
+/**
+ * Stops the threads and frees everything init() set up.
+ *
+ * Copes with a partial init() and with being called more than once.
+ */
+void VBoxNetNAT::term()
+{
+    ASMAtomicWriteBool(&m_fShutdown, true);
+
     /*
-     * Create the control pipe.
+     * Stop the threads first, they use everything else.
      */
-    rc = RTPipeCreate(&m_hPipeRead, &m_hPipeWrite, 0 /*fFlags*/);
-    AssertReleaseRC(rc);
+    if (m_hThrXmit != NIL_RTTHREAD)
+    {
+        RTSemEventSignal(m_EventXmit);
+        int rc = RTThreadWait(m_hThrXmit, 30000, NULL);
+        AssertRC(rc);
+        m_hThrXmit = NIL_RTTHREAD;
+    }
+    for (uint32_t iShard = 0; iShard < m_cShards; iShard++)
+    {
+        PNATSERVICESHARD pShard = &m_aShards[iShard];
+        if (pShard->hThread != NIL_RTTHREAD)
+        {
+            notifyShard(pShard);
+            int rc = RTThreadWait(pShard->hThread, 30000, NULL);
+            AssertRC(rc);
+            pShard->hThread = NIL_RTTHREAD;
+        }
+    }
+
+    /*
+     * The frames still on their way to the network hold mbufs of the engines.
+     */
+    if (m_hFrameCache != NIL_RTMEMCACHE)
+    {
+        freeList(m_pXmitUrgHead);
+        freeList(m_pXmitHead);
+        m_pXmitUrgHead  = NULL;
+        m_ppXmitUrgTail = &m_pXmitUrgHead;
+        m_pXmitHead     = NULL;
+        m_ppXmitTail    = &m_pXmitHead;
+        RTMemCacheDestroy(m_hFrameCache);
+        m_hFrameCache = NIL_RTMEMCACHE;
+    }
+
+    for (uint32_t iShard = 0; iShard < m_cShards; iShard++)
+    {
+        PNATSERVICESHARD pShard = &m_aShards[iShard];
+        if (pShard->pReqQueue)
+        {
+            /* Pending requests own mbufs and guest MAC copies, run them. */
+            RTReqProcess(pShard->pReqQueue, 0);
+            RTReqDestroyQueue(pShard->pReqQueue);
+            pShard->pReqQueue = NULL;
+        }
+        if (pShard->pNATState)
+        {
+            slirp_term(pShard->pNATState);
+            pShard->pNATState = NULL;
+        }
+#ifndef RT_OS_WINDOWS
+        RTPipeClose(pShard->hPipeRead);
+        pShard->hPipeRead = NIL_RTPIPE;
+        RTPipeClose(pShard->hPipeWrite);
+        pShard->hPipeWrite = NIL_RTPIPE;
 #else
-    m_hWakeupEvent = CreateEvent(NULL, FALSE, FALSE, NULL); /* auto-reset event */
-    AssertReleaseRC(m_hWakeupEvent != NULL);
-    slirp_register_external_event(m_pNATState, m_hWakeupEvent, VBOX_WAKEUP_EVENT_INDEX);
+        if (pShard->hWakeupEvent)
+        {
+            CloseHandle(pShard->hWakeupEvent);
+            pShard->hWakeupEvent = NULL;
+        }
 #endif
-    rc = RTReqCreateQueue(&m_pReqQueue);
-    AssertReleaseRC(rc);
+    }
 
-    rc = RTReqCreateQueue(&m_pSendQueue);
-    AssertReleaseRC(rc);
+    if (m_EventXmit != NIL_RTSEMEVENT)
+    {
+        RTSemEventDestroy(m_EventXmit);
+        m_EventXmit = NIL_RTSEMEVENT;
+    }
+    if (RTCritSectIsInitialized(&m_XmitLock))
+        RTCritSectDelete(&m_XmitLock);
+}
 
-    rc = RTReqCreateQueue(&m_pUrgSendQueue);
-    AssertReleaseRC(rc);
+/**
+ * Wakes up the thread of an engine.
+ *
+ * @param   pShard      The engine.
+ */
+void VBoxNetNAT::notifyShard(PNATSERVICESHARD pShard)
+{
+    int rc;
+#ifndef RT_OS_WINDOWS
+    /* kick select() */
+    size_t cbIgnored;
+    rc = RTPipeWrite(pShard->hPipeWrite, "", 1, &cbIgnored);
+#else
+    /* kick WSAWaitForMultipleEvents */
+    rc = WSASetEvent(pShard->hWakeupEvent);
+    rc = rc == TRUE ? VINF_SUCCESS : VERR_INVALID_HANDLE;
+#endif
+    AssertRC(rc);
+}
+
+/**
+ * Copies a frame from a VM into an mbuf of an engine and queues it.
+ *
+ * @returns true on success, false if the engine is out of mbufs.
+ * @param   pShard      The engine.
+ * @param   pbFrame     The ethernet frame.
+ * @param   cbFrame     The size of the frame.
+ */
+bool VBoxNetNAT::queueFrameForShard(PNATSERVICESHARD pShard, uint8_t const *pbFrame, size_t cbFrame)
+{
+    size_t       cbIgnored;
+    void        *pvSlirpFrame;
+    struct mbuf *m = slirp_ext_m_get(pShard->pNATState, cbFrame, &pvSlirpFrame, &cbIgnored);
+    if (!m)
+    {
+        LogRel(("NAT: Can't allocate send buffer cbFrame=%u engine=%u\n", cbFrame, pShard->iShard));
+        return false;
+    }
+    memcpy(pvSlirpFrame, pbFrame, cbFrame);
 
-    rc = RTThreadCreate(&m_ThrNAT, AsyncIoThread, this, 128 * _1K, RTTHREADTYPE_DEFAULT, 0, "NAT");
-    rc = RTThreadCreate(&m_ThrSndNAT, natSndThread, this, 128 * _1K, RTTHREADTYPE_DEFAULT, 0, "SndNAT");
-    rc = RTThreadCreate(&m_ThrUrgSndNAT, natUrgSndThread, this, 128 * _1K, RTTHREADTYPE_DEFAULT, 0, "UrgSndNAT");
-    rc = RTSemEventCreate(&m_EventSend);
-    rc = RTSemEventCreate(&m_EventUrgSend);
+    /* don't wait, we may have to wakeup the NAT thread first */
+    int rc = RTReqCallEx(pShard->pReqQueue, NULL /*ppReq*/, 0 /*cMillies*/, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
+                         (PFNRT)SendWorker, 3, pShard, m, cbFrame);
     AssertReleaseRC(rc);
+    return true;
+}
+
+/**
+ * Queues a frame from a VM for the engine owning its flow, see
+ * slirp_flow_select.
+ *
+ * @returns true on success, false if the engine is out of mbufs.
+ * @param   pbFrame     The ethernet frame.
+ * @param   cbFrame     The size of the frame.
+ * @param   pfShards    Where to mark the engines to wake up.
+ */
+bool VBoxNetNAT::queueGuestFrame(uint8_t const *pbFrame, size_t cbFrame, uint32_t *pfShards)
+{
+    unsigned iShard = slirp_flow_select(&m_FlowSel, pbFrame, cbFrame);
+    if (iShard == SLIRP_FLOW_ALL_ENGINES)
+    {
+        /* Every engine keeps its own ARP cache. */
+        for (uint32_t i = 1; i < m_cShards; i++)
+            if (queueFrameForShard(&m_aShards[i], pbFrame, cbFrame))
+                *pfShards |= RT_BIT_32(i);
+        iShard = 0;
+    }
+
+    if (!queueFrameForShard(&m_aShards[iShard], pbFrame, cbFrame))
+        return false;
+    *pfShards |= RT_BIT_32(iShard);
+    return true;
+}
+
+/**
+ * Makes a map key out of a MAC address.
+ *
+ * @returns The key.
+ * @param   pMac        The MAC address.
+ */
+/* static */ uint64_t VBoxNetNAT::macKey(PCRTMAC pMac)
+{
+    return RT_MAKE_U64_FROM_U16(pMac->au16[0], pMac->au16[1], pMac->au16[2], 0);
+}
+
+/**
+ * Tells the secondary engines about the address of a VM.
+ *
+ * The primary engine learns the addresses from DHCP and ARP, which the
+ * secondary engines never see, yet they need them to address the frames
+ * they send.
+ *
+ * @param   pbFrame     The ethernet frame from the VM.
+ * @param   cbFrame     The size of the frame.
+ */
+void VBoxNetNAT::learnGuest(uint8_t const *pbFrame, size_t cbFrame)
+{
+    if (   m_cShards <= 1
+        || cbFrame < sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN)
+        return;
+    PCRTNETETHERHDR pEthHdr = (PCRTNETETHERHDR)pbFrame;
+    if (pEthHdr->EtherType != RT_H2BE_U16_C(RTNET_ETHERTYPE_IPV4))
+        return;
+    PCRTNETIPV4 pIpHdr  = (PCRTNETIPV4)(pEthHdr + 1);
+    uint32_t const uNetmask = m_Ipv4Netmask.u;
+    if (   (RT_N2H_U32(pIpHdr->ip_src.u) & uNetmask) != (RT_N2H_U32(m_Ipv4Address.u) & uNetmask)
+        || pIpHdr->ip_src.u == m_Ipv4Address.u)
+        return;
+
+    uint32_t &rIp = m_GuestIps[macKey(&pEthHdr->SrcMac)];
+    if (rIp == pIpHdr->ip_src.u)
+        return;
+    rIp = pIpHdr->ip_src.u;
+    for (uint32_t iShard = 1; iShard < m_cShards; iShard++)
+    {
+        PRTMAC pMac = (PRTMAC)RTMemDup(&pEthHdr->SrcMac, sizeof(RTMAC));
+        AssertBreak(pMac);
+        int rc = RTReqCallEx(m_aShards[iShard].pReqQueue, NULL /*ppReq*/, 0 /*cMillies*/, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
+                             (PFNRT)GuestWorker, 3, &m_aShards[iShard], pMac, (uint32_t)pIpHdr->ip_src.u);
+        AssertRC(rc);
+    }
+}
+
+/**
+ * Accounts a frame to the VM it comes from or goes to.
+ *
+ * @param   paStats     The statistics of the direction, NATSERVICE_VMSTATS_MAX
+ *                      entries.
+ * @param   pcOther     The counter for VMs without an entry.
+ * @param   pMac        The MAC address of the VM.
+ * @param   cbFrame     The size of the frame.
+ * @thread  The thread handling the direction.
+ */
+/* static */ void VBoxNetNAT::countFrame(PNATSERVICEVMSTATS paStats, uint64_t volatile *pcOther, PCRTMAC pMac, size_t cbFrame)
+{
+    if (pMac->au8[0] & 1) /* broadcast / multicast */
+        return;
+    uint64_t const u64Key = macKey(pMac);
+    uint32_t       i      = (uint32_t)((u64Key * UINT64_C(0x9e3779b97f4a7c15)) >> 32) & (NATSERVICE_VMSTATS_MAX - 1);
+    for (uint32_t cProbes = 0; cProbes < NATSERVICE_VMSTATS_MAX; cProbes++, i = (i + 1) & (NATSERVICE_VMSTATS_MAX - 1))
+    {
+        PNATSERVICEVMSTATS pStats = &paStats[i];
+        if (pStats->u64Key != u64Key)
+        {
+            if (pStats->u64Key)
+                continue;
+            /* A new VM, publish the key last so the report never sees
+               counters of another one. */
+            ASMAtomicWriteU64(&pStats->u64Key, u64Key);
+        }
+        ASMAtomicWriteU64(&pStats->cFrames, pStats->cFrames + 1);
+        ASMAtomicWriteU64(&pStats->cbFrames, pStats->cbFrames + cbFrame);
+        return;
+    }
+    ASMAtomicWriteU64(pcOther, *pcOther + 1);
+}
+
+/**
+ * Writes the per VM and per engine statistics to the release log.
+ */
+void VBoxNetNAT::reportStats(void)
+{
+    /* Pair up the two directions by VM. */
+    std::map<uint64_t, std::pair<NATSERVICEVMSTATS, NATSERVICEVMSTATS> > VmStats;
+    for (uint32_t i = 0; i < NATSERVICE_VMSTATS_MAX; i++)
+    {
+        uint64_t u64Key = ASMAtomicReadU64(&m_aStatsFromGuest[i].u64Key);
+        if (u64Key)
+        {
+            NATSERVICEVMSTATS &rStats = VmStats[u64Key].first;
+            rStats.cFrames  = ASMAtomicReadU64(&m_aStatsFromGuest[i].cFrames);
+            rStats.cbFrames = ASMAtomicReadU64(&m_aStatsFromGuest[i].cbFrames);
+        }
+        u64Key = ASMAtomicReadU64(&m_aStatsToGuest[i].u64Key);
+        if (u64Key)
+        {
+            NATSERVICEVMSTATS &rStats = VmStats[u64Key].second;
+            rStats.cFrames  = ASMAtomicReadU64(&m_aStatsToGuest[i].cFrames);
+            rStats.cbFrames = ASMAtomicReadU64(&m_aStatsToGuest[i].cbFrames);
+        }
+    }
+
+    LogRel(("VBoxNetNAT: %u VMs\n", VmStats.size()));
+    for (std::map<uint64_t, std::pair<NATSERVICEVMSTATS, NATSERVICEVMSTATS> >::const_iterator It = VmStats.begin();
+         It != VmStats.end();
+         ++It)
+    {
+        RTMAC Mac;
+        Mac.au16[0] = (uint16_t)It->first;
+        Mac.au16[1] = (uint16_t)(It->first >> 16);
+        Mac.au16[2] = (uint16_t)(It->first >> 32);
+        LogRel(("VBoxNetNAT:   %RTmac: from guest %llu frames / %llu bytes, to guest %llu frames / %llu bytes\n",
+                &Mac, It->second.first.cFrames, It->second.first.cbFrames,
+                It->second.second.cFrames, It->second.second.cbFrames));
+    }
+    uint64_t const cFromOthers = ASMAtomicReadU64(&m_cFramesFromOtherGuests);
+    uint64_t const cToOthers   = ASMAtomicReadU64(&m_cFramesToOtherGuests);
+    if (cFromOthers || cToOthers)
+        LogRel(("VBoxNetNAT:   other VMs: from guest %llu frames, to guest %llu frames\n", cFromOthers, cToOthers));
+    for (uint32_t iShard = 0; iShard < m_cShards; iShard++)
+        LogRel(("VBoxNetNAT:   engine %u: %llu frames in\n", iShard, m_aShards[iShard].cFramesIn));
 }
 
 /* Mandatory functions */
@@ -203,9 +871,12 @@ void VBoxNetNAT::run()
     /*
      * The loop.
      */
-    fIsRunning = true;
     PINTNETRINGBUF  pRingBuf = &m_pIfBuf->Recv;
-    //RTThreadSetType(RTThreadSelf(), RTTHREADTYPE_IO);
+    if (m_cSecsStatsInterval)
+        m_u64NextStatsReport = RTTimeMilliTS() + m_cSecsStatsInterval * UINT64_C(1000);
+
+    /* The engines may have produced something before we were online. */
+    RTSemEventSignal(m_EventXmit);
     for (;;)
     {
         /*
@@ -217,22 +888,30 @@ void VBoxNetNAT::run()
         WaitReq.pSession = m_pSession;
         WaitReq.hIf = m_hIf;
         WaitReq.cMillies = 2000; /* 2 secs - the sleep is for some reason uninterruptible... */  /** @todo fix interruptability in SrvIntNet! */
-#if 1
-        RTReqProcess(m_pSendQueue, 0);
-        RTReqProcess(m_pUrgSendQueue, 0);
-#endif
         int rc = SUPR3CallVMMR0Ex(NIL_RTR0PTR, NIL_VMCPUID, VMMR0_DO_INTNET_IF_WAIT, 0, &WaitReq.Hdr);
+
+        if (   m_cSecsStatsInterval
+            && RTTimeMilliTS() >= m_u64NextStatsReport)
+        {
+            reportStats();
+            m_u64NextStatsReport = RTTimeMilliTS() + m_cSecsStatsInterval * UINT64_C(1000);
+        }
+
         if (RT_FAILURE(rc))
         {
             if (rc == VERR_TIMEOUT || rc == VERR_INTERRUPTED)
                 continue;
             LogRel(("VBoxNetNAT: VMMR0_DO_INTNET_IF_WAIT returned %Rrc\n", rc));
-            return;
+            break;
         }
 
         /*
          * Process the receive buffer.
+         *
+         * The frames are queued up for the engines owning their flows and
+         * each engine involved is woken up once at the end.
          */
+        uint32_t fShards = 0;
         PCINTNETHDR pHdr;
         while ((pHdr = IntNetRingGetNextFrameToRead(pRingBuf)) != NULL)
         {
@@ -241,24 +920,15 @@ void VBoxNetNAT::run()
                           || u16Type == INTNETHDR_TYPE_GSO))
             {
                 size_t       cbFrame = pHdr->cbFrame;
-                size_t       cbIgnored;
-                void        *pvSlirpFrame;
-                struct mbuf *m;
                 if (u16Type == INTNETHDR_TYPE_FRAME)
                 {
-                    m = slirp_ext_m_get(g_pNAT->m_pNATState, cbFrame, &pvSlirpFrame, &cbIgnored);
-                    if (!m)
-                    {
-                        LogRel(("NAT: Can't allocate send buffer cbFrame=%u\n", cbFrame));
+                    uint8_t const   *pbFrame = (uint8_t const *)IntNetHdrGetFramePtr(pHdr, m_pIfBuf);
+                    /* Out of mbufs, retry the frame after waking up the engines. */
+                    if (!queueGuestFrame(pbFrame, cbFrame, &fShards))
                         break;
-                    }
-                    memcpy(pvSlirpFrame, IntNetHdrGetFramePtr(pHdr, m_pIfBuf), cbFrame);
+                    learnGuest(pbFrame, cbFrame);
+                    countFrame(m_aStatsFromGuest, &m_cFramesFromOtherGuests, &((PCRTNETETHERHDR)pbFrame)->SrcMac, cbFrame);
                     IntNetRingSkipFrame(&m_pIfBuf->Recv);
-
-                    /* don't wait, we may have to wakeup the NAT thread first */
-                    rc = RTReqCallEx(m_pReqQueue, NULL /*ppReq*/, 0 /*cMillies*/, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
-                                     (PFNRT)SendWorker, 2, m, cbFrame);
-                    AssertReleaseRC(rc);
                 }
                 else
                 {
@@ -278,31 +948,16 @@ void VBoxNetNAT::run()
                         uint32_t cbSegFrame;
                         void  *pvSegFrame = PDMNetGsoCarveSegmentQD(pGso, (uint8_t *)(pGso + 1), cbFrame, abHdrScratch,
                                                                     iSeg, cSegs, &cbSegFrame);
-                        m = slirp_ext_m_get(g_pNAT->m_pNATState, cbFrame, &pvSlirpFrame, &cbIgnored);
-                        if (!m)
-                        {
-                            LogRel(("NAT: Can't allocate send buffer cbSegFrame=%u seg=%u/%u\n", cbSegFrame, iSeg, cSegs));
+                        /* The segments can't be retried, the rest is lost like on a wire. */
+                        if (!queueGuestFrame((uint8_t const *)pvSegFrame, cbSegFrame, &fShards))
                             break;
-                        }
-                        memcpy(pvSlirpFrame, pvSegFrame, cbFrame);
-
-                        rc = RTReqCallEx(m_pReqQueue, NULL /*ppReq*/, 0 /*cMillies*/, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
-                                         (PFNRT)SendWorker, 2, m, cbSegFrame);
-                        AssertReleaseRC(rc);
+                        if (!iSeg)
+                            learnGuest((uint8_t const *)pvSegFrame, cbSegFrame);
+                        countFrame(m_aStatsFromGuest, &m_cFramesFromOtherGuests,
+                                   &((PCRTNETETHERHDR)pvSegFrame)->SrcMac, cbSegFrame);
                     }
                     IntNetRingSkipFrame(&m_pIfBuf->Recv);
                 }
-
-#ifndef RT_OS_WINDOWS
-                /* kick select() */
-                size_t cbIgnored;
-                rc = RTPipeWrite(m_hPipeWrite, "", 1, &cbIgnored);
-                AssertRC(rc);
-#else
-                /* kick WSAWaitForMultipleEvents */
-                rc = WSASetEvent(m_hWakeupEvent);
-                AssertRelease(rc == TRUE);
-#endif
             }
             else if (u16Type == INTNETHDR_TYPE_PADDING)
                 IntNetRingSkipFrame(&m_pIfBuf->Recv);
@@ -313,12 +968,150 @@ void VBoxNetNAT::run()
             }
         }
 
+        for (uint32_t iShard = 0; iShard < m_cShards; iShard++)
+            if (fShards & RT_BIT_32(iShard))
+                notifyShard(&m_aShards[iShard]);
     }
-    fIsRunning = false;
+
+    reportStats();
+    term();
 }
 
 void VBoxNetNAT::usage()
 {
+    RTPrintf("\n"
+             "Port forwarding rules: tcp|udp,[host-ip],host-port,guest-mac,guest-port\n");
+}
+
+/**
+ * Queues a frame from an engine for the transmit thread.
+ *
+ * @param   pShard      The engine owning the mbuf.
+ * @param   m           The mbuf.
+ * @param   pu8Buf      The frame.
+ * @param   cb          The size of the frame.
+ * @param   fUrgent     Whether it's urgent (TCP OOB) data.
+ * @thread  The engine thread.
+ */
+void VBoxNetNAT::queueXmit(PNATSERVICESHARD pShard, struct mbuf *m, uint8_t *pu8Buf, int cb, bool fUrgent)
+{
+    PNATSERVICEFRAME pFrame = (PNATSERVICEFRAME)RTMemCacheAlloc(m_hFrameCache);
+    if (RT_UNLIKELY(!pFrame))
+    {
+        slirp_ext_m_free(pShard->pNATState, m, pu8Buf);
+        return;
+    }
+    pFrame->pNext  = NULL;
+    pFrame->pShard = pShard;
+    pFrame->m      = m;
+    pFrame->pu8Buf = pu8Buf;
+    pFrame->cb     = cb;
+
+    RTCritSectEnter(&m_XmitLock);
+    bool const fWasEmpty = !m_pXmitHead && !m_pXmitUrgHead;
+    if (fUrgent)
+    {
+        *m_ppXmitUrgTail = pFrame;
+        m_ppXmitUrgTail  = &pFrame->pNext;
+    }
+    else
+    {
+        *m_ppXmitTail = pFrame;
+        m_ppXmitTail  = &pFrame->pNext;
+    }
+    RTCritSectLeave(&m_XmitLock);
+
+    /* The transmit thread empties both FIFOs in one go, so only the first
+       frame needs to wake it up. */
+    if (fWasEmpty)
+        RTSemEventSignal(m_EventXmit);
+}
+
+/**
+ * Writes a list of frames to the send ring and returns their mbufs.
+ *
+ * @returns Number of frames written.
+ * @param   pHead       The frames.
+ * @param   pfShards    Where to mark the engines which got mbufs back.
+ * @thread  NATTX
+ */
+uint32_t VBoxNetNAT::xmitList(PNATSERVICEFRAME pHead, uint32_t *pfShards)
+{
+    uint32_t cFrames = 0;
+    while (pHead)
+    {
+        PNATSERVICEFRAME pFrame = pHead;
+        pHead = pFrame->pNext;
+
+        int rc = IntNetRingWriteFrame(&m_pIfBuf->Send, pFrame->pu8Buf, pFrame->cb);
+        if (rc == VERR_BUFFER_OVERFLOW)
+        {
+            /* Push what we've got so far and try again. */
+            VBoxNetIntIfFlush(m_pSession, m_hIf);
+            rc = IntNetRingWriteFrame(&m_pIfBuf->Send, pFrame->pu8Buf, pFrame->cb);
+        }
+        if (RT_SUCCESS(rc))
+        {
+            countFrame(m_aStatsToGuest, &m_cFramesToOtherGuests, &((PCRTNETETHERHDR)pFrame->pu8Buf)->DstMac, pFrame->cb);
+            cFrames++;
+        }
+        else
+            Log2(("VBoxNetNAT: Failed to send packet; rc=%Rrc\n", rc));
+
+        slirp_ext_m_free(pFrame->pShard->pNATState, pFrame->m, pFrame->pu8Buf);
+        *pfShards |= RT_BIT_32(pFrame->pShard->iShard);
+        RTMemCacheFree(m_hFrameCache, pFrame);
+    }
+    return cFrames;
+}
+
+/**
+ * Returns the mbufs of a list of frames without sending them.
+ *
+ * @param   pHead       The frames.
+ */
+void VBoxNetNAT::freeList(PNATSERVICEFRAME pHead)
+{
+    while (pHead)
+    {
+        PNATSERVICEFRAME pFrame = pHead;
+        pHead = pFrame->pNext;
+        slirp_ext_m_free(pFrame->pShard->pNATState, pFrame->m, pFrame->pu8Buf);
+        RTMemCacheFree(m_hFrameCache, pFrame);
+    }
+}
+
+/**
+ * Sends everything the engines have queued up, urgent frames first, with a
+ * single send request.
+ *
+ * @thread  NATTX
+ */
+void VBoxNetNAT::xmitPending(void)
+{
+    RTCritSectEnter(&m_XmitLock);
+    PNATSERVICEFRAME pUrgHead = m_pXmitUrgHead;
+    PNATSERVICEFRAME pHead    = m_pXmitHead;
+    m_pXmitUrgHead  = NULL;
+    m_ppXmitUrgTail = &m_pXmitUrgHead;
+    m_pXmitHead     = NULL;
+    m_ppXmitTail    = &m_pXmitHead;
+    RTCritSectLeave(&m_XmitLock);
+
+    uint32_t fShards = 0;
+    uint32_t cFrames = xmitList(pUrgHead, &fShards);
+    cFrames += xmitList(pHead, &fShards);
+    if (cFrames)
+    {
+        int rc = VBoxNetIntIfFlush(m_pSession, m_hIf);
+        if (RT_FAILURE(rc))
+            Log2(("VBoxNetNAT: Failed to send packets; rc=%Rrc\n", rc));
+    }
+
+    /* Wake up each engine which got mbufs back, it may be waiting for them. */
+    for (uint32_t iShard = 0; iShard < m_cShards; iShard++)
+        if (fShards & RT_BIT_32(iShard))
+            notifyShard(&m_aShards[iShard]);
 }
 
 /**
@@ -333,9 +1126,15 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
     if (!rc)
     {
         Log2(("NAT: initialization\n"));
-        g_pNAT->init();
+        rc = g_pNAT->init();
+    }
+    if (!rc)
+    {
         Log2(("NAT: try go online\n"));
-        g_pNAT->tryGoOnline();
+        rc = g_pNAT->tryGoOnline();
+    }
+    if (!rc)
+    {
         Log2(("NAT: main loop\n"));
         g_pNAT->run();
     }
@@ -351,121 +1150,149 @@ extern "C" int slirp_can_output(void * pvUser)
 
 extern "C" void slirp_urg_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
 {
-    int rc = RTReqCallEx(g_pNAT->m_pUrgSendQueue,  NULL /*ppReq*/, 0 /*cMillies*/, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
-                         (PFNRT)IntNetSendWorker, 4, (uintptr_t)1, (uintptr_t)pu8Buf, (uintptr_t)cb, (uintptr_t)m);
-    ASMAtomicIncU32(&g_pNAT->cUrgPkt);
-    RTSemEventSignal(g_pNAT->m_EventUrgSend);
-    AssertReleaseRC(rc);
+    PNATSERVICESHARD pShard = (PNATSERVICESHARD)pvUser;
+    pShard->pNAT->queueXmit(pShard, m, (uint8_t *)pu8Buf, cb, true /* fUrgent */);
 }
+
 extern "C" void slirp_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
 {
-    AssertRelease(g_pNAT == pvUser);
-    int rc = RTReqCallEx(g_pNAT->m_pSendQueue,  NULL /*ppReq*/, 0 /*cMillies*/, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
-                         (PFNRT)IntNetSendWorker, 4, (uintptr_t)0, (uintptr_t)pu8Buf, (uintptr_t)cb, (uintptr_t)m);
-    ASMAtomicIncU32(&g_pNAT->cPkt);
-    RTSemEventSignal(g_pNAT->m_EventSend);
-    AssertReleaseRC(rc);
+    PNATSERVICESHARD pShard = (PNATSERVICESHARD)pvUser;
+    pShard->pNAT->queueXmit(pShard, m, (uint8_t *)pu8Buf, cb, false /* fUrgent */);
 }
 
 extern "C" void slirp_output_pending(void *pvUser)
 {
-  AssertMsgFailed(("Unimplemented"));
+    /* The send ring is flushed by the transmit thread, nothing to do. */
+    NOREF(pvUser);
 }
 
 /**
- * Worker function for drvNATSend().
- * @thread "NAT" thread.
+ * Called by slirp from other threads when the NAT thread has work to pick up.
  */
-static void SendWorker(struct mbuf *m, size_t cb)
+extern "C" void slirp_wakeup_nat_thread(void *pvUser)
 {
-    slirp_input(g_pNAT->m_pNATState, m, cb);
+    PNATSERVICESHARD pShard = (PNATSERVICESHARD)pvUser;
+    pShard->pNAT->notifyShard(pShard);
 }
 
-static void IntNetSendWorker(bool urg, void *pvFrame, size_t cbFrame, struct mbuf *m)
+/**
+ * Worker function for handing a frame from a VM to an engine.
+ * @thread The engine thread.
+ */
+static void SendWorker(PNATSERVICESHARD pShard, struct mbuf *m, size_t cb)
 {
-    Log2(("VBoxNetNAT: going to send some bytes ... \n"));
-    VBoxNetNAT         *pThis = g_pNAT;
-    INTNETIFSENDREQ     SendReq;
-    int rc;
-
-    if (!urg)
-    {
-        while (ASMAtomicReadU32(&g_pNAT->cUrgPkt) != 0
-               || ASMAtomicReadU32(&g_pNAT->cPkt) == 0)
-            rc = RTSemEventWait(g_pNAT->m_EventSend, RT_INDEFINITE_WAIT);
-    }
-    else
-    {
-        while (ASMAtomicReadU32(&g_pNAT->cUrgPkt) == 0)
-            rc = RTSemEventWait(g_pNAT->m_EventUrgSend, RT_INDEFINITE_WAIT);
-    }
-    rc = IntNetRingWriteFrame(&pThis->m_pIfBuf->Send, pvFrame, cbFrame);
-    if (RT_FAILURE(rc))
-    {
-        SendReq.Hdr.u32Magic = SUPVMMR0REQHDR_MAGIC;
-        SendReq.Hdr.cbReq    = sizeof(SendReq);
-        SendReq.pSession     = pThis->m_pSession;
-        SendReq.hIf          = pThis->m_hIf;
-        rc = SUPR3CallVMMR0Ex(NIL_RTR0PTR, NIL_VMCPUID, VMMR0_DO_INTNET_IF_SEND, 0, &SendReq.Hdr);
-
-        rc = IntNetRingWriteFrame(&pThis->m_pIfBuf->Send, pvFrame, cbFrame);
+    ASMAtomicIncU64(&pShard->cFramesIn);
+    slirp_input(pShard->pNATState, m, cb);
+}
 
-    }
-    if (RT_SUCCESS(rc))
-    {
-        SendReq.Hdr.u32Magic = SUPVMMR0REQHDR_MAGIC;
-        SendReq.Hdr.cbReq    = sizeof(SendReq);
-        SendReq.pSession     = pThis->m_pSession;
-        SendReq.hIf          = pThis->m_hIf;
-        rc = SUPR3CallVMMR0Ex(NIL_RTR0PTR, NIL_VMCPUID, VMMR0_DO_INTNET_IF_SEND, 0, &SendReq.Hdr);
-    }
-    if (RT_FAILURE(rc))
-        Log2(("VBoxNetNAT: Failed to send packet; rc=%Rrc\n", rc));
+/**
+ * Worker function for telling a secondary engine the address of a VM.
+ * @thread The engine thread.
+ */
+static void GuestWorker(PNATSERVICESHARD pShard, PRTMAC pMac, uint32_t u32GuestIp)
+{
+    slirp_set_ethaddr_and_activate_port_forwarding(pShard->pNATState, &pMac->au8[0], u32GuestIp);
+    RTMemFree(pMac);
+}
 
-    if (!urg)
+static DECLCALLBACK(int) natXmitThread(RTTHREAD pThread, void *pvUser)
+{
+    VBoxNetNAT *pThis = (VBoxNetNAT *)pvUser;
+    for (;;)
     {
-        ASMAtomicDecU32(&g_pNAT->cPkt);
-    }
-    else {
-        if (ASMAtomicDecU32(&g_pNAT->cUrgPkt) == 0)
-            RTSemEventSignal(g_pNAT->m_EventSend);
+        /* queueXmit signals the first frame, term() the shutdown. */
+        RTSemEventWait(pThis->m_EventXmit, RT_INDEFINITE_WAIT);
+        if (ASMAtomicReadBool(&pThis->m_fShutdown))
+            break;
+        /* Nothing can be sent until run() has signalled us once online. */
+        if (pThis->m_pIfBuf)
+            pThis->xmitPending();
     }
-    natNotifyNATThread();
-    slirp_ext_m_free(pThis->m_pNATState, m, (uint8_t *)pvFrame);
+    return VINF_SUCCESS;
 }
 
 static DECLCALLBACK(int) AsyncIoThread(RTTHREAD pThread, void *pvUser)
 {
-    VBoxNetNAT *pThis = (VBoxNetNAT *)pvUser;
+    PNATSERVICESHARD pShard = (PNATSERVICESHARD)pvUser;
+    VBoxNetNAT *pThis = pShard->pNAT;
     int     nFDs = -1;
 #ifdef RT_OS_WINDOWS
-    HANDLE *pahEvents = slirp_get_events(pThis->m_pNATState);
+    HANDLE *pahEvents = slirp_get_events(pShard->pNATState);
 #else /* RT_OS_WINDOWS */
     unsigned int cPollNegRet = 0;
+# ifndef VBOX_WITH_NAT_EPOLL
+    /* Kept across rounds and only grown, the socket count rarely changes. */
+    struct pollfd *polls = NULL;
+    int cPollsAlloc = 0;
+# endif
 #endif /* !RT_OS_WINDOWS */
 
-    LogFlow(("drvNATAsyncIoThread: pThis=%p\n", pThis));
+    LogFlow(("drvNATAsyncIoThread: pThis=%p iShard=%u\n", pThis, pShard->iShard));
 
     /*
      * Polling loop.
      */
-    for(;;)
+    while (!ASMAtomicReadBool(&pThis->m_fShutdown))
     {
         /*
          * To prevent concurrent execution of sending/receiving threads
          */
-#ifndef RT_OS_WINDOWS
-        nFDs = slirp_get_nsock(pThis->m_pNATState);
+#if defined(VBOX_WITH_NAT_EPOLL)
+        /* The sockets and the management pipe stay registered with the epoll
+         * set, fill only pushes interest changes. */
+        slirp_select_fill(pShard->pNATState, &nFDs);
+
+        bool fWakeup = false;
+        int cEvents = slirp_select_wait(pShard->pNATState, slirp_get_timeout_ms(pShard->pNATState), &fWakeup);
+        if (cEvents < 0)
+        {
+            if (errno == EINTR)
+            {
+                Log2(("NAT: signal was caught while sleep on epoll_wait\n"));
+                cEvents = 0;
+            }
+            else if (cPollNegRet++ > 128)
+            {
+                LogRel(("NAT:epoll_wait returns (%s) suppressed %d\n", strerror(errno), cPollNegRet));
+                cPollNegRet = 0;
+            }
+        }
+
+        if (cEvents >= 0)
+        {
+            slirp_select_poll(pShard->pNATState, cEvents);
+            if (fWakeup)
+            {
+                /* drain the pipe, see the poll() variant below */
+                char ch;
+                size_t cbRead;
+                RTPipeRead(pShard->hPipeRead, &ch, 1, &cbRead);
+            }
+        }
+        /* process _all_ outstanding requests but don't wait */
+        RTReqProcess(pShard->pReqQueue, 0);
+
+#elif !defined(RT_OS_WINDOWS)
+        nFDs = slirp_get_nsock(pShard->pNATState);
         /* allocation for all sockets + Management pipe */
-        struct pollfd *polls = (struct pollfd *)RTMemAlloc((1 + nFDs) * sizeof(struct pollfd) + sizeof(uint32_t));
-        if (polls == NULL)
-            return VERR_NO_MEMORY;
+        if (nFDs + 1 > cPollsAlloc)
+        {
+            int cNew = RT_ALIGN_32(nFDs + 1, 64);
+            struct pollfd *pNew = (struct pollfd *)RTMemRealloc(polls, cNew * sizeof(struct pollfd) + sizeof(uint32_t));
+            if (pNew == NULL)
+            {
+                RTMemFree(polls);
+                return VERR_NO_MEMORY;
+            }
+            polls = pNew;
+            cPollsAlloc = cNew;
+        }
 
         /* don't pass the management pipe */
-        slirp_select_fill(pThis->m_pNATState, &nFDs, &polls[1]);
-        unsigned int cMsTimeout = slirp_get_timeout_ms(pThis->m_pNATState);
+        slirp_select_fill(pShard->pNATState, &nFDs, &polls[1]);
+        unsigned int cMsTimeout = slirp_get_timeout_ms(pShard->pNATState);
 
-        polls[0].fd = RTPipeToNative(pThis->m_hPipeRead);
+        polls[0].fd = RTPipeToNative(pShard->hPipeRead);
         /* POLLRDBAND usually doesn't used on Linux but seems used on Solaris */
         polls[0].events = POLLRDNORM|POLLPRI|POLLRDBAND;
         polls[0].revents = 0;
@@ -488,7 +1315,7 @@ static DECLCALLBACK(int) AsyncIoThread(RTTHREAD pThread, void *pvUser)
 
         if (cChangedFDs >= 0)
         {
-            slirp_select_poll(pThis->m_pNATState, &polls[1], nFDs);
+            slirp_select_poll(pShard->pNATState, &polls[1], nFDs);
             if (polls[0].revents & (POLLRDNORM|POLLPRI|POLLRDBAND))
             {
                 /* drain the pipe
@@ -506,18 +1333,17 @@ static DECLCALLBACK(int) AsyncIoThread(RTTHREAD pThread, void *pvUser)
                   *  pipe.  */
                 char    ch;
                 size_t  cbRead;
-                RTPipeRead(pThis->m_hPipeRead, &ch, 1, &cbRead);
+                RTPipeRead(pShard->hPipeRead, &ch, 1, &cbRead);
             }
         }
         /* process _all_ outstanding requests but don't wait */
-        RTReqProcess(pThis->m_pReqQueue, 0);
-        RTMemFree(polls);
+        RTReqProcess(pShard->pReqQueue, 0);
 
 #else /* RT_OS_WINDOWS */
         nFDs = -1;
-        slirp_select_fill(pThis->m_pNATState, &nFDs);
+        slirp_select_fill(pShard->pNATState, &nFDs);
         DWORD dwEvent = WSAWaitForMultipleEvents(nFDs, pahEvents, FALSE,
-                                                 slirp_get_timeout_ms(pThis->m_pNATState),
+                                                 slirp_get_timeout_ms(pShard->pNATState),
                                                  FALSE);
         if (   (dwEvent < WSA_WAIT_EVENT_0 || dwEvent > WSA_WAIT_EVENT_0 + nFDs - 1)
             && dwEvent != WSA_WAIT_TIMEOUT)
@@ -530,30 +1356,20 @@ static DECLCALLBACK(int) AsyncIoThread(RTTHREAD pThread, void *pvUser)
         if (dwEvent == WSA_WAIT_TIMEOUT)
         {
             /* only check for slow/fast timers */
-            slirp_select_poll(pThis->m_pNATState, /* fTimeout=*/true, /*fIcmp=*/false);
+            slirp_select_poll(pShard->pNATState, /* fTimeout=*/true, /*fIcmp=*/false);
             continue;
         }
 
         /* poll the sockets in any case */
-        slirp_select_poll(pThis->m_pNATState, /* fTimeout=*/false, /* fIcmp=*/(dwEvent == WSA_WAIT_EVENT_0));
+        slirp_select_poll(pShard->pNATState, /* fTimeout=*/false, /* fIcmp=*/(dwEvent == WSA_WAIT_EVENT_0));
         /* process _all_ outstanding requests but don't wait */
-        RTReqProcess(pThis->m_pReqQueue, 0);
+        RTReqProcess(pShard->pReqQueue, 0);
 #endif /* RT_OS_WINDOWS */
     }
 
-    return VINF_SUCCESS;
-}
-
-static DECLCALLBACK(int) natSndThread(RTTHREAD pThread, void *pvUser)
-{
-    while (g_pNAT->fIsRunning)
-        RTReqProcess(g_pNAT->m_pSendQueue, 0);
-    return VINF_SUCCESS;
-}
-static DECLCALLBACK(int) natUrgSndThread(RTTHREAD pThread, void *pvUser)
-{
-    while (g_pNAT->fIsRunning)
-        RTReqProcess(g_pNAT->m_pUrgSendQueue, 0);
+#if !defined(RT_OS_WINDOWS) && !defined(VBOX_WITH_NAT_EPOLL)
+    RTMemFree(polls);
+#endif
     return VINF_SUCCESS;
 }
 
@@ -119,8 +119,11 @@ int VBoxNetBaseService::parseArgs(int argc, char **argv)
         { "--verbose",        'v',   RTGETOPT_REQ_NOTHING },
     };
 
+    std::vector<RTGETOPTDEF> vecOptionDefs(&s_aOptionDefs[0], &s_aOptionDefs[RT_ELEMENTS(s_aOptionDefs)]);
+    vecOptionDefs.insert(vecOptionDefs.end(), m_vecOptionDefs.begin(), m_vecOptionDefs.end());
+
     RTGETOPTSTATE State;
-    int rc = RTGetOptInit(&State, argc, argv, &s_aOptionDefs[0], RT_ELEMENTS(s_aOptionDefs), 0, 0 /*fFlags*/);
+    int rc = RTGetOptInit(&State, argc, argv, &vecOptionDefs[0], vecOptionDefs.size(), 0, 0 /*fFlags*/);
     AssertRCReturn(rc, 49);
     Log2(("BaseService: parseArgs enter\n"));
 
@@ -182,21 +185,45 @@ int VBoxNetBaseService::parseArgs(int argc, char **argv)
                          "\n"
                          "Options:\n",
                          RTBldCfgVersion());
-                for (size_t i = 0; i < RT_ELEMENTS(s_aOptionDefs); i++)
-                    RTPrintf("    -%c, %s\n", s_aOptionDefs[i].iShort, s_aOptionDefs[i].pszLong);
+                for (size_t i = 0; i < vecOptionDefs.size(); i++)
+                    RTPrintf("    -%c, %s\n", vecOptionDefs[i].iShort, vecOptionDefs[i].pszLong);
                 usage(); /* to print Service Specific usage */
                 return 1;
 
             default:
-                rc = RTGetOptPrintError(rc, &Val);
-                RTPrintf("Use --help for more information.\n");
-                return rc;
+            {
+                int rcOpt = parseOpt(rc, Val);
+                if (rcOpt == VERR_NOT_FOUND)
+                {
+                    rc = RTGetOptPrintError(rc, &Val);
+                    RTPrintf("Use --help for more information.\n");
+                    return rc;
+                }
+                if (rcOpt)
+                    return rcOpt;
+                break;
+            }
         }
     }
 
     return rc;
 }
 
+/**
+ * Handles a service specific option (m_vecOptionDefs).
+ *
+ * @returns 0 if handled, VERR_NOT_FOUND if not a service specific option,
+ *          fully bitched exit code on failure.
+ *
+ * @param   rc      The RTGetOpt return value.
+ * @param   Val     The option value.
+ */
+int VBoxNetBaseService::parseOpt(int rc, const RTGETOPTUNION &Val)
+{
+    NOREF(rc); NOREF(Val);
+    return VERR_NOT_FOUND;
+}
+
 int VBoxNetBaseService::tryGoOnline(void)
 {
     /*
@@ -27,6 +27,7 @@ public:
     void                shutdown(void);
     virtual void        usage(void) = 0;
     virtual void        run(void) = 0;
+    virtual int         parseOpt(int rc, const RTGETOPTUNION &Val);
 
     inline void         debugPrint( int32_t iMinLevel, bool fMsg,  const char *pszFmt, ...) const;
     void                debugPrintV(int32_t iMinLevel, bool fMsg,  const char *pszFmt, va_list va) const;
@@ -52,5 +53,7 @@ public:
      * @{  */
     int32_t             m_cVerbosity;
     /** @} */
+    /** Service specific options, handed to parseOpt. */
+    std::vector<RTGETOPTDEF> m_vecOptionDefs;
 };
 #endif
@@ -178,11 +178,11 @@ void *VBoxNetUDPMatch(PINTNETBUF pBuf, unsigned uDstPort, PCRTMAC pDstMac, uint3
 }
 
 
-/** Internal worker for VBoxNetUDPUnicast and VBoxNetUDPBroadcast. */
+/** Internal worker for VBoxNetUDPUnicast and VBoxNetUDPBroadcast[Ex]. */
 static int vboxnetudpSend(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNETBUF pBuf,
                           RTNETADDRIPV4 SrcIPv4Addr, PCRTMAC pSrcMacAddr, unsigned uSrcPort,
                           RTNETADDRIPV4 DstIPv4Addr, PCRTMAC pDstMacAddr, unsigned uDstPort,
-                          void const *pvData, size_t cbData)
+                          void const *pvData, size_t cbData, bool fFlush)
 {
     INTNETSEG aSegs[4];
 
@@ -239,7 +239,7 @@ static int vboxnetudpSend(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNETBU
 
 
     /* send it */
-    return VBoxNetIntIfSend(pSession, hIf, pBuf, RT_ELEMENTS(aSegs), &aSegs[0], true /* fFlush */);
+    return VBoxNetIntIfSend(pSession, hIf, pBuf, RT_ELEMENTS(aSegs), &aSegs[0], fFlush);
 }
 
 
@@ -267,7 +267,7 @@ int     VBoxNetUDPUnicast(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNETBU
     return vboxnetudpSend(pSession, hIf, pBuf,
                           SrcIPv4Addr, pSrcMacAddr, uSrcPort,
                           DstIPv4Addr, pDstMacAddr, uDstPort,
-                          pvData, cbData);
+                          pvData, cbData, true /* fFlush */);
 }
 
 
@@ -289,6 +289,37 @@ int     VBoxNetUDPBroadcast(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNET
                             RTNETADDRIPV4 SrcIPv4Addr, PCRTMAC pSrcMacAddr, unsigned uSrcPort,
                             unsigned uDstPort,
                             void const *pvData, size_t cbData)
+{
+    return VBoxNetUDPBroadcastEx(pSession, hIf, pBuf,
+                                 SrcIPv4Addr, pSrcMacAddr, uSrcPort,
+                                 uDstPort,
+                                 pvData, cbData, true /* fFlush */);
+}
+
+
+/**
+ * Sends a broadcast UDP packet, optionally leaving it in the send ring.
+ *
+ * Servers answering a batch of requests pass fFlush=false and call
+ * VBoxNetIntIfFlush once they're done, which saves a ring-0 call per reply.
+ * The ring is still flushed should it run full.
+ *
+ * @returns VBox status code.
+ * @param   pSession        The support driver session handle.
+ * @param   hIf             The interface handle.
+ * @param   pBuf            The interface buffer.
+ * @param   SrcIPv4Addr     The source IPv4 address.
+ * @param   pSrcMacAddr     The source MAC address.
+ * @param   uSrcPort        The source port number.
+ * @param   uDstPort        The destination port number.
+ * @param   pvData          The data payload.
+ * @param   cbData          The size of the data payload.
+ * @param   fFlush          Whether to flush the send ring.
+ */
+int     VBoxNetUDPBroadcastEx(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNETBUF pBuf,
+                              RTNETADDRIPV4 SrcIPv4Addr, PCRTMAC pSrcMacAddr, unsigned uSrcPort,
+                              unsigned uDstPort,
+                              void const *pvData, size_t cbData, bool fFlush)
 {
     RTNETADDRIPV4   IPv4AddrBrdCast;
     IPv4AddrBrdCast.u = UINT32_C(0xffffffff);
@@ -298,6 +329,6 @@ int     VBoxNetUDPBroadcast(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNET
     return vboxnetudpSend(pSession, hIf, pBuf,
                           SrcIPv4Addr, pSrcMacAddr, uSrcPort,
                           IPv4AddrBrdCast, &MacBrdCast, uDstPort,
-                          pvData, cbData);
+                          pvData, cbData, fFlush);
 }
 
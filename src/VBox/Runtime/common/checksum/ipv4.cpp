@@ -34,6 +34,13 @@
 #include <iprt/asm.h>
 #include <iprt/assert.h>
 
+/** @def RTNETIPV4_WITH_SSE2
+ * Use SSE2 for summing up data, see rtNetIPv4SumWords. */
+#if defined(IN_RING3) && defined(RT_ARCH_AMD64)
+# define RTNETIPV4_WITH_SSE2
+# include <emmintrin.h>
+#endif
+
 
 /**
  * Calculates the checksum of the IPv4 header.
@@ -286,50 +293,167 @@ RT_EXPORT_SYMBOL(RTNetIPv4AddTCPChecksum);
 
 
 /**
- * Adds the checksum of the specified data segment to the intermediate checksum value [inlined].
+ * Sums up the 16-bit words of a block of data, optionally copying it
+ * [inlined].
+ *
+ * This is the inner loop of all the data checksumming.  On AMD64 ring-3 it
+ * uses SSE2 (which that architecture always has), elsewhere it adds 32-bit
+ * words to a 64-bit accumulator, which halves the number of additions and
+ * gets rid of the carry handling.  The FPU/SIMD state isn't ours to use in
+ * ring-0, hence the restriction.
+ *
+ * @returns The sum, folded to 16 bits.
+ * @param   pbDst           Where to copy the data to if @a fCopy is set.
+ * @param   pbSrc           The data.
+ * @param   cbData          The number of bytes, must be even.
+ * @param   fCopy           Whether to copy the data to @a pbDst.  This is a
+ *                          constant in all callers, so the compiler generates
+ *                          two specialized loops.
+ */
+DECLINLINE(uint32_t) rtNetIPv4SumWords(uint8_t *pbDst, uint8_t const *pbSrc, size_t cbData, bool fCopy)
+{
+    uint64_t u64Sum = 0;
+    Assert(!(cbData & 1));
+
+#ifdef RTNETIPV4_WITH_SSE2
+    if (cbData >= 64)
+    {
+        /* Zero-extend the dwords to qwords and add them up in two
+           accumulators, no carries to lose for the next 2^32 rounds. */
+        __m128i const Zero = _mm_setzero_si128();
+        __m128i       Acc0 = Zero;
+        __m128i       Acc1 = Zero;
+        do
+        {
+            __m128i const V0 = _mm_loadu_si128((__m128i const *)pbSrc);
+            __m128i const V1 = _mm_loadu_si128((__m128i const *)pbSrc + 1);
+            __m128i const V2 = _mm_loadu_si128((__m128i const *)pbSrc + 2);
+            __m128i const V3 = _mm_loadu_si128((__m128i const *)pbSrc + 3);
+            if (fCopy)
+            {
+                _mm_storeu_si128((__m128i *)pbDst,     V0);
+                _mm_storeu_si128((__m128i *)pbDst + 1, V1);
+                _mm_storeu_si128((__m128i *)pbDst + 2, V2);
+                _mm_storeu_si128((__m128i *)pbDst + 3, V3);
+                pbDst += 64;
+            }
+            Acc0 = _mm_add_epi64(Acc0, _mm_unpacklo_epi32(V0, Zero));
+            Acc1 = _mm_add_epi64(Acc1, _mm_unpackhi_epi32(V0, Zero));
+            Acc0 = _mm_add_epi64(Acc0, _mm_unpacklo_epi32(V1, Zero));
+            Acc1 = _mm_add_epi64(Acc1, _mm_unpackhi_epi32(V1, Zero));
+            Acc0 = _mm_add_epi64(Acc0, _mm_unpacklo_epi32(V2, Zero));
+            Acc1 = _mm_add_epi64(Acc1, _mm_unpackhi_epi32(V2, Zero));
+            Acc0 = _mm_add_epi64(Acc0, _mm_unpacklo_epi32(V3, Zero));
+            Acc1 = _mm_add_epi64(Acc1, _mm_unpackhi_epi32(V3, Zero));
+            pbSrc  += 64;
+            cbData -= 64;
+        } while (cbData >= 64);
+
+        Acc0 = _mm_add_epi64(Acc0, Acc1);
+        Acc0 = _mm_add_epi64(Acc0, _mm_srli_si128(Acc0, 8));
+        u64Sum = (uint64_t)_mm_cvtsi128_si64(Acc0);
+    }
+#endif
+
+#if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
+    /* x86 doesn't mind misaligned dword accesses. */
+    while (cbData >= 16)
+    {
+        uint32_t const u32A = ((uint32_t const *)pbSrc)[0];
+        uint32_t const u32B = ((uint32_t const *)pbSrc)[1];
+        uint32_t const u32C = ((uint32_t const *)pbSrc)[2];
+        uint32_t const u32D = ((uint32_t const *)pbSrc)[3];
+        if (fCopy)
+        {
+            ((uint32_t *)pbDst)[0] = u32A;
+            ((uint32_t *)pbDst)[1] = u32B;
+            ((uint32_t *)pbDst)[2] = u32C;
+            ((uint32_t *)pbDst)[3] = u32D;
+            pbDst += 16;
+        }
+        u64Sum += u32A;
+        u64Sum += u32B;
+        u64Sum += u32C;
+        u64Sum += u32D;
+        pbSrc  += 16;
+        cbData -= 16;
+    }
+#endif
+
+    while (cbData > 0)
+    {
+        uint16_t const u16 = *(uint16_t const *)pbSrc;
+        if (fCopy)
+        {
+            *(uint16_t *)pbDst = u16;
+            pbDst += 2;
+        }
+        u64Sum += u16;
+        pbSrc  += 2;
+        cbData -= 2;
+    }
+
+    /* Fold it, 2^32 and 2^16 are both 1 in one's complement arithmetic. */
+    u64Sum = (u64Sum >> 32) + (u64Sum & UINT32_MAX);
+    u64Sum = (u64Sum >> 32) + (u64Sum & UINT32_MAX);
+    uint32_t u32Sum = (uint32_t)(u64Sum >> 32) + (uint32_t)u64Sum;
+    u32Sum = (u32Sum >> 16) + (u32Sum & 0xffff);
+    u32Sum = (u32Sum >> 16) + (u32Sum & 0xffff);
+    return u32Sum;
+}
+
+
+/**
+ * Adds the checksum of the specified data segment to the intermediate
+ * checksum value, optionally copying the data [inlined].
  *
  * @returns 32-bit intermediary checksum value.
+ * @param   pvDst           Where to copy the data to if @a fCopy is set.
  * @param   pvData          Pointer to the data that should be checksummed.
  * @param   cbData          The number of bytes to checksum.
  * @param   u32Sum          The 32-bit intermediate checksum value.
  * @param   pfOdd           This is used to keep track of odd bits, initialize to false
  *                          when starting to checksum the data (aka text) after a TCP
  *                          or UDP header (data never start at an odd offset).
+ * @param   fCopy           Whether to copy the data.
  */
-DECLINLINE(uint32_t) rtNetIPv4AddDataChecksum(void const *pvData, size_t cbData, uint32_t u32Sum, bool *pfOdd)
+DECLINLINE(uint32_t) rtNetIPv4AddDataChecksumEx(void *pvDst, void const *pvData, size_t cbData, uint32_t u32Sum, bool *pfOdd,
+                                                bool fCopy)
 {
-    uint16_t const *pw = (uint16_t const *)pvData;
+    uint8_t const *pbSrc = (uint8_t const *)pvData;
+    uint8_t       *pbDst = (uint8_t *)pvDst;
+    if (!cbData)
+        return u32Sum;
     if (*pfOdd)
     {
+        if (fCopy)
+            *pbDst++ = *pbSrc;
 #ifdef RT_BIG_ENDIAN
         /* there was an odd byte in the previous chunk, add the lower byte. */
-        u32Sum += *(uint8_t *)pvData;
+        u32Sum += *pbSrc;
 #else
         /* there was an odd byte in the previous chunk, add the upper byte. */
-        u32Sum += (uint32_t)*(uint8_t *)pvData << 8;
+        u32Sum += (uint32_t)*pbSrc << 8;
 #endif
         /* skip the byte. */
+        pbSrc++;
         cbData--;
-        if (!cbData)
-            return u32Sum;
-        pvData = (uint8_t const *)pvData + 1;
     }
 
     /* iterate the data. */
-    while (cbData > 1)
-    {
-        u32Sum += *pw;
-        pw++;
-        cbData -= 2;
-    }
+    size_t const cbWords = cbData & ~(size_t)1;
+    uint64_t const u64Sum = (uint64_t)u32Sum + rtNetIPv4SumWords(pbDst, pbSrc, cbWords, fCopy);
+    u32Sum = (uint32_t)(u64Sum >> 32) + (uint32_t)u64Sum;
 
     /* handle odd byte. */
-    if (cbData)
+    if (cbData & 1)
     {
+        if (fCopy)
+            pbDst[cbWords] = pbSrc[cbWords];
 #ifdef RT_BIG_ENDIAN
-        u32Sum += (uint32_t)*(uint8_t *)pw << 8;
+        u32Sum += (uint32_t)pbSrc[cbWords] << 8;
 #else
-        u32Sum += *(uint8_t *)pw;
+        u32Sum += pbSrc[cbWords];
 #endif
         *pfOdd = true;
     }
@@ -338,6 +462,23 @@ DECLINLINE(uint32_t) rtNetIPv4AddDataChecksum(void const *pvData, size_t cbData,
     return u32Sum;
 }
 
+
+/**
+ * Adds the checksum of the specified data segment to the intermediate checksum value [inlined].
+ *
+ * @returns 32-bit intermediary checksum value.
+ * @param   pvData          Pointer to the data that should be checksummed.
+ * @param   cbData          The number of bytes to checksum.
+ * @param   u32Sum          The 32-bit intermediate checksum value.
+ * @param   pfOdd           This is used to keep track of odd bits, initialize to false
+ *                          when starting to checksum the data (aka text) after a TCP
+ *                          or UDP header (data never start at an odd offset).
+ */
+DECLINLINE(uint32_t) rtNetIPv4AddDataChecksum(void const *pvData, size_t cbData, uint32_t u32Sum, bool *pfOdd)
+{
+    return rtNetIPv4AddDataChecksumEx(NULL, pvData, cbData, u32Sum, pfOdd, false /*fCopy*/);
+}
+
 /**
  * Adds the checksum of the specified data segment to the intermediate checksum value.
  *
@@ -356,6 +497,27 @@ RTDECL(uint32_t) RTNetIPv4AddDataChecksum(void const *pvData, size_t cbData, uin
 RT_EXPORT_SYMBOL(RTNetIPv4AddDataChecksum);
 
 
+/**
+ * Copies a data segment and adds its checksum to the intermediate checksum
+ * value, all in one pass over the data.
+ *
+ * @returns 32-bit intermediary checksum value.
+ * @param   pvDst           Where to copy the data to.  Must not overlap with
+ *                          @a pvSrc.
+ * @param   pvSrc           The data bits to copy and checksum.
+ * @param   cbData          The number of bytes to copy and checksum.
+ * @param   u32Sum          The 32-bit intermediate checksum value.
+ * @param   pfOdd           This is used to keep track of odd bits, initialize to false
+ *                          when starting to checksum the data (aka text) after a TCP
+ *                          or UDP header (data never start at an odd offset).
+ */
+RTDECL(uint32_t) RTNetIPv4AddDataChecksumAndCopy(void *pvDst, void const *pvSrc, size_t cbData, uint32_t u32Sum, bool *pfOdd)
+{
+    return rtNetIPv4AddDataChecksumEx(pvDst, pvSrc, cbData, u32Sum, pfOdd, true /*fCopy*/);
+}
+RT_EXPORT_SYMBOL(RTNetIPv4AddDataChecksumAndCopy);
+
+
 /**
  * Finalizes a IPv4 checksum [inlined].
  *
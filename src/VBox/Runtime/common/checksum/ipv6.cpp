@@ -41,26 +41,22 @@
 DECLINLINE(uint32_t) rtNetIPv6PseudoChecksumBits(PCRTNETADDRIPV6 pSrcAddr, PCRTNETADDRIPV6 pDstAddr,
                                                  uint8_t bProtocol, uint32_t cbPkt)
 {
-    uint32_t u32Sum = pSrcAddr->au16[0]
-                    + pSrcAddr->au16[1]
-                    + pSrcAddr->au16[2]
-                    + pSrcAddr->au16[3]
-                    + pSrcAddr->au16[4]
-                    + pSrcAddr->au16[5]
-                    + pSrcAddr->au16[6]
-                    + pSrcAddr->au16[7]
-                    + pDstAddr->au16[0]
-                    + pDstAddr->au16[1]
-                    + pDstAddr->au16[2]
-                    + pDstAddr->au16[3]
-                    + pDstAddr->au16[4]
-                    + pDstAddr->au16[5]
-                    + pDstAddr->au16[6]
-                    + pDstAddr->au16[7]
-                    + RT_H2BE_U16(RT_HIWORD(cbPkt))
-                    + RT_H2BE_U16(RT_LOWORD(cbPkt))
-                    + 0
-                    + RT_H2BE_U16(RT_MAKE_U16(0, bProtocol));
+    /* Add the addresses up as dwords, see rtNetIPv4SumWords. */
+    uint64_t u64Sum = (uint64_t)pSrcAddr->au32[0]
+                    + pSrcAddr->au32[1]
+                    + pSrcAddr->au32[2]
+                    + pSrcAddr->au32[3]
+                    + pDstAddr->au32[0]
+                    + pDstAddr->au32[1]
+                    + pDstAddr->au32[2]
+                    + pDstAddr->au32[3];
+    u64Sum = (u64Sum >> 32) + (u64Sum & UINT32_MAX);
+    uint32_t u32Sum = (uint32_t)(u64Sum >> 32) + (uint32_t)u64Sum;
+    u32Sum = (u32Sum >> 16) + (u32Sum & 0xffff);
+    u32Sum += RT_H2BE_U16(RT_HIWORD(cbPkt))
+            + RT_H2BE_U16(RT_LOWORD(cbPkt))
+            + 0
+            + RT_H2BE_U16(RT_MAKE_U16(0, bProtocol));
     return u32Sum;
 }
 
@@ -0,0 +1,204 @@
+/* $Id$ */
+/** @file
+ * IPRT Testcase - Internet checksum (RTNetIPv4AddDataChecksum & friends).
+ */
+
+/*
+ * Copyright (C) 2011 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <iprt/net.h>
+
+#include <iprt/err.h>
+#include <iprt/mem.h>
+#include <iprt/rand.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/time.h>
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The size of the test buffers (64KB GSO frame + slack for misaligning). */
+#define TST_BUF_SIZE    (_64K + 64)
+
+static uint8_t *g_pbSrc;
+static uint8_t *g_pbDst;
+
+
+/**
+ * The obvious implementation, one 16-bit word at a time.
+ */
+static uint16_t tstRefChecksum(uint8_t const *pb, size_t cb)
+{
+    uint32_t u32Sum = 0;
+    for (size_t off = 0; off + 1 < cb; off += 2)
+        u32Sum += *(uint16_t const *)&pb[off];
+    if (cb & 1)
+    {
+#ifdef RT_BIG_ENDIAN
+        u32Sum += (uint32_t)pb[cb - 1] << 8;
+#else
+        u32Sum += pb[cb - 1];
+#endif
+    }
+    while (u32Sum >> 16)
+        u32Sum = (u32Sum >> 16) + (u32Sum & 0xffff);
+    return (uint16_t)~u32Sum;
+}
+
+
+/**
+ * Checks the results against tstRefChecksum for all sorts of sizes,
+ * alignments and splits.
+ */
+static void tst1(void)
+{
+    RTTestISub("Correctness");
+
+    for (uint32_t i = 0; i < 4096; i++)
+    {
+        size_t const offSrc = RTRandU32Ex(0, 31);
+        size_t const offDst = RTRandU32Ex(0, 31);
+        size_t const cb     = i < 512 ? i : RTRandU32Ex(0, _64K);
+        size_t const cb1    = cb ? RTRandU32Ex(0, (uint32_t)cb) : 0;
+        uint16_t const u16Ref = tstRefChecksum(&g_pbSrc[offSrc], cb);
+
+        /* in one go */
+        bool fOdd = false;
+        uint16_t u16Sum = RTNetIPv4FinalizeChecksum(RTNetIPv4AddDataChecksum(&g_pbSrc[offSrc], cb, 0, &fOdd));
+        if (u16Sum != u16Ref)
+            RTTestIFailed("cb=%zu off=%zu: %#06x, expected %#06x\n", cb, offSrc, u16Sum, u16Ref);
+
+        /* in two chunks, the split may leave an odd byte behind */
+        fOdd = false;
+        uint32_t u32Sum = RTNetIPv4AddDataChecksum(&g_pbSrc[offSrc], cb1, 0, &fOdd);
+        u32Sum = RTNetIPv4AddDataChecksum(&g_pbSrc[offSrc + cb1], cb - cb1, u32Sum, &fOdd);
+        u16Sum = RTNetIPv4FinalizeChecksum(u32Sum);
+        if (u16Sum != u16Ref)
+            RTTestIFailed("cb=%zu+%zu off=%zu: %#06x, expected %#06x\n", cb1, cb - cb1, offSrc, u16Sum, u16Ref);
+
+        /* copying, also in two chunks */
+        memset(g_pbDst, 0xcc, TST_BUF_SIZE);
+        fOdd = false;
+        u32Sum = RTNetIPv4AddDataChecksumAndCopy(&g_pbDst[offDst], &g_pbSrc[offSrc], cb1, 0, &fOdd);
+        u32Sum = RTNetIPv4AddDataChecksumAndCopy(&g_pbDst[offDst + cb1], &g_pbSrc[offSrc + cb1], cb - cb1, u32Sum, &fOdd);
+        u16Sum = RTNetIPv4FinalizeChecksum(u32Sum);
+        if (u16Sum != u16Ref)
+            RTTestIFailed("copy cb=%zu+%zu off=%zu/%zu: %#06x, expected %#06x\n", cb1, cb - cb1, offSrc, offDst, u16Sum, u16Ref);
+        if (memcmp(&g_pbDst[offDst], &g_pbSrc[offSrc], cb))
+            RTTestIFailed("copy cb=%zu off=%zu/%zu: data mismatch\n", cb, offSrc, offDst);
+        if (   (offDst && g_pbDst[offDst - 1] != 0xcc)
+            || g_pbDst[offDst + cb] != 0xcc)
+            RTTestIFailed("copy cb=%zu off=%zu/%zu: wrote outside the buffer\n", cb, offSrc, offDst);
+
+        if (RTTestIErrorCount() > 16)
+            break;
+    }
+}
+
+
+/**
+ * Measures the throughput for typical frame sizes.
+ */
+static void tst2(void)
+{
+    RTTestISub("Throughput");
+
+    static size_t const s_acbFrames[] = { 64, 576, 1514, 9014, _64K };
+    for (unsigned i = 0; i < RT_ELEMENTS(s_acbFrames); i++)
+    {
+        size_t const   cb      = s_acbFrames[i];
+        uint32_t const cRounds = (uint32_t)(_1G / cb);
+        uint32_t       u32Sum  = 0;
+
+        uint64_t u64Start = RTTimeNanoTS();
+        for (uint32_t iRound = 0; iRound < cRounds; iRound++)
+        {
+            bool fOdd = false;
+            u32Sum += RTNetIPv4AddDataChecksum(g_pbSrc, cb, 0, &fOdd);
+        }
+        uint64_t cNsElapsed = RT_MAX(RTTimeNanoTS() - u64Start, 1);
+        RTTestIValueF((uint64_t)cRounds * cb * 1000 / cNsElapsed, RTTESTUNIT_MEGABYTES_PER_SEC,
+                      "Checksum %zu bytes", cb);
+
+        u64Start = RTTimeNanoTS();
+        for (uint32_t iRound = 0; iRound < cRounds; iRound++)
+        {
+            bool fOdd = false;
+            u32Sum += RTNetIPv4AddDataChecksumAndCopy(g_pbDst, g_pbSrc, cb, 0, &fOdd);
+        }
+        cNsElapsed = RT_MAX(RTTimeNanoTS() - u64Start, 1);
+        RTTestIValueF((uint64_t)cRounds * cb * 1000 / cNsElapsed, RTTESTUNIT_MEGABYTES_PER_SEC,
+                      "Copy + checksum %zu bytes", cb);
+
+        /* For comparison. */
+        u64Start = RTTimeNanoTS();
+        for (uint32_t iRound = 0; iRound < cRounds; iRound++)
+            u32Sum += tstRefChecksum(g_pbSrc, cb);
+        cNsElapsed = RT_MAX(RTTimeNanoTS() - u64Start, 1);
+        RTTestIValueF((uint64_t)cRounds * cb * 1000 / cNsElapsed, RTTESTUNIT_MEGABYTES_PER_SEC,
+                      "Checksum 16-bit words %zu bytes", cb);
+
+        u64Start = RTTimeNanoTS();
+        for (uint32_t iRound = 0; iRound < cRounds; iRound++)
+        {
+            memcpy(g_pbDst, g_pbSrc, cb);
+            u32Sum += g_pbDst[iRound % cb];
+        }
+        cNsElapsed = RT_MAX(RTTimeNanoTS() - u64Start, 1);
+        RTTestIValueF((uint64_t)cRounds * cb * 1000 / cNsElapsed, RTTESTUNIT_MEGABYTES_PER_SEC,
+                      "memcpy %zu bytes", cb);
+
+        /* Keep the compiler from optimizing the loops away. */
+        g_pbDst[0] = (uint8_t)u32Sum;
+    }
+}
+
+
+int main()
+{
+    RTTEST hTest;
+    int rc = RTTestInitAndCreate("tstRTNetChecksum", &hTest);
+    if (rc)
+        return rc;
+    RTTestBanner(hTest);
+
+    g_pbSrc = (uint8_t *)RTTestGuardedAllocTail(hTest, TST_BUF_SIZE);
+    g_pbDst = (uint8_t *)RTTestGuardedAllocTail(hTest, TST_BUF_SIZE);
+    if (!g_pbSrc || !g_pbDst)
+        return RTTestSummaryAndDestroy(hTest);
+    RTRandBytes(g_pbSrc, TST_BUF_SIZE);
+
+    tst1();
+    if (RTTestIErrorCount() == 0)
+        tst2();
+
+    /*
+     * Summary.
+     */
+    return RTTestSummaryAndDestroy(hTest);
+}
+
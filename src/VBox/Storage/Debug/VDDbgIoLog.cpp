@@ -28,6 +28,7 @@
 #include <iprt/file.h>
 #include <iprt/string.h>
 #include <iprt/semaphore.h>
+#include <iprt/time.h>
 
 /*******************************************************************************
 *   Structures in a I/O log file, little endian                                *
@@ -50,6 +51,12 @@ typedef struct IoLogHeader
 
 #define VDIOLOG_MAGIC "VDIOLOG"
 
+/** Header flag - every start entry is followed by an IoLogEntryTimestamp.
+ * Set for all logs created by this version of the logger, older logs
+ * don't have any timestamps. Shares the flags field with the public
+ * VDDBG_IOLOG_* flags. */
+#define VDIOLOG_HDR_F_TIMESTAMPS RT_BIT_32(31)
+
 /** Event type - I/O request start. */
 #define VDIOLOG_EVENT_START    0x01
 /** Event type - I/O request complete. */
@@ -109,6 +116,17 @@ typedef struct IoLogEntryComplete
 } IoLogEntryComplete;
 #pragma pack()
 
+/**
+ * Timestamp following a start entry if VDIOLOG_HDR_F_TIMESTAMPS is set.
+ */
+#pragma pack(1)
+typedef struct IoLogEntryTimestamp
+{
+    /** Nanoseconds since the log was created. */
+    uint64_t    u64TsStart;
+} IoLogEntryTimestamp;
+#pragma pack()
+
 #pragma pack(1)
 typedef struct IoLogEntryDiscard
 {
@@ -146,6 +164,10 @@ typedef struct VDIOLOGGERINT
     uint32_t       u32EventTypeNext;
     /** Cached request type of the next request. */
     VDDBGIOLOGREQ  enmReqTypeNext;
+    /** Timestamp (RTTimeNanoTS) when the log was created or opened. */
+    uint64_t       tsCreate;
+    /** Timestamp of the last start event read, relative to log creation. */
+    uint64_t       u64TsStartLast;
 } VDIOLOGGERINT;
 /** Pointer to the internal I/O logger instance data. */
 typedef VDIOLOGGERINT *PVDIOLOGGERINT;
@@ -256,6 +278,128 @@ static int vddbgIoLogWriteSgBuf(PVDIOLOGGERINT pIoLogger, uint64_t off, PCRTSGBU
     return rc;
 }
 
+/**
+ * Returns the size of a start entry in the log, including the optional timestamp.
+ *
+ * @returns Size of the start entry in bytes.
+ * @param   pIoLogger    The I/O logger to use.
+ */
+DECLINLINE(size_t) vddbgIoLogStartEntrySize(PVDIOLOGGERINT pIoLogger)
+{
+    return   sizeof(IoLogEntryStart)
+           + (pIoLogger->fFlags & VDIOLOG_HDR_F_TIMESTAMPS ? sizeof(IoLogEntryTimestamp) : 0);
+}
+
+/**
+ * Writes the start entry together with the optional timestamp into the log.
+ *
+ * @returns VBox status code.
+ * @param   pIoLogger    The I/O logger to use.
+ * @param   pEntry       The start entry to write.
+ */
+static int vddbgIoLogStartEntryWrite(PVDIOLOGGERINT pIoLogger, IoLogEntryStart *pEntry)
+{
+    int rc = RTFileWriteAt(pIoLogger->hFile, pIoLogger->offWriteNext, pEntry, sizeof(*pEntry), NULL);
+    if (   RT_SUCCESS(rc)
+        && (pIoLogger->fFlags & VDIOLOG_HDR_F_TIMESTAMPS))
+    {
+        IoLogEntryTimestamp Ts;
+
+        Ts.u64TsStart = RT_H2LE_U64(RTTimeNanoTS() - pIoLogger->tsCreate);
+        rc = RTFileWriteAt(pIoLogger->hFile, pIoLogger->offWriteNext + sizeof(*pEntry), &Ts, sizeof(Ts), NULL);
+    }
+
+    return rc;
+}
+
+/**
+ * Reads the start entry together with the optional timestamp from the log.
+ *
+ * @returns VBox status code.
+ * @param   pIoLogger    The I/O logger to use.
+ * @param   pEntry       Where to store the start entry.
+ */
+static int vddbgIoLogStartEntryRead(PVDIOLOGGERINT pIoLogger, IoLogEntryStart *pEntry)
+{
+    int rc = RTFileReadAt(pIoLogger->hFile, pIoLogger->offReadNext, pEntry, sizeof(*pEntry), NULL);
+    if (RT_SUCCESS(rc))
+    {
+        if (pIoLogger->fFlags & VDIOLOG_HDR_F_TIMESTAMPS)
+        {
+            IoLogEntryTimestamp Ts;
+
+            rc = RTFileReadAt(pIoLogger->hFile, pIoLogger->offReadNext + sizeof(*pEntry), &Ts, sizeof(Ts), NULL);
+            if (RT_SUCCESS(rc))
+                pIoLogger->u64TsStartLast = RT_LE2H_U64(Ts.u64TsStart);
+        }
+        else
+            pIoLogger->u64TsStartLast = 0;
+    }
+
+    return rc;
+}
+
+/**
+ * Walks all entries of an opened log and returns the latest start timestamp,
+ * so that entries appended to the log continue the time line of the log
+ * instead of starting over at zero.
+ *
+ * @returns VBox status code.
+ * @param   pIoLogger    The I/O logger to use.
+ * @param   pu64TsLast   Where to store the latest start timestamp.
+ */
+static int vddbgIoLogScanLastTimestamp(PVDIOLOGGERINT pIoLogger, uint64_t *pu64TsLast)
+{
+    int rc = VINF_SUCCESS;
+    uint64_t off = sizeof(IoLogHeader);
+    uint64_t u64TsLast = 0;
+
+    while (   RT_SUCCESS(rc)
+           && off < pIoLogger->offWriteNext)
+    {
+        uint32_t u32Type;
+
+        rc = RTFileReadAt(pIoLogger->hFile, off, &u32Type, sizeof(u32Type), NULL);
+        if (RT_FAILURE(rc))
+            break;
+
+        if (u32Type == VDIOLOG_EVENT_START)
+        {
+            IoLogEntryStart Entry;
+            IoLogEntryTimestamp Ts;
+
+            rc = RTFileReadAt(pIoLogger->hFile, off, &Entry, sizeof(Entry), NULL);
+            if (RT_SUCCESS(rc))
+                rc = RTFileReadAt(pIoLogger->hFile, off + sizeof(Entry), &Ts, sizeof(Ts), NULL);
+            if (RT_FAILURE(rc))
+                break;
+
+            u64TsLast = RT_MAX(u64TsLast, RT_LE2H_U64(Ts.u64TsStart));
+            off += sizeof(Entry) + sizeof(Ts);
+            if (RT_LE2H_U32(Entry.u32ReqType) == VDDBGIOLOGREQ_DISCARD)
+                off += RT_LE2H_U32(Entry.Discard.cRanges) * sizeof(IoLogEntryDiscard);
+            else if (   RT_LE2H_U32(Entry.u32ReqType) == VDDBGIOLOGREQ_WRITE
+                     && (pIoLogger->fFlags & VDDBG_IOLOG_LOG_DATA_WRITTEN))
+                off += RT_LE2H_U64(Entry.Io.u64IoSize);
+        }
+        else if (u32Type == VDIOLOG_EVENT_COMPLETE)
+        {
+            IoLogEntryComplete Entry;
+
+            rc = RTFileReadAt(pIoLogger->hFile, off, &Entry, sizeof(Entry), NULL);
+            if (RT_FAILURE(rc))
+                break;
+            off += sizeof(Entry) + RT_LE2H_U64(Entry.u64IoBuffer);
+        }
+        else
+            rc = VERR_INVALID_PARAMETER;
+    }
+
+    if (RT_SUCCESS(rc))
+        *pu64TsLast = u64TsLast;
+    return rc;
+}
+
 VBOXDDU_DECL(int) VDDbgIoLogCreate(PVDIOLOGGER phIoLogger, const char *pszFilename, uint32_t fFlags)
 {
     int rc = VINF_SUCCESS;
@@ -268,8 +412,9 @@ VBOXDDU_DECL(int) VDDbgIoLogCreate(PVDIOLOGGER phIoLogger, const char *pszFilena
     rc = vddbgIoLoggerCreate(&pIoLogger);
     if (RT_SUCCESS(rc))
     {
-        pIoLogger->fFlags = fFlags;
-        pIoLogger->hFile = NIL_RTFILE;
+        pIoLogger->fFlags   = fFlags | VDIOLOG_HDR_F_TIMESTAMPS;
+        pIoLogger->hFile    = NIL_RTFILE;
+        pIoLogger->tsCreate = RTTimeNanoTS();
 
         /* Create new log. */
         rc = RTFileOpen(&pIoLogger->hFile, pszFilename, RTFILE_O_DENY_NONE | RTFILE_O_CREATE | RTFILE_O_WRITE | RTFILE_O_READ);
@@ -323,11 +468,21 @@ VBOXDDU_DECL(int) VDDbgIoLogOpen(PVDIOLOGGER phIoLogger, const char *pszFilename
             if (   RT_SUCCESS(rc)
                 && !memcmp(Hdr.szMagic, VDIOLOG_MAGIC, sizeof(Hdr.szMagic)))
             {
+                uint64_t u64TsLast = 0;
+
                 pIoLogger->fFlags = RT_LE2H_U32(Hdr.fFlags);
                 pIoLogger->offWriteNext = cbLog;
                 pIoLogger->offReadNext  = sizeof(Hdr);
                 pIoLogger->idNext       = RT_LE2H_U64(Hdr.u64Id);
-                *phIoLogger = pIoLogger;
+
+                /* Continue the time line of the log for appended entries. */
+                if (pIoLogger->fFlags & VDIOLOG_HDR_F_TIMESTAMPS)
+                    rc = vddbgIoLogScanLastTimestamp(pIoLogger, &u64TsLast);
+                if (RT_SUCCESS(rc))
+                {
+                    pIoLogger->tsCreate = RTTimeNanoTS() - u64TsLast;
+                    *phIoLogger = pIoLogger;
+                }
             }
             else if (RT_SUCCESS(rc))
                 rc = VERR_INVALID_PARAMETER;
@@ -371,7 +526,16 @@ VBOXDDU_DECL(uint32_t) VDDbgIoLogGetFlags(VDIOLOGGER hIoLogger)
 
     AssertPtrReturn(pIoLogger, VERR_INVALID_HANDLE);
 
-    return pIoLogger->fFlags;
+    return pIoLogger->fFlags & ~VDIOLOG_HDR_F_TIMESTAMPS;
+}
+
+VBOXDDU_DECL(bool) VDDbgIoLogHasTimestamps(VDIOLOGGER hIoLogger)
+{
+    PVDIOLOGGERINT pIoLogger = hIoLogger;
+
+    AssertPtrReturn(pIoLogger, false);
+
+    return RT_BOOL(pIoLogger->fFlags & VDIOLOG_HDR_F_TIMESTAMPS);
 }
 
 VBOXDDU_DECL(int) VDDbgIoLogStart(VDIOLOGGER hIoLogger, bool fAsync, VDDBGIOLOGREQ enmTxDir, uint64_t off, size_t cbIo, PCRTSGBUF pSgBuf,
@@ -403,10 +567,10 @@ VBOXDDU_DECL(int) VDDbgIoLogStart(VDIOLOGGER hIoLogger, bool fAsync, VDDBGIOLOGR
         Entry.Io.u64IoSize = RT_H2LE_U64(cbIo);
 
         /* Write new entry. */
-        rc = RTFileWriteAt(pIoLogger->hFile, pIoLogger->offWriteNext, &Entry, sizeof(Entry), NULL);
+        rc = vddbgIoLogStartEntryWrite(pIoLogger, &Entry);
         if (RT_SUCCESS(rc))
         {
-            pIoLogger->offWriteNext += sizeof(Entry);
+            pIoLogger->offWriteNext += vddbgIoLogStartEntrySize(pIoLogger);
 
             if (   enmTxDir == VDDBGIOLOGREQ_WRITE
                 && (pIoLogger->fFlags & VDDBG_IOLOG_LOG_DATA_WRITTEN))
@@ -415,7 +579,7 @@ VBOXDDU_DECL(int) VDDbgIoLogStart(VDIOLOGGER hIoLogger, bool fAsync, VDDBGIOLOGR
                 rc = vddbgIoLogWriteSgBuf(pIoLogger, pIoLogger->offWriteNext, pSgBuf, cbIo);
                 if (RT_FAILURE(rc))
                 {
-                    pIoLogger->offWriteNext -= sizeof(Entry);
+                    pIoLogger->offWriteNext -= vddbgIoLogStartEntrySize(pIoLogger);
                     rc = RTFileSetSize(pIoLogger->hFile, pIoLogger->offWriteNext);
                 }
                 else
@@ -475,10 +639,10 @@ VBOXDDU_DECL(int) VDDbgIoLogStartDiscard(VDIOLOGGER hIoLogger, bool fAsync, PVDR
         Entry.Discard.cRanges = RT_H2LE_U32(cRanges);
 
         /* Write new entry. */
-        rc = RTFileWriteAt(pIoLogger->hFile, pIoLogger->offWriteNext, &Entry, sizeof(Entry), NULL);
+        rc = vddbgIoLogStartEntryWrite(pIoLogger, &Entry);
         if (RT_SUCCESS(rc))
         {
-            pIoLogger->offWriteNext += sizeof(Entry);
+            pIoLogger->offWriteNext += vddbgIoLogStartEntrySize(pIoLogger);
 
             IoLogEntryDiscard DiscardRange;
 
@@ -494,7 +658,7 @@ VBOXDDU_DECL(int) VDDbgIoLogStartDiscard(VDIOLOGGER hIoLogger, bool fAsync, PVDR
 
             if (RT_FAILURE(rc))
             {
-                pIoLogger->offWriteNext -= sizeof(Entry);
+                pIoLogger->offWriteNext -= vddbgIoLogStartEntrySize(pIoLogger);
                 rc = RTFileSetSize(pIoLogger->hFile, pIoLogger->offWriteNext);
             }
             else
@@ -661,7 +825,8 @@ VBOXDDU_DECL(int) VDDbgIoLogEventGetStart(VDIOLOGGER hIoLogger, uint64_t *pidEve
     if (pIoLogger->u32EventTypeNext == VDIOLOG_EVENT_START)
     {
         IoLogEntryStart Entry;
-        rc = RTFileReadAt(pIoLogger->hFile, pIoLogger->offReadNext, &Entry, sizeof(Entry), NULL);
+        size_t cbEntry = vddbgIoLogStartEntrySize(pIoLogger);
+        rc = vddbgIoLogStartEntryRead(pIoLogger, &Entry);
         if (RT_SUCCESS(rc))
         {
             *pfAsync   = (bool)Entry.u8AsyncIo;
@@ -676,13 +841,13 @@ VBOXDDU_DECL(int) VDDbgIoLogEventGetStart(VDIOLOGGER hIoLogger, uint64_t *pidEve
                 if (cbBuf < *pcbIo)
                     rc = VERR_BUFFER_OVERFLOW;
                 else
-                    rc = RTFileReadAt(pIoLogger->hFile, pIoLogger->offReadNext + sizeof(Entry), pvBuf, *pcbIo, NULL);
+                    rc = RTFileReadAt(pIoLogger->hFile, pIoLogger->offReadNext + cbEntry, pvBuf, *pcbIo, NULL);
 
                 if (rc != VERR_BUFFER_OVERFLOW)
-                    pIoLogger->offReadNext += *pcbIo + sizeof(Entry);
+                    pIoLogger->offReadNext += *pcbIo + cbEntry;
             }
             else
-                pIoLogger->offReadNext += sizeof(Entry);
+                pIoLogger->offReadNext += cbEntry;
         }
     }
     else
@@ -712,13 +877,14 @@ VBOXDDU_DECL(int) VDDbgIoLogEventGetStartDiscard(VDIOLOGGER hIoLogger, uint64_t
         && pIoLogger->enmReqTypeNext == VDDBGIOLOGREQ_DISCARD)
     {
         IoLogEntryStart Entry;
-        rc = RTFileReadAt(pIoLogger->hFile, pIoLogger->offReadNext, &Entry, sizeof(Entry), NULL);
+        size_t cbEntry = vddbgIoLogStartEntrySize(pIoLogger);
+        rc = vddbgIoLogStartEntryRead(pIoLogger, &Entry);
         if (RT_SUCCESS(rc))
         {
             PVDRANGE paRanges = NULL;
             IoLogEntryDiscard DiscardRange;
 
-            pIoLogger->offReadNext += sizeof(Entry);
+            pIoLogger->offReadNext += cbEntry;
             *pfAsync   = (bool)Entry.u8AsyncIo;
             *pidEvent  = RT_LE2H_U64(Entry.u64Id);
             *pcRanges  = RT_LE2H_U32(Entry.Discard.cRanges);
@@ -743,7 +909,7 @@ VBOXDDU_DECL(int) VDDbgIoLogEventGetStartDiscard(VDIOLOGGER hIoLogger, uint64_t
                     *ppaRanges = paRanges;
                 }
                 else
-                    pIoLogger->offReadNext -= sizeof(Entry);
+                    pIoLogger->offReadNext -= cbEntry;
             }
             else
                 rc = VERR_NO_MEMORY;
@@ -810,3 +976,22 @@ VBOXDDU_DECL(int) VDDbgIoLogEventGetComplete(VDIOLOGGER hIoLogger, uint64_t *pid
     return rc;
 }
 
+VBOXDDU_DECL(int) VDDbgIoLogEventGetStartTimestamp(VDIOLOGGER hIoLogger, uint64_t *pu64TsStart)
+{
+    int rc = VINF_SUCCESS;
+    PVDIOLOGGERINT pIoLogger = hIoLogger;
+
+    AssertPtrReturn(pIoLogger, VERR_INVALID_HANDLE);
+    AssertPtrReturn(pu64TsStart, VERR_INVALID_POINTER);
+
+    rc = RTSemFastMutexRequest(pIoLogger->hMtx);
+    AssertRCReturn(rc, rc);
+
+    if (pIoLogger->fFlags & VDIOLOG_HDR_F_TIMESTAMPS)
+        *pu64TsStart = pIoLogger->u64TsStartLast;
+    else
+        rc = VERR_NOT_SUPPORTED;
+
+    RTSemFastMutexRelease(pIoLogger->hMtx);
+    return rc;
+}
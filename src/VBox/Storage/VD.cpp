@@ -39,6 +39,7 @@
 #include <iprt/critsect.h>
 #include <iprt/list.h>
 #include <iprt/avl.h>
+#include <iprt/sort.h>
 
 #include <VBox/vd-plugin.h>
 #include <VBox/vd-cache-plugin.h>
@@ -1232,6 +1233,59 @@ static int vdDiscardRange(PVBOXHDD pDisk, PVDDISCARDSTATE pDiscard, uint64_t off
     return rc;
 }
 
+/**
+ * @callback_method_impl{FNRTSORTCMP, Sorts discard ranges by start offset.}
+ */
+static DECLCALLBACK(int) vdDiscardRangeCmp(void const *pvElement1, void const *pvElement2, void *pvUser)
+{
+    PCVDRANGE pRange1 = (PCVDRANGE)pvElement1;
+    PCVDRANGE pRange2 = (PCVDRANGE)pvElement2;
+    NOREF(pvUser);
+
+    if (pRange1->offStart < pRange2->offStart)
+        return -1;
+    if (pRange1->offStart > pRange2->offStart)
+        return 1;
+    return 0;
+}
+
+/**
+ * Sorts the given ranges and merges overlapping and adjacent ones so the
+ * blocks are processed in one go instead of once per range.
+ *
+ * @returns Number of ranges after merging.
+ * @param   paRanges The array of ranges to merge, modified.
+ * @param   cRanges  The number of ranges in the array.
+ */
+static unsigned vdDiscardRangesMerge(PVDRANGE paRanges, unsigned cRanges)
+{
+    unsigned iRangeLast = 0;
+
+    RTSortShell(paRanges, cRanges, sizeof(VDRANGE), vdDiscardRangeCmp, NULL);
+
+    for (unsigned i = 1; i < cRanges; i++)
+    {
+        PVDRANGE pLast   = &paRanges[iRangeLast];
+        uint64_t offEnd  = pLast->offStart + pLast->cbRange;
+
+        if (paRanges[i].offStart <= offEnd)
+        {
+            uint64_t offEndNew = RT_MAX(offEnd, paRanges[i].offStart + paRanges[i].cbRange);
+
+            /* Don't let the size overflow on 32bit hosts. */
+            if (offEndNew - pLast->offStart <= ~(size_t)0 / 2)
+            {
+                pLast->cbRange = (size_t)(offEndNew - pLast->offStart);
+                continue;
+            }
+        }
+
+        paRanges[++iRangeLast] = paRanges[i];
+    }
+
+    return cRanges ? iRangeLast + 1 : 0;
+}
+
 /**
  * Discard helper.
  *
@@ -1244,6 +1298,7 @@ static int vdDiscardHelper(PVBOXHDD pDisk, PCVDRANGE paRanges, unsigned cRanges)
 {
     int rc = VINF_SUCCESS;
     PVDDISCARDSTATE pDiscard = pDisk->pDiscard;
+    PVDRANGE paRangesMerged = NULL;
 
     if (RT_UNLIKELY(!pDiscard))
     {
@@ -1254,6 +1309,21 @@ static int vdDiscardHelper(PVBOXHDD pDisk, PCVDRANGE paRanges, unsigned cRanges)
         pDisk->pDiscard = pDiscard;
     }
 
+    /*
+     * Guests tend to send many small ranges (one per free extent), merge them
+     * first. Not being able to allocate the copy is not fatal.
+     */
+    if (cRanges > 1)
+    {
+        paRangesMerged = (PVDRANGE)RTMemAlloc(cRanges * sizeof(VDRANGE));
+        if (paRangesMerged)
+        {
+            memcpy(paRangesMerged, paRanges, cRanges * sizeof(VDRANGE));
+            cRanges  = vdDiscardRangesMerge(paRangesMerged, cRanges);
+            paRanges = paRangesMerged;
+        }
+    }
+
     /* Go over the range array and discard individual blocks. */
     for (unsigned i = 0; i < cRanges; i++)
     {
@@ -1262,6 +1332,9 @@ static int vdDiscardHelper(PVBOXHDD pDisk, PCVDRANGE paRanges, unsigned cRanges)
             break;
     }
 
+    if (paRangesMerged)
+        RTMemFree(paRangesMerged);
+
     return rc;
 }
 
@@ -32,6 +32,8 @@
 #include <iprt/thread.h>
 #include <iprt/rand.h>
 #include <iprt/critsect.h>
+#include <iprt/sort.h>
+#include <iprt/time.h>
 
 #include "VDMemDisk.h"
 #include "VDIoBackendMem.h"
@@ -84,6 +86,8 @@ typedef struct VDDISK
     VDGEOMETRY     PhysGeom;
     /** Logical CHS geometry. */
     VDGEOMETRY     LogicalGeom;
+    /** I/O logger recording the requests of the io action, NULL if not recording. */
+    VDIOLOGGER     hIoLogger;
 } VDDISK, *PVDDISK;
 
 /**
@@ -159,6 +163,8 @@ typedef struct VDIOREQ
     void          *pvBufRead;
     /** Opaque user data. */
     void          *pvUser;
+    /** I/O log entry if the disk records the requests. */
+    VDIOLOGENT     hIoLogEnt;
 } VDIOREQ, *PVDIOREQ;
 
 /**
@@ -200,6 +206,76 @@ typedef struct VDIOTEST
     } u;
 } VDIOTEST, *PVDIOTEST;
 
+/**
+ * Request replayed from an I/O log.
+ */
+typedef struct VDIOLOGREPLAYREQ
+{
+    /** List node for the list of requests still outstanding in the log. */
+    RTLISTNODE      NodeReq;
+    /** Id of the start event in the log. */
+    uint64_t        idEvent;
+    /** Request type. */
+    VDDBGIOLOGREQ   enmReq;
+    /** Start offset. */
+    uint64_t        off;
+    /** Size of the transfer. */
+    size_t          cbIo;
+    /** Range array for discard requests. */
+    PVDRANGE        paRanges;
+    /** Number of ranges in the array. */
+    unsigned        cRanges;
+    /** Data buffer for reads and writes. */
+    void           *pvBuf;
+    /** Data segment. */
+    RTSGSEG         DataSeg;
+    /** S/G buffer. */
+    RTSGBUF         SgBuf;
+    /** Timestamp when the request was submitted. */
+    uint64_t        tsSubmit;
+    /** Latency of the request in nanoseconds, valid after completion. */
+    uint64_t        cNsLatency;
+    /** Status code the request completed with. */
+    int             rcReq;
+    /** Flag whether the replayed request completed. */
+    volatile bool   fCompleted;
+    /** Pointer to the replay state, for the completion callback. */
+    struct VDIOLOGREPLAY *pReplay;
+} VDIOLOGREPLAYREQ, *PVDIOLOGREPLAYREQ;
+
+/**
+ * I/O log replay state.
+ */
+typedef struct VDIOLOGREPLAY
+{
+    /** The disk to replay the log on. */
+    PVDDISK         pDisk;
+    /** Flag whether to use the async I/O interface. */
+    bool            fAsync;
+    /** Event semaphore signalled on request completion. */
+    RTSEMEVENT      hEvtComplete;
+    /** Requests started in the log which didn't see their complete event yet. */
+    RTLISTNODE      ListReqs;
+    /** Number of replayed requests currently in flight. */
+    volatile uint32_t cReqsInFlight;
+    /** Maximum number of replayed requests in flight. */
+    uint32_t        cReqsInFlightMax;
+    /** Number of requests replayed per request type. */
+    uint64_t        acReqs[VDDBGIOLOGREQ_DISCARD + 1];
+    /** Number of failed requests. */
+    uint64_t        cReqsFailed;
+    /** Number of bytes read. */
+    uint64_t        cbRead;
+    /** Number of bytes written. */
+    uint64_t        cbWritten;
+    /** Latencies of all completed requests in nanoseconds. */
+    uint64_t       *pacNsLatency;
+    /** Number of entries in the latency array. */
+    size_t          cLatencies;
+    /** Number of entries the latency array can hold. */
+    size_t          cLatenciesMax;
+} VDIOLOGREPLAY, *PVDIOLOGREPLAY;
+
 /**
  * Argument types.
  */
@@ -301,6 +377,8 @@ static DECLCALLBACK(int) vdScriptHandlerCopy(PVDTESTGLOB pGlob, PVDSCRIPTARG paS
 static DECLCALLBACK(int) vdScriptHandlerClose(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs);
 static DECLCALLBACK(int) vdScriptHandlerPrintFileSize(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs);
 static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs);
+static DECLCALLBACK(int) vdScriptHandlerIoLogRecord(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs);
+static DECLCALLBACK(int) vdScriptHandlerIoLogStop(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs);
 static DECLCALLBACK(int) vdScriptHandlerIoRngCreate(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs);
 static DECLCALLBACK(int) vdScriptHandlerIoRngDestroy(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs);
 static DECLCALLBACK(int) vdScriptHandlerIoPatternCreateFromNumber(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs);
@@ -425,7 +503,24 @@ const VDSCRIPTARGDESC g_aArgIoLogReplay[] =
 {
     /* pcszName    chId enmType                          fFlags */
     {"disk",       'd', VDSCRIPTARGTYPE_STRING,          VDSCRIPTARGDESC_FLAG_MANDATORY},
-    {"iolog",      'i', VDSCRIPTARGTYPE_STRING, VDSCRIPTARGDESC_FLAG_MANDATORY}
+    {"iolog",      'i', VDSCRIPTARGTYPE_STRING,          VDSCRIPTARGDESC_FLAG_MANDATORY},
+    {"async",      'a', VDSCRIPTARGTYPE_BOOL,            0},
+    {"timing",     't', VDSCRIPTARGTYPE_STRING,          0}
+};
+
+/* I/O log record action */
+const VDSCRIPTARGDESC g_aArgIoLogRecord[] =
+{
+    /* pcszName    chId enmType                          fFlags */
+    {"disk",       'd', VDSCRIPTARGTYPE_STRING,          VDSCRIPTARGDESC_FLAG_MANDATORY},
+    {"iolog",      'i', VDSCRIPTARGTYPE_STRING,          VDSCRIPTARGDESC_FLAG_MANDATORY}
+};
+
+/* I/O log stop action */
+const VDSCRIPTARGDESC g_aArgIoLogStop[] =
+{
+    /* pcszName    chId enmType                          fFlags */
+    {"disk",       'd', VDSCRIPTARGTYPE_STRING,          VDSCRIPTARGDESC_FLAG_MANDATORY}
 };
 
 /* I/O RNG create action */
@@ -523,6 +618,8 @@ const VDSCRIPTACTION g_aScriptActions[] =
     {"close",                      g_aArgClose,                       RT_ELEMENTS(g_aArgClose),                      vdScriptHandlerClose},
     {"printfilesize",              g_aArgPrintFileSize,               RT_ELEMENTS(g_aArgPrintFileSize),              vdScriptHandlerPrintFileSize},
     {"ioreplay",                   g_aArgIoLogReplay,                 RT_ELEMENTS(g_aArgIoLogReplay),                vdScriptHandlerIoLogReplay},
+    {"iologrecord",                g_aArgIoLogRecord,                 RT_ELEMENTS(g_aArgIoLogRecord),                vdScriptHandlerIoLogRecord},
+    {"iologstop",                  g_aArgIoLogStop,                   RT_ELEMENTS(g_aArgIoLogStop),                  vdScriptHandlerIoLogStop},
     {"merge",                      g_aArgMerge,                       RT_ELEMENTS(g_aArgMerge),                      vdScriptHandlerMerge},
     {"compact",                    g_aArgCompact,                     RT_ELEMENTS(g_aArgCompact),                    vdScriptHandlerCompact},
     {"discard",                    g_aArgDiscard,                     RT_ELEMENTS(g_aArgDiscard),                    vdScriptHandlerDiscard},
@@ -566,6 +663,13 @@ static void tstVDIoTestDestroy(PVDIOTEST pIoTest);
 static bool tstVDIoTestReqOutstanding(PVDIOREQ pIoReq);
 static int  tstVDIoTestReqInit(PVDIOTEST pIoTest, PVDIOREQ pIoReq, void *pvUser);
 static void tstVDIoTestReqComplete(void *pvUser1, void *pvUser2, int rcReq);
+static void tstVDIoTestReqLogStart(PVDDISK pDisk, PVDIOREQ pIoReq, bool fAsync);
+static void tstVDIoTestReqLogComplete(PVDDISK pDisk, PVDIOREQ pIoReq, int rcReq);
+
+static int  tstVDIoLogReplayReqSubmit(PVDIOLOGREPLAY pReplay, PVDIOLOGREPLAYREQ pReq);
+static int  tstVDIoLogReplayReqWait(PVDIOLOGREPLAY pReplay, PVDIOLOGREPLAYREQ pReq);
+static void tstVDIoLogReplayReqFree(PVDIOLOGREPLAYREQ pReq);
+static void tstVDIoLogReplayReport(PVDIOLOGREPLAY pReplay, uint64_t cNsElapsed, uint64_t cMsCpu);
 
 static PVDDISK tstVDIoGetDiskByName(PVDTESTGLOB pGlob, const char *pcszDisk);
 static PVDPATTERN tstVDIoGetPatternByName(PVDTESTGLOB pGlob, const char *pcszName);
@@ -914,6 +1018,8 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDTESTGLOB pGlob, PVDSCRIPTARG paScr
 
                             if (RT_SUCCESS(rc))
                             {
+                                tstVDIoTestReqLogStart(pDisk, &paIoReq[idx], fAsync);
+
                                 if (!fAsync)
                                 {
                                     switch (paIoReq[idx].enmTxDir)
@@ -956,6 +1062,7 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDTESTGLOB pGlob, PVDSCRIPTARG paScr
                                         }
                                     }
 
+                                    tstVDIoTestReqLogComplete(pDisk, &paIoReq[idx], rc);
                                     ASMAtomicXchgBool(&paIoReq[idx].fOutstanding, false);
                                     if (RT_SUCCESS(rc))
                                         idx++;
@@ -993,6 +1100,7 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDTESTGLOB pGlob, PVDSCRIPTARG paScr
                                     else if (rc == VINF_VD_ASYNC_IO_FINISHED)
                                     {
                                         LogFlow(("Request %d completed\n", idx));
+                                        tstVDIoTestReqLogComplete(pDisk, &paIoReq[idx], VINF_SUCCESS);
                                         switch (paIoReq[idx].enmTxDir)
                                         {
                                             case VDIOREQTXDIR_READ:
@@ -1036,7 +1144,11 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDTESTGLOB pGlob, PVDSCRIPTARG paScr
                                 }
 
                                 if (RT_FAILURE(rc))
+                                {
+                                    if (fAsync)
+                                        tstVDIoTestReqLogComplete(pDisk, &paIoReq[idx], rc);
                                     RTPrintf("Error submitting task %u rc=%Rrc\n", paIoReq[idx].idx, rc);
+                                }
                             }
                         }
                     }
@@ -1529,12 +1641,102 @@ static DECLCALLBACK(int) vdScriptHandlerPrintFileSize(PVDTESTGLOB pGlob, PVDSCRI
 }
 
 
+static DECLCALLBACK(int) vdScriptHandlerIoLogRecord(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs)
+{
+    int rc = VINF_SUCCESS;
+    const char *pcszDisk = NULL;
+    const char *pcszIoLog = NULL;
+    PVDDISK pDisk = NULL;
+
+    for (unsigned i = 0; i < cScriptArgs; i++)
+    {
+        switch (paScriptArgs[i].chId)
+        {
+            case 'd':
+            {
+                pcszDisk = paScriptArgs[i].u.pcszString;
+                break;
+            }
+            case 'i':
+            {
+                pcszIoLog = paScriptArgs[i].u.pcszString;
+                break;
+            }
+            default:
+                AssertMsgFailed(("Invalid argument given!\n"));
+        }
+    }
+
+    pDisk = tstVDIoGetDiskByName(pGlob, pcszDisk);
+    if (pDisk)
+    {
+        if (!pDisk->hIoLogger)
+        {
+            /* The written data is logged too, so a replay produces the same disk content. */
+            rc = VDDbgIoLogCreate(&pDisk->hIoLogger, pcszIoLog, VDDBG_IOLOG_LOG_DATA_WRITTEN);
+            if (RT_FAILURE(rc))
+            {
+                RTPrintf("Failed to create I/O log '%s' rc=%Rrc\n", pcszIoLog, rc);
+                pDisk->hIoLogger = NULL;
+            }
+        }
+        else
+            rc = VERR_INVALID_STATE;
+    }
+    else
+        rc = VERR_NOT_FOUND;
+
+    return rc;
+}
+
+
+static DECLCALLBACK(int) vdScriptHandlerIoLogStop(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs)
+{
+    int rc = VINF_SUCCESS;
+    const char *pcszDisk = NULL;
+    PVDDISK pDisk = NULL;
+
+    for (unsigned i = 0; i < cScriptArgs; i++)
+    {
+        switch (paScriptArgs[i].chId)
+        {
+            case 'd':
+            {
+                pcszDisk = paScriptArgs[i].u.pcszString;
+                break;
+            }
+            default:
+                AssertMsgFailed(("Invalid argument given!\n"));
+        }
+    }
+
+    pDisk = tstVDIoGetDiskByName(pGlob, pcszDisk);
+    if (pDisk)
+    {
+        if (pDisk->hIoLogger)
+        {
+            rc = VDDbgIoLogCommit(pDisk->hIoLogger);
+            VDDbgIoLogDestroy(pDisk->hIoLogger);
+            pDisk->hIoLogger = NULL;
+        }
+        else
+            rc = VERR_INVALID_STATE;
+    }
+    else
+        rc = VERR_NOT_FOUND;
+
+    return rc;
+}
+
+
 static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, unsigned cScriptArgs)
 {
     int rc = VINF_SUCCESS;
     const char *pcszDisk = NULL;
     PVDDISK pDisk = NULL;
     const char *pcszIoLog = NULL;
+    bool fAsync = false;
+    bool fTimingOriginal = false;
 
     for (unsigned i = 0; i < cScriptArgs; i++)
     {
@@ -1550,9 +1752,30 @@ static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDTESTGLOB pGlob, PVDSCRIPT
                 pcszIoLog = paScriptArgs[i].u.pcszString;
                 break;
             }
+            case 'a':
+            {
+                fAsync = paScriptArgs[i].u.fFlag;
+                break;
+            }
+            case 't':
+            {
+                if (!RTStrICmp(paScriptArgs[i].u.pcszString, "original"))
+                    fTimingOriginal = true;
+                else if (!RTStrICmp(paScriptArgs[i].u.pcszString, "fast"))
+                    fTimingOriginal = false;
+                else
+                {
+                    RTPrintf("Invalid timing mode '%s'\n", paScriptArgs[i].u.pcszString);
+                    rc = VERR_INVALID_PARAMETER;
+                }
+                break;
+            }
             default:
                 AssertMsgFailed(("Invalid argument given!\n"));
         }
+
+        if (RT_FAILURE(rc))
+            return rc;
     }
 
     pDisk = tstVDIoGetDiskByName(pGlob, pcszDisk);
@@ -1563,129 +1786,196 @@ static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDTESTGLOB pGlob, PVDSCRIPT
         rc = VDDbgIoLogOpen(&hIoLogger, pcszIoLog);
         if (RT_SUCCESS(rc))
         {
-            uint32_t fIoLogFlags;
+            VDIOLOGREPLAY Replay;
             VDIOLOGEVENT enmEvent;
-            void *pvBuf = NULL;
-            size_t cbBuf = 0;
+            uint64_t tsReplayStart = 0;
+            uint64_t tsLogFirst = UINT64_MAX;
+            uint64_t cMsKernelStart = 0, cMsUserStart = 0;
 
-            fIoLogFlags = VDDbgIoLogGetFlags(hIoLogger);
+            RT_ZERO(Replay);
+            Replay.pDisk  = pDisk;
+            Replay.fAsync = fAsync;
+            RTListInit(&Replay.ListReqs);
 
-            /* Loop through events. */
-            rc = VDDbgIoLogEventTypeGetNext(hIoLogger, &enmEvent);
-            while (   RT_SUCCESS(rc)
-                   && enmEvent != VDIOLOGEVENT_END)
+            if (   fTimingOriginal
+                && !VDDbgIoLogHasTimestamps(hIoLogger))
             {
-                VDDBGIOLOGREQ enmReq = VDDBGIOLOGREQ_INVALID;
-                uint64_t idEvent = 0;
-                bool fAsync = false;
-                uint64_t off = 0;
-                size_t cbIo = 0;
-                Assert(enmEvent == VDIOLOGEVENT_START);
+                RTPrintf("I/O log '%s' has no timestamps, replaying as fast as possible\n", pcszIoLog);
+                fTimingOriginal = false;
+            }
 
-                rc = VDDbgIoLogReqTypeGetNext(hIoLogger, &enmReq);
-                if (RT_FAILURE(rc))
-                    break;
+            rc = RTSemEventCreate(&Replay.hEvtComplete);
+            if (RT_SUCCESS(rc))
+            {
+                RTThreadGetExecutionTimeMilli(&cMsKernelStart, &cMsUserStart);
+                tsReplayStart = RTTimeNanoTS();
 
-                switch (enmReq)
+                /* Loop through events. */
+                rc = VDDbgIoLogEventTypeGetNext(hIoLogger, &enmEvent);
+                while (   RT_SUCCESS(rc)
+                       && enmEvent != VDIOLOGEVENT_END)
                 {
-                    case VDDBGIOLOGREQ_READ:
+                    if (enmEvent == VDIOLOGEVENT_START)
                     {
-                        rc = VDDbgIoLogEventGetStart(hIoLogger, &idEvent, &fAsync,
-                                                     &off, &cbIo, 0, NULL);
-                        if (   RT_SUCCESS(rc)
-                            && cbIo > cbBuf)
+                        PVDIOLOGREPLAYREQ pReq = (PVDIOLOGREPLAYREQ)RTMemAllocZ(sizeof(VDIOLOGREPLAYREQ));
+                        bool fAsyncLogged = false;
+
+                        if (!pReq)
                         {
-                            pvBuf = RTMemRealloc(pvBuf, cbIo);
-                            if (pvBuf)
-                                cbBuf = cbIo;
-                            else
-                                rc = VERR_NO_MEMORY;
+                            rc = VERR_NO_MEMORY;
+                            break;
+                        }
+
+                        pReq->pReplay = &Replay;
+                        rc = VDDbgIoLogReqTypeGetNext(hIoLogger, &pReq->enmReq);
+                        if (RT_SUCCESS(rc))
+                        {
+                            switch (pReq->enmReq)
+                            {
+                                case VDDBGIOLOGREQ_READ:
+                                case VDDBGIOLOGREQ_WRITE:
+                                case VDDBGIOLOGREQ_FLUSH:
+                                {
+                                    rc = VDDbgIoLogEventGetStart(hIoLogger, &pReq->idEvent, &fAsyncLogged,
+                                                                 &pReq->off, &pReq->cbIo, 0, NULL);
+                                    if (rc == VERR_BUFFER_OVERFLOW || (RT_SUCCESS(rc) && pReq->cbIo))
+                                    {
+                                        /* The log might not contain the written data, the buffer is zeroed then. */
+                                        pReq->pvBuf = RTMemAllocZ(pReq->cbIo);
+                                        if (!pReq->pvBuf)
+                                            rc = VERR_NO_MEMORY;
+                                        else if (rc == VERR_BUFFER_OVERFLOW)
+                                            rc = VDDbgIoLogEventGetStart(hIoLogger, &pReq->idEvent, &fAsyncLogged,
+                                                                         &pReq->off, &pReq->cbIo, pReq->cbIo, pReq->pvBuf);
+                                    }
+                                    break;
+                                }
+                                case VDDBGIOLOGREQ_DISCARD:
+                                {
+                                    rc = VDDbgIoLogEventGetStartDiscard(hIoLogger, &pReq->idEvent, &fAsyncLogged,
+                                                                        &pReq->paRanges, &pReq->cRanges);
+                                    break;
+                                }
+                                default:
+                                    AssertMsgFailed(("Invalid request type %d\n", pReq->enmReq));
+                                    rc = VERR_INVALID_PARAMETER;
+                            }
                         }
 
                         if (   RT_SUCCESS(rc)
-                            && !fAsync)
-                            rc = VDRead(pDisk->pVD, off, pvBuf, cbIo);
-                        else if (RT_SUCCESS(rc))
-                            rc = VERR_NOT_SUPPORTED;
-                        break;
+                            && fTimingOriginal)
+                        {
+                            /* Wait until the request was submitted in the original run. */
+                            uint64_t tsLog = 0;
+
+                            rc = VDDbgIoLogEventGetStartTimestamp(hIoLogger, &tsLog);
+                            if (RT_SUCCESS(rc))
+                            {
+                                if (tsLogFirst == UINT64_MAX)
+                                    tsLogFirst = tsLog;
+
+                                uint64_t tsDeadline = tsReplayStart + (tsLog - tsLogFirst);
+                                uint64_t tsNow = RTTimeNanoTS();
+                                while (tsNow < tsDeadline)
+                                {
+                                    if (tsDeadline - tsNow >= RT_NS_1MS)
+                                        RTThreadSleep((tsDeadline - tsNow) / RT_NS_1MS);
+                                    else
+                                        RTThreadYield();
+                                    tsNow = RTTimeNanoTS();
+                                }
+                            }
+                        }
+
+                        if (RT_SUCCESS(rc))
+                            rc = tstVDIoLogReplayReqSubmit(&Replay, pReq);
+
+                        if (RT_SUCCESS(rc))
+                            RTListAppend(&Replay.ListReqs, &pReq->NodeReq);
+                        else
+                            tstVDIoLogReplayReqFree(pReq);
                     }
-                    case VDDBGIOLOGREQ_WRITE:
+                    else
                     {
-                        rc = VDDbgIoLogEventGetStart(hIoLogger, &idEvent, &fAsync,
-                                                     &off, &cbIo, cbBuf, pvBuf);
+                        uint64_t idEvtComplete;
+                        int rcReq;
+                        uint64_t msDuration;
+                        size_t cbIo;
+
+                        Assert(enmEvent == VDIOLOGEVENT_COMPLETE);
+                        rc = VDDbgIoLogEventGetComplete(hIoLogger, &idEvtComplete, &rcReq,
+                                                        &msDuration, &cbIo, 0, NULL);
                         if (rc == VERR_BUFFER_OVERFLOW)
                         {
-                            pvBuf = RTMemRealloc(pvBuf, cbIo);
-                            if (pvBuf)
+                            /* Skip the read data, it is not needed for the replay. */
+                            void *pvTmp = RTMemAlloc(cbIo);
+                            if (pvTmp)
                             {
-                                cbBuf = cbIo;
-                                rc = VDDbgIoLogEventGetStart(hIoLogger, &idEvent, &fAsync,
-                                                             &off, &cbIo, cbBuf, pvBuf);
+                                rc = VDDbgIoLogEventGetComplete(hIoLogger, &idEvtComplete, &rcReq,
+                                                                &msDuration, &cbIo, cbIo, pvTmp);
+                                RTMemFree(pvTmp);
                             }
                             else
                                 rc = VERR_NO_MEMORY;
                         }
 
-                        if (   RT_SUCCESS(rc)
-                            && !fAsync)
-                            rc = VDWrite(pDisk->pVD, off, pvBuf, cbIo);
-                        else if (RT_SUCCESS(rc))
-                            rc = VERR_NOT_SUPPORTED;
-                        break;
-                    }
-                    case VDDBGIOLOGREQ_FLUSH:
-                    {
-                        rc = VDDbgIoLogEventGetStart(hIoLogger, &idEvent, &fAsync,
-                                                     &off, &cbIo, 0, NULL);
-                        if (   RT_SUCCESS(rc)
-                            && !fAsync)
-                            rc = VDFlush(pDisk->pVD);
-                        else if (RT_SUCCESS(rc))
-                            rc = VERR_NOT_SUPPORTED;
-                        break;
-                    }
-                    case VDDBGIOLOGREQ_DISCARD:
-                    {
-                        PVDRANGE paRanges = NULL;
-                        unsigned cRanges = 0;
-
-                        rc = VDDbgIoLogEventGetStartDiscard(hIoLogger, &idEvent, &fAsync,
-                                                            &paRanges, &cRanges);
-                        if (   RT_SUCCESS(rc)
-                            && !fAsync)
+                        if (RT_SUCCESS(rc))
                         {
-                            rc = VDDiscardRanges(pDisk->pVD, paRanges, cRanges);
-                            RTMemFree(paRanges);
+                            /*
+                             * Everything submitted after this point in the original run depended
+                             * on the completion of this request, so wait for the replayed one
+                             * before continuing. This keeps the original concurrency.
+                             */
+                            PVDIOLOGREPLAYREQ pReq;
+                            bool fFound = false;
+
+                            RTListForEach(&Replay.ListReqs, pReq, VDIOLOGREPLAYREQ, NodeReq)
+                            {
+                                if (pReq->idEvent == idEvtComplete)
+                                {
+                                    fFound = true;
+                                    break;
+                                }
+                            }
+
+                            if (fFound)
+                            {
+                                RTListNodeRemove(&pReq->NodeReq);
+                                rc = tstVDIoLogReplayReqWait(&Replay, pReq);
+                                tstVDIoLogReplayReqFree(pReq);
+                            }
+                            else
+                                RTPrintf("Complete event %llu without matching start event, ignored\n", idEvtComplete);
                         }
-                        else if (RT_SUCCESS(rc))
-                            rc = VERR_NOT_SUPPORTED;
-                        break;
                     }
-                    default:
-                        AssertMsgFailed(("Invalid request type %d\n", enmReq));
+
+                    if (RT_SUCCESS(rc))
+                        rc = VDDbgIoLogEventTypeGetNext(hIoLogger, &enmEvent);
                 }
 
-                if (RT_SUCCESS(rc))
+                /* Wait for all requests the log didn't see completing. */
+                while (!RTListIsEmpty(&Replay.ListReqs))
                 {
-                    /* Get matching complete event. */
-                    rc = VDDbgIoLogEventTypeGetNext(hIoLogger, &enmEvent);
+                    PVDIOLOGREPLAYREQ pReq = RTListGetFirst(&Replay.ListReqs, VDIOLOGREPLAYREQ, NodeReq);
+                    RTListNodeRemove(&pReq->NodeReq);
+                    int rc2 = tstVDIoLogReplayReqWait(&Replay, pReq);
                     if (RT_SUCCESS(rc))
-                    {
-                        uint64_t idEvtComplete;
-                        int rcReq;
-                        uint64_t msDuration;
-
-                        Assert(enmEvent == VDIOLOGEVENT_COMPLETE);
-                        rc = VDDbgIoLogEventGetComplete(hIoLogger, &idEvtComplete, &rcReq,
-                                                        &msDuration, &cbIo, cbBuf, pvBuf);
-                        Assert(RT_FAILURE(rc) || idEvtComplete == idEvent);
-                    }
+                        rc = rc2;
+                    tstVDIoLogReplayReqFree(pReq);
                 }
 
+                uint64_t cNsElapsed = RTTimeNanoTS() - tsReplayStart;
+                uint64_t cMsKernel = 0, cMsUser = 0;
+                RTThreadGetExecutionTimeMilli(&cMsKernel, &cMsUser);
+
                 if (RT_SUCCESS(rc))
-                    rc = VDDbgIoLogEventTypeGetNext(hIoLogger, &enmEvent);
+                    tstVDIoLogReplayReport(&Replay, cNsElapsed,
+                                           (cMsKernel - cMsKernelStart) + (cMsUser - cMsUserStart));
+
+                RTSemEventDestroy(Replay.hEvtComplete);
             }
 
+            RTMemFree(Replay.pacNsLatency);
             VDDbgIoLogDestroy(hIoLogger);
         }
     }
@@ -2099,6 +2389,8 @@ static DECLCALLBACK(int) vdScriptHandlerDestroyDisk(PVDTESTGLOB pGlob, PVDSCRIPT
     if (pDisk)
     {
         RTListNodeRemove(&pDisk->ListNode);
+        if (pDisk->hIoLogger)
+            VDDbgIoLogDestroy(pDisk->hIoLogger);
         VDDestroy(pDisk->pVD);
         if (pDisk->pMemDiskVerify)
         {
@@ -2699,6 +2991,8 @@ static void tstVDIoTestReqComplete(void *pvUser1, void *pvUser2, int rcReq)
 
     LogFlow(("Request %d completed\n", pIoReq->idx));
 
+    tstVDIoTestReqLogComplete(pDisk, pIoReq, rcReq);
+
     if (pDisk->pMemDiskVerify)
     {
         switch (pIoReq->enmTxDir)
@@ -2734,6 +3028,248 @@ static void tstVDIoTestReqComplete(void *pvUser1, void *pvUser2, int rcReq)
     return;
 }
 
+/**
+ * Records the start of a request of the io action if the disk has an I/O
+ * logger attached, see the iologrecord action.
+ */
+static void tstVDIoTestReqLogStart(PVDDISK pDisk, PVDIOREQ pIoReq, bool fAsync)
+{
+    pIoReq->hIoLogEnt = NULL;
+    if (pDisk->hIoLogger)
+    {
+        VDDBGIOLOGREQ enmReq =   pIoReq->enmTxDir == VDIOREQTXDIR_READ
+                               ? VDDBGIOLOGREQ_READ
+                               : pIoReq->enmTxDir == VDIOREQTXDIR_WRITE
+                               ? VDDBGIOLOGREQ_WRITE
+                               : VDDBGIOLOGREQ_FLUSH;
+        int rc = VDDbgIoLogStart(pDisk->hIoLogger, fAsync, enmReq, pIoReq->off, pIoReq->cbReq,
+                                 &pIoReq->SgBuf, &pIoReq->hIoLogEnt);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("Failed to log request %u rc=%Rrc\n", pIoReq->idx, rc);
+            pIoReq->hIoLogEnt = NULL;
+        }
+    }
+}
+
+/**
+ * Records the completion of a request started with tstVDIoTestReqLogStart.
+ */
+static void tstVDIoTestReqLogComplete(PVDDISK pDisk, PVDIOREQ pIoReq, int rcReq)
+{
+    if (pIoReq->hIoLogEnt)
+    {
+        RTSgBufReset(&pIoReq->SgBuf);
+        int rc = VDDbgIoLogComplete(pDisk->hIoLogger, pIoReq->hIoLogEnt, rcReq, &pIoReq->SgBuf);
+        if (RT_FAILURE(rc))
+            RTPrintf("Failed to log completion of request %u rc=%Rrc\n", pIoReq->idx, rc);
+        pIoReq->hIoLogEnt = NULL;
+    }
+}
+
+/**
+ * Completion callback for replayed asynchronous requests.
+ */
+static void tstVDIoLogReplayReqComplete(void *pvUser1, void *pvUser2, int rcReq)
+{
+    PVDIOLOGREPLAYREQ pReq = (PVDIOLOGREPLAYREQ)pvUser1;
+    PVDIOLOGREPLAY pReplay = (PVDIOLOGREPLAY)pvUser2;
+
+    pReq->cNsLatency = RTTimeNanoTS() - pReq->tsSubmit;
+    pReq->rcReq      = rcReq;
+    ASMAtomicDecU32(&pReplay->cReqsInFlight);
+    ASMAtomicXchgBool(&pReq->fCompleted, true);
+    RTSemEventSignal(pReplay->hEvtComplete);
+}
+
+/**
+ * Submits a request read from the I/O log to the disk.
+ *
+ * @returns VBox status code.
+ * @param   pReplay    The replay state.
+ * @param   pReq       The request to submit.
+ */
+static int tstVDIoLogReplayReqSubmit(PVDIOLOGREPLAY pReplay, PVDIOLOGREPLAYREQ pReq)
+{
+    int rc = VINF_SUCCESS;
+    PVBOXHDD pVD = pReplay->pDisk->pVD;
+
+    pReq->DataSeg.pvSeg = pReq->pvBuf;
+    pReq->DataSeg.cbSeg = pReq->cbIo;
+    RTSgBufInit(&pReq->SgBuf, &pReq->DataSeg, 1);
+
+    uint32_t cReqsInFlight = ASMAtomicIncU32(&pReplay->cReqsInFlight);
+    pReplay->cReqsInFlightMax = RT_MAX(pReplay->cReqsInFlightMax, cReqsInFlight);
+    pReq->tsSubmit = RTTimeNanoTS();
+
+    if (!pReplay->fAsync)
+    {
+        switch (pReq->enmReq)
+        {
+            case VDDBGIOLOGREQ_READ:
+                rc = VDRead(pVD, pReq->off, pReq->pvBuf, pReq->cbIo);
+                break;
+            case VDDBGIOLOGREQ_WRITE:
+                rc = VDWrite(pVD, pReq->off, pReq->pvBuf, pReq->cbIo);
+                break;
+            case VDDBGIOLOGREQ_FLUSH:
+                rc = VDFlush(pVD);
+                break;
+            case VDDBGIOLOGREQ_DISCARD:
+                rc = VDDiscardRanges(pVD, pReq->paRanges, pReq->cRanges);
+                break;
+            default:
+                AssertMsgFailed(("Invalid request type %d\n", pReq->enmReq));
+        }
+
+        tstVDIoLogReplayReqComplete(pReq, pReplay, rc);
+        return VINF_SUCCESS;
+    }
+
+    switch (pReq->enmReq)
+    {
+        case VDDBGIOLOGREQ_READ:
+            rc = VDAsyncRead(pVD, pReq->off, pReq->cbIo, &pReq->SgBuf,
+                             tstVDIoLogReplayReqComplete, pReq, pReplay);
+            break;
+        case VDDBGIOLOGREQ_WRITE:
+            rc = VDAsyncWrite(pVD, pReq->off, pReq->cbIo, &pReq->SgBuf,
+                              tstVDIoLogReplayReqComplete, pReq, pReplay);
+            break;
+        case VDDBGIOLOGREQ_FLUSH:
+            rc = VDAsyncFlush(pVD, tstVDIoLogReplayReqComplete, pReq, pReplay);
+            break;
+        case VDDBGIOLOGREQ_DISCARD:
+            /* There is no async discard interface, do it synchronously. */
+            rc = VDDiscardRanges(pVD, pReq->paRanges, pReq->cRanges);
+            if (RT_SUCCESS(rc))
+                rc = VINF_VD_ASYNC_IO_FINISHED;
+            break;
+        default:
+            AssertMsgFailed(("Invalid request type %d\n", pReq->enmReq));
+    }
+
+    if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+        rc = VINF_SUCCESS;
+    else
+    {
+        /* Completed immediately or failed, complete it here. */
+        tstVDIoLogReplayReqComplete(pReq, pReplay, rc == VINF_VD_ASYNC_IO_FINISHED ? VINF_SUCCESS : rc);
+        rc = VINF_SUCCESS;
+    }
+
+    return rc;
+}
+
+/**
+ * Waits for the given replayed request to complete and records the result.
+ *
+ * @returns VBox status code.
+ * @param   pReplay    The replay state.
+ * @param   pReq       The request to wait for.
+ */
+static int tstVDIoLogReplayReqWait(PVDIOLOGREPLAY pReplay, PVDIOLOGREPLAYREQ pReq)
+{
+    while (!ASMAtomicReadBool(&pReq->fCompleted))
+    {
+        int rc = RTSemEventWait(pReplay->hEvtComplete, 100);
+        Assert(RT_SUCCESS(rc) || rc == VERR_TIMEOUT);
+    }
+
+    pReplay->acReqs[pReq->enmReq]++;
+    if (RT_FAILURE(pReq->rcReq))
+        pReplay->cReqsFailed++;
+    else if (pReq->enmReq == VDDBGIOLOGREQ_READ)
+        pReplay->cbRead += pReq->cbIo;
+    else if (pReq->enmReq == VDDBGIOLOGREQ_WRITE)
+        pReplay->cbWritten += pReq->cbIo;
+
+    if (pReplay->cLatencies == pReplay->cLatenciesMax)
+    {
+        size_t cLatenciesNew = pReplay->cLatenciesMax ? pReplay->cLatenciesMax * 2 : _64K;
+        uint64_t *pacNsLatency = (uint64_t *)RTMemRealloc(pReplay->pacNsLatency, cLatenciesNew * sizeof(uint64_t));
+        if (!pacNsLatency)
+            return VERR_NO_MEMORY;
+        pReplay->pacNsLatency  = pacNsLatency;
+        pReplay->cLatenciesMax = cLatenciesNew;
+    }
+    pReplay->pacNsLatency[pReplay->cLatencies++] = pReq->cNsLatency;
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Frees a replayed request.
+ *
+ * @param   pReq       The request to free.
+ */
+static void tstVDIoLogReplayReqFree(PVDIOLOGREPLAYREQ pReq)
+{
+    if (pReq->pvBuf)
+        RTMemFree(pReq->pvBuf);
+    if (pReq->paRanges)
+        RTMemFree(pReq->paRanges);
+    RTMemFree(pReq);
+}
+
+/**
+ * Latency comparison callback for RTSortShell().
+ */
+static DECLCALLBACK(int) tstVDIoLogReplayLatencyCmp(void const *pvElement1, void const *pvElement2, void *pvUser)
+{
+    uint64_t u64Lat1 = *(uint64_t const *)pvElement1;
+    uint64_t u64Lat2 = *(uint64_t const *)pvElement2;
+
+    NOREF(pvUser);
+    if (u64Lat1 < u64Lat2)
+        return -1;
+    if (u64Lat1 > u64Lat2)
+        return 1;
+    return 0;
+}
+
+/**
+ * Prints the results of an I/O log replay.
+ *
+ * @param   pReplay      The replay state.
+ * @param   cNsElapsed   Wall clock time the replay took.
+ * @param   cMsCpu       CPU time (kernel and user) the replaying thread used.
+ */
+static void tstVDIoLogReplayReport(PVDIOLOGREPLAY pReplay, uint64_t cNsElapsed, uint64_t cMsCpu)
+{
+    static const unsigned s_auPercentiles[] = { 500, 900, 990, 999 };
+    uint64_t cReqs = pReplay->cLatencies;
+
+    RTPrintf("I/O Replay: %llu requests (%llu reads, %llu writes, %llu flushes, %llu discards, %llu failed) in %llu ms\n",
+             cReqs, pReplay->acReqs[VDDBGIOLOGREQ_READ], pReplay->acReqs[VDDBGIOLOGREQ_WRITE],
+             pReplay->acReqs[VDDBGIOLOGREQ_FLUSH], pReplay->acReqs[VDDBGIOLOGREQ_DISCARD],
+             pReplay->cReqsFailed, cNsElapsed / RT_NS_1MS);
+    if (!cReqs || !cNsElapsed)
+        return;
+
+    RTPrintf("I/O Replay: %llu IOPS, read %llu kb/s, write %llu kb/s, max %u requests in flight\n",
+             cReqs * RT_NS_1SEC / cNsElapsed,
+             (uint64_t)(pReplay->cbRead / (cNsElapsed / 1000000000.0) / 1024),
+             (uint64_t)(pReplay->cbWritten / (cNsElapsed / 1000000000.0) / 1024),
+             pReplay->cReqsInFlightMax);
+
+    RTSortShell(pReplay->pacNsLatency, pReplay->cLatencies, sizeof(uint64_t),
+                tstVDIoLogReplayLatencyCmp, NULL);
+    RTPrintf("I/O Replay: Latency min %llu us", pReplay->pacNsLatency[0] / RT_NS_1US);
+    for (unsigned i = 0; i < RT_ELEMENTS(s_auPercentiles); i++)
+    {
+        size_t idx = (size_t)(cReqs * s_auPercentiles[i] / 1000);
+        if (idx >= cReqs)
+            idx = cReqs - 1;
+        RTPrintf(", p%u.%u %llu us", s_auPercentiles[i] / 10, s_auPercentiles[i] % 10,
+                 pReplay->pacNsLatency[idx] / RT_NS_1US);
+    }
+    RTPrintf(", max %llu us\n", pReplay->pacNsLatency[cReqs - 1] / RT_NS_1US);
+
+    RTPrintf("I/O Replay: CPU %llu ms, %llu us per request\n",
+             cMsCpu, cMsCpu * RT_US_1MS / cReqs);
+}
+
 /**
  * Returns the disk handle by name or NULL if not found
  *
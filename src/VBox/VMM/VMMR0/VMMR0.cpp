@@ -1188,6 +1188,11 @@ static int vmmR0EntryExWorker(PVM pVM, VMCPUID idCpu, VMMR0OPERATION enmOperatio
                 return VERR_INVALID_PARAMETER;
             return IntNetR0IfAbortWaitReq(pSession, (PINTNETIFABORTWAITREQ)pReqHdr);
 
+        case VMMR0_DO_INTNET_IF_SET_QOS:
+            if (u64Arg || !pReqHdr || !vmmR0IsValidSession(pVM, ((PINTNETIFSETQOSREQ)pReqHdr)->pSession, pSession) || idCpu != NIL_VMCPUID)
+                return VERR_INVALID_PARAMETER;
+            return IntNetR0IfSetQoSReq(pSession, (PINTNETIFSETQOSREQ)pReqHdr);
+
 #ifdef VBOX_WITH_PCI_PASSTHROUGH
         /*
          * Requests to host PCI driver service.
@@ -30,6 +30,7 @@
 
 #include <VBox/log.h>
 #include <iprt/asm.h>
+#include <iprt/asm-math.h>
 #include <iprt/assert.h>
 #include <iprt/thread.h>
 #include <iprt/mem.h>
@@ -124,19 +125,45 @@ typedef struct PDMACBWMGR
     PPDMASYNCCOMPLETIONEPCLASS                  pEpClass;
     /** Identifier of the manager. */
     char                                       *pszId;
+    /** Critical section protecting the token buckets. */
+    RTCRITSECT                                  CritSect;
     /** Maximum number of bytes the endpoints are allowed to transfer (Max is 4GB/s currently) */
     volatile uint32_t                           cbTransferPerSecMax;
     /** Number of bytes we start with */
     volatile uint32_t                           cbTransferPerSecStart;
     /** Step after each update */
     volatile uint32_t                           cbTransferPerSecStep;
-    /** Number of bytes we are allowed to transfer till the next update.
-     * Reset by the refresh timer. */
-    volatile uint32_t                           cbTransferAllowed;
+    /** Maximum number of bytes which can accumulate in the byte bucket. */
+    volatile uint32_t                           cbTransferBurst;
+    /** Maximum number of I/O operations per second, 0 if unlimited. */
+    volatile uint32_t                           cIoPerSecMax;
+    /** Maximum number of I/O operations which can accumulate in the I/O bucket. */
+    volatile uint32_t                           cIoBurst;
+    /** Number of bytes available in the byte bucket. Can become negative
+     * because a request is allowed as long as there is anything left. */
+    int64_t                                     cbTransferAvail;
+    /** Number of I/O operations available in the I/O bucket. */
+    int64_t                                     cIoAvail;
+    /** Timestamp the byte bucket was refilled up to. */
+    uint64_t                                    tsBytesRefill;
+    /** Timestamp the I/O bucket was refilled up to. */
+    uint64_t                                    tsIoRefill;
     /** Timestamp of the last update */
     volatile uint64_t                           tsUpdatedLast;
+    /** Endpoint which got throttled first and is served next, for fairness. */
+    PPDMASYNCCOMPLETIONENDPOINT                 pEpWaiting;
+    /** Timestamp when pEpWaiting started waiting. */
+    uint64_t                                    tsEpWaiting;
     /** Reference counter - How many endpoints are associated with this manager. */
     volatile uint32_t                           cRefs;
+    /** Number of times a request was throttled. */
+    STAMCOUNTER                                 StatThrottled;
+    /** Time the endpoints waited for the group. */
+    STAMPROFILE                                 StatWait;
+    /** Number of bytes transferred by the group. */
+    STAMCOUNTER                                 StatBytes;
+    /** Number of I/O operations done by the group. */
+    STAMCOUNTER                                 StatIoOps;
 } PDMACBWMGR;
 /** Pointer to a bandwidth control manager pointer. */
 typedef PPDMACBWMGR *PPPDMACBWMGR;
@@ -631,6 +658,49 @@ static void pdmacBwMgrLink(PPDMACBWMGR pBwMgr)
     AssertRC(rc);
 }
 
+/**
+ * Registers the statistics of a bandwidth manager.
+ *
+ * @returns nothing.
+ * @param   pBwMgr    The bandwidth manager.
+ */
+static void pdmacBwMgrStatsRegister(PPDMACBWMGR pBwMgr)
+{
+    PVM pVM = pBwMgr->pEpClass->pVM;
+
+    STAMR3RegisterF(pVM, &pBwMgr->StatThrottled, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                    "Number of times a request had to wait for the bandwidth group",
+                    "/PDM/AsyncCompletion/BwGroups/%s/Throttled", pBwMgr->pszId);
+    STAMR3RegisterF(pVM, &pBwMgr->StatWait, STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_NS_PER_CALL,
+                    "Time endpoints waited before the bandwidth group allowed a request",
+                    "/PDM/AsyncCompletion/BwGroups/%s/Wait", pBwMgr->pszId);
+    STAMR3RegisterF(pVM, &pBwMgr->StatBytes, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                    "Number of bytes transferred by all endpoints in the group",
+                    "/PDM/AsyncCompletion/BwGroups/%s/Bytes", pBwMgr->pszId);
+    STAMR3RegisterF(pVM, &pBwMgr->StatIoOps, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                    "Number of I/O operations done by all endpoints in the group",
+                    "/PDM/AsyncCompletion/BwGroups/%s/IoOps", pBwMgr->pszId);
+}
+
+/**
+ * Destroys a bandwidth manager.
+ *
+ * @returns nothing.
+ * @param   pBwMgr    The bandwidth manager to destroy.
+ */
+static void pdmacBwMgrDestroy(PPDMACBWMGR pBwMgr)
+{
+    PVM pVM = pBwMgr->pEpClass->pVM;
+
+    STAMR3Deregister(pVM, &pBwMgr->StatThrottled);
+    STAMR3Deregister(pVM, &pBwMgr->StatWait);
+    STAMR3Deregister(pVM, &pBwMgr->StatBytes);
+    STAMR3Deregister(pVM, &pBwMgr->StatIoOps);
+    RTCritSectDelete(&pBwMgr->CritSect);
+    RTStrFree(pBwMgr->pszId);
+    MMR3HeapFree(pBwMgr);
+}
+
 static void pdmacBwMgrUnlink(PPDMACBWMGR pBwMgr)
 {
     int rc;
@@ -656,14 +726,29 @@ static void pdmacBwMgrUnlink(PPDMACBWMGR pBwMgr)
     AssertRC(rc);
 }
 
+/**
+ * Creates a new bandwidth manager.
+ *
+ * @returns VBox status code.
+ * @param   pEpClass                The endpoint class the manager is for.
+ * @param   pcszBwMgr               The identifier of the manager.
+ * @param   cbTransferPerSecMax     Maximum number of bytes per second, 0 for unlimited.
+ * @param   cbTransferPerSecStart   Number of bytes per second to start with.
+ * @param   cbTransferPerSecStep    Increment of the rate every second until the maximum is reached.
+ * @param   cbTransferBurst         Maximum number of bytes which can accumulate while the group is idle.
+ * @param   cIoPerSecMax            Maximum number of I/O operations per second, 0 for unlimited.
+ * @param   cIoBurst                Maximum number of I/O operations which can accumulate while the group is idle.
+ */
 static int pdmacAsyncCompletionBwMgrCreate(PPDMASYNCCOMPLETIONEPCLASS pEpClass, const char *pcszBwMgr, uint32_t cbTransferPerSecMax,
-                                           uint32_t cbTransferPerSecStart, uint32_t cbTransferPerSecStep)
+                                           uint32_t cbTransferPerSecStart, uint32_t cbTransferPerSecStep,
+                                           uint32_t cbTransferBurst, uint32_t cIoPerSecMax, uint32_t cIoBurst)
 {
     int rc = VINF_SUCCESS;
     PPDMACBWMGR pBwMgr;
 
-    LogFlowFunc(("pEpClass=%#p pcszBwMgr=%#p{%s} cbTransferPerSecMax=%u cbTransferPerSecStart=%u cbTransferPerSecStep=%u\n",
-                 pEpClass, pcszBwMgr, cbTransferPerSecMax, cbTransferPerSecStart, cbTransferPerSecStep));
+    LogFlowFunc(("pEpClass=%#p pcszBwMgr=%#p{%s} cbTransferPerSecMax=%u cbTransferPerSecStart=%u cbTransferPerSecStep=%u cbTransferBurst=%u cIoPerSecMax=%u cIoBurst=%u\n",
+                 pEpClass, pcszBwMgr, cbTransferPerSecMax, cbTransferPerSecStart, cbTransferPerSecStep,
+                 cbTransferBurst, cIoPerSecMax, cIoBurst));
 
     AssertPtrReturn(pEpClass, VERR_INVALID_POINTER);
     AssertPtrReturn(pcszBwMgr, VERR_INVALID_POINTER);
@@ -679,24 +764,37 @@ static int pdmacAsyncCompletionBwMgrCreate(PPDMASYNCCOMPLETIONEPCLASS pEpClass,
         {
             pBwMgr->pszId = RTStrDup(pcszBwMgr);
             if (pBwMgr->pszId)
+                rc = RTCritSectInit(&pBwMgr->CritSect);
+            else
+                rc = VERR_NO_MEMORY;
+
+            if (RT_SUCCESS(rc))
             {
                 pBwMgr->pEpClass              = pEpClass;
                 pBwMgr->cRefs                 = 0;
 
-                /* Init I/O flow control. */
+                /* Init I/O flow control, both buckets start full. */
                 pBwMgr->cbTransferPerSecMax   = cbTransferPerSecMax;
                 pBwMgr->cbTransferPerSecStart = cbTransferPerSecStart;
                 pBwMgr->cbTransferPerSecStep  = cbTransferPerSecStep;
+                pBwMgr->cbTransferBurst       = cbTransferBurst;
+                pBwMgr->cIoPerSecMax          = cIoPerSecMax;
+                pBwMgr->cIoBurst              = cIoBurst;
 
-                pBwMgr->cbTransferAllowed     = pBwMgr->cbTransferPerSecStart;
+                pBwMgr->cbTransferAvail       = cbTransferBurst;
+                pBwMgr->cIoAvail              = cIoBurst;
                 pBwMgr->tsUpdatedLast         = RTTimeSystemNanoTS();
+                pBwMgr->tsBytesRefill         = pBwMgr->tsUpdatedLast;
+                pBwMgr->tsIoRefill            = pBwMgr->tsUpdatedLast;
+                pBwMgr->pEpWaiting            = NULL;
 
+                pdmacBwMgrStatsRegister(pBwMgr);
                 pdmacBwMgrLink(pBwMgr);
                 rc = VINF_SUCCESS;
             }
             else
             {
-                rc = VERR_NO_MEMORY;
+                RTStrFree(pBwMgr->pszId);
                 MMR3HeapFree(pBwMgr);
             }
         }
@@ -713,12 +811,57 @@ DECLINLINE(void) pdmacBwMgrRef(PPDMACBWMGR pBwMgr)
     ASMAtomicIncU32(&pBwMgr->cRefs);
 }
 
-DECLINLINE(void) pdmacBwMgrUnref(PPDMACBWMGR pBwMgr)
+DECLINLINE(void) pdmacBwMgrUnref(PPDMACBWMGR pBwMgr, PPDMASYNCCOMPLETIONENDPOINT pEndpoint)
 {
     Assert(pBwMgr->cRefs > 0);
+
+    /* Don't let the other endpoints wait for an endpoint which left the group. */
+    RTCritSectEnter(&pBwMgr->CritSect);
+    if (pBwMgr->pEpWaiting == pEndpoint)
+        pBwMgr->pEpWaiting = NULL;
+    pEndpoint->tsBwThrottled = 0;
+    RTCritSectLeave(&pBwMgr->CritSect);
+
     ASMAtomicDecU32(&pBwMgr->cRefs);
 }
 
+/**
+ * Refills a token bucket of a bandwidth manager.
+ *
+ * @returns nothing.
+ * @param   pcAvail     The tokens available in the bucket.
+ * @param   ptsRefill   The timestamp the bucket was refilled up to.
+ * @param   uRate       Number of tokens added per second.
+ * @param   cBurst      Maximum number of tokens the bucket can hold.
+ * @param   tsNow       The current timestamp.
+ */
+static void pdmacBwMgrBucketRefill(int64_t *pcAvail, uint64_t *ptsRefill, uint32_t uRate, uint32_t cBurst, uint64_t tsNow)
+{
+    /* The clock may lag behind a refill done by another thread on another CPU. */
+    if (tsNow <= *ptsRefill)
+        return;
+    uint64_t cNsElapsed = tsNow - *ptsRefill;
+
+    /* ASMMultU64ByU32DivByU32 uses a 128-bit intermediate, so a long idle
+     * period can't overflow the multiplication. The bucket is capped before
+     * the tokens are added, so the sum can't overflow either. */
+    uint64_t cAdd = ASMMultU64ByU32DivByU32(cNsElapsed, uRate, RT_NS_1SEC);
+    if (cAdd)
+    {
+        if (cAdd >= (uint64_t)((int64_t)cBurst - *pcAvail))
+        {
+            *pcAvail   = cBurst;
+            *ptsRefill = tsNow;
+        }
+        else
+        {
+            *pcAvail += cAdd;
+            /* Keep the fraction of a token for the next round. */
+            *ptsRefill += ASMMultU64ByU32DivByU32(cAdd, RT_NS_1SEC, uRate);
+        }
+    }
+}
+
 bool pdmacEpIsTransferAllowed(PPDMASYNCCOMPLETIONENDPOINT pEndpoint, uint32_t cbTransfer, RTMSINTERVAL *pmsWhenNext)
 {
     bool fAllowed = true;
@@ -728,39 +871,91 @@ bool pdmacEpIsTransferAllowed(PPDMASYNCCOMPLETIONENDPOINT pEndpoint, uint32_t cb
 
     if (pBwMgr)
     {
-        uint32_t cbOld = ASMAtomicSubU32(&pBwMgr->cbTransferAllowed, cbTransfer);
-        if (RT_LIKELY(cbOld >= cbTransfer))
-            fAllowed = true;
-        else
-        {
-            fAllowed = false;
+        RTCritSectEnter(&pBwMgr->CritSect);
 
-            /* We are out of resources  Check if we can update again. */
-            uint64_t tsNow          = RTTimeSystemNanoTS();
-            uint64_t tsUpdatedLast  = ASMAtomicUoReadU64(&pBwMgr->tsUpdatedLast);
+        /* The endpoints of a group run on different I/O manager threads, read
+         * the time under the lock so it never goes back behind the timestamps
+         * the others stored. */
+        uint64_t tsNow = RTTimeSystemNanoTS();
 
-            if (tsNow - tsUpdatedLast >= (1000*1000*1000))
+        /* Increase the rate every second until the maximum is reached. */
+        if (tsNow - pBwMgr->tsUpdatedLast >= RT_NS_1SEC)
+        {
+            pBwMgr->tsUpdatedLast = tsNow;
+            if (pBwMgr->cbTransferPerSecStart < pBwMgr->cbTransferPerSecMax)
             {
-                if (ASMAtomicCmpXchgU64(&pBwMgr->tsUpdatedLast, tsNow, tsUpdatedLast))
-                {
-                    if (pBwMgr->cbTransferPerSecStart < pBwMgr->cbTransferPerSecMax)
-                    {
-                       pBwMgr->cbTransferPerSecStart = RT_MIN(pBwMgr->cbTransferPerSecMax, pBwMgr->cbTransferPerSecStart + pBwMgr->cbTransferPerSecStep);
-                       LogFlow(("AIOMgr: Increasing maximum bandwidth to %u bytes/sec\n", pBwMgr->cbTransferPerSecStart));
-                    }
+               pBwMgr->cbTransferPerSecStart = RT_MIN(pBwMgr->cbTransferPerSecMax, pBwMgr->cbTransferPerSecStart + pBwMgr->cbTransferPerSecStep);
+               LogFlow(("AIOMgr: Increasing maximum bandwidth to %u bytes/sec\n", pBwMgr->cbTransferPerSecStart));
+            }
+        }
 
-                    /* Update */
-                    ASMAtomicWriteU32(&pBwMgr->cbTransferAllowed, pBwMgr->cbTransferPerSecStart - cbTransfer);
-                    fAllowed = true;
-                    LogFlow(("AIOMgr: Refreshed bandwidth\n"));
-                }
+        uint32_t cbPerSec = pBwMgr->cbTransferPerSecStart;
+        uint32_t cIoPerSec = pBwMgr->cIoPerSecMax;
+
+        if (cbPerSec)
+            pdmacBwMgrBucketRefill(&pBwMgr->cbTransferAvail, &pBwMgr->tsBytesRefill, cbPerSec,
+                                   pBwMgr->cbTransferBurst, tsNow);
+        if (cIoPerSec)
+            pdmacBwMgrBucketRefill(&pBwMgr->cIoAvail, &pBwMgr->tsIoRefill, cIoPerSec,
+                                   pBwMgr->cIoBurst, tsNow);
+
+        /*
+         * The endpoint which was throttled first gets the next tokens, the others
+         * have to wait. This prevents a busy endpoint from starving the other
+         * endpoints in the group. The ticket expires if the waiting endpoint
+         * doesn't come back within a second.
+         */
+        if (   pBwMgr->pEpWaiting
+            && pBwMgr->pEpWaiting != pEndpoint
+            && tsNow - pBwMgr->tsEpWaiting < RT_NS_1SEC)
+            fAllowed = false;
+        else
+        {
+            /* A request is allowed as long as there is something left in the buckets so
+             * requests larger than the burst size can proceed. The debt is paid off later. */
+            fAllowed =    (!cbPerSec  || pBwMgr->cbTransferAvail > 0)
+                       && (!cIoPerSec || pBwMgr->cIoAvail > 0);
+        }
+
+        if (fAllowed)
+        {
+            if (cbPerSec)
+                pBwMgr->cbTransferAvail -= cbTransfer;
+            if (cIoPerSec)
+                pBwMgr->cIoAvail--;
+            if (pBwMgr->pEpWaiting == pEndpoint)
+                pBwMgr->pEpWaiting = NULL;
+            if (pEndpoint->tsBwThrottled)
+            {
+                STAM_REL_PROFILE_ADD_PERIOD(&pBwMgr->StatWait, tsNow - pEndpoint->tsBwThrottled);
+                pEndpoint->tsBwThrottled = 0;
             }
-            else
+            STAM_REL_COUNTER_ADD(&pBwMgr->StatBytes, cbTransfer);
+            STAM_REL_COUNTER_INC(&pBwMgr->StatIoOps);
+        }
+        else
+        {
+            /* Calculate when the buckets contain enough tokens again. */
+            uint64_t cNsWait = RT_NS_1MS;
+
+            if (cbPerSec && pBwMgr->cbTransferAvail <= 0)
+                cNsWait = RT_MAX(cNsWait, ASMMultU64ByU32DivByU32(1 - pBwMgr->cbTransferAvail, RT_NS_1SEC, cbPerSec));
+            if (cIoPerSec && pBwMgr->cIoAvail <= 0)
+                cNsWait = RT_MAX(cNsWait, ASMMultU64ByU32DivByU32(1 - pBwMgr->cIoAvail, RT_NS_1SEC, cIoPerSec));
+
+            if (!pBwMgr->pEpWaiting || tsNow - pBwMgr->tsEpWaiting >= RT_NS_1SEC)
             {
-                ASMAtomicAddU32(&pBwMgr->cbTransferAllowed, cbTransfer);
-                *pmsWhenNext = ((1000*1000*1000) - (tsNow - tsUpdatedLast)) / (1000*1000);
+                pBwMgr->pEpWaiting  = pEndpoint;
+                pBwMgr->tsEpWaiting = tsNow;
             }
+            if (!pEndpoint->tsBwThrottled)
+                pEndpoint->tsBwThrottled = tsNow;
+
+            STAM_REL_COUNTER_INC(&pBwMgr->StatThrottled);
+            *pmsWhenNext = (RTMSINTERVAL)RT_MIN((cNsWait + RT_NS_1MS - 1) / RT_NS_1MS, RT_MS_1SEC);
         }
+
+        RTCritSectLeave(&pBwMgr->CritSect);
     }
 
     LogFlowFunc(("fAllowed=%RTbool\n", fAllowed));
@@ -859,7 +1054,7 @@ int pdmR3AsyncCompletionEpClassInit(PVM pVM, PCPDMASYNCCOMPLETIONEPCLASSOPS pEpC
                     {
                         for (PCFGMNODE pCur = CFGMR3GetFirstChild(pCfgBwGrp); pCur; pCur = CFGMR3GetNextChild(pCur))
                         {
-                            uint32_t cbMax, cbStart, cbStep;
+                            uint32_t cbMax, cbStart, cbStep, cbBurst, cIopsMax, cIopsBurst;
                             size_t cchName = CFGMR3GetNameLen(pCur) + 1;
                             char *pszBwGrpId = (char *)RTMemAllocZ(cchName);
 
@@ -879,7 +1074,14 @@ int pdmR3AsyncCompletionEpClassInit(PVM pVM, PCPDMASYNCCOMPLETIONEPCLASSOPS pEpC
                             if (RT_SUCCESS(rc))
                                 rc = CFGMR3QueryU32Def(pCur, "Step", &cbStep, 0);
                             if (RT_SUCCESS(rc))
-                                rc = pdmacAsyncCompletionBwMgrCreate(pEndpointClass, pszBwGrpId, cbMax, cbStart, cbStep);
+                                rc = CFGMR3QueryU32Def(pCur, "Burst", &cbBurst, cbMax);
+                            if (RT_SUCCESS(rc))
+                                rc = CFGMR3QueryU32Def(pCur, "MaxIops", &cIopsMax, 0);
+                            if (RT_SUCCESS(rc))
+                                rc = CFGMR3QueryU32Def(pCur, "BurstIops", &cIopsBurst, cIopsMax);
+                            if (RT_SUCCESS(rc))
+                                rc = pdmacAsyncCompletionBwMgrCreate(pEndpointClass, pszBwGrpId, cbMax, cbStart, cbStep,
+                                                                     RT_MAX(cbBurst, 1), cIopsMax, RT_MAX(cIopsBurst, 1));
 
                             RTMemFree(pszBwGrpId);
 
@@ -934,7 +1136,7 @@ static void pdmR3AsyncCompletionEpClassTerminate(PPDMASYNCCOMPLETIONEPCLASS pEnd
     {
         PPDMACBWMGR pFree = pBwMgr;
         pBwMgr = pBwMgr->pNext;
-        MMR3HeapFree(pFree);
+        pdmacBwMgrDestroy(pFree);
     }
 
     /* Call the termination callback of the class. */
@@ -1020,6 +1222,8 @@ void pdmR3AsyncCompletionResume(PVM pVM)
                 LogRel(("AIOMgr:     Max:   %u B/s\n", pBwMgr->cbTransferPerSecMax));
                 LogRel(("AIOMgr:     Start: %u B/s\n", pBwMgr->cbTransferPerSecStart));
                 LogRel(("AIOMgr:     Step:  %u B/s\n", pBwMgr->cbTransferPerSecStep));
+                LogRel(("AIOMgr:     Burst: %u B\n", pBwMgr->cbTransferBurst));
+                LogRel(("AIOMgr:     IOPS:  %u/s (burst %u)\n", pBwMgr->cIoPerSecMax, pBwMgr->cIoBurst));
                 LogRel(("AIOMgr:     Endpoints:\n"));
 
                 pEp = pEpClass->pEndpointsHead;
@@ -1219,6 +1423,7 @@ VMMR3DECL(int) PDMR3AsyncCompletionEpCreateForFile(PPPDMASYNCCOMPLETIONENDPOINT
             pEndpoint->pszUri            = RTStrDup(pszFilename);
             pEndpoint->cUsers            = 1;
             pEndpoint->pBwMgr            = NULL;
+            pEndpoint->tsBwThrottled     = 0;
 
             if (   pEndpoint->pszUri
                 && RT_SUCCESS(rc))
@@ -1389,6 +1594,11 @@ VMMR3DECL(void) PDMR3AsyncCompletionEpClose(PPDMASYNCCOMPLETIONENDPOINT pEndpoin
         PPDMASYNCCOMPLETIONEPCLASS pEndpointClass = pEndpoint->pEpClass;
         pEndpointClass->pEndpointOps->pfnEpClose(pEndpoint);
 
+        /* Leave the bandwidth group. */
+        PPDMACBWMGR pBwMgr = ASMAtomicXchgPtrT(&pEndpoint->pBwMgr, NULL, PPDMACBWMGR);
+        if (pBwMgr)
+            pdmacBwMgrUnref(pBwMgr, pEndpoint);
+
         /* Drop reference from the template. */
         ASMAtomicDecU32(&pEndpoint->pTemplate->cUsed);
 
@@ -1571,7 +1781,7 @@ VMMR3DECL(int) PDMR3AsyncCompletionEpSetBwMgr(PPDMASYNCCOMPLETIONENDPOINT pEndpo
         pBwMgrOld = ASMAtomicXchgPtrT(&pEndpoint->pBwMgr, pBwMgrNew, PPDMACBWMGR);
 
         if (pBwMgrOld)
-            pdmacBwMgrUnref(pBwMgrOld);
+            pdmacBwMgrUnref(pBwMgrOld, pEndpoint);
     }
 
     return rc;
@@ -1596,10 +1806,15 @@ VMMR3DECL(int) PDMR3AsyncCompletionBwMgrSetMaxForFile(PVM pVM, const char *pcszB
     {
         /*
          * Set the new value for the start and max value to let the manager pick up
-         * the new limit immediately.
+         * the new limit immediately. The burst size is scaled with the limit if it
+         * was not configured separately.
          */
+        RTCritSectEnter(&pBwMgr->CritSect);
+        if (pBwMgr->cbTransferBurst == RT_MAX(pBwMgr->cbTransferPerSecMax, 1))
+            pBwMgr->cbTransferBurst = RT_MAX(cbMaxNew, 1);
         ASMAtomicXchgU32(&pBwMgr->cbTransferPerSecMax, cbMaxNew);
         ASMAtomicXchgU32(&pBwMgr->cbTransferPerSecStart, cbMaxNew);
+        RTCritSectLeave(&pBwMgr->CritSect);
     }
     else
         rc = VERR_NOT_FOUND;
@@ -220,6 +220,9 @@ typedef struct PDMASYNCCOMPLETIONENDPOINT
     uint64_t                                    tsIntervalStartMs;
     uint64_t                                    cIoOpsCompleted;
 #endif
+    /** Timestamp when the bandwidth manager throttled the endpoint first,
+     * 0 if not throttled. Protected by the bandwidth manager. */
+    uint64_t                                    tsBwThrottled;
 } PDMASYNCCOMPLETIONENDPOINT;
 #ifdef VBOX_WITH_STATISTICS
 AssertCompileMemberAlignment(PDMASYNCCOMPLETIONENDPOINT, StatTaskRunTimesNs, sizeof(uint64_t));